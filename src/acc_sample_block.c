@@ -0,0 +1,224 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "acc_sample_block.h"
+
+/* System */
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Other modules */
+#include "debug.h"
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Unpack two interleaved axes
+ *
+ * @param data Interleaved samples
+ * @param length Number of samples per axis
+ * @param x Destination for x axis
+ * @param y Destination for y axis
+ */
+static void acc_sample_block_unpack_2(
+		const guint8 *data,
+		guint length,
+		gint16 *x,
+		gint16 *y);
+
+/**
+ * @brief Unpack three interleaved axes
+ *
+ * @param data Interleaved samples
+ * @param length Number of samples per axis
+ * @param x Destination for x axis
+ * @param y Destination for y axis
+ * @param z Destination for z axis
+ */
+static void acc_sample_block_unpack_3(
+		const guint8 *data,
+		guint length,
+		gint16 *x,
+		gint16 *y,
+		gint16 *z);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+AccSampleBlock *acc_sample_block_new(gint axis_count, guint length)
+{
+	AccSampleBlock *self = NULL;
+	gint i = 0;
+
+	g_return_val_if_fail(axis_count == 2 || axis_count == 3, NULL);
+	g_return_val_if_fail(length > 0, NULL);
+
+	self = g_malloc(sizeof(AccSampleBlock) +
+			axis_count * length * sizeof(gint16));
+	self->ref_count = 1;
+	self->sample_rate = 0;
+	self->zero_level = 0;
+	self->axis_count = axis_count;
+	self->time = 0;
+	self->first_sample = 0;
+	self->length = length;
+
+	for(i = 0; i < ACC_SAMPLE_BLOCK_MAX_AXES; i++)
+	{
+		if(i < axis_count)
+		{
+			self->axis[i] = (gint16 *)(self + 1) + i * length;
+		} else {
+			self->axis[i] = NULL;
+		}
+	}
+
+	return self;
+}
+
+AccSampleBlock *acc_sample_block_ref(AccSampleBlock *self)
+{
+	g_return_val_if_fail(self != NULL, NULL);
+
+	g_atomic_int_inc(&self->ref_count);
+	return self;
+}
+
+void acc_sample_block_unref(AccSampleBlock *self)
+{
+	g_return_if_fail(self != NULL);
+
+	if(g_atomic_int_dec_and_test(&self->ref_count))
+	{
+		g_free(self);
+	}
+}
+
+void acc_sample_block_unpack(AccSampleBlock *self, const guint8 *data)
+{
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(data != NULL);
+
+	if(self->axis_count == 2)
+	{
+		acc_sample_block_unpack_2(data, self->length,
+				self->axis[0], self->axis[1]);
+	} else {
+		acc_sample_block_unpack_3(data, self->length,
+				self->axis[0], self->axis[1], self->axis[2]);
+	}
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static void acc_sample_block_unpack_2(
+		const guint8 *data,
+		guint length,
+		gint16 *x,
+		gint16 *y)
+{
+	guint i = 0;
+#if defined(__ARM_NEON__)
+	uint8x8x2_t samples;
+
+	/* vld2 de-interleaves 8 samples of both axes at a time */
+	for(; i + 8 <= length; i += 8)
+	{
+		samples = vld2_u8(data + 2 * i);
+		vst1q_s16(x + i, vreinterpretq_s16_u16(
+					vmovl_u8(samples.val[0])));
+		vst1q_s16(y + i, vreinterpretq_s16_u16(
+					vmovl_u8(samples.val[1])));
+	}
+#elif defined(__SSE2__)
+	__m128i samples;
+	const __m128i low_bytes = _mm_set1_epi16(0x00FF);
+
+	/* Seen as 16-bit words, the x samples are the low bytes and the
+	 * y samples the high bytes */
+	for(; i + 8 <= length; i += 8)
+	{
+		samples = _mm_loadu_si128((const __m128i *)(data + 2 * i));
+		_mm_storeu_si128((__m128i *)(x + i),
+				_mm_and_si128(samples, low_bytes));
+		_mm_storeu_si128((__m128i *)(y + i),
+				_mm_srli_epi16(samples, 8));
+	}
+#endif
+
+	for(; i < length; i++)
+	{
+		x[i] = data[2 * i];
+		y[i] = data[2 * i + 1];
+	}
+}
+
+static void acc_sample_block_unpack_3(
+		const guint8 *data,
+		guint length,
+		gint16 *x,
+		gint16 *y,
+		gint16 *z)
+{
+	guint i = 0;
+#if defined(__ARM_NEON__)
+	uint8x8x3_t samples;
+
+	for(; i + 8 <= length; i += 8)
+	{
+		samples = vld3_u8(data + 3 * i);
+		vst1q_s16(x + i, vreinterpretq_s16_u16(
+					vmovl_u8(samples.val[0])));
+		vst1q_s16(y + i, vreinterpretq_s16_u16(
+					vmovl_u8(samples.val[1])));
+		vst1q_s16(z + i, vreinterpretq_s16_u16(
+					vmovl_u8(samples.val[2])));
+	}
+#endif
+
+	/* SSE2 has no cheap three-way de-interleave. The loop has no
+	 * dependencies between iterations, so the compiler may vectorize
+	 * it. */
+	for(; i < length; i++)
+	{
+		x[i] = data[3 * i];
+		y[i] = data[3 * i + 1];
+		z[i] = data[3 * i + 2];
+	}
+}
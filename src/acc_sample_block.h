@@ -0,0 +1,122 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _ACC_SAMPLE_BLOCK_H
+#define _ACC_SAMPLE_BLOCK_H
+
+/* Configuration */
+#include "config.h"
+
+/* System */
+#include <sys/time.h>
+
+/* GLib */
+#include <glib.h>
+
+/** @brief Maximum number of axes of an accelerometer */
+#define ACC_SAMPLE_BLOCK_MAX_AXES		3
+
+/**
+ * @brief A block of consecutive accelerometer samples.
+ *
+ * The samples of each axis are stored in their own array (structure of
+ * arrays), so that the consumers can process one axis at a time with
+ * simple loops.
+ *
+ * The blocks are reference counted the same way as #EcgSampleBlock: a
+ * subscriber that needs the samples after its callback has returned must
+ * take a reference. The samples must not be modified.
+ */
+typedef struct _AccSampleBlock {
+	/** @brief Reference count. Use the functions to change it. */
+	volatile gint ref_count;
+
+	/** @brief Sample rate (in Hz) */
+	gint sample_rate;
+
+	/** @brief Value of zero acceleration */
+	gint zero_level;
+
+	/** @brief Number of axes (2 or 3) */
+	gint axis_count;
+
+	/**
+	 * @brief Time of the first sample in the block, in the time base of
+	 * sample_clock.h
+	 */
+	gint64 time;
+
+	/**
+	 * @brief Index of the first sample in the block, counted from the
+	 * beginning of the connection.
+	 */
+	guint64 first_sample;
+
+	/** @brief Number of samples per axis */
+	guint length;
+
+	/**
+	 * @brief The samples of x, y and z axis. The z axis is NULL if
+	 * there are only two axes. The samples are stored right after the
+	 * struct.
+	 */
+	gint16 *axis[ACC_SAMPLE_BLOCK_MAX_AXES];
+} AccSampleBlock;
+
+/**
+ * @brief Create a new sample block with the reference count of 1.
+ *
+ * The samples are not initialized.
+ *
+ * @param axis_count Number of axes (2 or 3)
+ * @param length Number of samples per axis
+ *
+ * @return Newly allocated block
+ */
+AccSampleBlock *acc_sample_block_new(gint axis_count, guint length);
+
+/**
+ * @brief Add a reference to a sample block
+ *
+ * @param self Pointer to #AccSampleBlock
+ *
+ * @return self
+ */
+AccSampleBlock *acc_sample_block_ref(AccSampleBlock *self);
+
+/**
+ * @brief Remove a reference from a sample block. The block is freed when
+ * the last reference is removed.
+ *
+ * @param self Pointer to #AccSampleBlock
+ */
+void acc_sample_block_unref(AccSampleBlock *self);
+
+/**
+ * @brief Fill the block from interleaved 8-bit samples (x, y[, z], x, ...)
+ *
+ * @param self Pointer to #AccSampleBlock
+ * @param data The samples, axis_count * length bytes
+ */
+void acc_sample_block_unpack(AccSampleBlock *self, const guint8 *data);
+
+#endif /* _ACC_SAMPLE_BLOCK_H */
@@ -0,0 +1,572 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "beat_compare.h"
+
+/* System */
+#include <string.h>
+
+/* Other modules */
+#include "osea/ecgcodes.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+/** @brief Class of an annotation that is not a beat */
+#define BEAT_COMPARE_NOT_BEAT			-1
+
+/** @brief Time of the beats after the last one */
+#define BEAT_COMPARE_END_TIME			G_MAXLONG
+
+/*****************************************************************************
+ * Data structures                                                           *
+ *****************************************************************************/
+
+/**
+ * @brief Reading position in the beats of an annotation file. These are the
+ * T, A, T' and A' (or t, a, t' and a') of bxb.
+ */
+typedef struct _BeatCompareStream {
+	const WfdbAnnotation *annotations;
+	guint count;
+	guint position;
+
+	/** @brief Time and class of the current beat */
+	glong time;
+	gint class;
+
+	/** @brief Time and class of the next beat */
+	glong next_time;
+	gint next_class;
+} BeatCompareStream;
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Map an annotation code to an AAMI beat class, as amap() of bxb
+ *
+ * @param type Annotation code
+ *
+ * @return The class, or BEAT_COMPARE_NOT_BEAT
+ */
+static gint beat_compare_map(gint type);
+
+/**
+ * @brief Initialize a stream
+ *
+ * @param stream The stream
+ * @param annotations The annotations
+ * @param count Amount of annotations
+ */
+static void beat_compare_stream_init(
+		BeatCompareStream *stream,
+		const WfdbAnnotation *annotations,
+		guint count);
+
+/**
+ * @brief Move to the next beat, as getref() and gettest() of bxb
+ *
+ * @param stream The stream
+ */
+static void beat_compare_stream_next(BeatCompareStream *stream);
+
+/**
+ * @brief Check whether the reference marks ventricular flutter at a time
+ *
+ * @param reference Reference annotations
+ * @param reference_count Amount of reference annotations
+ * @param time The time
+ *
+ * @return TRUE if the time is between VFON and VFOFF annotations
+ */
+static gboolean beat_compare_in_flutter(
+		const WfdbAnnotation *reference,
+		guint reference_count,
+		glong time);
+
+/**
+ * @brief Count a beat label pair
+ *
+ * @param result The result
+ * @param reference Class of the reference beat
+ * @param test Class of the test beat
+ */
+static void beat_compare_pair(
+		BeatCompareResult *result,
+		gint reference,
+		gint test);
+
+/**
+ * @brief Print a statistic as a percentage, as pstat() of bxb
+ *
+ * @param file The file to print to
+ * @param name Name of the statistic, or NULL to print only the value
+ * @param format Format of the percentage
+ * @param a Numerator
+ * @param b Denominator
+ */
+static void beat_compare_print_statistic(
+		FILE *file,
+		const gchar *name,
+		const gchar *format,
+		gulong a,
+		gulong b);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+void beat_compare(
+		BeatCompareResult *result,
+		const WfdbAnnotation *reference,
+		guint reference_count,
+		const WfdbAnnotation *test,
+		guint test_count,
+		glong start,
+		glong end,
+		glong match_window)
+{
+	BeatCompareStream ref;
+	BeatCompareStream tst;
+
+	g_return_if_fail(result != NULL);
+	g_return_if_fail(reference != NULL || reference_count == 0);
+	g_return_if_fail(test != NULL || test_count == 0);
+	DEBUG_BEGIN();
+
+	beat_compare_stream_init(&ref, reference, reference_count);
+	beat_compare_stream_init(&tst, test, test_count);
+
+	/* The first reference beat of the test period, and the last test
+	 * beat before it */
+	do {
+		beat_compare_stream_next(&ref);
+	} while(ref.time < start);
+
+	do {
+		beat_compare_stream_next(&tst);
+	} while(tst.next_time < start);
+
+	/* The last test beat before the test period may match the first
+	 * reference beat. Otherwise a test beat just after the beginning is
+	 * not counted, if the next one is a better match. */
+	if(ref.time - tst.time < ABS(ref.time - tst.next_time) &&
+			ref.time - tst.time <= match_window)
+	{
+		beat_compare_pair(result, ref.class, tst.class);
+		beat_compare_stream_next(&ref);
+		beat_compare_stream_next(&tst);
+	} else {
+		beat_compare_stream_next(&tst);
+		if(tst.time - start <= match_window &&
+				ABS(ref.time - tst.next_time) <
+				ABS(ref.time - tst.time))
+		{
+			beat_compare_stream_next(&tst);
+		}
+	}
+
+	while((end >= 0 && (ref.time <= end || tst.time <= end)) ||
+			(end < 0 && ref.time != BEAT_COMPARE_END_TIME))
+	{
+		if(tst.time < ref.time)
+		{
+			if(ref.time - tst.time <= match_window &&
+					ref.time - tst.time <
+					ABS(ref.time - tst.next_time))
+			{
+				beat_compare_pair(result, ref.class,
+						tst.class);
+				beat_compare_stream_next(&ref);
+				beat_compare_stream_next(&tst);
+			} else {
+				/* An extra beat */
+				if(!beat_compare_in_flutter(reference,
+							reference_count,
+							tst.time))
+				{
+					beat_compare_pair(result,
+							BEAT_COMPARE_O,
+							tst.class);
+				}
+				beat_compare_stream_next(&tst);
+			}
+		} else {
+			if(tst.time - ref.time <= match_window &&
+					tst.time - ref.time <
+					ABS(tst.time - ref.next_time))
+			{
+				beat_compare_pair(result, ref.class,
+						tst.class);
+				beat_compare_stream_next(&tst);
+				beat_compare_stream_next(&ref);
+			} else {
+				/* A missed beat */
+				beat_compare_pair(result, ref.class,
+						BEAT_COMPARE_O);
+				beat_compare_stream_next(&ref);
+			}
+		}
+	}
+
+	DEBUG_END();
+}
+
+void beat_compare_result_add(
+		BeatCompareResult *self,
+		const BeatCompareResult *other)
+{
+	gint i = 0;
+	gint j = 0;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(other != NULL);
+
+	for(i = 0; i < BEAT_COMPARE_CLASS_COUNT; i++)
+	{
+		for(j = 0; j < BEAT_COMPARE_CLASS_COUNT; j++)
+		{
+			self->counts[i][j] += other->counts[i][j];
+		}
+	}
+}
+
+void beat_compare_result_get_statistics(
+		const BeatCompareResult *self,
+		BeatCompareStatistics *statistics)
+{
+	gint i = 0;
+	gint j = 0;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(statistics != NULL);
+
+	memset(statistics, 0, sizeof(BeatCompareStatistics));
+
+	for(i = 0; i < BEAT_COMPARE_CLASS_COUNT; i++)
+	{
+		for(j = 0; j < BEAT_COMPARE_CLASS_COUNT; j++)
+		{
+			if(i == BEAT_COMPARE_O)
+			{
+				statistics->qrs_false_positives +=
+					self->counts[i][j];
+			} else if(j == BEAT_COMPARE_O) {
+				statistics->qrs_false_negatives +=
+					self->counts[i][j];
+			} else {
+				statistics->qrs_true_positives +=
+					self->counts[i][j];
+			}
+
+			if(i == BEAT_COMPARE_V && j == BEAT_COMPARE_V)
+			{
+				statistics->veb_true_positives +=
+					self->counts[i][j];
+			} else if(i == BEAT_COMPARE_V) {
+				statistics->veb_false_negatives +=
+					self->counts[i][j];
+			} else if(j == BEAT_COMPARE_V) {
+				/* Fusion and unclassifiable beats
+				 * classified as ventricular are not
+				 * counted */
+				if(i == BEAT_COMPARE_N || i == BEAT_COMPARE_O)
+				{
+					statistics->veb_false_positives +=
+						self->counts[i][j];
+				}
+			} else {
+				statistics->veb_true_negatives +=
+					self->counts[i][j];
+			}
+		}
+	}
+}
+
+void beat_compare_print_line_header(FILE *file)
+{
+	g_return_if_fail(file != NULL);
+
+	fprintf(file, "Record    Nn'   Vn'  Fn'  On'   Nv    Vv  Fv'  Ov'"
+			"  No'  Vo'  Fo'   Q Se   Q +P   V Se   V +P"
+			"  V FPR\n");
+}
+
+void beat_compare_print_line(
+		FILE *file,
+		const gchar *name,
+		const BeatCompareResult *self)
+{
+	const gulong (*c)[BEAT_COMPARE_CLASS_COUNT] = NULL;
+	BeatCompareStatistics s;
+
+	g_return_if_fail(file != NULL);
+	g_return_if_fail(name != NULL);
+	g_return_if_fail(self != NULL);
+
+	c = self->counts;
+	beat_compare_result_get_statistics(self, &s);
+
+	fprintf(file, "%-8s %5lu %5lu %4lu %4lu %4lu %5lu %4lu %4lu %4lu"
+			" %4lu %4lu",
+			name,
+			c[BEAT_COMPARE_N][BEAT_COMPARE_N] +
+			c[BEAT_COMPARE_N][BEAT_COMPARE_F] +
+			c[BEAT_COMPARE_N][BEAT_COMPARE_Q],
+			c[BEAT_COMPARE_V][BEAT_COMPARE_N] +
+			c[BEAT_COMPARE_V][BEAT_COMPARE_F] +
+			c[BEAT_COMPARE_V][BEAT_COMPARE_Q],
+			c[BEAT_COMPARE_F][BEAT_COMPARE_N] +
+			c[BEAT_COMPARE_F][BEAT_COMPARE_F] +
+			c[BEAT_COMPARE_F][BEAT_COMPARE_Q] +
+			c[BEAT_COMPARE_Q][BEAT_COMPARE_N] +
+			c[BEAT_COMPARE_Q][BEAT_COMPARE_F] +
+			c[BEAT_COMPARE_Q][BEAT_COMPARE_Q],
+			c[BEAT_COMPARE_O][BEAT_COMPARE_N] +
+			c[BEAT_COMPARE_O][BEAT_COMPARE_F] +
+			c[BEAT_COMPARE_O][BEAT_COMPARE_Q],
+			c[BEAT_COMPARE_N][BEAT_COMPARE_V],
+			c[BEAT_COMPARE_V][BEAT_COMPARE_V],
+			c[BEAT_COMPARE_F][BEAT_COMPARE_V] +
+			c[BEAT_COMPARE_Q][BEAT_COMPARE_V],
+			c[BEAT_COMPARE_O][BEAT_COMPARE_V],
+			c[BEAT_COMPARE_N][BEAT_COMPARE_O],
+			c[BEAT_COMPARE_V][BEAT_COMPARE_O],
+			c[BEAT_COMPARE_F][BEAT_COMPARE_O] +
+			c[BEAT_COMPARE_Q][BEAT_COMPARE_O]);
+
+	beat_compare_print_statistic(file, NULL, "%6.2f",
+			s.qrs_true_positives,
+			s.qrs_true_positives + s.qrs_false_negatives);
+	beat_compare_print_statistic(file, NULL, "%6.2f",
+			s.qrs_true_positives,
+			s.qrs_true_positives + s.qrs_false_positives);
+	beat_compare_print_statistic(file, NULL, "%6.2f",
+			s.veb_true_positives,
+			s.veb_true_positives + s.veb_false_negatives);
+	beat_compare_print_statistic(file, NULL, "%6.2f",
+			s.veb_true_positives,
+			s.veb_true_positives + s.veb_false_positives);
+	beat_compare_print_statistic(file, NULL, "%6.3f",
+			s.veb_false_positives,
+			s.veb_true_negatives + s.veb_false_positives);
+	fprintf(file, "\n");
+}
+
+void beat_compare_print_table(FILE *file, const BeatCompareResult *self)
+{
+	static const gchar names[BEAT_COMPARE_CLASS_COUNT] = {
+		'N', 'V', 'F', 'Q', 'O'
+	};
+	BeatCompareStatistics s;
+	gint i = 0;
+	gint j = 0;
+
+	g_return_if_fail(file != NULL);
+	g_return_if_fail(self != NULL);
+
+	beat_compare_result_get_statistics(self, &s);
+
+	fprintf(file, "               Algorithm\n");
+	fprintf(file, "        n    v    f    q    o\n");
+	fprintf(file, "   __________________________\n");
+	for(i = 0; i < BEAT_COMPARE_CLASS_COUNT; i++)
+	{
+		fprintf(file, " %c |", names[i]);
+		for(j = 0; j < BEAT_COMPARE_CLASS_COUNT; j++)
+		{
+			if(i == BEAT_COMPARE_O && j == BEAT_COMPARE_O)
+			{
+				break;
+			}
+			fprintf(file, " %4lu", self->counts[i][j]);
+		}
+		fprintf(file, "\n");
+	}
+	fprintf(file, "\n");
+
+	beat_compare_print_statistic(file, "           QRS sensitivity",
+			"%6.2f", s.qrs_true_positives,
+			s.qrs_true_positives + s.qrs_false_negatives);
+	beat_compare_print_statistic(file, " QRS positive predictivity",
+			"%6.2f", s.qrs_true_positives,
+			s.qrs_true_positives + s.qrs_false_positives);
+	beat_compare_print_statistic(file, "           VEB sensitivity",
+			"%6.2f", s.veb_true_positives,
+			s.veb_true_positives + s.veb_false_negatives);
+	beat_compare_print_statistic(file, " VEB positive predictivity",
+			"%6.2f", s.veb_true_positives,
+			s.veb_true_positives + s.veb_false_positives);
+	beat_compare_print_statistic(file, "   VEB false positive rate",
+			"%6.3f", s.veb_false_positives,
+			s.veb_true_negatives + s.veb_false_positives);
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static gint beat_compare_map(gint type)
+{
+	switch(type)
+	{
+	case NORMAL:
+	case LBBB:
+	case RBBB:
+	case BBB:
+	case NPC:
+	case APC:
+	case SVPB:
+	case ABERR:
+	case NESC:
+	case AESC:
+	case SVESC:
+		return BEAT_COMPARE_N;
+	case PVC:
+	case RONT:
+	case VESC:
+		return BEAT_COMPARE_V;
+	case FUSION:
+		return BEAT_COMPARE_F;
+	case UNKNOWN:
+	/* Paced records are excluded by the AAMI recommended practice, so
+	 * paced beats are unclassifiable. LEARN should appear only during the
+	 * learning period. */
+	case PACE:
+	case PFUS:
+	case LEARN:
+		return BEAT_COMPARE_Q;
+	default:
+		return BEAT_COMPARE_NOT_BEAT;
+	}
+}
+
+static void beat_compare_stream_init(
+		BeatCompareStream *stream,
+		const WfdbAnnotation *annotations,
+		guint count)
+{
+	stream->annotations = annotations;
+	stream->count = count;
+	stream->position = 0;
+	stream->time = 0;
+	stream->class = BEAT_COMPARE_NOT_BEAT;
+	stream->next_time = 0;
+	stream->next_class = BEAT_COMPARE_NOT_BEAT;
+}
+
+static void beat_compare_stream_next(BeatCompareStream *stream)
+{
+	const WfdbAnnotation *annotation = NULL;
+	gint class = 0;
+
+	stream->time = stream->next_time;
+	stream->class = stream->next_class;
+
+	while(stream->position < stream->count)
+	{
+		annotation = &stream->annotations[stream->position++];
+		class = beat_compare_map(annotation->type);
+		if(class != BEAT_COMPARE_NOT_BEAT)
+		{
+			stream->next_time = annotation->time;
+			stream->next_class = class;
+			return;
+		}
+	}
+
+	stream->next_time = BEAT_COMPARE_END_TIME;
+	stream->next_class = BEAT_COMPARE_NOT_BEAT;
+}
+
+static gboolean beat_compare_in_flutter(
+		const WfdbAnnotation *reference,
+		guint reference_count,
+		glong time)
+{
+	gboolean flutter = FALSE;
+	guint i = 0;
+
+	for(i = 0; i < reference_count && reference[i].time <= time; i++)
+	{
+		if(reference[i].type == VFON)
+		{
+			flutter = TRUE;
+		} else if(reference[i].type == VFOFF) {
+			flutter = FALSE;
+		}
+	}
+	return flutter;
+}
+
+static void beat_compare_pair(
+		BeatCompareResult *result,
+		gint reference,
+		gint test)
+{
+	/* Nothing to count before the first beats of the test period */
+	if(reference == BEAT_COMPARE_NOT_BEAT || test == BEAT_COMPARE_NOT_BEAT)
+	{
+		return;
+	}
+	result->counts[reference][test]++;
+}
+
+static void beat_compare_print_statistic(
+		FILE *file,
+		const gchar *name,
+		const gchar *format,
+		gulong a,
+		gulong b)
+{
+	if(name)
+	{
+		fprintf(file, "%s: ", name);
+		if(b == 0)
+		{
+			fprintf(file, "     - ");
+		} else {
+			fprintf(file, format, (100.0 * a) / b);
+			fprintf(file, "%%");
+		}
+		fprintf(file, " (%lu/%lu)\n", a, b);
+	} else if(b == 0) {
+		fprintf(file, "      -");
+	} else {
+		fprintf(file, " ");
+		fprintf(file, format, (100.0 * a) / b);
+	}
+}
@@ -0,0 +1,156 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _BEAT_COMPARE_H
+#define _BEAT_COMPARE_H
+
+/* Configuration */
+#include "config.h"
+
+/* System */
+#include <stdio.h>
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "wfdb_annotation.h"
+
+/**
+ * @brief Beat classes of the AAMI recommended practice. Supraventricular
+ * beats are counted as normal, as in the default report of bxb.
+ */
+typedef enum _BeatCompareClass {
+	BEAT_COMPARE_N,
+	BEAT_COMPARE_V,
+	BEAT_COMPARE_F,
+	BEAT_COMPARE_Q,
+
+	/** @brief No beat: an extra or a missed beat */
+	BEAT_COMPARE_O,
+
+	BEAT_COMPARE_CLASS_COUNT
+} BeatCompareClass;
+
+/**
+ * @brief Result of a beat-by-beat comparison: the confusion matrix
+ */
+typedef struct _BeatCompareResult {
+	/** @brief Beats by the reference class and the test class */
+	gulong counts[BEAT_COMPARE_CLASS_COUNT][BEAT_COMPARE_CLASS_COUNT];
+} BeatCompareResult;
+
+/**
+ * @brief Detection and classification statistics of a result
+ */
+typedef struct _BeatCompareStatistics {
+	gulong qrs_true_positives;
+	gulong qrs_false_negatives;
+	gulong qrs_false_positives;
+	gulong veb_true_positives;
+	gulong veb_false_negatives;
+	gulong veb_false_positives;
+	gulong veb_true_negatives;
+} BeatCompareStatistics;
+
+/**
+ * @brief Compare test beat annotations with reference annotations
+ *
+ * This is the comparison of the bxb program of the WFDB library (and of
+ * osea/bxbep.c): the beats are paired if they are within the match window
+ * of each other, and every pair, extra beat and missed beat is counted in
+ * the confusion matrix. Unpaired test beats during ventricular flutter in
+ * the reference are not counted. Shutdown periods are not handled.
+ *
+ * @param result Result to add the counts to
+ * @param reference Reference annotations (for example from a .atr file),
+ * in the order of time. Non-beat annotations are allowed.
+ * @param reference_count Amount of reference annotations
+ * @param test Test annotations, in the order of time
+ * @param test_count Amount of test annotations
+ * @param start Beginning of the comparison in samples. The AAMI
+ * recommended practice excludes the first five minutes, during which the
+ * detector learns.
+ * @param end End of the comparison in samples, or -1 to compare until the
+ * end of the reference annotations
+ * @param match_window Match window in samples (usually 150 ms)
+ */
+void beat_compare(
+		BeatCompareResult *result,
+		const WfdbAnnotation *reference,
+		guint reference_count,
+		const WfdbAnnotation *test,
+		guint test_count,
+		glong start,
+		glong end,
+		glong match_window);
+
+/**
+ * @brief Add the counts of a result to another result
+ *
+ * @param self The result to add to
+ * @param other The result to add
+ */
+void beat_compare_result_add(
+		BeatCompareResult *self,
+		const BeatCompareResult *other);
+
+/**
+ * @brief Compute the statistics of a result
+ *
+ * @param self Pointer to #BeatCompareResult
+ * @param statistics Storage for the statistics
+ */
+void beat_compare_result_get_statistics(
+		const BeatCompareResult *self,
+		BeatCompareStatistics *statistics);
+
+/**
+ * @brief Print the header of the line-format report (AAMI RP Table 7
+ * format, as printed by bxb -l)
+ *
+ * @param file The file to print to
+ */
+void beat_compare_print_line_header(FILE *file);
+
+/**
+ * @brief Print a result on one line of the line-format report
+ *
+ * @param file The file to print to
+ * @param name Name of the record
+ * @param self Pointer to #BeatCompareResult
+ */
+void beat_compare_print_line(
+		FILE *file,
+		const gchar *name,
+		const BeatCompareResult *self);
+
+/**
+ * @brief Print the standard report of a result (AAMI RP Table 3 format,
+ * as printed by bxb -s): the confusion matrix and the statistics
+ *
+ * @param file The file to print to
+ * @param self Pointer to #BeatCompareResult
+ */
+void beat_compare_print_table(FILE *file, const BeatCompareResult *self);
+
+#endif /* _BEAT_COMPARE_H */
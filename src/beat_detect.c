@@ -28,50 +28,188 @@
 #include "beat_detect.h"
 
 /* System */
-#if (BEAT_DETECTOR_SIMULATE_HEARTBEAT)
 #include <stdlib.h>
-#endif
 
 /* OSEA */
-#include "osea/bdac.h"
 #include "osea/ecgcodes.h"
+#include "osea/variant.h"
 
 /* Other modules */
+#include "sample_clock.h"
 #include "util.h"
 
 #include "debug.h"
 
 /*****************************************************************************
- * Private function prototypes                                               *
+ * Definitions                                                               *
  *****************************************************************************/
 
-static gboolean _beat_detector_initialized = FALSE;
+/** @brief Amplitude scale that the OSEA library expects */
+#define BEAT_DETECTOR_OSEA_UNITS_PER_MV		200
+
+/** @brief Amount of samples given to OSEA at a time */
+#define BEAT_DETECTOR_OSEA_BLOCK_LENGTH		128
+
+/** @brief Default length of the heart rate variability window in seconds */
+#define BEAT_DETECTOR_DEFAULT_HRV_WINDOW	300
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
 
 static void beat_detector_reset(BeatDetector *self);
 
+/**
+ * @brief Whether there are callbacks of either kind
+ *
+ * @param self Pointer to #BeatDetector
+ */
+static gboolean beat_detector_has_callbacks(BeatDetector *self);
+
+/**
+ * @brief Start receiving data from #EcgData. This is done when the first
+ * callback is added.
+ *
+ * @param self Pointer to #BeatDetector
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean beat_detector_connect(BeatDetector *self, GError **error);
+
+/**
+ * @brief Stop receiving data from #EcgData. This is done when the last
+ * callback is removed.
+ *
+ * @param self Pointer to #BeatDetector
+ */
+static void beat_detector_disconnect(BeatDetector *self);
+
+/**
+ * @brief Find the OSEA build for a sample rate
+ *
+ * @param sample_rate Sample rate in Hz
+ *
+ * @return The OSEA build, or NULL if there is none for the sample rate
+ */
+static const OseaVariant *beat_detector_find_osea_variant(gint sample_rate);
+
+/**
+ * @brief Pass a heart rate from a heart rate monitor to the callbacks
+ *
+ * @param ecg_data Pointer to #EcgData
+ * @param heart_rate Heart rate measured by the heart rate monitor
+ * @param user_data Pointer to #BeatDetector
+ */
+static void beat_detector_heart_rate_arrived(
+		EcgData *ecg_data,
+		gint heart_rate,
+		gpointer user_data);
+
+/**
+ * @brief Pass R-R intervals from a heart rate monitor to the heart rate
+ * variability callbacks
+ *
+ * @param ecg_data Pointer to #EcgData
+ * @param intervals The intervals in milliseconds, oldest first
+ * @param count Amount of intervals
+ * @param user_data Pointer to #BeatDetector
+ */
+static void beat_detector_intervals_arrived(
+		EcgData *ecg_data,
+		const gint *intervals,
+		gint count,
+		gpointer user_data);
+
 /**
  * @brief Analyze ECG data arriving from #EcgData
  *
  * @param ecg_data Pointer to #EcgData
- * @param samples Samples that have arrived
- * @param len Length of data
+ * @param block Samples that have arrived
  * @param user_data Pointer to #BeatDetector
  */
 static void beat_detector_analyze(
 		EcgData *ecg_data,
-		gint heart_rate,
+		EcgSampleBlock *block,
 		gpointer user_data);
 
 /**
- * @brief Calculate mean heart rate and invoke the callbacks.
+ * @brief Give a block of samples to the beat detector, and invoke the
+ * callbacks for the beats that were detected.
+ *
+ * @param self Pointer to #BeatDetector
+ * @param samples The samples, scaled for OSEA
+ * @param length Amount of samples, at most
+ * BEAT_DETECTOR_OSEA_BLOCK_LENGTH
+ */
+static void beat_detector_process_samples(
+		BeatDetector *self,
+		const gint *samples,
+		gint length);
+
+/**
+ * @brief Store the interval of a detected beat and invoke the callbacks
+ *
+ * The sample counters must be up to date with the sample the beat was
+ * detected at.
  *
  * @param self Pointer to #BeatDetector
- * @param beat_interval Beat interval (in samples)
+ * @param beat The beat
+ */
+static void beat_detector_process_beat(
+		BeatDetector *self,
+		const OseaBeat *beat);
+
+/**
+ * @brief Invoke the callbacks.
+ *
+ * @param self Pointer to #BeatDetector
+ * @param heart_rate Heart rate, or -1 if it is not known yet
+ * @param beat_time Time of the beat
  * @param beat_type (as defined by OSEA library)
  */
 static void beat_detector_invoke_callbacks(
 		BeatDetector *self,
-		gint heart_rate);
+		gdouble heart_rate,
+		struct timeval *beat_time,
+		gint beat_type);
+
+/**
+ * @brief Invoke the heart rate variability callbacks with the metrics of
+ * the current window
+ *
+ * @param self Pointer to #BeatDetector
+ * @param beat_time Time of the beat
+ */
+static void beat_detector_invoke_hrv_callbacks(
+		BeatDetector *self,
+		struct timeval *beat_time);
+
+/**
+ * @brief Empty the ring of beat intervals for the mean heart rate
+ *
+ * @param self Pointer to #BeatDetector
+ */
+static void beat_detector_clear_beat_intervals(BeatDetector *self);
+
+/**
+ * @brief Add a beat interval to the ring, replacing the oldest one
+ *
+ * @param self Pointer to #BeatDetector
+ * @param interval The interval in samples
+ */
+static void beat_detector_add_beat_interval(
+		BeatDetector *self,
+		gint interval);
+
+/**
+ * @brief Calculate the mean heart rate from the stored beat intervals
+ *
+ * @param self Pointer to #BeatDetector
+ *
+ * @return Heart rate, or -1 if there are no beat intervals yet
+ */
+static gdouble beat_detector_get_mean_heart_rate(BeatDetector *self);
 
 #if (BEAT_DETECTOR_SIMULATE_HEARTBEAT)
 static void beat_detector_start_simulating_heartbeat(BeatDetector *self);
@@ -79,6 +217,22 @@ static void beat_detector_stop_simulating_heartbeat(BeatDetector *self);
 static gboolean beat_detector_simulated_heartbeat(gpointer user_data);
 #endif
 
+/*****************************************************************************
+ * Static variables                                                          *
+ *****************************************************************************/
+
+/**
+ * @brief The OSEA builds, one for each supported sample rate.
+ *
+ * The time constants of OSEA are fixed at compile time, so the library is
+ * compiled once for every sample rate that the heart rate monitors use.
+ */
+static const OseaVariant *beat_detector_osea_variants[] = {
+	&OseaVariant_150,
+	&OseaVariant_200,
+	&OseaVariant_300
+};
+
 /*****************************************************************************
  * Function declarations                                                     *
  *****************************************************************************/
@@ -95,13 +249,6 @@ BeatDetector *beat_detector_new(EcgData *ecg_data)
 
 	DEBUG_BEGIN();
 
-	if(_beat_detector_initialized)
-	{
-		g_critical("Only one beat detector can be created at the\n"
-				"time because of library constraints");
-		return NULL;
-	}
-
 	self = g_new0(BeatDetector, 1);
 	if(!self)
 	{
@@ -110,16 +257,20 @@ BeatDetector *beat_detector_new(EcgData *ecg_data)
 	}
 
 	self->ecg_data = ecg_data;
+	callback_list_init(&self->callbacks);
+	callback_list_init(&self->hrv_callbacks);
 
 	beat_detector_set_beat_interval_mean_count(self, 20);
-
-	_beat_detector_initialized = TRUE;
+	self->hrv = hrv_window_new(BEAT_DETECTOR_DEFAULT_HRV_WINDOW);
 
 	self->beat_found = FALSE;
 	self->previous_beat_distance = 0;
+	self->previous_beat_type = NORMAL;
 
-	/* Reset the beat detector and classifier */
-	ResetBDAC();
+	/* The detector and classifier state is allocated when the sample
+	 * rate is known */
+	self->osea_variant = NULL;
+	self->osea = NULL;
 
 	DEBUG_END();
 	return self;
@@ -129,19 +280,28 @@ void beat_detector_set_beat_interval_mean_count(
 		BeatDetector *self,
 		guint count)
 {
-	gint i;
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(count > 0);
 
 	DEBUG_BEGIN();
 
+	g_free(self->beat_interval);
 	self->beat_interval = g_new(gint, count);
 	self->beat_interval_count = count;
+	beat_detector_clear_beat_intervals(self);
 
-	for(i = 0; i < count; i++)
-	{
-		self->beat_interval[i] = -1;
-	}
+	DEBUG_END();
+}
+
+void beat_detector_set_hrv_window(BeatDetector *self, guint seconds)
+{
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(seconds > 0);
+
+	DEBUG_BEGIN();
+
+	hrv_window_free(self->hrv);
+	self->hrv = hrv_window_new(seconds);
 
 	DEBUG_END();
 }
@@ -152,37 +312,23 @@ gboolean beat_detector_add_callback(
 		gpointer user_data,
 		GError **error)
 {
-	BeatDetectorCallbackData *cb_data = NULL;
-
 	g_return_val_if_fail(self != NULL, FALSE);
 	g_return_val_if_fail(callback != NULL, FALSE);
 	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
 	DEBUG_BEGIN();
 
-	if(self->callbacks == NULL)
+	if(!beat_detector_has_callbacks(self))
 	{
 		DEBUG_LONG("First callback added. Connecting to EcgData");
-#if (BEAT_DETECTOR_SIMULATE_HEARTBEAT)
-		beat_detector_start_simulating_heartbeat(self);
-#else
-		if(!ecg_data_add_callback_ecg(
-					self->ecg_data,
-					beat_detector_analyze,
-					self,
-					error))
+		if(!beat_detector_connect(self, error))
 		{
-			g_assert(error == NULL || *error != NULL);
+			DEBUG_END();
 			return FALSE;
 		}
-#endif
 	}
 
-	cb_data = g_new0(BeatDetectorCallbackData, 1);
-	cb_data->callback = callback;
-	cb_data->user_data = user_data;
-
-	self->callbacks = g_slist_append(self->callbacks, cb_data);
+	callback_list_add(&self->callbacks, (gpointer)callback, user_data);
 
 	DEBUG_END();
 	return TRUE;
@@ -193,81 +339,75 @@ void beat_detector_remove_callback(
 		BeatDetectorFunc callback,
 		gpointer user_data)
 {
-	GSList *temp = NULL;
-	GSList *indices = NULL;
-	GSList *to_remove = NULL;
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
 
-	gboolean match = TRUE;
-	BeatDetectorCallbackData *cb_data = NULL;
-	gint index = 0;
+	if(callback_list_remove(&self->callbacks, (gpointer)callback,
+				user_data) == 0)
+	{
+		DEBUG_END();
+		return;
+	}
+
+	if(!beat_detector_has_callbacks(self))
+	{
+		DEBUG_LONG("Last callback removed. Removing callback from"
+				"EcgData");
+		beat_detector_disconnect(self);
+	}
+
+	DEBUG_END();
+}
+
+gboolean beat_detector_add_hrv_callback(
+		BeatDetector *self,
+		BeatDetectorHrvFunc callback,
+		gpointer user_data,
+		GError **error)
+{
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(callback != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 
-	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 
-	for(temp = self->callbacks; temp; temp = g_slist_next(temp))
+	if(!beat_detector_has_callbacks(self))
 	{
-		match = TRUE;
-		cb_data = (BeatDetectorCallbackData *)temp->data;
-		if(callback)
-		{
-			if(callback != cb_data->callback)
-			{
-				match = FALSE;
-			}
-		}
-		if(user_data)
-		{
-			if(user_data != cb_data->user_data)
-			{
-				match = FALSE;
-			}
-		}
-		if(match)
+		DEBUG_LONG("First callback added. Connecting to EcgData");
+		if(!beat_detector_connect(self, error))
 		{
-			/* We can't just remove the item, because
-			 * the list may be relocated, which would break the
-			 * looping. Instead, append the index to another
-			 * list */
-			indices = g_slist_append(indices,
-					GINT_TO_POINTER(index));
-			
+			DEBUG_END();
+			return FALSE;
 		}
-		index++;
 	}
 
-	/* Reverse the list of indices, as we must go from end to begin
-	 * to avoid shifting in the list */
-	indices = g_slist_reverse(indices);
+	callback_list_add(&self->hrv_callbacks, (gpointer)callback,
+			user_data);
 
-	for(temp = indices; temp; temp = g_slist_next(temp))
+	DEBUG_END();
+	return TRUE;
+}
+
+void beat_detector_remove_hrv_callback(
+		BeatDetector *self,
+		BeatDetectorHrvFunc callback,
+		gpointer user_data)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(callback_list_remove(&self->hrv_callbacks, (gpointer)callback,
+				user_data) == 0)
 	{
-		index = GPOINTER_TO_INT(temp->data);
-		DEBUG_LONG("Removing callback %d", index);
-		to_remove = g_slist_nth(self->callbacks, index);
-		cb_data = (BeatDetectorCallbackData *)to_remove->data;
-		g_free(cb_data);
-		self->callbacks = g_slist_delete_link(
-				self->callbacks,
-				to_remove);
+		DEBUG_END();
+		return;
 	}
 
-	if(self->callbacks == NULL)
+	if(!beat_detector_has_callbacks(self))
 	{
 		DEBUG_LONG("Last callback removed. Removing callback from"
 				"EcgData");
-
-#if (BEAT_DETECTOR_SIMULATE_HEARTBEAT)
-		beat_detector_stop_simulating_heartbeat(self);
-#else
-		ecg_data_remove_callback_ecg(
-				self->ecg_data,
-				beat_detector_analyze,
-				self);
-
-		/* Reset the beat detector, as there will be a gap in the
-		 * data, or it might come even from a different person */
-		beat_detector_reset(self);
-#endif
+		beat_detector_disconnect(self);
 	}
 
 	DEBUG_END();
@@ -278,8 +418,12 @@ void beat_detector_destroy(BeatDetector *self)
 	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 
+	callback_list_clear(&self->callbacks);
+	callback_list_clear(&self->hrv_callbacks);
+	free(self->osea);
+	g_free(self->beat_interval);
+	hrv_window_free(self->hrv);
 	g_free(self);
-	_beat_detector_initialized = FALSE;
 	DEBUG_END();
 }
 
@@ -295,71 +439,423 @@ static void beat_detector_reset(BeatDetector *self)
 	self->parameters_configured = FALSE;
 	self->previous_beat_distance = 0;
 	self->beat_found = FALSE;
-	ResetBDAC();
+	self->sample_index = 0;
+	beat_detector_clear_beat_intervals(self);
+	hrv_window_reset(self->hrv);
+	if(self->osea)
+	{
+		self->osea_variant->reset(self->osea);
+	}
 
 	DEBUG_END();
 }
 
-static void beat_detector_analyze(
+static gboolean beat_detector_has_callbacks(BeatDetector *self)
+{
+	return !callback_list_is_empty(&self->callbacks) ||
+		!callback_list_is_empty(&self->hrv_callbacks);
+}
+
+static gboolean beat_detector_connect(BeatDetector *self, GError **error)
+{
+#if (BEAT_DETECTOR_SIMULATE_HEARTBEAT)
+	beat_detector_start_simulating_heartbeat(self);
+#else
+	/* Heart rate monitors send the heart rate (and some of them the
+	 * R-R intervals), and ECG monitors send the samples to analyze */
+	if(!ecg_data_add_callback_ecg(
+				self->ecg_data,
+				beat_detector_heart_rate_arrived,
+				self,
+				error))
+	{
+		g_assert(error == NULL || *error != NULL);
+		return FALSE;
+	}
+	if(!ecg_data_add_callback_intervals(
+				self->ecg_data,
+				beat_detector_intervals_arrived,
+				self,
+				error))
+	{
+		g_assert(error == NULL || *error != NULL);
+		ecg_data_remove_callback_ecg(
+				self->ecg_data,
+				beat_detector_heart_rate_arrived,
+				self);
+		return FALSE;
+	}
+	if(!ecg_data_add_callback_samples(
+				self->ecg_data,
+				beat_detector_analyze,
+				self,
+				error))
+	{
+		g_assert(error == NULL || *error != NULL);
+		ecg_data_remove_callback_intervals(
+				self->ecg_data,
+				beat_detector_intervals_arrived,
+				self);
+		ecg_data_remove_callback_ecg(
+				self->ecg_data,
+				beat_detector_heart_rate_arrived,
+				self);
+		return FALSE;
+	}
+#endif
+	return TRUE;
+}
+
+static void beat_detector_disconnect(BeatDetector *self)
+{
+#if (BEAT_DETECTOR_SIMULATE_HEARTBEAT)
+	beat_detector_stop_simulating_heartbeat(self);
+#else
+	ecg_data_remove_callback_samples(
+			self->ecg_data,
+			beat_detector_analyze,
+			self);
+	ecg_data_remove_callback_intervals(
+			self->ecg_data,
+			beat_detector_intervals_arrived,
+			self);
+	ecg_data_remove_callback_ecg(
+			self->ecg_data,
+			beat_detector_heart_rate_arrived,
+			self);
+
+	/* Reset the beat detector, as there will be a gap in the
+	 * data, or it might come even from a different person */
+	beat_detector_reset(self);
+#endif
+}
+
+static const OseaVariant *beat_detector_find_osea_variant(gint sample_rate)
+{
+	guint i = 0;
+
+	for(i = 0; i < G_N_ELEMENTS(beat_detector_osea_variants); i++)
+	{
+		if(beat_detector_osea_variants[i]->sampleRate == sample_rate)
+		{
+			return beat_detector_osea_variants[i];
+		}
+	}
+	return NULL;
+}
+
+static void beat_detector_heart_rate_arrived(
 		EcgData *ecg_data,
 		gint heart_rate,
 		gpointer user_data)
 {
-	gint converted_value = 0;
-	guint i = 0;
-	gint delay = 0;
-	gint beat_type = 0;
-	gint beat_match = 0;
+	struct timeval beat_time;
+	BeatDetector *self = (BeatDetector *)user_data;
 
-	gint beat_interval = 0;
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	sample_clock_to_timeval(ecg_data_get_event_time(ecg_data), &beat_time);
+	beat_detector_invoke_callbacks(self, heart_rate, &beat_time, NORMAL);
+
+	DEBUG_END();
+}
 
+static void beat_detector_intervals_arrived(
+		EcgData *ecg_data,
+		const gint *intervals,
+		gint count,
+		gpointer user_data)
+{
+	struct timeval beat_time;
+	gint64 now = 0;
+	gint64 later_msec = 0;
+	gint i = 0;
 	BeatDetector *self = (BeatDetector *)user_data;
 
 	g_return_if_fail(self != NULL);
-	//g_return_if_fail(samples != NULL);
-	
-	
 	DEBUG_BEGIN();
-	beat_detector_invoke_callbacks(self, heart_rate);
+
+	/* The latest beat is at about the arrival of the packet, and the
+	 * others are the later intervals before it */
+	now = ecg_data_get_event_time(ecg_data);
+	for(i = 0; i < count; i++)
+	{
+		later_msec += intervals[i];
+	}
+
+	for(i = 0; i < count; i++)
+	{
+		later_msec -= intervals[i];
+
+		/* The monitor does not classify the beats */
+		hrv_window_add_interval(self->hrv, intervals[i], TRUE);
+
+		sample_clock_to_timeval(now - later_msec * 1000, &beat_time);
+		beat_detector_invoke_hrv_callbacks(self, &beat_time);
+	}
 
 	DEBUG_END();
 }
 
-static void beat_detector_invoke_callbacks(
-		BeatDetector *self,
-		gint heart_rate)
+static void beat_detector_analyze(
+		EcgData *ecg_data,
+		EcgSampleBlock *block,
+		gpointer user_data)
 {
-	gint i;
-	GSList *temp = NULL;
-	BeatDetectorCallbackData *cb_data = NULL;
-	guint total_interval = 0;
-	guint total_interval_count = 0;
-	//gdouble heart_rate = -1;
-	struct timeval time_since_offset_time;
-	struct timeval beat_time;
+	guint i = 0;
+	gint length = 0;
+	gint samples[BEAT_DETECTOR_OSEA_BLOCK_LENGTH];
+	const OseaVariant *variant = NULL;
+	gpointer osea = NULL;
+	BeatDetector *self = (BeatDetector *)user_data;
 
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(block != NULL);
 	DEBUG_BEGIN();
 
-	
+	if(self->parameters_configured &&
+			(block->sample_rate != self->sample_rate ||
+			 block->first_sample != self->next_sample))
+	{
+		/* There is a gap in the data, or it might come even from a
+		 * different device. Start over. */
+		DEBUG_LONG("Discontinuity in ECG data. Resetting");
+		beat_detector_reset(self);
+	}
 
-	for(temp = self->callbacks; temp; temp = g_slist_next(temp))
+	if(!self->parameters_configured)
 	{
-		cb_data = (BeatDetectorCallbackData *)temp->data;
-		if(cb_data->callback)
+		/* OSEA is built separately for each sample rate */
+		variant = beat_detector_find_osea_variant(block->sample_rate);
+		if(!variant)
 		{
-			gettimeofday(&beat_time, NULL);
-			cb_data->callback(
-					self,
-					heart_rate,
-					&beat_time,
-					NORMAL,
-					cb_data->user_data);
+			g_warning("Unsupported ECG sample rate: %d",
+					block->sample_rate);
+			DEBUG_END();
+			return;
 		}
+		if(variant != self->osea_variant)
+		{
+			/* The beat templates in the context must be aligned
+			 * for the SIMD code of OSEA */
+			free(self->osea);
+			if(posix_memalign(&osea, OSEA_CONTEXT_ALIGNMENT,
+						variant->contextSize) != 0)
+			{
+				g_error("Could not allocate OSEA context");
+			}
+			self->osea = osea;
+			self->osea_variant = variant;
+			self->osea_variant->init(self->osea);
+		}
+		self->sample_rate = block->sample_rate;
+		self->units_per_mv = block->units_per_mv;
+		self->zero_level = block->zero_level;
+		self->sample_index = block->first_sample;
+		self->parameters_configured = TRUE;
+	}
+
+	self->block_time = block->time;
+	self->block_first_sample = block->first_sample;
+	self->next_sample = block->first_sample + block->length;
+
+	for(i = 0; i < block->length; i++)
+	{
+		samples[length++] = (block->samples[i] -
+				(gint)self->zero_level) *
+			BEAT_DETECTOR_OSEA_UNITS_PER_MV /
+			(gint)self->units_per_mv;
+		if(length == BEAT_DETECTOR_OSEA_BLOCK_LENGTH)
+		{
+			beat_detector_process_samples(self, samples, length);
+			length = 0;
+		}
+	}
+	if(length > 0)
+	{
+		beat_detector_process_samples(self, samples, length);
 	}
 
 	DEBUG_END();
 }
 
+static void beat_detector_process_samples(
+		BeatDetector *self,
+		const gint *samples,
+		gint length)
+{
+	gint i = 0;
+	gint count = 0;
+	gint processed = 0;
+	OseaBeat beats[BEAT_DETECTOR_OSEA_BLOCK_LENGTH];
+
+	/* OSEA filters the whole block at once, and returns the beats in
+	 * the order they were detected */
+	count = self->osea_variant->beatDetectAndClassifyBlock(self->osea,
+			samples, length, beats);
+
+	for(i = 0; i < count; i++)
+	{
+		/* Count the samples up to and including the one the beat
+		 * was detected at */
+		self->sample_index += beats[i].index + 1 - processed;
+		self->previous_beat_distance += beats[i].index + 1 - processed;
+		processed = beats[i].index + 1;
+
+		beat_detector_process_beat(self, &beats[i]);
+	}
+
+	self->sample_index += length - processed;
+	self->previous_beat_distance += length - processed;
+}
+
+static void beat_detector_process_beat(
+		BeatDetector *self,
+		const OseaBeat *beat)
+{
+	gint delay = beat->delay;
+	gint rate = self->sample_rate;
+	gint interval = 0;
+	gint interval_ms = 0;
+	gint64 beat_offset = 0;
+	struct timeval beat_time;
+
+	if(self->beat_found)
+	{
+		interval = self->previous_beat_distance - delay;
+		beat_detector_add_beat_interval(self, interval);
+
+		/* Only the intervals between normal beats count for the
+		 * heart rate variability */
+		interval_ms = (interval * 1000 + rate / 2) / rate;
+		hrv_window_add_interval(self->hrv, interval_ms,
+				beat->type == NORMAL &&
+				self->previous_beat_type == NORMAL);
+	}
+	self->previous_beat_distance = delay;
+	self->previous_beat_type = beat->type;
+	self->beat_found = TRUE;
+
+	/* The time comes from the sample clock of the block, not from when
+	 * the beat was processed. The beat may be in an earlier block. */
+	beat_offset = (gint64)(self->sample_index - delay -
+			self->block_first_sample) * G_USEC_PER_SEC / rate;
+	sample_clock_to_timeval(self->block_time + beat_offset, &beat_time);
+
+	beat_detector_invoke_callbacks(self,
+			beat_detector_get_mean_heart_rate(self),
+			&beat_time, beat->type);
+	beat_detector_invoke_hrv_callbacks(self, &beat_time);
+}
+
+static void beat_detector_clear_beat_intervals(BeatDetector *self)
+{
+	gint i;
+
+	for(i = 0; i < self->beat_interval_count; i++)
+	{
+		self->beat_interval[i] = -1;
+	}
+	self->beat_interval_next = 0;
+	self->beat_interval_total = 0;
+	self->beat_interval_valid = 0;
+}
+
+static void beat_detector_add_beat_interval(
+		BeatDetector *self,
+		gint interval)
+{
+	gint *oldest = &self->beat_interval[self->beat_interval_next];
+
+	/* Keep the sum up to date instead of adding up the ring for every
+	 * beat */
+	if(*oldest > 0)
+	{
+		self->beat_interval_total -= *oldest;
+		self->beat_interval_valid--;
+	}
+	*oldest = interval;
+	if(interval > 0)
+	{
+		self->beat_interval_total += interval;
+		self->beat_interval_valid++;
+	}
+
+	self->beat_interval_next = (self->beat_interval_next + 1) %
+		self->beat_interval_count;
+}
+
+static gdouble beat_detector_get_mean_heart_rate(BeatDetector *self)
+{
+	if(self->beat_interval_total == 0)
+	{
+		return -1;
+	}
+
+	return 60.0 * self->sample_rate * self->beat_interval_valid /
+		self->beat_interval_total;
+}
+
+static void beat_detector_invoke_callbacks(
+		BeatDetector *self,
+		gdouble heart_rate,
+		struct timeval *beat_time,
+		gint beat_type)
+{
+	CallbackArray *callbacks = NULL;
+	BeatDetectorFunc callback = NULL;
+	guint i = 0;
+
+	DEBUG_BEGIN();
+
+	callbacks = callback_list_acquire(&self->callbacks);
+	if(!callbacks)
+	{
+		DEBUG_END();
+		return;
+	}
+
+	for(i = 0; i < callbacks->length; i++)
+	{
+		callback = (BeatDetectorFunc)callbacks->entries[i].callback;
+		callback(self, heart_rate, beat_time, beat_type,
+				callbacks->entries[i].user_data);
+	}
+	callback_array_unref(callbacks);
+
+	DEBUG_END();
+}
+
+static void beat_detector_invoke_hrv_callbacks(
+		BeatDetector *self,
+		struct timeval *beat_time)
+{
+	CallbackArray *callbacks = NULL;
+	BeatDetectorHrvFunc callback = NULL;
+	HrvMetrics metrics;
+	guint i = 0;
+
+	callbacks = callback_list_acquire(&self->hrv_callbacks);
+	if(!callbacks)
+	{
+		return;
+	}
+
+	DEBUG_BEGIN();
+
+	hrv_window_get_metrics(self->hrv, &metrics);
+	for(i = 0; i < callbacks->length; i++)
+	{
+		callback = (BeatDetectorHrvFunc)callbacks->entries[i].callback;
+		callback(self, &metrics, beat_time,
+				callbacks->entries[i].user_data);
+	}
+	callback_array_unref(callbacks);
+
+	DEBUG_END();
+}
+
 #if (BEAT_DETECTOR_SIMULATE_HEARTBEAT)
 static void beat_detector_start_simulating_heartbeat(BeatDetector *self)
 {
@@ -393,7 +889,7 @@ static void beat_detector_stop_simulating_heartbeat(BeatDetector *self)
 static gboolean beat_detector_simulated_heartbeat(gpointer user_data)
 {
 	static guint millisecs = 0;
-	gint sample_interval;
+	struct timeval beat_time;
 	BeatDetector *self = (BeatDetector *)user_data;
 
 	g_return_val_if_fail(self != NULL, FALSE);
@@ -405,14 +901,13 @@ static gboolean beat_detector_simulated_heartbeat(gpointer user_data)
 	}
 
 	/* Simulate the heartbeat */
+	sample_clock_to_timeval(sample_clock_now(), &beat_time);
 	if(millisecs)
 	{
-		sample_interval = millisecs * self->sample_rate / 1000;
-		self->sample_count_since_offset_time += sample_interval;
-		beat_detector_invoke_callbacks(self, sample_interval, NORMAL);
+		beat_detector_invoke_callbacks(self, 60000.0 / millisecs,
+				&beat_time, NORMAL);
 	} else {
-		gettimeofday(&self->offset_time, NULL);
-		beat_detector_invoke_callbacks(self, -1, NORMAL);
+		beat_detector_invoke_callbacks(self, -1, &beat_time, NORMAL);
 	}
 
 	/* Add a new timeout after a variable delay */
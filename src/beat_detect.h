@@ -37,7 +37,12 @@
 #include <glib.h>
 
 /* Other modules */
+#include "callback_list.h"
 #include "ecg_data.h"
+#include "hrv.h"
+
+/* OSEA */
+#include "osea/variant.h"
 
 /*****************************************************************************
  * Definitions                                                               *
@@ -67,7 +72,8 @@ typedef struct _BeatDetector BeatDetector;
  *
  * @param self Pointer to #BeatDetector
  * @param heart_rate Heart rate (beats per minute); may be -1 if the
- * heart rate cannot be yet calculated
+ * heart rate cannot be yet calculated, or if the connection to the heart
+ * rate monitor was lost
  * @param time Time when the beat occurred
  * @param user_data User data pointer to be passed to the callback
  * @param beat_type Type of the heart beat, as defined by OSEA library
@@ -89,27 +95,50 @@ typedef void (*BeatDetectorFunc)
 	 gint beat_type,
 	 gpointer user_data);
 
+/**
+ * @brief Type definition for heart rate variability callback
+ *
+ * The callback is invoked for every beat, with the metrics over the heart
+ * rate variability window (see #beat_detector_set_hrv_window). The R-R
+ * intervals are found from the ECG, or taken from the heart rate monitor
+ * if it sends them.
+ *
+ * @param self Pointer to #BeatDetector
+ * @param metrics The metrics. Do not store the pointer.
+ * @param time Time when the beat occurred (see #BeatDetectorFunc)
+ * @param user_data User data pointer to be passed to the callback
+ */
+typedef void (*BeatDetectorHrvFunc)
+	(BeatDetector *self,
+	 const HrvMetrics *metrics,
+	 struct timeval *time,
+	 gpointer user_data);
+
 /*****************************************************************************
  * Data structures                                                           *
  *****************************************************************************/
 
-typedef struct _BeatDetectorCallbackData {
-	BeatDetectorFunc callback;
-	gpointer user_data;
-} BeatDetectorCallbackData;
-
 struct _BeatDetector
 {
 	/** @brief Pointer to #EcgData */
 	EcgData *ecg_data;
 
 	/** @brief List of callbacks */
-	GSList *callbacks;
+	CallbackList callbacks;
+
+	/** @brief List of heart rate variability callbacks */
+	CallbackList hrv_callbacks;
+
+	/** @brief OSEA build for the sample rate of the ECG data */
+	const OseaVariant *osea_variant;
+
+	/** @brief State of the OSEA beat detector and classifier */
+	struct _OseaContext *osea;
 
 	/** @brief Whether or not the sample rate etc. are configured */
 	gboolean parameters_configured;
 
-	/** @brief Sample rate in Hz */
+	/** @brief Sample rate of the ECG data in Hz */
 	guint sample_rate;
 
 	/** @brief How many units per mV */
@@ -127,19 +156,46 @@ struct _BeatDetector
 	 */
 	gint previous_beat_distance;
 
+	/** @brief Type of the previous beat */
+	gint previous_beat_type;
+
 	/**
-	 * @brief The beat intervals in samples
+	 * @brief Ring of the latest beat intervals in samples for the mean
+	 * heart rate, -1 where there is no interval yet
 	 */
 	gint beat_interval_count;
 	gint *beat_interval;
 
-	/** @brief The time stamp from which the sample count is calculated */
-	struct timeval offset_time;
+	/** @brief Index of the oldest beat interval */
+	gint beat_interval_next;
+
+	/** @brief Sum and amount of the beat intervals in the ring */
+	guint beat_interval_total;
+	guint beat_interval_valid;
+
+	/** @brief R-R intervals for the heart rate variability */
+	HrvWindow *hrv;
+
+	/**
+	 * @brief Time of the first sample of the latest block, in the time
+	 * base of sample_clock.h
+	 */
+	gint64 block_time;
+
+	/** @brief Index of the first sample of the latest block */
+	guint64 block_first_sample;
+
+	/**
+	 * @brief Index of the next sample to be given to OSEA. This lags
+	 * behind next_sample while a block is being processed.
+	 */
+	guint64 sample_index;
 
 	/**
-	 * @brief Count of samples since the offset_time
+	 * @brief Index of the next expected ECG sample (see
+	 * #EcgSampleBlock). A different index means that samples were lost.
 	 */
-	guint sample_count_since_offset_time;
+	guint64 next_sample;
 
 #if (BEAT_DETECTOR_SIMULATE_HEARTBEAT)
 	/**
@@ -216,4 +272,49 @@ void beat_detector_set_beat_interval_mean_count(
 		BeatDetector *self,
 		guint count);
 
+/**
+ * @brief Add a callback that will receive heart rate variability metrics.
+ *
+ * The connection to EcgData is established as with
+ * #beat_detector_add_callback, when the first callback of either kind is
+ * added.
+ *
+ * @param self Pointer to #BeatDetector
+ * @param callback Callback to be invoked when a beat is detected
+ * @param user_data Optional user data pointer to be passed to the
+ * 	callback
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure.
+ */
+gboolean beat_detector_add_hrv_callback(
+		BeatDetector *self,
+		BeatDetectorHrvFunc callback,
+		gpointer user_data,
+		GError **error);
+
+/**
+ * @brief Remove a heart rate variability callback
+ *
+ * If a parameter is NULL, it is considered to be a wildcard.
+ *
+ * @param self Pointer to #BeatDetector (must not be NULL)
+ * @param callback Callback function
+ * @param user_data User data that was passed to the callback
+ */
+void beat_detector_remove_hrv_callback(
+		BeatDetector *self,
+		BeatDetectorHrvFunc callback,
+		gpointer user_data);
+
+/**
+ * @brief Set the length of the window for the heart rate variability
+ * metrics. The intervals in the window are discarded.
+ *
+ * @param self Pointer to #BeatDetector
+ * @param seconds Length of the window in seconds (five minutes by
+ * default)
+ */
+void beat_detector_set_hrv_window(BeatDetector *self, guint seconds);
+
 #endif /* _BEAT_DETECT_H */
@@ -0,0 +1,238 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*
+ * Benchmark for the beat classifier of OSEA.
+ *
+ * Synthetic beats of a few morphologies (normal beats, wide premature
+ * ventricular beats and noisy beats, with small shifts) are classified
+ * with Classify(), and the number of beats classified per second is
+ * printed. Most of the time goes to matching each beat against the beat
+ * templates in BestMorphMatch().
+ *
+ * The classifications are summed into a checksum. The template matching
+ * uses SIMD instructions when they are available; build the OSEA library
+ * with -DOSEA_NO_SIMD to get the plain C version, which must give the
+ * same checksum.
+ *
+ * Usage: beat_match_bench [beats]
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* System */
+#include <stdlib.h>
+#include <string.h>
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "osea/ecgcodes.h"
+#include "osea/osea.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define BEAT_MATCH_BENCH_DEFAULT_BEATS		200000
+
+/* Beats generated before classifying, reused cyclically */
+#define BEAT_MATCH_BENCH_BEAT_COUNT		1024
+
+/*****************************************************************************
+ * Data structures                                                           *
+ *****************************************************************************/
+
+typedef struct _BeatMatchBenchBeat {
+	gint samples[TEMPLATE_LGTH];
+
+	/** @brief RR interval before the beat, in samples at SAMPLE_RATE */
+	gint rr;
+} BeatMatchBenchBeat;
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Generate synthetic beats
+ *
+ * The beats are BEATLGTH samples at BEAT_SAMPLE_RATE, in the units that
+ * OSEA expects (200 per mV), with the R-wave at about FIDMARK.
+ *
+ * @param beats Storage for the beats
+ * @param count Amount of beats
+ */
+static void beat_match_bench_generate(BeatMatchBenchBeat *beats, gint count);
+
+/**
+ * @brief Add a triangular wave to a beat
+ *
+ * @param samples The beat
+ * @param center Center of the wave
+ * @param half_width Half of the width of the wave, in samples
+ * @param amplitude Amplitude of the wave
+ */
+static void beat_match_bench_add_wave(
+		gint *samples,
+		gint center,
+		gint half_width,
+		gint amplitude);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+int main(int argc, char **argv)
+{
+	OseaContext *ctx = NULL;
+	BeatMatchBenchBeat *beats = NULL;
+	GTimer *timer = NULL;
+	gint new_beat[TEMPLATE_LGTH];
+	gint count = BEAT_MATCH_BENCH_DEFAULT_BEATS;
+	gint beat_class = 0;
+	gint beat_match = 0;
+	gint fid_adj = 0;
+	gint i = 0;
+	guint64 checksum = 0;
+	gdouble elapsed = 0;
+
+	if(argc > 1)
+	{
+		count = MAX(atoi(argv[1]), 1);
+	}
+
+	beats = g_new(BeatMatchBenchBeat, BEAT_MATCH_BENCH_BEAT_COUNT);
+	beat_match_bench_generate(beats, BEAT_MATCH_BENCH_BEAT_COUNT);
+
+	if(posix_memalign((gpointer *)&ctx, OSEA_CONTEXT_ALIGNMENT,
+				sizeof(OseaContext)) != 0)
+	{
+		g_printerr("Could not allocate OSEA context\n");
+		return 1;
+	}
+	InitBDAC(ctx);
+
+	g_print("%d beats at %d Hz\n", count, BEAT_SAMPLE_RATE);
+
+	timer = g_timer_new();
+	for(i = 0; i < count; i++)
+	{
+		/* Classify() modifies the beat */
+		memcpy(new_beat, beats[i % BEAT_MATCH_BENCH_BEAT_COUNT].samples,
+				sizeof(new_beat));
+		beat_class = Classify(ctx, new_beat,
+				beats[i % BEAT_MATCH_BENCH_BEAT_COUNT].rr, 0,
+				&beat_match, &fid_adj, 0);
+		checksum = checksum * 31 + beat_class * MAXTYPES + beat_match;
+		checksum = checksum * 31 + fid_adj;
+	}
+	elapsed = g_timer_elapsed(timer, NULL);
+
+	g_print("%10s %14s %18s\n", "time (s)", "beats/s", "checksum");
+	g_print("%10.3f %14.0f %18" G_GINT64_MODIFIER "x\n", elapsed,
+			count / elapsed, checksum);
+
+	g_timer_destroy(timer);
+	free(ctx);
+	g_free(beats);
+	return 0;
+}
+
+/*****************************************************************************
+ * Private functions                                                         *
+ *****************************************************************************/
+
+static void beat_match_bench_generate(BeatMatchBenchBeat *beats, gint count)
+{
+	GRand *rand = NULL;
+	gint shift = 0;
+	gint noise = 0;
+	gint kind = 0;
+	gint i = 0;
+	gint j = 0;
+
+	/* Fixed seed, so that every run classifies the same beats */
+	rand = g_rand_new_with_seed(1);
+
+	for(i = 0; i < count; i++)
+	{
+		memset(beats[i].samples, 0, sizeof(beats[i].samples));
+		shift = g_rand_int_range(rand, -BEAT_MS20, BEAT_MS20 + 1);
+		kind = g_rand_int_range(rand, 0, 20);
+		noise = 4;
+
+		if(kind < 16)
+		{
+			/* Normal: narrow QRS complex and a T wave */
+			beat_match_bench_add_wave(beats[i].samples,
+					FIDMARK + shift, BEAT_MS40,
+					g_rand_int_range(rand, 180, 220));
+			beat_match_bench_add_wave(beats[i].samples,
+					FIDMARK + shift + BEAT_MS250,
+					BEAT_MS80, 40);
+			beats[i].rr = SAMPLE_RATE * 4 / 5;
+		} else if(kind < 19) {
+			/* PVC: premature, wide and inverted */
+			beat_match_bench_add_wave(beats[i].samples,
+					FIDMARK + shift, BEAT_MS80,
+					-g_rand_int_range(rand, 250, 300));
+			beat_match_bench_add_wave(beats[i].samples,
+					FIDMARK + shift + BEAT_MS280,
+					BEAT_MS100, 60);
+			beats[i].rr = SAMPLE_RATE / 2;
+		} else {
+			/* Normal beat with muscle noise */
+			beat_match_bench_add_wave(beats[i].samples,
+					FIDMARK + shift, BEAT_MS40, 200);
+			noise = 40;
+			beats[i].rr = SAMPLE_RATE * 4 / 5;
+		}
+
+		for(j = 0; j < BEATLGTH; j++)
+		{
+			beats[i].samples[j] += g_rand_int_range(rand, -noise,
+					noise + 1);
+		}
+	}
+
+	g_rand_free(rand);
+}
+
+static void beat_match_bench_add_wave(
+		gint *samples,
+		gint center,
+		gint half_width,
+		gint amplitude)
+{
+	gint i = 0;
+
+	for(i = MAX(center - half_width, 0);
+			i < MIN(center + half_width, BEATLGTH); i++)
+	{
+		samples[i] += amplitude * (half_width - ABS(i - center)) /
+			half_width;
+	}
+}
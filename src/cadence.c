@@ -0,0 +1,336 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "cadence.h"
+
+/* Other modules */
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define CADENCE_DETECTOR_FRACTION_BITS		8
+
+/*
+ * Time constants of the moving averages as shifts: the new value gets
+ * the weight of 1 / (1 << shift). At 75 Hz, 6 is about 0.85 seconds and
+ * 2 is about 50 ms.
+ */
+#define CADENCE_DETECTOR_BASELINE_SHIFT		6
+#define CADENCE_DETECTOR_SMOOTH_SHIFT		2
+#define CADENCE_DETECTOR_ENVELOPE_SHIFT		6
+#define CADENCE_DETECTOR_INTERVAL_SHIFT		2
+
+/** @brief Smallest peak that is counted as a step, in sensor units */
+#define CADENCE_DETECTOR_MIN_THRESHOLD		2
+
+/** @brief Shortest step interval (250 steps per minute), in ms */
+#define CADENCE_DETECTOR_MIN_INTERVAL_MS	240
+
+/** @brief Longest step interval; after this the runner has stopped */
+#define CADENCE_DETECTOR_MAX_INTERVAL_MS	2000
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Reset the filters and the step counters
+ *
+ * @param self Pointer to #CadenceDetector
+ */
+static void cadence_detector_reset(CadenceDetector *self);
+
+/**
+ * @brief Process accelerometer data arriving from #EcgData
+ *
+ * @param ecg_data Pointer to #EcgData
+ * @param block Samples that have arrived
+ * @param user_data Pointer to #CadenceDetector
+ */
+static void cadence_detector_analyze(
+		EcgData *ecg_data,
+		AccSampleBlock *block,
+		gpointer user_data);
+
+/**
+ * @brief Process one sample
+ *
+ * @param self Pointer to #CadenceDetector
+ * @param magnitude Magnitude of the acceleration (fixed point)
+ */
+static inline void cadence_detector_process_sample(
+		CadenceDetector *self,
+		gint32 magnitude);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+CadenceDetector *cadence_detector_new(EcgData *ecg_data)
+{
+	CadenceDetector *self = NULL;
+
+	g_return_val_if_fail(ecg_data != NULL, NULL);
+	DEBUG_BEGIN();
+
+	self = g_new0(CadenceDetector, 1);
+	self->ecg_data = ecg_data;
+	cadence_detector_reset(self);
+
+	DEBUG_END();
+	return self;
+}
+
+void cadence_detector_destroy(CadenceDetector *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	cadence_detector_stop(self);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+gboolean cadence_detector_start(CadenceDetector *self, GError **error)
+{
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	DEBUG_BEGIN();
+
+	if(self->started)
+	{
+		DEBUG_END();
+		return TRUE;
+	}
+
+	if(!ecg_data_add_callback_acc(self->ecg_data,
+				cadence_detector_analyze,
+				self,
+				error))
+	{
+		DEBUG_END();
+		return FALSE;
+	}
+
+	self->started = TRUE;
+
+	DEBUG_END();
+	return TRUE;
+}
+
+void cadence_detector_stop(CadenceDetector *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(self->started)
+	{
+		ecg_data_remove_callback_acc(self->ecg_data,
+				cadence_detector_analyze,
+				self);
+		self->started = FALSE;
+		cadence_detector_reset(self);
+	}
+
+	DEBUG_END();
+}
+
+gint cadence_detector_get_cadence(CadenceDetector *self)
+{
+	g_return_val_if_fail(self != NULL, -1);
+
+	if(self->sample_rate == 0)
+	{
+		return -1;
+	}
+
+	if(self->step_interval == 0 ||
+			self->samples_since_step * 1000 >
+			CADENCE_DETECTOR_MAX_INTERVAL_MS * self->sample_rate)
+	{
+		return 0;
+	}
+
+	return (60 * self->sample_rate << CADENCE_DETECTOR_FRACTION_BITS) /
+		self->step_interval;
+}
+
+guint cadence_detector_get_step_count(CadenceDetector *self)
+{
+	g_return_val_if_fail(self != NULL, 0);
+	return self->step_count;
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static void cadence_detector_reset(CadenceDetector *self)
+{
+	DEBUG_BEGIN();
+
+	self->sample_rate = 0;
+	self->next_sample = 0;
+	self->baseline = 0;
+	self->smoothed = 0;
+	self->envelope = 0;
+	self->in_peak = FALSE;
+	self->samples_since_step = 0;
+	self->step_interval = 0;
+	self->step_count = 0;
+
+	DEBUG_END();
+}
+
+static void cadence_detector_analyze(
+		EcgData *ecg_data,
+		AccSampleBlock *block,
+		gpointer user_data)
+{
+	CadenceDetector *self = (CadenceDetector *)user_data;
+	const gint16 *x = NULL;
+	const gint16 *y = NULL;
+	const gint16 *z = NULL;
+	gint32 magnitude = 0;
+	guint i = 0;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(block != NULL);
+	DEBUG_BEGIN();
+
+	if(self->sample_rate != block->sample_rate ||
+			self->next_sample != block->first_sample)
+	{
+		/* New connection, or lost data. The filters would see a
+		 * jump, so start over. */
+		cadence_detector_reset(self);
+		self->sample_rate = block->sample_rate;
+	}
+	self->next_sample = block->first_sample + block->length;
+
+	x = block->axis[0];
+	y = block->axis[1];
+	z = block->axis[2];
+
+	/* The sum of absolute values is used as the magnitude. It does not
+	 * need a square root, and it peaks at the same moments. */
+	for(i = 0; i < block->length; i++)
+	{
+		magnitude = ABS(x[i] - block->zero_level) +
+			ABS(y[i] - block->zero_level);
+		if(z)
+		{
+			magnitude += ABS(z[i] - block->zero_level);
+		}
+		cadence_detector_process_sample(self,
+				magnitude << CADENCE_DETECTOR_FRACTION_BITS);
+	}
+
+	DEBUG_END();
+}
+
+static inline void cadence_detector_process_sample(
+		CadenceDetector *self,
+		gint32 magnitude)
+{
+	gint32 threshold = 0;
+	guint interval = 0;
+
+	if(self->baseline == 0)
+	{
+		/* First sample: start the baseline from it instead of
+		 * waiting for it to rise from zero */
+		self->baseline = magnitude;
+	}
+
+	self->baseline += (magnitude - self->baseline) >>
+		CADENCE_DETECTOR_BASELINE_SHIFT;
+	self->smoothed += ((magnitude - self->baseline) - self->smoothed) >>
+		CADENCE_DETECTOR_SMOOTH_SHIFT;
+	self->envelope += (ABS(self->smoothed) - self->envelope) >>
+		CADENCE_DETECTOR_ENVELOPE_SHIFT;
+
+	threshold = MAX(self->envelope / 2,
+			CADENCE_DETECTOR_MIN_THRESHOLD <<
+			CADENCE_DETECTOR_FRACTION_BITS);
+
+	/* Saturate so that the interval checks below cannot overflow */
+	if(self->samples_since_step < G_MAXUINT / 1000)
+	{
+		self->samples_since_step++;
+	}
+
+	if(self->in_peak)
+	{
+		/* The peak ends only when the signal has gone well below
+		 * zero, so that noise at the top is not counted twice */
+		if(self->smoothed < -threshold)
+		{
+			self->in_peak = FALSE;
+		}
+		return;
+	}
+
+	if(self->smoothed <= threshold)
+	{
+		return;
+	}
+
+	interval = self->samples_since_step;
+	if(interval * 1000 < CADENCE_DETECTOR_MIN_INTERVAL_MS *
+			(guint)self->sample_rate)
+	{
+		/* Too soon to be a new step */
+		return;
+	}
+
+	self->in_peak = TRUE;
+	self->step_count++;
+	self->samples_since_step = 0;
+
+	if(interval * 1000 > CADENCE_DETECTOR_MAX_INTERVAL_MS *
+			(guint)self->sample_rate)
+	{
+		/* The first step after a stop. There is no interval yet. */
+		self->step_interval = 0;
+	} else if(self->step_interval == 0) {
+		self->step_interval = interval <<
+			CADENCE_DETECTOR_FRACTION_BITS;
+	} else {
+		self->step_interval += ((gint32)(interval <<
+					CADENCE_DETECTOR_FRACTION_BITS) -
+				self->step_interval) >>
+			CADENCE_DETECTOR_INTERVAL_SHIFT;
+	}
+}
@@ -0,0 +1,155 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _CADENCE_H
+#define _CADENCE_H
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* Configuration */
+#include "config.h"
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "ecg_data.h"
+
+/*****************************************************************************
+ * Data structures                                                           *
+ *****************************************************************************/
+
+/**
+ * @brief Estimates running cadence from accelerometer data
+ *
+ * Every foot strike shows as a peak in the magnitude of the acceleration.
+ * The magnitude is filtered with a few exponential moving averages, and
+ * the peaks are detected with hysteresis against an adaptive threshold.
+ * All of this takes constant time and memory per sample.
+ *
+ * Consider all the fields private.
+ */
+typedef struct _CadenceDetector {
+	/** @brief Pointer to #EcgData */
+	EcgData *ecg_data;
+
+	/** @brief Whether or not receiving data from #EcgData */
+	gboolean started;
+
+	/** @brief Sample rate of the accelerometer data, or 0 if unknown */
+	gint sample_rate;
+
+	/** @brief Index of the next expected sample */
+	guint64 next_sample;
+
+	/*
+	 * Filter state. The values are fixed point numbers with
+	 * CADENCE_DETECTOR_FRACTION_BITS fraction bits.
+	 */
+
+	/** @brief Slow moving average of the magnitude (gravity etc.) */
+	gint32 baseline;
+
+	/** @brief Smoothed magnitude with the baseline removed */
+	gint32 smoothed;
+
+	/** @brief Moving average of the absolute value of smoothed */
+	gint32 envelope;
+
+	/** @brief Whether the signal is above the threshold (in a peak) */
+	gboolean in_peak;
+
+	/** @brief Samples since the previous step */
+	guint samples_since_step;
+
+	/**
+	 * @brief Moving average of the step interval in samples (fixed
+	 * point), or 0 if not known
+	 */
+	gint32 step_interval;
+
+	/** @brief Total number of steps */
+	guint step_count;
+} CadenceDetector;
+
+/*****************************************************************************
+ * Function prototypes                                                       *
+ *****************************************************************************/
+
+/**
+ * @brief Create a new cadence detector
+ *
+ * @param ecg_data Pointer to #EcgData
+ *
+ * @return Newly allocated #CadenceDetector
+ */
+CadenceDetector *cadence_detector_new(EcgData *ecg_data);
+
+/**
+ * @brief Destroy a cadence detector
+ *
+ * @param self Pointer to #CadenceDetector
+ */
+void cadence_detector_destroy(CadenceDetector *self);
+
+/**
+ * @brief Start receiving accelerometer data
+ *
+ * @note Like with all #EcgData callbacks, this connects to the heart rate
+ * monitor if it is not connected yet.
+ *
+ * @param self Pointer to #CadenceDetector
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean cadence_detector_start(CadenceDetector *self, GError **error);
+
+/**
+ * @brief Stop receiving accelerometer data, and reset the detector
+ *
+ * @param self Pointer to #CadenceDetector
+ */
+void cadence_detector_stop(CadenceDetector *self);
+
+/**
+ * @brief Get the current cadence
+ *
+ * @param self Pointer to #CadenceDetector
+ *
+ * @return Cadence in steps per minute, 0 when not moving, or -1 if there
+ * is no accelerometer data
+ */
+gint cadence_detector_get_cadence(CadenceDetector *self);
+
+/**
+ * @brief Get the number of steps since the detector was started
+ *
+ * @param self Pointer to #CadenceDetector
+ *
+ * @return Number of steps
+ */
+guint cadence_detector_get_step_count(CadenceDetector *self);
+
+#endif /* _CADENCE_H */
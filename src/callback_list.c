@@ -0,0 +1,274 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "callback_list.h"
+
+/* System */
+#include <string.h>
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Allocate an array with room for the given number of callbacks
+ *
+ * @param length Number of callbacks, at least one
+ *
+ * @return New array with one reference
+ */
+static CallbackArray *callback_array_new(guint length);
+
+/**
+ * @brief Replace the current array, if it still is the expected one
+ *
+ * @param self Pointer to #CallbackList
+ * @param old The expected current array, referenced by the caller
+ * @param array The new array (the reference is given to the list), or
+ * NULL
+ *
+ * @return TRUE if the array was replaced, FALSE if another thread changed
+ * the list first
+ */
+static gboolean callback_list_swap(
+		CallbackList *self,
+		CallbackArray *old,
+		CallbackArray *array);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+void callback_list_init(CallbackList *self)
+{
+	gint i = 0;
+
+	g_return_if_fail(self != NULL);
+
+	self->array = NULL;
+	for(i = 0; i < CALLBACK_LIST_MAX_READERS; i++)
+	{
+		self->hazards[i] = NULL;
+	}
+}
+
+void callback_list_clear(CallbackList *self)
+{
+	callback_list_remove(self, NULL, NULL);
+}
+
+void callback_list_add(
+		CallbackList *self,
+		gpointer callback,
+		gpointer user_data)
+{
+	CallbackArray *old = NULL;
+	CallbackArray *array = NULL;
+	guint length = 0;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(callback != NULL);
+
+	do {
+		old = callback_list_acquire(self);
+		length = old ? old->length : 0;
+
+		array = callback_array_new(length + 1);
+		if(old)
+		{
+			memcpy(array->entries, old->entries,
+					length * sizeof(CallbackListEntry));
+		}
+		array->entries[length].callback = callback;
+		array->entries[length].user_data = user_data;
+	} while(!callback_list_swap(self, old, array));
+}
+
+guint callback_list_remove(
+		CallbackList *self,
+		gpointer callback,
+		gpointer user_data)
+{
+	CallbackArray *old = NULL;
+	CallbackArray *array = NULL;
+	CallbackListEntry *entry = NULL;
+	guint removed = 0;
+	guint i = 0;
+
+	g_return_val_if_fail(self != NULL, 0);
+
+	do {
+		old = callback_list_acquire(self);
+		if(!old)
+		{
+			return 0;
+		}
+
+		array = callback_array_new(old->length);
+		array->length = 0;
+		for(i = 0; i < old->length; i++)
+		{
+			entry = &old->entries[i];
+			if((callback && callback != entry->callback) ||
+				(user_data && user_data != entry->user_data))
+			{
+				array->entries[array->length++] = *entry;
+			}
+		}
+		removed = old->length - array->length;
+
+		if(removed == 0)
+		{
+			callback_array_unref(array);
+			callback_array_unref(old);
+			return 0;
+		}
+		if(array->length == 0)
+		{
+			callback_array_unref(array);
+			array = NULL;
+		}
+	} while(!callback_list_swap(self, old, array));
+
+	return removed;
+}
+
+gboolean callback_list_is_empty(CallbackList *self)
+{
+	g_return_val_if_fail(self != NULL, TRUE);
+	return g_atomic_pointer_get(&self->array) == NULL;
+}
+
+CallbackArray *callback_list_acquire(CallbackList *self)
+{
+	CallbackArray *array = NULL;
+	gint slot = 0;
+
+	g_return_val_if_fail(self != NULL, NULL);
+
+	for(;;)
+	{
+		array = g_atomic_pointer_get(&self->array);
+		if(!array)
+		{
+			return NULL;
+		}
+
+		/* Announce the array. The slots are only busy for a few
+		 * instructions at a time. */
+		while(!g_atomic_pointer_compare_and_exchange(
+					&self->hazards[slot], NULL, array))
+		{
+			slot = (slot + 1) % CALLBACK_LIST_MAX_READERS;
+		}
+
+		/* If the array is still current, it was not swapped out
+		 * before the announcement, and will not be freed before the
+		 * announcement is withdrawn */
+		if(g_atomic_pointer_get(&self->array) == array)
+		{
+			g_atomic_int_inc(&array->ref_count);
+			g_atomic_pointer_set(&self->hazards[slot], NULL);
+			return array;
+		}
+		g_atomic_pointer_set(&self->hazards[slot], NULL);
+	}
+}
+
+void callback_array_unref(CallbackArray *array)
+{
+	g_return_if_fail(array != NULL);
+
+	if(g_atomic_int_dec_and_test(&array->ref_count))
+	{
+		g_free(array);
+	}
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static CallbackArray *callback_array_new(guint length)
+{
+	CallbackArray *array = NULL;
+
+	array = g_malloc(sizeof(CallbackArray) +
+			(length - 1) * sizeof(CallbackListEntry));
+	array->ref_count = 1;
+	array->length = length;
+
+	return array;
+}
+
+static gboolean callback_list_swap(
+		CallbackList *self,
+		CallbackArray *old,
+		CallbackArray *array)
+{
+	gint i = 0;
+
+	if(!g_atomic_pointer_compare_and_exchange(&self->array, old, array))
+	{
+		if(array)
+		{
+			callback_array_unref(array);
+		}
+		if(old)
+		{
+			callback_array_unref(old);
+		}
+		return FALSE;
+	}
+
+	if(!old)
+	{
+		return TRUE;
+	}
+
+	/* Wait for the threads that are taking a reference to the old
+	 * array. The ones that announce it from now on will see that it is
+	 * not current anymore. A reader may have been preempted in the
+	 * middle, so let it run. */
+	for(i = 0; i < CALLBACK_LIST_MAX_READERS; i++)
+	{
+		while(g_atomic_pointer_get(&self->hazards[i]) == old)
+		{
+			g_thread_yield();
+		}
+	}
+
+	/* Release the reference of the list and the one of the caller */
+	callback_array_unref(old);
+	callback_array_unref(old);
+
+	return TRUE;
+}
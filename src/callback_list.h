@@ -0,0 +1,148 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _CALLBACK_LIST_H
+#define _CALLBACK_LIST_H
+
+/* Configuration */
+#include "config.h"
+
+/* GLib */
+#include <glib.h>
+
+/** @brief Maximum number of threads invoking the callbacks at a time */
+#define CALLBACK_LIST_MAX_READERS		4
+
+/**
+ * @brief A callback function with its user data
+ */
+typedef struct _CallbackListEntry {
+	/** @brief The function, cast to its real type when invoked */
+	gpointer callback;
+	gpointer user_data;
+} CallbackListEntry;
+
+/**
+ * @brief Immutable, reference counted array of callbacks. The entries are
+ * in the order they were added.
+ */
+typedef struct _CallbackArray {
+	volatile gint ref_count;
+	guint length;
+	CallbackListEntry entries[1];
+} CallbackArray;
+
+/**
+ * @brief List of callbacks that can be invoked from any thread while
+ * callbacks are added and removed.
+ *
+ * The callbacks are kept in a #CallbackArray that is never changed.
+ * Adding or removing a callback makes a new array and swaps it in
+ * atomically. Invoking the callbacks takes a reference to the current
+ * array, so callbacks that are removed during the invocation are still
+ * called that one time, and new ones are called from the next invocation
+ * on.
+ *
+ * The array can be freed while a thread is between loading it and taking
+ * the reference. Each invoking thread announces the array it is about to
+ * reference in a hazard pointer, and the thread that swapped the array
+ * out waits until no hazard pointer points to it before releasing it.
+ * The wait only spans a few instructions of the other thread.
+ *
+ * Consider all the fields private.
+ */
+typedef struct _CallbackList {
+	/** @brief The current #CallbackArray, or NULL if there are none */
+	volatile gpointer array;
+
+	/** @brief Arrays that invoking threads are about to reference */
+	volatile gpointer hazards[CALLBACK_LIST_MAX_READERS];
+} CallbackList;
+
+/**
+ * @brief Initialize an empty list
+ *
+ * @param self Pointer to #CallbackList
+ */
+void callback_list_init(CallbackList *self);
+
+/**
+ * @brief Remove all the callbacks
+ *
+ * @param self Pointer to #CallbackList
+ */
+void callback_list_clear(CallbackList *self);
+
+/**
+ * @brief Add a callback to the end of the list
+ *
+ * @param self Pointer to #CallbackList
+ * @param callback The callback function
+ * @param user_data User data pointer passed to the callback
+ */
+void callback_list_add(
+		CallbackList *self,
+		gpointer callback,
+		gpointer user_data);
+
+/**
+ * @brief Remove callbacks from the list
+ *
+ * @param self Pointer to #CallbackList
+ * @param callback The callback function to remove, or NULL to match all
+ * @param user_data User data of the callbacks to remove, or NULL to match
+ * all
+ *
+ * @return Number of callbacks removed
+ */
+guint callback_list_remove(
+		CallbackList *self,
+		gpointer callback,
+		gpointer user_data);
+
+/**
+ * @brief Whether the list is empty
+ *
+ * @param self Pointer to #CallbackList
+ *
+ * @return TRUE if there are no callbacks
+ */
+gboolean callback_list_is_empty(CallbackList *self);
+
+/**
+ * @brief Get a reference to the current callbacks, for invoking them.
+ * Release it with callback_array_unref().
+ *
+ * @param self Pointer to #CallbackList
+ *
+ * @return The callbacks, or NULL if there are none
+ */
+CallbackArray *callback_list_acquire(CallbackList *self);
+
+/**
+ * @brief Release a reference to a #CallbackArray
+ *
+ * @param array Pointer to #CallbackArray
+ */
+void callback_array_unref(CallbackArray *array);
+
+#endif /* _CALLBACK_LIST_H */
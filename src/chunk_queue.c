@@ -0,0 +1,136 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "chunk_queue.h"
+
+/* Other modules */
+#include "debug.h"
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+ChunkQueue *chunk_queue_new(guint min_chunks)
+{
+	ChunkQueue *self = NULL;
+	guint size = 1;
+
+	g_return_val_if_fail(min_chunks > 0, NULL);
+	DEBUG_BEGIN();
+
+	while(size < min_chunks)
+	{
+		size = size << 1;
+	}
+
+	self = g_new0(ChunkQueue, 1);
+	self->chunks = g_new0(ChunkQueueChunk, size);
+	self->size = size;
+	self->mask = size - 1;
+
+	DEBUG_END();
+	return self;
+}
+
+void chunk_queue_free(ChunkQueue *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	g_free(self->chunks);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+ChunkQueueChunk *chunk_queue_get_write_chunk(ChunkQueue *self)
+{
+	guint head;
+	guint tail;
+
+	g_return_val_if_fail(self != NULL, NULL);
+
+	/* Only the producer changes the head, so it can be read without
+	 * synchronization here */
+	head = (guint)self->head;
+	tail = (guint)g_atomic_int_get(&self->tail);
+
+	if(head - tail >= self->size)
+	{
+		return NULL;
+	}
+
+	return &self->chunks[head & self->mask];
+}
+
+void chunk_queue_commit(ChunkQueue *self)
+{
+	g_return_if_fail(self != NULL);
+
+	/* The atomic store makes the chunk contents visible to the consumer
+	 * before the new head */
+	g_atomic_int_set(&self->head, (gint)((guint)self->head + 1));
+}
+
+ChunkQueueChunk *chunk_queue_peek(ChunkQueue *self)
+{
+	guint head;
+	guint tail;
+
+	g_return_val_if_fail(self != NULL, NULL);
+
+	head = (guint)g_atomic_int_get(&self->head);
+	tail = (guint)self->tail;
+
+	if(head == tail)
+	{
+		return NULL;
+	}
+
+	return &self->chunks[tail & self->mask];
+}
+
+void chunk_queue_release(ChunkQueue *self)
+{
+	g_return_if_fail(self != NULL);
+	g_atomic_int_set(&self->tail, (gint)((guint)self->tail + 1));
+}
+
+void chunk_queue_reset(ChunkQueue *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	g_atomic_int_set(&self->head, 0);
+	g_atomic_int_set(&self->tail, 0);
+
+	DEBUG_END();
+}
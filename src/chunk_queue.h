@@ -0,0 +1,136 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _CHUNK_QUEUE_H
+#define _CHUNK_QUEUE_H
+
+/* Configuration */
+#include "config.h"
+
+/* GLib */
+#include <glib.h>
+
+/** @brief Maximum amount of data in one chunk */
+#define CHUNK_QUEUE_CHUNK_SIZE		1024
+
+/**
+ * @brief One slot of the queue
+ */
+typedef struct _ChunkQueueChunk {
+	/** @brief Amount of valid data in the chunk */
+	guint length;
+
+	guint8 data[CHUNK_QUEUE_CHUNK_SIZE];
+} ChunkQueueChunk;
+
+/**
+ * @brief Lock-free queue of byte chunks between exactly one producer
+ * thread and exactly one consumer thread.
+ *
+ * The producer fills the chunk returned by
+ * #chunk_queue_get_write_chunk() in place (for example, by reading from
+ * a socket directly into it) and publishes it with
+ * #chunk_queue_commit(). The consumer looks at the oldest published
+ * chunk with #chunk_queue_peek() and gives it back with
+ * #chunk_queue_release(). No data is copied and no locks are taken.
+ *
+ * Consider all the fields private.
+ */
+typedef struct _ChunkQueue {
+	/** @brief The slots */
+	ChunkQueueChunk *chunks;
+
+	/** @brief Number of slots (a power of two) */
+	guint size;
+
+	/** @brief size - 1 */
+	guint mask;
+
+	/** @brief Number of chunks published, only written by the producer */
+	volatile gint head;
+
+	/** @brief Number of chunks released, only written by the consumer */
+	volatile gint tail;
+} ChunkQueue;
+
+/**
+ * @brief Create a new queue
+ *
+ * @param min_chunks Minimum number of slots. The real number is rounded
+ * up to the next power of two.
+ *
+ * @return Newly allocated queue
+ */
+ChunkQueue *chunk_queue_new(guint min_chunks);
+
+/**
+ * @brief Free a queue
+ *
+ * @param self Pointer to #ChunkQueue
+ */
+void chunk_queue_free(ChunkQueue *self);
+
+/**
+ * @brief Get the next free chunk for writing (producer only)
+ *
+ * @param self Pointer to #ChunkQueue
+ *
+ * @return Pointer to the chunk, or NULL if the queue is full
+ */
+ChunkQueueChunk *chunk_queue_get_write_chunk(ChunkQueue *self);
+
+/**
+ * @brief Publish the chunk returned by #chunk_queue_get_write_chunk()
+ * (producer only)
+ *
+ * @param self Pointer to #ChunkQueue
+ */
+void chunk_queue_commit(ChunkQueue *self);
+
+/**
+ * @brief Get the oldest published chunk (consumer only)
+ *
+ * @param self Pointer to #ChunkQueue
+ *
+ * @return Pointer to the chunk, or NULL if the queue is empty
+ */
+ChunkQueueChunk *chunk_queue_peek(ChunkQueue *self);
+
+/**
+ * @brief Give the chunk returned by #chunk_queue_peek() back to the
+ * producer (consumer only)
+ *
+ * @param self Pointer to #ChunkQueue
+ */
+void chunk_queue_release(ChunkQueue *self);
+
+/**
+ * @brief Empty the queue
+ *
+ * @note This must only be called when neither the producer nor the
+ * consumer is using the queue.
+ *
+ * @param self Pointer to #ChunkQueue
+ */
+void chunk_queue_reset(ChunkQueue *self);
+
+#endif /* _CHUNK_QUEUE_H */
@@ -49,6 +49,7 @@ typedef enum
 {
 	EC_ERROR_BLUETOOTH,
 	EC_ERROR_HRM_NOT_CONFIGURED,
+	EC_ERROR_HRM_NOT_SUPPORTED,
 	EC_ERROR_PIPE,
 	EC_ERROR_FILE,
 	EC_ERROR_FILE_FORMAT,
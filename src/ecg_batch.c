@@ -0,0 +1,660 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*
+ * Offline ECG analyzer for records of PhysioBank databases, such as the
+ * MIT-BIH Arrhythmia Database.
+ *
+ * Every record is split into chunks, which are analyzed with OSEA in a
+ * thread pool, each chunk with its own OSEA context. A chunk is analyzed
+ * from some time before its beginning, so that the detector has learned
+ * the signal when the chunk begins, and the beats found before the
+ * beginning are dropped. The classifier learns for minutes (its dominant
+ * beat monitor spans 180 beats), so the default warm-up is the five minute
+ * learning period of the AAMI recommended practice. The beats of the
+ * chunks are written to an annotation file of the record, and compared
+ * with the reference annotations as bxb of the WFDB library does.
+ *
+ * Records whose sample rate is not one that OSEA is built for are resampled
+ * to the highest rate below theirs (for example 360 Hz to 300 Hz), and the
+ * beat times are converted back.
+ *
+ * Usage: ecoach-ecg-batch [OPTION...] RECORD...
+ *
+ * For example: ecoach-ecg-batch -j 8 mitdb/100 mitdb/101
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* System */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "beat_compare.h"
+#include "ec_error.h"
+#include "wfdb_annotation.h"
+#include "wfdb_record.h"
+
+#include "osea/variant.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define ECG_BATCH_DEFAULT_CHUNK_SECONDS		600
+#define ECG_BATCH_DEFAULT_WARM_UP_SECONDS	300
+#define ECG_BATCH_DEFAULT_START_SECONDS		300
+#define ECG_BATCH_DEFAULT_MATCH_WINDOW_MS	150
+#define ECG_BATCH_DEFAULT_ANNOTATOR		"osea"
+#define ECG_BATCH_DEFAULT_REFERENCE		"atr"
+
+/**
+ * @brief A chunk is analyzed this far past its end, so that the beats near
+ * the end are detected in spite of the detection delay
+ */
+#define ECG_BATCH_TAIL_SECONDS			5
+
+/** @brief Samples given to OSEA at a time */
+#define ECG_BATCH_BLOCK_LENGTH			1024
+
+/**
+ * @brief If the first beat of a chunk is closer than this to the last beat
+ * of the previous chunk, it is dropped (the same beat was found by both)
+ */
+#define ECG_BATCH_MIN_RR_MS			200
+
+/** @brief Units per millivolt that OSEA expects */
+#define ECG_BATCH_OSEA_GAIN			200
+
+/*****************************************************************************
+ * Data structures                                                           *
+ *****************************************************************************/
+
+typedef struct _EcgBatchRecord EcgBatchRecord;
+
+/**
+ * @brief A part of a record that is analyzed with one OSEA context
+ */
+typedef struct _EcgBatchChunk {
+	EcgBatchRecord *record;
+
+	/** @brief The beats of [start, end) belong to this chunk. The times
+	 * are OSEA samples. */
+	glong start;
+	glong end;
+
+	/** @brief The beats (#WfdbAnnotation), in record samples */
+	GArray *beats;
+
+	/** @brief Amount of OSEA samples analyzed, including the warm-up */
+	glong analyzed;
+
+	gboolean failed;
+} EcgBatchChunk;
+
+/**
+ * @brief A record and its chunks
+ */
+struct _EcgBatchRecord {
+	const gchar *path;
+	WfdbRecord *record;
+	gint signal;
+
+	const OseaVariant *variant;
+
+	/** @brief Sample rate of the record */
+	gint sample_rate;
+
+	/** @brief Length of the record resampled to the rate of OSEA */
+	glong osea_length;
+
+	EcgBatchChunk *chunks;
+	gint chunk_count;
+
+	/** @brief All the beats (#WfdbAnnotation), in record samples */
+	GArray *beats;
+};
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Open a record and split it into chunks
+ *
+ * @param self The record to fill in
+ * @param path Path of the record
+ * @param error Return location for errors
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean ecg_batch_record_open(
+		EcgBatchRecord *self,
+		const gchar *path,
+		GError **error);
+
+/**
+ * @brief Free the resources of a record
+ *
+ * @param self The record
+ */
+static void ecg_batch_record_close(EcgBatchRecord *self);
+
+/**
+ * @brief Analyze a chunk. This is the function of the thread pool.
+ *
+ * @param data Pointer to #EcgBatchChunk
+ * @param user_data Not used
+ */
+static void ecg_batch_analyze_chunk(gpointer data, gpointer user_data);
+
+/**
+ * @brief Collect the beats of the chunks of a record
+ *
+ * @param self The record
+ *
+ * @return FALSE if the analysis of a chunk had failed
+ */
+static gboolean ecg_batch_record_merge(EcgBatchRecord *self);
+
+/**
+ * @brief Write the beats of a record to an annotation file, and compare
+ * them with the reference annotations if there are any
+ *
+ * @param self The record
+ * @param result Result to add the comparison to
+ *
+ * @return TRUE if the record was compared
+ */
+static gboolean ecg_batch_record_report(
+		EcgBatchRecord *self,
+		BeatCompareResult *result);
+
+/*****************************************************************************
+ * Static variables                                                          *
+ *****************************************************************************/
+
+static gint ecg_batch_threads = 0;
+static gint ecg_batch_chunk_seconds = ECG_BATCH_DEFAULT_CHUNK_SECONDS;
+static gint ecg_batch_warm_up_seconds = ECG_BATCH_DEFAULT_WARM_UP_SECONDS;
+static gint ecg_batch_signal = 0;
+static gint ecg_batch_start_seconds = ECG_BATCH_DEFAULT_START_SECONDS;
+static gint ecg_batch_match_window_ms = ECG_BATCH_DEFAULT_MATCH_WINDOW_MS;
+static gchar *ecg_batch_annotator = NULL;
+static gchar *ecg_batch_reference = NULL;
+static gchar *ecg_batch_output_directory = NULL;
+
+static const OseaVariant *ecg_batch_osea_variants[] = {
+	&OseaVariant_300,
+	&OseaVariant_200,
+	&OseaVariant_150
+};
+
+static GOptionEntry ecg_batch_options[] = {
+	{ "threads", 'j', 0, G_OPTION_ARG_INT, &ecg_batch_threads,
+		"Analyze N chunks at a time (default: number of processors)",
+		"N" },
+	{ "chunk", 'c', 0, G_OPTION_ARG_INT, &ecg_batch_chunk_seconds,
+		"Split the records into chunks of SECONDS (default: 600)",
+		"SECONDS" },
+	{ "warm-up", 'w', 0, G_OPTION_ARG_INT, &ecg_batch_warm_up_seconds,
+		"Start analyzing a chunk SECONDS before it (default: 300)",
+		"SECONDS" },
+	{ "signal", 's', 0, G_OPTION_ARG_INT, &ecg_batch_signal,
+		"Analyze signal N of the records (default: 0)", "N" },
+	{ "annotator", 'a', 0, G_OPTION_ARG_STRING, &ecg_batch_annotator,
+		"Write the beats to RECORD.NAME (default: osea)", "NAME" },
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME,
+		&ecg_batch_output_directory,
+		"Write the annotation files to DIRECTORY (default: the "
+			"directory of the record)", "DIRECTORY" },
+	{ "reference", 'r', 0, G_OPTION_ARG_STRING, &ecg_batch_reference,
+		"Compare with the annotations in RECORD.NAME (default: atr)",
+		"NAME" },
+	{ "from", 'f', 0, G_OPTION_ARG_INT, &ecg_batch_start_seconds,
+		"Begin the comparison at SECONDS (default: 300)", "SECONDS" },
+	{ "match-window", 'm', 0, G_OPTION_ARG_INT,
+		&ecg_batch_match_window_ms,
+		"Pair beats that are at most MS apart (default: 150)", "MS" },
+	{ NULL }
+};
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context = NULL;
+	GThreadPool *pool = NULL;
+	GTimer *timer = NULL;
+	GError *error = NULL;
+	EcgBatchRecord *records = NULL;
+	BeatCompareResult result;
+	gdouble elapsed = 0;
+	gdouble seconds = 0;
+	glong samples = 0;
+	glong analyzed = 0;
+	glong beats = 0;
+	gint record_count = 0;
+	gint chunk_count = 0;
+	gint compared = 0;
+	gint status = 0;
+	gint i = 0;
+	gint j = 0;
+
+	g_thread_init(NULL);
+
+	context = g_option_context_new("RECORD... - analyze ECG records "
+			"with OSEA");
+	g_option_context_add_main_entries(context, ecg_batch_options, NULL);
+	if(!g_option_context_parse(context, &argc, &argv, &error))
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(context);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	if(argc < 2)
+	{
+		g_printerr("No records given (see %s --help)\n", argv[0]);
+		return 1;
+	}
+	if(ecg_batch_threads < 1)
+	{
+		ecg_batch_threads = MAX(sysconf(_SC_NPROCESSORS_ONLN), 1);
+	}
+	ecg_batch_chunk_seconds = MAX(ecg_batch_chunk_seconds, 1);
+	ecg_batch_warm_up_seconds = MAX(ecg_batch_warm_up_seconds, 0);
+	if(!ecg_batch_annotator)
+	{
+		ecg_batch_annotator = g_strdup(ECG_BATCH_DEFAULT_ANNOTATOR);
+	}
+	if(!ecg_batch_reference)
+	{
+		ecg_batch_reference = g_strdup(ECG_BATCH_DEFAULT_REFERENCE);
+	}
+
+	record_count = argc - 1;
+	records = g_new0(EcgBatchRecord, record_count);
+	for(i = 0; i < record_count; i++)
+	{
+		if(!ecg_batch_record_open(&records[i], argv[i + 1], &error))
+		{
+			g_printerr("%s: %s\n", argv[i + 1], error->message);
+			g_clear_error(&error);
+			status = 1;
+			continue;
+		}
+		chunk_count += records[i].chunk_count;
+		samples += records[i].record->length;
+		seconds += records[i].record->length /
+			records[i].record->sample_rate;
+	}
+
+	pool = g_thread_pool_new(ecg_batch_analyze_chunk, NULL,
+			ecg_batch_threads, TRUE, &error);
+	if(!pool)
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+
+	timer = g_timer_new();
+	for(i = 0; i < record_count; i++)
+	{
+		for(j = 0; j < records[i].chunk_count; j++)
+		{
+			g_thread_pool_push(pool, &records[i].chunks[j], NULL);
+		}
+	}
+
+	/* Wait for all the chunks */
+	g_thread_pool_free(pool, FALSE, TRUE);
+	elapsed = g_timer_elapsed(timer, NULL);
+	g_timer_destroy(timer);
+
+	memset(&result, 0, sizeof(result));
+	beat_compare_print_line_header(stdout);
+	for(i = 0; i < record_count; i++)
+	{
+		if(!records[i].record)
+		{
+			continue;
+		}
+		if(!ecg_batch_record_merge(&records[i]))
+		{
+			g_printerr("%s: analysis failed\n", records[i].path);
+			status = 1;
+			continue;
+		}
+		beats += records[i].beats->len;
+		for(j = 0; j < records[i].chunk_count; j++)
+		{
+			analyzed += records[i].chunks[j].analyzed;
+		}
+		if(ecg_batch_record_report(&records[i], &result))
+		{
+			compared++;
+		}
+	}
+
+	if(compared > 0)
+	{
+		beat_compare_print_line(stdout, "Gross", &result);
+		g_print("\n");
+		beat_compare_print_table(stdout, &result);
+	}
+
+	g_print("\n%d records, %d chunks, %d threads\n", record_count,
+			chunk_count, ecg_batch_threads);
+	g_print("%ld samples (%.1f hours of ECG) in %.3f s\n", samples,
+			seconds / 3600, elapsed);
+	g_print("%ld samples analyzed at the rates of OSEA, including the "
+			"warm-ups\n", analyzed);
+	if(elapsed > 0)
+	{
+		g_print("%.0f samples/s, %.0f x realtime, %.0f beats/s\n",
+				samples / elapsed, seconds / elapsed,
+				beats / elapsed);
+	}
+
+	for(i = 0; i < record_count; i++)
+	{
+		ecg_batch_record_close(&records[i]);
+	}
+	g_free(records);
+	g_free(ecg_batch_annotator);
+	g_free(ecg_batch_reference);
+	g_free(ecg_batch_output_directory);
+
+	return status;
+}
+
+/*****************************************************************************
+ * Private functions                                                         *
+ *****************************************************************************/
+
+static gboolean ecg_batch_record_open(
+		EcgBatchRecord *self,
+		const gchar *path,
+		GError **error)
+{
+	glong chunk_length = 0;
+	gint i = 0;
+
+	self->path = path;
+	self->record = wfdb_record_open(path, error);
+	if(!self->record)
+	{
+		return FALSE;
+	}
+
+	if(ecg_batch_signal >= self->record->signal_count)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"the record has only %d signals",
+				self->record->signal_count);
+		wfdb_record_close(self->record);
+		self->record = NULL;
+		return FALSE;
+	}
+	self->signal = ecg_batch_signal;
+
+	/* The highest rate of OSEA that is not higher than the rate of the
+	 * record */
+	self->sample_rate = (gint)(self->record->sample_rate + 0.5);
+	for(i = 0; i < (gint)G_N_ELEMENTS(ecg_batch_osea_variants); i++)
+	{
+		if(ecg_batch_osea_variants[i]->sampleRate <= self->sample_rate)
+		{
+			self->variant = ecg_batch_osea_variants[i];
+			break;
+		}
+	}
+	if(!self->variant)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"sample rate %d Hz is too low",
+				self->sample_rate);
+		wfdb_record_close(self->record);
+		self->record = NULL;
+		return FALSE;
+	}
+
+	self->osea_length = wfdb_record_get_resampled_length(self->record,
+			self->variant->sampleRate);
+
+	chunk_length = (glong)ecg_batch_chunk_seconds *
+		self->variant->sampleRate;
+	self->chunk_count = (self->osea_length + chunk_length - 1) /
+		chunk_length;
+	self->chunks = g_new0(EcgBatchChunk, self->chunk_count);
+	for(i = 0; i < self->chunk_count; i++)
+	{
+		self->chunks[i].record = self;
+		self->chunks[i].start = i * chunk_length;
+		self->chunks[i].end = MIN((i + 1) * chunk_length,
+				self->osea_length);
+		self->chunks[i].beats = g_array_new(FALSE, FALSE,
+				sizeof(WfdbAnnotation));
+	}
+
+	return TRUE;
+}
+
+static void ecg_batch_record_close(EcgBatchRecord *self)
+{
+	gint i = 0;
+
+	for(i = 0; i < self->chunk_count; i++)
+	{
+		g_array_free(self->chunks[i].beats, TRUE);
+	}
+	g_free(self->chunks);
+	if(self->beats)
+	{
+		g_array_free(self->beats, TRUE);
+	}
+	if(self->record)
+	{
+		wfdb_record_close(self->record);
+	}
+}
+
+static void ecg_batch_analyze_chunk(gpointer data, gpointer user_data)
+{
+	EcgBatchChunk *chunk = (EcgBatchChunk *)data;
+	EcgBatchRecord *record = chunk->record;
+	const OseaVariant *variant = record->variant;
+	struct _OseaContext *ctx = NULL;
+	OseaBeat beats[ECG_BATCH_BLOCK_LENGTH];
+	WfdbAnnotation annotation;
+	gint *samples = NULL;
+	glong from = 0;
+	glong to = 0;
+	glong time = 0;
+	gint length = 0;
+	gint position = 0;
+	gint count = 0;
+	gint i = 0;
+
+	if(posix_memalign((gpointer *)&ctx, OSEA_CONTEXT_ALIGNMENT,
+				variant->contextSize) != 0)
+	{
+		chunk->failed = TRUE;
+		return;
+	}
+	variant->init(ctx);
+
+	from = MAX(chunk->start -
+			(glong)ecg_batch_warm_up_seconds * variant->sampleRate,
+			0);
+	to = MIN(chunk->end +
+			(glong)ECG_BATCH_TAIL_SECONDS * variant->sampleRate,
+			record->osea_length);
+	length = to - from;
+	chunk->analyzed = length;
+	samples = g_new(gint, length);
+	wfdb_record_read_resampled(record->record, record->signal,
+			variant->sampleRate, ECG_BATCH_OSEA_GAIN, from, length,
+			samples);
+
+	annotation.subtype = 0;
+	for(position = 0; position < length;
+			position += ECG_BATCH_BLOCK_LENGTH)
+	{
+		count = variant->beatDetectAndClassifyBlock(ctx,
+				samples + position,
+				MIN(ECG_BATCH_BLOCK_LENGTH, length - position),
+				beats);
+		for(i = 0; i < count; i++)
+		{
+			/* As in easytest.c of OSEA: the sample count up to
+			 * and including the detection, minus the delay */
+			time = from + position + beats[i].index + 1 -
+				beats[i].delay;
+			if(time < chunk->start || time >= chunk->end)
+			{
+				continue;
+			}
+			annotation.time = (glong)((gint64)time *
+					record->sample_rate /
+					variant->sampleRate);
+			annotation.type = beats[i].type;
+			g_array_append_val(chunk->beats, annotation);
+		}
+	}
+
+	g_free(samples);
+	free(ctx);
+}
+
+static gboolean ecg_batch_record_merge(EcgBatchRecord *self)
+{
+	WfdbAnnotation *beat = NULL;
+	glong min_rr = 0;
+	glong previous = 0;
+	gint i = 0;
+	guint j = 0;
+
+	min_rr = (glong)self->sample_rate * ECG_BATCH_MIN_RR_MS / 1000;
+	self->beats = g_array_new(FALSE, FALSE, sizeof(WfdbAnnotation));
+
+	for(i = 0; i < self->chunk_count; i++)
+	{
+		if(self->chunks[i].failed)
+		{
+			return FALSE;
+		}
+		for(j = 0; j < self->chunks[i].beats->len; j++)
+		{
+			beat = &g_array_index(self->chunks[i].beats,
+					WfdbAnnotation, j);
+
+			/* Both chunks may have found the beat at the
+			 * border */
+			if(i > 0 && j == 0 && self->beats->len > 0 &&
+					beat->time - previous < min_rr)
+			{
+				continue;
+			}
+			g_array_append_val(self->beats, *beat);
+			previous = beat->time;
+		}
+	}
+
+	return TRUE;
+}
+
+static gboolean ecg_batch_record_report(
+		EcgBatchRecord *self,
+		BeatCompareResult *result)
+{
+	BeatCompareResult record_result;
+	GArray *reference = NULL;
+	GError *error = NULL;
+	gchar *path = NULL;
+	gchar *name = NULL;
+
+	/* The annotations of the analysis */
+	if(ecg_batch_output_directory)
+	{
+		name = g_strdup_printf("%s.%s", self->record->name,
+				ecg_batch_annotator);
+		path = g_build_filename(ecg_batch_output_directory, name,
+				NULL);
+		g_free(name);
+	} else {
+		path = g_strdup_printf("%s.%s", self->path,
+				ecg_batch_annotator);
+	}
+	if(!wfdb_annotation_write(path,
+				(WfdbAnnotation *)self->beats->data,
+				self->beats->len, &error))
+	{
+		g_printerr("%s\n", error->message);
+		g_clear_error(&error);
+	}
+	g_free(path);
+
+	/* The reference, if there is one */
+	path = g_strdup_printf("%s.%s", self->path, ecg_batch_reference);
+	if(!g_file_test(path, G_FILE_TEST_EXISTS))
+	{
+		g_free(path);
+		return FALSE;
+	}
+	reference = wfdb_annotation_read(path, &error);
+	g_free(path);
+	if(!reference)
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	memset(&record_result, 0, sizeof(record_result));
+	beat_compare(&record_result,
+			(WfdbAnnotation *)reference->data, reference->len,
+			(WfdbAnnotation *)self->beats->data, self->beats->len,
+			(glong)ecg_batch_start_seconds * self->sample_rate,
+			self->record->length,
+			(glong)self->sample_rate * ecg_batch_match_window_ms /
+			1000);
+	g_array_free(reference, TRUE);
+
+	beat_compare_print_line(stdout, self->record->name, &record_result);
+	beat_compare_result_add(result, &record_result);
+
+	return TRUE;
+}
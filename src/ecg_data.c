@@ -32,10 +32,10 @@
 #include <bluetooth/rfcomm.h>
 #include <errno.h>
 #include <fcntl.h>
-#include <sys/time.h>
-#include <sys/select.h>
+#include <poll.h>
 #include <sys/socket.h>
-#include <time.h>
+#include <sys/time.h>
+#include <sys/un.h>
 #include <string.h>			/* for strerror() */
 #include <unistd.h>
 
@@ -54,18 +54,251 @@
 
 #define ECG_CHUNK_HEADER_LEN			6
 #define ECG_PACKET_HEADER_LEN			5
-#define ECG_PACKET_ID_ECG			'\xAA'
-#define ECG_PACKET_ID_ACC_2			'\x55'
-#define ECG_PACKET_ID_ACC_3			'\x56'
-#define ECG_DATA_POLLING_STOP_CHECK_INTERVAL	15
-#define ECG_DATA_READ_BUFFER_SIZE		1024
-#define FRWD_PACKET_SIZE			93
-#define ZEPHYR_PACKET_SIZE			60
+#define ECG_PACKET_ID_ECG			0xAA
+#define ECG_PACKET_ID_ACC_2			0x55
+#define ECG_PACKET_ID_ACC_3			0x56
+#define ECG_DATA_BUFFER_SIZE			16384
+#define ECG_DATA_QUEUE_LENGTH			64
+
+/** @brief Sample rate of the accelerometer of Alive ECG monitors */
+#define ECG_ACC_SAMPLE_RATE			75
+#define ECG_ACC_ZERO_LEVEL			128
+
+/** @brief Records pushed at a time when replaying as fast as possible */
+#define ECG_DATA_REPLAY_BATCH			64
+
+/** @brief How long to wait when the queue is full during a replay (ms) */
+#define ECG_DATA_REPLAY_BACKOFF			10
+
+/* Flags for EcgData.subscriptions */
+#define ECG_DATA_SUBSCRIPTION_HEART_RATE	(1 << 0)
+#define ECG_DATA_SUBSCRIPTION_SAMPLES		(1 << 1)
+#define ECG_DATA_SUBSCRIPTION_ACC		(1 << 2)
+#define ECG_DATA_SUBSCRIPTION_INTERVALS		(1 << 3)
+
+/****************************************************************************
+ * Data structures                                                          *
+ ****************************************************************************/
+
+typedef enum _EcgDataEventType {
+	ECG_DATA_EVENT_HEART_RATE,
+	ECG_DATA_EVENT_SAMPLES,
+	ECG_DATA_EVENT_ACC,
+	ECG_DATA_EVENT_INTERVALS
+} EcgDataEventType;
+
+/**
+ * @brief Decoded data on its way from the ingest worker to the callbacks
+ */
+typedef struct _EcgDataEvent {
+	EcgDataEventType type;
+	gint heart_rate;
+
+	/** @brief #EcgSampleBlock or #AccSampleBlock (owns a reference) */
+	gpointer block;
+
+	/** @brief R-R intervals (for ECG_DATA_EVENT_INTERVALS) */
+	gint intervals[HRM_PROTOCOL_MAX_BEAT_TIMES - 1];
+	gint interval_count;
+
+	/** @brief Time when the event was queued (see sample_clock.h) */
+	gint64 time;
+
+	/** @brief Serial of the connection the event came from */
+	gint connection_serial;
+} EcgDataEvent;
+/****************************************************************************
+ * Static variables                                                         *
+ ****************************************************************************/
+
+static const guint8 ecg_data_sync_mark[] = { 0x00, 0xFE };
+
 /****************************************************************************
  * Private function prototypes                                              *
  ****************************************************************************/
 
 static void ecg_data_invoke_callbacks(EcgData *self, gint heart_rate);
+
+/**
+ * @brief Give a block of samples to all the sample callbacks
+ *
+ * @param self Pointer to #EcgData
+ * @param block The samples
+ */
+static void ecg_data_invoke_sample_callbacks(
+		EcgData *self,
+		EcgSampleBlock *block);
+
+/**
+ * @brief Give a block of accelerometer samples to all the accelerometer
+ * callbacks
+ *
+ * @param self Pointer to #EcgData
+ * @param block The samples
+ */
+static void ecg_data_invoke_acc_callbacks(
+		EcgData *self,
+		AccSampleBlock *block);
+
+/**
+ * @brief Give R-R intervals to all the interval callbacks
+ *
+ * @param self Pointer to #EcgData
+ * @param intervals The intervals
+ * @param count Amount of intervals
+ */
+static void ecg_data_invoke_interval_callbacks(
+		EcgData *self,
+		const gint *intervals,
+		gint count);
+
+/**
+ * @brief Find the R-R intervals of the new beats in a packet, and queue
+ * them for the callbacks. This is called by the ingest worker.
+ *
+ * @param self Pointer to #EcgData
+ * @param packet The packet
+ */
+static void ecg_data_process_beat_times(
+		EcgData *self,
+		const HrmProtocolPacket *packet);
+
+/**
+ * @brief Update the subscription flags after the callback lists have
+ * changed
+ *
+ * @param self Pointer to #EcgData
+ */
+static void ecg_data_update_subscriptions(EcgData *self);
+
+/**
+ * @brief Queue decoded data for the callbacks. This is called by the
+ * ingest worker.
+ *
+ * @param self Pointer to #EcgData
+ * @param type Type of the data
+ * @param heart_rate The heart rate (for ECG_DATA_EVENT_HEART_RATE)
+ * @param block The samples. The reference is passed to the event.
+ */
+static void ecg_data_post_event(
+		EcgData *self,
+		EcgDataEventType type,
+		gint heart_rate,
+		gpointer block);
+
+/**
+ * @brief Queue an event for the callbacks, and schedule its delivery
+ *
+ * @param self Pointer to #EcgData
+ * @param event The event. It is freed after the delivery.
+ */
+static void ecg_data_queue_event(EcgData *self, EcgDataEvent *event);
+
+/**
+ * @brief Free an event and release its samples
+ *
+ * @param event The event
+ */
+static void ecg_data_free_event(EcgDataEvent *event);
+
+/**
+ * @brief Give all the queued decoded data to the callbacks.
+ *
+ * This is run in the main loop. The ingest worker schedules it once per
+ * batch of data, not for every event.
+ *
+ * @param user_data Pointer to #EcgData
+ *
+ * @return Always FALSE
+ */
+static gboolean ecg_data_deliver(gpointer user_data);
+
+/**
+ * @brief Check whether the event that is being delivered came from the
+ * current connection.
+ *
+ * A callback can close the connection (by removing the last callback) or
+ * open a new one, so this is checked again before every callback.
+ *
+ * @param self Pointer to #EcgData
+ *
+ * @return TRUE if the event can still be delivered
+ */
+static gboolean ecg_data_event_is_current(EcgData *self);
+
+/**
+ * @brief Check whether there are callbacks of any kind
+ *
+ * @param self Pointer to #EcgData
+ *
+ * @return TRUE if there is at least one callback
+ */
+static gboolean ecg_data_has_callbacks(EcgData *self);
+
+/**
+ * @brief Select the protocol and connect to the ECG monitor.
+ *
+ * This is called when the first callback (of any kind) is added.
+ *
+ * @param self Pointer to #EcgData
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean ecg_data_start(EcgData *self, GError **error);
+
+/**
+ * @brief Select the protocol and set up the frame scanner for it
+ *
+ * @param self Pointer to #EcgData
+ * @param bluetooth_name Bluetooth name of the heart rate monitor
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE if the heart rate monitor is not
+ * supported
+ */
+static gboolean ecg_data_set_protocol(
+		EcgData *self,
+		const gchar *bluetooth_name,
+		GError **error);
+
+/**
+ * @brief Forget all unparsed data and the parser state.
+ *
+ * This is done whenever a new connection is established.
+ *
+ * @param self Pointer to #EcgData
+ */
+static void ecg_data_reset_parser(EcgData *self);
+
+/**
+ * @brief Forget the position of the parser in the stream, but keep the
+ * unparsed data. The parser synchronizes again on the next header.
+ *
+ * This is done when data has been dropped from the buffer, as the
+ * partly parsed chunk or packet is not there anymore.
+ *
+ * @param self Pointer to #EcgData
+ */
+static void ecg_data_resynchronize_parser(EcgData *self);
+
+/**
+ * @brief Connect to the heart rate monitor, or start replaying a capture
+ * file if one has been configured.
+ *
+ * @param self Pointer to #EcgData
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean ecg_data_connect(EcgData *self, GError **error);
+
+/**
+ * @brief Disconnect from the heart rate monitor, or stop replaying
+ *
+ * @param self Pointer to #EcgData
+ */
+static void ecg_data_disconnect(EcgData *self);
 static void ecg_data_process(EcgData *self);
 static gboolean ecg_data_process_data_chunk(EcgData *self);
 static gint ecg_data_process_data_block(EcgData *self);
@@ -75,44 +308,173 @@ static gboolean ecg_data_synchronize(EcgData *self, gboolean force);
 static void ecg_data_pop(EcgData *self, guint len, guint8 *checksum);
 
 static gboolean ecg_data_connect_bluetooth(EcgData *self, GError **error);
+
+/**
+ * @brief Connect to the Unix domain socket set with #ecg_data_set_socket()
+ * and start polling it as the RFCOMM socket
+ *
+ * @param self Pointer to #EcgData
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean ecg_data_connect_socket(EcgData *self, GError **error);
 static void ecg_data_disconnect_bluetooth(EcgData *self);
 static void ecg_data_wait_for_disconnect(EcgData *self);
-static gboolean ecg_data_setup_serial_pipe(EcgData *self, GError **error);
-static gboolean frwd_parse_heartrate(EcgData *self,gchar* frwd);
-static gboolean zephyr_parse_heartrate(EcgData *self,gchar* zephyr);
+
 /**
- * @brief Remove unnecessary voltage data from the array.
+ * @brief Get the connection status
+ *
+ * This can be called from any thread without locking.
  *
  * @param self Pointer to #EcgData
- * @param len Amount of bytes to remove
  *
- * @todo Do this automatically, as no single data getter can remove
- * data anymore (others need it, too)
+ * @return Current connection status
+ */
+static EcgDataConnectionStatus ecg_data_get_connection_status(EcgData *self);
+
+/**
+ * @brief Change the connection status and wake up everyone waiting for
+ * it to change
+ *
+ * @param self Pointer to #EcgData
+ * @param status New connection status
+ */
+static void ecg_data_set_connection_status(
+		EcgData *self,
+		EcgDataConnectionStatus status);
+
+/**
+ * @brief Create a non-blocking pipe
+ *
+ * @param fds Return location for the file descriptors
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean ecg_data_create_wakeup_pipe(gint fds[2]);
+
+/**
+ * @brief Read away all the pending wakeups from the wakeup pipe
+ *
+ * @param self Pointer to #EcgData
  */
-static void ecg_data_dispose_voltage_data(EcgData *self, guint len);
+static void ecg_data_clear_poller_wakeup(EcgData *self);
+static gboolean ecg_data_start_polling(EcgData *self, GError **error);
 
+/**
+ * @brief Start the ingest worker for a new connection
+ *
+ * The queue must be empty and the parser reset.
+ *
+ * @param self Pointer to #EcgData
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean ecg_data_start_ingest(EcgData *self, GError **error);
 
 /**
- * @brief Read data from rfcomm socket and push it into a pipe.
+ * @brief Stop the ingest worker and wait for it to exit.
+ *
+ * The worker parses everything that is still in the queue before it
+ * exits, so the producer must have stopped already.
  *
  * @param self Pointer to #EcgData
+ */
+static void ecg_data_stop_ingest(EcgData *self);
+
+/**
+ * @brief Tell the ingest worker that data has been committed to the queue
  *
- * @returns FALSE on critical error, TRUE otherwise.
+ * @param self Pointer to #EcgData
  */
-static gboolean ecg_data_read_and_push_bluetooth_data(EcgData *self);
+static void ecg_data_notify_ingest(EcgData *self);
 
-static gpointer ecg_data_bluetooth_poller(gpointer user_data);
+/**
+ * @brief The ingest worker: parses the queued data of one connection
+ *
+ * @param user_data Pointer to #EcgData
+ *
+ * @return NULL
+ */
+static gpointer ecg_data_ingest_worker(gpointer user_data);
+
+/**
+ * @brief Start capturing the data read from the heart rate monitor, if
+ * a capture file has been configured
+ *
+ * @param self Pointer to #EcgData
+ */
+static void ecg_data_start_capture(EcgData *self);
+
+/**
+ * @brief Start replaying a capture file instead of reading from the
+ * heart rate monitor
+ *
+ * @param self Pointer to #EcgData
+ * @param path Path of the capture file
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean ecg_data_start_replay(
+		EcgData *self,
+		const gchar *path,
+		GError **error);
+
+/**
+ * @brief Stop the replay and report how fast it was
+ *
+ * @param self Pointer to #EcgData
+ */
+static void ecg_data_stop_replay(EcgData *self);
+
+/**
+ * @brief Queue the next records of the capture file.
+ *
+ * In a real time replay, this is run with a timeout when the next record
+ * is due. Otherwise it is run whenever the main loop is idle, and it
+ * queues a batch of records at a time.
+ *
+ * @param user_data Pointer to #EcgData
+ *
+ * @return Always FALSE. The replay schedules itself again.
+ */
+static gboolean ecg_data_replay(gpointer user_data);
+
+/**
+ * @brief Schedule the replay to be run again
+ *
+ * @param self Pointer to #EcgData
+ * @param delay Delay in milliseconds. Without a delay, a fast replay is
+ * run when the main loop is idle.
+ */
+static void ecg_data_schedule_replay(EcgData *self, guint delay);
+
+/**
+ * @brief Copy the pending record of the replay to the queue
+ *
+ * @param self Pointer to #EcgData
+ *
+ * @return TRUE if the whole record was queued, FALSE if the queue got
+ * full (the rest of the record stays pending)
+ */
+static gboolean ecg_data_replay_queue_record(EcgData *self);
 
-static void ecg_data_receive_data(
-		GIOChannel *channel,
-		guchar *buffer,
-		gsize count);
 
-static void ecg_data_send_data(
-		GIOChannel *channel,
-		guchar *buf,
-		gssize count,
-		gboolean flush);
+/**
+ * @brief Read data from rfcomm socket and push it into the queue.
+ *
+ * The socket is non-blocking. All the data that is available is read,
+ * and the ingest worker is woken up once for the whole batch.
+ *
+ * @param self Pointer to #EcgData
+ *
+ * @returns FALSE if the connection was closed or failed, TRUE otherwise.
+ */
+static gboolean ecg_data_read_and_push_bluetooth_data(EcgData *self);
+
+static gpointer ecg_data_bluetooth_poller(gpointer user_data);
 
 /**
  * @brief Callback for setting the bluetooth address of the ECG device
@@ -161,13 +523,43 @@ EcgData *ecg_data_new(GConfHelperData *gconf_helper)
 
 	self->gconf_helper = gconf_helper;
 
-	self->buffer = g_byte_array_new();
-	self->voltage_array = g_byte_array_new();
+	callback_list_init(&self->callbacks);
+	callback_list_init(&self->sample_callbacks);
+	callback_list_init(&self->acc_callbacks);
+	callback_list_init(&self->interval_callbacks);
+
+	self->buffer = ring_buffer_new(ECG_DATA_BUFFER_SIZE);
+	self->bluetooth_queue = chunk_queue_new(ECG_DATA_QUEUE_LENGTH);
 	self->connection_status_mutex = g_mutex_new();
+	self->connection_status_cond = g_cond_new();
 	self->connection_status = ECG_DATA_DISCONNECTED;
+	self->ingest_mutex = g_mutex_new();
+	self->ingest_cond = g_cond_new();
+	self->delivery_queue = g_async_queue_new();
+
+	if(!ecg_data_create_wakeup_pipe(self->poller_wakeup_pipe))
+	{
+		g_critical("Unable to create a pipe: %s", strerror(errno));
+		g_async_queue_unref(self->delivery_queue);
+		g_cond_free(self->ingest_cond);
+		g_mutex_free(self->ingest_mutex);
+		g_cond_free(self->connection_status_cond);
+		g_mutex_free(self->connection_status_mutex);
+		chunk_queue_free(self->bluetooth_queue);
+		ring_buffer_free(self->buffer);
+		g_free(self);
+		DEBUG_END();
+		return NULL;
+	}
 
 	self->current_sequence_number = -1;
+	self->chunk_data_block_count = -1;
 	self->bluetooth_serial_fd = -1;
+	self->beat_number = -1;
+
+	hrm_scanner_init(&self->sync_scanner);
+	hrm_scanner_add_signature(&self->sync_scanner, ecg_data_sync_mark,
+			sizeof(ecg_data_sync_mark));
 
 	gconf_helper_add_key_string(
 		gconf_helper,
@@ -183,218 +575,824 @@ EcgData *ecg_data_new(GConfHelperData *gconf_helper)
 
 void ecg_data_destroy(EcgData *self)
 {
+	EcgDataEvent *event = NULL;
+
 	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 
 	ecg_data_remove_callback_ecg(self, NULL, NULL);
+	ecg_data_remove_callback_samples(self, NULL, NULL);
+	ecg_data_remove_callback_acc(self, NULL, NULL);
+	ecg_data_remove_callback_intervals(self, NULL, NULL);
 	ecg_data_wait_for_disconnect(self);
 
+	/* The poller thread and the ingest worker have stopped, so nothing
+	 * can schedule the delivery anymore */
+	g_source_remove_by_user_data(self);
+	while((event = g_async_queue_try_pop(self->delivery_queue)) != NULL)
+	{
+		ecg_data_free_event(event);
+	}
+
+	close(self->poller_wakeup_pipe[0]);
+	close(self->poller_wakeup_pipe[1]);
+	g_async_queue_unref(self->delivery_queue);
+	g_cond_free(self->ingest_cond);
+	g_mutex_free(self->ingest_mutex);
+	g_cond_free(self->connection_status_cond);
 	g_mutex_free(self->connection_status_mutex);
-	g_byte_array_free(self->buffer, TRUE);
-	g_byte_array_free(self->voltage_array, TRUE);
+	ring_buffer_free(self->buffer);
+	chunk_queue_free(self->bluetooth_queue);
+	g_free(self->bluetooth_name);
+	g_free(self->bluetooth_address);
+	g_free(self->fixed_replay_file);
+
+	g_free(self->fixed_socket_path);
+	g_free(self->fixed_socket_name);
 
 	g_free(self);
 	DEBUG_END();
 }
 
-gboolean ecg_data_add_callback_ecg(
+void ecg_data_set_device(
 		EcgData *self,
-		EcgDataFunc callback,
-		gpointer user_data,
-		GError **error)
+		const gchar *bluetooth_address,
+		const gchar *bluetooth_name)
 {
-	gboolean first = FALSE;
-	EcgDataCallbackData *cb_data = NULL;
-	EcgDataConnectionStatus status = ECG_DATA_DISCONNECTED;
-	gboolean bluetooth_connection_ok = TRUE;
-
-	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
-	g_return_val_if_fail(self != NULL, FALSE);
-	g_return_val_if_fail(callback != NULL, FALSE);
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(bluetooth_address != NULL);
 	DEBUG_BEGIN();
 
-	if(self->callbacks == NULL)
+	if(ecg_data_has_callbacks(self))
 	{
-		DEBUG_LONG("First callback added. Connecting to ECG monitor");
-		first = TRUE;
-		self->bluetooth_name = gconf_helper_get_value_string_with_default(self->gconf_helper,ECGC_BLUETOOTH_NAME,"");
-		if(g_strrstr(self->bluetooth_name,"HXM") != NULL)
-		{
-		 self->hrm_name = ZEPHYR; 
-		 DEBUG_LONG("ZEPHYR HRM attached");
-		}
-		
-		if(g_strrstr(self->bluetooth_name,"FRWD") != NULL)
-		{
-		 self->hrm_name = FRWD;
-		  DEBUG_LONG("FRWD HRM attached");
-		}
+		g_warning("Changing the device of a connected EcgData");
 	}
 
-	if(first)
-	{
-		g_mutex_lock(self->connection_status_mutex);
-		status = self->connection_status;
-		g_mutex_unlock(self->connection_status_mutex);
+	self->device_fixed = TRUE;
 
-		switch(status)
-		{
-			case ECG_DATA_DISCONNECTED:
-				bluetooth_connection_ok =
-					ecg_data_connect_bluetooth(self,
-							error);
-				break;
-			case ECG_DATA_CONNECTED:
-			case ECG_DATA_CONNECTING:
-				g_critical("Already connecting or connected, "
-						"even though this is the first "
-						"callback.\n"
-						"This shouldn't happen");
-				/* Don't do anything */
-				break;
-			case ECG_DATA_REQUEST_DISCONNECT:
-			case ECG_DATA_DISCONNECTING:
-				/* Wait for the connection to be closed
-				 * and then connect again */
-				ecg_data_wait_for_disconnect(self);
-				bluetooth_connection_ok =
-					ecg_data_connect_bluetooth(self,
-							error);
-				break;
-		}
-	}
+	g_free(self->bluetooth_address);
+	self->bluetooth_address = g_strdup(bluetooth_address);
 
-	if(bluetooth_connection_ok)
-	{
-		cb_data = g_new0(EcgDataCallbackData, 1);
+	g_free(self->bluetooth_name);
+	self->bluetooth_name = g_strdup(bluetooth_name ? bluetooth_name : "");
 
-		cb_data->callback = callback;
-		cb_data->user_data = user_data;
+	DEBUG_END();
+}
+
+void ecg_data_set_replay(
+		EcgData *self,
+		const gchar *path,
+		gboolean realtime)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
 
-		self->callbacks = g_slist_append(self->callbacks, cb_data);
+	if(ecg_data_has_callbacks(self))
+	{
+		g_warning("Changing the replay of a connected EcgData");
 	}
 
-	return bluetooth_connection_ok;
+	g_free(self->fixed_replay_file);
+	self->fixed_replay_file = g_strdup(path);
+	self->fixed_replay_realtime = realtime;
 
 	DEBUG_END();
 }
 
+void ecg_data_set_socket(
+		EcgData *self,
+		const gchar *path,
+		const gchar *device_name)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(ecg_data_has_callbacks(self))
+	{
+		g_warning("Changing the socket of a connected EcgData");
+	}
+
+	g_free(self->fixed_socket_path);
+	self->fixed_socket_path = g_strdup(path);
+
+	g_free(self->fixed_socket_name);
+	self->fixed_socket_name = g_strdup(device_name ? device_name : "");
+
+	DEBUG_END();
+}
+
+gboolean ecg_data_add_callback_ecg(
+		EcgData *self,
+		EcgDataFunc callback,
+		gpointer user_data,
+		GError **error)
+{
+	gboolean first = FALSE;
+
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(callback != NULL, FALSE);
+	DEBUG_BEGIN();
+
+	first = !ecg_data_has_callbacks(self);
+
+	callback_list_add(&self->callbacks, (gpointer)callback, user_data);
+	ecg_data_update_subscriptions(self);
+
+	/* The callback is added before connecting, so that the ingest
+	 * worker does not skip the data that arrives right away */
+	if(first)
+	{
+		DEBUG_LONG("First callback added. Connecting to ECG monitor");
+		if(!ecg_data_start(self, error))
+		{
+			callback_list_remove(&self->callbacks,
+					(gpointer)callback, user_data);
+			ecg_data_update_subscriptions(self);
+			DEBUG_END();
+			return FALSE;
+		}
+	}
+
+	DEBUG_END();
+	return TRUE;
+}
+
 void ecg_data_remove_callback_ecg(
 		EcgData *self,
 		EcgDataFunc callback,
 		gpointer user_data)
 {
-	GSList *temp = NULL;
-	GSList *indices = NULL;
-	GSList *to_remove = NULL;
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
 
-	gboolean match = TRUE;
-	EcgDataCallbackData *cb_data = NULL;
-	gint index = 0;
+	if(callback_list_remove(&self->callbacks, (gpointer)callback,
+				user_data) == 0)
+	{
+		/* No matching callbacks. Nothing to be done */
+		DEBUG_END();
+		return;
+	}
+
+	ecg_data_update_subscriptions(self);
+
+	if(!ecg_data_has_callbacks(self))
+	{
+		DEBUG_LONG("Last callback removed. Stopping ECG");
+		ecg_data_disconnect(self);
+	}
+	DEBUG_END();
+}
 
+gboolean ecg_data_add_callback_samples(
+		EcgData *self,
+		EcgDataSampleFunc callback,
+		gpointer user_data,
+		GError **error)
+{
+	gboolean first = FALSE;
+
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(callback != NULL, FALSE);
+	DEBUG_BEGIN();
+
+	first = !ecg_data_has_callbacks(self);
+
+	callback_list_add(&self->sample_callbacks, (gpointer)callback,
+			user_data);
+	ecg_data_update_subscriptions(self);
+
+	if(first)
+	{
+		DEBUG_LONG("First callback added. Connecting to ECG monitor");
+		if(!ecg_data_start(self, error))
+		{
+			callback_list_remove(&self->sample_callbacks,
+					(gpointer)callback, user_data);
+			ecg_data_update_subscriptions(self);
+			DEBUG_END();
+			return FALSE;
+		}
+	}
+
+	DEBUG_END();
+	return TRUE;
+}
+
+void ecg_data_remove_callback_samples(
+		EcgData *self,
+		EcgDataSampleFunc callback,
+		gpointer user_data)
+{
 	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 
-	if(self->callbacks == NULL)
+	if(callback_list_remove(&self->sample_callbacks, (gpointer)callback,
+				user_data) == 0)
 	{
-		/* There are no callbacks. Nothing to be done */
+		/* No matching callbacks. Nothing to be done */
 		DEBUG_END();
 		return;
 	}
 
-	for(temp = self->callbacks; temp; temp = g_slist_next(temp))
+	ecg_data_update_subscriptions(self);
+
+	if(!ecg_data_has_callbacks(self))
+	{
+		DEBUG_LONG("Last callback removed. Stopping ECG");
+		ecg_data_disconnect(self);
+	}
+	DEBUG_END();
+}
+
+gboolean ecg_data_add_callback_acc(
+		EcgData *self,
+		EcgDataAccFunc callback,
+		gpointer user_data,
+		GError **error)
+{
+	gboolean first = FALSE;
+
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(callback != NULL, FALSE);
+	DEBUG_BEGIN();
+
+	first = !ecg_data_has_callbacks(self);
+
+	callback_list_add(&self->acc_callbacks, (gpointer)callback, user_data);
+	ecg_data_update_subscriptions(self);
+
+	if(first)
 	{
-		match = TRUE;
-		cb_data = (EcgDataCallbackData *)temp->data;
-		if(callback)
+		DEBUG_LONG("First callback added. Connecting to ECG monitor");
+		if(!ecg_data_start(self, error))
 		{
-			if(callback != cb_data->callback)
-			{
-				match = FALSE;
-			}
+			callback_list_remove(&self->acc_callbacks,
+					(gpointer)callback, user_data);
+			ecg_data_update_subscriptions(self);
+			DEBUG_END();
+			return FALSE;
 		}
-		if(user_data)
+	}
+
+	DEBUG_END();
+	return TRUE;
+}
+
+void ecg_data_remove_callback_acc(
+		EcgData *self,
+		EcgDataAccFunc callback,
+		gpointer user_data)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(callback_list_remove(&self->acc_callbacks, (gpointer)callback,
+				user_data) == 0)
+	{
+		/* No matching callbacks. Nothing to be done */
+		DEBUG_END();
+		return;
+	}
+
+	ecg_data_update_subscriptions(self);
+
+	if(!ecg_data_has_callbacks(self))
+	{
+		DEBUG_LONG("Last callback removed. Stopping ECG");
+		ecg_data_disconnect(self);
+	}
+	DEBUG_END();
+}
+
+gboolean ecg_data_add_callback_intervals(
+		EcgData *self,
+		EcgDataIntervalFunc callback,
+		gpointer user_data,
+		GError **error)
+{
+	gboolean first = FALSE;
+
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(callback != NULL, FALSE);
+	DEBUG_BEGIN();
+
+	first = !ecg_data_has_callbacks(self);
+
+	callback_list_add(&self->interval_callbacks, (gpointer)callback,
+			user_data);
+	ecg_data_update_subscriptions(self);
+
+	if(first)
+	{
+		DEBUG_LONG("First callback added. Connecting to ECG monitor");
+		if(!ecg_data_start(self, error))
 		{
-			if(user_data != cb_data->user_data)
-			{
-				match = FALSE;
-			}
+			callback_list_remove(&self->interval_callbacks,
+					(gpointer)callback, user_data);
+			ecg_data_update_subscriptions(self);
+			DEBUG_END();
+			return FALSE;
+		}
+	}
+
+	DEBUG_END();
+	return TRUE;
+}
+
+void ecg_data_remove_callback_intervals(
+		EcgData *self,
+		EcgDataIntervalFunc callback,
+		gpointer user_data)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(callback_list_remove(&self->interval_callbacks, (gpointer)callback,
+				user_data) == 0)
+	{
+		/* No matching callbacks. Nothing to be done */
+		DEBUG_END();
+		return;
+	}
+
+	ecg_data_update_subscriptions(self);
+
+	if(!ecg_data_has_callbacks(self))
+	{
+		DEBUG_LONG("Last callback removed. Stopping ECG");
+		ecg_data_disconnect(self);
+	}
+	DEBUG_END();
+}
+
+gint ecg_data_get_sample_rate(EcgData *self)
+{
+	g_return_val_if_fail(self != NULL, 0);
+	return g_atomic_int_get(&self->sample_rate);
+}
+
+gint ecg_data_get_units_per_mv(EcgData *self)
+{
+	g_return_val_if_fail(self != NULL, 0);
+	return 50;
+}
+
+gint ecg_data_get_zero_level(EcgData *self)
+{
+	g_return_val_if_fail(self != NULL, 0);
+	return 128;
+}
+
+guint ecg_data_get_buffer_peak_fill(EcgData *self)
+{
+	g_return_val_if_fail(self != NULL, 0);
+	return ring_buffer_get_peak_fill(self->buffer);
+}
+
+gint64 ecg_data_get_event_time(EcgData *self)
+{
+	g_return_val_if_fail(self != NULL, 0);
+	return self->event_time;
+}
+
+/*===========================================================================*
+ * Private function declarations                                             *
+ *===========================================================================*/
+
+static void ecg_data_invoke_callbacks(
+		EcgData *self,
+		gint heart_rate)
+{
+	CallbackArray *callbacks = NULL;
+	EcgDataFunc callback = NULL;
+	guint i = 0;
+
+	DEBUG_BEGIN();
+
+	/* Work on a snapshot, so that the callbacks can add and remove
+	 * callbacks */
+	callbacks = callback_list_acquire(&self->callbacks);
+	if(!callbacks)
+	{
+		DEBUG_END();
+		return;
+	}
+
+	for(i = 0; i < callbacks->length; i++)
+	{
+		if(!ecg_data_event_is_current(self))
+		{
+			/* An earlier callback closed the connection */
+			break;
+		}
+		callback = (EcgDataFunc)callbacks->entries[i].callback;
+		callback(self, heart_rate, callbacks->entries[i].user_data);
+	}
+	callback_array_unref(callbacks);
+
+	DEBUG_END();
+}
+
+static void ecg_data_invoke_sample_callbacks(
+		EcgData *self,
+		EcgSampleBlock *block)
+{
+	CallbackArray *callbacks = NULL;
+	EcgDataSampleFunc callback = NULL;
+	guint i = 0;
+
+	DEBUG_BEGIN();
+
+	/* Work on a snapshot, so that the callbacks can add and remove
+	 * callbacks */
+	callbacks = callback_list_acquire(&self->sample_callbacks);
+	if(!callbacks)
+	{
+		DEBUG_END();
+		return;
+	}
+
+	for(i = 0; i < callbacks->length; i++)
+	{
+		if(!ecg_data_event_is_current(self))
+		{
+			/* An earlier callback closed the connection */
+			break;
+		}
+		callback = (EcgDataSampleFunc)callbacks->entries[i].callback;
+		callback(self, block, callbacks->entries[i].user_data);
+	}
+	callback_array_unref(callbacks);
+
+	DEBUG_END();
+}
+
+static void ecg_data_invoke_acc_callbacks(
+		EcgData *self,
+		AccSampleBlock *block)
+{
+	CallbackArray *callbacks = NULL;
+	EcgDataAccFunc callback = NULL;
+	guint i = 0;
+
+	DEBUG_BEGIN();
+
+	/* Work on a snapshot, so that the callbacks can add and remove
+	 * callbacks */
+	callbacks = callback_list_acquire(&self->acc_callbacks);
+	if(!callbacks)
+	{
+		DEBUG_END();
+		return;
+	}
+
+	for(i = 0; i < callbacks->length; i++)
+	{
+		if(!ecg_data_event_is_current(self))
+		{
+			/* An earlier callback closed the connection */
+			break;
+		}
+		callback = (EcgDataAccFunc)callbacks->entries[i].callback;
+		callback(self, block, callbacks->entries[i].user_data);
+	}
+	callback_array_unref(callbacks);
+
+	DEBUG_END();
+}
+
+static void ecg_data_invoke_interval_callbacks(
+		EcgData *self,
+		const gint *intervals,
+		gint count)
+{
+	CallbackArray *callbacks = NULL;
+	EcgDataIntervalFunc callback = NULL;
+	guint i = 0;
+
+	DEBUG_BEGIN();
+
+	/* Work on a snapshot, so that the callbacks can add and remove
+	 * callbacks */
+	callbacks = callback_list_acquire(&self->interval_callbacks);
+	if(!callbacks)
+	{
+		DEBUG_END();
+		return;
+	}
+
+	for(i = 0; i < callbacks->length; i++)
+	{
+		if(!ecg_data_event_is_current(self))
+		{
+			/* An earlier callback closed the connection */
+			break;
 		}
-		if(match)
+		callback = (EcgDataIntervalFunc)callbacks->entries[i].callback;
+		callback(self, intervals, count,
+				callbacks->entries[i].user_data);
+	}
+	callback_array_unref(callbacks);
+
+	DEBUG_END();
+}
+
+static void ecg_data_update_subscriptions(EcgData *self)
+{
+	gint subscriptions = 0;
+
+	if(!callback_list_is_empty(&self->callbacks))
+	{
+		subscriptions |= ECG_DATA_SUBSCRIPTION_HEART_RATE;
+	}
+	if(!callback_list_is_empty(&self->sample_callbacks))
+	{
+		subscriptions |= ECG_DATA_SUBSCRIPTION_SAMPLES;
+	}
+	if(!callback_list_is_empty(&self->acc_callbacks))
+	{
+		subscriptions |= ECG_DATA_SUBSCRIPTION_ACC;
+	}
+	if(!callback_list_is_empty(&self->interval_callbacks))
+	{
+		subscriptions |= ECG_DATA_SUBSCRIPTION_INTERVALS;
+	}
+
+	g_atomic_int_set(&self->subscriptions, subscriptions);
+}
+
+static void ecg_data_post_event(
+		EcgData *self,
+		EcgDataEventType type,
+		gint heart_rate,
+		gpointer block)
+{
+	EcgDataEvent *event = NULL;
+
+	event = g_new(EcgDataEvent, 1);
+	event->type = type;
+	event->heart_rate = heart_rate;
+	event->block = block;
+	event->interval_count = 0;
+
+	ecg_data_queue_event(self, event);
+}
+
+static void ecg_data_queue_event(EcgData *self, EcgDataEvent *event)
+{
+	/* Stamp the event once here, so that every callback of it gets the
+	 * same time */
+	event->time = sample_clock_now();
+	event->connection_serial = g_atomic_int_get(&self->connection_serial);
+	g_async_queue_push(self->delivery_queue, event);
+
+	/* Wake up the main loop, unless it has already been woken up and
+	 * has not yet started emptying the queue */
+	if(g_atomic_int_compare_and_exchange(&self->delivery_scheduled,
+				FALSE, TRUE))
+	{
+		g_idle_add(ecg_data_deliver, self);
+	}
+}
+
+static void ecg_data_free_event(EcgDataEvent *event)
+{
+	switch(event->type)
+	{
+		case ECG_DATA_EVENT_SAMPLES:
+			ecg_sample_block_unref(
+					(EcgSampleBlock *)event->block);
+			break;
+		case ECG_DATA_EVENT_ACC:
+			acc_sample_block_unref(
+					(AccSampleBlock *)event->block);
+			break;
+		default:
+			break;
+	}
+
+	g_free(event);
+}
+
+static gboolean ecg_data_deliver(gpointer user_data)
+{
+	EcgData *self = (EcgData *)user_data;
+	EcgDataEvent *event = NULL;
+
+	g_return_val_if_fail(self != NULL, FALSE);
+	DEBUG_BEGIN();
+
+	/* Clear the flag before emptying the queue, so that events posted
+	 * after this point schedule a new run instead of being left in the
+	 * queue */
+	g_atomic_int_set(&self->delivery_scheduled, FALSE);
+
+	while((event = g_async_queue_try_pop(self->delivery_queue)) != NULL)
+	{
+		/* A callback may have been removed after the data was
+		 * decoded. It is not called anymore, as the lists are read
+		 * at the time of the delivery. If the connection has been
+		 * closed since, none of the callbacks are called. */
+		self->event_time = event->time;
+		self->event_connection_serial = event->connection_serial;
+		switch(event->type)
 		{
-			/* We can't just remove the item, because the
-			 * list may be relocated, which would break the
-			 * looping. Instead, append the index to another
-			 * list */
-			indices = g_slist_append(indices,
-					GINT_TO_POINTER(index));
+			case ECG_DATA_EVENT_HEART_RATE:
+				ecg_data_invoke_callbacks(self,
+						event->heart_rate);
+				break;
+			case ECG_DATA_EVENT_SAMPLES:
+				ecg_data_invoke_sample_callbacks(self,
+						(EcgSampleBlock *)event->block);
+				break;
+			case ECG_DATA_EVENT_ACC:
+				ecg_data_invoke_acc_callbacks(self,
+						(AccSampleBlock *)event->block);
+				break;
+			case ECG_DATA_EVENT_INTERVALS:
+				ecg_data_invoke_interval_callbacks(self,
+						event->intervals,
+						event->interval_count);
+				break;
 		}
-		index++;
+		ecg_data_free_event(event);
 	}
 
-	/* Reverse the list of indices, as we must go from end to begin
-	 * to avoid shifting in the list */
-	indices = g_slist_reverse(indices);
+	DEBUG_END();
+	return FALSE;
+}
+
+static gboolean ecg_data_event_is_current(EcgData *self)
+{
+	return self->event_connection_serial ==
+		g_atomic_int_get(&self->connection_serial);
+}
+
+static gboolean ecg_data_has_callbacks(EcgData *self)
+{
+	return !callback_list_is_empty(&self->callbacks) ||
+		!callback_list_is_empty(&self->sample_callbacks) ||
+		!callback_list_is_empty(&self->acc_callbacks) ||
+		!callback_list_is_empty(&self->interval_callbacks);
+}
+
+static gboolean ecg_data_start(EcgData *self, GError **error)
+{
+	EcgDataConnectionStatus status = ECG_DATA_DISCONNECTED;
+	gboolean connection_ok = TRUE;
+
+	DEBUG_BEGIN();
 
-	for(temp = indices; temp; temp = g_slist_next(temp))
+	if(!self->device_fixed)
 	{
-		index = GPOINTER_TO_INT(temp->data);
-		DEBUG_LONG("Removing callback %d", index);
-		to_remove = g_slist_nth(self->callbacks, index);
-		cb_data = (EcgDataCallbackData *)to_remove->data;
-		g_free(cb_data);
-		self->callbacks = g_slist_delete_link(
-				self->callbacks,
-				to_remove);
+		g_free(self->bluetooth_name);
+		self->bluetooth_name =
+			gconf_helper_get_value_string_with_default(
+					self->gconf_helper,
+					ECGC_BLUETOOTH_NAME, "");
+	}
+
+	status = ecg_data_get_connection_status(self);
+
+	switch(status)
+	{
+		case ECG_DATA_DISCONNECTED:
+			connection_ok = ecg_data_connect(self, error);
+			break;
+		case ECG_DATA_CONNECTED:
+		case ECG_DATA_CONNECTING:
+			g_critical("Already connecting or connected, "
+					"even though this is the first "
+					"callback.\n"
+					"This shouldn't happen");
+			/* Don't do anything */
+			break;
+		case ECG_DATA_REQUEST_DISCONNECT:
+		case ECG_DATA_DISCONNECTING:
+			/* Wait for the connection to be closed
+			 * and then connect again */
+			ecg_data_wait_for_disconnect(self);
+			connection_ok = ecg_data_connect(self, error);
+			break;
+	}
+
+	DEBUG_END();
+	return connection_ok;
+}
+
+static gboolean ecg_data_set_protocol(
+		EcgData *self,
+		const gchar *bluetooth_name,
+		GError **error)
+{
+	const HrmProtocol *protocol = NULL;
+
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	DEBUG_BEGIN();
+
+	protocol = hrm_protocol_find(bluetooth_name);
+	if(!protocol)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_HRM_NOT_SUPPORTED,
+				"Heart rate monitor %s is not supported",
+				bluetooth_name);
+		DEBUG_END();
+		return FALSE;
 	}
+	self->protocol = protocol;
 
-	if(self->callbacks == NULL)
-	{
-		DEBUG_LONG("Last callback removed. Stopping ECG");
+	hrm_scanner_init(&self->frame_scanner);
+	hrm_scanner_add_signature(&self->frame_scanner,
+			self->protocol->signature,
+			self->protocol->signature_length);
 
-		/* Last callback was removed. Stop ECG monitoring */
-		ecg_data_disconnect_bluetooth(self);
-	}
 	DEBUG_END();
+	return TRUE;
 }
 
-gint ecg_data_get_sample_rate(EcgData *self)
+static void ecg_data_reset_parser(EcgData *self)
 {
-	g_return_val_if_fail(self != NULL, 0);
-	return self->sample_rate;
+	DEBUG_BEGIN();
+
+	ring_buffer_clear(self->buffer);
+	ecg_data_resynchronize_parser(self);
+	self->sample_count = 0;
+	self->acc_sample_count = 0;
+	sample_clock_reset(&self->sample_clock, self->sample_rate);
+	sample_clock_reset(&self->acc_sample_clock, ECG_ACC_SAMPLE_RATE);
+
+	DEBUG_END();
 }
 
-gint ecg_data_get_units_per_mv(EcgData *self)
+static void ecg_data_resynchronize_parser(EcgData *self)
 {
-	g_return_val_if_fail(self != NULL, 0);
-	return 50;
+	DEBUG_BEGIN();
+
+	/* The offsets of the scanners point to data that may be gone */
+	hrm_scanner_reset(&self->frame_scanner);
+	hrm_scanner_reset(&self->sync_scanner);
+	self->current_sequence_number = -1;
+	self->chunk_data_block_count = -1;
+	self->chunk_current_data_block = 0;
+	self->chunk_checksum = 0;
+	self->in_sync = FALSE;
+	self->beat_number = -1;
+
+	DEBUG_END();
 }
 
-gint ecg_data_get_zero_level(EcgData *self)
+static gboolean ecg_data_connect(EcgData *self, GError **error)
 {
-	g_return_val_if_fail(self != NULL, 0);
-	return 128;
-}
+	gchar *replay_file = NULL;
+	gboolean retval = FALSE;
 
-/*===========================================================================*
- * Private function declarations                                             *
- *===========================================================================*/
+	DEBUG_BEGIN();
 
-static void ecg_data_invoke_callbacks(EcgData *self, gint heart_rate)
-{
-	GSList *temp = NULL;
-	EcgDataCallbackData *cb_data = NULL;
+	/* The threads of the previous connection have stopped, so all the
+	 * events queued from now on are from this connection */
+	g_atomic_int_inc(&self->connection_serial);
+
+	if(self->fixed_replay_file)
+	{
+		replay_file = g_strdup(self->fixed_replay_file);
+	} else {
+		replay_file = gconf_helper_get_value_string_with_default(
+				self->gconf_helper, ECGC_HRM_REPLAY_FILE, "");
+	}
+
+	if(replay_file && strcmp(replay_file, "") != 0)
+	{
+		retval = ecg_data_start_replay(self, replay_file, error);
+	} else if(self->fixed_socket_path) {
+		retval = ecg_data_connect_socket(self, error);
+	} else {
+		retval = ecg_data_connect_bluetooth(self, error);
+	}
+
+	g_free(replay_file);
+
+	DEBUG_END();
+	return retval;
+}
 
+static void ecg_data_disconnect(EcgData *self)
+{
 	DEBUG_BEGIN();
 
-	for(temp = self->callbacks; temp; temp = g_slist_next(temp))
-	  
+	/* Drop the events that are still waiting for the delivery */
+	g_atomic_int_inc(&self->connection_serial);
+
+	if(self->replay)
 	{
-		cb_data = (EcgDataCallbackData *)temp->data;
-		if(cb_data->callback)
-		{
-		cb_data->callback(self,heart_rate, cb_data->user_data);
-		}
+		/* The replay runs in the main loop, so it can be stopped
+		 * right away */
+		ecg_data_stop_replay(self);
+	} else {
+		ecg_data_disconnect_bluetooth(self);
 	}
 
 	DEBUG_END();
@@ -408,7 +1406,16 @@ static void ecg_data_push(EcgData *self, const guint8 *data, guint len)
 	DEBUG_BEGIN();
 
 	DEBUG("Pushing %d bytes of data to buffer", len);
-	self->buffer = g_byte_array_append(self->buffer, data, len);
+	if(ring_buffer_write(self->buffer, data, len) > 0)
+	{
+		/* The parser was not keeping up, and the beginning of the
+		 * unparsed data was thrown away */
+		ecg_data_resynchronize_parser(self);
+		if(self->protocol->framing == HRM_PROTOCOL_FRAMING_ECG_CHUNKS)
+		{
+			ecg_data_synchronize(self, FALSE);
+		}
+	}
 
 	ecg_data_process(self);
 
@@ -429,79 +1436,125 @@ static void ecg_data_process(EcgData *self)
 
 	DEBUG_BEGIN();
 	gint offset = 0;
+	guint length = 0;
+	guint tail = 0;
+	HrmProtocolPacket packet;
 
-	if(self->hrm_name == FRWD)
+	if(self->protocol->framing == HRM_PROTOCOL_FRAMING_ECG_CHUNKS)
 	{
-	while(self->buffer->len > 0)
+		/* Process the chunks until an incomplete one is found */
+		while(ring_buffer_get_length(self->buffer) > 0 &&
+				ecg_data_process_data_chunk(self))
+		{
+		}
+		DEBUG_END();
+		return;
+	}
+
+	while((length = ring_buffer_get_length(self->buffer)) > 0)
 	{
-		gchar *pointer = g_strstr_len((const gchar *)self->buffer->data,
-					       self->buffer->len,
-	    "FRWD");
-		if(!pointer)
+		offset = hrm_scanner_find(&self->frame_scanner,
+				ring_buffer_peek(self->buffer), length, NULL);
+		if(offset == -1)
 		{
-			/* No FRWD data. Clear buffer and wait for more data. */
-			ecg_data_pop(self, self->buffer->len, NULL);
+			/* No packet header. Throw away everything except a
+			 * possibly incomplete header at the end, and wait for
+			 * more data. */
+			tail = hrm_scanner_get_tail_length(&self->frame_scanner);
+			if(length > tail)
+			{
+				ecg_data_pop(self, length - tail, NULL);
+			}
 			break;
 		}
 
-		/* Remove non-FRWD data from the beginning of the buffer */
-		offset = pointer - (gchar *)self->buffer->data;
+		/* Remove non-packet data from the beginning of the buffer */
 		if(offset > 0)
-		ecg_data_pop(self, offset, NULL);
-
-		if(frwd_parse_heartrate(self, pointer))
 		{
-			/* Remove parsed data */
-			ecg_data_pop(self, FRWD_PACKET_SIZE,NULL);
-		}
-		else {
-			/*Wait for more data */
-			break;
+			ecg_data_pop(self, offset, NULL);
 		}
-		/* Continue until the buffer is empty */
-	}
-	}
-	if(self->hrm_name == ZEPHYR){
-	  
-	  while(self->buffer->len > 0)
-	{
-		gchar begin_char[] = {0x02, '\0'};
-		gchar *pointer = g_strstr_len((const gchar *)self->buffer->data,
-					       self->buffer->len,&begin_char);
-		if(!pointer)
+
+		if(ring_buffer_get_length(self->buffer) <
+				self->protocol->frame_length)
 		{
-			/* No ZEPHYR data. Clear buffer and wait for more data. */
-			ecg_data_pop(self, self->buffer->len, NULL);
+			/* Wait for more data */
 			break;
 		}
 
-		/* Remove non-ZEPHYR data from the beginning of the buffer */
-		offset = pointer - (gchar *)self->buffer->data;
-		if(offset > 0)
-		ecg_data_pop(self, offset, NULL);
+		/* Decode straight from the buffer */
+		if(!self->protocol->decode(ring_buffer_peek(self->buffer),
+					&packet))
+		{
+			/* The header was there only by chance. Skip it
+			 * and search for the next one. */
+			DEBUG("Invalid %s packet", self->protocol->name);
+			ecg_data_pop(self, 1, NULL);
+			continue;
+		}
 
-		if(zephyr_parse_heartrate(self, pointer))
+		if(packet.heart_rate >= 0)
 		{
-			/* Remove parsed data */
-			ecg_data_pop(self, ZEPHYR_PACKET_SIZE,NULL);
+			self->hr = packet.heart_rate;
 		}
-		else {
-			/*Wait for more data */
-			break;
+		if(g_atomic_int_get(&self->subscriptions) &
+				ECG_DATA_SUBSCRIPTION_HEART_RATE)
+		{
+			ecg_data_post_event(self, ECG_DATA_EVENT_HEART_RATE,
+					self->hr, NULL);
 		}
-		/* Continue until the buffer is empty */
-	}
-	  
-	  
-	  
+		if(packet.beat_number >= 0)
+		{
+			ecg_data_process_beat_times(self, &packet);
+		}
+
+		/* Remove parsed data, and continue until the buffer is
+		 * empty */
+		ecg_data_pop(self, self->protocol->frame_length, NULL);
 	}
-	 
-	  
-	
 
 	DEBUG_END();
 }
 
+static void ecg_data_process_beat_times(
+		EcgData *self,
+		const HrmProtocolPacket *packet)
+{
+	EcgDataEvent *event = NULL;
+	gint count = 0;
+	gint i = 0;
+
+	/* The beats since the previous packet. After a lost packet, only
+	 * the intervals of the time stamps in this packet are known. */
+	if(self->beat_number >= 0)
+	{
+		count = (packet->beat_number - self->beat_number) & 0xFF;
+		count = MIN(count, packet->beat_time_count - 1);
+	}
+	self->beat_number = packet->beat_number;
+
+	if(count <= 0 || !(g_atomic_int_get(&self->subscriptions) &
+				ECG_DATA_SUBSCRIPTION_INTERVALS))
+	{
+		return;
+	}
+
+	event = g_new(EcgDataEvent, 1);
+	event->type = ECG_DATA_EVENT_INTERVALS;
+	event->heart_rate = 0;
+	event->block = NULL;
+	event->interval_count = count;
+
+	/* The time stamps are latest first, and wrap around */
+	for(i = 0; i < count; i++)
+	{
+		event->intervals[i] = (guint16)(
+				packet->beat_times[count - 1 - i] -
+				packet->beat_times[count - i]);
+	}
+
+	ecg_data_queue_event(self, event);
+}
+
 /**
  * @brief Process one data chunk from buffer.
  *
@@ -514,29 +1567,30 @@ static void ecg_data_process(EcgData *self)
  */
 static gboolean ecg_data_process_data_chunk(EcgData *self)
 {
-	static gint data_block_count = -1;
-	static gint current_data_block = 0;
 	gint data_block_offset = 0;
 	guint16 sequence_number = 0;
 	guint8 seq_number_temp = 0;
 	gint i = 0;
 	gint retval = 0;
 	gboolean was_ok = TRUE;
-	static guint8 checksum = 0;
+	const guint8 *data = NULL;
 
 	g_return_val_if_fail(self != NULL, FALSE);
 	DEBUG_BEGIN();
+
+	data = ring_buffer_peek(self->buffer);
 	
 	
 
 	
-	if(data_block_count == -1)
+	if(self->chunk_data_block_count == -1)
 	{
 		/* We are processing a yet unprocessed data chunk. */
 
-		/* Check that we have the full packet header. If not, we'll get
+		/* Check that we have the full chunk header. If not, we'll get
 		 * back here later. */
-		if(self->buffer->len < ECG_PACKET_HEADER_LEN)
+		if(ring_buffer_get_length(self->buffer) <
+				ECG_CHUNK_HEADER_LEN)
 		{
 			DEBUG_LONG("Packet header incomplete. Waiting for more "
 					"data");
@@ -546,8 +1600,8 @@ static gboolean ecg_data_process_data_chunk(EcgData *self)
 
 		/* Just a check to be sure */
 		if(!(
-					(self->buffer->data[0] == 0x00) &&
-					(self->buffer->data[1] == 0xFE)
+					(data[0] == 0x00) &&
+					(data[1] == 0xFE)
 		    ))
 		{
 			g_critical("Sync mark is not where it is supposed "
@@ -556,16 +1610,16 @@ static gboolean ecg_data_process_data_chunk(EcgData *self)
 			return ecg_data_synchronize(self, FALSE);
 		}
 
-		self->battery_level = ((guint8)self->buffer->data[2]) / 2;
+		self->battery_level = ((guint8)data[2]) / 2;
 		/* Get the most significant byte and shift it */
-		sequence_number = ((guint16)(self->buffer->data[3])) & 0x0F;
+		sequence_number = ((guint16)(data[3])) & 0x0F;
 		sequence_number = sequence_number << 8;
 
 		/* Get the four first butes from the end part, and shift it */
-		sequence_number += (guint16)(self->buffer->data[4]);
+		sequence_number += (guint16)(data[4]);
 		sequence_number += (guint16)seq_number_temp;
 
-		if(self->buffer->data[3] && (1 << 4))
+		if(data[3] && (1 << 4))
 		{
 			/**
 			 * @todo: How is the exact position of the event
@@ -595,15 +1649,16 @@ static gboolean ecg_data_process_data_chunk(EcgData *self)
 		self->current_sequence_number = (gint)sequence_number;
 
 		/* How many data blocks are there? */
-		data_block_count = (gint)((guint8)(self->buffer->data[5]));
-		DEBUG_LONG("%d data blocks", data_block_count);
+		self->chunk_data_block_count = (gint)((guint8)(data[5]));
+		DEBUG_LONG("%d data blocks", self->chunk_data_block_count);
 
 		/* We have now read the whole header and stored the extracted
 		 * data, so it can be removed from the buffer now */
 		// self->last_processed_location = ECG_CHUNK_HEADER_LEN;
 
-		checksum = 0;
-		ecg_data_pop(self, ECG_CHUNK_HEADER_LEN, &checksum);
+		self->chunk_checksum = 0;
+		ecg_data_pop(self, ECG_CHUNK_HEADER_LEN,
+				&self->chunk_checksum);
 
 		/* @todo Is this variable needed anymore? */
 		data_block_offset = 0;
@@ -615,7 +1670,8 @@ static gboolean ecg_data_process_data_chunk(EcgData *self)
 		data_block_offset = 0;
 	}
 
-	for(i = current_data_block; i < data_block_count; i++)
+	for(i = self->chunk_current_data_block;
+			i < self->chunk_data_block_count; i++)
 	/* for(i = 0; i < data_block_count; i++) */
 	{
 		DEBUG_LONG("Processing data block %d", i);
@@ -624,7 +1680,7 @@ static gboolean ecg_data_process_data_chunk(EcgData *self)
 		{
 			case -1:
 				/* Not enough data */
-				current_data_block = i;
+				self->chunk_current_data_block = i;
 				return FALSE;
 			case -2:
 				/* Invalid data. Synchronize and start over,
@@ -648,7 +1704,8 @@ static gboolean ecg_data_process_data_chunk(EcgData *self)
 				 * processed. */
 				/* self->last_processed_location =
 					data_block_offset; */
-				ecg_data_pop(self, retval, &checksum);
+				ecg_data_pop(self, retval,
+						&self->chunk_checksum);
 				data_block_offset = 0;
 				break;
 
@@ -665,10 +1722,19 @@ static gboolean ecg_data_process_data_chunk(EcgData *self)
 	}
 
 	/* Verify the checksum and remove it */
-	if(checksum != (guint8)self->buffer->data[0])
+	if(ring_buffer_get_length(self->buffer) < 1)
+	{
+		/* All the blocks are processed, but the checksum has not
+		 * arrived yet */
+		self->chunk_current_data_block = self->chunk_data_block_count;
+		DEBUG_END();
+		return FALSE;
+	}
+	data = ring_buffer_peek(self->buffer);
+	if(self->chunk_checksum != (guint8)data[0])
 	{
 		g_warning("Checksum does not match (%d ; %d)",
-				checksum, (guint8)self->buffer->data[0]);
+				self->chunk_checksum, (guint8)data[0]);
 		goto resync_required;
 	} else {
 		DEBUG_LONG("Checksum OK");
@@ -678,11 +1744,8 @@ static gboolean ecg_data_process_data_chunk(EcgData *self)
 	ecg_data_pop(self, 1, NULL);
 	/* All data blocks in the data chunk were processed OK. Reset
 	 * the required variables. */
-	current_data_block = 0;
-	data_block_count = -1;
-
-	/** @todo update this only after processing whole data unit */
-	self->current_sequence_number = sequence_number;
+	self->chunk_current_data_block = 0;
+	self->chunk_data_block_count = -1;
 
 	/* Return TRUE so that the next block will be processed (if
 	 * it happens to be in the buffer) */
@@ -691,8 +1754,8 @@ static gboolean ecg_data_process_data_chunk(EcgData *self)
 
 resync_required:
 	/* If a resynchronization is required, we must reset the variables */
-	current_data_block = 0;
-	data_block_count = -1;
+	self->chunk_current_data_block = 0;
+	self->chunk_data_block_count = -1;
 	/* If there was data corruption, also the current sequence number
 	 * might be wrong */
 	self->current_sequence_number = -1;
@@ -712,11 +1775,14 @@ resync_required:
 static gint ecg_data_process_data_block(EcgData *self)
 {
 	gint retval = 1;
+	const guint8 *data = NULL;
 
 	g_return_val_if_fail(self != NULL, -2);
 	DEBUG_BEGIN();
 
-	if(self->buffer->len < ECG_PACKET_HEADER_LEN)
+	data = ring_buffer_peek(self->buffer);
+
+	if(ring_buffer_get_length(self->buffer) < ECG_PACKET_HEADER_LEN)
 	{
 		DEBUG("Not enough data yet.");
 		return -1;
@@ -724,7 +1790,7 @@ static gint ecg_data_process_data_block(EcgData *self)
 
 	/* Determine the packet type: ECG, 2 Axis accelerometer or
 	 * 3 axis accelerometer */
-	switch(self->buffer->data[0])
+	switch(data[0])
 	{
 		case ECG_PACKET_ID_ECG:
 			retval = ecg_data_process_ecg_data_block(self);
@@ -737,7 +1803,7 @@ static gint ecg_data_process_data_block(EcgData *self)
 			break;
 		default:
 			g_warning("Unknown data packet ID: 0x%X",
-					self->buffer->data[0]);
+					data[0]);
 			DEBUG_END();
 			return -2;
 	}
@@ -758,52 +1824,85 @@ static gint ecg_data_process_data_block(EcgData *self)
 static gint ecg_data_process_ecg_data_block(EcgData *self)
 {
 	guint data_block_length = 0;
-	guint ecg_data_offset = 0;
+	guint sample_count = 0;
+	guint i = 0;
+	const guint8 *data = NULL;
+	const guint8 *samples = NULL;
+	EcgSampleBlock *block = NULL;
 
 	g_return_val_if_fail(self != NULL, -2);
 	DEBUG_BEGIN();
 
-	data_block_length = self->buffer->data[1];
+	data = ring_buffer_peek(self->buffer);
+
+	data_block_length = data[1];
 	data_block_length = data_block_length << 8;
-	data_block_length += self->buffer->data[2];
+	data_block_length += data[2];
 	DEBUG("Data block length: %d", data_block_length);
 
-	if(self->buffer->len < data_block_length)
+	/* A block that does not fit in the buffer would never be complete.
+	 * It is most likely corrupted anyway. */
+	if(data_block_length < ECG_PACKET_HEADER_LEN ||
+			data_block_length >
+			ring_buffer_get_capacity(self->buffer))
+	{
+		g_warning("Invalid ECG data block length: %d",
+				data_block_length);
+		return -2;
+	}
+
+	if(ring_buffer_get_length(self->buffer) < data_block_length)
 	{
 		DEBUG("Not enough data yet.");
 		return -1;
 	}
 
-	switch(self->buffer->data[3])
+	switch(data[3])
 	{
 		case '\x01':
 			DEBUG("150 samples per second");
-			self->sample_rate = 150;
+			g_atomic_int_set(&self->sample_rate, 150);
 			break;
 		case '\x02':
 			DEBUG("300 samples per second");
-			self->sample_rate = 300;
+			g_atomic_int_set(&self->sample_rate, 300);
 			break;
 		default:
 			g_warning("Unknown ECG data format ID: 0x%X",
-					self->buffer->data[3]);
+					data[3]);
 			return -2;
 	}
 
-	ecg_data_offset = self->voltage_array->len;
+	samples = data + ECG_PACKET_HEADER_LEN;
+	sample_count = data_block_length - ECG_PACKET_HEADER_LEN;
+
+	if((g_atomic_int_get(&self->subscriptions) &
+				ECG_DATA_SUBSCRIPTION_SAMPLES) &&
+			sample_count > 0)
+	{
+		/* Decode the samples once, and give the same block to
+		 * every callback */
+		block = ecg_sample_block_new(sample_count);
+		block->sample_rate = self->sample_rate;
+		block->units_per_mv = ecg_data_get_units_per_mv(self);
+		block->zero_level = ecg_data_get_zero_level(self);
+		block->first_sample = self->sample_count;
+
+		for(i = 0; i < sample_count; i++)
+		{
+			block->samples[i] = samples[i];
+		}
 
-	self->voltage_array = g_byte_array_append(
-			self->voltage_array,
-			self->buffer->data + ECG_PACKET_HEADER_LEN,
-			data_block_length - ECG_PACKET_HEADER_LEN);
+		sample_clock_set_sample_rate(&self->sample_clock,
+				self->sample_rate);
+		block->time = sample_clock_stamp_block(&self->sample_clock,
+				block->first_sample, sample_count,
+				sample_clock_now());
 
-	/*
-	ecg_data_invoke_callbacks(self, ecg_data_offset,
-			data_block_length - ECG_PACKET_HEADER_LEN);
-*/
-	/** @todo: Is the voltage buffer even needed anymore? */
-	ecg_data_dispose_voltage_data(self, data_block_length -
-			ECG_PACKET_HEADER_LEN);
+		/* The event takes over the reference */
+		ecg_data_post_event(self, ECG_DATA_EVENT_SAMPLES, 0, block);
+	}
+	self->sample_count += sample_count;
 
 	DEBUG_END();
 	return data_block_length;
@@ -822,63 +1921,66 @@ static gint ecg_data_process_ecg_data_block(EcgData *self)
 static gint ecg_data_process_acc_data_block(EcgData *self, gint axis_count)
 {
 	guint data_block_length = 0;
-	guint ecg_data_offset = 0;
+	guint sample_count = 0;
+	const guint8 *data = NULL;
+	AccSampleBlock *block = NULL;
 
 	g_return_val_if_fail(self != NULL, -2);
 	g_return_val_if_fail(axis_count == 2 || axis_count == 3, -2);
 
 	DEBUG_BEGIN();
 
-	data_block_length = self->buffer->data[1];
+	data = ring_buffer_peek(self->buffer);
+
+	data_block_length = data[1];
 	data_block_length = data_block_length << 8;
-	data_block_length += self->buffer->data[2];
+	data_block_length += data[2];
 	DEBUG("Data block length: %d (0x%X)", data_block_length,
 			data_block_length);
 
-	if(self->buffer->len < data_block_length)
+	if(data_block_length < ECG_PACKET_HEADER_LEN ||
+			data_block_length >
+			ring_buffer_get_capacity(self->buffer))
+	{
+		g_warning("Invalid accelerometer data block length: %d",
+				data_block_length);
+		return -2;
+	}
+
+	if(ring_buffer_get_length(self->buffer) < data_block_length)
 	{
 		DEBUG("Not enough data yet.");
 		return -1;
 	}
 
-	if(self->buffer->data[3] != '\x00')
+	if(data[3] != '\x00')
 	{
 		g_warning("Invalid accelerometer data format: 0x%X",
-				self->buffer->data[3]);
+				data[3]);
 		return -2;
 	}
 
-	ecg_data_offset = self->voltage_array->len;
-
-#if 0
-	/** @todo Extract the acc data */
-	gint i;
-	for(i = 0; i < data_block_length - ECG_PACKET_HEADER_LEN; i++)
-	{
-		printf("0x%X\t", self->buffer->data[ECG_PACKET_HEADER_LEN + i]);
-		if((i % 8) == 7)
-		{
-			printf("\n");
-		}
-	}
-	printf("\n");
-
-	self->voltage_array = g_byte_array_append(
-			self->voltage_array,
-			self->buffer->data + ECG_PACKET_HEADER_LEN,
-			data_block_length - ECG_PACKET_HEADER_LEN);
+	/* The samples of the axes are interleaved */
+	sample_count = (data_block_length - ECG_PACKET_HEADER_LEN) / axis_count;
 
-	if(self->ecg_callback)
+	if((g_atomic_int_get(&self->subscriptions) &
+				ECG_DATA_SUBSCRIPTION_ACC) &&
+			sample_count > 0)
 	{
-		self->ecg_callback(
-				self,
-				self->voltage_array,
-				ecg_data_offset,
-				data_block_length - ECG_PACKET_HEADER_LEN,
-				self->ecg_callback_data);
+		block = acc_sample_block_new(axis_count, sample_count);
+		block->sample_rate = ECG_ACC_SAMPLE_RATE;
+		block->zero_level = ECG_ACC_ZERO_LEVEL;
+		block->first_sample = self->acc_sample_count;
+		acc_sample_block_unpack(block, data + ECG_PACKET_HEADER_LEN);
+		block->time = sample_clock_stamp_block(
+				&self->acc_sample_clock,
+				block->first_sample, sample_count,
+				sample_clock_now());
+
+		ecg_data_post_event(self, ECG_DATA_EVENT_ACC, 0, block);
 	}
+	self->acc_sample_count += sample_count;
 
-#endif
 	DEBUG_END();
 	return data_block_length;
 }
@@ -904,6 +2006,8 @@ static gboolean ecg_data_synchronize(EcgData *self, gboolean force)
 	 */
 
 	gint i = 0;
+	gint length = 0;
+	const guint8 *data = NULL;
 
 	g_return_val_if_fail(self != NULL, FALSE);
 	DEBUG_BEGIN();
@@ -911,7 +2015,7 @@ static gboolean ecg_data_synchronize(EcgData *self, gboolean force)
 	if(force)
 	{
 		/* Check that there is room even for the initial sync mark */
-		if(self->buffer->len < 2)
+		if(ring_buffer_get_length(self->buffer) < 2)
 		{
 			DEBUG_END();
 			return FALSE;
@@ -921,38 +2025,40 @@ static gboolean ecg_data_synchronize(EcgData *self, gboolean force)
 		ecg_data_pop(self, 2, NULL);
 	}
 
-	/* Loop only to buffer->len - 1, because the sync mark is
-	 * two bytes */
-	for(i = 0; i < self->buffer->len - 1; i++)
+	data = ring_buffer_peek(self->buffer);
+	length = ring_buffer_get_length(self->buffer);
+
+	i = hrm_scanner_find(&self->sync_scanner, data, length, NULL);
+	if(i != -1)
 	{
-		if(self->buffer->data[i] ==  0x00)
+		/* Throw away anything before sync mark,
+		 * because it might be anything. We don't
+		 * have a header for it. */
+		DEBUG("Found sync mark at %d (%X)", i, i);
+		if(i < length - 5)
 		{
-			if(self->buffer->data[i+1] == 0xFE)
-			{
-				/* Throw away anything before sync mark,
-				 * because it might be anything. We don't
-				 * have a header for it. */
-				DEBUG("Found sync mark at %d (%X)", i, i);
-				if(i < self->buffer->len - 5)
-				{
-					DEBUG("Battery level seems now to be %d (%X)",
-							(guint8)self->buffer->data[i+2],
-							(guint8)self->buffer->data[i+2]);
-				}
+			DEBUG("Battery level seems now to be %d (%X)",
+					(guint8)data[i+2],
+					(guint8)data[i+2]);
+		}
 
-				if(i > 0)
-				{
-					DEBUG("Removing %d unnecessary bytes",
-							i);
-					// self->last_processed_location = i;
-					ecg_data_pop(self, i, NULL);
-				}
-				// self->last_processed_location = 0;
-				self->in_sync = TRUE;
-				DEBUG_END();
-				return TRUE;
-			}
+		if(i > 0)
+		{
+			DEBUG("Removing %d unnecessary bytes", i);
+			ecg_data_pop(self, i, NULL);
 		}
+		self->in_sync = TRUE;
+		DEBUG_END();
+		return TRUE;
+	}
+
+	/* Nothing before the last byte (which may be the first half of
+	 * the sync mark) can be used */
+	if(length > hrm_scanner_get_tail_length(&self->sync_scanner))
+	{
+		ecg_data_pop(self, length -
+				hrm_scanner_get_tail_length(
+					&self->sync_scanner), NULL);
 	}
 
 	/* The sync mark was not found. Set the in_sync to FALSE,
@@ -974,10 +2080,8 @@ static gboolean ecg_data_synchronize(EcgData *self, gboolean force)
  */
 static void ecg_data_pop(EcgData *self, guint len, guint8 *checksum)
 {
-	guint8 *data_ptr;
-
 	g_return_if_fail(self != NULL);
-	g_return_if_fail(len <= self->buffer->len);
+	g_return_if_fail(len <= ring_buffer_get_length(self->buffer));
 	g_return_if_fail(len > 0);
 
 	DEBUG_BEGIN();
@@ -992,33 +2096,14 @@ static void ecg_data_pop(EcgData *self, guint len, guint8 *checksum)
 	}
 	*/
 
-	if(checksum)
-	{
-		/* Add to the checksum of the removed data */
-		data_ptr = self->buffer->data;
-		for(data_ptr = self->buffer->data;
-				data_ptr < self->buffer->data + len;
-				data_ptr++)
-		{
-			*checksum += *((guint8 *)data_ptr);
-		}
-	}
-
 	// self->last_processed_location = self->last_processed_location + 1 - len;
 	DEBUG("Removing %d bytes", len);
-	self->buffer = g_byte_array_remove_range(
-			self->buffer,
-			0, len);
+	ring_buffer_consume(self->buffer, len, checksum);
 
-	DEBUG_END();
-}
+	/* The scanners do not need to search the removed data again */
+	hrm_scanner_consumed(&self->frame_scanner, len);
+	hrm_scanner_consumed(&self->sync_scanner, len);
 
-static void ecg_data_dispose_voltage_data(EcgData *self, guint len)
-{
-	DEBUG_BEGIN();
-	self->voltage_array = g_byte_array_remove_range(
-			self->voltage_array,
-			0, len);
 	DEBUG_END();
 }
 
@@ -1040,6 +2125,13 @@ static void ecg_data_set_bluetooth_address(
 
 	DEBUG_BEGIN();
 
+	if(self->device_fixed)
+	{
+		/* Set with ecg_data_set_device() */
+		DEBUG_END();
+		return;
+	}
+
 	value = gconf_entry_get_value(entry);
 	bluetooth_address = gconf_value_get_string(value);
 
@@ -1053,41 +2145,6 @@ static void ecg_data_set_bluetooth_address(
 	DEBUG_END();
 }
 
-static gboolean ecg_data_bluetooth_data_arrived(
-		GIOChannel *source,
-		GIOCondition condition,
-		gpointer user_data)
-{
-	gchar str_ret[ECG_DATA_READ_BUFFER_SIZE];
-
-	EcgData *self = (EcgData *)user_data;
-
-	g_return_val_if_fail(user_data != NULL, FALSE);
-	DEBUG_BEGIN();
-
-	guchar data_size_c[2];
-	guint data_size;
-
-	/* Read 2 characters to data_size_c */
-	ecg_data_receive_data(
-			self->bluetooth_serial_channel_read,
-			data_size_c,
-			2);
-
-	data_size = (gint)data_size_c[1] + ((gint) data_size_c[0] << 8);
-
-	/* Read <data_size> characters to str_ret */
-	ecg_data_receive_data(
-			self->bluetooth_serial_channel_read,
-			str_ret,
-			data_size);
-
-	ecg_data_push(self, (gint8 *)str_ret, (guint)data_size);
-	
-	DEBUG_END();
-	return TRUE;
-}
-
 static gboolean ecg_data_connect_bluetooth(EcgData *self, GError **error)
 {
 	struct sockaddr_rc addr = { 0 };
@@ -1113,9 +2170,12 @@ static gboolean ecg_data_connect_bluetooth(EcgData *self, GError **error)
 		return FALSE;
 	}
 
-	g_mutex_lock(self->connection_status_mutex);
-	self->connection_status = ECG_DATA_CONNECTING;
-	g_mutex_unlock(self->connection_status_mutex);
+	if(!ecg_data_set_protocol(self, self->bluetooth_name, error))
+	{
+		return FALSE;
+	}
+
+	ecg_data_set_connection_status(self, ECG_DATA_CONNECTING);
 
 	/* Create a socket */
 	self->bluetooth_serial_fd = socket(
@@ -1158,25 +2218,74 @@ static gboolean ecg_data_connect_bluetooth(EcgData *self, GError **error)
 		goto connection_failure;
 	}
 
-	if(!ecg_data_setup_serial_pipe(self, error))
+	if(!ecg_data_start_polling(self, error))
+	{
+		goto connection_failure;
+	}
+
+	DEBUG_END();
+	return TRUE;
+
+connection_failure:
+	if(self->bluetooth_serial_fd != -1)
+	{
+		shutdown(self->bluetooth_serial_fd, SHUT_RDWR);
+		self->bluetooth_serial_fd = -1;
+	}
+
+	ecg_data_set_connection_status(self, ECG_DATA_DISCONNECTED);
+
+	DEBUG_END();
+	return FALSE;
+}
+
+static gboolean ecg_data_connect_socket(EcgData *self, GError **error)
+{
+	struct sockaddr_un addr;
+
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	DEBUG_BEGIN();
+
+	if(!ecg_data_set_protocol(self, self->fixed_socket_name, error))
 	{
 		DEBUG_END();
 		return FALSE;
 	}
 
+	ecg_data_set_connection_status(self, ECG_DATA_CONNECTING);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	g_strlcpy(addr.sun_path, self->fixed_socket_path,
+			sizeof(addr.sun_path));
+
+	self->bluetooth_serial_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(self->bluetooth_serial_fd == -1 ||
+	   connect(self->bluetooth_serial_fd, (struct sockaddr *)&addr,
+		   sizeof(addr)) == -1)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_BLUETOOTH,
+				"Unable to connect to %s: %s",
+				self->fixed_socket_path, strerror(errno));
+		goto connection_failure;
+	}
+
+	if(!ecg_data_start_polling(self, error))
+	{
+		goto connection_failure;
+	}
+
 	DEBUG_END();
 	return TRUE;
 
 connection_failure:
 	if(self->bluetooth_serial_fd != -1)
 	{
-		shutdown(self->bluetooth_serial_fd, SHUT_RDWR);
+		close(self->bluetooth_serial_fd);
 		self->bluetooth_serial_fd = -1;
 	}
 
-	g_mutex_lock(self->connection_status_mutex);
-	self->connection_status = ECG_DATA_DISCONNECTED;
-	g_mutex_unlock(self->connection_status_mutex);
+	ecg_data_set_connection_status(self, ECG_DATA_DISCONNECTED);
 
 	DEBUG_END();
 	return FALSE;
@@ -1184,102 +2293,168 @@ connection_failure:
 
 static void ecg_data_disconnect_bluetooth(EcgData *self)
 {
+	const guchar wakeup = 1;
+
 	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 
 	/* Set the connection status to REQEUST_DISCONNECT so that
-	 * the data poller knows to stop polling
+	 * the data poller knows to stop polling. If the poller has already
+	 * stopped by itself (the connection was lost), there is nothing to
+	 * do.
 	 */
 	g_mutex_lock(self->connection_status_mutex);
-	self->connection_status = ECG_DATA_REQUEST_DISCONNECT;
+	if(g_atomic_int_compare_and_exchange(&self->connection_status,
+				ECG_DATA_CONNECTED,
+				ECG_DATA_REQUEST_DISCONNECT))
+	{
+		g_cond_broadcast(self->connection_status_cond);
+		g_mutex_unlock(self->connection_status_mutex);
+
+		/* Wake up the poller. If the pipe is full, there is a
+		 * wakeup pending already. */
+		if(write(self->poller_wakeup_pipe[1], &wakeup, 1) == -1 &&
+				errno != EAGAIN)
+		{
+			g_critical("Unable to wake up the poller thread: %s",
+					strerror(errno));
+		}
+	} else {
+		g_mutex_unlock(self->connection_status_mutex);
+	}
+
+	DEBUG_END();
+}
+
+static void ecg_data_wait_for_disconnect(EcgData *self)
+{
+	EcgDataConnectionStatus status;
+
+	DEBUG_BEGIN();
+
+	status = ecg_data_get_connection_status(self);
+
+	if(status != ECG_DATA_REQUEST_DISCONNECT &&
+	   status != ECG_DATA_DISCONNECTING &&
+           status != ECG_DATA_DISCONNECTED)
+	{
+		ecg_data_disconnect(self);
+	}
+
+	g_mutex_lock(self->connection_status_mutex);
+	for(;;)
+	{
+		status = ecg_data_get_connection_status(self);
+		if(status != ECG_DATA_REQUEST_DISCONNECT &&
+		   status != ECG_DATA_DISCONNECTING)
+		{
+			break;
+		}
+		g_cond_wait(self->connection_status_cond,
+				self->connection_status_mutex);
+	}
+	g_mutex_unlock(self->connection_status_mutex);
+
+	DEBUG_END();
+}
+
+static EcgDataConnectionStatus ecg_data_get_connection_status(EcgData *self)
+{
+	return (EcgDataConnectionStatus)g_atomic_int_get(
+			&self->connection_status);
+}
+
+static void ecg_data_set_connection_status(
+		EcgData *self,
+		EcgDataConnectionStatus status)
+{
+	g_mutex_lock(self->connection_status_mutex);
+	g_atomic_int_set(&self->connection_status, (gint)status);
+	g_cond_broadcast(self->connection_status_cond);
 	g_mutex_unlock(self->connection_status_mutex);
-
-	/* Firstly, we remove the watch for the readable end of the serial
-	 * channel so that we can immediately stop sending data to the
-	 * listeners (that should happen automatically anyhow, though, because
-	 * the callbacks have already been removed)
-	 */
-	g_source_remove(self->bluetooth_serial_channel_read_watch_id);
-	self->bluetooth_serial_channel_read_watch_id = 0;
-
-	DEBUG_END();
 }
 
-static void ecg_data_wait_for_disconnect(EcgData *self)
+static gboolean ecg_data_create_wakeup_pipe(gint fds[2])
 {
-	struct timespec tv;
-	struct timespec rem;
-	EcgDataConnectionStatus status;
+	gint i = 0;
+	gint flags = 0;
 
 	DEBUG_BEGIN();
 
-	g_mutex_lock(self->connection_status_mutex);
-	status = self->connection_status;
-	g_mutex_unlock(self->connection_status_mutex);
+	if(pipe(fds) == -1)
+	{
+		DEBUG_END();
+		return FALSE;
+	}
 
-	if(status != ECG_DATA_REQUEST_DISCONNECT &&
-	   status != ECG_DATA_DISCONNECTING &&
-           status != ECG_DATA_DISCONNECTED)
+	for(i = 0; i < 2; i++)
 	{
-		ecg_data_disconnect_bluetooth(self);
+		flags = fcntl(fds[i], F_GETFL);
+		if(flags == -1 ||
+		   fcntl(fds[i], F_SETFL, flags | O_NONBLOCK) == -1)
+		{
+			close(fds[0]);
+			close(fds[1]);
+			DEBUG_END();
+			return FALSE;
+		}
 	}
 
+	DEBUG_END();
+	return TRUE;
+}
+
+static void ecg_data_clear_poller_wakeup(EcgData *self)
+{
+	guchar buf[16];
+	ssize_t read_size = 0;
+
+	DEBUG_BEGIN();
+
 	do {
-		tv.tv_sec = 1;
-		tv.tv_nsec = 0;
-		nanosleep(&tv, &rem);
-		g_mutex_lock(self->connection_status_mutex);
-		status = self->connection_status;
-		g_mutex_unlock(self->connection_status_mutex);
-	} while(status == ECG_DATA_REQUEST_DISCONNECT ||
-		status == ECG_DATA_DISCONNECTING);
+		read_size = read(self->poller_wakeup_pipe[0], buf,
+				sizeof(buf));
+	} while(read_size > 0 || (read_size == -1 && errno == EINTR));
+
 	DEBUG_END();
 }
 
-static gboolean ecg_data_setup_serial_pipe(EcgData *self, GError **error)
+static gboolean ecg_data_start_polling(EcgData *self, GError **error)
 {
-	gchar *err_msg = NULL;
+	gint flags = 0;
+
 	g_return_val_if_fail(self != NULL, FALSE);
 	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 	DEBUG_BEGIN();
 
-	if(pipe(self->bluetooth_serial_pipe) == -1)
+	/* The poller thread reads until there is no more data, so the reads
+	 * must not block */
+	flags = fcntl(self->bluetooth_serial_fd, F_GETFL);
+	if(flags == -1 || fcntl(self->bluetooth_serial_fd, F_SETFL,
+				flags | O_NONBLOCK) == -1)
 	{
-		err_msg = strerror(errno);
-		g_set_error(error, EC_ERROR, EC_ERROR_PIPE,
-				err_msg);
-		/** @todo Disconnect bluetooth */
+		g_set_error(error, EC_ERROR, EC_ERROR_BLUETOOTH,
+				strerror(errno));
+		DEBUG_END();
 		return FALSE;
 	}
 
-	/* Create the writable channel for the pipe */
-	self->bluetooth_serial_channel_write = g_io_channel_unix_new(
-			self->bluetooth_serial_pipe[1]);
-
-	/* Binary data, set NULL encoding */
-	g_io_channel_set_encoding(self->bluetooth_serial_channel_write,
-			NULL, NULL);
-
-	/* Create the readable channel for the pipe */
-	self->bluetooth_serial_channel_read = g_io_channel_unix_new(
-			self->bluetooth_serial_pipe[0]);
-
-	/* Binary data, set NULL encoding */
-	g_io_channel_set_encoding(self->bluetooth_serial_channel_read,
-			NULL, NULL);
+	/* The previous poller thread and ingest worker (if any) have
+	 * stopped, so nothing uses the queue or the parser now. Drop
+	 * anything left from the previous connection. */
+	ecg_data_reset_parser(self);
+	chunk_queue_reset(self->bluetooth_queue);
+	ecg_data_clear_poller_wakeup(self);
 
-	g_io_channel_set_buffered(self->bluetooth_serial_channel_read,
-			FALSE);
+	if(!ecg_data_start_ingest(self, error))
+	{
+		DEBUG_END();
+		return FALSE;
+	}
 
-	self->bluetooth_serial_channel_read_watch_id =
-		g_io_add_watch(self->bluetooth_serial_channel_read,
-				G_IO_IN,
-				ecg_data_bluetooth_data_arrived,
-				self);
+	ecg_data_start_capture(self);
 
-	g_mutex_lock(self->connection_status_mutex);
-	self->connection_status = ECG_DATA_CONNECTED;
-	g_mutex_unlock(self->connection_status_mutex);
+	ecg_data_set_connection_status(self, ECG_DATA_CONNECTED);
 
 	/* Finally, create the thread for polling data from the actual
 	 * rfcomm socket */
@@ -1298,109 +2473,89 @@ static gboolean ecg_data_setup_serial_pipe(EcgData *self, GError **error)
 static gpointer ecg_data_bluetooth_poller(gpointer user_data)
 {
 	EcgData *self = (EcgData *)user_data;
-	struct timeval tv;
-	fd_set readfs;
-	GError *error = NULL;
+	struct pollfd fds[2];
 
 	gboolean stop_thread = FALSE;
 
 	g_return_val_if_fail(self != NULL, NULL);
 	DEBUG_BEGIN();
 
-	FD_ZERO(&readfs);
-	FD_SET(self->bluetooth_serial_fd, &readfs);
+	fds[0].fd = self->bluetooth_serial_fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = self->poller_wakeup_pipe[0];
+	fds[1].events = POLLIN;
 
 	do {
-		/* Check every N seconds if the polling should be stopped */
-		tv.tv_sec = ECG_DATA_POLLING_STOP_CHECK_INTERVAL;
-		tv.tv_usec = 0;
-
-		switch(select(self->bluetooth_serial_fd + 1,
-					&readfs,
-					NULL, /* Ignore writefds */
-					NULL, /* Ignore exceptfds */
-					&tv))
+		/* No timeout is needed: a disconnect request wakes us up
+		 * through the wakeup pipe */
+		if(poll(fds, 2, -1) == -1)
 		{
-			case -1:
-				g_critical("Select() call failed");
-				stop_thread = TRUE;
-				break;
-			case 0:
-				DEBUG("No data arrived yet");
-				/* There was no data. This is normal */
-				break;
-			default:
-				/* There is data available. Read it, and
-				 * then push to the read pipe. */
-				ecg_data_read_and_push_bluetooth_data(self);
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			g_critical("poll() call failed: %s", strerror(errno));
+			stop_thread = TRUE;
+			break;
 		}
-		if(!stop_thread)
+
+		if(fds[1].revents)
 		{
-			g_mutex_lock(self->connection_status_mutex);
-			stop_thread = (self->connection_status ==
-				ECG_DATA_REQUEST_DISCONNECT);
-			g_mutex_unlock(self->connection_status_mutex);
+			ecg_data_clear_poller_wakeup(self);
 		}
-	} while(!stop_thread);
 
-	DEBUG_LONG("Disconnecting ECG Bluetooth");
+		if(ecg_data_get_connection_status(self) ==
+				ECG_DATA_REQUEST_DISCONNECT)
+		{
+			break;
+		}
 
-	g_mutex_lock(self->connection_status_mutex);
-	self->connection_status = ECG_DATA_DISCONNECTING;
-	g_mutex_unlock(self->connection_status_mutex);
+		if(fds[0].revents & (POLLERR | POLLNVAL))
+		{
+			g_warning("Heart rate monitor connection failed");
+			stop_thread = TRUE;
+		} else if(fds[0].revents & (POLLIN | POLLHUP)) {
+			/* There is data available (or the connection was
+			 * closed, which the read notices). Read it, and
+			 * then push to the queue. */
+			if(!ecg_data_read_and_push_bluetooth_data(self))
+			{
+				stop_thread = TRUE;
+			}
+		}
+	} while(!stop_thread);
 
-	/* Close all the IO channels */
-	DEBUG("Shutting down bluetooth_serial_channel_write");
-	g_io_channel_shutdown(self->bluetooth_serial_channel_write,
-			FALSE, &error);
-	if(error)
-	{
-		g_warning("Error shutting down GIOChannel: %s",
-				error->message);
-		g_error_free(error);
-		error = NULL;
-	}
-	g_io_channel_unref(self->bluetooth_serial_channel_write);
-	self->bluetooth_serial_channel_write = NULL;
+	DEBUG_LONG("Disconnecting ECG Bluetooth");
 
-	DEBUG("Shutting down bluetooth_serial_channel_read");
-	g_io_channel_shutdown(self->bluetooth_serial_channel_read,
-			FALSE, &error);
-	if(error)
-	{
-		g_warning("Error shutting down GIOChannel: %s",
-				error->message);
-		g_error_free(error);
-		error = NULL;
-	}
-	g_io_channel_unref(self->bluetooth_serial_channel_read);
-	self->bluetooth_serial_channel_read = NULL;
+	ecg_data_set_connection_status(self, ECG_DATA_DISCONNECTING);
 
 	shutdown(self->bluetooth_serial_fd, SHUT_RDWR);
+	close(self->bluetooth_serial_fd);
 	self->bluetooth_serial_fd = -1;
 
-	close(self->bluetooth_serial_pipe[0]);
-	close(self->bluetooth_serial_pipe[1]);
-	self->bluetooth_serial_pipe[0] = -1;
-	self->bluetooth_serial_pipe[1] = -1;
-
-	/* Empty the byte arrays */
-	DEBUG("Clearing arrays");
-	if(self->buffer->len > 0)
+	if(self->capture)
 	{
-		g_byte_array_remove_range(self->buffer, 0,
-				self->buffer->len);
+		hrm_capture_writer_close(self->capture);
+		self->capture = NULL;
 	}
-	if(self->voltage_array->len > 0)
+
+	/* Nothing is queued anymore. Let the worker parse what is left. */
+	ecg_data_stop_ingest(self);
+
+	if(stop_thread)
 	{
-		g_byte_array_remove_range(self->voltage_array, 0,
-				self->voltage_array->len);
+		/* The connection was lost (closed by the heart rate monitor,
+		 * or failed) instead of being closed by us. Tell the
+		 * callbacks after the rest of the data, so that the
+		 * connection does not look alive. */
+		ecg_data_post_event(self, ECG_DATA_EVENT_HEART_RATE, -1,
+				NULL);
 	}
-	DEBUG("Cleared arrays");
 
-	g_mutex_lock(self->connection_status_mutex);
-	self->connection_status = ECG_DATA_DISCONNECTED;
-	g_mutex_unlock(self->connection_status_mutex);
+	DEBUG("Buffer peak fill was %d bytes",
+			ring_buffer_get_peak_fill(self->buffer));
+
+	ecg_data_set_connection_status(self, ECG_DATA_DISCONNECTED);
 
 	DEBUG_END();
 	return NULL;
@@ -1408,149 +2563,437 @@ static gpointer ecg_data_bluetooth_poller(gpointer user_data)
 
 static gboolean ecg_data_read_and_push_bluetooth_data(EcgData *self)
 {
-	size_t bufsize = ECG_DATA_READ_BUFFER_SIZE;
 	ssize_t read_size = 0;
-
-	guchar data_len[2];
-	guchar buf[ECG_DATA_READ_BUFFER_SIZE];
+	ChunkQueueChunk *chunk = NULL;
+	guchar discard[CHUNK_QUEUE_CHUNK_SIZE];
+	guchar *target = NULL;
+	gboolean committed = FALSE;
+	gboolean connection_ok = TRUE;
+	struct timeval now;
 
 	g_return_val_if_fail(self != NULL, FALSE);
 	DEBUG_BEGIN();
 
-	read_size = read(self->bluetooth_serial_fd, buf, bufsize);
-	DEBUG("Received %d bytes", read_size);
+	for(;;)
+	{
+		chunk = chunk_queue_get_write_chunk(self->bluetooth_queue);
+
+		/* Read straight into the queue. If the ingest worker is not
+		 * keeping up, read the data anyway so that the socket does
+		 * not stay readable forever. */
+		target = chunk ? chunk->data : discard;
+
+		read_size = read(self->bluetooth_serial_fd, target,
+				CHUNK_QUEUE_CHUNK_SIZE);
+		DEBUG("Received %d bytes", read_size);
+
+		if(read_size > 0)
+		{
+			if(self->capture)
+			{
+				gettimeofday(&now, NULL);
+				hrm_capture_writer_append(self->capture,
+						target, read_size, &now);
+			}
+			if(!chunk)
+			{
+				g_warning("ECG data queue full, dropped %d "
+						"bytes", read_size);
+				continue;
+			}
+			chunk->length = read_size;
+			chunk_queue_commit(self->bluetooth_queue);
+			committed = TRUE;
+			continue;
+		}
+
+		if(read_size == 0)
+		{
+			g_warning("Heart rate monitor closed the connection");
+			connection_ok = FALSE;
+			break;
+		}
+
+		if(errno == EINTR)
+		{
+			continue;
+		}
+
+		if(errno != EAGAIN && errno != EWOULDBLOCK)
+		{
+			g_warning("Reading from heart rate monitor failed: %s",
+					strerror(errno));
+			connection_ok = FALSE;
+		}
+
+		/* Everything available has been read */
+		break;
+	}
 
-	if(read_size < 1)
+	if(committed)
 	{
-		DEBUG_END();
-		return TRUE;
+		ecg_data_notify_ingest(self);
 	}
 
-	data_len[1] = read_size & 0xFF;
-	data_len[0] = read_size >> 8;
+	DEBUG_END();
+	return connection_ok;
+}
+
+/*---------------------------------------------------------------------------*
+ * Ingest worker                                                             *
+ *---------------------------------------------------------------------------*/
+
+static gboolean ecg_data_start_ingest(EcgData *self, GError **error)
+{
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	DEBUG_BEGIN();
 
-	ecg_data_send_data(self->bluetooth_serial_channel_write,
-			data_len, 2, FALSE);
-	ecg_data_send_data(self->bluetooth_serial_channel_write,
-			buf, read_size, TRUE);
+	self->ingest_pending = FALSE;
+	self->ingest_stop = FALSE;
+
+	self->ingest_thread = g_thread_create(
+			ecg_data_ingest_worker,
+			self,
+			TRUE,
+			error);
+	if(!self->ingest_thread)
+	{
+		DEBUG_END();
+		return FALSE;
+	}
 
 	DEBUG_END();
 	return TRUE;
 }
 
-static void ecg_data_receive_data(
-		GIOChannel *channel,
-		guchar *buffer,
-		gsize count)
+static void ecg_data_stop_ingest(EcgData *self)
+{
+	DEBUG_BEGIN();
+
+	if(!self->ingest_thread)
+	{
+		DEBUG_END();
+		return;
+	}
+
+	g_mutex_lock(self->ingest_mutex);
+	self->ingest_stop = TRUE;
+	g_cond_signal(self->ingest_cond);
+	g_mutex_unlock(self->ingest_mutex);
+
+	g_thread_join(self->ingest_thread);
+	self->ingest_thread = NULL;
+
+	DEBUG_END();
+}
+
+static void ecg_data_notify_ingest(EcgData *self)
 {
-	gint read_bytes;
-	gint pos = 0;
+	g_mutex_lock(self->ingest_mutex);
+	self->ingest_pending = TRUE;
+	g_cond_signal(self->ingest_cond);
+	g_mutex_unlock(self->ingest_mutex);
+}
 
-	struct timespec tv;
-	struct timespec rem;
+static gpointer ecg_data_ingest_worker(gpointer user_data)
+{
+	EcgData *self = (EcgData *)user_data;
+	ChunkQueueChunk *chunk = NULL;
+	gboolean stop = FALSE;
 
+	g_return_val_if_fail(self != NULL, NULL);
 	DEBUG_BEGIN();
 
 	do {
-		tv.tv_sec = 1;
-		tv.tv_nsec = 0;
-
-		g_io_channel_read_chars(channel,
-				buffer + pos,
-				count - pos,
-				&read_bytes,
-				NULL);
-		pos = pos + read_bytes;
+		g_mutex_lock(self->ingest_mutex);
+		while(!self->ingest_pending && !self->ingest_stop)
+		{
+			g_cond_wait(self->ingest_cond, self->ingest_mutex);
+		}
+		/* Clear the flag before emptying the queue, so that data
+		 * committed after this point is not left waiting */
+		self->ingest_pending = FALSE;
+		stop = self->ingest_stop;
+		g_mutex_unlock(self->ingest_mutex);
 
-		if(pos < count)
+		while((chunk = chunk_queue_peek(self->bluetooth_queue)) != NULL)
 		{
-			nanosleep(&tv, &rem);
+			/* After the last callback has been removed the data
+			 * is not needed anymore */
+			if(g_atomic_int_get(&self->subscriptions))
+			{
+				ecg_data_push(self, chunk->data, chunk->length);
+			}
+			chunk_queue_release(self->bluetooth_queue);
 		}
-	} while(pos < count);
+	} while(!stop);
 
-	/** @todo error checking */
 	DEBUG_END();
+	return NULL;
 }
 
-static void ecg_data_send_data(
-		GIOChannel *channel,
-		guchar *buf,
-		gssize count,
-		gboolean flush)
+/*---------------------------------------------------------------------------*
+ * Capture and replay                                                        *
+ *---------------------------------------------------------------------------*/
+
+static void ecg_data_start_capture(EcgData *self)
 {
-	struct timespec tv;
-	struct timespec rem;
-	gint position = 0;
-	gsize wrote_size = 0;
+	gchar *capture_file = NULL;
+	GError *error = NULL;
 
 	DEBUG_BEGIN();
 
-	do {
-		tv.tv_sec = 1;
-		tv.tv_nsec = 0;
-
-		g_io_channel_write_chars(
-				channel,
-				buf + position,
-				count - position,
-				&wrote_size,
-				NULL);
+	capture_file = gconf_helper_get_value_string_with_default(
+			self->gconf_helper, ECGC_HRM_CAPTURE_FILE, "");
 
-		position += wrote_size;
-		if(position != wrote_size)
+	if(capture_file && strcmp(capture_file, "") != 0)
+	{
+		/* Capturing is only for debugging, so a failure is not
+		 * fatal */
+		self->capture = hrm_capture_writer_new(capture_file,
+				self->bluetooth_name, &error);
+		if(!self->capture)
 		{
-			nanosleep(&tv, &rem);
+			g_warning("%s", error->message);
+			g_error_free(error);
 		}
-	} while(position != count);
-
-	if(flush)
-	{
-		g_io_channel_flush(channel, NULL);
 	}
 
-	/** @todo error checking */
+	g_free(capture_file);
+
 	DEBUG_END();
 }
 
-static gboolean frwd_parse_heartrate(EcgData *self,gchar* frwd){
-	
-	int i;
-	gint value = 0;
+static gboolean ecg_data_start_replay(
+		EcgData *self,
+		const gchar *path,
+		GError **error)
+{
+	const HrmCaptureHeader *header = NULL;
+	const gchar *device_name = NULL;
+
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 	DEBUG_BEGIN();
 
-	if(self->buffer->len < FRWD_PACKET_SIZE)
+	self->replay = hrm_capture_reader_new(path, error);
+	if(!self->replay)
 	{
 		DEBUG_END();
 		return FALSE;
 	}
-	gchar *decrypt = g_strndup(frwd + 12, 3);
-	for(i = 0; i < 3; i++)
+
+	/* The data is in the format of the device that was captured */
+	header = hrm_capture_reader_get_header(self->replay);
+	device_name = header->device_name;
+	if(device_name[0] == '\0')
 	{
-		decrypt[i] /= 2;
+		device_name = self->bluetooth_name;
 	}
-	value = strtol(decrypt, NULL, 10);
-	
-	if(value < 235 && value > 20)
-	self->hr = value;
-	ecg_data_invoke_callbacks(self,self->hr);
-	g_free(decrypt);
+	if(!ecg_data_set_protocol(self, device_name, error))
+	{
+		hrm_capture_reader_close(self->replay);
+		self->replay = NULL;
+		DEBUG_END();
+		return FALSE;
+	}
+
+	/* Nothing uses the queue or the parser now */
+	ecg_data_reset_parser(self);
+	chunk_queue_reset(self->bluetooth_queue);
+
+	if(!ecg_data_start_ingest(self, error))
+	{
+		hrm_capture_reader_close(self->replay);
+		self->replay = NULL;
+		DEBUG_END();
+		return FALSE;
+	}
+
+	if(self->fixed_replay_file)
+	{
+		self->replay_realtime = self->fixed_replay_realtime;
+	} else {
+		self->replay_realtime =
+			gconf_helper_get_value_bool_with_default(
+					self->gconf_helper,
+					ECGC_HRM_REPLAY_REALTIME, TRUE);
+	}
+	self->replay_data = NULL;
+	self->replay_length = 0;
+	self->replay_position = 0;
+	self->replay_bytes = 0;
+	self->replay_records = 0;
+	self->replay_timer = g_timer_new();
+
+	ecg_data_set_connection_status(self, ECG_DATA_CONNECTED);
+
+	ecg_data_schedule_replay(self, 0);
+
 	DEBUG_END();
 	return TRUE;
+}
+
+static void ecg_data_stop_replay(EcgData *self)
+{
+	gdouble elapsed = 0;
+
+	DEBUG_BEGIN();
+
+	if(self->replay_source_id)
+	{
+		g_source_remove(self->replay_source_id);
+		self->replay_source_id = 0;
+	}
+
+	/* Nothing is queued anymore. Let the worker parse what is left. */
+	ecg_data_stop_ingest(self);
 
+	elapsed = g_timer_elapsed(self->replay_timer, NULL);
+	g_message("Replayed %u records (%" G_GUINT64_FORMAT " bytes, "
+			"%.1f s of capture) in %.3f s: %.0f bytes/s, "
+			"%.1f x real time",
+			self->replay_records,
+			self->replay_bytes,
+			self->replay_position / (gdouble)G_USEC_PER_SEC,
+			elapsed,
+			elapsed > 0 ? self->replay_bytes / elapsed : 0,
+			elapsed > 0 ? self->replay_position /
+				(gdouble)G_USEC_PER_SEC / elapsed : 0);
+
+	g_timer_destroy(self->replay_timer);
+	self->replay_timer = NULL;
+	hrm_capture_reader_close(self->replay);
+	self->replay = NULL;
+
+	ecg_data_set_connection_status(self, ECG_DATA_DISCONNECTED);
+
+	DEBUG_END();
 }
-static gboolean zephyr_parse_heartrate(EcgData *self,gchar* zephyr){
-  
-	int i;
-	gint value = 0;
+
+static gboolean ecg_data_replay(gpointer user_data)
+{
+	EcgData *self = (EcgData *)user_data;
+	const guint8 *data = NULL;
+	guint length = 0;
+	guint32 delay = 0;
+	gint64 elapsed = 0;
+	gint i = 0;
+
+	g_return_val_if_fail(self != NULL, FALSE);
 	DEBUG_BEGIN();
-	if(self->buffer->len < ZEPHYR_PACKET_SIZE)
+
+	self->replay_source_id = 0;
+
+	if(self->replay_realtime)
 	{
-		DEBUG_END();
-		return FALSE;
+		elapsed = (gint64)(g_timer_elapsed(self->replay_timer, NULL) *
+				G_USEC_PER_SEC);
+	}
+
+	/* In a real time replay, queue every record that is due by now */
+	for(i = 0; i < ECG_DATA_REPLAY_BATCH; i++)
+	{
+		if(self->replay_data && !ecg_data_replay_queue_record(self))
+		{
+			/* The ingest worker is not keeping up. Give it
+			 * some time. */
+			ecg_data_schedule_replay(self,
+					ECG_DATA_REPLAY_BACKOFF);
+			DEBUG_END();
+			return FALSE;
+		}
+
+		if(!hrm_capture_reader_next(self->replay, &data, &length,
+					&delay))
+		{
+			goto replay_finished;
+		}
+
+		/* The delay of the first record is from the beginning of
+		 * the capture. The replay starts from the first record. */
+		if(self->replay_records > 0)
+		{
+			self->replay_position += delay;
+		}
+		self->replay_data = data;
+		self->replay_length = length;
+
+		if(self->replay_realtime && self->replay_position > elapsed)
+		{
+			/* The timeout is counted from the start of the
+			 * replay, so that the delays do not accumulate */
+			ecg_data_schedule_replay(self,
+					(self->replay_position - elapsed) /
+					1000);
+			DEBUG_END();
+			return FALSE;
+		}
 	}
-	self->hr = zephyr[12];
-	ecg_data_invoke_callbacks(self,self->hr);
+
+	ecg_data_schedule_replay(self, 0);
+
+	DEBUG_END();
+	return FALSE;
+
+replay_finished:
+	/* Like a closed connection: the callbacks stay, but no more data
+	 * arrives */
+	DEBUG_LONG("Replay finished");
+	ecg_data_stop_replay(self);
 	DEBUG_END();
+	return FALSE;
+}
+
+static void ecg_data_schedule_replay(EcgData *self, guint delay)
+{
+	if(delay == 0 && !self->replay_realtime)
+	{
+		self->replay_source_id = g_idle_add(ecg_data_replay, self);
+	} else {
+		self->replay_source_id = g_timeout_add(delay, ecg_data_replay,
+				self);
+	}
+}
+
+static gboolean ecg_data_replay_queue_record(EcgData *self)
+{
+	ChunkQueueChunk *chunk = NULL;
+	guint length = 0;
+	gboolean committed = FALSE;
+	gboolean complete = TRUE;
+
+	/* A record can be longer than a chunk */
+	while(self->replay_length > 0)
+	{
+		chunk = chunk_queue_get_write_chunk(self->bluetooth_queue);
+		if(!chunk)
+		{
+			complete = FALSE;
+			break;
+		}
+
+		length = MIN(self->replay_length, CHUNK_QUEUE_CHUNK_SIZE);
+		memcpy(chunk->data, self->replay_data, length);
+		chunk->length = length;
+		chunk_queue_commit(self->bluetooth_queue);
+		committed = TRUE;
+
+		self->replay_data += length;
+		self->replay_length -= length;
+		self->replay_bytes += length;
+	}
+
+	if(committed)
+	{
+		ecg_data_notify_ingest(self);
+	}
+
+	if(!complete)
+	{
+		return FALSE;
+	}
+
+	self->replay_data = NULL;
+	self->replay_records++;
 	return TRUE;
-  
 }
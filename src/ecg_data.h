@@ -32,25 +32,74 @@
 
 /* Other modules */
 #include "gconf_helper.h"
+#include "ring_buffer.h"
+#include "chunk_queue.h"
+#include "hrm_scanner.h"
+#include "hrm_protocol.h"
+#include "ecg_sample_block.h"
+#include "acc_sample_block.h"
+#include "hrm_capture.h"
+#include "callback_list.h"
+#include "sample_clock.h"
 
 #define EC_MAX_NUM_EVENTS   20
 
 typedef struct _EcgData EcgData;
 
 /**
- * @brief Type definition for ecg data callback
- *
- * @todo update documentation if required
+ * @brief Type definition for heart rate callback
  *
  * @param self Pointer to #EcgData
- * @param data Ecg data buffer
- * @param offset Start point of the newly arrived data
- * @param len Length of the newly arrived data
+ * @param heart_rate Latest heart rate from the heart rate monitor, or -1
+ * if the connection to the heart rate monitor was lost
  * @param user_data User data that was set for the callback
  */
 typedef void (*EcgDataFunc)
 	(EcgData *self,
-	gint heart_rate, gpointer *user_data);
+	gint heart_rate, gpointer user_data);
+
+/**
+ * @brief Type definition for ECG sample callback
+ *
+ * @param self Pointer to #EcgData
+ * @param block The decoded samples. The block is shared by all the
+ * callbacks, so it must not be modified. Take a reference with
+ * #ecg_sample_block_ref() to use it after the callback has returned.
+ * @param user_data User data that was set for the callback
+ */
+typedef void (*EcgDataSampleFunc)
+	(EcgData *self,
+	 EcgSampleBlock *block,
+	 gpointer user_data);
+
+/**
+ * @brief Type definition for accelerometer sample callback
+ *
+ * @param self Pointer to #EcgData
+ * @param block The samples. The block is shared by all the callbacks, so
+ * it must not be modified. Take a reference with #acc_sample_block_ref()
+ * to use it after the callback has returned.
+ * @param user_data User data that was set for the callback
+ */
+typedef void (*EcgDataAccFunc)
+	(EcgData *self,
+	 AccSampleBlock *block,
+	 gpointer user_data);
+
+/**
+ * @brief Type definition for R-R interval callback
+ *
+ * @param self Pointer to #EcgData
+ * @param intervals The R-R intervals of the new beats in milliseconds,
+ * oldest first. The array is only valid during the callback.
+ * @param count Amount of intervals
+ * @param user_data User data that was set for the callback
+ */
+typedef void (*EcgDataIntervalFunc)
+	(EcgData *self,
+	 const gint *intervals,
+	 gint count,
+	 gpointer user_data);
 
 typedef enum _EcgDataConnectionStatus {
 	ECG_DATA_DISCONNECTED,
@@ -60,18 +109,6 @@ typedef enum _EcgDataConnectionStatus {
 	ECG_DATA_DISCONNECTING
 } EcgDataConnectionStatus;
 
-typedef enum _HRMName{
-	FRWD,
-	ZEPHYR,
-} HRMName;
-/**
- * @brief Struct to hold data for a callback
- */
-typedef struct _EcgDataCallbackData {
-		EcgDataFunc callback;
-		gpointer user_data;
-} EcgDataCallbackData;
-
 struct _EcgData {
 	/**
 	 * @brief Sample rate (in Hz)
@@ -79,23 +116,63 @@ struct _EcgData {
 	 * If you need to retrieve this, use the #ecg_data_get_sample_rate()
 	 * function
 	 */
-	gint sample_rate;
+	volatile gint sample_rate;
 
 	GConfHelperData *gconf_helper;
 
 	/**
 	 * @brief List of callbacks
+	 *
+	 * The callback lists are only used in the main loop.
 	 */
-	GSList *callbacks;
-	
+	CallbackList callbacks;
+
 	/**
-	 * @brief ECG data from the heart rate monitor is in signed char
-	 * format.
-	 *
-	 * If this is needed, connecting to a callback is the right way
-	 * to do it.
+	 * @brief List of sample callbacks
 	 */
-	GByteArray *voltage_array;
+	CallbackList sample_callbacks;
+
+	/**
+	 * @brief Number of samples decoded since the connection was
+	 * established
+	 */
+	guint64 sample_count;
+
+	/** @brief Time stamps of the ECG samples */
+	SampleClock sample_clock;
+
+	/**
+	 * @brief List of accelerometer callbacks
+	 */
+	CallbackList acc_callbacks;
+
+	/**
+	 * @brief Number of accelerometer samples decoded since the
+	 * connection was established
+	 */
+	guint64 acc_sample_count;
+
+	/** @brief Time stamps of the accelerometer samples */
+	SampleClock acc_sample_clock;
+
+	/**
+	 * @brief List of R-R interval callbacks
+	 */
+	CallbackList interval_callbacks;
+
+	/**
+	 * @brief Number of the latest beat of the heart rate monitor, or -1
+	 * if no beat times have been received since the connection was
+	 * established
+	 */
+	gint beat_number;
+
+	/**
+	 * @brief Kinds of data (ECG_DATA_SUBSCRIPTION_* flags) that have
+	 * callbacks, so that the ingest worker does not decode data that
+	 * nobody wants
+	 */
+	volatile gint subscriptions;
 
 	/**
 	 * @brief Time stamps of the events.
@@ -125,11 +202,11 @@ struct _EcgData {
 	guint battery_level;
 
 	/**
-	 * @brief FIFO-like buffer for the ECG data
+	 * @brief FIFO buffer for the ECG data
 	 *
 	 * Consider this field private.
 	 */
-	GByteArray *buffer;
+	RingBuffer *buffer;
 
 	/**
 	 * @brief The sequence number of current data packet.
@@ -142,6 +219,28 @@ struct _EcgData {
 	 */
 	gint current_sequence_number;
 
+	/**
+	 * @brief Number of data blocks in the data chunk that is being
+	 * parsed, or -1 if the chunk header has not been parsed yet
+	 *
+	 * Consider this field private.
+	 */
+	gint chunk_data_block_count;
+
+	/**
+	 * @brief Index of the first unparsed data block in the data chunk
+	 *
+	 * Consider this field private.
+	 */
+	gint chunk_current_data_block;
+
+	/**
+	 * @brief Checksum of the data chunk so far
+	 *
+	 * Consider this field private.
+	 */
+	guint8 chunk_checksum;
+
 	/**
 	 * @brief Last processed location in the buffer.
 	 *
@@ -155,37 +254,160 @@ struct _EcgData {
 
 	gboolean in_sync;
 
+	/** @brief Scanner for the packet headers of the heart rate monitor */
+	HrmScanner frame_scanner;
+
+	/** @brief Scanner for the 0x00 0xFE sync mark of the ECG data */
+	HrmScanner sync_scanner;
+
 	/** @brief Bluetooth address of the ECG device */
 	gchar *bluetooth_address;
 
+	/**
+	 * @brief Whether the device has been set with #ecg_data_set_device()
+	 * instead of taking it from the settings
+	 */
+	gboolean device_fixed;
+
 	/** @brief Whether or not connected to the device */
 	gboolean connected;
 
 	gint bluetooth_serial_fd;
 
-	/** @brief The file descriptors for the Bluetooth serial data pipes */
-	gint bluetooth_serial_pipe[2];
+	/**
+	 * @brief Data read by the poller thread (or the replay), waiting to
+	 * be parsed by the ingest worker
+	 */
+	ChunkQueue *bluetooth_queue;
 
-	/** @brief The writable end of the pipe */
-	GIOChannel *bluetooth_serial_channel_write;
+	/**
+	 * @brief Thread that parses the data of this connection
+	 *
+	 * Every #EcgData has its own worker, so that several heart rate
+	 * monitors can be read at the same time without parsing all of
+	 * them in the main loop. The parser state is only used by the
+	 * worker while it is running.
+	 */
+	GThread *ingest_thread;
 
-	/** @brief The readable end of the pipe */
-	GIOChannel *bluetooth_serial_channel_read;
+	/**
+	 * @brief Protects ingest_pending and ingest_stop. ingest_cond is
+	 * signalled when either of them is set.
+	 */
+	GMutex *ingest_mutex;
+	GCond *ingest_cond;
+
+	/** @brief Whether there is new data in the queue */
+	gboolean ingest_pending;
+
+	/** @brief Whether the worker should stop after emptying the queue */
+	gboolean ingest_stop;
+
+	/**
+	 * @brief Decoded data from the ingest worker, waiting to be given to
+	 * the callbacks in the main loop
+	 */
+	GAsyncQueue *delivery_queue;
+
+	/**
+	 * @brief Whether or not emptying the delivery queue has already been
+	 * scheduled in the main loop
+	 */
+	volatile gint delivery_scheduled;
+
+	/** @brief Arrival time of the event that is being delivered */
+	gint64 event_time;
+
+	/**
+	 * @brief Serial number of the connection. It changes whenever a
+	 * connection is opened or closed, so that events of a closed
+	 * connection are not delivered.
+	 */
+	volatile gint connection_serial;
 
-	/** @brief The watch id for the readable end of the pipe */
-	guint bluetooth_serial_channel_read_watch_id;
+	/** @brief Connection serial of the event that is being delivered */
+	gint event_connection_serial;
 
 	/** @brief Thread for reading data from the rfcomm device */
 	GThread *bluetooth_poll_thread;
 
-	/** @brief Connection status */
-	EcgDataConnectionStatus connection_status;
+	/**
+	 * @brief Connection status (an #EcgDataConnectionStatus)
+	 *
+	 * This is read with atomic operations. It is changed only while
+	 * holding connection_status_mutex, and every change is signalled
+	 * with connection_status_cond.
+	 */
+	volatile gint connection_status;
 	GMutex *connection_status_mutex;
+	GCond *connection_status_cond;
+
+	/**
+	 * @brief Pipe for waking up the poller thread.
+	 *
+	 * The poller waits for this in addition to the rfcomm socket, so
+	 * that a disconnect request is noticed immediately.
+	 */
+	gint poller_wakeup_pipe[2];
 	
 	gint hr;
 	
 	gchar *bluetooth_name;
-	HRMName *hrm_name;
+
+	/** @brief Protocol of the heart rate monitor */
+	const HrmProtocol *protocol;
+
+	/**
+	 * @brief Capture file for the data read from the heart rate
+	 * monitor, or NULL if not capturing.
+	 *
+	 * This is only used by the poller thread while it is running.
+	 */
+	HrmCaptureWriter *capture;
+
+	/**
+	 * @brief Capture file that is being replayed instead of reading
+	 * from the heart rate monitor, or NULL
+	 */
+	HrmCaptureReader *replay;
+
+	/** @brief G source ID of the replay */
+	guint replay_source_id;
+
+	/** @brief Whether the capture is replayed in real time */
+	gboolean replay_realtime;
+
+	/**
+	 * @brief Capture to replay, set with #ecg_data_set_replay(), or NULL
+	 * to use the settings
+	 */
+	gchar *fixed_replay_file;
+	gboolean fixed_replay_realtime;
+
+	/** @brief Record (or the rest of it) that will be queued next */
+	const guint8 *replay_data;
+	guint replay_length;
+
+	/**
+	 * @brief Position of the replay in the capture and the time it has
+	 * taken so far, in microseconds
+	 */
+	gint64 replay_position;
+	GTimer *replay_timer;
+
+	/** @brief Amount of bytes and records replayed */
+	guint64 replay_bytes;
+	guint replay_records;
+
+	/**
+	 * @brief Unix domain socket to read instead of the heart rate
+	 * monitor, set with #ecg_data_set_socket(), or NULL
+	 */
+	gchar *fixed_socket_path;
+
+	/** @brief Name of the device behind fixed_socket_path */
+	gchar *fixed_socket_name;
+
 	gint hr1,hr2,hr3,count;
 };
 
@@ -197,9 +419,63 @@ struct _EcgData {
  */
 EcgData *ecg_data_new(GConfHelperData *gconf_helper);
 
+/**
+ * @brief Use the given heart rate monitor instead of the one in the
+ * settings
+ *
+ * This makes it possible to read several heart rate monitors at the same
+ * time, each with its own #EcgData. This must be called before adding
+ * the first callback.
+ *
+ * @param self Pointer to #EcgData
+ * @param bluetooth_address Bluetooth address of the heart rate monitor
+ * @param bluetooth_name Bluetooth name of the heart rate monitor (used to
+ * find out the protocol)
+ */
+void ecg_data_set_device(
+		EcgData *self,
+		const gchar *bluetooth_address,
+		const gchar *bluetooth_name);
+
+/**
+ * @brief Replay a capture instead of the replay file in the settings
+ *
+ * This must be called before adding the first callback.
+ *
+ * @param self Pointer to #EcgData
+ * @param path Path of the capture (see #HrmCaptureReader), or NULL to use
+ * the settings again
+ * @param realtime Whether to replay at the original speed, or as fast as
+ * possible
+ */
+void ecg_data_set_replay(
+		EcgData *self,
+		const gchar *path,
+		gboolean realtime);
+
+/**
+ * @brief Read a Unix domain socket instead of the heart rate monitor
+ *
+ * The socket is read exactly as the RFCOMM socket of a heart rate
+ * monitor would be, so that the connection can be tested against a
+ * stand-in device. A replay (see #ecg_data_set_replay()) is still used
+ * instead, if set. This must be called before adding the first callback.
+ *
+ * @param self Pointer to #EcgData
+ * @param path Path of the socket, or NULL to use Bluetooth again
+ * @param device_name Name of the device (used to find out the protocol)
+ */
+void ecg_data_set_socket(
+		EcgData *self,
+		const gchar *path,
+		const gchar *device_name);
+
 /**
  * @brief Add a callback that is invoked when new ECG data arrives.
  *
+ * The data is read and parsed in threads of the #EcgData, but all the
+ * callbacks are invoked in the main loop.
+ *
  * @note Whenever there are callbacks registered, the connection to ECG
  * device is established and data polling started. Therefore, adding a
  * callback might sometimes last a considerable amount of time, and it might
@@ -242,6 +518,122 @@ void ecg_data_remove_callback_ecg(
 		EcgDataFunc callback,
 		gpointer user_data);
 
+/**
+ * @brief Add a callback that is invoked with the decoded ECG samples.
+ *
+ * The samples are delivered in blocks as they arrive from the ECG
+ * monitor. Only ECG monitors (not plain heart rate monitors) send
+ * samples.
+ *
+ * The connection to the ECG device is established when the first
+ * callback of any kind is added, see #ecg_data_add_callback_ecg.
+ *
+ * @param self Pointer to #EcgData
+ * @param callback Function to be called
+ * @param user_data User data pointer passed to the callback
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean ecg_data_add_callback_samples(
+		EcgData *self,
+		EcgDataSampleFunc callback,
+		gpointer user_data,
+		GError **error);
+
+/**
+ * @brief Remove a sample callback.
+ *
+ * If a parameter is NULL, it is considered to be a wildcard.
+ *
+ * @note When the last callback of any kind is removed, connection to
+ * ECG device is closed and data polling stopped.
+ *
+ * @param self Pointer to #EcgData (must not be NULL)
+ * @param callback Callback function
+ * @param user_data User data that was passed to the callback
+ */
+void ecg_data_remove_callback_samples(
+		EcgData *self,
+		EcgDataSampleFunc callback,
+		gpointer user_data);
+
+/**
+ * @brief Add a callback that is invoked with the accelerometer samples.
+ *
+ * Only some ECG monitors have an accelerometer. The connection to the
+ * ECG device is established when the first callback of any kind is
+ * added, see #ecg_data_add_callback_ecg.
+ *
+ * @param self Pointer to #EcgData
+ * @param callback Function to be called
+ * @param user_data User data pointer passed to the callback
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean ecg_data_add_callback_acc(
+		EcgData *self,
+		EcgDataAccFunc callback,
+		gpointer user_data,
+		GError **error);
+
+/**
+ * @brief Remove an accelerometer callback.
+ *
+ * If a parameter is NULL, it is considered to be a wildcard.
+ *
+ * @note When the last callback of any kind is removed, connection to ECG
+ * device is closed and data polling stopped.
+ *
+ * @param self Pointer to #EcgData (must not be NULL)
+ * @param callback Callback function
+ * @param user_data User data that was passed to the callback
+ */
+void ecg_data_remove_callback_acc(
+		EcgData *self,
+		EcgDataAccFunc callback,
+		gpointer user_data);
+
+/**
+ * @brief Add a callback that is invoked with the R-R intervals measured by
+ * the heart rate monitor.
+ *
+ * Only some heart rate monitors (such as Zephyr HxM) send the times of the
+ * beats. For ECG monitors, the intervals are found by #BeatDetector. The
+ * connection to the ECG device is established when the first callback of
+ * any kind is added, see #ecg_data_add_callback_ecg.
+ *
+ * @param self Pointer to #EcgData
+ * @param callback Function to be called
+ * @param user_data User data pointer passed to the callback
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean ecg_data_add_callback_intervals(
+		EcgData *self,
+		EcgDataIntervalFunc callback,
+		gpointer user_data,
+		GError **error);
+
+/**
+ * @brief Remove an R-R interval callback.
+ *
+ * If a parameter is NULL, it is considered to be a wildcard.
+ *
+ * @note When the last callback of any kind is removed, connection to ECG
+ * device is closed and data polling stopped.
+ *
+ * @param self Pointer to #EcgData (must not be NULL)
+ * @param callback Callback function
+ * @param user_data User data that was passed to the callback
+ */
+void ecg_data_remove_callback_intervals(
+		EcgData *self,
+		EcgDataIntervalFunc callback,
+		gpointer user_data);
+
 /**
  * @brief Retrieve sample rate.
  *
@@ -275,4 +667,31 @@ gint ecg_data_get_units_per_mv(EcgData *self);
  */
 gint ecg_data_get_zero_level(EcgData *self);
 
+/**
+ * @brief Retrieve the peak fill level of the incoming data buffer
+ *
+ * This tells how much unparsed data has been waiting in the buffer at
+ * most. If it gets close to the buffer capacity, data has probably been
+ * dropped.
+ *
+ * @param self Pointer to #EcgData
+ *
+ * @return Peak fill level in bytes
+ */
+guint ecg_data_get_buffer_peak_fill(EcgData *self);
+
+/**
+ * @brief Get the time when the data of the event that is being delivered
+ * arrived from the heart rate monitor. Every callback of the event gets
+ * the same time, however long the earlier callbacks take.
+ *
+ * This is only meaningful in the callbacks. The sample callbacks should
+ * use the time of the block instead.
+ *
+ * @param self Pointer to #EcgData
+ *
+ * @return Time in the time base of sample_clock.h
+ */
+gint64 ecg_data_get_event_time(EcgData *self);
+
 #endif /* _ECG_DATA_H */
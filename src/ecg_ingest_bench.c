@@ -0,0 +1,412 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*
+ * Benchmark for the ingest path of EcgData.
+ *
+ * A synthetic Alive ECG stream (ECG at 300 Hz and a 3-axis accelerometer)
+ * is written to a capture file, and the capture is replayed as fast as
+ * possible by 1, 2, 4, ... EcgData objects at the same time, as if that
+ * many heart rate monitors were connected. Every EcgData parses its data
+ * in its own ingest worker, so the throughput should grow with the number
+ * of straps until the cores (or the main loop, which delivers the
+ * decoded data) are saturated.
+ *
+ * Usage: ecg_ingest_bench [max straps] [minutes of data per strap]
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* System */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* GLib */
+#include <glib.h>
+#include <glib-object.h>
+
+/* Other modules */
+#include "ec_error.h"
+#include "ecg_data.h"
+#include "gconf_helper.h"
+#include "gconf_keys.h"
+#include "hrm_capture.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define ECG_INGEST_BENCH_DEFAULT_STRAPS		8
+#define ECG_INGEST_BENCH_DEFAULT_MINUTES	10
+
+/* One data chunk of the synthetic stream per 200 ms */
+#define ECG_INGEST_BENCH_CHUNK_INTERVAL		200000
+#define ECG_INGEST_BENCH_ECG_SAMPLES		60
+#define ECG_INGEST_BENCH_ACC_SAMPLES		15
+#define ECG_INGEST_BENCH_ACC_AXES		3
+
+#define ECG_INGEST_BENCH_CHUNK_HEADER_LEN	6
+#define ECG_INGEST_BENCH_BLOCK_HEADER_LEN	5
+
+/*****************************************************************************
+ * Data structures                                                           *
+ *****************************************************************************/
+
+typedef struct _EcgIngestBench {
+	GMainLoop *main_loop;
+
+	/** @brief Samples each strap should deliver */
+	guint64 expected_samples;
+
+	/** @brief Straps that have not yet delivered all the samples */
+	guint straps_running;
+} EcgIngestBench;
+
+typedef struct _EcgIngestBenchStrap {
+	EcgIngestBench *bench;
+	EcgData *ecg_data;
+	guint64 samples;
+	guint64 acc_samples;
+} EcgIngestBenchStrap;
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Write the synthetic stream to a capture file
+ *
+ * @param path Path of the capture file
+ * @param chunk_count Number of data chunks to write
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean ecg_ingest_bench_write_capture(
+		const gchar *path,
+		guint chunk_count,
+		GError **error);
+
+/**
+ * @brief Build one data chunk of the synthetic stream
+ *
+ * @param chunk Buffer for the chunk (long enough)
+ * @param sequence_number Sequence number of the chunk
+ *
+ * @return Length of the chunk
+ */
+static guint ecg_ingest_bench_build_chunk(
+		guint8 *chunk,
+		guint sequence_number);
+
+/**
+ * @brief Replay the capture with the given number of straps at once
+ *
+ * @param gconf_helper Pointer to #GConfHelperData
+ * @param path Path of the capture file
+ * @param strap_count Number of straps
+ * @param expected_samples ECG samples in the capture
+ * @param capture_bytes Size of the capture data
+ */
+static void ecg_ingest_bench_run(
+		GConfHelperData *gconf_helper,
+		const gchar *path,
+		guint strap_count,
+		guint64 expected_samples,
+		guint64 capture_bytes);
+
+static void ecg_ingest_bench_samples_arrived(
+		EcgData *ecg_data,
+		EcgSampleBlock *block,
+		gpointer user_data);
+
+static void ecg_ingest_bench_acc_arrived(
+		EcgData *ecg_data,
+		AccSampleBlock *block,
+		gpointer user_data);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+int main(int argc, char **argv)
+{
+	GConfHelperData *gconf_helper = NULL;
+	GError *error = NULL;
+	gchar *path = NULL;
+	guint8 chunk[1024];
+	guint max_straps = ECG_INGEST_BENCH_DEFAULT_STRAPS;
+	guint minutes = ECG_INGEST_BENCH_DEFAULT_MINUTES;
+	guint chunk_count = 0;
+	guint strap_count = 0;
+	gint fd = -1;
+
+	if(argc > 1)
+	{
+		max_straps = MAX(atoi(argv[1]), 1);
+	}
+	if(argc > 2)
+	{
+		minutes = MAX(atoi(argv[2]), 1);
+	}
+
+	g_thread_init(NULL);
+	g_type_init();
+
+	fd = g_file_open_tmp("ecg_ingest_bench-XXXXXX", &path, &error);
+	if(fd == -1)
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return 1;
+	}
+	close(fd);
+
+	chunk_count = minutes * 60 * (G_USEC_PER_SEC /
+			ECG_INGEST_BENCH_CHUNK_INTERVAL);
+	if(!ecg_ingest_bench_write_capture(path, chunk_count, &error))
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		unlink(path);
+		g_free(path);
+		return 1;
+	}
+
+	gconf_helper = gconf_helper_new(ECGC_BASE_DIR);
+
+	g_print("%u minutes of ECG and accelerometer data per strap\n",
+			minutes);
+	g_print("%6s %10s %12s %14s %10s\n", "straps", "time (s)", "MB/s",
+			"samples/s", "x realtime");
+
+	for(strap_count = 1; strap_count <= max_straps; strap_count *= 2)
+	{
+		ecg_ingest_bench_run(gconf_helper, path, strap_count,
+				(guint64)chunk_count *
+				ECG_INGEST_BENCH_ECG_SAMPLES,
+				(guint64)chunk_count *
+				ecg_ingest_bench_build_chunk(chunk, 0));
+	}
+
+	unlink(path);
+	g_free(path);
+	return 0;
+}
+
+/*****************************************************************************
+ * Private functions                                                         *
+ *****************************************************************************/
+
+static gboolean ecg_ingest_bench_write_capture(
+		const gchar *path,
+		guint chunk_count,
+		GError **error)
+{
+	HrmCaptureWriter *writer = NULL;
+	guint8 chunk[1024];
+	struct timeval time = { 0, 0 };
+	guint length = 0;
+	guint i = 0;
+
+	/* The device name selects the protocol when replaying */
+	writer = hrm_capture_writer_new(path, "ALIVE benchmark", error);
+	if(!writer)
+	{
+		return FALSE;
+	}
+
+	for(i = 0; i < chunk_count; i++)
+	{
+		length = ecg_ingest_bench_build_chunk(chunk, i);
+		if(!hrm_capture_writer_append(writer, chunk, length, &time))
+		{
+			g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+					"Unable to write the capture");
+			hrm_capture_writer_close(writer);
+			return FALSE;
+		}
+
+		time.tv_usec += ECG_INGEST_BENCH_CHUNK_INTERVAL;
+		if(time.tv_usec >= G_USEC_PER_SEC)
+		{
+			time.tv_sec++;
+			time.tv_usec -= G_USEC_PER_SEC;
+		}
+	}
+
+	hrm_capture_writer_close(writer);
+	return TRUE;
+}
+
+static guint ecg_ingest_bench_build_chunk(
+		guint8 *chunk,
+		guint sequence_number)
+{
+	guint length = 0;
+	guint block_length = 0;
+	guint8 checksum = 0;
+	guint i = 0;
+	guint sample = 0;
+
+	/* Chunk header: sync mark, battery level, 12-bit sequence number,
+	 * number of data blocks */
+	chunk[length++] = 0x00;
+	chunk[length++] = 0xFE;
+	chunk[length++] = 180;
+	chunk[length++] = (sequence_number >> 8) & 0x0F;
+	chunk[length++] = sequence_number & 0xFF;
+	chunk[length++] = 2;
+
+	/* ECG block at 300 Hz: a beat (a spike) every 200 samples */
+	block_length = ECG_INGEST_BENCH_BLOCK_HEADER_LEN +
+		ECG_INGEST_BENCH_ECG_SAMPLES;
+	chunk[length++] = 0xAA;
+	chunk[length++] = block_length >> 8;
+	chunk[length++] = block_length & 0xFF;
+	chunk[length++] = 0x02;
+	chunk[length++] = 0x00;
+	for(i = 0; i < ECG_INGEST_BENCH_ECG_SAMPLES; i++)
+	{
+		sample = (sequence_number * ECG_INGEST_BENCH_ECG_SAMPLES + i)
+			% 200;
+		chunk[length++] = sample < 4 ? 128 + 60 * (4 - sample) / 4 :
+			128 + (sample % 7);
+	}
+
+	/* Interleaved 3-axis accelerometer block at 75 Hz */
+	block_length = ECG_INGEST_BENCH_BLOCK_HEADER_LEN +
+		ECG_INGEST_BENCH_ACC_SAMPLES * ECG_INGEST_BENCH_ACC_AXES;
+	chunk[length++] = 0x56;
+	chunk[length++] = block_length >> 8;
+	chunk[length++] = block_length & 0xFF;
+	chunk[length++] = 0x00;
+	chunk[length++] = 0x00;
+	for(i = 0; i < ECG_INGEST_BENCH_ACC_SAMPLES *
+			ECG_INGEST_BENCH_ACC_AXES; i++)
+	{
+		chunk[length++] = 128 + (i % ECG_INGEST_BENCH_ACC_AXES) * 10 +
+			(sequence_number & 0x07);
+	}
+
+	/* The checksum is the sum of all the other bytes of the chunk */
+	for(i = 0; i < length; i++)
+	{
+		checksum += chunk[i];
+	}
+	chunk[length++] = checksum;
+
+	return length;
+}
+
+static void ecg_ingest_bench_run(
+		GConfHelperData *gconf_helper,
+		const gchar *path,
+		guint strap_count,
+		guint64 expected_samples,
+		guint64 capture_bytes)
+{
+	EcgIngestBench bench;
+	EcgIngestBenchStrap *straps = NULL;
+	GError *error = NULL;
+	GTimer *timer = NULL;
+	gdouble elapsed = 0;
+	guint i = 0;
+
+	bench.main_loop = g_main_loop_new(NULL, FALSE);
+	bench.expected_samples = expected_samples;
+	bench.straps_running = strap_count;
+
+	straps = g_new0(EcgIngestBenchStrap, strap_count);
+	timer = g_timer_new();
+
+	for(i = 0; i < strap_count; i++)
+	{
+		straps[i].bench = &bench;
+		straps[i].ecg_data = ecg_data_new(gconf_helper);
+		ecg_data_set_replay(straps[i].ecg_data, path, FALSE);
+
+		if(!ecg_data_add_callback_samples(straps[i].ecg_data,
+					ecg_ingest_bench_samples_arrived,
+					&straps[i], &error) ||
+		   !ecg_data_add_callback_acc(straps[i].ecg_data,
+					ecg_ingest_bench_acc_arrived,
+					&straps[i], &error))
+		{
+			g_printerr("%s\n", error->message);
+			exit(1);
+		}
+	}
+
+	g_main_loop_run(bench.main_loop);
+	elapsed = g_timer_elapsed(timer, NULL);
+
+	g_print("%6u %10.3f %12.2f %14.0f %10.1f\n",
+			strap_count,
+			elapsed,
+			strap_count * capture_bytes / elapsed / (1024 * 1024),
+			strap_count * expected_samples / elapsed,
+			expected_samples / 300.0 / elapsed);
+
+	for(i = 0; i < strap_count; i++)
+	{
+		ecg_data_destroy(straps[i].ecg_data);
+	}
+
+	g_timer_destroy(timer);
+	g_free(straps);
+	g_main_loop_unref(bench.main_loop);
+}
+
+static void ecg_ingest_bench_samples_arrived(
+		EcgData *ecg_data,
+		EcgSampleBlock *block,
+		gpointer user_data)
+{
+	EcgIngestBenchStrap *strap = (EcgIngestBenchStrap *)user_data;
+
+	strap->samples += block->length;
+
+	if(strap->samples == strap->bench->expected_samples)
+	{
+		strap->bench->straps_running--;
+		if(strap->bench->straps_running == 0)
+		{
+			g_main_loop_quit(strap->bench->main_loop);
+		}
+	}
+}
+
+static void ecg_ingest_bench_acc_arrived(
+		EcgData *ecg_data,
+		AccSampleBlock *block,
+		gpointer user_data)
+{
+	EcgIngestBenchStrap *strap = (EcgIngestBenchStrap *)user_data;
+
+	strap->acc_samples += block->length;
+}
@@ -0,0 +1,655 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*
+ * Benchmark for the hop between the Bluetooth poller thread of EcgData and
+ * the thread that parses the data.
+ *
+ * Packets are handed from one thread to another, first the way EcgData
+ * used to hand them (a 2-byte length and the payload written to a pipe,
+ * and read back from it after poll(), as the unbuffered GIOChannel of the
+ * main loop did), and then the way it does now (the payload committed to
+ * a ChunkQueue, and the consumer woken up through a GCond). Every packet
+ * carries the time it was sent, so that the consumer can tell how late it
+ * arrived. For both ways the number of read() and write() calls (from
+ * /proc/self/io) and of context switches per packet is printed, as well
+ * as the mean, the 99th percentile and the maximum of the latency.
+ *
+ * The exit status is 0 if all the packets arrived in order, 1 if not.
+ *
+ * Usage: ecg_queue_bench [packets] [interval in us] [packet size]
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* System */
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "chunk_queue.h"
+#include "sample_clock.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define ECG_QUEUE_BENCH_DEFAULT_PACKETS		20000
+#define ECG_QUEUE_BENCH_DEFAULT_INTERVAL	200
+#define ECG_QUEUE_BENCH_DEFAULT_SIZE		128
+
+/** @brief Same as the queue of EcgData */
+#define ECG_QUEUE_BENCH_QUEUE_CHUNKS		64
+
+/** @brief Time stamp and sequence number at the start of each packet */
+#define ECG_QUEUE_BENCH_HEADER_LEN		(sizeof(gint64) + sizeof(guint))
+
+/*****************************************************************************
+ * Data structures                                                           *
+ *****************************************************************************/
+
+typedef struct _EcgQueueBench {
+	guint packet_count;
+	guint interval;
+	guint packet_size;
+
+	/** @brief Latency of each packet, in microseconds */
+	gint64 *latencies;
+
+	/** @brief Packets that arrived */
+	guint received;
+
+	/** @brief Sequence number the next packet should have at least */
+	guint next_sequence_number;
+
+	/** @brief Packets that arrived out of order or damaged */
+	guint errors;
+
+	/** @brief Packets the producer dropped because the queue was full */
+	guint dropped;
+
+	/* The old way */
+	gint pipe_fds[2];
+
+	/* The new way */
+	ChunkQueue *queue;
+	GMutex *mutex;
+	GCond *cond;
+	gboolean pending;
+	gboolean stop;
+} EcgQueueBench;
+
+typedef struct _EcgQueueBenchCounters {
+	guint64 syscalls;
+	glong context_switches;
+} EcgQueueBenchCounters;
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Read the number of read() and write() calls, and of context
+ * switches, of the process so far
+ *
+ * @param counters Return location for the counters
+ *
+ * @return TRUE if the number of calls is known, FALSE if not
+ */
+static gboolean ecg_queue_bench_get_counters(
+		EcgQueueBenchCounters *counters);
+
+/**
+ * @brief Fill a packet
+ *
+ * @param self Pointer to #EcgQueueBench
+ * @param packet Buffer of packet_size bytes
+ * @param sequence_number Sequence number of the packet
+ */
+static void ecg_queue_bench_build_packet(
+		EcgQueueBench *self,
+		guint8 *packet,
+		guint sequence_number);
+
+/**
+ * @brief Check a packet that arrived and store its latency
+ *
+ * @param self Pointer to #EcgQueueBench
+ * @param packet The packet
+ * @param length Length of the packet
+ */
+static void ecg_queue_bench_receive_packet(
+		EcgQueueBench *self,
+		const guint8 *packet,
+		guint length);
+
+/**
+ * @brief Wait until the time the next packet is due
+ *
+ * @param due Time when the packet is due, as from sample_clock_now()
+ */
+static void ecg_queue_bench_wait(gint64 due);
+
+/**
+ * @brief Hand the packets over a pipe
+ *
+ * @param self Pointer to #EcgQueueBench
+ *
+ * @return TRUE on success, FALSE if the pipe could not be created
+ */
+static gboolean ecg_queue_bench_run_pipe(EcgQueueBench *self);
+
+/**
+ * @brief Consumer thread of the pipe
+ *
+ * @param user_data Pointer to #EcgQueueBench
+ *
+ * @return NULL
+ */
+static gpointer ecg_queue_bench_pipe_consumer(gpointer user_data);
+
+/**
+ * @brief Read exactly the given amount of data from the pipe
+ *
+ * @param fd The read end of the pipe
+ * @param buf Buffer for the data
+ * @param length Amount of data to read
+ *
+ * @return TRUE on success, FALSE if the pipe was closed
+ */
+static gboolean ecg_queue_bench_pipe_read(gint fd, guint8 *buf, guint length);
+
+/**
+ * @brief Hand the packets over a ChunkQueue
+ *
+ * @param self Pointer to #EcgQueueBench
+ *
+ * @return TRUE
+ */
+static gboolean ecg_queue_bench_run_queue(EcgQueueBench *self);
+
+/**
+ * @brief Consumer thread of the queue
+ *
+ * @param user_data Pointer to #EcgQueueBench
+ *
+ * @return NULL
+ */
+static gpointer ecg_queue_bench_queue_consumer(gpointer user_data);
+
+/**
+ * @brief Run one of the ways and print the results
+ *
+ * @param self Pointer to #EcgQueueBench
+ * @param name Name of the way
+ * @param run Function that hands the packets over
+ *
+ * @return TRUE if all the packets arrived in order, FALSE if not
+ */
+static gboolean ecg_queue_bench_run(
+		EcgQueueBench *self,
+		const gchar *name,
+		gboolean (*run)(EcgQueueBench *self));
+
+/**
+ * @brief Compare two latencies for qsort()
+ */
+static gint ecg_queue_bench_compare_latencies(
+		gconstpointer a,
+		gconstpointer b);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+int main(int argc, char **argv)
+{
+	EcgQueueBench bench;
+	gboolean ok = TRUE;
+
+	memset(&bench, 0, sizeof(bench));
+	bench.packet_count = ECG_QUEUE_BENCH_DEFAULT_PACKETS;
+	bench.interval = ECG_QUEUE_BENCH_DEFAULT_INTERVAL;
+	bench.packet_size = ECG_QUEUE_BENCH_DEFAULT_SIZE;
+
+	if(argc > 1)
+	{
+		bench.packet_count = MAX(atoi(argv[1]), 1);
+	}
+	if(argc > 2)
+	{
+		bench.interval = MAX(atoi(argv[2]), 0);
+	}
+	if(argc > 3)
+	{
+		bench.packet_size = CLAMP(atoi(argv[3]),
+				(gint)ECG_QUEUE_BENCH_HEADER_LEN,
+				CHUNK_QUEUE_CHUNK_SIZE);
+	}
+
+	g_thread_init(NULL);
+
+	bench.latencies = g_new0(gint64, bench.packet_count);
+
+	g_print("%u packets of %u bytes, one per %u us\n",
+			bench.packet_count, bench.packet_size, bench.interval);
+	g_print("%-6s %10s %12s %10s %10s %10s %8s\n", "", "syscalls/p",
+			"switches/p", "mean (us)", "99% (us)", "max (us)",
+			"dropped");
+
+	ok = ecg_queue_bench_run(&bench, "pipe", ecg_queue_bench_run_pipe) &&
+		ok;
+	ok = ecg_queue_bench_run(&bench, "queue", ecg_queue_bench_run_queue) &&
+		ok;
+
+	g_free(bench.latencies);
+
+	if(!ok)
+	{
+		g_print("some packets did not arrive in order\n");
+		return 1;
+	}
+	return 0;
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static gboolean ecg_queue_bench_get_counters(
+		EcgQueueBenchCounters *counters)
+{
+	struct rusage usage;
+	gchar *contents = NULL;
+	gchar **lines = NULL;
+	guint64 value = 0;
+	gboolean found = FALSE;
+	gint i = 0;
+
+	getrusage(RUSAGE_SELF, &usage);
+	counters->context_switches = usage.ru_nvcsw + usage.ru_nivcsw;
+
+	/* Counts the calls of all the threads, also those that have
+	 * exited */
+	counters->syscalls = 0;
+	if(!g_file_get_contents("/proc/self/io", &contents, NULL, NULL))
+	{
+		return FALSE;
+	}
+
+	lines = g_strsplit(contents, "\n", 0);
+	for(i = 0; lines[i]; i++)
+	{
+		if(sscanf(lines[i], "syscr: %" G_GUINT64_FORMAT, &value) == 1 ||
+		   sscanf(lines[i], "syscw: %" G_GUINT64_FORMAT, &value) == 1)
+		{
+			counters->syscalls += value;
+			found = TRUE;
+		}
+	}
+
+	g_strfreev(lines);
+	g_free(contents);
+	return found;
+}
+
+static void ecg_queue_bench_build_packet(
+		EcgQueueBench *self,
+		guint8 *packet,
+		guint sequence_number)
+{
+	gint64 now = 0;
+	guint i = 0;
+
+	for(i = ECG_QUEUE_BENCH_HEADER_LEN; i < self->packet_size; i++)
+	{
+		packet[i] = (guint8)(sequence_number + i);
+	}
+
+	now = sample_clock_now();
+	memcpy(packet, &now, sizeof(now));
+	memcpy(packet + sizeof(now), &sequence_number,
+			sizeof(sequence_number));
+}
+
+static void ecg_queue_bench_receive_packet(
+		EcgQueueBench *self,
+		const guint8 *packet,
+		guint length)
+{
+	gint64 now = sample_clock_now();
+	gint64 sent = 0;
+	guint sequence_number = 0;
+	guint i = 0;
+
+	memcpy(&sent, packet, sizeof(sent));
+	memcpy(&sequence_number, packet + sizeof(sent),
+			sizeof(sequence_number));
+
+	if(length != self->packet_size ||
+	   sequence_number < self->next_sequence_number ||
+	   sequence_number >= self->packet_count)
+	{
+		self->errors++;
+		return;
+	}
+	for(i = ECG_QUEUE_BENCH_HEADER_LEN; i < length; i++)
+	{
+		if(packet[i] != (guint8)(sequence_number + i))
+		{
+			self->errors++;
+			return;
+		}
+	}
+
+	self->next_sequence_number = sequence_number + 1;
+	self->latencies[self->received++] = now - sent;
+}
+
+static void ecg_queue_bench_wait(gint64 due)
+{
+	gint64 now = sample_clock_now();
+
+	if(due > now)
+	{
+		g_usleep(due - now);
+	}
+}
+
+/*---------------------------------------------------------------------------*
+ * The old way                                                               *
+ *---------------------------------------------------------------------------*/
+
+static gboolean ecg_queue_bench_run_pipe(EcgQueueBench *self)
+{
+	GThread *consumer = NULL;
+	guint8 packet[CHUNK_QUEUE_CHUNK_SIZE];
+	guint16 length = self->packet_size;
+	gint64 due = 0;
+	guint i = 0;
+
+	if(pipe(self->pipe_fds) == -1)
+	{
+		g_printerr("Unable to create a pipe: %s\n", strerror(errno));
+		return FALSE;
+	}
+
+	consumer = g_thread_create(ecg_queue_bench_pipe_consumer, self, TRUE,
+			NULL);
+
+	due = sample_clock_now();
+	for(i = 0; i < self->packet_count; i++)
+	{
+		ecg_queue_bench_wait(due);
+		due += self->interval;
+
+		ecg_queue_bench_build_packet(self, packet, i);
+		if(write(self->pipe_fds[1], &length, sizeof(length)) !=
+				sizeof(length) ||
+		   write(self->pipe_fds[1], packet, length) != length)
+		{
+			g_printerr("Unable to write to the pipe: %s\n",
+					strerror(errno));
+			break;
+		}
+	}
+
+	close(self->pipe_fds[1]);
+	g_thread_join(consumer);
+	close(self->pipe_fds[0]);
+
+	return TRUE;
+}
+
+static gpointer ecg_queue_bench_pipe_consumer(gpointer user_data)
+{
+	EcgQueueBench *self = (EcgQueueBench *)user_data;
+	guint8 packet[CHUNK_QUEUE_CHUNK_SIZE];
+	guint16 length = 0;
+	struct pollfd fds;
+
+	fds.fd = self->pipe_fds[0];
+	fds.events = POLLIN;
+
+	for(;;)
+	{
+		/* The main loop polled the pipe */
+		if(poll(&fds, 1, -1) == -1)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			break;
+		}
+
+		if(!ecg_queue_bench_pipe_read(fds.fd, (guint8 *)&length,
+					sizeof(length)))
+		{
+			break;
+		}
+		if(length > sizeof(packet) ||
+		   !ecg_queue_bench_pipe_read(fds.fd, packet, length))
+		{
+			self->errors++;
+			break;
+		}
+		ecg_queue_bench_receive_packet(self, packet, length);
+	}
+
+	return NULL;
+}
+
+static gboolean ecg_queue_bench_pipe_read(gint fd, guint8 *buf, guint length)
+{
+	ssize_t read_size = 0;
+	guint offset = 0;
+
+	while(offset < length)
+	{
+		read_size = read(fd, buf + offset, length - offset);
+		if(read_size == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if(read_size <= 0)
+		{
+			return FALSE;
+		}
+		offset += read_size;
+	}
+
+	return TRUE;
+}
+
+/*---------------------------------------------------------------------------*
+ * The new way                                                               *
+ *---------------------------------------------------------------------------*/
+
+static gboolean ecg_queue_bench_run_queue(EcgQueueBench *self)
+{
+	GThread *consumer = NULL;
+	ChunkQueueChunk *chunk = NULL;
+	guint8 packet[CHUNK_QUEUE_CHUNK_SIZE];
+	gint64 due = 0;
+	guint i = 0;
+
+	self->queue = chunk_queue_new(ECG_QUEUE_BENCH_QUEUE_CHUNKS);
+	self->mutex = g_mutex_new();
+	self->cond = g_cond_new();
+	self->pending = FALSE;
+	self->stop = FALSE;
+
+	consumer = g_thread_create(ecg_queue_bench_queue_consumer, self, TRUE,
+			NULL);
+
+	due = sample_clock_now();
+	for(i = 0; i < self->packet_count; i++)
+	{
+		ecg_queue_bench_wait(due);
+		due += self->interval;
+
+		/* The poller reads straight into the chunk */
+		chunk = chunk_queue_get_write_chunk(self->queue);
+		if(!chunk)
+		{
+			ecg_queue_bench_build_packet(self, packet, i);
+			self->dropped++;
+			continue;
+		}
+		ecg_queue_bench_build_packet(self, chunk->data, i);
+		chunk->length = self->packet_size;
+		chunk_queue_commit(self->queue);
+
+		g_mutex_lock(self->mutex);
+		self->pending = TRUE;
+		g_cond_signal(self->cond);
+		g_mutex_unlock(self->mutex);
+	}
+
+	g_mutex_lock(self->mutex);
+	self->stop = TRUE;
+	g_cond_signal(self->cond);
+	g_mutex_unlock(self->mutex);
+
+	g_thread_join(consumer);
+
+	g_cond_free(self->cond);
+	g_mutex_free(self->mutex);
+	chunk_queue_free(self->queue);
+	self->queue = NULL;
+
+	return TRUE;
+}
+
+static gpointer ecg_queue_bench_queue_consumer(gpointer user_data)
+{
+	EcgQueueBench *self = (EcgQueueBench *)user_data;
+	ChunkQueueChunk *chunk = NULL;
+	gboolean stop = FALSE;
+
+	/* As the ingest worker of EcgData */
+	do {
+		g_mutex_lock(self->mutex);
+		while(!self->pending && !self->stop)
+		{
+			g_cond_wait(self->cond, self->mutex);
+		}
+		self->pending = FALSE;
+		stop = self->stop;
+		g_mutex_unlock(self->mutex);
+
+		while((chunk = chunk_queue_peek(self->queue)) != NULL)
+		{
+			ecg_queue_bench_receive_packet(self, chunk->data,
+					chunk->length);
+			chunk_queue_release(self->queue);
+		}
+	} while(!stop);
+
+	return NULL;
+}
+
+/*---------------------------------------------------------------------------*
+ * Results                                                                   *
+ *---------------------------------------------------------------------------*/
+
+static gboolean ecg_queue_bench_run(
+		EcgQueueBench *self,
+		const gchar *name,
+		gboolean (*run)(EcgQueueBench *self))
+{
+	EcgQueueBenchCounters before;
+	EcgQueueBenchCounters after;
+	gboolean syscalls_known = FALSE;
+	gdouble mean = 0;
+	guint i = 0;
+
+	self->received = 0;
+	self->next_sequence_number = 0;
+	self->errors = 0;
+	self->dropped = 0;
+
+	syscalls_known = ecg_queue_bench_get_counters(&before);
+	if(!run(self))
+	{
+		return FALSE;
+	}
+	syscalls_known = ecg_queue_bench_get_counters(&after) &&
+		syscalls_known;
+
+	if(self->received == 0)
+	{
+		g_print("%-6s no packets arrived\n", name);
+		return FALSE;
+	}
+
+	for(i = 0; i < self->received; i++)
+	{
+		mean += self->latencies[i];
+	}
+	mean /= self->received;
+	qsort(self->latencies, self->received, sizeof(gint64),
+			ecg_queue_bench_compare_latencies);
+
+	if(syscalls_known)
+	{
+		g_print("%-6s %10.2f ", name,
+				(gdouble)(after.syscalls - before.syscalls) /
+				self->packet_count);
+	} else {
+		g_print("%-6s %10s ", name, "-");
+	}
+	g_print("%12.2f %10.1f %10" G_GINT64_FORMAT " %10" G_GINT64_FORMAT
+			" %8u\n",
+			(gdouble)(after.context_switches -
+				before.context_switches) / self->packet_count,
+			mean,
+			self->latencies[(self->received - 1) * 99 / 100],
+			self->latencies[self->received - 1],
+			self->dropped);
+
+	return self->errors == 0 &&
+		self->received + self->dropped == self->packet_count;
+}
+
+static gint ecg_queue_bench_compare_latencies(
+		gconstpointer a,
+		gconstpointer b)
+{
+	gint64 latency_a = *(const gint64 *)a;
+	gint64 latency_b = *(const gint64 *)b;
+
+	return latency_a < latency_b ? -1 : (latency_a > latency_b ? 1 : 0);
+}
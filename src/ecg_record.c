@@ -0,0 +1,819 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "ecg_record.h"
+
+/* System */
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Other modules */
+#include "ec_error.h"
+#include "sample_clock.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+/** @brief Number of bits in the Rice parameter of a partition */
+#define ECG_RECORD_RICE_PARAMETER_BITS		4
+
+/**
+ * @brief Size of the buffer for a coded segment: every sample escaped,
+ * and a Rice parameter for every partition
+ */
+#define ECG_RECORD_BUFFER_SIZE						\
+	(ECG_RECORD_MAX_SEGMENT_LENGTH *				\
+	 (ECG_RECORD_ESCAPE + ECG_RECORD_ESCAPE_BITS) / 8 +		\
+	 ECG_RECORD_MAX_SEGMENT_LENGTH / ECG_RECORD_PARTITION_LENGTH + 8)
+
+/**
+ * @brief Bits that are being written to a buffer
+ */
+typedef struct _EcgRecordBitWriter {
+	guint8 *data;
+	gsize length;
+
+	/** @brief The bits that do not fill a byte yet are the lowest
+	 * bit_count bits */
+	guint64 accumulator;
+	gint bit_count;
+} EcgRecordBitWriter;
+
+/**
+ * @brief Bits that are being read from a buffer
+ */
+typedef struct _EcgRecordBitReader {
+	const guint8 *data;
+	gsize length;
+
+	/** @brief Index of the next bit */
+	gsize position;
+} EcgRecordBitReader;
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Whether a block continues the current segment
+ *
+ * @param self Pointer to #EcgRecordWriter
+ * @param block The block
+ * @param offset Index of the first sample of the block that is not in the
+ * segment yet
+ * @param time Wall clock time of that sample
+ *
+ * @return TRUE if the samples can be added to the segment
+ */
+static gboolean ecg_record_writer_continues_segment(
+		EcgRecordWriter *self,
+		const EcgSampleBlock *block,
+		guint offset,
+		gint64 time);
+
+/**
+ * @brief Write data to the file, or mark the writer as failed
+ *
+ * @param self Pointer to #EcgRecordWriter
+ * @param data The data
+ * @param length Length of the data
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean ecg_record_writer_write(
+		EcgRecordWriter *self,
+		const void *data,
+		gsize length);
+
+/**
+ * @brief Code the differences of a segment
+ *
+ * @param samples The samples. The first one is stored in the header.
+ * @param length Number of samples
+ * @param buffer Storage for the coded samples, ECG_RECORD_BUFFER_SIZE
+ * bytes
+ *
+ * @return Length of the coded samples in bytes
+ */
+static gsize ecg_record_encode(
+		const gint16 *samples,
+		guint length,
+		guint8 *buffer);
+
+/**
+ * @brief Decode the differences of a segment
+ *
+ * @param bits The coded samples
+ * @param samples Storage for the samples. The first one must be set.
+ * @param length Number of samples
+ *
+ * @return TRUE on success, FALSE if the data ends too early
+ */
+static gboolean ecg_record_decode(
+		EcgRecordBitReader *bits,
+		gint16 *samples,
+		guint length);
+
+/**
+ * @brief Choose the Rice parameter that codes the numbers in the fewest
+ * bits
+ *
+ * @param values The numbers
+ * @param count Amount of numbers
+ *
+ * @return The parameter
+ */
+static guint ecg_record_choose_rice_parameter(
+		const guint32 *values,
+		guint count);
+
+static void ecg_record_bit_writer_put(
+		EcgRecordBitWriter *bits,
+		guint32 value,
+		gint count);
+
+static void ecg_record_bit_writer_finish(EcgRecordBitWriter *bits);
+
+/**
+ * @brief Read a number
+ *
+ * @param bits Pointer to #EcgRecordBitReader
+ * @param count Amount of bits, at most 32
+ * @param value Return location for the number
+ *
+ * @return TRUE on success, FALSE if the data ends too early
+ */
+static gboolean ecg_record_bit_reader_get(
+		EcgRecordBitReader *bits,
+		gint count,
+		guint32 *value);
+
+static gint64 ecg_record_timeval_to_usec(const struct timeval *time);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+EcgRecordWriter *ecg_record_writer_new(
+		const gchar *path,
+		const gchar *device_name,
+		GError **error)
+{
+	EcgRecordWriter *self = NULL;
+	EcgRecordHeader header;
+	struct timeval now;
+
+	g_return_val_if_fail(path != NULL, NULL);
+	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+	DEBUG_BEGIN();
+
+	self = g_new0(EcgRecordWriter, 1);
+	self->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(self->fd == -1)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to create ECG record file %s: %s",
+				path, strerror(errno));
+		g_free(self);
+		DEBUG_END();
+		return NULL;
+	}
+
+	gettimeofday(&now, NULL);
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, ECG_RECORD_MAGIC, sizeof(header.magic));
+	header.version = ECG_RECORD_VERSION;
+	header.header_length = sizeof(header);
+	header.start_time = ecg_record_timeval_to_usec(&now);
+	if(device_name)
+	{
+		g_strlcpy(header.device_name, device_name,
+				sizeof(header.device_name));
+	}
+
+	if(!ecg_record_writer_write(self, &header, sizeof(header)))
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to write ECG record file %s: %s",
+				path, strerror(errno));
+		close(self->fd);
+		g_free(self);
+		DEBUG_END();
+		return NULL;
+	}
+
+	self->buffer = g_malloc(ECG_RECORD_BUFFER_SIZE);
+
+	DEBUG_END();
+	return self;
+}
+
+gboolean ecg_record_writer_append(
+		EcgRecordWriter *self,
+		const EcgSampleBlock *block)
+{
+	struct timeval wall;
+	gint64 block_time = 0;
+	gint64 time = 0;
+	guint offset = 0;
+	guint count = 0;
+
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(block != NULL, FALSE);
+	g_return_val_if_fail(block->sample_rate > 0, FALSE);
+
+	if(self->failed)
+	{
+		return FALSE;
+	}
+
+	sample_clock_to_timeval(block->time, &wall);
+	block_time = ecg_record_timeval_to_usec(&wall);
+
+	while(offset < block->length)
+	{
+		time = block_time + (gint64)offset * G_USEC_PER_SEC /
+			block->sample_rate;
+
+		if(self->segment.length > 0 &&
+				!ecg_record_writer_continues_segment(self,
+					block, offset, time))
+		{
+			if(!ecg_record_writer_flush(self))
+			{
+				return FALSE;
+			}
+		}
+
+		if(self->segment.length == 0)
+		{
+			self->segment.time = time;
+			self->segment.first_sample = block->first_sample +
+				offset;
+			self->segment.sample_rate = block->sample_rate;
+			self->segment.units_per_mv = block->units_per_mv;
+			self->segment.zero_level = block->zero_level;
+		}
+
+		count = MIN(block->length - offset,
+				ECG_RECORD_MAX_SEGMENT_LENGTH -
+				self->segment.length);
+		memcpy(self->samples + self->segment.length,
+				block->samples + offset,
+				count * sizeof(gint16));
+		self->segment.length += count;
+		self->sample_count += count;
+		offset += count;
+
+		if(self->segment.length == ECG_RECORD_MAX_SEGMENT_LENGTH)
+		{
+			if(!ecg_record_writer_flush(self))
+			{
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+gboolean ecg_record_writer_flush(EcgRecordWriter *self)
+{
+	g_return_val_if_fail(self != NULL, FALSE);
+
+	if(self->failed)
+	{
+		return FALSE;
+	}
+
+	if(self->segment.length == 0)
+	{
+		return TRUE;
+	}
+
+	self->segment.first_value = self->samples[0];
+	self->segment.data_length = ecg_record_encode(self->samples,
+			self->segment.length, self->buffer);
+
+	/* The header and the data are written separately, but the file is
+	 * only read up to the last complete segment */
+	if(!ecg_record_writer_write(self, &self->segment,
+				sizeof(self->segment)) ||
+			!ecg_record_writer_write(self, self->buffer,
+				self->segment.data_length))
+	{
+		g_warning("Unable to write ECG record file: %s",
+				strerror(errno));
+		return FALSE;
+	}
+
+	self->segment.length = 0;
+	return TRUE;
+}
+
+gboolean ecg_record_writer_sync(EcgRecordWriter *self)
+{
+	g_return_val_if_fail(self != NULL, FALSE);
+
+	if(!ecg_record_writer_flush(self))
+	{
+		return FALSE;
+	}
+
+	if(fsync(self->fd) == -1)
+	{
+		g_warning("Unable to sync ECG record file: %s",
+				strerror(errno));
+		self->failed = TRUE;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void ecg_record_writer_close(EcgRecordWriter *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	ecg_record_writer_sync(self);
+
+	DEBUG("Wrote %llu samples in %llu bytes",
+			(unsigned long long)self->sample_count,
+			(unsigned long long)self->length);
+
+	close(self->fd);
+	g_free(self->buffer);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+EcgRecordReader *ecg_record_reader_new(const gchar *path, GError **error)
+{
+	EcgRecordReader *self = NULL;
+	const EcgRecordHeader *header = NULL;
+	struct stat file_stat;
+	void *map = NULL;
+
+	g_return_val_if_fail(path != NULL, NULL);
+	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+	DEBUG_BEGIN();
+
+	self = g_new0(EcgRecordReader, 1);
+	self->fd = open(path, O_RDONLY);
+	if(self->fd == -1 || fstat(self->fd, &file_stat) == -1)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to open ECG record file %s: %s",
+				path, strerror(errno));
+		goto error;
+	}
+
+	if(file_stat.st_size < (off_t)sizeof(EcgRecordHeader))
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"%s is not an ECG record file", path);
+		goto error;
+	}
+
+	self->map_size = file_stat.st_size;
+	map = mmap(NULL, self->map_size, PROT_READ, MAP_PRIVATE, self->fd, 0);
+	if(map == MAP_FAILED)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to map ECG record file %s: %s",
+				path, strerror(errno));
+		goto error;
+	}
+	self->map = map;
+
+	/* The segments are read in order */
+	madvise(map, self->map_size, MADV_SEQUENTIAL);
+
+	header = (const EcgRecordHeader *)self->map;
+	if(memcmp(header->magic, ECG_RECORD_MAGIC, sizeof(header->magic))
+			!= 0 ||
+			header->version != ECG_RECORD_VERSION ||
+			header->header_length < sizeof(EcgRecordHeader) ||
+			header->header_length > self->map_size)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"%s is not a supported ECG record file", path);
+		goto error;
+	}
+
+	ecg_record_reader_rewind(self);
+
+	DEBUG_END();
+	return self;
+
+error:
+	if(self->map)
+	{
+		munmap((void *)self->map, self->map_size);
+	}
+	if(self->fd != -1)
+	{
+		close(self->fd);
+	}
+	g_free(self);
+	DEBUG_END();
+	return NULL;
+}
+
+const EcgRecordHeader *ecg_record_reader_get_header(EcgRecordReader *self)
+{
+	g_return_val_if_fail(self != NULL, NULL);
+	return (const EcgRecordHeader *)self->map;
+}
+
+EcgSampleBlock *ecg_record_reader_next(EcgRecordReader *self)
+{
+	EcgRecordSegmentHeader segment;
+	EcgRecordBitReader bits;
+	EcgSampleBlock *block = NULL;
+
+	g_return_val_if_fail(self != NULL, NULL);
+
+	if(self->position + sizeof(segment) > self->map_size)
+	{
+		return NULL;
+	}
+	memcpy(&segment, self->map + self->position, sizeof(segment));
+
+	if(segment.length == 0 || segment.sample_rate == 0 ||
+			self->position + sizeof(segment) +
+			segment.data_length > self->map_size)
+	{
+		/* The writer did not finish the last segment */
+		return NULL;
+	}
+
+	bits.data = self->map + self->position + sizeof(segment);
+	bits.length = segment.data_length;
+	bits.position = 0;
+
+	block = ecg_sample_block_new(segment.length);
+	block->sample_rate = segment.sample_rate;
+	block->units_per_mv = segment.units_per_mv;
+	block->zero_level = segment.zero_level;
+	block->time = segment.time;
+	block->first_sample = segment.first_sample;
+	block->samples[0] = segment.first_value;
+
+	if(!ecg_record_decode(&bits, block->samples, segment.length))
+	{
+		g_warning("Corrupted segment in ECG record file");
+		ecg_sample_block_unref(block);
+		return NULL;
+	}
+
+	self->position += sizeof(segment) + segment.data_length;
+	return block;
+}
+
+void ecg_record_reader_rewind(EcgRecordReader *self)
+{
+	g_return_if_fail(self != NULL);
+	self->position = ecg_record_reader_get_header(self)->header_length;
+}
+
+void ecg_record_reader_close(EcgRecordReader *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	munmap((void *)self->map, self->map_size);
+	close(self->fd);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static gboolean ecg_record_writer_continues_segment(
+		EcgRecordWriter *self,
+		const EcgSampleBlock *block,
+		guint offset,
+		gint64 time)
+{
+	EcgRecordSegmentHeader *segment = &self->segment;
+	gint64 expected = 0;
+
+	if(block->sample_rate != segment->sample_rate ||
+			block->units_per_mv != segment->units_per_mv ||
+			block->zero_level != segment->zero_level ||
+			block->first_sample + offset !=
+			segment->first_sample + segment->length)
+	{
+		return FALSE;
+	}
+
+	/* The sample clock was anchored again, or the wall clock offset
+	 * was measured again */
+	expected = segment->time + (gint64)segment->length * G_USEC_PER_SEC /
+		segment->sample_rate;
+	return ABS(time - expected) <= ECG_RECORD_MAX_TIME_ERROR;
+}
+
+static gboolean ecg_record_writer_write(
+		EcgRecordWriter *self,
+		const void *data,
+		gsize length)
+{
+	const guint8 *position = data;
+	ssize_t written = 0;
+
+	while(length > 0)
+	{
+		written = write(self->fd, position, length);
+		if(written == -1)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			self->failed = TRUE;
+			return FALSE;
+		}
+		position += written;
+		length -= written;
+		self->length += written;
+	}
+
+	return TRUE;
+}
+
+static gsize ecg_record_encode(
+		const gint16 *samples,
+		guint length,
+		guint8 *buffer)
+{
+	EcgRecordBitWriter bits;
+	guint32 values[ECG_RECORD_PARTITION_LENGTH];
+	guint start = 0;
+	guint count = 0;
+	guint parameter = 0;
+	guint i = 0;
+	gint difference = 0;
+	guint32 quotient = 0;
+
+	bits.data = buffer;
+	bits.length = 0;
+	bits.accumulator = 0;
+	bits.bit_count = 0;
+
+	for(start = 1; start < length; start += count)
+	{
+		count = MIN(length - start, ECG_RECORD_PARTITION_LENGTH);
+
+		/* Map the differences to 0, 1, 2... in the order 0, -1, 1,
+		 * -2, 2... */
+		for(i = 0; i < count; i++)
+		{
+			difference = samples[start + i] -
+				samples[start + i - 1];
+			values[i] = difference >= 0 ?
+				(guint32)difference << 1 :
+				((guint32)-difference << 1) - 1;
+		}
+
+		parameter = ecg_record_choose_rice_parameter(values, count);
+		ecg_record_bit_writer_put(&bits, parameter,
+				ECG_RECORD_RICE_PARAMETER_BITS);
+
+		for(i = 0; i < count; i++)
+		{
+			quotient = values[i] >> parameter;
+			if(quotient >= ECG_RECORD_ESCAPE)
+			{
+				ecg_record_bit_writer_put(&bits, G_MAXUINT32,
+						ECG_RECORD_ESCAPE);
+				ecg_record_bit_writer_put(&bits, values[i],
+						ECG_RECORD_ESCAPE_BITS);
+				continue;
+			}
+
+			/* Ones and the terminating zero */
+			ecg_record_bit_writer_put(&bits,
+					((1u << quotient) - 1) << 1,
+					quotient + 1);
+			if(parameter > 0)
+			{
+				ecg_record_bit_writer_put(&bits, values[i] &
+						((1u << parameter) - 1),
+						parameter);
+			}
+		}
+	}
+
+	ecg_record_bit_writer_finish(&bits);
+	return bits.length;
+}
+
+static gboolean ecg_record_decode(
+		EcgRecordBitReader *bits,
+		gint16 *samples,
+		guint length)
+{
+	guint start = 0;
+	guint count = 0;
+	guint32 parameter = 0;
+	guint32 quotient = 0;
+	guint32 bit = 0;
+	guint32 low = 0;
+	guint32 value = 0;
+	guint i = 0;
+
+	for(start = 1; start < length; start += count)
+	{
+		count = MIN(length - start, ECG_RECORD_PARTITION_LENGTH);
+
+		if(!ecg_record_bit_reader_get(bits,
+					ECG_RECORD_RICE_PARAMETER_BITS,
+					&parameter))
+		{
+			return FALSE;
+		}
+
+		for(i = 0; i < count; i++)
+		{
+			quotient = 0;
+			do {
+				if(!ecg_record_bit_reader_get(bits, 1, &bit))
+				{
+					return FALSE;
+				}
+				quotient += bit;
+			} while(bit && quotient < ECG_RECORD_ESCAPE);
+
+			if(quotient == ECG_RECORD_ESCAPE)
+			{
+				if(!ecg_record_bit_reader_get(bits,
+						ECG_RECORD_ESCAPE_BITS,
+						&value))
+				{
+					return FALSE;
+				}
+			} else {
+				low = 0;
+				if(parameter > 0 &&
+						!ecg_record_bit_reader_get(bits,
+							parameter, &low))
+				{
+					return FALSE;
+				}
+				value = (quotient << parameter) | low;
+			}
+
+			samples[start + i] = samples[start + i - 1] +
+				((value & 1) ? -(gint)((value + 1) >> 1) :
+				 (gint)(value >> 1));
+		}
+	}
+
+	return TRUE;
+}
+
+static guint ecg_record_choose_rice_parameter(
+		const guint32 *values,
+		guint count)
+{
+	guint64 sum = 0;
+	guint64 cost = 0;
+	guint64 best_cost = G_MAXUINT64;
+	guint estimate = 0;
+	guint best = 0;
+	guint parameter = 0;
+	guint i = 0;
+
+	for(i = 0; i < count; i++)
+	{
+		sum += values[i];
+	}
+
+	/* The best parameter is near the logarithm of the mean. Try its
+	 * neighbours too, as the estimate is rough for skewed data. */
+	while(estimate < ECG_RECORD_MAX_RICE_PARAMETER &&
+			((guint64)count << (estimate + 1)) <= sum)
+	{
+		estimate++;
+	}
+
+	for(parameter = estimate > 0 ? estimate - 1 : 0;
+			parameter <= MIN(estimate + 1,
+				ECG_RECORD_MAX_RICE_PARAMETER);
+			parameter++)
+	{
+		cost = (guint64)count * (parameter + 1);
+		for(i = 0; i < count; i++)
+		{
+			cost += MIN(values[i] >> parameter,
+					ECG_RECORD_ESCAPE +
+					ECG_RECORD_ESCAPE_BITS);
+		}
+		if(cost < best_cost)
+		{
+			best_cost = cost;
+			best = parameter;
+		}
+	}
+
+	return best;
+}
+
+static void ecg_record_bit_writer_put(
+		EcgRecordBitWriter *bits,
+		guint32 value,
+		gint count)
+{
+	bits->accumulator = (bits->accumulator << count) |
+		(value & (guint32)((G_GUINT64_CONSTANT(1) << count) - 1));
+	bits->bit_count += count;
+
+	while(bits->bit_count >= 8)
+	{
+		bits->bit_count -= 8;
+		bits->data[bits->length++] =
+			(guint8)(bits->accumulator >> bits->bit_count);
+	}
+}
+
+static void ecg_record_bit_writer_finish(EcgRecordBitWriter *bits)
+{
+	if(bits->bit_count > 0)
+	{
+		ecg_record_bit_writer_put(bits, 0, 8 - bits->bit_count);
+	}
+}
+
+static gboolean ecg_record_bit_reader_get(
+		EcgRecordBitReader *bits,
+		gint count,
+		guint32 *value)
+{
+	guint32 result = 0;
+	guint bit = 0;
+
+	if(bits->position + count > bits->length * 8)
+	{
+		return FALSE;
+	}
+
+	while(count > 0)
+	{
+		bit = (bits->data[bits->position >> 3] >>
+				(7 - (bits->position & 7))) & 1;
+		result = (result << 1) | bit;
+		bits->position++;
+		count--;
+	}
+
+	*value = result;
+	return TRUE;
+}
+
+static gint64 ecg_record_timeval_to_usec(const struct timeval *time)
+{
+	return (gint64)time->tv_sec * G_USEC_PER_SEC + time->tv_usec;
+}
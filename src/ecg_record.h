@@ -0,0 +1,276 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _ECG_RECORD_H
+#define _ECG_RECORD_H
+
+/* Configuration */
+#include "config.h"
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "ecg_sample_block.h"
+
+/**
+ * @brief Identifies an ECG record file. Stored in the beginning of the file.
+ */
+#define ECG_RECORD_MAGIC			"ECECGREC"
+#define ECG_RECORD_VERSION			1
+
+/** @brief Maximum length of the device name in the header */
+#define ECG_RECORD_DEVICE_NAME_LENGTH		32
+
+/**
+ * @brief Maximum number of samples in a segment. A segment is written
+ * when it is full, even if the samples continue.
+ */
+#define ECG_RECORD_MAX_SEGMENT_LENGTH		8192
+
+/** @brief Number of samples that share one Rice parameter */
+#define ECG_RECORD_PARTITION_LENGTH		64
+
+/** @brief Largest Rice parameter (it is stored in 4 bits) */
+#define ECG_RECORD_MAX_RICE_PARAMETER		15
+
+/** @brief Quotient from which on a number is stored as it is */
+#define ECG_RECORD_ESCAPE			32
+
+/** @brief Number of bits in an escaped number */
+#define ECG_RECORD_ESCAPE_BITS			17
+
+/**
+ * @brief How much the time of a block may differ from the time that
+ * follows from the segment, in microseconds, before a new segment is
+ * started
+ */
+#define ECG_RECORD_MAX_TIME_ERROR		1000
+
+/**
+ * @brief Header of an ECG record file.
+ *
+ * An ECG record file stores decoded ECG samples losslessly, so that the
+ * beats can be analyzed again after the exercise. The header is followed
+ * by segments of consecutive samples, each of which is an
+ * #EcgRecordSegmentHeader followed by the coded samples.
+ *
+ * The first sample of a segment is stored in the header. The rest are
+ * stored as differences to the previous sample, mapped to unsigned
+ * numbers (0, -1, 1, -2, 2...) and Rice coded. The samples are divided
+ * into partitions of ECG_RECORD_PARTITION_LENGTH, and each partition
+ * begins with its Rice parameter in 4 bits. A code is the quotient in
+ * unary (ones terminated by a zero), followed by as many low bits as the
+ * parameter says. A quotient of ECG_RECORD_ESCAPE or more is written as
+ * ECG_RECORD_ESCAPE ones followed by the number in ECG_RECORD_ESCAPE_BITS
+ * bits. The bits are written most significant first, and the data of a
+ * segment is padded to whole bytes.
+ *
+ * The numbers in the headers are stored in the byte order of the machine
+ * that wrote the file.
+ */
+typedef struct _EcgRecordHeader {
+	gchar magic[8];
+	guint32 version;
+	guint32 header_length;
+
+	/** @brief Wall clock time when the file was created, in
+	 * microseconds */
+	gint64 start_time;
+
+	/** @brief Bluetooth name of the device. Zero terminated. */
+	gchar device_name[ECG_RECORD_DEVICE_NAME_LENGTH];
+} EcgRecordHeader;
+
+/**
+ * @brief Header of a segment of consecutive samples
+ */
+typedef struct _EcgRecordSegmentHeader {
+	/** @brief Wall clock time of the first sample, in microseconds */
+	gint64 time;
+
+	/** @brief Index of the first sample (see #EcgSampleBlock) */
+	guint64 first_sample;
+
+	/** @brief Length of the coded samples in bytes */
+	guint32 data_length;
+
+	/** @brief Number of samples */
+	guint32 length;
+
+	guint16 sample_rate;
+	gint16 units_per_mv;
+	gint16 zero_level;
+
+	/** @brief Value of the first sample */
+	gint16 first_value;
+} EcgRecordSegmentHeader;
+
+/**
+ * @brief Writes an ECG record file.
+ *
+ * The blocks that are appended are collected in a segment for as long as
+ * they continue each other. A segment is coded and written to the file
+ * when it is full, when the next block does not continue it, or when
+ * ecg_record_writer_flush() is called. The writer blocks on the disk, so
+ * it should not be used from the main loop (see #EcgRecorder).
+ *
+ * Consider all the fields private.
+ */
+typedef struct _EcgRecordWriter {
+	gint fd;
+
+	/** @brief Whether writing has failed. Nothing is written after
+	 * that. */
+	gboolean failed;
+
+	/** @brief Header of the current segment */
+	EcgRecordSegmentHeader segment;
+
+	/** @brief Samples of the current segment */
+	gint16 samples[ECG_RECORD_MAX_SEGMENT_LENGTH];
+
+	/** @brief Coded segment. Large enough for the worst case. */
+	guint8 *buffer;
+
+	/** @brief Number of samples written, including the current
+	 * segment */
+	guint64 sample_count;
+
+	/** @brief Number of bytes written, including the file header */
+	guint64 length;
+} EcgRecordWriter;
+
+/**
+ * @brief Reads an ECG record file.
+ *
+ * The whole file is memory mapped.
+ *
+ * Consider all the fields private.
+ */
+typedef struct _EcgRecordReader {
+	gint fd;
+	const guint8 *map;
+	gsize map_size;
+
+	/** @brief Offset of the next segment */
+	gsize position;
+} EcgRecordReader;
+
+/**
+ * @brief Create an ECG record file. An existing file is overwritten.
+ *
+ * @param path Path of the file
+ * @param device_name Bluetooth name of the device, or NULL
+ * @param error Return location for possible error
+ *
+ * @return Newly allocated writer, or NULL in case of an error
+ */
+EcgRecordWriter *ecg_record_writer_new(
+		const gchar *path,
+		const gchar *device_name,
+		GError **error);
+
+/**
+ * @brief Append a block of samples
+ *
+ * @param self Pointer to #EcgRecordWriter
+ * @param block The samples. The time is in the time base of
+ * sample_clock.h, and it is stored as wall clock time.
+ *
+ * @return TRUE on success, FALSE if writing has failed
+ */
+gboolean ecg_record_writer_append(
+		EcgRecordWriter *self,
+		const EcgSampleBlock *block);
+
+/**
+ * @brief Write the current segment to the file
+ *
+ * @param self Pointer to #EcgRecordWriter
+ *
+ * @return TRUE on success, FALSE if writing has failed
+ */
+gboolean ecg_record_writer_flush(EcgRecordWriter *self);
+
+/**
+ * @brief Write the current segment, and wait until the file is on the
+ * disk
+ *
+ * @param self Pointer to #EcgRecordWriter
+ *
+ * @return TRUE on success, FALSE if writing has failed
+ */
+gboolean ecg_record_writer_sync(EcgRecordWriter *self);
+
+/**
+ * @brief Write the current segment, close the file and free the writer
+ *
+ * @param self Pointer to #EcgRecordWriter
+ */
+void ecg_record_writer_close(EcgRecordWriter *self);
+
+/**
+ * @brief Open an ECG record file for reading
+ *
+ * @param path Path of the file
+ * @param error Return location for possible error
+ *
+ * @return Newly allocated reader, or NULL in case of an error
+ */
+EcgRecordReader *ecg_record_reader_new(const gchar *path, GError **error);
+
+/**
+ * @brief Get the header of the file
+ *
+ * @param self Pointer to #EcgRecordReader
+ *
+ * @return The header
+ */
+const EcgRecordHeader *ecg_record_reader_get_header(EcgRecordReader *self);
+
+/**
+ * @brief Decode the next segment
+ *
+ * @param self Pointer to #EcgRecordReader
+ *
+ * @return A new block with the samples of the segment, or NULL at the end
+ * of the file (or if the rest of the file is truncated or corrupted). The
+ * time of the block is wall clock time in microseconds.
+ */
+EcgSampleBlock *ecg_record_reader_next(EcgRecordReader *self);
+
+/**
+ * @brief Start reading from the first segment again
+ *
+ * @param self Pointer to #EcgRecordReader
+ */
+void ecg_record_reader_rewind(EcgRecordReader *self);
+
+/**
+ * @brief Close the file and free the reader
+ *
+ * @param self Pointer to #EcgRecordReader
+ */
+void ecg_record_reader_close(EcgRecordReader *self);
+
+#endif /* _ECG_RECORD_H */
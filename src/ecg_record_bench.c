@@ -0,0 +1,457 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*
+ * Benchmark and round trip test for the ECG record files.
+ *
+ * A synthetic 11-bit ECG is generated at each of the sample rates of the
+ * supported devices, and cut into blocks as EcgData would deliver them.
+ * A block is left out now and then, as if it had been lost, so that the
+ * writer has to start new segments. The blocks are written to an ECG
+ * record file as fast as possible, first without syncing and then with an
+ * ecg_record_writer_sync() after every 5 seconds of signal, as
+ * EcgRecorder does. The size of the file is compared with the 12 bits per
+ * sample of MIT format 212 and the 16 bits of raw samples.
+ *
+ * Finally, the file is read back, and every sample must come out as it
+ * went in, at the same index.
+ *
+ * The exit status is 0 if the samples were read back intact, 1 if not.
+ *
+ * Usage: ecg_record_bench [minutes] [directory]
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* System */
+#include <math.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "ecg_record.h"
+#include "ecg_sample_block.h"
+#include "sample_clock.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define ECG_RECORD_BENCH_DEFAULT_MINUTES	30
+
+/** @brief Samples per block, as the Alive monitor sends them */
+#define ECG_RECORD_BENCH_BLOCK_LENGTH		60
+
+/** @brief As in ecg_recorder.c */
+#define ECG_RECORD_BENCH_SYNC_SECONDS		5
+
+/** @brief One block in this many is lost */
+#define ECG_RECORD_BENCH_LOST_BLOCK_PERIOD	1000
+
+/** @brief Calibration of the samples, as in the MIT-BIH records */
+#define ECG_RECORD_BENCH_UNITS_PER_MV		200
+#define ECG_RECORD_BENCH_ZERO_LEVEL		1024
+#define ECG_RECORD_BENCH_MAX_VALUE		2047
+
+/*****************************************************************************
+ * Data structures                                                           *
+ *****************************************************************************/
+
+/**
+ * @brief The blocks of one synthetic recording
+ */
+typedef struct _EcgRecordBenchSignal {
+	gint sample_rate;
+
+	/** @brief All the samples, including the lost ones */
+	gint16 *samples;
+	guint64 length;
+
+	/** @brief The blocks that were not lost */
+	GPtrArray *blocks;
+
+	/** @brief Number of samples in the blocks */
+	guint64 block_samples;
+} EcgRecordBenchSignal;
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Generate a synthetic ECG and cut it into blocks
+ *
+ * @param self Storage for the signal
+ * @param sample_rate Sample rate
+ * @param minutes Length of the signal
+ */
+static void ecg_record_bench_synthesize(
+		EcgRecordBenchSignal *self,
+		gint sample_rate,
+		gint minutes);
+
+/**
+ * @brief Write the blocks of a signal to an ECG record file
+ *
+ * @param self The signal
+ * @param path Path of the file
+ * @param sync Whether to sync after every ECG_RECORD_BENCH_SYNC_SECONDS
+ * of signal
+ * @param length Return location for the length of the file
+ *
+ * @return Time in seconds, or a negative number in case of an error
+ */
+static gdouble ecg_record_bench_write(
+		EcgRecordBenchSignal *self,
+		const gchar *path,
+		gboolean sync,
+		guint64 *length);
+
+/**
+ * @brief Read an ECG record file, and compare it with the signal
+ *
+ * @param self The signal
+ * @param path Path of the file
+ * @param time Return location for the time in seconds
+ *
+ * @return TRUE if every sample of the blocks was read back at its index,
+ * FALSE if not
+ */
+static gboolean ecg_record_bench_read(
+		EcgRecordBenchSignal *self,
+		const gchar *path,
+		gdouble *time);
+
+static void ecg_record_bench_signal_free(EcgRecordBenchSignal *self);
+
+static gdouble ecg_record_bench_elapsed(
+		const struct timeval *start,
+		const struct timeval *end);
+
+/*****************************************************************************
+ * Static variables                                                          *
+ *****************************************************************************/
+
+/** @brief Sample rates of the synthetic signals */
+static const gint _ecg_record_bench_rates[] = { 360, 300, 250 };
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+int main(int argc, char **argv)
+{
+	EcgRecordBenchSignal signal;
+	const gchar *directory = NULL;
+	gchar *path = NULL;
+	gdouble write_time = 0;
+	gdouble sync_time = 0;
+	gdouble read_time = 0;
+	gdouble bits = 0;
+	gdouble msamples = 0;
+	guint64 length = 0;
+	gint minutes = ECG_RECORD_BENCH_DEFAULT_MINUTES;
+	gboolean ok = TRUE;
+	guint i = 0;
+
+	if(argc > 1)
+	{
+		minutes = MAX(atoi(argv[1]), 1);
+	}
+	directory = argc > 2 ? argv[2] : g_get_tmp_dir();
+
+	path = g_build_filename(directory, "ecg_record_bench.ecg", NULL);
+
+	g_print("%d minutes of 11-bit ECG per rate, %d samples per block\n",
+			minutes, ECG_RECORD_BENCH_BLOCK_LENGTH);
+	g_print("%4s %11s %8s %13s %9s %13s %13s\n", "Hz", "bits/sample",
+			"vs 212", "write Msmp/s", "MB/s", "synced Msmp/s",
+			"read Msmp/s");
+
+	for(i = 0; i < G_N_ELEMENTS(_ecg_record_bench_rates); i++)
+	{
+		ecg_record_bench_synthesize(&signal,
+				_ecg_record_bench_rates[i], minutes);
+		msamples = signal.block_samples / 1e6;
+
+		write_time = ecg_record_bench_write(&signal, path, FALSE,
+				&length);
+		sync_time = ecg_record_bench_write(&signal, path, TRUE,
+				&length);
+		if(write_time < 0 || sync_time < 0)
+		{
+			ecg_record_bench_signal_free(&signal);
+			ok = FALSE;
+			break;
+		}
+
+		if(!ecg_record_bench_read(&signal, path, &read_time))
+		{
+			g_print("%4d the samples were not read back intact\n",
+					signal.sample_rate);
+			ok = FALSE;
+		}
+
+		bits = length * 8.0 / signal.block_samples;
+		g_print("%4d %11.2f %7.2fx %13.1f %9.1f %13.1f %13.1f\n",
+				signal.sample_rate, bits, 12 / bits,
+				msamples / MAX(write_time, 1e-6),
+				length / MAX(write_time, 1e-6) /
+				(1024 * 1024),
+				msamples / MAX(sync_time, 1e-6),
+				msamples / MAX(read_time, 1e-6));
+
+		ecg_record_bench_signal_free(&signal);
+	}
+
+	unlink(path);
+	g_free(path);
+
+	if(!ok)
+	{
+		return 1;
+	}
+	g_print("every sample was read back intact\n");
+
+	return 0;
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static void ecg_record_bench_synthesize(
+		EcgRecordBenchSignal *self,
+		gint sample_rate,
+		gint minutes)
+{
+	GRand *rand = NULL;
+	EcgSampleBlock *block = NULL;
+	gint64 start_time = 0;
+	gdouble beat_time = 0;
+	gdouble rr = 0;
+	gdouble t = 0;
+	gdouble d = 0;
+	gdouble mv = 0;
+	guint64 i = 0;
+	guint j = 0;
+
+	self->sample_rate = sample_rate;
+	self->length = (guint64)minutes * 60 * sample_rate;
+	self->length -= self->length % ECG_RECORD_BENCH_BLOCK_LENGTH;
+	self->samples = g_new(gint16, self->length);
+	self->blocks = g_ptr_array_new();
+	self->block_samples = 0;
+
+	/* The same signal every time */
+	rand = g_rand_new_with_seed(sample_rate);
+
+	/* P, QRS and T waves around each beat, baseline wander and noise */
+	beat_time = 0.5;
+	rr = 0.8;
+	for(i = 0; i < self->length; i++)
+	{
+		t = (gdouble)i / sample_rate;
+		if(t > beat_time + 0.5)
+		{
+			rr = CLAMP(rr + g_rand_double_range(rand, -0.02, 0.02),
+					0.4, 1.2);
+			beat_time += rr;
+		}
+
+		d = t - beat_time;
+		mv = 0.12 * exp(-0.5 * pow((d + 0.17) / 0.022, 2)) -
+			0.12 * exp(-0.5 * pow((d + 0.028) / 0.008, 2)) +
+			1.1 * exp(-0.5 * pow(d / 0.011, 2)) -
+			0.28 * exp(-0.5 * pow((d - 0.028) / 0.009, 2)) +
+			0.28 * exp(-0.5 * pow((d - 0.24) / 0.045, 2));
+		mv += 0.1 * sin(2 * G_PI * 0.3 * t);
+		mv += g_rand_double_range(rand, -0.02, 0.02);
+
+		self->samples[i] = CLAMP((gint)floor(mv *
+					ECG_RECORD_BENCH_UNITS_PER_MV +
+					ECG_RECORD_BENCH_ZERO_LEVEL + 0.5),
+				0, ECG_RECORD_BENCH_MAX_VALUE);
+	}
+
+	start_time = sample_clock_now();
+	for(i = 0; i < self->length; i += ECG_RECORD_BENCH_BLOCK_LENGTH)
+	{
+		if((i / ECG_RECORD_BENCH_BLOCK_LENGTH) %
+				ECG_RECORD_BENCH_LOST_BLOCK_PERIOD ==
+				ECG_RECORD_BENCH_LOST_BLOCK_PERIOD - 1)
+		{
+			continue;
+		}
+
+		block = ecg_sample_block_new(ECG_RECORD_BENCH_BLOCK_LENGTH);
+		block->sample_rate = sample_rate;
+		block->units_per_mv = ECG_RECORD_BENCH_UNITS_PER_MV;
+		block->zero_level = ECG_RECORD_BENCH_ZERO_LEVEL;
+		block->time = start_time + (gint64)(i * G_USEC_PER_SEC /
+				sample_rate);
+		block->first_sample = i;
+		for(j = 0; j < ECG_RECORD_BENCH_BLOCK_LENGTH; j++)
+		{
+			block->samples[j] = self->samples[i + j];
+		}
+		g_ptr_array_add(self->blocks, block);
+		self->block_samples += ECG_RECORD_BENCH_BLOCK_LENGTH;
+	}
+
+	g_rand_free(rand);
+}
+
+static gdouble ecg_record_bench_write(
+		EcgRecordBenchSignal *self,
+		const gchar *path,
+		gboolean sync,
+		guint64 *length)
+{
+	EcgRecordWriter *writer = NULL;
+	EcgSampleBlock *block = NULL;
+	GError *error = NULL;
+	struct timeval start;
+	struct timeval end;
+	struct stat file_stat;
+	guint64 next_sync = 0;
+	gboolean ok = TRUE;
+	guint i = 0;
+
+	gettimeofday(&start, NULL);
+
+	writer = ecg_record_writer_new(path, "ECG_RECORD_BENCH", &error);
+	if(!writer)
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return -1;
+	}
+
+	next_sync = ECG_RECORD_BENCH_SYNC_SECONDS * self->sample_rate;
+	for(i = 0; i < self->blocks->len && ok; i++)
+	{
+		block = g_ptr_array_index(self->blocks, i);
+		ok = ecg_record_writer_append(writer, block);
+		if(sync && block->first_sample + block->length >= next_sync)
+		{
+			ok = ok && ecg_record_writer_sync(writer);
+			next_sync += ECG_RECORD_BENCH_SYNC_SECONDS *
+				self->sample_rate;
+		}
+	}
+	ok = ok && ecg_record_writer_flush(writer);
+	ecg_record_writer_close(writer);
+
+	gettimeofday(&end, NULL);
+
+	if(!ok || stat(path, &file_stat) != 0)
+	{
+		g_printerr("Could not write %s\n", path);
+		return -1;
+	}
+	*length = file_stat.st_size;
+
+	return ecg_record_bench_elapsed(&start, &end);
+}
+
+static gboolean ecg_record_bench_read(
+		EcgRecordBenchSignal *self,
+		const gchar *path,
+		gdouble *time)
+{
+	EcgRecordReader *reader = NULL;
+	EcgSampleBlock *block = NULL;
+	GError *error = NULL;
+	struct timeval start;
+	struct timeval end;
+	guint64 sample_count = 0;
+	guint mismatches = 0;
+	guint i = 0;
+
+	gettimeofday(&start, NULL);
+
+	reader = ecg_record_reader_new(path, &error);
+	if(!reader)
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	while((block = ecg_record_reader_next(reader)) != NULL)
+	{
+		if(block->sample_rate != self->sample_rate ||
+		   block->units_per_mv != ECG_RECORD_BENCH_UNITS_PER_MV ||
+		   block->zero_level != ECG_RECORD_BENCH_ZERO_LEVEL ||
+		   block->first_sample + block->length > self->length)
+		{
+			mismatches++;
+		} else {
+			for(i = 0; i < block->length; i++)
+			{
+				if(block->samples[i] != self->samples[
+						block->first_sample + i])
+				{
+					mismatches++;
+				}
+			}
+		}
+		sample_count += block->length;
+		ecg_sample_block_unref(block);
+	}
+	ecg_record_reader_close(reader);
+
+	gettimeofday(&end, NULL);
+	*time = ecg_record_bench_elapsed(&start, &end);
+
+	return mismatches == 0 && sample_count == self->block_samples;
+}
+
+static void ecg_record_bench_signal_free(EcgRecordBenchSignal *self)
+{
+	guint i = 0;
+
+	for(i = 0; i < self->blocks->len; i++)
+	{
+		ecg_sample_block_unref(g_ptr_array_index(self->blocks, i));
+	}
+	g_ptr_array_free(self->blocks, TRUE);
+	g_free(self->samples);
+}
+
+static gdouble ecg_record_bench_elapsed(
+		const struct timeval *start,
+		const struct timeval *end)
+{
+	return (end->tv_sec - start->tv_sec) +
+		(end->tv_usec - start->tv_usec) / 1e6;
+}
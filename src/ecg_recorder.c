@@ -0,0 +1,256 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "ecg_recorder.h"
+
+/* System */
+#include <string.h>
+
+/* Other modules */
+#include "debug.h"
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Queue a block for the writer thread
+ *
+ * @param ecg_data Pointer to #EcgData
+ * @param block The samples
+ * @param user_data Pointer to #EcgRecorder
+ */
+static void ecg_recorder_samples_arrived(
+		EcgData *ecg_data,
+		EcgSampleBlock *block,
+		gpointer user_data);
+
+/**
+ * @brief Write the queued blocks until the recorder itself is queued
+ *
+ * @param user_data Pointer to #EcgRecorder
+ *
+ * @return NULL
+ */
+static gpointer ecg_recorder_writer_thread(gpointer user_data);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+EcgRecorder *ecg_recorder_new(
+		EcgData *ecg_data,
+		const gchar *path,
+		GError **error)
+{
+	EcgRecorder *self = NULL;
+
+	g_return_val_if_fail(ecg_data != NULL, NULL);
+	g_return_val_if_fail(path != NULL, NULL);
+	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+	DEBUG_BEGIN();
+
+	self = g_new0(EcgRecorder, 1);
+	self->ecg_data = ecg_data;
+
+	self->writer = ecg_record_writer_new(path, ecg_data->bluetooth_name,
+			error);
+	if(!self->writer)
+	{
+		g_free(self);
+		DEBUG_END();
+		return NULL;
+	}
+
+	self->queue = g_async_queue_new();
+	self->writer_thread = g_thread_create(
+			ecg_recorder_writer_thread,
+			self,
+			TRUE,
+			error);
+	if(!self->writer_thread)
+	{
+		g_async_queue_unref(self->queue);
+		ecg_record_writer_close(self->writer);
+		g_free(self);
+		DEBUG_END();
+		return NULL;
+	}
+
+	if(!ecg_data_add_callback_samples(ecg_data,
+				ecg_recorder_samples_arrived, self, error))
+	{
+		g_async_queue_push(self->queue, self);
+		g_thread_join(self->writer_thread);
+		g_async_queue_unref(self->queue);
+		ecg_record_writer_close(self->writer);
+		g_free(self);
+		DEBUG_END();
+		return NULL;
+	}
+
+	DEBUG_END();
+	return self;
+}
+
+void ecg_recorder_close(EcgRecorder *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	ecg_data_remove_callback_samples(self->ecg_data,
+			ecg_recorder_samples_arrived, self);
+
+	/* The writer thread stops when it gets to the recorder, after the
+	 * blocks that were queued before it */
+	g_async_queue_push(self->queue, self);
+	g_thread_join(self->writer_thread);
+	g_async_queue_unref(self->queue);
+
+	if(self->dropped_blocks > 0)
+	{
+		g_warning("ECG recorder dropped %u blocks",
+				self->dropped_blocks);
+	}
+
+	ecg_record_writer_close(self->writer);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+guint ecg_recorder_get_dropped_blocks(EcgRecorder *self)
+{
+	g_return_val_if_fail(self != NULL, 0);
+	return g_atomic_int_get(&self->dropped_blocks);
+}
+
+gchar *ecg_recorder_get_path_for_track(const gchar *track_path)
+{
+	const gchar *extension = NULL;
+	const gchar *base_name = NULL;
+
+	g_return_val_if_fail(track_path != NULL, NULL);
+
+	base_name = strrchr(track_path, G_DIR_SEPARATOR);
+	base_name = base_name ? base_name + 1 : track_path;
+
+	extension = strrchr(base_name, '.');
+	if(!extension || extension == base_name)
+	{
+		return g_strconcat(track_path, ECG_RECORDER_EXTENSION, NULL);
+	}
+
+	return g_strdup_printf("%.*s%s", (gint)(extension - track_path),
+			track_path, ECG_RECORDER_EXTENSION);
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static void ecg_recorder_samples_arrived(
+		EcgData *ecg_data,
+		EcgSampleBlock *block,
+		gpointer user_data)
+{
+	EcgRecorder *self = (EcgRecorder *)user_data;
+
+	g_return_if_fail(self != NULL);
+
+	/* The length is only a hint, as the writer thread is popping at
+	 * the same time, but it keeps the queue bounded */
+	if(g_async_queue_length(self->queue) >= ECG_RECORDER_MAX_QUEUED)
+	{
+		g_atomic_int_inc(&self->dropped_blocks);
+		return;
+	}
+
+	g_async_queue_push(self->queue, ecg_sample_block_ref(block));
+}
+
+static gpointer ecg_recorder_writer_thread(gpointer user_data)
+{
+	EcgRecorder *self = (EcgRecorder *)user_data;
+	EcgSampleBlock *block = NULL;
+	gpointer item = NULL;
+	gboolean unsynced = FALSE;
+	GTimeVal sync_time;
+	GTimeVal now;
+	glong sync_interval = ECG_RECORDER_SYNC_INTERVAL * G_USEC_PER_SEC;
+
+	g_return_val_if_fail(self != NULL, NULL);
+	DEBUG_BEGIN();
+
+	for(;;)
+	{
+		/* Wait for the sync time only if there is something to
+		 * sync */
+		if(unsynced)
+		{
+			item = g_async_queue_timed_pop(self->queue, &sync_time);
+		} else {
+			item = g_async_queue_pop(self->queue);
+		}
+
+		if(item == self)
+		{
+			break;
+		}
+
+		g_get_current_time(&now);
+		if(item)
+		{
+			block = (EcgSampleBlock *)item;
+			ecg_record_writer_append(self->writer, block);
+			ecg_sample_block_unref(block);
+			if(!unsynced)
+			{
+				unsynced = TRUE;
+				sync_time = now;
+				g_time_val_add(&sync_time, sync_interval);
+			}
+		}
+
+		/* Many blocks are written with one sync, so that the disk
+		 * is not woken up for every block */
+		if(unsynced && (now.tv_sec > sync_time.tv_sec ||
+					(now.tv_sec == sync_time.tv_sec &&
+					 now.tv_usec >= sync_time.tv_usec)))
+		{
+			ecg_record_writer_sync(self->writer);
+			unsynced = FALSE;
+		}
+	}
+
+	DEBUG_END();
+	return NULL;
+}
@@ -0,0 +1,117 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _ECG_RECORDER_H
+#define _ECG_RECORDER_H
+
+/* Configuration */
+#include "config.h"
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "ecg_data.h"
+#include "ecg_record.h"
+
+/**
+ * @brief Maximum number of blocks waiting for the writer thread. Blocks
+ * that arrive when the queue is full are dropped.
+ */
+#define ECG_RECORDER_MAX_QUEUED			256
+
+/** @brief Interval of syncing the file to the disk, in seconds */
+#define ECG_RECORDER_SYNC_INTERVAL		5
+
+/** @brief Extension of the ECG record file that is stored with a track */
+#define ECG_RECORDER_EXTENSION			".ecg"
+
+/**
+ * @brief Records the ECG samples of an #EcgData to an ECG record file
+ * (see #EcgRecordWriter).
+ *
+ * The sample callback only queues a reference to the block, so recording
+ * never waits for the disk. A writer thread codes the samples and writes
+ * them, and syncs the file every ECG_RECORDER_SYNC_INTERVAL seconds. If
+ * the disk is so slow that ECG_RECORDER_MAX_QUEUED blocks are waiting,
+ * the new blocks are dropped, which shows as a gap in the sample indices
+ * of the file.
+ *
+ * Consider all the fields private.
+ */
+typedef struct _EcgRecorder {
+	EcgData *ecg_data;
+	EcgRecordWriter *writer;
+
+	/** @brief Blocks waiting for the writer thread */
+	GAsyncQueue *queue;
+
+	GThread *writer_thread;
+
+	/** @brief Number of blocks dropped because the queue was full */
+	volatile gint dropped_blocks;
+} EcgRecorder;
+
+/**
+ * @brief Create an ECG record file and start recording to it. The
+ * connection to the ECG device is established if it is not already.
+ *
+ * @param ecg_data Pointer to #EcgData
+ * @param path Path of the file. An existing file is overwritten.
+ * @param error Return location for possible error
+ *
+ * @return Newly allocated recorder, or NULL in case of an error
+ */
+EcgRecorder *ecg_recorder_new(
+		EcgData *ecg_data,
+		const gchar *path,
+		GError **error);
+
+/**
+ * @brief Stop recording, write the remaining samples, and free the
+ * recorder
+ *
+ * @param self Pointer to #EcgRecorder
+ */
+void ecg_recorder_close(EcgRecorder *self);
+
+/**
+ * @brief Get the number of blocks that were dropped because the writer
+ * thread did not keep up
+ *
+ * @param self Pointer to #EcgRecorder
+ *
+ * @return Number of blocks
+ */
+guint ecg_recorder_get_dropped_blocks(EcgRecorder *self);
+
+/**
+ * @brief Get the path of the ECG record file that is stored with a track
+ *
+ * @param track_path Path of the track (GPX) file
+ *
+ * @return Newly allocated path with the extension replaced by
+ * ECG_RECORDER_EXTENSION. Free with g_free().
+ */
+gchar *ecg_recorder_get_path_for_track(const gchar *track_path);
+
+#endif /* _ECG_RECORDER_H */
@@ -0,0 +1,76 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "ecg_sample_block.h"
+
+/* Other modules */
+#include "debug.h"
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+EcgSampleBlock *ecg_sample_block_new(guint length)
+{
+	EcgSampleBlock *self = NULL;
+
+	g_return_val_if_fail(length > 0, NULL);
+
+	self = g_malloc(sizeof(EcgSampleBlock) + length * sizeof(gint16));
+	self->ref_count = 1;
+	self->sample_rate = 0;
+	self->units_per_mv = 0;
+	self->zero_level = 0;
+	self->time = 0;
+	self->first_sample = 0;
+	self->length = length;
+	self->samples = (gint16 *)(self + 1);
+
+	return self;
+}
+
+EcgSampleBlock *ecg_sample_block_ref(EcgSampleBlock *self)
+{
+	g_return_val_if_fail(self != NULL, NULL);
+
+	g_atomic_int_inc(&self->ref_count);
+	return self;
+}
+
+void ecg_sample_block_unref(EcgSampleBlock *self)
+{
+	g_return_if_fail(self != NULL);
+
+	if(g_atomic_int_dec_and_test(&self->ref_count))
+	{
+		g_free(self);
+	}
+}
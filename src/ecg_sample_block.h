@@ -0,0 +1,114 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _ECG_SAMPLE_BLOCK_H
+#define _ECG_SAMPLE_BLOCK_H
+
+/* Configuration */
+#include "config.h"
+
+/* System */
+#include <sys/time.h>
+
+/* GLib */
+#include <glib.h>
+
+/**
+ * @brief A block of consecutive decoded ECG samples.
+ *
+ * The blocks are reference counted, so that one block can be given to
+ * every subscriber without copying it. A subscriber that needs the
+ * samples after its callback has returned must take a reference with
+ * #ecg_sample_block_ref(). The samples must not be modified.
+ *
+ * The sample value in millivolts is
+ * <code>(samples[i] - zero_level) / units_per_mv</code>.
+ */
+typedef struct _EcgSampleBlock {
+	/** @brief Reference count. Use the functions to change it. */
+	volatile gint ref_count;
+
+	/** @brief Sample rate (in Hz) */
+	gint sample_rate;
+
+	/** @brief How many units one mV is */
+	gint units_per_mv;
+
+	/** @brief Value of zero voltage */
+	gint zero_level;
+
+	/**
+	 * @brief Time of the first sample in the block, in the time base of
+	 * sample_clock.h
+	 */
+	gint64 time;
+
+	/**
+	 * @brief Index of the first sample in the block, counted from the
+	 * beginning of the connection.
+	 *
+	 * If the index of a block is not the index of the previous block
+	 * plus its length, samples have been lost in between.
+	 */
+	guint64 first_sample;
+
+	/** @brief Number of samples */
+	guint length;
+
+	/** @brief The samples. They are stored right after the struct. */
+	gint16 *samples;
+} EcgSampleBlock;
+
+/**
+ * @brief Create a new sample block with the reference count of 1.
+ *
+ * The struct and the samples are allocated in one piece. The samples are
+ * not initialized.
+ *
+ * @param length Number of samples
+ *
+ * @return Newly allocated block
+ */
+EcgSampleBlock *ecg_sample_block_new(guint length);
+
+/**
+ * @brief Add a reference to a sample block
+ *
+ * This can be called from any thread.
+ *
+ * @param self Pointer to #EcgSampleBlock
+ *
+ * @return self
+ */
+EcgSampleBlock *ecg_sample_block_ref(EcgSampleBlock *self);
+
+/**
+ * @brief Remove a reference from a sample block. The block is freed when
+ * the last reference is removed.
+ *
+ * This can be called from any thread.
+ *
+ * @param self Pointer to #EcgSampleBlock
+ */
+void ecg_sample_block_unref(EcgSampleBlock *self);
+
+#endif /* _ECG_SAMPLE_BLOCK_H */
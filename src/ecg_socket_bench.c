@@ -0,0 +1,767 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*
+ * Test for reading the connection of a heart rate monitor in fragments.
+ *
+ * A stand-in Zephyr HxM heart rate monitor listens on a Unix domain
+ * socket, which EcgData reads as if it were the RFCOMM socket (see
+ * ecg_data_set_socket()). The stand-in writes a stream of packets, each
+ * with a different heart rate, in fragments of random length (up to 1,
+ * 16 and 256 bytes), pausing after each one, so that the poller thread of
+ * EcgData gets the packets a few bytes at a time. Every heart rate must
+ * arrive, in order, with the value it was sent with.
+ *
+ * Then the stand-in sends a packet every 10 ms, and the connection is
+ * closed and opened again as when switching between heart rate monitors.
+ * The time from removing the last callback until the stand-in sees the
+ * connection closed (teardown), and until adding the callback again has
+ * returned with a new connection (reconnect), is printed.
+ *
+ * The exit status is 0 if all the heart rates arrived and the connection
+ * was opened again every time, 1 if not.
+ *
+ * Usage: ecg_socket_bench [packets] [pause in us] [teardowns]
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* System */
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* GLib */
+#include <glib.h>
+#include <glib-object.h>
+
+/* Other modules */
+#include "ecg_data.h"
+#include "gconf_helper.h"
+#include "gconf_keys.h"
+#include "sample_clock.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define ECG_SOCKET_BENCH_DEFAULT_PACKETS	200
+#define ECG_SOCKET_BENCH_DEFAULT_PAUSE		20
+#define ECG_SOCKET_BENCH_DEFAULT_TEARDOWNS	20
+
+/** @brief Time between the packets when tearing down, in milliseconds */
+#define ECG_SOCKET_BENCH_TEARDOWN_INTERVAL	10
+
+/** @brief The device name selects the protocol */
+#define ECG_SOCKET_BENCH_DEVICE_NAME		"HXM stand-in"
+
+/** @brief Longest fragment of the first run; the next ones are longer */
+#define ECG_SOCKET_BENCH_MIN_FRAGMENT		1
+#define ECG_SOCKET_BENCH_MAX_FRAGMENT		256
+#define ECG_SOCKET_BENCH_FRAGMENT_STEP		16
+
+/** @brief Time for a run to complete, in seconds */
+#define ECG_SOCKET_BENCH_TIMEOUT		60
+
+/* Zephyr HxM packet: STX, message id, payload length, 55 bytes of
+ * payload, CRC, ETX */
+#define ECG_SOCKET_BENCH_PACKET_SIZE		60
+#define ECG_SOCKET_BENCH_HEART_RATE_OFFSET	12
+#define ECG_SOCKET_BENCH_BEAT_NUMBER_OFFSET	13
+#define ECG_SOCKET_BENCH_ETX_OFFSET		59
+
+/*****************************************************************************
+ * Data structures                                                           *
+ *****************************************************************************/
+
+typedef struct _EcgSocketBench {
+	GMainLoop *main_loop;
+
+	/** @brief Listening socket of the stand-in device */
+	gint listen_fd;
+
+	/* Stand-in device */
+	guint packet_count;
+	guint max_fragment;
+	guint pause;
+	guint fragments;
+
+	/* EcgData */
+	guint heart_rates;
+	guint errors;
+	gboolean timed_out;
+
+	/* Teardown */
+	guint teardown_count;
+
+	/**
+	 * @brief Time of removing the last callback, and of the stand-in
+	 * device seeing the connection closed, for each connection
+	 */
+	gint64 *remove_times;
+	gint64 *close_times;
+
+	/** @brief Time adding the callback again took */
+	gint64 *reconnect_times;
+} EcgSocketBench;
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Create the listening socket of the stand-in device
+ *
+ * @param path Path of the socket
+ *
+ * @return The socket, or -1 on failure
+ */
+static gint ecg_socket_bench_listen(const gchar *path);
+
+/**
+ * @brief Build one packet of the stream
+ *
+ * @param packet Buffer for the packet (long enough)
+ * @param index Index of the packet
+ *
+ * @return Length of the packet
+ */
+static guint ecg_socket_bench_build_packet(guint8 *packet, guint index);
+
+/**
+ * @brief Get the heart rate of a packet of the stream
+ *
+ * @param index Index of the packet
+ *
+ * @return The heart rate
+ */
+static gint ecg_socket_bench_heart_rate(guint index);
+
+/**
+ * @brief Write all of the data to a socket
+ *
+ * @param fd The socket
+ * @param data The data
+ * @param length Length of the data
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean ecg_socket_bench_write(
+		gint fd,
+		const guint8 *data,
+		guint length);
+
+/**
+ * @brief Stand-in heart rate monitor thread
+ *
+ * Accepts one connection, writes the stream in fragments, and waits for
+ * EcgData to close the connection.
+ *
+ * @param user_data Pointer to #EcgSocketBench
+ *
+ * @return NULL
+ */
+static gpointer ecg_socket_bench_device(gpointer user_data);
+
+/**
+ * @brief Read the stream of the stand-in device with EcgData
+ *
+ * @param gconf_helper Pointer to #GConfHelperData
+ * @param self Pointer to #EcgSocketBench
+ * @param path Path of the socket
+ *
+ * @return TRUE if all the heart rates arrived, FALSE if not
+ */
+static gboolean ecg_socket_bench_run(
+		GConfHelperData *gconf_helper,
+		EcgSocketBench *self,
+		const gchar *path);
+
+/**
+ * @brief Stand-in heart rate monitor thread for the teardown
+ *
+ * Accepts teardown_count connections one after another. Writes a packet
+ * to each of them every #ECG_SOCKET_BENCH_TEARDOWN_INTERVAL, until
+ * EcgData closes the connection.
+ *
+ * @param user_data Pointer to #EcgSocketBench
+ *
+ * @return NULL
+ */
+static gpointer ecg_socket_bench_teardown_device(gpointer user_data);
+
+/**
+ * @brief Close and open the connection to the stand-in device again
+ * and again
+ *
+ * @param gconf_helper Pointer to #GConfHelperData
+ * @param self Pointer to #EcgSocketBench
+ * @param path Path of the socket
+ *
+ * @return TRUE if the connection was opened again every time, FALSE if
+ * not
+ */
+static gboolean ecg_socket_bench_run_teardown(
+		GConfHelperData *gconf_helper,
+		EcgSocketBench *self,
+		const gchar *path);
+
+/**
+ * @brief Print the mean and the maximum of time differences
+ *
+ * @param name What the times are
+ * @param start Start times, or NULL if the times are durations
+ * @param end End times or durations
+ * @param count Number of times
+ */
+static void ecg_socket_bench_print_times(
+		const gchar *name,
+		const gint64 *start,
+		const gint64 *end,
+		guint count);
+
+static void ecg_socket_bench_heart_rate_arrived(
+		EcgData *ecg_data,
+		gint heart_rate,
+		gpointer user_data);
+
+static void ecg_socket_bench_teardown_heart_rate_arrived(
+		EcgData *ecg_data,
+		gint heart_rate,
+		gpointer user_data);
+
+static gboolean ecg_socket_bench_timeout(gpointer user_data);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+int main(int argc, char **argv)
+{
+	GConfHelperData *gconf_helper = NULL;
+	EcgSocketBench bench;
+	gchar *path = NULL;
+	gboolean ok = TRUE;
+
+	memset(&bench, 0, sizeof(bench));
+	bench.packet_count = ECG_SOCKET_BENCH_DEFAULT_PACKETS;
+	bench.pause = ECG_SOCKET_BENCH_DEFAULT_PAUSE;
+	bench.teardown_count = ECG_SOCKET_BENCH_DEFAULT_TEARDOWNS;
+
+	if(argc > 1)
+	{
+		bench.packet_count = MAX(atoi(argv[1]), 1);
+	}
+	if(argc > 2)
+	{
+		bench.pause = MAX(atoi(argv[2]), 0);
+	}
+	if(argc > 3)
+	{
+		bench.teardown_count = MAX(atoi(argv[3]), 1);
+	}
+
+	g_thread_init(NULL);
+	g_type_init();
+
+	path = g_strdup_printf("%s/ecg_socket_bench-%d", g_get_tmp_dir(),
+			getpid());
+	bench.listen_fd = ecg_socket_bench_listen(path);
+	if(bench.listen_fd == -1)
+	{
+		g_printerr("Unable to listen on %s: %s\n", path,
+				strerror(errno));
+		g_free(path);
+		return 1;
+	}
+
+	gconf_helper = gconf_helper_new(ECGC_BASE_DIR);
+	bench.main_loop = g_main_loop_new(NULL, FALSE);
+
+	g_print("%u packets, %u us pause after each fragment\n",
+			bench.packet_count, bench.pause);
+	g_print("%12s %10s %10s %11s %8s\n", "max fragment", "fragments",
+			"time (s)", "heart rates", "errors");
+
+	for(bench.max_fragment = ECG_SOCKET_BENCH_MIN_FRAGMENT;
+			bench.max_fragment <= ECG_SOCKET_BENCH_MAX_FRAGMENT;
+			bench.max_fragment *= ECG_SOCKET_BENCH_FRAGMENT_STEP)
+	{
+		ok = ecg_socket_bench_run(gconf_helper, &bench, path) && ok;
+	}
+
+	bench.remove_times = g_new0(gint64, bench.teardown_count);
+	bench.close_times = g_new0(gint64, bench.teardown_count);
+	bench.reconnect_times = g_new0(gint64, bench.teardown_count);
+
+	g_print("%u teardowns, a packet every %u ms\n", bench.teardown_count,
+			ECG_SOCKET_BENCH_TEARDOWN_INTERVAL);
+	g_print("%12s %10s %10s\n", "", "mean (ms)", "max (ms)");
+	ok = ecg_socket_bench_run_teardown(gconf_helper, &bench, path) && ok;
+
+	g_free(bench.remove_times);
+	g_free(bench.close_times);
+	g_free(bench.reconnect_times);
+	g_main_loop_unref(bench.main_loop);
+	if(bench.listen_fd != -1)
+	{
+		close(bench.listen_fd);
+	}
+	unlink(path);
+	g_free(path);
+
+	if(!ok)
+	{
+		g_print("some heart rates were lost or damaged, or the "
+				"connection was not opened again\n");
+		return 1;
+	}
+	g_print("all heart rates arrived\n");
+
+	return 0;
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static gint ecg_socket_bench_listen(const gchar *path)
+{
+	struct sockaddr_un addr;
+	gint fd = -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	g_strlcpy(addr.sun_path, path, sizeof(addr.sun_path));
+
+	unlink(path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd == -1)
+	{
+		return -1;
+	}
+
+	if(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 ||
+	   listen(fd, 1) == -1)
+	{
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static guint ecg_socket_bench_build_packet(guint8 *packet, guint index)
+{
+	guint i = 0;
+
+	/* The poller finds the packets by their STX, and the stream is
+	 * searched as a string, so the other bytes are neither STX nor
+	 * NUL */
+	packet[0] = 0x02;
+	packet[1] = 0x26;
+	packet[2] = 0x37;
+	for(i = 3; i < ECG_SOCKET_BENCH_ETX_OFFSET; i++)
+	{
+		packet[i] = 'A' + i % 26;
+	}
+	packet[ECG_SOCKET_BENCH_HEART_RATE_OFFSET] =
+		ecg_socket_bench_heart_rate(index);
+	packet[ECG_SOCKET_BENCH_BEAT_NUMBER_OFFSET] = 0x20 + index % 0x50;
+	packet[ECG_SOCKET_BENCH_ETX_OFFSET] = 0x03;
+
+	return ECG_SOCKET_BENCH_PACKET_SIZE;
+}
+
+static gint ecg_socket_bench_heart_rate(guint index)
+{
+	/* From 40 to 120 bpm, different in consecutive packets */
+	return 40 + (index * 7) % 81;
+}
+
+static gboolean ecg_socket_bench_write(
+		gint fd,
+		const guint8 *data,
+		guint length)
+{
+	ssize_t written = 0;
+
+	while(length > 0)
+	{
+		written = send(fd, data, length, MSG_NOSIGNAL);
+		if(written == -1 && errno == EINTR)
+		{
+			continue;
+		}
+		if(written <= 0)
+		{
+			return FALSE;
+		}
+		data += written;
+		length -= written;
+	}
+
+	return TRUE;
+}
+
+static gpointer ecg_socket_bench_device(gpointer user_data)
+{
+	EcgSocketBench *self = (EcgSocketBench *)user_data;
+	GRand *rand = NULL;
+	guint8 packet[ECG_SOCKET_BENCH_PACKET_SIZE];
+	ssize_t read_size = 0;
+	guint length = 0;
+	guint offset = 0;
+	guint fragment = 0;
+	guint i = 0;
+	gint fd = -1;
+
+	fd = accept(self->listen_fd, NULL, NULL);
+	if(fd == -1)
+	{
+		g_printerr("accept() failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	/* The same fragments every time */
+	rand = g_rand_new_with_seed(self->max_fragment);
+	self->fragments = 0;
+
+	for(i = 0; i < self->packet_count; i++)
+	{
+		length = ecg_socket_bench_build_packet(packet, i);
+		for(offset = 0; offset < length; offset += fragment)
+		{
+			fragment = g_rand_int_range(rand, 1,
+					self->max_fragment + 1);
+			fragment = MIN(fragment, length - offset);
+
+			/* EcgData closes the connection as soon as it has
+			 * all the heart rates */
+			if(!ecg_socket_bench_write(fd, packet + offset,
+						fragment))
+			{
+				i = self->packet_count;
+				break;
+			}
+			self->fragments++;
+
+			if(self->pause > 0)
+			{
+				g_usleep(self->pause);
+			}
+		}
+	}
+
+	/* Wait for EcgData to close the connection */
+	do {
+		read_size = read(fd, packet, sizeof(packet));
+	} while(read_size > 0 || (read_size == -1 && errno == EINTR));
+
+	close(fd);
+	g_rand_free(rand);
+
+	return NULL;
+}
+
+static gboolean ecg_socket_bench_run(
+		GConfHelperData *gconf_helper,
+		EcgSocketBench *self,
+		const gchar *path)
+{
+	EcgData *ecg_data = NULL;
+	GThread *device = NULL;
+	GError *error = NULL;
+	GTimer *timer = NULL;
+	gdouble elapsed = 0;
+	guint timeout_id = 0;
+
+	self->heart_rates = 0;
+	self->errors = 0;
+	self->timed_out = FALSE;
+
+	device = g_thread_create(ecg_socket_bench_device, self, TRUE, NULL);
+
+	ecg_data = ecg_data_new(gconf_helper);
+	ecg_data_set_socket(ecg_data, path, ECG_SOCKET_BENCH_DEVICE_NAME);
+
+	timer = g_timer_new();
+	if(!ecg_data_add_callback_ecg(ecg_data,
+				ecg_socket_bench_heart_rate_arrived,
+				self, &error))
+	{
+		g_printerr("%s\n", error->message);
+		exit(1);
+	}
+
+	timeout_id = g_timeout_add(ECG_SOCKET_BENCH_TIMEOUT * 1000,
+			ecg_socket_bench_timeout, self);
+	g_main_loop_run(self->main_loop);
+	elapsed = g_timer_elapsed(timer, NULL);
+	if(!self->timed_out)
+	{
+		g_source_remove(timeout_id);
+	}
+
+	/* Closes the connection, which the stand-in device waits for */
+	ecg_data_remove_callback_ecg(ecg_data,
+			ecg_socket_bench_heart_rate_arrived, self);
+	g_thread_join(device);
+	ecg_data_destroy(ecg_data);
+
+	g_print("%12u %10u %10.3f %11u %8u%s\n",
+			self->max_fragment,
+			self->fragments,
+			elapsed,
+			self->heart_rates,
+			self->errors,
+			self->timed_out ? " (timed out)" : "");
+
+	g_timer_destroy(timer);
+
+	return !self->timed_out && self->errors == 0 &&
+		self->heart_rates == self->packet_count;
+}
+
+static gpointer ecg_socket_bench_teardown_device(gpointer user_data)
+{
+	EcgSocketBench *self = (EcgSocketBench *)user_data;
+	struct pollfd fds;
+	guint8 packet[ECG_SOCKET_BENCH_PACKET_SIZE];
+	ssize_t read_size = 0;
+	guint length = 0;
+	guint index = 0;
+	guint i = 0;
+	gint ready = 0;
+
+	for(i = 0; i < self->teardown_count; i++)
+	{
+		fds.fd = accept(self->listen_fd, NULL, NULL);
+		fds.events = POLLIN;
+		if(fds.fd == -1)
+		{
+			g_printerr("accept() failed: %s\n", strerror(errno));
+			return NULL;
+		}
+
+		for(index = 0; ; index++)
+		{
+			ready = poll(&fds, 1,
+					ECG_SOCKET_BENCH_TEARDOWN_INTERVAL);
+			if(ready == -1 && errno == EINTR)
+			{
+				continue;
+			}
+
+			if(ready == 0)
+			{
+				length = ecg_socket_bench_build_packet(packet,
+						index);
+				if(ecg_socket_bench_write(fds.fd, packet,
+							length))
+				{
+					continue;
+				}
+			} else if(ready == 1) {
+				/* EcgData never writes, so this is the end
+				 * of the connection */
+				read_size = read(fds.fd, packet, sizeof(packet));
+				if(read_size > 0 ||
+				   (read_size == -1 && errno == EINTR))
+				{
+					continue;
+				}
+			}
+
+			self->close_times[i] = sample_clock_now();
+			break;
+		}
+
+		close(fds.fd);
+	}
+
+	return NULL;
+}
+
+static gboolean ecg_socket_bench_run_teardown(
+		GConfHelperData *gconf_helper,
+		EcgSocketBench *self,
+		const gchar *path)
+{
+	EcgData *ecg_data = NULL;
+	GThread *device = NULL;
+	GError *error = NULL;
+	guint timeout_id = 0;
+	guint i = 0;
+
+	self->timed_out = FALSE;
+
+	device = g_thread_create(ecg_socket_bench_teardown_device, self, TRUE,
+			NULL);
+
+	ecg_data = ecg_data_new(gconf_helper);
+	ecg_data_set_socket(ecg_data, path, ECG_SOCKET_BENCH_DEVICE_NAME);
+
+	if(!ecg_data_add_callback_ecg(ecg_data,
+				ecg_socket_bench_teardown_heart_rate_arrived,
+				self, &error))
+	{
+		g_printerr("%s\n", error->message);
+		exit(1);
+	}
+
+	for(i = 0; i < self->teardown_count; i++)
+	{
+		/* Wait until the connection is up and running */
+		timeout_id = g_timeout_add(ECG_SOCKET_BENCH_TIMEOUT * 1000,
+				ecg_socket_bench_timeout, self);
+		g_main_loop_run(self->main_loop);
+		if(self->timed_out)
+		{
+			break;
+		}
+		g_source_remove(timeout_id);
+
+		self->remove_times[i] = sample_clock_now();
+		ecg_data_remove_callback_ecg(ecg_data,
+				ecg_socket_bench_teardown_heart_rate_arrived,
+				self);
+		if(i == self->teardown_count - 1)
+		{
+			break;
+		}
+
+		/* Waits for the previous connection to be closed */
+		if(!ecg_data_add_callback_ecg(ecg_data,
+				ecg_socket_bench_teardown_heart_rate_arrived,
+				self, &error))
+		{
+			g_printerr("%s\n", error->message);
+			exit(1);
+		}
+		self->reconnect_times[i] = sample_clock_now() -
+			self->remove_times[i];
+	}
+
+	if(self->timed_out)
+	{
+		/* Let the stand-in device give up */
+		ecg_data_destroy(ecg_data);
+		shutdown(self->listen_fd, SHUT_RDWR);
+		close(self->listen_fd);
+		self->listen_fd = -1;
+		g_thread_join(device);
+		g_print("the connection was not opened again (timed out)\n");
+		return FALSE;
+	}
+
+	g_thread_join(device);
+	ecg_data_destroy(ecg_data);
+
+	ecg_socket_bench_print_times("teardown", self->remove_times,
+			self->close_times, self->teardown_count);
+	ecg_socket_bench_print_times("reconnect", NULL,
+			self->reconnect_times, self->teardown_count - 1);
+
+	return TRUE;
+}
+
+static void ecg_socket_bench_print_times(
+		const gchar *name,
+		const gint64 *start,
+		const gint64 *end,
+		guint count)
+{
+	gint64 time = 0;
+	gint64 max = 0;
+	gdouble sum = 0;
+	guint i = 0;
+
+	if(count == 0)
+	{
+		return;
+	}
+
+	for(i = 0; i < count; i++)
+	{
+		time = end[i] - (start ? start[i] : 0);
+		sum += time;
+		max = MAX(max, time);
+	}
+
+	g_print("%12s %10.3f %10.3f\n", name, sum / count / 1000.0,
+			max / 1000.0);
+}
+
+static void ecg_socket_bench_heart_rate_arrived(
+		EcgData *ecg_data,
+		gint heart_rate,
+		gpointer user_data)
+{
+	EcgSocketBench *self = (EcgSocketBench *)user_data;
+
+	if(self->heart_rates >= self->packet_count)
+	{
+		return;
+	}
+
+	if(heart_rate != ecg_socket_bench_heart_rate(self->heart_rates))
+	{
+		/* Packets were lost or damaged */
+		self->errors++;
+	}
+
+	self->heart_rates++;
+	if(self->heart_rates == self->packet_count)
+	{
+		g_main_loop_quit(self->main_loop);
+	}
+}
+
+static void ecg_socket_bench_teardown_heart_rate_arrived(
+		EcgData *ecg_data,
+		gint heart_rate,
+		gpointer user_data)
+{
+	EcgSocketBench *self = (EcgSocketBench *)user_data;
+
+	g_main_loop_quit(self->main_loop);
+}
+
+static gboolean ecg_socket_bench_timeout(gpointer user_data)
+{
+	EcgSocketBench *self = (EcgSocketBench *)user_data;
+
+	self->timed_out = TRUE;
+	g_main_loop_quit(self->main_loop);
+
+	return FALSE;
+}
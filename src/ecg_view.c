@@ -103,11 +103,12 @@ EcgViewData *ecg_view_new(GConfHelperData *gconf_helper, EcgData *ecg_data)
 
 static void ecg_view_ecg_data_arrived(
 		EcgData *ecg_data,
-		guint8 *data,
-		guint len,
+		EcgSampleBlock *block,
 		gpointer user_data)
 {
 	gint i = 0;
+	gint len = block->length;
+	const gint16 *data = block->samples;
 	GdkGC *gc = NULL;
 	gint x1 = 0;
 	gint x2 = 0;
@@ -171,8 +172,8 @@ static void ecg_view_ecg_data_arrived(
 		x2 = x1 + 1;
 		x1++;
 		
-		y1 = data[i];
-		y2 = data[i + 1];
+		y1 = CLAMP(data[i], 0, 255);
+		y2 = CLAMP(data[i + 1], 0, 255);
 		y1d = (gdouble)y1;
 		y2d = (gdouble)y2;
 
@@ -227,7 +228,7 @@ void ecg_view_start_drawing(EcgViewData *self)
 	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 
-	retval = ecg_data_add_callback_ecg(self->ecg_data,
+	retval = ecg_data_add_callback_samples(self->ecg_data,
 			ecg_view_ecg_data_arrived,
 			self, &error);
 
@@ -249,7 +250,7 @@ void ecg_view_stop_drawing(EcgViewData *self)
 	if(self->is_drawing)
 	{
 		self->is_drawing = FALSE;
-		ecg_data_remove_callback_ecg(self->ecg_data,
+		ecg_data_remove_callback_samples(self->ecg_data,
 				ecg_view_ecg_data_arrived,
 				self);
 	}
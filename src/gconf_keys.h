@@ -28,6 +28,19 @@
 #define ECGC_BLUETOOTH_ADDRESS	ECGC_BASE_DIR "/bluetooth_address"
 #define ECGC_BLUETOOTH_NAME	ECGC_BASE_DIR "/bluetooth_name"
 
+/* Debugging: capture the data read from the heart rate monitor, or replay
+ * a capture instead of connecting to the heart rate monitor */
+#define ECGC_HRM_CAPTURE_FILE	ECGC_BASE_DIR "/hrm_capture_file"
+#define ECGC_HRM_REPLAY_FILE	ECGC_BASE_DIR "/hrm_replay_file"
+#define ECGC_HRM_REPLAY_REALTIME	ECGC_BASE_DIR "/hrm_replay_realtime"
+
+/* Record the raw ECG samples next to the GPX file of the activity */
+#define ECGC_ECG_RECORDING	ECGC_BASE_DIR "/ecg_recording"
+
+/* Journal of the track that is being recorded. Recovered on the next start
+ * if eCoach did not get to save the track. */
+#define ECGC_TRACK_JOURNAL	ECGC_BASE_DIR "/track_journal"
+
 #define ECGC_HRM_DIALOG_SHOWN	ECGC_BASE_DIR "/hrm_dialog_shown"
 
 #define ECGC_HRM_RANGES_DIALOG_SHOWN		ECGC_BASE_DIR \
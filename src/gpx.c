@@ -30,10 +30,12 @@
 
 /* System */
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
+#include <unistd.h>
 
 /* LibXML2 */
-#include <libxml/xpath.h>
+#include <libxml/tree.h>
 
 /* Other modules */
 #include "ec_error.h"
@@ -46,21 +48,30 @@
 
 #include "debug.h"
 
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+/** @brief Initial size of the buffer for the data that is written */
+#define GPX_STORAGE_STREAM_BUFFER_SIZE	4096
+
+/** @brief Length of the first gap for the track points of a segment */
+#define GPX_STORAGE_STREAM_GAP_SIZE	4096
+
 /*****************************************************************************
  * Private function prototypes                                               *
  *****************************************************************************/
 
 /**
- * @brief Search and return a top node of the given route or track
+ * @brief Search the index for the given route or track
  *
  * @param self Pointer to #GpxStorage
  * @param is_track Whether to search for a track or a route
  * @param route_track_id ID of the route or track to search for
  *
- * @return The pointer to the top node of the track or route, NULL
- * if no node was found
+ * @return The track or route, NULL if it was not found
  */
-xmlNodePtr gpx_storage_find_route_track(
+static GpxStorageRouteTrack *gpx_storage_find_route_track(
 		GpxStorage *self,
 		gboolean is_track,
 		guint route_track_id);
@@ -71,20 +82,22 @@ xmlNodePtr gpx_storage_find_route_track(
  * @param self Pointer to #GpxStorage
  * @param id Storage location for the allocated route ID
  *
- * @return The created XML node
+ * @return The created track
  */
-static xmlNodePtr gpx_storage_track_new(GpxStorage *self, guint *id);
+static GpxStorageRouteTrack *gpx_storage_track_new(
+		GpxStorage *self,
+		guint *id);
 
 /**
  * @brief Creates a new track segmend XML node
  *
  * @param self Pointer to #GpxStorage
- * @param parent_node Parent track node to add the route segment to
+ * @param track Track to add the route segment to
  *
  * @return The created XML node
  */
 static xmlNodePtr gpx_storage_track_segment_new(GpxStorage *self,
-		xmlNodePtr parent_node);
+		GpxStorageRouteTrack *track);
 
 /**
  * @brief Allocates a new route ID and creates an XML node for it
@@ -92,20 +105,279 @@ static xmlNodePtr gpx_storage_track_segment_new(GpxStorage *self,
  * @param self Pointer to #GpxStorage
  * @param id Storage location for the allocated route ID
  *
- * @return The created XML node
+ * @return The created route
  */
-static xmlNodePtr gpx_storage_route_new(GpxStorage *self, guint *id);
+static GpxStorageRouteTrack *gpx_storage_route_new(
+		GpxStorage *self,
+		guint *id);
+
+/**
+ * @brief Add a track or a route to the index
+ *
+ * @param index The index of tracks or routes
+ * @param id ID of the track or route
+ * @param node The trk or rte element
+ *
+ * @return The track or route in the index
+ */
+static GpxStorageRouteTrack *gpx_storage_route_track_insert(
+		GHashTable *index,
+		guint id,
+		xmlNodePtr node);
 
 /**
  * @brief Retrieve the last route segment in the given route
  *
  * @param self Pointer to #GpxStorage
- * @param parent_node The track node to get the segment under
+ * @param track The track to get the segment of
  *
  * @return The track segment, or NULL in case of failure
  */
 static xmlNodePtr gpx_storage_get_last_track_segment(GpxStorage *self,
-		xmlNodePtr parent_node);
+		GpxStorageRouteTrack *track);
+
+/**
+ * @brief Initialize an ID allocator
+ *
+ * @param ids Pointer to #GpxStorageIdAllocator
+ */
+static void gpx_storage_id_allocator_init(GpxStorageIdAllocator *ids);
+
+/**
+ * @brief Allocate the smallest ID that is not in use
+ *
+ * @param ids Pointer to #GpxStorageIdAllocator
+ *
+ * @return The ID
+ */
+static guint gpx_storage_id_allocate(GpxStorageIdAllocator *ids);
+
+/**
+ * @brief Add a heart rate node to the heart rate list of a track segment
+ *
+ * @param self Pointer to #GpxStorage
+ * @param point_type See gpx_storage_add_heart_rate()
+ * @param track_id See gpx_storage_add_heart_rate()
+ * @param time Time when the heart rate was detected
+ * @param heart_rate The heart rate (in beats per minute)
+ *
+ * @return The heart rate node, or NULL in case of failure
+ */
+static xmlNodePtr gpx_storage_heart_rate_new(
+		GpxStorage *self,
+		GpxStoragePointType point_type,
+		guint *track_id,
+		struct timeval *time,
+		gint heart_rate);
+
+/**
+ * @brief Find the extensions node of a track segment. There is at most
+ * one, and it is always the last child, after the track points.
+ *
+ * @param node_trkseg The track segment
+ *
+ * @return The extensions node, or NULL if there is none
+ */
+static xmlNodePtr gpx_storage_track_segment_get_extensions(
+		xmlNodePtr node_trkseg);
+
+/**
+ * @brief Set a heart rate variability attribute, unless the value is
+ * unknown (negative)
+ *
+ * @param node The heart rate node
+ * @param name Name of the attribute
+ * @param value Value of the attribute
+ */
+static void gpx_storage_set_hrv_attribute(
+		xmlNodePtr node,
+		const gchar *name,
+		gdouble value);
+
+/**
+ * @brief Make sure that a node is added to an element at the end of the
+ * document. If not, the next write is of the whole document.
+ *
+ * @param self Pointer to #GpxStorage
+ * @param parent The element that a node is about to be added to
+ */
+static void gpx_storage_stream_check_append(
+		GpxStorage *self,
+		xmlNodePtr parent);
+
+/**
+ * @brief Serialize the whole document, leaving the elements at the end
+ * open
+ *
+ * @param self Pointer to #GpxStorage
+ * @param data Buffer to append to
+ */
+static void gpx_storage_stream_begin(GpxStorage *self, GString *data);
+
+/**
+ * @brief Serialize the nodes that were added after the previous write.
+ * The data replaces the tail of the file.
+ *
+ * @param self Pointer to #GpxStorage
+ * @param data Buffer to append to
+ */
+static void gpx_storage_stream_continue(GpxStorage *self, GString *data);
+
+/**
+ * @brief Serialize the track points that were inserted before the heart
+ * rates of the segment that has a gap. If they do not fit in the gap, the
+ * stream is rewound to the gap, so that gpx_storage_stream_continue()
+ * writes the segment again from there.
+ *
+ * @param self Pointer to #GpxStorage
+ * @param data Buffer to append to
+ * @param offset Storage location for the offset of the data in the file
+ */
+static void gpx_storage_stream_fill_gap(
+		GpxStorage *self,
+		GString *data,
+		gsize *offset);
+
+/**
+ * @brief Serialize the tail: the end tags of the open elements
+ *
+ * @param self Pointer to #GpxStorage
+ * @param data Buffer to append to
+ */
+static void gpx_storage_stream_tail(GpxStorage *self, GString *data);
+
+/**
+ * @brief Serialize a gap of white space for the track points that are
+ * inserted before the extensions node of a track segment
+ *
+ * @param self Pointer to #GpxStorage
+ * @param data Buffer to append to
+ * @param segment The track segment
+ */
+static void gpx_storage_stream_gap(
+		GpxStorage *self,
+		GString *data,
+		xmlNodePtr segment);
+
+/**
+ * @brief Write the start tag of an element, leave it open, and serialize
+ * its children
+ *
+ * @param self Pointer to #GpxStorage
+ * @param data Buffer to append to
+ * @param node The element
+ * @param level Depth of the element in the document
+ */
+static void gpx_storage_stream_open(
+		GpxStorage *self,
+		GString *data,
+		xmlNodePtr node,
+		gint level);
+
+/**
+ * @brief Serialize the children of an element from the given one on. The
+ * last child is left open if more can be added to it. The extensions node
+ * of an open track segment comes after a gap, because track points are
+ * still inserted before it.
+ *
+ * @param self Pointer to #GpxStorage
+ * @param data Buffer to append to
+ * @param parent The element, or NULL if it is being closed and nothing is
+ * left open
+ * @param first The first child to serialize, or NULL if there are none
+ * @param level Depth of the children in the document
+ */
+static void gpx_storage_stream_children(
+		GpxStorage *self,
+		GString *data,
+		xmlNodePtr parent,
+		xmlNodePtr first,
+		gint level);
+
+/**
+ * @brief Serialize a whole node
+ *
+ * @param self Pointer to #GpxStorage
+ * @param data Buffer to append to
+ * @param node The node
+ * @param level Depth of the node in the document
+ */
+static void gpx_storage_stream_node(
+		GpxStorage *self,
+		GString *data,
+		xmlNodePtr node,
+		gint level);
+
+/**
+ * @brief Whether nodes can still be added to an element that is the last
+ * child of its parent
+ *
+ * @param node The element
+ *
+ * @return TRUE if the element is left open when writing
+ */
+static gboolean gpx_storage_stream_is_open_element(xmlNodePtr node);
+
+/**
+ * @brief Whether nodes are still inserted before a child of an open
+ * element
+ *
+ * @param parent The open element
+ * @param node The child
+ *
+ * @return TRUE if the node is the extensions node of a track segment
+ */
+static gboolean gpx_storage_stream_is_gap_node(
+		xmlNodePtr parent,
+		xmlNodePtr node);
+
+/**
+ * @brief Serialize the start tag of an element with its namespace
+ * declarations and attributes
+ *
+ * @param data Buffer to append to
+ * @param node The element
+ * @param level Depth of the element in the document
+ */
+static void gpx_storage_stream_start_tag(
+		GString *data,
+		xmlNodePtr node,
+		gint level);
+
+/**
+ * @brief Serialize the end tag of an element
+ *
+ * @param data Buffer to append to
+ * @param node The element
+ * @param level Depth of the element in the document
+ */
+static void gpx_storage_stream_end_tag(
+		GString *data,
+		xmlNodePtr node,
+		gint level);
+
+/**
+ * @brief Serialize the name of an element or an attribute with its
+ * namespace prefix
+ *
+ * @param data Buffer to append to
+ * @param node The element or attribute
+ */
+static void gpx_storage_stream_name(GString *data, xmlNodePtr node);
+
+/**
+ * @brief Write data to a file descriptor
+ *
+ * @param fd The file descriptor
+ * @param data The data
+ * @param length Length of the data
+ *
+ * @return TRUE on success, FALSE on failure (see errno)
+ */
+static gboolean gpx_storage_write_data(
+		gint fd,
+		const gchar *data,
+		gsize length);
 
 /*****************************************************************************
  * Function declarations                                                     *
@@ -156,6 +428,16 @@ GpxStorage *gpx_storage_new()
 
 	xmlDocSetRootElement(self->xml_document, self->root_node);
 
+	gpx_storage_id_allocator_init(&self->track_ids);
+	gpx_storage_id_allocator_init(&self->route_ids);
+	self->tracks = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+			NULL, g_free);
+	self->routes = g_hash_table_new_full(g_direct_hash, g_direct_equal,
+			NULL, g_free);
+
+	self->coordinate_decimals = GPX_STORAGE_COORDINATE_DECIMALS;
+	self->elevation_decimals = GPX_STORAGE_ELEVATION_DECIMALS;
+
 	DEBUG_END();
 	return self;
 }
@@ -167,8 +449,10 @@ void gpx_storage_free(GpxStorage *self)
 
 	xmlFreeDoc(self->xml_document);
 	g_free(self->file_path);
-	g_slist_free(self->track_ids);
-	g_slist_free(self->route_ids);
+	g_array_free(self->track_ids.words, TRUE);
+	g_array_free(self->route_ids.words, TRUE);
+	g_hash_table_destroy(self->tracks);
+	g_hash_table_destroy(self->routes);
 	g_free(self);
 
 	DEBUG_END();
@@ -187,15 +471,37 @@ void gpx_storage_set_path(
 	}
 	self->file_path = g_strdup(path);
 
+	/* The new file is written from the beginning */
+	self->stream_valid = FALSE;
+
 	DEBUG_END();
 }
 
+void gpx_storage_set_decimals(
+		GpxStorage *self,
+		guint coordinate_decimals,
+		guint elevation_decimals)
+{
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(coordinate_decimals <= UTIL_FORMAT_FIXED_MAX_DECIMALS);
+	g_return_if_fail(elevation_decimals <= UTIL_FORMAT_FIXED_MAX_DECIMALS);
+
+	self->coordinate_decimals = coordinate_decimals;
+	self->elevation_decimals = elevation_decimals;
+}
+
 gboolean gpx_storage_write(
 		GpxStorage *self,
 		GError **error)
 {
-	/** @todo Do autosave every now and then */
-	g_return_val_if_fail(error != NULL || *error == NULL, FALSE);
+	GString *data = NULL;
+	GString *gap = NULL;
+	gsize offset = 0;
+	gsize gap_offset = 0;
+	gsize length = 0;
+	gint fd = -1;
+
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
 	g_return_val_if_fail(self != NULL, FALSE);
 	DEBUG_BEGIN();
 
@@ -206,20 +512,71 @@ gboolean gpx_storage_write(
 		return FALSE;
 	}
 
-	xmlIndentTreeOutput = 1;
-
 	/**
 	 * @todo Make configurable whether or not to use indentation
 	 */
-	if(xmlSaveFormatFile(self->file_path,
-				self->xml_document,
-				1) < 0)
+	xmlIndentTreeOutput = 1;
+
+	data = g_string_sized_new(GPX_STORAGE_STREAM_BUFFER_SIZE);
+	gap = g_string_sized_new(GPX_STORAGE_STREAM_BUFFER_SIZE);
+	if(self->stream_valid)
+	{
+		gpx_storage_stream_fill_gap(self, gap, &gap_offset);
+	}
+	if(self->stream_valid)
+	{
+		/* Overwrite the tail of the file */
+		offset = self->stream_offset;
+		self->stream_data_offset = offset;
+		gpx_storage_stream_continue(self, data);
+	} else {
+		self->stream_data_offset = 0;
+		gpx_storage_stream_begin(self, data);
+	}
+	length = data->len;
+	gpx_storage_stream_tail(self, data);
+
+	/* If anything fails, the next write starts from the beginning */
+	self->stream_valid = FALSE;
+
+	fd = open(self->file_path, offset > 0 ?
+			O_WRONLY | O_CREAT : O_WRONLY | O_CREAT | O_TRUNC,
+			0644);
+	if(fd == -1 ||
+			(gap->len > 0 &&
+			 (lseek(fd, gap_offset, SEEK_SET) == (off_t)-1 ||
+			  !gpx_storage_write_data(fd, gap->str, gap->len))) ||
+			lseek(fd, offset, SEEK_SET) == (off_t)-1 ||
+			!gpx_storage_write_data(fd, data->str, data->len) ||
+			ftruncate(fd, offset + data->len) == -1)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"File saving failed: %s", strerror(errno));
+		if(fd != -1)
+		{
+			close(fd);
+		}
+		g_string_free(data, TRUE);
+		g_string_free(gap, TRUE);
+		DEBUG_END();
+		return FALSE;
+	}
+
+	if(close(fd) == -1)
 	{
 		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
-				"File saving failed");
+				"File saving failed: %s", strerror(errno));
+		g_string_free(data, TRUE);
+		g_string_free(gap, TRUE);
+		DEBUG_END();
 		return FALSE;
 	}
 
+	self->stream_offset = offset + length;
+	self->stream_valid = TRUE;
+	g_string_free(data, TRUE);
+	g_string_free(gap, TRUE);
+
 	DEBUG_END();
 	return TRUE;
 }
@@ -228,11 +585,13 @@ void gpx_storage_add_waypoint(
 		GpxStorage *self,
 		GpxStorageWaypoint *waypoint)
 {
+	GpxStorageRouteTrack *route_track = NULL;
 	xmlNodePtr parent_node = NULL;
 	xmlNodePtr waypoint_node = NULL;
+	xmlNodePtr node_extensions = NULL;
 	gboolean is_track = FALSE;
-	gchar *buf = NULL;
-	gchar dbuf[G_ASCII_DTOSTR_BUF_SIZE];
+	gchar buf[UTIL_XML_DATE_TIME_BUF_SIZE];
+	gchar dbuf[UTIL_FORMAT_FIXED_BUF_SIZE];
 
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(waypoint != NULL);
@@ -253,18 +612,18 @@ void gpx_storage_add_waypoint(
 	{
 		DEBUG("Creating a new track");
 		/* Create a new track */
-		parent_node = gpx_storage_track_new(self,
+		route_track = gpx_storage_track_new(self,
 				&waypoint->route_track_id);
 	} else if(waypoint->point_type == GPX_STORAGE_POINT_TYPE_ROUTE_START) {
 		DEBUG("Creating a new route");
-		parent_node = gpx_storage_route_new(self,
+		route_track = gpx_storage_route_new(self,
 				&waypoint->route_track_id);
 	} else {
-		parent_node = gpx_storage_find_route_track(
+		route_track = gpx_storage_find_route_track(
 				self, is_track, waypoint->route_track_id);
 	}
 
-	if(!parent_node)
+	if(!route_track)
 	{
 		g_warning("Unable to add point to track or route");
 		DEBUG_END();
@@ -276,11 +635,13 @@ void gpx_storage_add_waypoint(
 			GPX_STORAGE_POINT_TYPE_TRACK_START)
 	{
 		DEBUG("Creating a new track segment");
-		parent_node = gpx_storage_track_segment_new(self, parent_node);
+		parent_node = gpx_storage_track_segment_new(self, route_track);
 	} else if(waypoint->point_type == GPX_STORAGE_POINT_TYPE_TRACK) {
 		/* Tracks have trkseg nodes that have the actual data */
 		parent_node = gpx_storage_get_last_track_segment(self,
-				parent_node);
+				route_track);
+	} else {
+		parent_node = route_track->node;
 	}
 
 	if(!parent_node)
@@ -290,12 +651,24 @@ void gpx_storage_add_waypoint(
 		return;
 	}
 
+	gpx_storage_stream_check_append(self, parent_node);
+
 	if(is_track)
 	{
-		waypoint_node = xmlNewChild(parent_node,
-				NULL,
-				EC_GPX_NODE_TRACK_POINT,
-				NULL);
+		/* The heart rates of the segment stay after the points */
+		node_extensions = gpx_storage_track_segment_get_extensions(
+				parent_node);
+		if(node_extensions)
+		{
+			waypoint_node = xmlNewNode(NULL,
+					EC_GPX_NODE_TRACK_POINT);
+			xmlAddPrevSibling(node_extensions, waypoint_node);
+		} else {
+			waypoint_node = xmlNewChild(parent_node,
+					NULL,
+					EC_GPX_NODE_TRACK_POINT,
+					NULL);
+		}
 	} else {
 		waypoint_node = xmlNewChild(parent_node,
 				NULL,
@@ -303,32 +676,45 @@ void gpx_storage_add_waypoint(
 				NULL);
 	}
 
-	g_ascii_dtostr(dbuf, G_ASCII_DTOSTR_BUF_SIZE, waypoint->latitude);
+	util_format_fixed(waypoint->latitude, self->coordinate_decimals, dbuf);
 	xmlNewProp(waypoint_node,
 			EC_GPX_NODE_WAYPOINT_ATTR_LATITUDE_NAME,
 			dbuf);
 
-	g_ascii_dtostr(dbuf, G_ASCII_DTOSTR_BUF_SIZE, waypoint->longitude);
+	util_format_fixed(waypoint->longitude, self->coordinate_decimals,
+			dbuf);
 	xmlNewProp(waypoint_node,
 			EC_GPX_NODE_WAYPOINT_ATTR_LONGITUDE_NAME,
 			dbuf);
 
 	if(waypoint->altitude_is_set)
 	{
-		g_ascii_dtostr(dbuf,
-				G_ASCII_DTOSTR_BUF_SIZE, waypoint->altitude);
+		util_format_fixed(waypoint->altitude,
+				self->elevation_decimals, dbuf);
 		xmlNewChild(waypoint_node,
 				NULL,
 				EC_GPX_NODE_WAYPOINT_ALTITUDE,
 				dbuf);
 	}
 
-	buf = util_xml_date_time_string_from_timeval(&waypoint->timestamp);
+	util_xml_date_time_format(&waypoint->timestamp, buf);
 	xmlNewChild(waypoint_node,
 			NULL,
 			EC_GPX_NODE_WAYPOINT_TIME,
 			buf);
-	g_free(buf);
+
+	if(is_track && waypoint->cadence >= 0)
+	{
+		node_extensions = xmlNewChild(waypoint_node,
+				NULL,
+				EC_GPX_NODE_EXTENSIONS,
+				NULL);
+		util_format_int(waypoint->cadence, dbuf);
+		xmlNewChild(node_extensions,
+				self->xmlns_gpx_extensions,
+				EC_GPX_EXT_NODE_CADENCE,
+				dbuf);
+	}
 
 	DEBUG_END();
 }
@@ -340,112 +726,53 @@ void gpx_storage_add_heart_rate(
 		struct timeval *time,
 		gint heart_rate)
 {
-	xmlNodePtr node_track = NULL;
-	xmlNodePtr node_trkseg = NULL;
-	xmlNodePtr node_extensions = NULL;
-	xmlNodePtr node_hr_list = NULL;
-	xmlNodePtr node_hr = NULL;
-	gchar *buf = NULL;
-
-	/** @todo Add caching for the xml node */
-
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(time != NULL);
 	DEBUG_BEGIN();
 
-	if((point_type != GPX_STORAGE_POINT_TYPE_TRACK_START) &&
-	   (point_type != GPX_STORAGE_POINT_TYPE_TRACK_SEGMENT_START) &&
-	   (point_type != GPX_STORAGE_POINT_TYPE_TRACK))
-	{
-		g_warning("Invalid point type for heart rate");
-		DEBUG_END();
-		return;
-	}
-
-	if(point_type == GPX_STORAGE_POINT_TYPE_TRACK_START)
-	{
-		node_track = gpx_storage_track_new(self, track_id);
-	} else {
-		node_track = gpx_storage_find_route_track(
-				self,
-				TRUE,
-				*track_id);
-	}
-
-	if(!node_track)
-	{
-		g_warning("Unable to find or create track with id %d",
-				*track_id);
-		DEBUG_END();
-		return;
-	}
-
-	if((point_type == GPX_STORAGE_POINT_TYPE_TRACK_SEGMENT_START) ||
-	   (point_type == GPX_STORAGE_POINT_TYPE_TRACK_START))
-	{
-		node_trkseg = gpx_storage_track_segment_new(self, node_track);
-	} else {
-		node_trkseg = gpx_storage_get_last_track_segment(self,
-				node_track);
-	}
-
-	if(!node_trkseg)
-	{
-		g_warning("Unable to find or create a track segment");
-		DEBUG_END();
-		return;
-	}
+	gpx_storage_heart_rate_new(self, point_type, track_id, time,
+			heart_rate);
 
-	node_extensions = xml_util_find_or_create_child_ordered(
-			node_trkseg,
-			EC_GPX_NODE_EXTENSIONS,
-			NULL,
-			EC_GPX_NODE_TRACK_SEGMENT,
-			NULL);
+	DEBUG_END();
+}
 
-	if(!node_extensions)
-	{
-		g_warning("Unable to find or create extension node");
-		DEBUG_END();
-		return;
-	}
+void gpx_storage_add_heart_rate_variability(
+		GpxStorage *self,
+		GpxStoragePointType point_type,
+		guint *track_id,
+		struct timeval *time,
+		const HrvMetrics *metrics)
+{
+	xmlNodePtr node_hr = NULL;
 
-	node_hr_list = xml_util_find_or_create_child(
-			node_extensions,
-			EC_GPX_EXT_NODE_HEART_RATE_LIST,
-			self->xmlns_gpx_extensions,
-			TRUE);
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(time != NULL);
+	g_return_if_fail(metrics != NULL);
+	DEBUG_BEGIN();
 
-	if(!node_hr_list)
+	if(metrics->heart_rate < 0)
 	{
-		g_warning("Unable to find or create hear rate list node");
 		DEBUG_END();
 		return;
 	}
 
-	node_hr = xmlNewChild(node_hr_list,
-			self->xmlns_gpx_extensions,
-			EC_GPX_EXT_NODE_HEART_RATE,
-			NULL);
+	node_hr = gpx_storage_heart_rate_new(self, point_type, track_id,
+			time, (gint)(metrics->heart_rate + 0.5));
 	if(!node_hr)
 	{
-		g_warning("Unable to create heart rate node");
 		DEBUG_END();
 		return;
 	}
 
-	buf = util_xml_date_time_string_from_timeval(time);
-
-	xmlNewProp(node_hr,
-			EC_GPX_EXT_ATTR_HEART_RATE_TIME,
-			buf);
-	g_free(buf);
-
-	buf = g_strdup_printf("%d", heart_rate);
-	xmlNewProp(node_hr,
-			EC_GPX_EXT_ATTR_HEART_RATE_VALUE,
-			buf);
-	g_free(buf);
+	gpx_storage_set_hrv_attribute(node_hr,
+			EC_GPX_EXT_ATTR_HEART_RATE_SDNN,
+			metrics->sdnn);
+	gpx_storage_set_hrv_attribute(node_hr,
+			EC_GPX_EXT_ATTR_HEART_RATE_RMSSD,
+			metrics->rmssd);
+	gpx_storage_set_hrv_attribute(node_hr,
+			EC_GPX_EXT_ATTR_HEART_RATE_PNN50,
+			metrics->pnn50);
 
 	DEBUG_END();
 }
@@ -457,6 +784,7 @@ void gpx_storage_set_route_or_track_details(
 		const gchar *name,
 		const gchar *comment)
 {
+	GpxStorageRouteTrack *found = NULL;
 	xmlNodePtr route_track = NULL;
 	xmlNodePtr node_name = NULL;
 	xmlNodePtr node_comment = NULL;
@@ -464,18 +792,25 @@ void gpx_storage_set_route_or_track_details(
 	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 
-	route_track = gpx_storage_find_route_track(
+	found = gpx_storage_find_route_track(
 			self,
 			is_track,
 			route_track_id);
 
-	if(!route_track)
+	if(!found)
 	{
 		DEBUG("Unable to find route or track with ID %d",
 				route_track_id);
 		DEBUG_END();
 		return;
 	}
+	route_track = found->node;
+
+	/* The start of the track or route changes */
+	if((name || comment) && route_track->_private == self)
+	{
+		self->stream_valid = FALSE;
+	}
 
 	if(name)
 	{
@@ -546,73 +881,17 @@ void gpx_storage_set_route_or_track_details(
  * Private functions                                                         *
  *===========================================================================*/
 
-xmlNodePtr gpx_storage_find_route_track(
+static GpxStorageRouteTrack *gpx_storage_find_route_track(
 		GpxStorage *self,
 		gboolean is_track,
 		guint route_track_id)
 {
-	xmlXPathContextPtr xpathCtx;
-	xmlXPathObjectPtr xpathObj;
-	xmlNodePtr retval = NULL;
-	xmlNodeSetPtr nodes = NULL;
-
-	gint i = 0;
-	guint found_id;
-
-	/**
-	 * @todo It is inefficient to find the right track every time.
-	 * A simple cache of the previous result would be easy to implement,
-	 * also it is possible to implement a list of trackid-node -pairs
-	 */
+	GpxStorageRouteTrack *retval = NULL;
 
 	g_return_val_if_fail(self != NULL, NULL);
-	DEBUG_BEGIN();
-
-	xpathCtx = xmlXPathNewContext(self->xml_document);
-	if(xpathCtx == NULL)
-	{
-		g_warning("Unable to create XPath context");
-		DEBUG_END();
-		return NULL;
-	}
-
-	if(is_track)
-	{
-		xpathObj = xmlXPathEvalExpression(
-				EC_GPX_XPATH_TRACK_NUMBER,
-				xpathCtx);
-	} else {
-		xpathObj = xmlXPathEvalExpression(
-				EC_GPX_XPATH_ROUTE_NUMBER,
-				xpathCtx);
-	}
-
-	if(xpathObj == NULL)
-	{
-		xmlXPathFreeContext(xpathCtx);
-		g_warning("Unable to evaluate XPath expression");
-		DEBUG_END();
-		return NULL;
-	}
-
-	nodes = xpathObj->nodesetval;
-	for(i = 0; i < nodes->nodeNr; i++)
-	{
-		g_assert(nodes->nodeTab[i]);
-		if(nodes->nodeTab[i]->type == XML_ELEMENT_NODE)
-		{
-			/* Check if the route id matches */
-			errno = 0;
-			found_id = strtoul(nodes->nodeTab[i]->children->content,
-						NULL, 10);
-			if(errno == 0 && found_id == route_track_id)
-			{
-				retval = nodes->nodeTab[i]->parent;
-				break;
-			}
-		}
-	}
 
+	retval = g_hash_table_lookup(is_track ? self->tracks : self->routes,
+			GUINT_TO_POINTER(route_track_id));
 	if(!retval)
 	{
 		/* No track/route was found */
@@ -620,179 +899,660 @@ xmlNodePtr gpx_storage_find_route_track(
 				route_track_id);
 	}
 
-	xmlXPathFreeObject(xpathObj);
-	xmlXPathFreeContext(xpathCtx);
-
-	DEBUG_END();
 	return retval;
 }
 
-static xmlNodePtr gpx_storage_track_new(GpxStorage *self, guint *id)
+static GpxStorageRouteTrack *gpx_storage_track_new(
+		GpxStorage *self,
+		guint *id)
 {
-	GSList *temp = NULL;
-	guint curr = 0;
-	guint prev = 0;
-	xmlNodePtr retval = NULL;
+	xmlNodePtr node = NULL;
 	gchar *buf = NULL;
-	gboolean found_gap = FALSE;
-	gint counter = 1;
 
 	g_return_val_if_fail(self != NULL, NULL);
 	g_return_val_if_fail(id != NULL, NULL);
 	DEBUG_BEGIN();
 
-	/* Search for an available number */
-	for(temp = self->track_ids; temp; temp = g_slist_next(temp))
-	{
-		counter++;
-		curr = GPOINTER_TO_UINT(temp->data);
-
-		if(curr - prev > 1)
-		{
-			/* There is a gap. Use that for the ID */
-			DEBUG_LONG("Found a gap. Using track id %d", curr);
-			found_gap = TRUE;
-			prev = curr - 1;
-			break;
-		}
-		prev = curr;
-	}
-	if(!found_gap)
-	{
-		/* There were no gaps. Add a new ID */
-		*id = counter;
-		self->track_ids = g_slist_append(self->track_ids,
-				GUINT_TO_POINTER(prev));
-
-	} else {
-		/* There was a gap. Use it. */
-		*id = prev;
-		self->track_ids = g_slist_insert(
-				self->track_ids,
-				GUINT_TO_POINTER(prev),
-				counter - 1);
-	}
+	*id = gpx_storage_id_allocate(&self->track_ids);
 
 	DEBUG("Adding track with id %d", *id);
 
 	/* Create the XML node */
-	retval = xmlNewChild(self->root_node,
+	gpx_storage_stream_check_append(self, self->root_node);
+	node = xmlNewChild(self->root_node,
 			NULL,
 			EC_GPX_NODE_TRACK,
 			NULL);
 
 	/* Add the route number */
 	buf = g_strdup_printf("%u", *id);
-	xmlNewChild(retval,
+	xmlNewChild(node,
 			NULL,
 			EC_GPX_NODE_TRACK_NUMBER,
 			buf);
 	g_free(buf);
 
 	DEBUG_END();
-	return retval;
+	return gpx_storage_route_track_insert(self->tracks, *id, node);
 }
 
 static xmlNodePtr gpx_storage_track_segment_new(GpxStorage *self,
-		xmlNodePtr parent_node)
+		GpxStorageRouteTrack *track)
 {
 	xmlNodePtr retval = NULL;
 
 	g_return_val_if_fail(self != NULL, NULL);
-	g_return_val_if_fail(parent_node != NULL, NULL);
+	g_return_val_if_fail(track != NULL, NULL);
 	DEBUG_BEGIN();
 
-	retval = xmlNewChild(parent_node,
+	gpx_storage_stream_check_append(self, track->node);
+	retval = xmlNewChild(track->node,
 			NULL,
 			EC_GPX_NODE_TRACK_SEGMENT,
 			NULL);
+	track->last_segment = retval;
 
 	DEBUG_END();
 	return retval;
 }
 
-static xmlNodePtr gpx_storage_route_new(GpxStorage *self, guint *id)
+static GpxStorageRouteTrack *gpx_storage_route_new(
+		GpxStorage *self,
+		guint *id)
 {
-	GSList *temp = NULL;
-	guint curr = 0;
-	guint prev = 0;
-	xmlNodePtr retval = NULL;
+	xmlNodePtr node = NULL;
 	gchar *buf = NULL;
 
 	g_return_val_if_fail(self != NULL, NULL);
 	g_return_val_if_fail(id != NULL, NULL);
 	DEBUG_BEGIN();
 
-	/* Search for an available number */
-	for(temp = self->route_ids; temp; temp = g_slist_next(temp))
-	{
-		curr = GPOINTER_TO_UINT(temp->data);
+	*id = gpx_storage_id_allocate(&self->route_ids);
 
-		if(curr - prev > 1)
-		{
-			/* There is a gap. Use that for the ID */
-			prev = curr - 1;
-			break;
-		}
-		prev = curr;
-	}
-	if(prev == curr && prev != 0)
-	{
-		/* There were no gaps. Add a new ID */
-		prev++;
-	}
-
-	DEBUG("Adding route with id %d", prev);
-	self->route_ids = g_slist_append(self->route_ids,
-			GUINT_TO_POINTER(prev));
-
-	*id = prev;
+	DEBUG("Adding route with id %d", *id);
 
 	/* Create the XML node */
-	retval = xmlNewChild(self->root_node,
+	gpx_storage_stream_check_append(self, self->root_node);
+	node = xmlNewChild(self->root_node,
 			NULL,
 			EC_GPX_NODE_ROUTE,
 			NULL);
 
 	/* Add the route number */
 	buf = g_strdup_printf("%u", *id);
-	xmlNewChild(retval,
+	xmlNewChild(node,
 			NULL,
 			EC_GPX_NODE_ROUTE_NUBMER,
 			buf);
 	g_free(buf);
 
 	DEBUG_END();
-	return retval;
+	return gpx_storage_route_track_insert(self->routes, *id, node);
 }
 
+static GpxStorageRouteTrack *gpx_storage_route_track_insert(
+		GHashTable *index,
+		guint id,
+		xmlNodePtr node)
+{
+	GpxStorageRouteTrack *route_track = NULL;
 
-static xmlNodePtr gpx_storage_get_last_track_segment(GpxStorage *self,
-		xmlNodePtr parent_node)
+	g_return_val_if_fail(index != NULL, NULL);
+	g_return_val_if_fail(node != NULL, NULL);
+
+	route_track = g_new0(GpxStorageRouteTrack, 1);
+	route_track->node = node;
+	g_hash_table_insert(index, GUINT_TO_POINTER(id), route_track);
+
+	return route_track;
+}
+
+static xmlNodePtr gpx_storage_heart_rate_new(
+		GpxStorage *self,
+		GpxStoragePointType point_type,
+		guint *track_id,
+		struct timeval *time,
+		gint heart_rate)
 {
-	xmlNodePtr temp;
-	xmlNodePtr found = NULL;
+	GpxStorageRouteTrack *track = NULL;
+	xmlNodePtr node_trkseg = NULL;
+	xmlNodePtr node_extensions = NULL;
+	xmlNodePtr node_hr_list = NULL;
+	xmlNodePtr node_hr = NULL;
+	gchar buf[UTIL_XML_DATE_TIME_BUF_SIZE];
+
+	if((point_type != GPX_STORAGE_POINT_TYPE_TRACK_START) &&
+	   (point_type != GPX_STORAGE_POINT_TYPE_TRACK_SEGMENT_START) &&
+	   (point_type != GPX_STORAGE_POINT_TYPE_TRACK))
+	{
+		g_warning("Invalid point type for heart rate");
+		return NULL;
+	}
 
+	if(point_type == GPX_STORAGE_POINT_TYPE_TRACK_START)
+	{
+		track = gpx_storage_track_new(self, track_id);
+	} else {
+		track = gpx_storage_find_route_track(
+				self,
+				TRUE,
+				*track_id);
+	}
+
+	if(!track)
+	{
+		g_warning("Unable to find or create track with id %d",
+				*track_id);
+		return NULL;
+	}
+
+	if((point_type == GPX_STORAGE_POINT_TYPE_TRACK_SEGMENT_START) ||
+	   (point_type == GPX_STORAGE_POINT_TYPE_TRACK_START))
+	{
+		node_trkseg = gpx_storage_track_segment_new(self, track);
+	} else {
+		node_trkseg = gpx_storage_get_last_track_segment(self, track);
+	}
+
+	if(!node_trkseg)
+	{
+		g_warning("Unable to find or create a track segment");
+		return NULL;
+	}
+
+	/* The heart rates of a segment go to one extensions node after its
+	 * track points */
+	node_extensions = gpx_storage_track_segment_get_extensions(
+			node_trkseg);
+	if(node_extensions)
+	{
+		node_hr_list = node_extensions->last;
+	} else {
+		gpx_storage_stream_check_append(self, node_trkseg);
+		node_extensions = xmlNewChild(node_trkseg,
+				NULL,
+				EC_GPX_NODE_EXTENSIONS,
+				NULL);
+		if(!node_extensions)
+		{
+			g_warning("Unable to create extension node");
+			return NULL;
+		}
+		node_hr_list = xmlNewChild(node_extensions,
+				self->xmlns_gpx_extensions,
+				EC_GPX_EXT_NODE_HEART_RATE_LIST,
+				NULL);
+	}
+
+	if(!node_hr_list)
+	{
+		g_warning("Unable to find or create hear rate list node");
+		return NULL;
+	}
+
+	gpx_storage_stream_check_append(self, node_hr_list);
+	node_hr = xmlNewChild(node_hr_list,
+			self->xmlns_gpx_extensions,
+			EC_GPX_EXT_NODE_HEART_RATE,
+			NULL);
+	if(!node_hr)
+	{
+		g_warning("Unable to create heart rate node");
+		return NULL;
+	}
+
+	util_xml_date_time_format(time, buf);
+	xmlNewProp(node_hr,
+			EC_GPX_EXT_ATTR_HEART_RATE_TIME,
+			buf);
+
+	util_format_int(heart_rate, buf);
+	xmlNewProp(node_hr,
+			EC_GPX_EXT_ATTR_HEART_RATE_VALUE,
+			buf);
+
+	return node_hr;
+}
+
+
+static xmlNodePtr gpx_storage_track_segment_get_extensions(
+		xmlNodePtr node_trkseg)
+{
+	xmlNodePtr node = node_trkseg->last;
+
+	if(node && node->type == XML_ELEMENT_NODE &&
+			strcmp(node->name, EC_GPX_NODE_EXTENSIONS) == 0)
+	{
+		return node;
+	}
+
+	return NULL;
+}
+
+static void gpx_storage_set_hrv_attribute(
+		xmlNodePtr node,
+		const gchar *name,
+		gdouble value)
+{
+	gchar dbuf[UTIL_FORMAT_FIXED_BUF_SIZE];
+
+	/* Metrics that could not be computed are left out */
+	if(value < 0)
+	{
+		return;
+	}
+
+	util_format_fixed(value, 1, dbuf);
+	xmlNewProp(node, name, dbuf);
+}
+
+static xmlNodePtr gpx_storage_get_last_track_segment(GpxStorage *self,
+		GpxStorageRouteTrack *track)
+{
 	g_return_val_if_fail(self != NULL, NULL);
-	g_return_val_if_fail(parent_node != NULL, NULL);
-	DEBUG_BEGIN();
+	g_return_val_if_fail(track != NULL, NULL);
 
-	for(temp = parent_node->children; temp; temp = temp->next)
+	if(!track->last_segment)
 	{
-		if(temp->type == XML_ELEMENT_NODE)
+		g_warning("No route segments");
+	}
+
+	return track->last_segment;
+}
+
+static void gpx_storage_id_allocator_init(GpxStorageIdAllocator *ids)
+{
+	g_return_if_fail(ids != NULL);
+
+	ids->words = g_array_new(FALSE, TRUE, sizeof(guint32));
+
+	/* There is no ID 0 */
+	g_array_set_size(ids->words, 1);
+	g_array_index(ids->words, guint32, 0) = 1;
+	ids->first_free = 1;
+}
+
+static guint gpx_storage_id_allocate(GpxStorageIdAllocator *ids)
+{
+	guint word = 0;
+	guint bit = 0;
+	guint32 used = 0;
+
+	g_return_val_if_fail(ids != NULL, 0);
+
+	/* Skip the words that have no free IDs */
+	word = ids->first_free / 32;
+	while(word < ids->words->len &&
+			g_array_index(ids->words, guint32, word) == G_MAXUINT32)
+	{
+		word++;
+	}
+
+	if(word == ids->words->len)
+	{
+		g_array_set_size(ids->words, word + 1);
+	}
+
+	used = g_array_index(ids->words, guint32, word);
+	for(bit = 0; used & (1U << bit); bit++)
+	{
+		/* Find the lowest free bit */
+	}
+
+	g_array_index(ids->words, guint32, word) = used | (1U << bit);
+	ids->first_free = word * 32 + bit + 1;
+
+	return word * 32 + bit;
+}
+
+static void gpx_storage_stream_check_append(
+		GpxStorage *self,
+		xmlNodePtr parent)
+{
+	xmlNodePtr node = NULL;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(parent != NULL);
+
+	if(!self->stream_valid)
+	{
+		return;
+	}
+
+	for(node = parent; node != self->root_node; node = node->parent)
+	{
+		if(!node->parent || node->parent->last != node)
+		{
+			DEBUG("Adding to the middle of the document");
+			self->stream_valid = FALSE;
+			return;
+		}
+	}
+}
+
+static void gpx_storage_stream_begin(GpxStorage *self, GString *data)
+{
+	g_string_append(data, "<?xml version=\"" EC_GPX_XML_VERSION "\"?>");
+
+	self->stream_depth = 0;
+	self->stream_gap_segment = NULL;
+	gpx_storage_stream_open(self, data, self->root_node, 0);
+}
+
+static void gpx_storage_stream_continue(GpxStorage *self, GString *data)
+{
+	xmlNodePtr *path = self->stream_path;
+	xmlNodePtr after = NULL;
+	gint open = 1;
+	gint level = 0;
+
+	/* The elements that are still the last children of their parents
+	 * can still grow, and stay open */
+	while(open < self->stream_depth &&
+			path[open] == path[open - 1]->last)
+	{
+		open++;
+	}
+
+	/* Close the others, after writing the nodes that were added to
+	 * them */
+	after = self->stream_last_child;
+	for(level = self->stream_depth - 1; level >= open; level--)
+	{
+		gpx_storage_stream_children(self, data, NULL,
+				after ? after->next : path[level]->children,
+				level + 1);
+		gpx_storage_stream_end_tag(data, path[level], level);
+		if(path[level] == self->stream_gap_segment)
+		{
+			self->stream_gap_segment = NULL;
+		}
+		after = path[level];
+	}
+
+	self->stream_depth = open;
+	gpx_storage_stream_children(self, data, path[open - 1],
+			after ? after->next : path[open - 1]->children,
+			open);
+}
+
+static void gpx_storage_stream_fill_gap(
+		GpxStorage *self,
+		GString *data,
+		gsize *offset)
+{
+	xmlNodePtr segment = self->stream_gap_segment;
+	xmlNodePtr extensions = NULL;
+	xmlNodePtr node = NULL;
+	gint level = 0;
+
+	if(!segment)
+	{
+		return;
+	}
+
+	extensions = gpx_storage_track_segment_get_extensions(segment);
+	node = self->stream_gap_last_child ?
+		self->stream_gap_last_child->next : segment->children;
+	if(node == extensions)
+	{
+		return;
+	}
+
+	/* Points can only be inserted into an open segment */
+	while(level < self->stream_depth &&
+			self->stream_path[level] != segment)
+	{
+		level++;
+	}
+	if(level == self->stream_depth)
+	{
+		self->stream_valid = FALSE;
+		return;
+	}
+
+	for(; node != extensions; node = node->next)
+	{
+		gpx_storage_stream_node(self, data, node, level + 1);
+	}
+
+	if(data->len <= self->stream_gap_length)
+	{
+		*offset = self->stream_gap_offset;
+		self->stream_gap_offset += data->len;
+		self->stream_gap_length -= data->len;
+		self->stream_gap_last_child = extensions->prev;
+		return;
+	}
+
+	/* The points do not fit, so the segment is written again from the
+	 * gap on */
+	g_string_truncate(data, 0);
+	self->stream_depth = level + 1;
+	self->stream_last_child = self->stream_gap_last_child;
+	self->stream_offset = self->stream_gap_offset;
+}
+
+static void gpx_storage_stream_tail(GpxStorage *self, GString *data)
+{
+	gint level = 0;
+
+	for(level = self->stream_depth - 1; level >= 0; level--)
+	{
+		gpx_storage_stream_end_tag(data, self->stream_path[level],
+				level);
+	}
+	g_string_append_c(data, '\n');
+}
+
+static void gpx_storage_stream_gap(
+		GpxStorage *self,
+		GString *data,
+		xmlNodePtr segment)
+{
+	gsize size = GPX_STORAGE_STREAM_GAP_SIZE;
+
+	/* The gap of the same segment filled up */
+	if(self->stream_gap_segment == segment)
+	{
+		size = self->stream_gap_size * 2;
+	}
+
+	self->stream_gap_segment = segment;
+	self->stream_gap_last_child = segment->last->prev;
+	self->stream_gap_offset = self->stream_data_offset + data->len;
+	self->stream_gap_length = size;
+	self->stream_gap_size = size;
+	g_string_append_printf(data, "%*s", (gint)size, "");
+}
+
+static void gpx_storage_stream_open(
+		GpxStorage *self,
+		GString *data,
+		xmlNodePtr node,
+		gint level)
+{
+	gpx_storage_stream_start_tag(data, node, level);
+	node->_private = self;
+
+	self->stream_path[self->stream_depth++] = node;
+	gpx_storage_stream_children(self, data, node, node->children,
+			level + 1);
+}
+
+static void gpx_storage_stream_children(
+		GpxStorage *self,
+		GString *data,
+		xmlNodePtr parent,
+		xmlNodePtr first,
+		gint level)
+{
+	xmlNodePtr node = NULL;
+
+	for(node = first; node; node = node->next)
+	{
+		/* Only the last child of an open element may stay open */
+		if(parent && !node->next &&
+				self->stream_depth <
+				GPX_STORAGE_STREAM_MAX_DEPTH &&
+				gpx_storage_stream_is_open_element(node))
 		{
-			if(strcmp(temp->name, "trkseg") == 0)
+			if(gpx_storage_stream_is_gap_node(parent, node))
 			{
-				found = temp;	
+				gpx_storage_stream_gap(self, data, parent);
 			}
+			gpx_storage_stream_open(self, data, node, level);
+			return;
 		}
+		gpx_storage_stream_node(self, data, node, level);
 	}
 
-	if(!found)
+	if(parent)
 	{
-		g_warning("No route segments");
+		self->stream_last_child = parent->last;
 	}
+}
 
-	DEBUG_END();
-	return found;
+static void gpx_storage_stream_node(
+		GpxStorage *self,
+		GString *data,
+		xmlNodePtr node,
+		gint level)
+{
+	xmlBufferPtr buffer = NULL;
+
+	buffer = xmlBufferCreate();
+	if(!buffer)
+	{
+		g_warning("Unable to create XML buffer");
+		return;
+	}
+
+	g_string_append_c(data, '\n');
+	g_string_append_printf(data, "%*s", level * 2, "");
+	xmlNodeDump(buffer, self->xml_document, node, level, 1);
+	g_string_append_len(data, (const gchar *)xmlBufferContent(buffer),
+			xmlBufferLength(buffer));
+	xmlBufferFree(buffer);
+
+	node->_private = self;
+}
+
+static gboolean gpx_storage_stream_is_open_element(xmlNodePtr node)
+{
+	if(node->type != XML_ELEMENT_NODE)
+	{
+		return FALSE;
+	}
+
+	if(node->parent &&
+			gpx_storage_stream_is_gap_node(node->parent, node))
+	{
+		return TRUE;
+	}
+
+	return strcmp(node->name, EC_GPX_NODE_TRACK) == 0 ||
+		strcmp(node->name, EC_GPX_NODE_TRACK_SEGMENT) == 0 ||
+		strcmp(node->name, EC_GPX_NODE_ROUTE) == 0 ||
+		strcmp(node->name, EC_GPX_EXT_NODE_HEART_RATE_LIST) == 0;
+}
+
+static gboolean gpx_storage_stream_is_gap_node(
+		xmlNodePtr parent,
+		xmlNodePtr node)
+{
+	if(parent->type != XML_ELEMENT_NODE ||
+			strcmp(parent->name, EC_GPX_NODE_TRACK_SEGMENT) != 0)
+	{
+		return FALSE;
+	}
+
+	return node == gpx_storage_track_segment_get_extensions(parent);
+}
+
+static void gpx_storage_stream_start_tag(
+		GString *data,
+		xmlNodePtr node,
+		gint level)
+{
+	xmlNsPtr ns = NULL;
+	xmlAttrPtr attr = NULL;
+	xmlChar *value = NULL;
+	xmlChar *escaped = NULL;
+
+	g_string_append_c(data, '\n');
+	g_string_append_printf(data, "%*s<", level * 2, "");
+	gpx_storage_stream_name(data, node);
+
+	for(ns = node->nsDef; ns; ns = ns->next)
+	{
+		g_string_append(data, " xmlns");
+		if(ns->prefix)
+		{
+			g_string_append_c(data, ':');
+			g_string_append(data, (const gchar *)ns->prefix);
+		}
+		escaped = xmlEncodeSpecialChars(node->doc, ns->href);
+		g_string_append_printf(data, "=\"%s\"", escaped);
+		xmlFree(escaped);
+	}
+
+	for(attr = node->properties; attr; attr = attr->next)
+	{
+		g_string_append_c(data, ' ');
+		gpx_storage_stream_name(data, (xmlNodePtr)attr);
+		value = xmlNodeGetContent((xmlNodePtr)attr);
+		escaped = xmlEncodeSpecialChars(node->doc, value);
+		g_string_append_printf(data, "=\"%s\"", escaped);
+		xmlFree(escaped);
+		xmlFree(value);
+	}
+
+	g_string_append_c(data, '>');
+}
+
+static void gpx_storage_stream_end_tag(
+		GString *data,
+		xmlNodePtr node,
+		gint level)
+{
+	g_string_append_c(data, '\n');
+	g_string_append_printf(data, "%*s</", level * 2, "");
+	gpx_storage_stream_name(data, node);
+	g_string_append_c(data, '>');
+}
+
+static void gpx_storage_stream_name(GString *data, xmlNodePtr node)
+{
+	if(node->ns && node->ns->prefix)
+	{
+		g_string_append(data, (const gchar *)node->ns->prefix);
+		g_string_append_c(data, ':');
+	}
+	g_string_append(data, (const gchar *)node->name);
+}
+
+static gboolean gpx_storage_write_data(
+		gint fd,
+		const gchar *data,
+		gsize length)
+{
+	gssize written = 0;
+
+	while(length > 0)
+	{
+		written = write(fd, data, length);
+		if(written < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			return FALSE;
+		}
+		data += written;
+		length -= written;
+	}
+
+	return TRUE;
 }
@@ -36,8 +36,51 @@
 /* LibXML2 */
 #include <libxml/tree.h>
 
+/* Other modules */
+#include "hrv.h"
+
+/**
+ * @brief Maximum depth of the elements that are left open at the end of
+ * the file: gpx, trk, trkseg, extensions, hbtlist
+ */
+#define GPX_STORAGE_STREAM_MAX_DEPTH	8
+
+/**
+ * @brief Default number of decimals of latitudes and longitudes, which is
+ * about a centimeter
+ */
+#define GPX_STORAGE_COORDINATE_DECIMALS	7
+
+/** @brief Default number of decimals of elevations (in meters) */
+#define GPX_STORAGE_ELEVATION_DECIMALS	2
+
 typedef struct _GpxStorage GpxStorage;
 
+/**
+ * @brief A track or a route in the index of #GpxStorage
+ */
+typedef struct _GpxStorageRouteTrack {
+	/** @brief The trk or rte element */
+	xmlNodePtr node;
+
+	/** @brief The last trkseg element of a track, or NULL if none */
+	xmlNodePtr last_segment;
+} GpxStorageRouteTrack;
+
+/**
+ * @brief Allocates the IDs of tracks or routes, starting from 1
+ */
+typedef struct _GpxStorageIdAllocator {
+	/**
+	 * @brief Bitmap of the IDs that are in use: ID n is bit n % 32 of
+	 * word n / 32
+	 */
+	GArray *words;
+
+	/** @brief All the IDs below this one are in use */
+	guint first_free;
+} GpxStorageIdAllocator;
+
 typedef enum _GpxStoragePointType {
 	/**
 	 * @brief Start a track. Implies a track segment start
@@ -81,6 +124,12 @@ typedef struct _GpxStorageWaypoint {
 	 * @brief Timestamp of the waypoint.
 	 */
 	struct timeval timestamp;
+
+	/**
+	 * @brief Cadence in steps per minute, or -1 if not known. Only
+	 * stored for track points.
+	 */
+	gint cadence;
 } GpxStorageWaypoint;
 
 struct _GpxStorage {
@@ -102,11 +151,75 @@ struct _GpxStorage {
 	/** @brief The name of current file, or NULL if not any */
 	gchar *file_path;
 
-	/** @brief List of track IDs that are in use */
-	GSList *track_ids;
+	/** @brief Track IDs that are in use */
+	GpxStorageIdAllocator track_ids;
+
+	/** @brief Route IDs that are in use */
+	GpxStorageIdAllocator route_ids;
+
+	/** @brief Tracks by ID (#GpxStorageRouteTrack) */
+	GHashTable *tracks;
+
+	/** @brief Routes by ID (#GpxStorageRouteTrack) */
+	GHashTable *routes;
+
+	/** @brief Number of decimals of latitudes and longitudes */
+	guint coordinate_decimals;
 
-	/** @brief List of route IDs that are in use */
-	GSList *route_ids;
+	/** @brief Number of decimals of elevations */
+	guint elevation_decimals;
+
+	/**
+	 * @brief Whether the file can be appended to. If not, the whole
+	 * document is written by the next gpx_storage_write().
+	 */
+	gboolean stream_valid;
+
+	/**
+	 * @brief Elements whose start tags have been written, but whose end
+	 * tags are only in the tail of the file. The root is the first.
+	 */
+	xmlNodePtr stream_path[GPX_STORAGE_STREAM_MAX_DEPTH];
+	gint stream_depth;
+
+	/**
+	 * @brief Last child of the innermost open element that has been
+	 * written, or NULL if none has
+	 */
+	xmlNodePtr stream_last_child;
+
+	/**
+	 * @brief Offset of the tail in the file. The tail is the end tags of
+	 * the open elements.
+	 */
+	gsize stream_offset;
+
+	/**
+	 * @brief Offset in the file of the data that is being serialized
+	 */
+	gsize stream_data_offset;
+
+	/**
+	 * @brief Track segment that has a gap of white space before its
+	 * extensions node, or NULL if none. The track points that are
+	 * inserted before the extensions node are written in the gap.
+	 */
+	xmlNodePtr stream_gap_segment;
+
+	/**
+	 * @brief Last child of the track segment that has been written before
+	 * or in the gap, or NULL if none has
+	 */
+	xmlNodePtr stream_gap_last_child;
+
+	/** @brief Offset of the free space of the gap in the file */
+	gsize stream_gap_offset;
+
+	/** @brief Length of the free space of the gap */
+	gsize stream_gap_length;
+
+	/** @brief Length of the whole gap */
+	gsize stream_gap_size;
 };
 
 /*****************************************************************************
@@ -166,6 +279,24 @@ void gpx_storage_add_heart_rate(
 		struct timeval *time,
 		gint heart_rate);
 
+/**
+ * @brief Adds heart rate variability metrics to the given track. They are
+ * stored in a heart rate node, with the mean heart rate of the window as
+ * the value. Nothing is stored if the window has no intervals yet.
+ *
+ * @param self pointer to #GpxStorage
+ * @param point_type See gpx_storage_add_heart_rate()
+ * @param track_id See gpx_storage_add_heart_rate()
+ * @param time Time of the latest beat in the window
+ * @param metrics The metrics to be added
+ */
+void gpx_storage_add_heart_rate_variability(
+		GpxStorage *self,
+		GpxStoragePointType point_type,
+		guint *track_id,
+		struct timeval *time,
+		const HrvMetrics *metrics);
+
 /**
  * @brief Setup some details to a route or a track
  *
@@ -191,12 +322,40 @@ void gpx_storage_set_path(
 		GpxStorage *self,
 		const gchar *path);
 
+/**
+ * @brief Set the number of decimals of the points that are added from now
+ * on. The defaults are GPX_STORAGE_COORDINATE_DECIMALS and
+ * GPX_STORAGE_ELEVATION_DECIMALS.
+ *
+ * @param self Pointer to #GpxStorage
+ * @param coordinate_decimals Decimals of latitudes and longitudes, at most
+ * UTIL_FORMAT_FIXED_MAX_DECIMALS
+ * @param elevation_decimals Decimals of elevations, at most
+ * UTIL_FORMAT_FIXED_MAX_DECIMALS
+ */
+void gpx_storage_set_decimals(
+		GpxStorage *self,
+		guint coordinate_decimals,
+		guint elevation_decimals);
+
 /**
  * @brief Write data to a file.
  *
  * The file name is determined by using the function gpx_storage_set_path()
  * function. If the file exists, it will be overwritten.
  *
+ * Points and heart rates are only ever added to the end of the document,
+ * so the file is written as a stream: the elements that can still grow
+ * are left open, and their end tags form a tail at the end of the file.
+ * The next write replaces the tail with the nodes that were added since,
+ * followed by a new tail, so that the file is always a complete document
+ * and autosaving costs as much as the new data. Track points go before the
+ * heart rates of their segment, so they are written in a gap of white
+ * space that is left before the heart rates. If the gap fills up, the
+ * segment is written again from the gap on, with a gap twice as large.
+ * The whole document is written only the first time, and after changes to
+ * nodes that were already written (such as the name of a track).
+ *
  * @param self Pointer to #GpxStorage
  * @param error Storage location for possible error
  *
@@ -101,9 +101,9 @@
 #define EC_GPX_EXT_NODE_HEART_RATE		"hbt"
 #define EC_GPX_EXT_ATTR_HEART_RATE_TIME	"time"
 #define EC_GPX_EXT_ATTR_HEART_RATE_VALUE	"value"
-
-/* XPath definitions */
-#define EC_GPX_XPATH_TRACK_NUMBER	"//gpx/trk/number"
-#define EC_GPX_XPATH_ROUTE_NUMBER	"//gpx/rte/number"
+#define EC_GPX_EXT_ATTR_HEART_RATE_SDNN	"sdnn"
+#define EC_GPX_EXT_ATTR_HEART_RATE_RMSSD	"rmssd"
+#define EC_GPX_EXT_ATTR_HEART_RATE_PNN50	"pnn50"
+#define EC_GPX_EXT_NODE_CADENCE		"cadence"
 
 #endif /* _GPX_DEFS_H */
@@ -29,6 +29,7 @@
 
 /* System */
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
 /* LibXML2 */
@@ -58,6 +59,8 @@ typedef enum _GpxParserState {
 	GPX_PARSER_STATE_IN_TRACK_WAYPOINT,
 	GPX_PARSER_STATE_IN_TRACK_WAYPOINT_ALTITUDE,
 	GPX_PARSER_STATE_IN_TRACK_WAYPOINT_TIME,
+	GPX_PARSER_STATE_IN_TRACK_WAYPOINT_EXTENSIONS,
+	GPX_PARSER_STATE_IN_TRACK_WAYPOINT_CADENCE,
 	GPX_PARSER_STATE_IN_ROUTE_WAYPOINT,
 	GPX_PARSER_STATE_IN_HEART_RATE_LIST,
 	GPX_PARSER_STATE_IN_HEART_RATE,
@@ -431,6 +434,20 @@ static void gpx_parser_sax_start_element_ns(
 			self->state = GPX_PARSER_STATE_IN_TRACK_WAYPOINT_ALTITUDE;
 		} else if(strcmp(name, EC_GPX_NODE_WAYPOINT_TIME) == 0) {
 			self->state = GPX_PARSER_STATE_IN_TRACK_WAYPOINT_TIME;
+		} else if(strcmp(name, EC_GPX_NODE_EXTENSIONS) == 0) {
+			self->state =
+				GPX_PARSER_STATE_IN_TRACK_WAYPOINT_EXTENSIONS;
+		} else {
+			gpx_parser_unknown_node(self);
+		}
+	} else if(self->state ==
+			GPX_PARSER_STATE_IN_TRACK_WAYPOINT_EXTENSIONS) {
+		if(strcmp(name, EC_GPX_EXT_NODE_CADENCE) == 0 &&
+				strcmp(URI, EC_GPX_EXTENSIONS_NAMESPACE) == 0)
+		{
+			self->state =
+				GPX_PARSER_STATE_IN_TRACK_WAYPOINT_CADENCE;
+			g_string_truncate(self->buffer, 0);
 		} else {
 			gpx_parser_unknown_node(self);
 		}
@@ -557,6 +574,18 @@ static void gpx_parser_sax_end_element_ns(
 				&self->data.waypoint->timestamp);
 		g_free(tmp_buffer);
 
+	} else if(self->state ==
+			GPX_PARSER_STATE_IN_TRACK_WAYPOINT_EXTENSIONS) {
+		self->state = GPX_PARSER_STATE_IN_TRACK_WAYPOINT;
+
+	} else if(self->state ==
+			GPX_PARSER_STATE_IN_TRACK_WAYPOINT_CADENCE) {
+		self->state = GPX_PARSER_STATE_IN_TRACK_WAYPOINT_EXTENSIONS;
+		tmp_buffer = g_string_free(self->buffer, FALSE);
+		self->buffer = g_string_new("");
+		self->data.waypoint->cadence = strtol(tmp_buffer, NULL, 10);
+		g_free(tmp_buffer);
+
 	} else if(self->state == GPX_PARSER_STATE_IN_HEART_RATE_LIST ) {
 		self->state = GPX_PARSER_STATE_IN_TRACK_SEGMENT_EXTENSIONS;
 
@@ -641,6 +670,7 @@ static void gpx_parser_parse_track_point(
 	DEBUG_BEGIN();
 
 	self->data.waypoint = g_new0(GpxParserDataWaypoint, 1);
+	self->data.waypoint->cadence = -1;
 
 	for(i = 0; i < nb_attributes; i++)
 	{
@@ -693,6 +723,9 @@ static void gpx_parser_parse_heart_rate(
 	DEBUG_BEGIN();
 
 	self->data.heart_rate = g_new0(GpxParserDataHeartRate, 1);
+	self->data.heart_rate->sdnn = -1;
+	self->data.heart_rate->rmssd = -1;
+	self->data.heart_rate->pnn50 = -1;
 
 	for(i = 0; i < nb_attributes; i++)
 	{
@@ -717,6 +750,30 @@ static void gpx_parser_parse_heart_rate(
 						value);
 			}
 			g_free(value);
+		} else if(strcmp(attr->name,
+				EC_GPX_EXT_ATTR_HEART_RATE_SDNN) == 0)
+		{
+			value = g_strndup(attr->value_start,
+					attr->value_end - attr->value_start);
+			self->data.heart_rate->sdnn =
+				g_ascii_strtod(value, NULL);
+			g_free(value);
+		} else if(strcmp(attr->name,
+				EC_GPX_EXT_ATTR_HEART_RATE_RMSSD) == 0)
+		{
+			value = g_strndup(attr->value_start,
+					attr->value_end - attr->value_start);
+			self->data.heart_rate->rmssd =
+				g_ascii_strtod(value, NULL);
+			g_free(value);
+		} else if(strcmp(attr->name,
+				EC_GPX_EXT_ATTR_HEART_RATE_PNN50) == 0)
+		{
+			value = g_strndup(attr->value_start,
+					attr->value_end - attr->value_start);
+			self->data.heart_rate->pnn50 =
+				g_ascii_strtod(value, NULL);
+			g_free(value);
 		}
 	}
 
@@ -119,6 +119,11 @@ struct _GpxParserDataTrackSegment {
 struct _GpxParserDataHeartRate {
 	struct timeval timestamp;
 	gint value;
+
+	/* Heart rate variability, or -1 if not stored */
+	gdouble sdnn;
+	gdouble rmssd;
+	gdouble pnn50;
 };
 
 /*****************************************************************************
@@ -0,0 +1,224 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*
+ * Benchmark for adding data to a GpxStorage.
+ *
+ * A number of tracks is created, and track points, each followed by a heart
+ * rate, are added to the last of them, with a new track segment every
+ * GPX_STORAGE_BENCH_SEGMENT_LENGTH points, as when recording a long
+ * exercise. The points are added in slices, and the rate of each slice is
+ * printed, so that it can be seen whether adding gets slower as the
+ * document grows. Finally, the document is written to a file once.
+ *
+ * Usage: gpx_storage_bench [points] [tracks] [directory]
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* System */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "gpx.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define GPX_STORAGE_BENCH_DEFAULT_POINTS	100000
+#define GPX_STORAGE_BENCH_DEFAULT_TRACKS	10
+
+/** @brief Number of points in a track segment */
+#define GPX_STORAGE_BENCH_SEGMENT_LENGTH	3600
+
+/** @brief Number of slices of which the rate is printed */
+#define GPX_STORAGE_BENCH_SLICES		10
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Add a track point and a heart rate to a track
+ *
+ * @param storage Pointer to #GpxStorage
+ * @param track_id ID of the track
+ * @param point_type Type of the track point
+ * @param index Index of the point in the track
+ */
+static void gpx_storage_bench_add(
+		GpxStorage *storage,
+		guint *track_id,
+		GpxStoragePointType point_type,
+		guint index);
+
+/**
+ * @brief Get the time between two time values
+ *
+ * @param start The earlier time
+ * @param end The later time
+ *
+ * @return The time in seconds
+ */
+static gdouble gpx_storage_bench_elapsed(
+		const struct timeval *start,
+		const struct timeval *end);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+int main(int argc, char **argv)
+{
+	GpxStorage *storage = NULL;
+	GError *error = NULL;
+	gchar *path = NULL;
+	const gchar *directory = NULL;
+	struct timeval start;
+	struct timeval slice_start;
+	struct timeval end;
+	guint point_count = GPX_STORAGE_BENCH_DEFAULT_POINTS;
+	guint track_count = GPX_STORAGE_BENCH_DEFAULT_TRACKS;
+	guint slice_length = 0;
+	guint track_id = 0;
+	guint i = 0;
+	gdouble elapsed = 0;
+
+	if(argc > 1)
+	{
+		point_count = MAX(atoi(argv[1]), 1);
+	}
+	if(argc > 2)
+	{
+		track_count = MAX(atoi(argv[2]), 1);
+	}
+	directory = argc > 3 ? argv[3] : g_get_tmp_dir();
+
+	storage = gpx_storage_new();
+
+	/* The points go to the last track, so that a lookup that walks
+	 * through the tracks would have to pass all the others */
+	for(i = 0; i < track_count; i++)
+	{
+		gpx_storage_bench_add(storage, &track_id,
+				GPX_STORAGE_POINT_TYPE_TRACK_START, 0);
+	}
+
+	slice_length = MAX(point_count / GPX_STORAGE_BENCH_SLICES, 1);
+
+	gettimeofday(&start, NULL);
+	slice_start = start;
+	for(i = 1; i <= point_count; i++)
+	{
+		gpx_storage_bench_add(storage, &track_id,
+				i % GPX_STORAGE_BENCH_SEGMENT_LENGTH == 0 ?
+				GPX_STORAGE_POINT_TYPE_TRACK_SEGMENT_START :
+				GPX_STORAGE_POINT_TYPE_TRACK,
+				i);
+
+		if(i % slice_length == 0 || i == point_count)
+		{
+			gettimeofday(&end, NULL);
+			elapsed = gpx_storage_bench_elapsed(&slice_start, &end);
+			g_print("points %6u-%6u: %8.0f points/s\n",
+					i - (i - 1) % slice_length, i,
+					((i - 1) % slice_length + 1) /
+					MAX(elapsed, 1e-6));
+			slice_start = end;
+		}
+	}
+
+	elapsed = gpx_storage_bench_elapsed(&start, &end);
+	g_print("add: %u points with heart rates to track %u of %u: "
+			"%.3f s, %.2f us per point\n",
+			point_count, track_id, track_count, elapsed,
+			elapsed * 1e6 / point_count);
+
+	path = g_build_filename(directory, "gpx_storage_bench.gpx", NULL);
+	gpx_storage_set_path(storage, path);
+
+	gettimeofday(&start, NULL);
+	if(!gpx_storage_write(storage, &error))
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		gpx_storage_free(storage);
+		g_free(path);
+		return 1;
+	}
+	gettimeofday(&end, NULL);
+	g_print("write: %.3f s\n", gpx_storage_bench_elapsed(&start, &end));
+
+	unlink(path);
+	g_free(path);
+	gpx_storage_free(storage);
+
+	return 0;
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static void gpx_storage_bench_add(
+		GpxStorage *storage,
+		guint *track_id,
+		GpxStoragePointType point_type,
+		guint index)
+{
+	GpxStorageWaypoint waypoint;
+
+	memset(&waypoint, 0, sizeof(waypoint));
+	waypoint.point_type = point_type;
+	waypoint.route_track_id = *track_id;
+	waypoint.latitude = 60.0 + index * 1e-5;
+	waypoint.longitude = 25.0 - index * 1e-5;
+	waypoint.altitude = index % 100;
+	waypoint.altitude_is_set = TRUE;
+	waypoint.cadence = -1;
+	waypoint.timestamp.tv_sec = 1200000000 + index;
+
+	gpx_storage_add_waypoint(storage, &waypoint);
+	*track_id = waypoint.route_track_id;
+
+	gpx_storage_add_heart_rate(storage, GPX_STORAGE_POINT_TYPE_TRACK,
+			track_id, &waypoint.timestamp, 120 + index % 60);
+}
+
+static gdouble gpx_storage_bench_elapsed(
+		const struct timeval *start,
+		const struct timeval *end)
+{
+	return (end->tv_sec - start->tv_sec) +
+		(end->tv_usec - start->tv_usec) / 1e6;
+}
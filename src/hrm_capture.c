@@ -0,0 +1,406 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "hrm_capture.h"
+
+/* System */
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Other modules */
+#include "ec_error.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+/** @brief Length of the record header: delay (32 bits), length (16 bits) */
+#define HRM_CAPTURE_RECORD_HEADER_LENGTH	6
+
+/** @brief Initial size of the file. It is doubled whenever it gets full. */
+#define HRM_CAPTURE_INITIAL_SIZE		(256 * 1024)
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Grow the file and the mapping so that at least the given amount
+ * of bytes fits in
+ *
+ * @param self Pointer to #HrmCaptureWriter
+ * @param required Required size of the file
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean hrm_capture_writer_grow(
+		HrmCaptureWriter *self,
+		gsize required);
+
+static gint64 hrm_capture_timeval_to_usec(const struct timeval *time);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+HrmCaptureWriter *hrm_capture_writer_new(
+		const gchar *path,
+		const gchar *device_name,
+		GError **error)
+{
+	HrmCaptureWriter *self = NULL;
+	HrmCaptureHeader header;
+	struct timeval now;
+
+	g_return_val_if_fail(path != NULL, NULL);
+	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+	DEBUG_BEGIN();
+
+	self = g_new0(HrmCaptureWriter, 1);
+	self->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(self->fd == -1)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to create capture file %s: %s",
+				path, strerror(errno));
+		g_free(self);
+		DEBUG_END();
+		return NULL;
+	}
+
+	if(!hrm_capture_writer_grow(self, HRM_CAPTURE_INITIAL_SIZE))
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to map capture file %s: %s",
+				path, strerror(errno));
+		close(self->fd);
+		g_free(self);
+		DEBUG_END();
+		return NULL;
+	}
+
+	gettimeofday(&now, NULL);
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, HRM_CAPTURE_MAGIC, sizeof(header.magic));
+	header.version = HRM_CAPTURE_VERSION;
+	header.header_length = sizeof(header);
+	header.start_time = hrm_capture_timeval_to_usec(&now);
+	if(device_name)
+	{
+		g_strlcpy(header.device_name, device_name,
+				sizeof(header.device_name));
+	}
+
+	memcpy(self->map, &header, sizeof(header));
+	self->length = sizeof(header);
+	self->previous_time = header.start_time;
+
+	DEBUG_END();
+	return self;
+}
+
+gboolean hrm_capture_writer_append(
+		HrmCaptureWriter *self,
+		const guint8 *data,
+		guint length,
+		const struct timeval *time)
+{
+	gint64 now = 0;
+	guint32 delay = 0;
+	guint16 length_16 = 0;
+	guint8 *record = NULL;
+
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(data != NULL, FALSE);
+	g_return_val_if_fail(length > 0 && length <= G_MAXUINT16, FALSE);
+	g_return_val_if_fail(time != NULL, FALSE);
+
+	if(!self->map)
+	{
+		/* Growing the file has failed already */
+		return FALSE;
+	}
+
+	if(self->length + HRM_CAPTURE_RECORD_HEADER_LENGTH + length >
+			self->map_size)
+	{
+		if(!hrm_capture_writer_grow(self, self->length +
+					HRM_CAPTURE_RECORD_HEADER_LENGTH +
+					length))
+		{
+			g_warning("Unable to grow capture file: %s",
+					strerror(errno));
+			return FALSE;
+		}
+	}
+
+	/* The clock may have been changed. Never store a negative delay,
+	 * and clamp long pauses. */
+	now = hrm_capture_timeval_to_usec(time);
+	if(now > self->previous_time)
+	{
+		delay = (guint32)MIN(now - self->previous_time, G_MAXUINT32);
+	}
+	self->previous_time = now;
+	length_16 = (guint16)length;
+
+	record = self->map + self->length;
+	memcpy(record, &delay, sizeof(delay));
+	memcpy(record + sizeof(delay), &length_16, sizeof(length_16));
+	memcpy(record + HRM_CAPTURE_RECORD_HEADER_LENGTH, data, length);
+	self->length += HRM_CAPTURE_RECORD_HEADER_LENGTH + length;
+
+	return TRUE;
+}
+
+void hrm_capture_writer_close(HrmCaptureWriter *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(self->map)
+	{
+		munmap(self->map, self->map_size);
+	}
+
+	/* Cut off the unused part of the last growth step */
+	if(ftruncate(self->fd, self->length) == -1)
+	{
+		g_warning("Unable to truncate capture file: %s",
+				strerror(errno));
+	}
+	close(self->fd);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+HrmCaptureReader *hrm_capture_reader_new(const gchar *path, GError **error)
+{
+	HrmCaptureReader *self = NULL;
+	const HrmCaptureHeader *header = NULL;
+	struct stat file_stat;
+	void *map = NULL;
+
+	g_return_val_if_fail(path != NULL, NULL);
+	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+	DEBUG_BEGIN();
+
+	self = g_new0(HrmCaptureReader, 1);
+	self->fd = open(path, O_RDONLY);
+	if(self->fd == -1 || fstat(self->fd, &file_stat) == -1)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to open capture file %s: %s",
+				path, strerror(errno));
+		goto error;
+	}
+
+	if(file_stat.st_size < (off_t)sizeof(HrmCaptureHeader))
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"%s is not a capture file", path);
+		goto error;
+	}
+
+	self->map_size = file_stat.st_size;
+	map = mmap(NULL, self->map_size, PROT_READ, MAP_PRIVATE, self->fd, 0);
+	if(map == MAP_FAILED)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to map capture file %s: %s",
+				path, strerror(errno));
+		goto error;
+	}
+	self->map = map;
+
+	/* The records are read in order */
+	madvise(map, self->map_size, MADV_SEQUENTIAL);
+
+	header = (const HrmCaptureHeader *)self->map;
+	if(memcmp(header->magic, HRM_CAPTURE_MAGIC, sizeof(header->magic))
+			!= 0 ||
+			header->version != HRM_CAPTURE_VERSION ||
+			header->header_length < sizeof(HrmCaptureHeader) ||
+			header->header_length > self->map_size)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"%s is not a supported capture file", path);
+		goto error;
+	}
+
+	hrm_capture_reader_rewind(self);
+
+	DEBUG_END();
+	return self;
+
+error:
+	if(self->map)
+	{
+		munmap((void *)self->map, self->map_size);
+	}
+	if(self->fd != -1)
+	{
+		close(self->fd);
+	}
+	g_free(self);
+	DEBUG_END();
+	return NULL;
+}
+
+const HrmCaptureHeader *hrm_capture_reader_get_header(
+		HrmCaptureReader *self)
+{
+	g_return_val_if_fail(self != NULL, NULL);
+	return (const HrmCaptureHeader *)self->map;
+}
+
+gboolean hrm_capture_reader_next(
+		HrmCaptureReader *self,
+		const guint8 **data,
+		guint *length,
+		guint32 *delay)
+{
+	guint16 length_16 = 0;
+	const guint8 *record = NULL;
+
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(data != NULL, FALSE);
+	g_return_val_if_fail(length != NULL, FALSE);
+	g_return_val_if_fail(delay != NULL, FALSE);
+
+	if(self->position + HRM_CAPTURE_RECORD_HEADER_LENGTH > self->map_size)
+	{
+		return FALSE;
+	}
+
+	record = self->map + self->position;
+	memcpy(delay, record, sizeof(*delay));
+	memcpy(&length_16, record + sizeof(*delay), sizeof(length_16));
+
+	/* Records are never empty. If the writer crashed, the rest of the
+	 * last growth step is zeros. */
+	if(length_16 == 0)
+	{
+		return FALSE;
+	}
+
+	if(self->position + HRM_CAPTURE_RECORD_HEADER_LENGTH + length_16 >
+			self->map_size)
+	{
+		/* The writer did not finish the last record */
+		return FALSE;
+	}
+
+	*data = record + HRM_CAPTURE_RECORD_HEADER_LENGTH;
+	*length = length_16;
+	self->position += HRM_CAPTURE_RECORD_HEADER_LENGTH + length_16;
+
+	return TRUE;
+}
+
+void hrm_capture_reader_rewind(HrmCaptureReader *self)
+{
+	g_return_if_fail(self != NULL);
+	self->position = hrm_capture_reader_get_header(self)->header_length;
+}
+
+void hrm_capture_reader_close(HrmCaptureReader *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	munmap((void *)self->map, self->map_size);
+	close(self->fd);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static gboolean hrm_capture_writer_grow(
+		HrmCaptureWriter *self,
+		gsize required)
+{
+	gsize size = MAX(self->map_size, HRM_CAPTURE_INITIAL_SIZE);
+	void *map = NULL;
+
+	DEBUG_BEGIN();
+
+	while(size < required)
+	{
+		size = size * 2;
+	}
+
+	/* Whatever happens below, the old mapping is gone, and nothing
+	 * can be written until a new one exists */
+	if(self->map)
+	{
+		munmap(self->map, self->map_size);
+		self->map = NULL;
+	}
+	self->map_size = 0;
+
+	if(ftruncate(self->fd, size) == -1)
+	{
+		DEBUG_END();
+		return FALSE;
+	}
+
+	map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+			self->fd, 0);
+	if(map == MAP_FAILED)
+	{
+		DEBUG_END();
+		return FALSE;
+	}
+
+	self->map = map;
+	self->map_size = size;
+
+	DEBUG_END();
+	return TRUE;
+}
+
+static gint64 hrm_capture_timeval_to_usec(const struct timeval *time)
+{
+	return (gint64)time->tv_sec * G_USEC_PER_SEC + time->tv_usec;
+}
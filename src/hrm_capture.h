@@ -0,0 +1,212 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _HRM_CAPTURE_H
+#define _HRM_CAPTURE_H
+
+/* Configuration */
+#include "config.h"
+
+/* System */
+#include <sys/time.h>
+
+/* GLib */
+#include <glib.h>
+
+/**
+ * @brief Identifies a capture file. Stored in the beginning of the file.
+ */
+#define HRM_CAPTURE_MAGIC			"ECHRMCAP"
+#define HRM_CAPTURE_VERSION			1
+
+/** @brief Maximum length of the device name in the header */
+#define HRM_CAPTURE_DEVICE_NAME_LENGTH		32
+
+/**
+ * @brief Header of a capture file.
+ *
+ * A capture file stores the raw bytes read from a heart rate monitor, so
+ * that they can be fed to the parsers again later. The header is followed
+ * by records, each of which is:
+ *
+ * - time since the previous record in microseconds (32 bits)
+ * - length of the data (16 bits)
+ * - the data
+ *
+ * The numbers are stored in the byte order of the machine that wrote the
+ * file, and they are not aligned.
+ */
+typedef struct _HrmCaptureHeader {
+	gchar magic[8];
+	guint32 version;
+	guint32 header_length;
+
+	/** @brief Time of the beginning of the capture, in microseconds */
+	gint64 start_time;
+
+	/**
+	 * @brief Bluetooth name of the device, so that the right protocol
+	 * can be selected for the replay. Zero terminated.
+	 */
+	gchar device_name[HRM_CAPTURE_DEVICE_NAME_LENGTH];
+} HrmCaptureHeader;
+
+/**
+ * @brief Writes a capture file.
+ *
+ * The file is memory mapped, and it is grown in large steps, so that
+ * appending a record is only a copy in the normal case. When the file is
+ * closed, it is truncated to the length of the data.
+ *
+ * Consider all the fields private.
+ */
+typedef struct _HrmCaptureWriter {
+	gint fd;
+
+	/**
+	 * @brief Mapping of the file, or NULL if growing the file failed
+	 * and nothing more can be written
+	 */
+	guint8 *map;
+	gsize map_size;
+
+	/**
+	 * @brief Amount of bytes written (including the header). The file
+	 * is cut to this length when it is closed.
+	 */
+	gsize length;
+
+	/** @brief Time of the previous record, in microseconds */
+	gint64 previous_time;
+} HrmCaptureWriter;
+
+/**
+ * @brief Reads a capture file.
+ *
+ * The whole file is memory mapped, and the records are returned straight
+ * from the mapping.
+ *
+ * Consider all the fields private.
+ */
+typedef struct _HrmCaptureReader {
+	gint fd;
+	const guint8 *map;
+	gsize map_size;
+
+	/** @brief Offset of the next record */
+	gsize position;
+} HrmCaptureReader;
+
+/**
+ * @brief Create a capture file. An existing file is overwritten.
+ *
+ * @param path Path of the file
+ * @param device_name Bluetooth name of the device, or NULL
+ * @param error Return location for possible error
+ *
+ * @return Newly allocated writer, or NULL in case of an error
+ */
+HrmCaptureWriter *hrm_capture_writer_new(
+		const gchar *path,
+		const gchar *device_name,
+		GError **error);
+
+/**
+ * @brief Append one record to a capture file
+ *
+ * @param self Pointer to #HrmCaptureWriter
+ * @param data Data that was read
+ * @param length Length of the data (1 to 65535 bytes)
+ * @param time Time when the data was read
+ *
+ * @return TRUE on success, FALSE if the file could not be grown. After a
+ * failure nothing more is written, but the records that were appended
+ * before it are kept.
+ */
+gboolean hrm_capture_writer_append(
+		HrmCaptureWriter *self,
+		const guint8 *data,
+		guint length,
+		const struct timeval *time);
+
+/**
+ * @brief Close a capture file and free the writer
+ *
+ * @param self Pointer to #HrmCaptureWriter
+ */
+void hrm_capture_writer_close(HrmCaptureWriter *self);
+
+/**
+ * @brief Open a capture file for reading
+ *
+ * @param path Path of the file
+ * @param error Return location for possible error
+ *
+ * @return Newly allocated reader, or NULL in case of an error
+ */
+HrmCaptureReader *hrm_capture_reader_new(const gchar *path, GError **error);
+
+/**
+ * @brief Get the header of the capture file
+ *
+ * @param self Pointer to #HrmCaptureReader
+ *
+ * @return The header
+ */
+const HrmCaptureHeader *hrm_capture_reader_get_header(
+		HrmCaptureReader *self);
+
+/**
+ * @brief Get the next record
+ *
+ * @param self Pointer to #HrmCaptureReader
+ * @param data Return location for the data. It points to the mapping, so
+ * it is valid until the reader is closed.
+ * @param length Return location for the length of the data
+ * @param delay Return location for the time since the previous record,
+ * in microseconds
+ *
+ * @return TRUE if a record was returned, FALSE at the end of the file (or
+ * if the rest of the file is truncated, or was never written because the
+ * writer was not closed)
+ */
+gboolean hrm_capture_reader_next(
+		HrmCaptureReader *self,
+		const guint8 **data,
+		guint *length,
+		guint32 *delay);
+
+/**
+ * @brief Start reading from the first record again
+ *
+ * @param self Pointer to #HrmCaptureReader
+ */
+void hrm_capture_reader_rewind(HrmCaptureReader *self);
+
+/**
+ * @brief Close a capture file and free the reader
+ *
+ * @param self Pointer to #HrmCaptureReader
+ */
+void hrm_capture_reader_close(HrmCaptureReader *self);
+
+#endif /* _HRM_CAPTURE_H */
@@ -0,0 +1,247 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "hrm_protocol.h"
+
+/* System */
+#include <string.h>
+
+/* Other modules */
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define FRWD_PACKET_SIZE			93
+#define FRWD_HEART_RATE_OFFSET			12
+#define FRWD_HEART_RATE_DIGITS			3
+#define FRWD_HEART_RATE_MIN			20
+#define FRWD_HEART_RATE_MAX			235
+
+/* Zephyr HxM: STX, message id, payload length, 55 bytes of payload,
+ * CRC, ETX */
+#define ZEPHYR_PACKET_SIZE			60
+#define ZEPHYR_HEART_RATE_OFFSET		12
+#define ZEPHYR_BEAT_NUMBER_OFFSET		13
+#define ZEPHYR_BEAT_TIMES_OFFSET		14
+#define ZEPHYR_ETX_OFFSET			59
+#define ZEPHYR_ETX				0x03
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Decode a FRWD packet
+ *
+ * The heart rate is three ASCII digits, each multiplied by two.
+ */
+static gboolean hrm_protocol_frwd_decode(
+		const guint8 *frame,
+		HrmProtocolPacket *packet);
+
+/**
+ * @brief Decode a Zephyr HxM packet
+ *
+ * After the heart rate, the packet has the number of the latest beat and
+ * the time stamps of the 15 latest beats (16-bit little-endian
+ * milliseconds, latest first), from which the R-R intervals are found.
+ */
+static gboolean hrm_protocol_zephyr_decode(
+		const guint8 *frame,
+		HrmProtocolPacket *packet);
+
+/*****************************************************************************
+ * Static variables                                                          *
+ *****************************************************************************/
+
+static const guint8 hrm_protocol_frwd_signature[] = { 'F', 'R', 'W', 'D' };
+static const guint8 hrm_protocol_zephyr_signature[] = { 0x02, 0x26, 0x37 };
+static const guint8 hrm_protocol_alive_signature[] = { 0x00, 0xFE };
+
+/**
+ * @brief The known protocols
+ *
+ * To support a new heart rate monitor, add an entry here.
+ */
+static const HrmProtocol hrm_protocols[] = {
+	{
+		"FRWD",
+		"FRWD",
+		hrm_protocol_frwd_signature,
+		sizeof(hrm_protocol_frwd_signature),
+		HRM_PROTOCOL_FRAMING_FIXED,
+		FRWD_PACKET_SIZE,
+		hrm_protocol_frwd_decode
+	},
+	{
+		"Zephyr HxM",
+		"HXM",
+		hrm_protocol_zephyr_signature,
+		sizeof(hrm_protocol_zephyr_signature),
+		HRM_PROTOCOL_FRAMING_FIXED,
+		ZEPHYR_PACKET_SIZE,
+		hrm_protocol_zephyr_decode
+	},
+	{
+		"Alive ECG",
+		"ALIVE",
+		hrm_protocol_alive_signature,
+		sizeof(hrm_protocol_alive_signature),
+		HRM_PROTOCOL_FRAMING_ECG_CHUNKS,
+		0,
+		NULL
+	}
+};
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+const HrmProtocol *hrm_protocol_find(const gchar *bluetooth_name)
+{
+	guint i = 0;
+	gchar *name = NULL;
+	const HrmProtocol *protocol = NULL;
+
+	DEBUG_BEGIN();
+
+	if(bluetooth_name)
+	{
+		/* The Bluetooth names in the table are in upper case */
+		name = g_ascii_strup(bluetooth_name, -1);
+		for(i = 0; i < G_N_ELEMENTS(hrm_protocols); i++)
+		{
+			if(strstr(name, hrm_protocols[i].bluetooth_name))
+			{
+				protocol = &hrm_protocols[i];
+				break;
+			}
+		}
+		g_free(name);
+	}
+
+	if(!protocol)
+	{
+		/* Parsing the data of some other device as if it were one
+		 * of ours would only give garbage */
+		g_warning("Unsupported heart rate monitor \"%s\"",
+				bluetooth_name ? bluetooth_name : "");
+		DEBUG_END();
+		return NULL;
+	}
+
+	DEBUG_LONG("%s HRM attached", protocol->name);
+
+	DEBUG_END();
+	return protocol;
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static gboolean hrm_protocol_frwd_decode(
+		const guint8 *frame,
+		HrmProtocolPacket *packet)
+{
+	const guint8 *digits = frame + FRWD_HEART_RATE_OFFSET;
+	gchar c = 0;
+	gint value = 0;
+	gint i = 0;
+	gboolean negative = FALSE;
+
+	/* Parse the same way as strtol() would parse the digits as a
+	 * string: the string ends at the first zero byte, and leading
+	 * white space and a sign are allowed */
+	for(i = 0; i < FRWD_HEART_RATE_DIGITS; i++)
+	{
+		c = ((gchar)digits[i]) / 2;
+		if(c != ' ' && (c < '\t' || c > '\r'))
+		{
+			break;
+		}
+	}
+	if(i < FRWD_HEART_RATE_DIGITS && (c == '-' || c == '+'))
+	{
+		negative = (c == '-');
+		i++;
+	}
+	for(; i < FRWD_HEART_RATE_DIGITS; i++)
+	{
+		c = ((gchar)digits[i]) / 2;
+		if(c < '0' || c > '9')
+		{
+			break;
+		}
+		value = value * 10 + (c - '0');
+	}
+	if(negative)
+	{
+		value = -value;
+	}
+
+	if(value < FRWD_HEART_RATE_MAX && value > FRWD_HEART_RATE_MIN)
+	{
+		packet->heart_rate = value;
+	} else {
+		packet->heart_rate = -1;
+	}
+	packet->beat_number = -1;
+	packet->beat_time_count = 0;
+
+	return TRUE;
+}
+
+static gboolean hrm_protocol_zephyr_decode(
+		const guint8 *frame,
+		HrmProtocolPacket *packet)
+{
+	const guint8 *times = NULL;
+	gint i = 0;
+
+	if(frame[ZEPHYR_ETX_OFFSET] != ZEPHYR_ETX)
+	{
+		return FALSE;
+	}
+
+	packet->heart_rate = frame[ZEPHYR_HEART_RATE_OFFSET];
+	packet->beat_number = frame[ZEPHYR_BEAT_NUMBER_OFFSET];
+	for(i = 0; i < HRM_PROTOCOL_MAX_BEAT_TIMES; i++)
+	{
+		times = frame + ZEPHYR_BEAT_TIMES_OFFSET + i * 2;
+		packet->beat_times[i] = times[0] | (times[1] << 8);
+	}
+	packet->beat_time_count = HRM_PROTOCOL_MAX_BEAT_TIMES;
+
+	return TRUE;
+}
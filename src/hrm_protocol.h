@@ -0,0 +1,126 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _HRM_PROTOCOL_H
+#define _HRM_PROTOCOL_H
+
+/* Configuration */
+#include "config.h"
+
+/* GLib */
+#include <glib.h>
+
+/** @brief Most beat time stamps a packet can have */
+#define HRM_PROTOCOL_MAX_BEAT_TIMES	15
+
+/**
+ * @brief Data decoded from one packet
+ */
+typedef struct _HrmProtocolPacket {
+	/** @brief Heart rate, or -1 if the packet had no valid heart rate */
+	gint heart_rate;
+
+	/**
+	 * @brief Number of the latest beat (counts up and wraps around at
+	 * 256), or -1 if the monitor does not send beat times
+	 */
+	gint beat_number;
+
+	/**
+	 * @brief Time stamps of the latest beats in milliseconds, latest
+	 * first. They wrap around at 65536.
+	 */
+	guint16 beat_times[HRM_PROTOCOL_MAX_BEAT_TIMES];
+
+	/** @brief Amount of time stamps in beat_times */
+	gint beat_time_count;
+} HrmProtocolPacket;
+
+/**
+ * @brief Decode one packet.
+ *
+ * The packet is decoded in place, and nothing is allocated.
+ *
+ * @param frame The packet. It starts with the signature of the protocol,
+ * and it is always frame_length bytes long.
+ * @param packet Storage for the decoded data
+ *
+ * @return TRUE if the packet was valid, FALSE if it was not (that is, the
+ * signature was only found by chance)
+ */
+typedef gboolean (*HrmProtocolDecodeFunc)(
+		const guint8 *frame,
+		HrmProtocolPacket *packet);
+
+/**
+ * @brief How the data stream of a protocol is split into packets
+ */
+typedef enum _HrmProtocolFraming {
+	/** @brief Fixed-length packets, decoded with the decode function */
+	HRM_PROTOCOL_FRAMING_FIXED,
+
+	/**
+	 * @brief Alive ECG data chunks. They have a variable length, and
+	 * they are parsed by #EcgData itself.
+	 */
+	HRM_PROTOCOL_FRAMING_ECG_CHUNKS
+} HrmProtocolFraming;
+
+/**
+ * @brief Description of a heart rate monitor protocol
+ */
+typedef struct _HrmProtocol {
+	/** @brief Name of the protocol, for debugging */
+	const gchar *name;
+
+	/**
+	 * @brief Substring of the Bluetooth name of the devices that use
+	 * this protocol
+	 */
+	const gchar *bluetooth_name;
+
+	/** @brief Bytes every packet starts with */
+	const guint8 *signature;
+	guint signature_length;
+
+	HrmProtocolFraming framing;
+
+	/** @brief Length of a packet (only for fixed-length packets) */
+	guint frame_length;
+
+	/** @brief Packet decoder (only for fixed-length packets) */
+	HrmProtocolDecodeFunc decode;
+} HrmProtocol;
+
+/**
+ * @brief Find the protocol of a heart rate monitor
+ *
+ * The names are compared case-insensitively.
+ *
+ * @param bluetooth_name Bluetooth name of the heart rate monitor
+ *
+ * @return The protocol whose Bluetooth name matches, or NULL if the heart
+ * rate monitor is not supported
+ */
+const HrmProtocol *hrm_protocol_find(const gchar *bluetooth_name);
+
+#endif /* _HRM_PROTOCOL_H */
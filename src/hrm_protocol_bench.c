@@ -0,0 +1,366 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*
+ * Benchmark for decoding the packets of the heart rate monitors that send
+ * fixed-length packets (FRWD and Zephyr HxM).
+ *
+ * A set of packets with different heart rates is decoded over and over,
+ * first the way EcgData used to decode them (for FRWD, g_strndup() and
+ * strtol() on the heart rate digits), and then with the decode function of
+ * the protocol in hrm_protocol.c. The rate of both is printed for each
+ * protocol. Both must give the same heart rates.
+ *
+ * The exit status is 0 if the heart rates are the same, 1 if not.
+ *
+ * Usage: hrm_protocol_bench [packets]
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* System */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "hrm_protocol.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define HRM_PROTOCOL_BENCH_DEFAULT_PACKETS	10000000
+
+/** @brief Number of different packets of each protocol */
+#define HRM_PROTOCOL_BENCH_FRAMES		256
+
+/* As in hrm_protocol.c */
+#define HRM_PROTOCOL_BENCH_HEART_RATE_OFFSET	12
+#define HRM_PROTOCOL_BENCH_FRWD_DIGITS		3
+#define HRM_PROTOCOL_BENCH_ZEPHYR_BEAT_NUMBER	13
+#define HRM_PROTOCOL_BENCH_ZEPHYR_BEAT_TIMES	14
+#define HRM_PROTOCOL_BENCH_ZEPHYR_ETX		0x03
+
+/*****************************************************************************
+ * Data structures                                                           *
+ *****************************************************************************/
+
+/**
+ * @brief Decodes the heart rate of a packet the way EcgData used to
+ *
+ * @param frame The packet
+ * @param heart_rate Heart rate of the previous packet
+ *
+ * @return The heart rate
+ */
+typedef gint (*HrmProtocolBenchOldDecodeFunc)(
+		const guint8 *frame,
+		gint heart_rate);
+
+/**
+ * @brief Builds a packet
+ *
+ * @param frame Buffer of frame_length bytes, starting with the signature
+ * @param length frame_length of the protocol
+ * @param index Index of the packet
+ */
+typedef void (*HrmProtocolBenchBuildFunc)(
+		guint8 *frame,
+		guint length,
+		guint index);
+
+typedef struct _HrmProtocolBenchCase {
+	/** @brief Bluetooth name that selects the protocol */
+	const gchar *device;
+	HrmProtocolBenchBuildFunc build;
+	HrmProtocolBenchOldDecodeFunc old_decode;
+} HrmProtocolBenchCase;
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+static void hrm_protocol_bench_build_frwd(
+		guint8 *frame,
+		guint length,
+		guint index);
+
+static gint hrm_protocol_bench_old_frwd(const guint8 *frame, gint heart_rate);
+
+static void hrm_protocol_bench_build_zephyr(
+		guint8 *frame,
+		guint length,
+		guint index);
+
+static gint hrm_protocol_bench_old_zephyr(
+		const guint8 *frame,
+		gint heart_rate);
+
+/**
+ * @brief Decode the packets of one protocol both ways, and print the
+ * rates
+ *
+ * @param bench_case The protocol
+ * @param packet_count Number of packets to decode
+ *
+ * @return TRUE if both ways gave the same heart rates, FALSE if not
+ */
+static gboolean hrm_protocol_bench_run(
+		const HrmProtocolBenchCase *bench_case,
+		guint packet_count);
+
+/*****************************************************************************
+ * Static variables                                                          *
+ *****************************************************************************/
+
+static const HrmProtocolBenchCase _hrm_protocol_bench_cases[] = {
+	{
+		"FRWD",
+		hrm_protocol_bench_build_frwd,
+		hrm_protocol_bench_old_frwd
+	},
+	{
+		"HXM",
+		hrm_protocol_bench_build_zephyr,
+		hrm_protocol_bench_old_zephyr
+	}
+};
+
+/** @brief Keeps the compiler from leaving the decoding out */
+static volatile gint _hrm_protocol_bench_sink = 0;
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+int main(int argc, char **argv)
+{
+	guint packet_count = HRM_PROTOCOL_BENCH_DEFAULT_PACKETS;
+	gboolean ok = TRUE;
+	guint i = 0;
+
+	if(argc > 1)
+	{
+		packet_count = MAX(atoi(argv[1]), 1);
+	}
+
+	g_print("%u packets per protocol\n", packet_count);
+	g_print("%-12s %14s %14s\n", "protocol", "old packets/s",
+			"new packets/s");
+
+	for(i = 0; i < G_N_ELEMENTS(_hrm_protocol_bench_cases); i++)
+	{
+		ok = hrm_protocol_bench_run(&_hrm_protocol_bench_cases[i],
+				packet_count) && ok;
+	}
+
+	if(!ok)
+	{
+		g_print("some heart rates were decoded differently\n");
+		return 1;
+	}
+	g_print("all heart rates were decoded the same\n");
+
+	return 0;
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static void hrm_protocol_bench_build_frwd(
+		guint8 *frame,
+		guint length,
+		guint index)
+{
+	gchar digits[HRM_PROTOCOL_BENCH_FRWD_DIGITS + 1];
+	guint i = 0;
+
+	for(i = 4; i < length; i++)
+	{
+		frame[i] = 2 * ('0' + (index + i) % 10);
+	}
+
+	/* Heart rates from 10 to 265, so that some are out of range */
+	g_snprintf(digits, sizeof(digits), "%03u", 10 + index % 256);
+	for(i = 0; i < HRM_PROTOCOL_BENCH_FRWD_DIGITS; i++)
+	{
+		frame[HRM_PROTOCOL_BENCH_HEART_RATE_OFFSET + i] = 2 * digits[i];
+	}
+}
+
+static gint hrm_protocol_bench_old_frwd(const guint8 *frame, gint heart_rate)
+{
+	gchar *decrypt = NULL;
+	gint value = 0;
+	gint i = 0;
+
+	decrypt = g_strndup((const gchar *)frame +
+			HRM_PROTOCOL_BENCH_HEART_RATE_OFFSET,
+			HRM_PROTOCOL_BENCH_FRWD_DIGITS);
+	for(i = 0; i < HRM_PROTOCOL_BENCH_FRWD_DIGITS; i++)
+	{
+		decrypt[i] /= 2;
+	}
+	value = strtol(decrypt, NULL, 10);
+	g_free(decrypt);
+
+	if(value < 235 && value > 20)
+	{
+		heart_rate = value;
+	}
+	return heart_rate;
+}
+
+static void hrm_protocol_bench_build_zephyr(
+		guint8 *frame,
+		guint length,
+		guint index)
+{
+	guint i = 0;
+
+	for(i = 3; i < length; i++)
+	{
+		frame[i] = (guint8)(index * 7 + i);
+	}
+
+	frame[HRM_PROTOCOL_BENCH_HEART_RATE_OFFSET] = 40 + index % 160;
+	frame[HRM_PROTOCOL_BENCH_ZEPHYR_BEAT_NUMBER] = index;
+	for(i = 0; i < HRM_PROTOCOL_MAX_BEAT_TIMES; i++)
+	{
+		frame[HRM_PROTOCOL_BENCH_ZEPHYR_BEAT_TIMES + 2 * i] =
+			(index * 800 - i * 800) & 0xFF;
+		frame[HRM_PROTOCOL_BENCH_ZEPHYR_BEAT_TIMES + 2 * i + 1] =
+			((index * 800 - i * 800) >> 8) & 0xFF;
+	}
+	frame[length - 1] = HRM_PROTOCOL_BENCH_ZEPHYR_ETX;
+}
+
+static gint hrm_protocol_bench_old_zephyr(
+		const guint8 *frame,
+		gint heart_rate)
+{
+	return frame[HRM_PROTOCOL_BENCH_HEART_RATE_OFFSET];
+}
+
+static gboolean hrm_protocol_bench_run(
+		const HrmProtocolBenchCase *bench_case,
+		guint packet_count)
+{
+	const HrmProtocol *protocol = NULL;
+	HrmProtocolPacket packet;
+	struct timeval start;
+	struct timeval end;
+	guint8 *frames = NULL;
+	guint8 *frame = NULL;
+	gdouble old_time = 0;
+	gdouble new_time = 0;
+	gint old_heart_rate = 0;
+	gint new_heart_rate = 0;
+	guint mismatches = 0;
+	guint i = 0;
+
+	protocol = hrm_protocol_find(bench_case->device);
+	if(!protocol || protocol->framing != HRM_PROTOCOL_FRAMING_FIXED)
+	{
+		g_print("%-12s no fixed-length protocol\n", bench_case->device);
+		return FALSE;
+	}
+
+	frames = g_malloc(HRM_PROTOCOL_BENCH_FRAMES * protocol->frame_length);
+	for(i = 0; i < HRM_PROTOCOL_BENCH_FRAMES; i++)
+	{
+		frame = frames + i * protocol->frame_length;
+		memcpy(frame, protocol->signature, protocol->signature_length);
+		bench_case->build(frame, protocol->frame_length, i);
+	}
+
+	gettimeofday(&start, NULL);
+	for(i = 0; i < packet_count; i++)
+	{
+		frame = frames + (i % HRM_PROTOCOL_BENCH_FRAMES) *
+			protocol->frame_length;
+		old_heart_rate = bench_case->old_decode(frame, old_heart_rate);
+		_hrm_protocol_bench_sink += old_heart_rate;
+	}
+	gettimeofday(&end, NULL);
+	old_time = (end.tv_sec - start.tv_sec) +
+		(end.tv_usec - start.tv_usec) / 1e6;
+
+	gettimeofday(&start, NULL);
+	for(i = 0; i < packet_count; i++)
+	{
+		frame = frames + (i % HRM_PROTOCOL_BENCH_FRAMES) *
+			protocol->frame_length;
+		if(protocol->decode(frame, &packet))
+		{
+			_hrm_protocol_bench_sink += packet.heart_rate;
+		}
+	}
+	gettimeofday(&end, NULL);
+	new_time = (end.tv_sec - start.tv_sec) +
+		(end.tv_usec - start.tv_usec) / 1e6;
+
+	/* EcgData keeps the previous heart rate if the new one is not
+	 * valid */
+	old_heart_rate = 0;
+	new_heart_rate = 0;
+	for(i = 0; i < HRM_PROTOCOL_BENCH_FRAMES; i++)
+	{
+		frame = frames + i * protocol->frame_length;
+		old_heart_rate = bench_case->old_decode(frame, old_heart_rate);
+		if(!protocol->decode(frame, &packet))
+		{
+			mismatches++;
+			continue;
+		}
+		if(packet.heart_rate >= 0)
+		{
+			new_heart_rate = packet.heart_rate;
+		}
+		if(old_heart_rate != new_heart_rate)
+		{
+			mismatches++;
+		}
+	}
+
+	g_print("%-12s %14.0f %14.0f\n", protocol->name,
+			packet_count / MAX(old_time, 1e-6),
+			packet_count / MAX(new_time, 1e-6));
+	if(mismatches > 0)
+	{
+		g_print("%-12s %u packets were decoded differently\n",
+				protocol->name, mismatches);
+	}
+
+	g_free(frames);
+
+	return mismatches == 0;
+}
@@ -0,0 +1,352 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "hrm_scanner.h"
+
+/* System */
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/* Other modules */
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+/** @brief Amount of bytes compared at a time */
+#define HRM_SCANNER_BLOCK_SIZE		16
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Check whether a signature starts at the given position
+ *
+ * @param self Pointer to #HrmScanner
+ * @param data The data
+ * @param length Length of the data
+ * @param position Position to check
+ * @param signature_index Return location for the index of the signature
+ *
+ * @return TRUE if a signature starts at the position
+ */
+static inline gboolean hrm_scanner_match_at(
+		HrmScanner *self,
+		const guint8 *data,
+		guint length,
+		guint position,
+		guint *signature_index);
+
+/**
+ * @brief Check the candidate positions of one block
+ *
+ * @param self Pointer to #HrmScanner
+ * @param data The data
+ * @param length Length of the data
+ * @param position Position of the block
+ * @param mask Candidate positions in the block (bit n set means that a
+ * first byte of a signature is at position + n)
+ * @param signature_index Return location for the index of the signature
+ *
+ * @return Offset of the found signature, or -1 if none was found
+ */
+static inline gint hrm_scanner_check_candidates(
+		HrmScanner *self,
+		const guint8 *data,
+		guint length,
+		guint position,
+		gulong mask,
+		guint *signature_index);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+void hrm_scanner_init(HrmScanner *self)
+{
+	g_return_if_fail(self != NULL);
+	memset(self, 0, sizeof(HrmScanner));
+}
+
+gboolean hrm_scanner_add_signature(
+		HrmScanner *self,
+		const guint8 *signature,
+		guint length)
+{
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(signature != NULL, FALSE);
+	g_return_val_if_fail(length > 0, FALSE);
+	DEBUG_BEGIN();
+
+	if(self->signature_count >= HRM_SCANNER_MAX_SIGNATURES)
+	{
+		g_critical("Too many signatures for the scanner");
+		DEBUG_END();
+		return FALSE;
+	}
+
+	self->signatures[self->signature_count] = signature;
+	self->lengths[self->signature_count] = length;
+	self->signature_count++;
+
+	if(self->min_length == 0 || length < self->min_length)
+	{
+		self->min_length = length;
+	}
+	if(length > self->max_length)
+	{
+		self->max_length = length;
+	}
+
+	hrm_scanner_reset(self);
+
+	DEBUG_END();
+	return TRUE;
+}
+
+gint hrm_scanner_find(
+		HrmScanner *self,
+		const guint8 *data,
+		guint length,
+		guint *signature_index)
+{
+	guint position = 0;
+	guint end = 0;
+	guint found_index = 0;
+	gint found = -1;
+#if defined(__SSE2__) || defined(__ARM_NEON__)
+	guint i = 0;
+	gulong mask = 0;
+#endif
+#if defined(__SSE2__)
+	__m128i first_bytes[HRM_SCANNER_MAX_SIGNATURES];
+	__m128i block;
+#elif defined(__ARM_NEON__)
+	uint8x16_t first_bytes[HRM_SCANNER_MAX_SIGNATURES];
+	uint8x16_t block;
+	uint8x16_t equal;
+	uint64x2_t equal_64;
+#endif
+
+	g_return_val_if_fail(self != NULL, -1);
+	g_return_val_if_fail(self->signature_count > 0, -1);
+	g_return_val_if_fail(data != NULL || length == 0, -1);
+
+	if(length < self->min_length)
+	{
+		self->offset = 0;
+		return -1;
+	}
+
+	/* Candidate start positions are [offset, end) */
+	position = MIN(self->offset, length);
+	end = length - self->min_length + 1;
+
+#if defined(__SSE2__)
+	for(i = 0; i < self->signature_count; i++)
+	{
+		first_bytes[i] = _mm_set1_epi8((char)self->signatures[i][0]);
+	}
+
+	for(; position + HRM_SCANNER_BLOCK_SIZE <= end;
+			position += HRM_SCANNER_BLOCK_SIZE)
+	{
+		block = _mm_loadu_si128((const __m128i *)(data + position));
+		mask = 0;
+		for(i = 0; i < self->signature_count; i++)
+		{
+			mask |= (gulong)_mm_movemask_epi8(
+					_mm_cmpeq_epi8(block, first_bytes[i]));
+		}
+		if(mask)
+		{
+			found = hrm_scanner_check_candidates(self, data,
+					length, position, mask, &found_index);
+			if(found != -1)
+			{
+				goto found;
+			}
+		}
+	}
+#elif defined(__ARM_NEON__)
+	for(i = 0; i < self->signature_count; i++)
+	{
+		first_bytes[i] = vdupq_n_u8(self->signatures[i][0]);
+	}
+
+	for(; position + HRM_SCANNER_BLOCK_SIZE <= end;
+			position += HRM_SCANNER_BLOCK_SIZE)
+	{
+		block = vld1q_u8(data + position);
+		equal = vceqq_u8(block, first_bytes[0]);
+		for(i = 1; i < self->signature_count; i++)
+		{
+			equal = vorrq_u8(equal,
+					vceqq_u8(block, first_bytes[i]));
+		}
+
+		/* NEON has no movemask. Check quickly if there were any
+		 * candidates at all, and find them with plain byte
+		 * comparisons only if there were. */
+		equal_64 = vreinterpretq_u64_u8(equal);
+		if(vgetq_lane_u64(equal_64, 0) | vgetq_lane_u64(equal_64, 1))
+		{
+			mask = 0xFFFF;
+			found = hrm_scanner_check_candidates(self, data,
+					length, position, mask, &found_index);
+			if(found != -1)
+			{
+				goto found;
+			}
+		}
+	}
+#endif
+
+	/* The rest (or everything, if there is no SIMD support) */
+	for(; position < end; position++)
+	{
+		if(hrm_scanner_match_at(self, data, length, position,
+					&found_index))
+		{
+			found = position;
+			goto found;
+		}
+	}
+
+	/* Nothing found. The longest signature may still begin in the
+	 * last max_length - 1 bytes, so they must be searched again when
+	 * there is more data. */
+	if(length > hrm_scanner_get_tail_length(self))
+	{
+		self->offset = length - hrm_scanner_get_tail_length(self);
+	} else {
+		self->offset = 0;
+	}
+	return -1;
+
+found:
+	self->offset = found;
+	if(signature_index)
+	{
+		*signature_index = found_index;
+	}
+	return found;
+}
+
+void hrm_scanner_consumed(HrmScanner *self, guint length)
+{
+	g_return_if_fail(self != NULL);
+
+	if(self->offset > length)
+	{
+		self->offset -= length;
+	} else {
+		self->offset = 0;
+	}
+}
+
+void hrm_scanner_reset(HrmScanner *self)
+{
+	g_return_if_fail(self != NULL);
+	self->offset = 0;
+}
+
+guint hrm_scanner_get_tail_length(HrmScanner *self)
+{
+	g_return_val_if_fail(self != NULL, 0);
+
+	if(self->max_length == 0)
+	{
+		return 0;
+	}
+	return self->max_length - 1;
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static inline gboolean hrm_scanner_match_at(
+		HrmScanner *self,
+		const guint8 *data,
+		guint length,
+		guint position,
+		guint *signature_index)
+{
+	guint i = 0;
+
+	for(i = 0; i < self->signature_count; i++)
+	{
+		if(data[position] != self->signatures[i][0])
+		{
+			continue;
+		}
+		if(position + self->lengths[i] > length)
+		{
+			continue;
+		}
+		if(memcmp(data + position + 1, self->signatures[i] + 1,
+					self->lengths[i] - 1) == 0)
+		{
+			*signature_index = i;
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static inline gint hrm_scanner_check_candidates(
+		HrmScanner *self,
+		const guint8 *data,
+		guint length,
+		guint position,
+		gulong mask,
+		guint *signature_index)
+{
+	gint bit = -1;
+
+	while((bit = g_bit_nth_lsf(mask, bit)) != -1)
+	{
+		if(hrm_scanner_match_at(self, data, length, position + bit,
+					signature_index))
+		{
+			return position + bit;
+		}
+	}
+	return -1;
+}
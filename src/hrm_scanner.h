@@ -0,0 +1,136 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _HRM_SCANNER_H
+#define _HRM_SCANNER_H
+
+/* Configuration */
+#include "config.h"
+
+/* GLib */
+#include <glib.h>
+
+/** @brief Maximum number of signatures one scanner can search for */
+#define HRM_SCANNER_MAX_SIGNATURES		4
+
+/**
+ * @brief Searches a byte stream for frame signatures (sync marks, packet
+ * headers).
+ *
+ * All the signatures are searched in one pass. Candidate positions are
+ * found by comparing the first byte of every signature against 16 bytes
+ * at a time (with SSE2 or NEON if available), and only the candidates
+ * are compared against the whole signature.
+ *
+ * The scanner remembers how far it has already searched, so that when
+ * more data arrives after an unsuccessful search, only the new data (and
+ * the possibly incomplete signature at the end of the old data) is
+ * searched again. Tell the scanner whenever data is removed from the
+ * beginning of the buffer with #hrm_scanner_consumed().
+ *
+ * Consider all the fields private.
+ */
+typedef struct _HrmScanner {
+	const guint8 *signatures[HRM_SCANNER_MAX_SIGNATURES];
+	guint lengths[HRM_SCANNER_MAX_SIGNATURES];
+	guint signature_count;
+
+	/** @brief Length of the shortest signature */
+	guint min_length;
+
+	/** @brief Length of the longest signature */
+	guint max_length;
+
+	/** @brief Offset to continue the search from */
+	guint offset;
+} HrmScanner;
+
+/**
+ * @brief Initialize a scanner with no signatures
+ *
+ * @param self Pointer to #HrmScanner
+ */
+void hrm_scanner_init(HrmScanner *self);
+
+/**
+ * @brief Add a signature to search for
+ *
+ * @param self Pointer to #HrmScanner
+ * @param signature The signature. This is not copied, so it must stay
+ * valid as long as the scanner is used.
+ * @param length Length of the signature
+ *
+ * @return TRUE on success, FALSE if there are too many signatures
+ */
+gboolean hrm_scanner_add_signature(
+		HrmScanner *self,
+		const guint8 *signature,
+		guint length);
+
+/**
+ * @brief Find the first signature in the data
+ *
+ * @param self Pointer to #HrmScanner
+ * @param data The data to search. This must be the same data (with
+ * possibly more data appended) that was searched the last time, unless
+ * #hrm_scanner_consumed() or #hrm_scanner_reset() has been called.
+ * @param length Length of the data
+ * @param signature_index Return location for the index of the found
+ * signature (in the order they were added), or NULL
+ *
+ * @return Offset of the found signature, or -1 if none was found
+ */
+gint hrm_scanner_find(
+		HrmScanner *self,
+		const guint8 *data,
+		guint length,
+		guint *signature_index);
+
+/**
+ * @brief Tell the scanner that data has been removed from the beginning
+ * of the buffer
+ *
+ * @param self Pointer to #HrmScanner
+ * @param length Amount of bytes removed
+ */
+void hrm_scanner_consumed(HrmScanner *self, guint length);
+
+/**
+ * @brief Make the scanner forget how far it has searched
+ *
+ * @param self Pointer to #HrmScanner
+ */
+void hrm_scanner_reset(HrmScanner *self);
+
+/**
+ * @brief Get the amount of bytes at the end of the data that may contain
+ * the beginning of a signature after an unsuccessful search
+ *
+ * Everything before these bytes can be discarded.
+ *
+ * @param self Pointer to #HrmScanner
+ *
+ * @return Amount of bytes to keep
+ */
+guint hrm_scanner_get_tail_length(HrmScanner *self);
+
+#endif /* _HRM_SCANNER_H */
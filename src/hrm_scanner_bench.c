@@ -0,0 +1,410 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*
+ * Benchmark for searching heart rate monitor streams for frame signatures.
+ *
+ * The stream is either a capture of a heart rate monitor (see
+ * hrm_capture.h), or a synthetic one: random noise with the frame headers
+ * of FRWD, Zephyr HxM and Alive here and there. The stream arrives a few
+ * bytes at a time, and after each arrival the buffer is searched for the
+ * signatures of all the three protocols at once. A signature that is
+ * found is removed with everything before it. If none is found,
+ * everything except a possibly incomplete signature at the end is
+ * removed.
+ *
+ * The stream is searched first the way EcgData used to search it (every
+ * signature compared at every offset, from the beginning of the buffer
+ * after each arrival), and then with HrmScanner. The rate of both is
+ * printed. Both must find the same signatures at the same offsets.
+ *
+ * The exit status is 0 if they found the same signatures, 1 if not.
+ *
+ * Usage: hrm_scanner_bench [megabytes] [bytes per read] [capture file]
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* System */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "hrm_capture.h"
+#include "hrm_protocol.h"
+#include "hrm_scanner.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define HRM_SCANNER_BENCH_DEFAULT_MEGABYTES	64
+#define HRM_SCANNER_BENCH_DEFAULT_READ_SIZE	64
+
+/** @brief Mean amount of noise between two frame headers */
+#define HRM_SCANNER_BENCH_MEAN_GAP		200
+
+/** @brief Number of protocols searched for */
+#define HRM_SCANNER_BENCH_PROTOCOLS		3
+
+/*****************************************************************************
+ * Data structures                                                           *
+ *****************************************************************************/
+
+/**
+ * @brief The signatures that were found
+ */
+typedef struct _HrmScannerBenchResult {
+	/** @brief Number of signatures found */
+	guint64 count;
+
+	/** @brief Sum of the offsets (in the stream) and indices */
+	guint64 sum;
+
+	/** @brief Time in seconds */
+	gdouble time;
+} HrmScannerBenchResult;
+
+/**
+ * @brief Function that finds the first signature in the data
+ */
+typedef gint (*HrmScannerBenchFindFunc)(
+		HrmScanner *scanner,
+		const guint8 *data,
+		guint length,
+		guint *signature_index);
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Create a synthetic stream
+ *
+ * @param length Length of the stream
+ *
+ * @return Newly allocated stream. Free with g_free().
+ */
+static guint8 *hrm_scanner_bench_create_stream(guint length);
+
+/**
+ * @brief Read a stream from a capture file
+ *
+ * @param path Path of the capture file
+ * @param length Return location for the length of the stream
+ *
+ * @return Newly allocated stream, or NULL on failure. Free with g_free().
+ */
+static guint8 *hrm_scanner_bench_read_capture(
+		const gchar *path,
+		guint *length);
+
+/**
+ * @brief Find the first signature the way EcgData used to, by comparing
+ * every signature at every offset
+ *
+ * The scanner is not used.
+ */
+static gint hrm_scanner_bench_naive_find(
+		HrmScanner *scanner,
+		const guint8 *data,
+		guint length,
+		guint *signature_index);
+
+/**
+ * @brief Search the stream as it arrives
+ *
+ * @param scanner Scanner that has the signatures of the protocols
+ * @param find Function that finds the first signature
+ * @param resume Whether the search can resume from where it stopped
+ * (otherwise the scanner is reset before each search)
+ * @param stream The stream
+ * @param length Length of the stream
+ * @param read_size Bytes per arrival
+ * @param result Return location for the result
+ */
+static void hrm_scanner_bench_run(
+		HrmScanner *scanner,
+		HrmScannerBenchFindFunc find,
+		gboolean resume,
+		const guint8 *stream,
+		guint length,
+		guint read_size,
+		HrmScannerBenchResult *result);
+
+/*****************************************************************************
+ * Static variables                                                          *
+ *****************************************************************************/
+
+static const gchar *_hrm_scanner_bench_devices[HRM_SCANNER_BENCH_PROTOCOLS] = {
+	"FRWD", "HXM", "ALIVE"
+};
+
+/** @brief The protocols, in the order of the signatures of the scanner */
+static const HrmProtocol *_hrm_scanner_bench_protocols[
+	HRM_SCANNER_BENCH_PROTOCOLS];
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+int main(int argc, char **argv)
+{
+	HrmScanner scanner;
+	HrmScannerBenchResult old_result;
+	HrmScannerBenchResult new_result;
+	const HrmProtocol *protocol = NULL;
+	guint8 *stream = NULL;
+	guint megabytes = HRM_SCANNER_BENCH_DEFAULT_MEGABYTES;
+	guint read_size = HRM_SCANNER_BENCH_DEFAULT_READ_SIZE;
+	guint length = 0;
+	guint i = 0;
+
+	if(argc > 1)
+	{
+		megabytes = CLAMP(atoi(argv[1]), 1, 1024);
+	}
+	if(argc > 2)
+	{
+		read_size = MAX(atoi(argv[2]), 1);
+	}
+
+	hrm_scanner_init(&scanner);
+	for(i = 0; i < HRM_SCANNER_BENCH_PROTOCOLS; i++)
+	{
+		protocol = hrm_protocol_find(_hrm_scanner_bench_devices[i]);
+		hrm_scanner_add_signature(&scanner, protocol->signature,
+				protocol->signature_length);
+		_hrm_scanner_bench_protocols[i] = protocol;
+	}
+
+	if(argc > 3)
+	{
+		stream = hrm_scanner_bench_read_capture(argv[3], &length);
+		if(!stream)
+		{
+			return 1;
+		}
+		g_print("%s: %u bytes, %u bytes per read\n", argv[3], length,
+				read_size);
+	} else {
+		length = megabytes * 1024 * 1024;
+		stream = hrm_scanner_bench_create_stream(length);
+		g_print("%u MB of noise and frame headers, %u bytes per "
+				"read\n", megabytes, read_size);
+	}
+
+	hrm_scanner_bench_run(&scanner, hrm_scanner_bench_naive_find, FALSE,
+			stream, length, read_size, &old_result);
+	hrm_scanner_bench_run(&scanner, hrm_scanner_find, TRUE,
+			stream, length, read_size, &new_result);
+
+	g_print("old: %8.1f MB/s, %" G_GUINT64_FORMAT " signatures\n",
+			length / MAX(old_result.time, 1e-6) / (1024 * 1024),
+			old_result.count);
+	g_print("new: %8.1f MB/s, %" G_GUINT64_FORMAT " signatures\n",
+			length / MAX(new_result.time, 1e-6) / (1024 * 1024),
+			new_result.count);
+
+	g_free(stream);
+
+	if(old_result.count != new_result.count ||
+	   old_result.sum != new_result.sum)
+	{
+		g_print("the signatures found were different\n");
+		return 1;
+	}
+	g_print("the same signatures were found\n");
+
+	return 0;
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static guint8 *hrm_scanner_bench_create_stream(guint length)
+{
+	const HrmProtocol *protocol = NULL;
+	GRand *rand = NULL;
+	guint8 *stream = NULL;
+	guint offset = 0;
+	guint next_frame = 0;
+
+	stream = g_malloc(length);
+
+	/* The same stream every time */
+	rand = g_rand_new_with_seed(length);
+
+	while(offset < length)
+	{
+		next_frame = offset + g_rand_int_range(rand, 0,
+				2 * HRM_SCANNER_BENCH_MEAN_GAP);
+		next_frame = MIN(next_frame, length);
+
+		for(; offset < next_frame; offset++)
+		{
+			stream[offset] = g_rand_int_range(rand, 0, 256);
+		}
+
+		protocol = _hrm_scanner_bench_protocols[g_rand_int_range(rand,
+				0, HRM_SCANNER_BENCH_PROTOCOLS)];
+		if(offset + protocol->signature_length <= length)
+		{
+			memcpy(stream + offset, protocol->signature,
+					protocol->signature_length);
+			offset += protocol->signature_length;
+		}
+	}
+
+	g_rand_free(rand);
+	return stream;
+}
+
+static guint8 *hrm_scanner_bench_read_capture(
+		const gchar *path,
+		guint *length)
+{
+	HrmCaptureReader *reader = NULL;
+	GByteArray *stream = NULL;
+	GError *error = NULL;
+	const guint8 *data = NULL;
+	guint record_length = 0;
+	guint32 delay = 0;
+
+	reader = hrm_capture_reader_new(path, &error);
+	if(!reader)
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return NULL;
+	}
+
+	stream = g_byte_array_new();
+	while(hrm_capture_reader_next(reader, &data, &record_length, &delay))
+	{
+		g_byte_array_append(stream, data, record_length);
+	}
+	hrm_capture_reader_close(reader);
+
+	*length = stream->len;
+	return g_byte_array_free(stream, FALSE);
+}
+
+static gint hrm_scanner_bench_naive_find(
+		HrmScanner *scanner,
+		const guint8 *data,
+		guint length,
+		guint *signature_index)
+{
+	const HrmProtocol *protocol = NULL;
+	guint offset = 0;
+	guint i = 0;
+
+	for(offset = 0; offset < length; offset++)
+	{
+		for(i = 0; i < HRM_SCANNER_BENCH_PROTOCOLS; i++)
+		{
+			protocol = _hrm_scanner_bench_protocols[i];
+			if(offset + protocol->signature_length <= length &&
+			   memcmp(data + offset, protocol->signature,
+				   protocol->signature_length) == 0)
+			{
+				*signature_index = i;
+				return offset;
+			}
+		}
+	}
+
+	return -1;
+}
+
+static void hrm_scanner_bench_run(
+		HrmScanner *scanner,
+		HrmScannerBenchFindFunc find,
+		gboolean resume,
+		const guint8 *stream,
+		guint length,
+		guint read_size,
+		HrmScannerBenchResult *result)
+{
+	struct timeval start;
+	struct timeval end;
+	guint buffer_start = 0;
+	guint buffer_end = 0;
+	guint consumed = 0;
+	guint signature_index = 0;
+	guint tail = 0;
+	gint offset = 0;
+
+	memset(result, 0, sizeof(*result));
+	hrm_scanner_reset(scanner);
+
+	gettimeofday(&start, NULL);
+	while(buffer_end < length)
+	{
+		buffer_end = MIN(buffer_end + read_size, length);
+
+		for(;;)
+		{
+			if(!resume)
+			{
+				hrm_scanner_reset(scanner);
+			}
+			offset = find(scanner, stream + buffer_start,
+					buffer_end - buffer_start,
+					&signature_index);
+			if(offset == -1)
+			{
+				/* Keep only what may be the beginning of a
+				 * signature */
+				tail = MIN(hrm_scanner_get_tail_length(
+							scanner),
+						buffer_end - buffer_start);
+				consumed = buffer_end - buffer_start - tail;
+				buffer_start += consumed;
+				hrm_scanner_consumed(scanner, consumed);
+				break;
+			}
+
+			result->count++;
+			result->sum += buffer_start + offset + signature_index;
+
+			consumed = offset + _hrm_scanner_bench_protocols[
+				signature_index]->signature_length;
+			buffer_start += consumed;
+			hrm_scanner_consumed(scanner, consumed);
+		}
+	}
+	gettimeofday(&end, NULL);
+
+	result->time = (end.tv_sec - start.tv_sec) +
+		(end.tv_usec - start.tv_usec) / 1e6;
+}
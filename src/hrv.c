@@ -0,0 +1,257 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "hrv.h"
+
+/* System */
+#include <math.h>
+#include <stdlib.h>
+
+/* Other modules */
+#include "debug.h"
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Remove the oldest interval from the window
+ *
+ * @param self Pointer to #HrvWindow
+ */
+static void hrv_window_remove_first(HrvWindow *self);
+
+/**
+ * @brief Add or remove a successive difference to or from the sums
+ *
+ * @param self Pointer to #HrvWindow
+ * @param difference The difference
+ * @param sign 1 to add, -1 to remove
+ */
+static void hrv_window_count_difference(
+		HrvWindow *self,
+		gint difference,
+		gint sign);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+HrvWindow *hrv_window_new(guint seconds)
+{
+	HrvWindow *self = NULL;
+	guint capacity = 1;
+	guint max_count = 0;
+
+	g_return_val_if_fail(seconds > 0, NULL);
+	DEBUG_BEGIN();
+
+	/* Every interval that is not an artifact fits in the window */
+	seconds = MAX(seconds, HRV_MAX_INTERVAL_MS / 1000);
+
+	/* The window can not hold more intervals than this, as shorter
+	 * ones are artifacts */
+	max_count = seconds * 1000 / HRV_MIN_INTERVAL_MS + 1;
+	while(capacity < max_count)
+	{
+		capacity = capacity << 1;
+	}
+
+	self = g_new0(HrvWindow, 1);
+	self->intervals = g_new(HrvInterval, capacity);
+	self->capacity = capacity;
+	self->mask = capacity - 1;
+	self->length = (gint64)seconds * 1000;
+	hrv_window_reset(self);
+
+	DEBUG_END();
+	return self;
+}
+
+void hrv_window_free(HrvWindow *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	g_free(self->intervals);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+void hrv_window_reset(HrvWindow *self)
+{
+	g_return_if_fail(self != NULL);
+
+	self->first = 0;
+	self->count = 0;
+	self->time = 0;
+	self->previous_valid = FALSE;
+	self->previous_length = 0;
+	self->sum = 0;
+	self->sum_of_squares = 0;
+	self->difference_count = 0;
+	self->difference_sum_of_squares = 0;
+	self->nn50_count = 0;
+}
+
+void hrv_window_add_interval(HrvWindow *self, gint length, gboolean normal)
+{
+	HrvInterval *interval = NULL;
+
+	g_return_if_fail(self != NULL);
+
+	if(length <= 0)
+	{
+		return;
+	}
+	self->time += length;
+
+	/* Remove the intervals that began before the window */
+	while(self->count > 0)
+	{
+		interval = &self->intervals[self->first & self->mask];
+		if(interval->end - interval->length >=
+				self->time - self->length)
+		{
+			break;
+		}
+		hrv_window_remove_first(self);
+	}
+
+	if(!normal || length < HRV_MIN_INTERVAL_MS ||
+			length > HRV_MAX_INTERVAL_MS)
+	{
+		/* The next interval has no successive difference */
+		self->previous_valid = FALSE;
+		return;
+	}
+
+	if(self->count == self->capacity)
+	{
+		hrv_window_remove_first(self);
+	}
+
+	interval = &self->intervals[(self->first + self->count) & self->mask];
+	interval->length = length;
+	interval->end = self->time;
+	interval->has_difference = self->previous_valid && self->count > 0;
+	interval->difference = length - self->previous_length;
+	self->count++;
+
+	self->sum += length;
+	self->sum_of_squares += (gint64)length * length;
+	if(interval->has_difference)
+	{
+		hrv_window_count_difference(self, interval->difference, 1);
+	}
+
+	self->previous_valid = TRUE;
+	self->previous_length = length;
+}
+
+void hrv_window_get_metrics(const HrvWindow *self, HrvMetrics *metrics)
+{
+	gdouble variance = 0;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(metrics != NULL);
+
+	metrics->heart_rate = -1;
+	metrics->sdnn = -1;
+	metrics->rmssd = -1;
+	metrics->pnn50 = -1;
+	metrics->interval_count = self->count;
+
+	if(self->count > 0)
+	{
+		metrics->heart_rate = 60000.0 * self->count / self->sum;
+	}
+	if(self->count > 1)
+	{
+		variance = (self->sum_of_squares -
+				(gdouble)self->sum * self->sum / self->count) /
+			(self->count - 1);
+		metrics->sdnn = sqrt(MAX(variance, 0));
+	}
+	if(self->difference_count > 0)
+	{
+		metrics->rmssd = sqrt((gdouble)self->difference_sum_of_squares /
+				self->difference_count);
+		metrics->pnn50 = 100.0 * self->nn50_count /
+			self->difference_count;
+	}
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static void hrv_window_remove_first(HrvWindow *self)
+{
+	HrvInterval *interval = NULL;
+	HrvInterval *next = NULL;
+
+	interval = &self->intervals[self->first & self->mask];
+	self->sum -= interval->length;
+	self->sum_of_squares -= (gint64)interval->length * interval->length;
+
+	/* The difference of the oldest interval was removed with the
+	 * interval before it, and the difference of the next one is to this
+	 * one */
+	if(self->count > 1)
+	{
+		next = &self->intervals[(self->first + 1) & self->mask];
+		if(next->has_difference)
+		{
+			hrv_window_count_difference(self, next->difference,
+					-1);
+			next->has_difference = FALSE;
+		}
+	}
+
+	self->first++;
+	self->count--;
+}
+
+static void hrv_window_count_difference(
+		HrvWindow *self,
+		gint difference,
+		gint sign)
+{
+	self->difference_count += sign;
+	self->difference_sum_of_squares += sign * (gint64)difference *
+		difference;
+	if(abs(difference) > HRV_NN50_MS)
+	{
+		self->nn50_count += sign;
+	}
+}
@@ -0,0 +1,187 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _HRV_H
+#define _HRV_H
+
+/* Configuration */
+#include "config.h"
+
+/* GLib */
+#include <glib.h>
+
+/** @brief R-R intervals shorter than this are artifacts (240 bpm) */
+#define HRV_MIN_INTERVAL_MS		250
+
+/** @brief R-R intervals longer than this are artifacts or missed beats
+ * (30 bpm) */
+#define HRV_MAX_INTERVAL_MS		2000
+
+/** @brief Successive differences longer than this count to pNN50 */
+#define HRV_NN50_MS			50
+
+/**
+ * @brief Heart rate variability metrics over a window of R-R intervals.
+ * A metric that cannot be computed yet is -1.
+ */
+typedef struct _HrvMetrics {
+	/** @brief Mean heart rate in beats per minute */
+	gdouble heart_rate;
+
+	/** @brief Standard deviation of the NN intervals in milliseconds */
+	gdouble sdnn;
+
+	/**
+	 * @brief Root mean square of the successive differences of the NN
+	 * intervals in milliseconds
+	 */
+	gdouble rmssd;
+
+	/**
+	 * @brief Percentage of the successive differences that are longer
+	 * than 50 ms
+	 */
+	gdouble pnn50;
+
+	/** @brief Amount of NN intervals in the window */
+	guint interval_count;
+} HrvMetrics;
+
+/**
+ * @brief One NN interval in the window
+ */
+typedef struct _HrvInterval {
+	/** @brief Length of the interval in milliseconds */
+	gint length;
+
+	/** @brief Time at the end of the interval, in milliseconds since the
+	 * window was reset */
+	gint64 end;
+
+	/**
+	 * @brief Whether the previous interval in the window is the one
+	 * right before this, so that their difference counts to RMSSD and
+	 * pNN50
+	 */
+	gboolean has_difference;
+
+	/** @brief Difference to the previous interval in milliseconds */
+	gint difference;
+} HrvInterval;
+
+/**
+ * @brief Sliding window of R-R intervals, with running sums for the
+ * heart rate variability metrics.
+ *
+ * Adding an interval and getting the metrics take constant time: the sums
+ * are updated when an interval enters or leaves the window, and the
+ * window is never scanned. The sums are integers, so they do not drift
+ * however long the window runs.
+ *
+ * Only the intervals between two normal beats (NN intervals) are used.
+ * Intervals next to ectopic beats and artifacts move the window forward,
+ * but are left out of the metrics.
+ *
+ * Consider all the fields private.
+ */
+typedef struct _HrvWindow {
+	/** @brief Ring of NN intervals, oldest at first */
+	HrvInterval *intervals;
+
+	/** @brief Capacity of the ring (a power of two) */
+	guint capacity;
+
+	/** @brief capacity - 1 */
+	guint mask;
+
+	/** @brief Index of the oldest interval (wraps around) */
+	guint first;
+
+	/** @brief Amount of intervals in the ring */
+	guint count;
+
+	/** @brief Length of the window in milliseconds */
+	gint64 length;
+
+	/** @brief Time at the end of the latest interval, in milliseconds */
+	gint64 time;
+
+	/** @brief Whether the latest interval was an NN interval */
+	gboolean previous_valid;
+
+	/** @brief Length of the latest NN interval */
+	gint previous_length;
+
+	/* Running sums of the intervals in the ring */
+	gint64 sum;
+	gint64 sum_of_squares;
+	guint difference_count;
+	gint64 difference_sum_of_squares;
+	guint nn50_count;
+} HrvWindow;
+
+/**
+ * @brief Create a new window
+ *
+ * @param seconds Length of the window in seconds. Five minutes is the
+ * standard for short-term heart rate variability. The window is at least
+ * HRV_MAX_INTERVAL_MS long.
+ *
+ * @return Newly allocated window
+ */
+HrvWindow *hrv_window_new(guint seconds);
+
+/**
+ * @brief Free a window
+ *
+ * @param self Pointer to #HrvWindow
+ */
+void hrv_window_free(HrvWindow *self);
+
+/**
+ * @brief Empty the window, for example after a gap in the data
+ *
+ * @param self Pointer to #HrvWindow
+ */
+void hrv_window_reset(HrvWindow *self);
+
+/**
+ * @brief Add an R-R interval to the window
+ *
+ * The intervals that have fallen out of the window are removed.
+ *
+ * @param self Pointer to #HrvWindow
+ * @param length Length of the interval in milliseconds
+ * @param normal Whether the beats at both ends of the interval were
+ * normal beats
+ */
+void hrv_window_add_interval(HrvWindow *self, gint length, gboolean normal);
+
+/**
+ * @brief Get the metrics of the intervals in the window
+ *
+ * @param self Pointer to #HrvWindow
+ * @param metrics Storage for the metrics
+ */
+void hrv_window_get_metrics(const HrvWindow *self, HrvMetrics *metrics);
+
+#endif /* _HRV_H */
@@ -197,6 +197,13 @@ AppData *interface_create()
 		return NULL;
 	}
 
+	app_data->cadence_detector = cadence_detector_new(app_data->ecg_data);
+	if(!app_data->cadence_detector)
+	{
+		g_critical("Could not create CadenceDetector");
+		return NULL;
+	}
+
 #ifdef ENABLE_ECG_VIEW
 	app_data->ecg_view = ecg_view_new(app_data->gconf_helper,
 			app_data->ecg_data);
@@ -213,6 +220,7 @@ AppData *interface_create()
 			GTK_WINDOW(app_data->window),
 			app_data->gconf_helper,
 			app_data->beat_detector,
+			app_data->cadence_detector,
 			app_data->osso);
 
 	/*app_data->map_view_tab_id = navigation_menu_append_page(
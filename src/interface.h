@@ -44,6 +44,7 @@
 #include "activity.h"
 #include "analyzer.h"
 #include "beat_detect.h"
+#include "cadence.h"
 #include "ecg_data.h"
 #include "gconf_helper.h"
 #include "heart_rate_settings.h"
@@ -83,6 +84,9 @@ typedef struct _AppData {
 	/* Beat detector */
 	BeatDetector *beat_detector;
 
+	/* Cadence detector */
+	CadenceDetector *cadence_detector;
+
 #ifdef ENABLE_ECG_VIEW
 	/* ECG view */
 	gint ecg_view_tab_id;
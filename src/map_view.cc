@@ -55,6 +55,7 @@
 #include "ec_error.h"
 #include "ec-button.h"
 #include "ec-progress.h"
+#include "sample_clock.h"
 #include "util.h"
 
 //#include "map_widget/map_widget.h"
@@ -98,6 +99,12 @@ static void map_view_heart_rate_changed(
 		gint beat_type,
 		gpointer user_data);
 
+static void map_view_heart_rate_variability_changed(
+		BeatDetector *beat_detector,
+		const HrvMetrics *metrics,
+		struct timeval *time,
+		gpointer user_data);
+
 static void map_view_hide_map_widget(MapView *self);
 
 static void map_view_location_changed(
@@ -116,6 +123,53 @@ static gboolean map_view_update_stats(gpointer user_data);
 static void map_view_set_elapsed_time(MapView *self, struct timeval *tv);
 static void map_view_pause_activity(MapView *self);
 static void map_view_continue_activity(MapView *self);
+
+/**
+ * @brief Start recording the raw ECG next to the track, if it is enabled
+ * in the settings
+ *
+ * @param self Pointer to #MapView
+ */
+static void map_view_start_ecg_recording(MapView *self);
+
+/**
+ * @brief Stop recording the raw ECG, if it is being recorded
+ *
+ * @param self Pointer to #MapView
+ */
+static void map_view_stop_ecg_recording(MapView *self);
+
+/**
+ * @brief Start storing the heart rate variability metrics to the track
+ *
+ * @param self Pointer to #MapView
+ */
+static void map_view_start_hrv_recording(MapView *self);
+
+/**
+ * @brief Stop storing the heart rate variability metrics, if they are
+ * being stored
+ *
+ * @param self Pointer to #MapView
+ */
+static void map_view_stop_hrv_recording(MapView *self);
+
+/**
+ * @brief Save the track of the journal that was left behind, if eCoach was
+ * not stopped properly while recording
+ *
+ * @param self Pointer to #MapView
+ */
+static void map_view_recover_track(MapView *self);
+
+/**
+ * @brief Remember the journal of the track that is being recorded, or
+ * forget it when it is not needed anymore
+ *
+ * @param self Pointer to #MapView
+ * @param recording Whether the track is being recorded
+ */
+static void map_view_set_track_journal(MapView *self, gboolean recording);
 gboolean map_button_press_cb(GtkWidget *widget, GdkEventButton *event, gpointer user_data);
 gboolean map_button_release_cb(GtkWidget *widget, GdkEventButton *event, gpointer user_data);
 void select_map_source_cb (HildonButton *button, gpointer user_data);
@@ -159,6 +213,7 @@ MapView *map_view_new(
 		GtkWindow *parent_window,
 		GConfHelperData *gconf_helper,
 		BeatDetector *beat_detector,
+		CadenceDetector *cadence_detector,
 		osso_context_t *osso)
 {
 	MapView *self = NULL;
@@ -167,6 +222,7 @@ MapView *map_view_new(
 	g_return_val_if_fail(parent_window != NULL, NULL);
 	g_return_val_if_fail(gconf_helper != NULL, NULL);
 	g_return_val_if_fail(beat_detector != NULL, NULL);
+	g_return_val_if_fail(cadence_detector != NULL, NULL);
 	g_return_val_if_fail(osso != NULL, NULL);
 	DEBUG_BEGIN();
 
@@ -174,8 +230,10 @@ MapView *map_view_new(
 	self->parent_window = parent_window;
 	self->gconf_helper = gconf_helper;
 	self->beat_detector = beat_detector;
+	self->cadence_detector = cadence_detector;
 	self->osso = osso;
 	self->track_helper = track_helper_new();
+	map_view_recover_track(self);
 	self->first_location_point_added = FALSE;
 
 
@@ -457,6 +515,7 @@ static void map_view_hide(MapView *self)
 					self->beat_detector,
 					map_view_heart_rate_changed,
 					self);
+			cadence_detector_stop(self->cadence_detector);
 		}
 	}
 	DEBUG_END();
@@ -755,6 +814,9 @@ void map_view_stop(MapView *self)
 	}
 	track_helper_stop(self->track_helper);
 	track_helper_clear(self->track_helper, FALSE);
+	map_view_stop_ecg_recording(self);
+	map_view_stop_hrv_recording(self);
+	map_view_set_track_journal(self, FALSE);
 	self->activity_state = MAP_VIEW_ACTIVITY_STATE_STOPPED;
 	g_source_remove(self->activity_timer_id);
 	self->activity_timer_id = 0;
@@ -855,6 +917,15 @@ static gboolean map_view_connect_beat_detector_idle(gpointer user_data)
 		return FALSE;
 	}
 
+	/* Only some heart rate monitors have an accelerometer, so it is
+	 * not an error if there is no cadence */
+	if(!cadence_detector_start(self->cadence_detector, &error))
+	{
+		g_warning("Could not start cadence detection: %s",
+				error->message);
+		g_error_free(error);
+	}
+
 	DEBUG_END();
 
 	/* This only needs to be done once */
@@ -961,10 +1032,44 @@ static void map_view_heart_rate_changed(
 						heart_rate);
 			}
 		}
+	} else {
+		/* Not known yet, or the heart rate monitor was lost */
+		map_view_update_heart_rate_icon(self, -1);
+	}
+
+	DEBUG_END();
+}
+static void map_view_heart_rate_variability_changed(
+		BeatDetector *beat_detector,
+		const HrvMetrics *metrics,
+		struct timeval *time,
+		gpointer user_data)
+{
+	MapView *self = (MapView *)user_data;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(time != NULL);
+	DEBUG_BEGIN();
+
+	/* The metrics come with every beat. Store them as often as the
+	 * heart rate. */
+	if(self->activity_state == MAP_VIEW_ACTIVITY_STATE_STARTED &&
+			self->first_location_point_added)
+	{
+		self->hrv_count++;
+		if(self->hrv_count == 10)
+		{
+			self->hrv_count = 0;
+			track_helper_add_heart_rate_variability(
+					self->track_helper,
+					time,
+					metrics);
+		}
 	}
 
 	DEBUG_END();
 }
+
 static void map_view_location_changed(
 		LocationGPSDevice *device,
 		gpointer user_data)
@@ -1116,7 +1221,13 @@ static void map_view_check_and_add_route_point(
 			track_helper_point.altitude_is_set = FALSE;
 		}
 
-		gettimeofday(&track_helper_point.timestamp, NULL);
+		track_helper_point.cadence = cadence_detector_get_cadence(
+				self->cadence_detector);
+
+		/* On the same time base as the heart rates, so that they
+		 * line up with the track points */
+		sample_clock_to_timeval(sample_clock_now(),
+				&track_helper_point.timestamp);
 		track_helper_add_track_point(self->track_helper,
 				&track_helper_point);
 
@@ -1242,6 +1353,10 @@ static void map_view_start_activity(MapView *self)
 			map_view_update_stats,
 			self);
 
+	map_view_start_ecg_recording(self);
+	map_view_start_hrv_recording(self);
+	map_view_set_track_journal(self, TRUE);
+
 	self->activity_state = MAP_VIEW_ACTIVITY_STATE_STARTED;
 	
 	
@@ -1289,6 +1404,160 @@ static void map_view_continue_activity(MapView *self)
 	DEBUG_END();
 }
 
+static void map_view_start_ecg_recording(MapView *self)
+{
+	GError *error = NULL;
+	gchar *path = NULL;
+
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(self->ecg_recorder || !self->file_name ||
+			!gconf_helper_get_value_bool_with_default(
+				self->gconf_helper, ECGC_ECG_RECORDING, FALSE))
+	{
+		DEBUG_END();
+		return;
+	}
+
+	/* The samples are stored next to the GPX file, with the same
+	 * name */
+	path = ecg_recorder_get_path_for_track(self->file_name);
+	self->ecg_recorder = ecg_recorder_new(self->beat_detector->ecg_data,
+			path, &error);
+	if(!self->ecg_recorder)
+	{
+		/* The track is recorded anyway */
+		g_warning("Unable to record ECG: %s", error->message);
+		g_error_free(error);
+	}
+	g_free(path);
+
+	DEBUG_END();
+}
+
+static void map_view_stop_ecg_recording(MapView *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(self->ecg_recorder)
+	{
+		ecg_recorder_close(self->ecg_recorder);
+		self->ecg_recorder = NULL;
+	}
+
+	DEBUG_END();
+}
+
+static void map_view_start_hrv_recording(MapView *self)
+{
+	GError *error = NULL;
+
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	/* Do not try to connect again if the heart rate monitor could not
+	 * be connected for the heart rate */
+	if(self->hrv_connected || !self->beat_detector_connected)
+	{
+		DEBUG_END();
+		return;
+	}
+
+	self->hrv_count = 0;
+	if(!beat_detector_add_hrv_callback(
+				self->beat_detector,
+				map_view_heart_rate_variability_changed,
+				self,
+				&error))
+	{
+		/* The track is recorded anyway */
+		g_warning("Unable to record heart rate variability: %s",
+				error->message);
+		g_error_free(error);
+		DEBUG_END();
+		return;
+	}
+	self->hrv_connected = TRUE;
+
+	DEBUG_END();
+}
+
+static void map_view_stop_hrv_recording(MapView *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(self->hrv_connected)
+	{
+		self->hrv_connected = FALSE;
+		beat_detector_remove_hrv_callback(
+				self->beat_detector,
+				map_view_heart_rate_variability_changed,
+				self);
+	}
+
+	DEBUG_END();
+}
+
+static void map_view_recover_track(MapView *self)
+{
+	GError *error = NULL;
+	gchar *path = NULL;
+
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	path = gconf_helper_get_value_string_with_default(self->gconf_helper,
+			ECGC_TRACK_JOURNAL, "");
+	if(path && path[0] && g_file_test(path, G_FILE_TEST_EXISTS))
+	{
+		if(!track_helper_recover(path, &error))
+		{
+			ec_error_show_message_error_printf(
+					"Unable to recover the track:\n%s",
+					error->message);
+			g_error_free(error);
+		}
+	}
+	g_free(path);
+
+	gconf_helper_set_value_string_simple(self->gconf_helper,
+			ECGC_TRACK_JOURNAL, "");
+
+	DEBUG_END();
+}
+
+static void map_view_set_track_journal(MapView *self, gboolean recording)
+{
+	gchar *path = NULL;
+
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(!self->file_name)
+	{
+		DEBUG_END();
+		return;
+	}
+
+	/* The journal of the track stays if the track could not be saved,
+	 * so that it is recovered on the next start */
+	path = track_journal_get_path_for_track(self->file_name);
+	if(recording || g_file_test(path, G_FILE_TEST_EXISTS))
+	{
+		gconf_helper_set_value_string_simple(self->gconf_helper,
+				ECGC_TRACK_JOURNAL, path);
+	} else {
+		gconf_helper_set_value_string_simple(self->gconf_helper,
+				ECGC_TRACK_JOURNAL, "");
+	}
+	g_free(path);
+
+	DEBUG_END();
+}
+
 static void map_view_pause_activity(MapView *self)
 {
 	struct timeval time_now;
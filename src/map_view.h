@@ -55,6 +55,8 @@
 /* Other modules */
 
 #include "beat_detect.h"
+#include "cadence.h"
+#include "ecg_recorder.h"
 #include "gconf_helper.h"
 #include "track.h"
 
@@ -159,6 +161,8 @@ struct _MapView {
 
 	GConfHelperData *gconf_helper;	/**< GConf helper		*/
 	BeatDetector *beat_detector;	/**< Beat detector		*/
+	CadenceDetector *cadence_detector;
+					/**< Cadence detector		*/
 	osso_context_t *osso;		/**< Osso context		*/
 	LocationGPSDevice *gps_device;	/**< GPS device connection	*/
 	LocationGPSDControl
@@ -172,6 +176,7 @@ struct _MapView {
 
 	gboolean beat_detector_connected;
 					/**< Is beat detector connected	*/
+	gboolean hrv_connected;		/**< Are HRV metrics recorded	*/
 
 	MapViewActivityState
 		activity_state;		/**< State of the activity	*/
@@ -183,12 +188,14 @@ struct _MapView {
 	guint activity_timer_id;	/**< Source id for g_timeout	*/
 
 	TrackHelper *track_helper;	/**< Track management		*/
+	EcgRecorder *ecg_recorder;	/**< Raw ECG recording, or NULL	*/
 	
 	gchar *activity_name;
 	gchar *activity_comment;
 	gchar *file_name;
 
 	gint heart_rate_count;		/**< Count of heart rate values	*/
+	gint hrv_count;			/**< Count of HRV metrics	*/
 	gint heart_rate_limit_low;	/**< Heart rate lower range	*/
 	gint heart_rate_limit_high;	/**< Heart rate upper range	*/
 
@@ -268,11 +275,13 @@ struct _Point
  *
  * @param gconf_helper Pointer to #GConfHelperData
  * @param beat_detector Pointer to #BeatDetector
+ * @param cadence_detector Pointer to #CadenceDetector
  */
 MapView *map_view_new(
 		GtkWindow *parent_window,
 		GConfHelperData *gconf_helper,
 		BeatDetector *beat_detector,
+		CadenceDetector *cadence_detector,
 		osso_context_t *osso);
 
 /**
@@ -54,73 +54,140 @@ Functions in bdac.cpp require functions in the following files:
          and BEAT_SAMPLE_RATE in bcac.h.
 
 *******************************************************************************/
+#include <string.h>	// For memset
 #include "qrsdet.h"	// For base SAMPLE_RATE
 #include "bdac.h"
+#include "ecgcodes.h"
+#include "osea.h"	// For the buffer lengths and OseaContext
+#include "variant.h"
 
-#define ECG_BUFFER_LENGTH	1000	// Should be long enough for a beat
-											// plus extra space to accommodate
-											// the maximum detection delay.
-#define BEAT_QUE_LENGTH	10			// Length of que for beats awaiting
-											// classification.  Because of
-											// detection delays, Multiple beats
-											// can occur before there is enough data
-											// to classify the first beat in the que.
+#if (SAMPLE_RATE != BEAT_SAMPLE_RATE) && (SAMPLE_RATE != 2*BEAT_SAMPLE_RATE)
+#error DownSampleBeat() only handles sample rate ratios of 1 and 2
+#endif
+
+#define BDAC_BLOCK_LENGTH	64	// Samples filtered at a time by
+											// BeatDetectAndClassifyBlock().
 
 // Internal function prototypes.
 
 void DownSampleBeat(int *beatOut, int *beatIn) ;
+static int BDACFiltered(OseaContext *ctx, int ecgSample, int fdatum,
+	int *beatType, int *beatMatch) ;
 
 // External functions prototypes.
 
-int QRSDet( int datum, int init ) ;
-int NoiseCheck(int datum, int delay, int RR, int beatBegin, int beatEnd) ;
-int Classify(int *newBeat,int rr, int noiseLevel, int *beatMatch, int *fidAdj, int init) ;
-int GetDominantType(void) ;
-int GetBeatEnd(int type) ;
-int GetBeatBegin(int type) ;
+int NoiseCheck(OseaContext *ctx, int datum, int delay, int RR, int beatBegin, int beatEnd) ;
+int Classify(OseaContext *ctx, int *newBeat,int rr, int noiseLevel, int *beatMatch, int *fidAdj, int init) ;
+int GetDominantType(OseaContext *ctx) ;
+int GetBeatEnd(OseaContext *ctx, int type) ;
+int GetBeatBegin(OseaContext *ctx, int type) ;
 int gcd(int x, int y) ;
 
-// Global Variables
+/******************************************************************************
+	InitBDAC() initializes a new context: all the variables get the values
+	that the global and static variables had when the program started, and
+	the context is reset.
+*******************************************************************************/
 
-int ECGBuffer[ECG_BUFFER_LENGTH], ECGBufferIndex = 0 ;  // Circular data buffer.
-int BeatBuffer[BEATLGTH] ;
-int BeatQue[BEAT_QUE_LENGTH], BeatQueCount = 0 ;  // Buffer of detection delays.
-int RRCount = 0 ;
-int InitBeatFlag = 1 ;
+void InitBDAC(OseaContext *ctx)
+	{
+	memset(ctx, 0, sizeof(OseaContext)) ;
+	ctx->classify.lastRhythmClass = UNKNOWN ;
+	ctx->bdac.InitBeatFlag = 1 ;
+	ResetBDAC(ctx) ;
+	}
 
 /******************************************************************************
-	ResetBDAC() resets static variables required for beat detection and
+	ResetBDAC() resets the variables in ctx required for beat detection and
 	classification.
 *******************************************************************************/
 
-void ResetBDAC(void)
+void ResetBDAC(OseaContext *ctx)
 	{
+	OseaBDAC *b = &ctx->bdac ;
 	int dummy ;
-	QRSDet(0,1) ;	// Reset the qrs detector
-	RRCount = 0 ;
-	Classify(BeatBuffer,0,0,&dummy,&dummy,1) ;
-	InitBeatFlag = 1 ;
-   BeatQueCount = 0 ;	// Flush the beat que.
+	QRSDet(ctx,0,1) ;	// Reset the qrs detector
+	b->RRCount = 0 ;
+	Classify(ctx,b->BeatBuffer,0,0,&dummy,&dummy,1) ;
+	b->InitBeatFlag = 1 ;
+   b->BeatQueCount = 0 ;	// Flush the beat que.
 	}
 
 /*****************************************************************************
 Syntax:
-	int BeatDetectAndClassify(int ecgSample, int *beatType, *beatMatch) ;
+	int BeatDetectAndClassify(OseaContext *ctx, int ecgSample, int *beatType,
+		int *beatMatch) ;
 Description:
 	BeatDetectAndClassify() implements a beat detector and classifier.
 	ECG samples are passed into BeatDetectAndClassify() one sample at a
-	time.  BeatDetectAndClassify has been designed for a sample rate of
-	200 Hz.  When a beat has been detected and classified the detection
-	delay is returned and the beat classification is returned through the
-	pointer *beatType.  For use in debugging, the number of the template
+	time, together with the context of the stream.  BeatDetectAndClassify
+	has been designed for a sample rate of 200 Hz.  When a beat has been
+	detected and classified the detection delay is returned and the beat
+	classification is returned through the pointer *beatType.  For use in debugging, the number of the template
    that the beat was matched to is returned in via *beatMatch.
 Returns
 	BeatDetectAndClassify() returns 0 if no new beat has been detected and
 	classified.  If a beat has been classified, BeatDetectAndClassify returns
 	the number of samples since the approximate location of the R-wave.
 ****************************************************************************/
-int BeatDetectAndClassify(int ecgSample, int *beatType, int *beatMatch)
+int BeatDetectAndClassify(OseaContext *ctx, int ecgSample, int *beatType,
+	int *beatMatch)
+	{
+	return(BDACFiltered(ctx,ecgSample,QRSFilter(ctx,ecgSample,0),beatType,
+		beatMatch)) ;
+	}
+
+/*****************************************************************************
+Syntax:
+	int BeatDetectAndClassifyBlock(OseaContext *ctx, const int *ecgSamples,
+		int n, OseaBeat *beats) ;
+Description:
+	BeatDetectAndClassifyBlock() does the same as n calls to
+	BeatDetectAndClassify(), but the QRS filters are run over blocks of
+	samples with QRSFilterBlock().  The beats are stored in beats, which
+	must have room for n beats (there can be at most one per sample).
+	beats[i].index is the index of the sample after which
+	BeatDetectAndClassify() would have returned the beat.
+Returns
+	The number of beats stored in beats.
+****************************************************************************/
+int BeatDetectAndClassifyBlock(OseaContext *ctx, const int *ecgSamples, int n,
+	OseaBeat *beats)
 	{
+	int fdata[BDAC_BLOCK_LENGTH] ;
+	int i, len, start, delay, beatType, beatMatch, count = 0 ;
+
+	for(start = 0; start < n; start += len)
+		{
+		len = n - start ;
+		if(len > BDAC_BLOCK_LENGTH)
+			len = BDAC_BLOCK_LENGTH ;
+		QRSFilterBlock(ctx,&ecgSamples[start],fdata,len) ;
+		for(i = 0; i < len; ++i)
+			{
+			delay = BDACFiltered(ctx,ecgSamples[start+i],fdata[i],&beatType,
+				&beatMatch) ;
+			if(delay != 0)
+				{
+				beats[count].index = start+i ;
+				beats[count].delay = delay ;
+				beats[count].type = beatType ;
+				beats[count].match = beatMatch ;
+				++count ;
+				}
+			}
+		}
+	return(count) ;
+	}
+
+/*****************************************************************************
+	BDACFiltered() is BeatDetectAndClassify() for a sample that has already
+	been run through the QRS filters, fdatum being the filtered sample.
+****************************************************************************/
+static int BDACFiltered(OseaContext *ctx, int ecgSample, int fdatum,
+	int *beatType, int *beatMatch)
+	{
+	OseaBDAC *b = &ctx->bdac ;
 	int detectDelay, rr, i, j ;
 	int noiseEst = 0, beatBegin, beatEnd ;
 	int domType ;
@@ -129,46 +196,46 @@ int BeatDetectAndClassify(int ecgSample, int *beatType, int *beatMatch)
 
 	// Store new sample in the circular buffer.
 
-	ECGBuffer[ECGBufferIndex] = ecgSample ;
-	if(++ECGBufferIndex == ECG_BUFFER_LENGTH)
-		ECGBufferIndex = 0 ;
+	b->ECGBuffer[b->ECGBufferIndex] = ecgSample ;
+	if(++b->ECGBufferIndex == ECG_BUFFER_LENGTH)
+		b->ECGBufferIndex = 0 ;
 
 	// Increment RRInterval count.
 
-	++RRCount ;
+	++b->RRCount ;
 
 	// Increment detection delays for any beats in the que.
 
-	for(i = 0; i < BeatQueCount; ++i)
-		++BeatQue[i] ;
+	for(i = 0; i < b->BeatQueCount; ++i)
+		++b->BeatQue[i] ;
 
 	// Run the sample through the QRS detector.
 
-	detectDelay = QRSDet(ecgSample,0) ;
+	detectDelay = QRSDetFiltered(ctx,ecgSample,fdatum) ;
 	if(detectDelay != 0)
 		{
-		BeatQue[BeatQueCount] = detectDelay ;
-		++BeatQueCount ;
+		b->BeatQue[b->BeatQueCount] = detectDelay ;
+		++b->BeatQueCount ;
 		}
 
 	// Return if no beat is ready for classification.
 
-	if((BeatQue[0] < (BEATLGTH-FIDMARK)*(SAMPLE_RATE/BEAT_SAMPLE_RATE))
-		|| (BeatQueCount == 0))
+	if((b->BeatQue[0] < (BEATLGTH-FIDMARK)*(SAMPLE_RATE/BEAT_SAMPLE_RATE))
+		|| (b->BeatQueCount == 0))
 		{
-		NoiseCheck(ecgSample,0,rr, beatBegin, beatEnd) ;	// Update noise check buffer
+		NoiseCheck(ctx,ecgSample,0,rr, beatBegin, beatEnd) ;	// Update noise check buffer
 		return 0 ;
 		}
 
 	// Otherwise classify the beat at the head of the que.
 
-	rr = RRCount - BeatQue[0] ;	// Calculate the R-to-R interval
-	detectDelay = RRCount = BeatQue[0] ;
+	rr = b->RRCount - b->BeatQue[0] ;	// Calculate the R-to-R interval
+	detectDelay = b->RRCount = b->BeatQue[0] ;
 
 	// Estimate low frequency noise in the beat.
 	// Might want to move this into classify().
 
-	domType = GetDominantType() ;
+	domType = GetDominantType(ctx) ;
 	if(domType == -1)
 		{
 		beatBegin = MS250 ;
@@ -176,39 +243,39 @@ int BeatDetectAndClassify(int ecgSample, int *beatType, int *beatMatch)
 		}
 	else
 		{
-		beatBegin = (SAMPLE_RATE/BEAT_SAMPLE_RATE)*(FIDMARK-GetBeatBegin(domType)) ;
-		beatEnd = (SAMPLE_RATE/BEAT_SAMPLE_RATE)*(GetBeatEnd(domType)-FIDMARK) ;
+		beatBegin = (SAMPLE_RATE/BEAT_SAMPLE_RATE)*(FIDMARK-GetBeatBegin(ctx,domType)) ;
+		beatEnd = (SAMPLE_RATE/BEAT_SAMPLE_RATE)*(GetBeatEnd(ctx,domType)-FIDMARK) ;
 		}
-	noiseEst = NoiseCheck(ecgSample,detectDelay,rr,beatBegin,beatEnd) ;
+	noiseEst = NoiseCheck(ctx,ecgSample,detectDelay,rr,beatBegin,beatEnd) ;
 
 	// Copy the beat from the circular buffer to the beat buffer
 	// and reduce the sample rate by averageing pairs of data
 	// points.
 
-	j = ECGBufferIndex - detectDelay - (SAMPLE_RATE/BEAT_SAMPLE_RATE)*FIDMARK ;
+	j = b->ECGBufferIndex - detectDelay - (SAMPLE_RATE/BEAT_SAMPLE_RATE)*FIDMARK ;
 	if(j < 0) j += ECG_BUFFER_LENGTH ;
 
 	for(i = 0; i < (SAMPLE_RATE/BEAT_SAMPLE_RATE)*BEATLGTH; ++i)
 		{
-		tempBeat[i] = ECGBuffer[j] ;
+		tempBeat[i] = b->ECGBuffer[j] ;
 		if(++j == ECG_BUFFER_LENGTH)
 			j = 0 ;
 		}
 
-	DownSampleBeat(BeatBuffer,tempBeat) ;
+	DownSampleBeat(b->BeatBuffer,tempBeat) ;
 
 	// Update the QUE.
 
-	for(i = 0; i < BeatQueCount-1; ++i)
-		BeatQue[i] = BeatQue[i+1] ;
-	--BeatQueCount ;
+	for(i = 0; i < b->BeatQueCount-1; ++i)
+		b->BeatQue[i] = b->BeatQue[i+1] ;
+	--b->BeatQueCount ;
 
 
 	// Skip the first beat.
 
-	if(InitBeatFlag)
+	if(b->InitBeatFlag)
 		{
-		InitBeatFlag = 0 ;
+		b->InitBeatFlag = 0 ;
 		*beatType = 13 ;
 		*beatMatch = 0 ;
 		fidAdj = 0 ;
@@ -216,7 +283,7 @@ int BeatDetectAndClassify(int ecgSample, int *beatType, int *beatMatch)
 	// Classify all other beats.
 	else
 		{
-		*beatType = Classify(BeatBuffer,rr,noiseEst,beatMatch,&fidAdj,0) ;
+		*beatType = Classify(ctx,b->BeatBuffer,rr,noiseEst,beatMatch,&fidAdj,0) ;
 		fidAdj *= SAMPLE_RATE/BEAT_SAMPLE_RATE ;
       }
 
@@ -225,7 +292,7 @@ int BeatDetectAndClassify(int ecgSample, int *beatType, int *beatMatch)
 
 	if(*beatType == 100)
 		{
-		RRCount += rr ;
+		b->RRCount += rr ;
 		return(0) ;
 		}
 
@@ -244,6 +311,26 @@ void DownSampleBeat(int *beatOut, int *beatIn)
 	{
 	int i ;
 
+#if (SAMPLE_RATE == BEAT_SAMPLE_RATE)
+	for(i = 0; i < BEATLGTH; ++i)
+		beatOut[i] = beatIn[i] ;
+#else
 	for(i = 0; i < BEATLGTH; ++i)
 		beatOut[i] = (beatIn[i<<1]+beatIn[(i<<1)+1])>>1 ;
+#endif
 	}
+
+/******************************************************************************
+	The descriptor of this build, OseaVariant_300 for the 300 Hz build and
+	so on (see variant.h).
+*******************************************************************************/
+
+const OseaVariant OSEA_NAME(OseaVariant) =
+	{
+	SAMPLE_RATE,
+	sizeof(OseaContext),
+	InitBDAC,
+	ResetBDAC,
+	BeatDetectAndClassify,
+	BeatDetectAndClassifyBlock
+	} ;
@@ -30,34 +30,45 @@ MA 02143 USA).  For updates to this software, please visit our website
 #ifndef _BDAC_H
 #define _BDAC_H
 
-#define BEAT_SAMPLE_RATE	150
-#define BEAT_MS_PER_SAMPLE	( (double) 1000/ (double) BEAT_SAMPLE_RATE)
-
-#define BEAT_MS10		((int) (10/BEAT_MS_PER_SAMPLE + 0.5))
-#define BEAT_MS20		((int) (20/BEAT_MS_PER_SAMPLE + 0.5))
-#define BEAT_MS40		((int) (40/BEAT_MS_PER_SAMPLE + 0.5))
-#define BEAT_MS50		((int) (50/BEAT_MS_PER_SAMPLE + 0.5))
-#define BEAT_MS60		((int) (60/BEAT_MS_PER_SAMPLE + 0.5))
-#define BEAT_MS70		((int) (70/BEAT_MS_PER_SAMPLE + 0.5))
-#define BEAT_MS80		((int) (80/BEAT_MS_PER_SAMPLE + 0.5))
-#define BEAT_MS90		((int) (90/BEAT_MS_PER_SAMPLE + 0.5))
-#define BEAT_MS100	((int) (100/BEAT_MS_PER_SAMPLE + 0.5))
-#define BEAT_MS110	((int) (110/BEAT_MS_PER_SAMPLE + 0.5))
-#define BEAT_MS130	((int) (130/BEAT_MS_PER_SAMPLE + 0.5))
-#define BEAT_MS140	((int) (140/BEAT_MS_PER_SAMPLE + 0.5))
-#define BEAT_MS150	((int) (150/BEAT_MS_PER_SAMPLE + 0.5))
-#define BEAT_MS250	((int) (250/BEAT_MS_PER_SAMPLE + 0.5))
-#define BEAT_MS280	((int) (280/BEAT_MS_PER_SAMPLE + 0.5))
-#define BEAT_MS300	((int) (300/BEAT_MS_PER_SAMPLE + 0.5))
-#define BEAT_MS350	((int) (350/BEAT_MS_PER_SAMPLE + 0.5))
-#define BEAT_MS400	((int) (400/BEAT_MS_PER_SAMPLE + 0.5))
+#include "osearate.h"
+#include "variant.h"	// For OseaBeat
+
+#define BEAT_SAMPLE_RATE	OSEA_BEAT_SAMPLE_RATE
+
+#define BEAT_MS10		OSEA_MS_TO_SAMPLES(10, BEAT_SAMPLE_RATE)
+#define BEAT_MS20		OSEA_MS_TO_SAMPLES(20, BEAT_SAMPLE_RATE)
+#define BEAT_MS40		OSEA_MS_TO_SAMPLES(40, BEAT_SAMPLE_RATE)
+#define BEAT_MS50		OSEA_MS_TO_SAMPLES(50, BEAT_SAMPLE_RATE)
+#define BEAT_MS60		OSEA_MS_TO_SAMPLES(60, BEAT_SAMPLE_RATE)
+#define BEAT_MS70		OSEA_MS_TO_SAMPLES(70, BEAT_SAMPLE_RATE)
+#define BEAT_MS80		OSEA_MS_TO_SAMPLES(80, BEAT_SAMPLE_RATE)
+#define BEAT_MS90		OSEA_MS_TO_SAMPLES(90, BEAT_SAMPLE_RATE)
+#define BEAT_MS100	OSEA_MS_TO_SAMPLES(100, BEAT_SAMPLE_RATE)
+#define BEAT_MS110	OSEA_MS_TO_SAMPLES(110, BEAT_SAMPLE_RATE)
+#define BEAT_MS130	OSEA_MS_TO_SAMPLES(130, BEAT_SAMPLE_RATE)
+#define BEAT_MS140	OSEA_MS_TO_SAMPLES(140, BEAT_SAMPLE_RATE)
+#define BEAT_MS150	OSEA_MS_TO_SAMPLES(150, BEAT_SAMPLE_RATE)
+#define BEAT_MS250	OSEA_MS_TO_SAMPLES(250, BEAT_SAMPLE_RATE)
+#define BEAT_MS280	OSEA_MS_TO_SAMPLES(280, BEAT_SAMPLE_RATE)
+#define BEAT_MS300	OSEA_MS_TO_SAMPLES(300, BEAT_SAMPLE_RATE)
+#define BEAT_MS350	OSEA_MS_TO_SAMPLES(350, BEAT_SAMPLE_RATE)
+#define BEAT_MS400	OSEA_MS_TO_SAMPLES(400, BEAT_SAMPLE_RATE)
 #define BEAT_MS1000	BEAT_SAMPLE_RATE
 
 #define BEATLGTH	BEAT_MS1000
 #define MAXTYPES 8
 #define FIDMARK BEAT_MS400
 
-void ResetBDAC(void);
-int BeatDetectAndClassify(int ecgSample, int *beatType, int *beatMatch);
+// The detector and classifier state, defined in osea.h.  Allocate one
+// context for each ECG stream and reset it with InitBDAC() before use.
+
+typedef struct _OseaContext OseaContext ;
+
+void InitBDAC(OseaContext *ctx);
+void ResetBDAC(OseaContext *ctx);
+int BeatDetectAndClassify(OseaContext *ctx, int ecgSample, int *beatType,
+	int *beatMatch);
+int BeatDetectAndClassifyBlock(OseaContext *ctx, const int *ecgSamples, int n,
+	OseaBeat *beats);
 
 #endif /* BDAC_H */
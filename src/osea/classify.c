@@ -66,6 +66,7 @@ MA 02143 USA).  For updates to this software, please visit our website
 #include "rythmchk.h"
 #include "analbeat.h"
 #include "postclas.h"
+#include "osea.h"
 
 // Detection Rule Parameters.
 
@@ -109,22 +110,18 @@ MA 02143 USA).  For updates to this software, please visit our website
 
 // Dominant monitor constants.
 
-#define DM_BUFFER_LENGTH	180
 #define IRREG_RR_LIMIT	60
 
 // Local prototypes.
 
 int HFNoiseCheck(int *beat) ;
-int TempClass(int rhythmClass, int morphType, int beatWidth, int domWidth,
-	int domType, int hfNoise, int noiseLevel, int blShift, double domIndex) ;
-int DomMonitor(int morphType, int rhythmClass, int beatWidth, int rr, int reset) ;
-int GetDomRhythm(void) ;
-int GetRunCount(void) ;
-
-// Local Global variables
-
-int DomType ;
-int RecentRRs[8], RecentTypes[8] ;
+int TempClass(OseaContext *ctx, int rhythmClass, int morphType, int beatWidth,
+	int domWidth, int domType, int hfNoise, int noiseLevel, int blShift,
+	double domIndex) ;
+int DomMonitor(OseaContext *ctx, int morphType, int rhythmClass, int beatWidth,
+	int rr, int reset) ;
+int GetDomRhythm(OseaContext *ctx) ;
+int GetRunCount(OseaContext *ctx) ;
 
 /***************************************************************************
 *  Classify() takes a beat buffer, the previous rr interval, and the present
@@ -132,43 +129,42 @@ int RecentRRs[8], RecentTypes[8] ;
 *  UNKNOWN.  The UNKNOWN classification is only returned.  The beat template
 *  type that the beat has been matched to is returned through the pointer
 *  *beatMatch for debugging display.  Passing anything other than 0 in init
-*  resets the static variables used by Classify.
+*  resets the variables used by Classify.
 ****************************************************************************/
 
-int Classify(int *newBeat,int rr, int noiseLevel, int *beatMatch, int *fidAdj,
-	int init)
+int Classify(OseaContext *ctx, int *newBeat,int rr, int noiseLevel,
+	int *beatMatch, int *fidAdj, int init)
 	{
+	OseaClassify *c = &ctx->classify ;
 	int rhythmClass, beatClass, i, beatWidth, blShift ;
-	static int morphType, runCount = 0 ;
 	double matchIndex, domIndex, mi2 ;
 	int shiftAdj ;
 	int domType, domWidth, onset, offset, amp ;
 	int beatBegin, beatEnd, tempClass ;
 	int hfNoise, isoLevel ;
-	static int lastIsoLevel=0, lastRhythmClass = UNKNOWN, lastBeatWasNew = 0 ;
 
 	// If initializing...
 
 	if(init)
 		{
-		ResetRhythmChk() ;
-		ResetMatch() ;
-		ResetPostClassify() ;
-		runCount = 0 ;
-		DomMonitor(0, 0, 0, 0, 1) ;
+		ResetRhythmChk(ctx) ;
+		ResetMatch(ctx) ;
+		ResetPostClassify(ctx) ;
+		c->runCount = 0 ;
+		DomMonitor(ctx, 0, 0, 0, 0, 1) ;
 		return(0) ;
 		}
 
 	hfNoise = HFNoiseCheck(newBeat) ;	// Check for muscle noise.
-	rhythmClass = RhythmChk(rr) ;			// Check the rhythm.
+	rhythmClass = RhythmChk(ctx, rr) ;			// Check the rhythm.
 
 	// Estimate beat features.
 
 	AnalyzeBeat(newBeat, &onset, &offset, &isoLevel,
 		&beatBegin, &beatEnd, &amp) ;
 
-	blShift = abs(lastIsoLevel-isoLevel) ;
-	lastIsoLevel = isoLevel ;
+	blShift = abs(c->lastIsoLevel-isoLevel) ;
+	c->lastIsoLevel = isoLevel ;
 
 	// Make isoelectric level 0.
 
@@ -181,16 +177,16 @@ int Classify(int *newBeat,int rr, int noiseLevel, int *beatMatch, int *fidAdj,
 	// from a baseline shift.
 
 	if( (blShift > BL_SHIFT_LIMIT)
-		&& (lastBeatWasNew == 1)
-		&& (lastRhythmClass == NORMAL)
+		&& (c->lastBeatWasNew == 1)
+		&& (c->lastRhythmClass == NORMAL)
 		&& (rhythmClass == NORMAL) )
-		ClearLastNewType() ;
+		ClearLastNewType(ctx) ;
 
-	lastBeatWasNew = 0 ;
+	c->lastBeatWasNew = 0 ;
 
 	// Find the template that best matches this beat.
 
-	BestMorphMatch(newBeat,&morphType,&matchIndex,&mi2,&shiftAdj) ;
+	BestMorphMatch(ctx, newBeat,&c->morphType,&matchIndex,&mi2,&shiftAdj) ;
 
 	// Disregard noise if the match is good. (New)
 
@@ -200,65 +196,65 @@ int Classify(int *newBeat,int rr, int noiseLevel, int *beatMatch, int *fidAdj,
 	// Apply a stricter match limit to premature beats.
 
 	if((matchIndex < MATCH_LIMIT) && (rhythmClass == PVC) &&
-		MinimumBeatVariation(morphType) && (mi2 > PVC_MATCH_WITH_AMP_LIMIT))
+		MinimumBeatVariation(ctx, c->morphType) && (mi2 > PVC_MATCH_WITH_AMP_LIMIT))
 		{
-		morphType = NewBeatType(newBeat) ;
-		lastBeatWasNew = 1 ;
+		c->morphType = NewBeatType(ctx, newBeat) ;
+		c->lastBeatWasNew = 1 ;
 		}
 
 	// Match if within standard match limits.
 
 	else if((matchIndex < MATCH_LIMIT) && (mi2 <= MATCH_WITH_AMP_LIMIT))
-		UpdateBeatType(morphType,newBeat,mi2,shiftAdj) ;
+		UpdateBeatType(ctx, c->morphType,newBeat,mi2,shiftAdj) ;
 
 	// If the beat isn't noisy but doesn't match, start a new beat.
 
 	else if((blShift < BL_SHIFT_LIMIT) && (noiseLevel < NEW_TYPE_NOISE_THRESHOLD)
 		&& (hfNoise < NEW_TYPE_HF_NOISE_LIMIT))
 		{
-		morphType = NewBeatType(newBeat) ;
-		lastBeatWasNew = 1 ;
+		c->morphType = NewBeatType(ctx, newBeat) ;
+		c->lastBeatWasNew = 1 ;
 		}
 
 	// Even if it is a noisy, start new beat if it was an irregular beat.
 
-	else if((lastRhythmClass != NORMAL) || (rhythmClass != NORMAL))
+	else if((c->lastRhythmClass != NORMAL) || (rhythmClass != NORMAL))
 		{
-		morphType = NewBeatType(newBeat) ;
-		lastBeatWasNew = 1 ;
+		c->morphType = NewBeatType(ctx, newBeat) ;
+		c->lastBeatWasNew = 1 ;
 		}
 
 	// If its noisy and regular, don't waste space starting a new beat.
 
-	else morphType = MAXTYPES ;
+	else c->morphType = MAXTYPES ;
 
 	// Update recent rr and type arrays.
 
 	for(i = 7; i > 0; --i)
 		{
-		RecentRRs[i] = RecentRRs[i-1] ;
-		RecentTypes[i] = RecentTypes[i-1] ;
+		c->RecentRRs[i] = c->RecentRRs[i-1] ;
+		c->RecentTypes[i] = c->RecentTypes[i-1] ;
 		}
-	RecentRRs[0] = rr ;
-	RecentTypes[0] = morphType ;
+	c->RecentRRs[0] = rr ;
+	c->RecentTypes[0] = c->morphType ;
 
-	lastRhythmClass = rhythmClass ;
-	lastIsoLevel = isoLevel ;
+	c->lastRhythmClass = rhythmClass ;
+	c->lastIsoLevel = isoLevel ;
 
 	// Fetch beat features needed for classification.
 	// Get features from average beat if it matched.
 
-	if(morphType != MAXTYPES)
+	if(c->morphType != MAXTYPES)
 		{
-		beatClass = GetBeatClass(morphType) ;
-		beatWidth = GetBeatWidth(morphType) ;
-		*fidAdj = GetBeatCenter(morphType)-FIDMARK ;
+		beatClass = GetBeatClass(ctx, c->morphType) ;
+		beatWidth = GetBeatWidth(ctx, c->morphType) ;
+		*fidAdj = GetBeatCenter(ctx, c->morphType)-FIDMARK ;
 
 		// If the width seems large and there have only been a few
 		// beats of this type, use the actual beat for width
 		// estimate.
 
-		if((beatWidth > offset-onset) && (GetBeatTypeCount(morphType) <= 4))
+		if((beatWidth > offset-onset) && (GetBeatTypeCount(ctx, c->morphType) <= 4))
 			{
 			beatWidth = offset-onset ;
 			*fidAdj = ((offset+onset)/2)-FIDMARK ;
@@ -277,69 +273,69 @@ int Classify(int *newBeat,int rr, int noiseLevel, int *beatMatch, int *fidAdj,
 
 	// Fetch dominant type beat features.
 
-	DomType = domType = DomMonitor(morphType, rhythmClass, beatWidth, rr, 0) ;
-	domWidth = GetBeatWidth(domType) ;
+	c->DomType = domType = DomMonitor(ctx, c->morphType, rhythmClass, beatWidth, rr, 0) ;
+	domWidth = GetBeatWidth(ctx, domType) ;
 
 	// Compare the beat type, or actual beat to the dominant beat.
 
-	if((morphType != domType) && (morphType != 8))
-		domIndex = DomCompare(morphType,domType) ;
-	else if(morphType == 8)
-		domIndex = DomCompare2(newBeat,domType) ;
+	if((c->morphType != domType) && (c->morphType != 8))
+		domIndex = DomCompare(ctx, c->morphType,domType) ;
+	else if(c->morphType == 8)
+		domIndex = DomCompare2(ctx, newBeat,domType) ;
 	else domIndex = matchIndex ;
 
 	// Update post classificaton of the previous beat.
 
-	PostClassify(RecentTypes, domType, RecentRRs, beatWidth, domIndex, rhythmClass) ;
+	PostClassify(ctx, c->RecentTypes, domType, c->RecentRRs, beatWidth, domIndex, rhythmClass) ;
 
 	// Classify regardless of how the morphology
 	// was previously classified.
 
-	tempClass = TempClass(rhythmClass, morphType, beatWidth, domWidth,
+	tempClass = TempClass(ctx, rhythmClass, c->morphType, beatWidth, domWidth,
 		domType, hfNoise, noiseLevel, blShift, domIndex) ;
 
 	// If this morphology has not been classified yet, attempt to classify
 	// it.
 
-	if((beatClass == UNKNOWN) && (morphType < MAXTYPES))
+	if((beatClass == UNKNOWN) && (c->morphType < MAXTYPES))
 		{
 
 		// Classify as normal if there are 6 in a row
 		// or at least two in a row that meet rhythm
 		// rules for normal.
 
-		runCount = GetRunCount() ;
+		c->runCount = GetRunCount(ctx) ;
 
 		// Classify a morphology as NORMAL if it is not too wide, and there
 		// are three in a row.  The width criterion prevents ventricular beats
 		// from being classified as normal during VTACH (MIT/BIH 205).
 
-		if((runCount >= 3) && (domType != -1) && (beatWidth < domWidth+BEAT_MS20))
-			SetBeatClass(morphType,NORMAL) ;
+		if((c->runCount >= 3) && (domType != -1) && (beatWidth < domWidth+BEAT_MS20))
+			SetBeatClass(ctx, c->morphType,NORMAL) ;
 
 		// If there is no dominant type established yet, classify any type
 		// with six in a row as NORMAL.
 
-		else if((runCount >= 6) && (domType == -1))
-			SetBeatClass(morphType,NORMAL) ;
+		else if((c->runCount >= 6) && (domType == -1))
+			SetBeatClass(ctx, c->morphType,NORMAL) ;
 
 		// During bigeminy, classify the premature beats as ventricular if
 		// they are not too narrow.
 
-		else if(IsBigeminy() == 1)
+		else if(IsBigeminy(ctx) == 1)
 			{
 			if((rhythmClass == PVC) && (beatWidth > BEAT_MS100))
-				SetBeatClass(morphType,PVC) ;
+				SetBeatClass(ctx, c->morphType,PVC) ;
 			else if(rhythmClass == NORMAL)
-				SetBeatClass(morphType,NORMAL) ;
+				SetBeatClass(ctx, c->morphType,NORMAL) ;
 			}
 		}
 
 	// Save morphology type of this beat for next classification.
 
-	*beatMatch = morphType ;
+	*beatMatch = c->morphType ;
 
-	beatClass = GetBeatClass(morphType) ;
+	beatClass = GetBeatClass(ctx, c->morphType) ;
    
 	// If the morphology has been previously classified.
 	// use that classification.
@@ -348,7 +344,7 @@ int Classify(int *newBeat,int rr, int noiseLevel, int *beatMatch, int *fidAdj,
 	if(beatClass != UNKNOWN)
 		return(beatClass) ;
 
-	if(CheckPostClass(morphType) == PVC)
+	if(CheckPostClass(ctx, c->morphType) == PVC)
 		return(PVC) ;
 
 	// Otherwise use the temporary classification.
@@ -406,7 +402,7 @@ int HFNoiseCheck(int *beat)
 *  to the features of the dominant beat and the present noise level.
 *************************************************************************/
 
-int TempClass(int rhythmClass, int morphType,
+int TempClass(OseaContext *ctx, int rhythmClass, int morphType,
 	int beatWidth, int domWidth, int domType,
 	int hfNoise, int noiseLevel, int blShift, double domIndex)
 	{
@@ -422,8 +418,8 @@ int TempClass(int rhythmClass, int morphType,
 	// and looks sufficiently different than the dominant beat
 	// classify as PVC.
 
-	if(MinimumBeatVariation(domType) && (rhythmClass == PVC)
-		&& (domIndex > R2_DI_THRESHOLD) && (GetDomRhythm() == 1))
+	if(MinimumBeatVariation(ctx, domType) && (rhythmClass == PVC)
+		&& (domIndex > R2_DI_THRESHOLD) && (GetDomRhythm(ctx) == 1))
 		return(PVC) ;
 
 	// Rule 3:  If the beat is sufficiently narrow, classify as normal.
@@ -443,7 +439,7 @@ int TempClass(int rhythmClass, int morphType,
 	// beat of this morphology has been seen, call it normal (probably
 	// noisy).
 
-	if((GetTypesCount() == MAXTYPES) && (GetBeatTypeCount(morphType)==1)
+	if((GetTypesCount(ctx) == MAXTYPES) && (GetBeatTypeCount(ctx, morphType)==1)
 			 && (rhythmClass == UNKNOWN))
 		return(NORMAL) ;
 
@@ -457,14 +453,14 @@ int TempClass(int rhythmClass, int morphType,
 	// type and its shape is close to the dominant shape, classify
 	// as normal.
 
-	if((domIndex < R8_DI_THRESHOLD) && (CheckPCRhythm(morphType) == NORMAL))
+	if((domIndex < R8_DI_THRESHOLD) && (CheckPCRhythm(ctx, morphType) == NORMAL))
 		return(NORMAL) ;
 
 	// Rule 9:  If the beat is not premature, it looks similar to the dominant
 	// beat type, and the dominant beat type is variable (noisy), classify as
 	// normal.
 
-	if((domIndex < R9_DI_THRESHOLD) && (rhythmClass != PVC) && WideBeatVariation(domType))
+	if((domIndex < R9_DI_THRESHOLD) && (rhythmClass != PVC) && WideBeatVariation(ctx, domType))
 		return(NORMAL) ;
 
 	// Rule 10:  If this beat is significantly different from the dominant beat
@@ -472,8 +468,8 @@ int TempClass(int rhythmClass, int morphType,
 	// of this type is PVC, and the dominant rhythm is regular, classify as PVC.
 
 	if((domIndex > R10_DI_THRESHOLD)
-		&& (GetBeatTypeCount(morphType) >= R10_BC_LIM) &&
-		(CheckPCRhythm(morphType) == PVC) && (GetDomRhythm() == 1))
+		&& (GetBeatTypeCount(ctx, morphType) >= R10_BC_LIM) &&
+		(CheckPCRhythm(ctx, morphType) == PVC) && (GetDomRhythm(ctx) == 1))
 		return(PVC) ;
 
 	// Rule 11: if the beat is wide, wider than the dominant beat, doesn't
@@ -484,20 +480,20 @@ int TempClass(int rhythmClass, int morphType,
 		(((beatWidth - domWidth >= R11_WIDTH_DIFF1) && (domWidth < R11_WIDTH_BREAK)) ||
 		(beatWidth - domWidth >= R11_WIDTH_DIFF2)) &&
 		(hfNoise < R11_HF_THRESHOLD) && (noiseLevel < R11_MA_THRESHOLD) && (blShift < BL_SHIFT_LIMIT) &&
-		(morphType < MAXTYPES) && (GetBeatTypeCount(morphType) > R11_BC_LIM))	// Rev 1.1
+		(morphType < MAXTYPES) && (GetBeatTypeCount(ctx, morphType) > R11_BC_LIM))	// Rev 1.1
 
 		return(PVC) ;
 
 	// Rule 12:  If the dominant rhythm is regular and this beat is premature
 	// then classify as PVC.
 
-	if((rhythmClass == PVC) && (GetDomRhythm() == 1))
+	if((rhythmClass == PVC) && (GetDomRhythm(ctx) == 1))
 		return(PVC) ;
 
 	// Rule 14:  If the beat is regular and the dominant rhythm is regular
 	// call the beat normal.
 
-	if((rhythmClass == NORMAL) && (GetDomRhythm() == 1))
+	if((rhythmClass == NORMAL) && (GetDomRhythm(ctx) == 1))
 		return(NORMAL) ;
 
 	// By this point, we know that rhythm will not help us, so we
@@ -556,24 +552,18 @@ int TempClass(int rhythmClass, int morphType,
 *  have been classified as regular.
 *******************************************************************************/
 
-#define DM_BUFFER_LENGTH	180
-
-int NewDom, DomRhythm ;
-int DMBeatTypes[DM_BUFFER_LENGTH], DMBeatClasses[DM_BUFFER_LENGTH] ;
-int DMBeatRhythms[DM_BUFFER_LENGTH] ;
-int DMNormCounts[8], DMBeatCounts[8], DMIrregCount = 0 ;
-
-int DomMonitor(int morphType, int rhythmClass, int beatWidth, int rr, int reset)
+int DomMonitor(OseaContext *ctx, int morphType, int rhythmClass, int beatWidth,
+	int rr, int reset)
 	{
-	static int brIndex = 0 ;
+	OseaClassify *c = &ctx->classify ;
 	int i, oldType, runCount, dom, max ;
 
 	// Fetch the type of the beat before the last beat.
 
-	i = brIndex - 2 ;
+	i = c->brIndex - 2 ;
 	if(i < 0)
 		i += DM_BUFFER_LENGTH ;
-	oldType = DMBeatTypes[i] ;
+	oldType = c->DMBeatTypes[i] ;
 
 	// If reset flag is set, reset beat type counts and
 	// beat information buffers.
@@ -582,28 +572,28 @@ int DomMonitor(int morphType, int rhythmClass, int beatWidth, int rr, int reset)
 		{
 		for(i = 0; i < DM_BUFFER_LENGTH; ++i)
 			{
-			DMBeatTypes[i] = -1 ;
-			DMBeatClasses[i] = 0 ;
+			c->DMBeatTypes[i] = -1 ;
+			c->DMBeatClasses[i] = 0 ;
 			}
 
 		for(i = 0; i < 8; ++i)
 			{
-			DMNormCounts[i] = 0 ;
-			DMBeatCounts[i] = 0 ;
+			c->DMNormCounts[i] = 0 ;
+			c->DMBeatCounts[i] = 0 ;
 			}
-		DMIrregCount = 0 ;
+		c->DMIrregCount = 0 ;
 		return(0) ;
 		}
 
 	// Once we have wrapped around, subtract old beat types from
 	// the beat counts.
 
-	if((DMBeatTypes[brIndex] != -1) && (DMBeatTypes[brIndex] != MAXTYPES))
+	if((c->DMBeatTypes[c->brIndex] != -1) && (c->DMBeatTypes[c->brIndex] != MAXTYPES))
 		{
-		--DMBeatCounts[DMBeatTypes[brIndex]] ;
-		DMNormCounts[DMBeatTypes[brIndex]] -= DMBeatClasses[brIndex] ;
-		if(DMBeatRhythms[brIndex] == UNKNOWN)
-			--DMIrregCount ;
+		--c->DMBeatCounts[c->DMBeatTypes[c->brIndex]] ;
+		c->DMNormCounts[c->DMBeatTypes[c->brIndex]] -= c->DMBeatClasses[c->brIndex] ;
+		if(c->DMBeatRhythms[c->brIndex] == UNKNOWN)
+			--c->DMIrregCount ;
 		}
 
 	// If this is a morphology that has been detected before, decide
@@ -616,22 +606,22 @@ int DomMonitor(int morphType, int rhythmClass, int beatWidth, int rr, int reset)
 		// Update the buffers of previous beats and increment the
 		// count for this beat type.
 
-		DMBeatTypes[brIndex] = morphType ;
-		++DMBeatCounts[morphType] ;
-		DMBeatRhythms[brIndex] = rhythmClass ;
+		c->DMBeatTypes[c->brIndex] = morphType ;
+		++c->DMBeatCounts[morphType] ;
+		c->DMBeatRhythms[c->brIndex] = rhythmClass ;
 
 		// If the rhythm appears regular, update the regular rhythm
 		// count.
 
 		if(rhythmClass == UNKNOWN)
-			++DMIrregCount ;
+			++c->DMIrregCount ;
 
 		// Check to see how many beats of this type have occurred in
 		// a row (stop counting at six).
 
-		i = brIndex - 1 ;
+		i = c->brIndex - 1 ;
 		if(i < 0) i += DM_BUFFER_LENGTH ;
-		for(runCount = 0; (DMBeatTypes[i] == morphType) && (runCount < 6); ++runCount)
+		for(runCount = 0; (c->DMBeatTypes[i] == morphType) && (runCount < 6); ++runCount)
 			if(--i < 0) i += DM_BUFFER_LENGTH ;
 
 		// If the rhythm is regular, the beat width is less than 130 ms, and
@@ -640,24 +630,24 @@ int DomMonitor(int morphType, int rhythmClass, int beatWidth, int rr, int reset)
 
 		if((rhythmClass == NORMAL) && (beatWidth < BEAT_MS130) && (runCount >= 1))
 			{
-			DMBeatClasses[brIndex] = 1 ;
-			++DMNormCounts[morphType] ;
+			c->DMBeatClasses[c->brIndex] = 1 ;
+			++c->DMNormCounts[morphType] ;
 			}
 
 		// If the last beat was within the normal P-R interval for this beat,
 		// and the one before that was this beat type, assume the last beat
 		// was noise and this beat is normal.
 
-		else if(rr < ((FIDMARK-GetBeatBegin(morphType))*SAMPLE_RATE/BEAT_SAMPLE_RATE)
+		else if(rr < ((FIDMARK-GetBeatBegin(ctx, morphType))*SAMPLE_RATE/BEAT_SAMPLE_RATE)
 			&& (oldType == morphType))
 			{
-			DMBeatClasses[brIndex] = 1 ;
-			++DMNormCounts[morphType] ;
+			c->DMBeatClasses[c->brIndex] = 1 ;
+			++c->DMNormCounts[morphType] ;
 			}
 
 		// Otherwise assume that this is not a normal beat.
 
-		else DMBeatClasses[brIndex] = 0 ;
+		else c->DMBeatClasses[c->brIndex] = 0 ;
 		}
 
 	// If the beat does not match any of the beat types, store
@@ -665,106 +655,108 @@ int DomMonitor(int morphType, int rhythmClass, int beatWidth, int rr, int reset)
 
 	else
 		{
-		DMBeatClasses[brIndex] = 0 ;
-		DMBeatTypes[brIndex] = -1 ;
+		c->DMBeatClasses[c->brIndex] = 0 ;
+		c->DMBeatTypes[c->brIndex] = -1 ;
 		}
 
 	// Increment the index to the beginning of the circular buffers.
 
-	if(++brIndex == DM_BUFFER_LENGTH)
-		brIndex = 0 ;
+	if(++c->brIndex == DM_BUFFER_LENGTH)
+		c->brIndex = 0 ;
 
 	// Determine which beat type has the most beats that seem
 	// normal.
 
 	dom = 0 ;
 	for(i = 1; i < 8; ++i)
-		if(DMNormCounts[i] > DMNormCounts[dom])
+		if(c->DMNormCounts[i] > c->DMNormCounts[dom])
 			dom = i ;
 
 	max = 0 ;
 	for(i = 1; i < 8; ++i)
-		if(DMBeatCounts[i] > DMBeatCounts[max])
+		if(c->DMBeatCounts[i] > c->DMBeatCounts[max])
 			max = i ;
 
 	// If there are no normal looking beats, fall back on which beat
 	// has occurred most frequently since classification began.
 
-	if((DMNormCounts[dom] == 0) || (DMBeatCounts[max]/DMBeatCounts[dom] >= 2))			// == 0
-		dom = GetDominantType() ;
+	if((c->DMNormCounts[dom] == 0) || (c->DMBeatCounts[max]/c->DMBeatCounts[dom] >= 2))			// == 0
+		dom = GetDominantType(ctx) ;
 
 	// If at least half of the most frequently occuring normal
 	// type do not seem normal, fall back on choosing the most frequently
 	// occurring type since classification began.
 
-	else if(DMBeatCounts[dom]/DMNormCounts[dom] >= 2)
-		dom = GetDominantType() ;
+	else if(c->DMBeatCounts[dom]/c->DMNormCounts[dom] >= 2)
+		dom = GetDominantType(ctx) ;
 
 	// If there is any beat type that has been classfied as normal,
 	// but at least 10 don't seem normal, reclassify it to UNKNOWN.
 
 	for(i = 0; i < 8; ++i)
-		if((DMBeatCounts[i] > 10) && (DMNormCounts[i] == 0) && (i != dom)
-			&& (GetBeatClass(i) == NORMAL))
-			SetBeatClass(i,UNKNOWN) ;
+		if((c->DMBeatCounts[i] > 10) && (c->DMNormCounts[i] == 0) && (i != dom)
+			&& (GetBeatClass(ctx, i) == NORMAL))
+			SetBeatClass(ctx, i,UNKNOWN) ;
 
-	// Save the dominant type in a global variable so that it is
+	// Save the dominant type in the context so that it is
 	// accessable for debugging.
 
-	NewDom = dom ;
+	c->NewDom = dom ;
 	return(dom) ;
 	}
 
-int GetNewDominantType(void)
+int GetNewDominantType(OseaContext *ctx)
 	{
-	return(NewDom) ;
+	return(ctx->classify.NewDom) ;
 	}
 
-int GetDomRhythm(void)
+int GetDomRhythm(OseaContext *ctx)
 	{
-	if(DMIrregCount > IRREG_RR_LIMIT)
+	if(ctx->classify.DMIrregCount > IRREG_RR_LIMIT)
 		return(0) ;
 	else return(1) ;
 	}
 
 
-void AdjustDomData(int oldType, int newType)
+void AdjustDomData(OseaContext *ctx, int oldType, int newType)
 	{
+	OseaClassify *c = &ctx->classify ;
 	int i ;
 
 	for(i = 0; i < DM_BUFFER_LENGTH; ++i)
 		{
-		if(DMBeatTypes[i] == oldType)
-			DMBeatTypes[i] = newType ;
+		if(c->DMBeatTypes[i] == oldType)
+			c->DMBeatTypes[i] = newType ;
 		}
 
 	if(newType != MAXTYPES)
 		{
-		DMNormCounts[newType] = DMNormCounts[oldType] ;
-		DMBeatCounts[newType] = DMBeatCounts[oldType] ;
+		c->DMNormCounts[newType] = c->DMNormCounts[oldType] ;
+		c->DMBeatCounts[newType] = c->DMBeatCounts[oldType] ;
 		}
 
-	DMNormCounts[oldType] = DMBeatCounts[oldType] = 0 ;
+	c->DMNormCounts[oldType] = c->DMBeatCounts[oldType] = 0 ;
 
 	}
 
-void CombineDomData(int oldType, int newType)
+void CombineDomData(OseaContext *ctx, int oldType, int newType)
 	{
+	OseaClassify *c = &ctx->classify ;
 	int i ;
 
 	for(i = 0; i < DM_BUFFER_LENGTH; ++i)
 		{
-		if(DMBeatTypes[i] == oldType)
-			DMBeatTypes[i] = newType ;
+		if(c->DMBeatTypes[i] == oldType)
+			c->DMBeatTypes[i] = newType ;
 		}
 
 	if(newType != MAXTYPES)
 		{
-		DMNormCounts[newType] += DMNormCounts[oldType] ;
-		DMBeatCounts[newType] += DMBeatCounts[oldType] ;
+		c->DMNormCounts[newType] += c->DMNormCounts[oldType] ;
+		c->DMBeatCounts[newType] += c->DMBeatCounts[oldType] ;
 		}
 
-	DMNormCounts[oldType] = DMBeatCounts[oldType] = 0 ;
+	c->DMNormCounts[oldType] = c->DMBeatCounts[oldType] = 0 ;
 
 	}
 
@@ -773,10 +765,11 @@ void CombineDomData(int oldType, int newType)
 	in a row.
 ***********************************************************************/
 
-GetRunCount()
+GetRunCount(OseaContext *ctx)
 	{
+	OseaClassify *c = &ctx->classify ;
 	int i ;
-	for(i = 1; (i < 8) && (RecentTypes[0] == RecentTypes[i]); ++i) ;
+	for(i = 1; (i < 8) && (c->RecentTypes[0] == c->RecentTypes[i]); ++i) ;
 	return(i) ;
 	}
 
@@ -73,12 +73,27 @@ some level of encapsulation:
 	GetBeatBegin -- Returns the beginning point for a given beat type.
 	GetBeatEnd -- Returns the ending point for a given beat type.
 
+The sums of differences that CompareBeats and CompareBeats2 calculate for
+each shift are computed with SSE2 or NEON instructions when they are
+available (unless OSEA_NO_SIMD is defined), with the same results as the
+plain C loops.
+
 ******************************************************************************/
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
 #include "ecgcodes.h"
 
+#if !defined(OSEA_NO_SIMD) && defined(__SSE2__)
+#define MATCH_SSE2
+#include <emmintrin.h>
+#elif !defined(OSEA_NO_SIMD) && defined(__ARM_NEON__)
+#define MATCH_NEON
+#include <arm_neon.h>
+#endif
+
 #include "bdac.h"
+#include "osea.h"
 #define MATCH_LENGTH	BEAT_MS300	// Number of points used for beat matching.
 #define MATCH_LIMIT	1.2			// Match limit used testing whether two
 											// beat types might be combined.
@@ -89,6 +104,10 @@ some level of encapsulation:
 #define MATCH_END	(FIDMARK+(MATCH_LENGTH/2))		// End point for beat matching.
 #define MAXPREV	8	// Number of preceeding beats used as beat features.
 #define MAX_SHIFT	BEAT_MS40
+#define MATCH_SPAN	64	// At least MATCH_END-MATCH_START + 2*MAX_SHIFT+1,
+										// the points that shifted matching uses.
+#define SHIFT_COUNT	16	// At least 2*MAX_SHIFT+2, the number of shifts
+										// rounded up to an even number.
 
 // Local prototypes.
 
@@ -96,52 +115,37 @@ int NoiseCheck(int *beat) ;
 double CompareBeats(int *beat1, int *beat2, int *shiftAdj) ;
 double CompareBeats2(int *beat1, int *beat2, int *shiftAdj) ;
 void UpdateBeat(int *aveBeat, int *newBeat, int shift) ;
-void BeatCopy(int srcBeat, int destBeat) ;
-int MinimumBeatVariation(int type) ;
+void BeatCopy(OseaContext *ctx, int srcBeat, int destBeat) ;
+int MinimumBeatVariation(OseaContext *ctx, int type) ;
+static long SumDiff(const int *x, const int *y, int n) ;
+static long SumAbsDiff(const int *x, const int *y, long offset, int n) ;
+static long SumAbsDiffScaled(const int *x, const double *y, long offset, int n) ;
+static void SumDiffsScaled(const int *x, const double *y, int n, int shifts,
+	long *sums) ;
 
 // External prototypes.
 
 void AnalyzeBeat(int *beat, int *onset, int *offset, int *isoLevel,
 	int *beatBegin, int *beatEnd, int *amp) ;
-void AdjustDomData(int oldType, int newType) ;
-void CombineDomData(int oldType, int newType) ;
-
-// Global variables.
-
-int BeatTemplates[MAXTYPES][BEATLGTH] ;
-int BeatCounts[MAXTYPES] ;
-int BeatWidths[MAXTYPES] ;
-int BeatClassifications[MAXTYPES] ;
-int BeatBegins[MAXTYPES] ;
-int BeatEnds[MAXTYPES] ;
-int BeatsSinceLastMatch[MAXTYPES] ;
-int BeatAmps[MAXTYPES] ;
-int BeatCenters[MAXTYPES] ;
-double MIs[MAXTYPES][8] ;
-
-// Need access to these in postclas.cpp when beat types are combined
-// and moved.
-
-extern int PostClass[MAXTYPES][8] ;
-extern int PCRhythm[MAXTYPES][8] ;
-
-int TypeCount = 0 ;
+void AdjustDomData(OseaContext *ctx, int oldType, int newType) ;
+void CombineDomData(OseaContext *ctx, int oldType, int newType) ;
 
 /***************************************************************************
-ResetMatch() resets static variables involved with template matching.
+ResetMatch() resets the variables involved with template matching.
 ****************************************************************************/
 
-void ResetMatch(void)
+void ResetMatch(OseaContext *ctx)
 	{
+	OseaMatch *m = &ctx->match ;
 	int i, j ;
-	TypeCount = 0 ;
+	m->TypeCount = 0 ;
 	for(i = 0; i < MAXTYPES; ++i)
 		{
-		BeatCounts[i] = 0 ;
-		BeatClassifications[i] = UNKNOWN ;
+		m->BeatCounts[i] = 0 ;
+		m->BeatClassifications[i] = UNKNOWN ;
 		for(j = 0; j < 8; ++j)
 			{
-			MIs[i][j] = 0 ;
+			m->MIs[i][j] = 0 ;
 			}
 		}
 	}
@@ -152,6 +156,12 @@ void ResetMatch(void)
 	possible match.  The metric returned is the sum of the absolute
 	differences between beats divided by the amplitude of the beats.  The
 	shift used for the match is returned via the pointer *shiftAdj.
+
+	The scaled points of beat2 are calculated once into scaled[], instead
+	of twice for every shift.  The mean difference truncates at each point,
+	so it must be summed in order, but the sums for all the shifts are
+	independent and are calculated side by side by SumDiffsScaled().  The
+	absolute differences are summed by SumAbsDiffScaled().
 ***************************************************************************/
 
 #define MATCH_START	(FIDMARK-(MATCH_LENGTH/2))
@@ -162,6 +172,8 @@ double CompareBeats(int *beat1, int *beat2, int *shiftAdj)
 	int i, max, min, magSum, shift ;
 	long beatDiff, meanDiff, minDiff, minShift ;
 	double metric, scaleFactor, tempD ;
+	double scaled[MATCH_SPAN] ;
+	long meanDiffs[SHIFT_COUNT] ;
 
 	// Calculate the magnitude of each beat.
 
@@ -187,27 +199,32 @@ double CompareBeats(int *beat1, int *beat2, int *shiftAdj)
 	scaleFactor /= max-min ;
 	magSum *= 2 ;
 
+	// Scale the points of beat2 used by all the shifts.
+	// scaled[0] is beat2[MATCH_START-MAX_SHIFT] scaled.
+
+	for(i = 0; i < MATCH_END-MATCH_START + 2*MAX_SHIFT; ++i)
+		{
+		tempD = beat2[MATCH_START-MAX_SHIFT+i] ;
+		tempD *= scaleFactor ;
+		scaled[i] = tempD ;
+		}
+	scaled[i] = 0 ;	// Read when the shifts are summed in pairs.
+
+	// Calculate the mean differences for all shifts.
+	// meanDiffs[0] is for shift -MAX_SHIFT.
+
+	SumDiffsScaled(&beat1[MATCH_START],scaled,MATCH_END-MATCH_START,
+		2*MAX_SHIFT+1,meanDiffs) ;
+
 	// Calculate the sum of the point-by-point
 	// absolute differences for five possible shifts.
 
 	for(shift = -MAX_SHIFT; shift <= MAX_SHIFT; ++shift)
 		{
-		for(i = FIDMARK-(MATCH_LENGTH>>1), meanDiff = 0;
-			i < FIDMARK + (MATCH_LENGTH>>1); ++i)
-			{
-			tempD = beat2[i+shift] ;
-			tempD *= scaleFactor ;
-			meanDiff += beat1[i]- tempD ; // beat2[i+shift] ;
-			}
-		meanDiff /= MATCH_LENGTH ;
+		meanDiff = meanDiffs[MAX_SHIFT+shift] / MATCH_LENGTH ;
 
-		for(i = FIDMARK-(MATCH_LENGTH>>1), beatDiff = 0;
-			i < FIDMARK + (MATCH_LENGTH>>1); ++i)
-			{
-			tempD = beat2[i+shift] ;
-			tempD *= scaleFactor ;
-			beatDiff += abs(beat1[i] - meanDiff- tempD) ; // beat2[i+shift]  ) ;
-			}
+		beatDiff = SumAbsDiffScaled(&beat1[MATCH_START],
+			&scaled[MAX_SHIFT+shift],meanDiff,MATCH_END-MATCH_START) ;
 
 
 		if(shift == -MAX_SHIFT)
@@ -275,14 +292,12 @@ double CompareBeats2(int *beat1, int *beat2, int *shiftAdj)
 
 	for(shift = -MAX_SHIFT; shift <= MAX_SHIFT; ++shift)
 		{
-		for(i = FIDMARK-(MATCH_LENGTH>>1), meanDiff = 0;
-			i < FIDMARK + (MATCH_LENGTH>>1); ++i)
-			meanDiff += beat1[i]- beat2[i+shift] ;
+		meanDiff = SumDiff(&beat1[MATCH_START],&beat2[MATCH_START+shift],
+			MATCH_END-MATCH_START) ;
 		meanDiff /= MATCH_LENGTH ;
 
-		for(i = FIDMARK-(MATCH_LENGTH>>1), beatDiff = 0;
-			i < FIDMARK + (MATCH_LENGTH>>1); ++i)
-			beatDiff += abs(beat1[i] - meanDiff- beat2[i+shift]) ; ;
+		beatDiff = SumAbsDiff(&beat1[MATCH_START],&beat2[MATCH_START+shift],
+			meanDiff,MATCH_END-MATCH_START) ;
 
 		if(shift == -MAX_SHIFT)
 			{
@@ -310,6 +325,170 @@ double CompareBeats2(int *beat1, int *beat2, int *shiftAdj)
 	return(metric) ;
 	}
 
+/***************************************************************************
+	SumDiff() returns the sum of x[i] - y[i], SumAbsDiff() the sum of
+	abs(x[i] - offset - y[i]) and SumAbsDiffScaled() the sum of
+	abs(x[i] - offset - y[i]) for a scaled y, for i from 0 to n-1.  The
+	results are the same as those of the plain C loops at the end of each
+	function: the differences wrap around and are truncated to int the
+	same way, and the sums are kept in 64 bits.  Templates are aligned and
+	padded (see osea.h), but x and y are shifted, so unaligned loads are used.
+****************************************************************************/
+
+static long SumDiff(const int *x, const int *y, int n)
+	{
+	int i = 0 ;
+	long sum = 0 ;
+#if defined(MATCH_SSE2)
+	__m128i d, sign, acc = _mm_setzero_si128() ;
+	long long lanes[2] ;
+
+	for(; i+4 <= n; i += 4)
+		{
+		d = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)&x[i]),
+			_mm_loadu_si128((const __m128i *)&y[i])) ;
+		sign = _mm_srai_epi32(d,31) ;
+		acc = _mm_add_epi64(acc,_mm_unpacklo_epi32(d,sign)) ;
+		acc = _mm_add_epi64(acc,_mm_unpackhi_epi32(d,sign)) ;
+		}
+	_mm_storeu_si128((__m128i *)lanes,acc) ;
+	sum = lanes[0] + lanes[1] ;
+#elif defined(MATCH_NEON)
+	int64x2_t acc = vdupq_n_s64(0) ;
+
+	for(; i+4 <= n; i += 4)
+		acc = vpadalq_s32(acc,vsubq_s32(vld1q_s32(&x[i]),vld1q_s32(&y[i]))) ;
+	sum = vgetq_lane_s64(acc,0) + vgetq_lane_s64(acc,1) ;
+#endif
+	for(; i < n; ++i)
+		sum += x[i] - y[i] ;
+	return(sum) ;
+	}
+
+static long SumAbsDiff(const int *x, const int *y, long offset, int n)
+	{
+	int i = 0 ;
+	long sum = 0 ;
+#if defined(MATCH_SSE2)
+	__m128i d, sign, acc = _mm_setzero_si128() ;
+	__m128i off = _mm_set1_epi32((int) offset) ;
+	long long lanes[2] ;
+
+	for(; i+4 <= n; i += 4)
+		{
+		d = _mm_sub_epi32(_mm_sub_epi32(
+			_mm_loadu_si128((const __m128i *)&x[i]),off),
+			_mm_loadu_si128((const __m128i *)&y[i])) ;
+		sign = _mm_srai_epi32(d,31) ;
+		d = _mm_sub_epi32(_mm_xor_si128(d,sign),sign) ;	// abs(d)
+		sign = _mm_srai_epi32(d,31) ;
+		acc = _mm_add_epi64(acc,_mm_unpacklo_epi32(d,sign)) ;
+		acc = _mm_add_epi64(acc,_mm_unpackhi_epi32(d,sign)) ;
+		}
+	_mm_storeu_si128((__m128i *)lanes,acc) ;
+	sum = lanes[0] + lanes[1] ;
+#elif defined(MATCH_NEON)
+	int64x2_t acc = vdupq_n_s64(0) ;
+	int32x4_t off = vdupq_n_s32((int) offset) ;
+
+	for(; i+4 <= n; i += 4)
+		acc = vpadalq_s32(acc,vabsq_s32(vsubq_s32(vsubq_s32(vld1q_s32(&x[i]),
+			off),vld1q_s32(&y[i])))) ;
+	sum = vgetq_lane_s64(acc,0) + vgetq_lane_s64(acc,1) ;
+#endif
+	for(; i < n; ++i)
+		sum += abs(x[i] - offset - y[i]) ;
+	return(sum) ;
+	}
+
+static long SumAbsDiffScaled(const int *x, const double *y, long offset, int n)
+	{
+	int i = 0 ;
+	long sum = 0 ;
+#if defined(MATCH_SSE2)
+	__m128i d, sign, acc = _mm_setzero_si128() ;
+	__m128d off = _mm_set1_pd((double) offset) ;
+	long long lanes[2] ;
+
+	// NEON has no double precision arithmetic, so only SSE2 is used here.
+
+	for(; i+4 <= n; i += 4)
+		{
+		d = _mm_unpacklo_epi64(
+			_mm_cvttpd_epi32(_mm_sub_pd(_mm_sub_pd(_mm_cvtepi32_pd(
+				_mm_loadl_epi64((const __m128i *)&x[i])),off),
+				_mm_loadu_pd(&y[i]))),
+			_mm_cvttpd_epi32(_mm_sub_pd(_mm_sub_pd(_mm_cvtepi32_pd(
+				_mm_loadl_epi64((const __m128i *)&x[i+2])),off),
+				_mm_loadu_pd(&y[i+2])))) ;
+		sign = _mm_srai_epi32(d,31) ;
+		d = _mm_sub_epi32(_mm_xor_si128(d,sign),sign) ;	// abs(d)
+		sign = _mm_srai_epi32(d,31) ;
+		acc = _mm_add_epi64(acc,_mm_unpacklo_epi32(d,sign)) ;
+		acc = _mm_add_epi64(acc,_mm_unpackhi_epi32(d,sign)) ;
+		}
+	_mm_storeu_si128((__m128i *)lanes,acc) ;
+	sum = lanes[0] + lanes[1] ;
+#endif
+	for(; i < n; ++i)
+		sum += abs(x[i] - offset - y[i]) ;
+	return(sum) ;
+	}
+
+/***************************************************************************
+	SumDiffsScaled() sums x[i] - y[i+k] into sums[k], for i from 0 to n-1
+	and k from 0 to shifts-1, the same way as the plain C loops at the end:
+	the sum is truncated to an integer after each point.  With SSE2, two
+	sums are kept in a register and truncated with conversions to 32 bit
+	integers, which gives the same results as long as the sums stay well
+	within 32 bits.  That is checked first.  sums must have room for an
+	even number of sums, and y for one point more than the last shift uses.
+****************************************************************************/
+
+static void SumDiffsScaled(const int *x, const double *y, int n, int shifts,
+	long *sums)
+	{
+	int i, k ;
+#if defined(MATCH_SSE2)
+	__m128d xi, acc[SHIFT_COUNT/2] ;
+	double maxX = 0, maxY = 0 ;
+	int pairs = (shifts+1)/2 ;
+
+	// Every partial sum is at most n times the largest difference.
+
+	for(i = 0; i < n; ++i)
+		if(fabs(x[i]) > maxX)
+			maxX = fabs(x[i]) ;
+	for(i = 0; i < n+shifts-1; ++i)
+		if(fabs(y[i]) > maxY)
+			maxY = fabs(y[i]) ;
+
+	if(n*(maxX+maxY) < 1e9)
+		{
+		for(k = 0; k < pairs; ++k)
+			acc[k] = _mm_setzero_pd() ;
+		for(i = 0; i < n; ++i)
+			{
+			xi = _mm_set1_pd(x[i]) ;
+			for(k = 0; k < pairs; ++k)
+				acc[k] = _mm_cvtepi32_pd(_mm_cvttpd_epi32(_mm_add_pd(acc[k],
+					_mm_sub_pd(xi,_mm_loadu_pd(&y[i+2*k]))))) ;
+			}
+		for(k = 0; k < pairs; ++k)
+			{
+			sums[2*k] = _mm_cvtsd_si32(acc[k]) ;
+			sums[2*k+1] = _mm_cvtsd_si32(_mm_unpackhi_pd(acc[k],acc[k])) ;
+			}
+		return ;
+		}
+#endif
+	for(k = 0; k < shifts; ++k)
+		sums[k] = 0 ;
+	for(i = 0; i < n; ++i)
+		for(k = 0; k < shifts; ++k)
+			sums[k] += x[i] - y[i+k] ;
+	}
+
 /************************************************************************
 UpdateBeat() averages a new beat into an average beat template by adding
 1/8th of the new beat to 7/8ths of the average beat.
@@ -338,9 +517,9 @@ void UpdateBeat(int *aveBeat, int *newBeat, int shift)
 	been detected.
 *******************************************************/
 
-int GetTypesCount(void)
+int GetTypesCount(OseaContext *ctx)
 	{
-	return(TypeCount) ;
+	return(ctx->match.TypeCount) ;
 	}
 
 /********************************************************
@@ -348,18 +527,18 @@ int GetTypesCount(void)
 	a particular type have been detected.
 ********************************************************/
 
-int GetBeatTypeCount(int type)
+int GetBeatTypeCount(OseaContext *ctx, int type)
 	{
-	return(BeatCounts[type]) ;
+	return(ctx->match.BeatCounts[type]) ;
 	}
 
 /*******************************************************
 	GetBeatWidth returns the QRS width estimate for
 	a given type of beat.
 *******************************************************/
-int GetBeatWidth(int type)
+int GetBeatWidth(OseaContext *ctx, int type)
 	{
-	return(BeatWidths[type]) ;
+	return(ctx->match.BeatWidths[type]) ;
 	}
 
 /*******************************************************
@@ -367,9 +546,9 @@ int GetBeatWidth(int type)
 	offset of a beat.
 ********************************************************/
 
-int GetBeatCenter(int type)
+int GetBeatCenter(OseaContext *ctx, int type)
 	{
-	return(BeatCenters[type]) ;
+	return(ctx->match.BeatCenters[type]) ;
 	}
 
 /*******************************************************
@@ -377,11 +556,11 @@ int GetBeatCenter(int type)
 	a given beat type (NORMAL, PVC, or UNKNOWN).
 ********************************************************/
 
-int GetBeatClass(int type)
+int GetBeatClass(OseaContext *ctx, int type)
 	{
 	if(type == MAXTYPES)
 		return(UNKNOWN) ;
-	return(BeatClassifications[type]) ;
+	return(ctx->match.BeatClassifications[type]) ;
 	}
 
 /******************************************************
@@ -389,9 +568,9 @@ int GetBeatClass(int type)
 	given type.
 ******************************************************/
 
-void SetBeatClass(int type, int beatClass)
+void SetBeatClass(OseaContext *ctx, int type, int beatClass)
 	{
-	BeatClassifications[type] = beatClass ;
+	ctx->match.BeatClassifications[type] = beatClass ;
 	}
 
 /******************************************************************************
@@ -399,35 +578,36 @@ void SetBeatClass(int type, int beatClass)
 	features as the next available beat type.
 ******************************************************************************/
 
-int NewBeatType(int *newBeat )
+int NewBeatType(OseaContext *ctx, int *newBeat )
 	{
+	OseaMatch *m = &ctx->match ;
 	int i, onset, offset, isoLevel, beatBegin, beatEnd ;
 	int mcType, amp ;
 
 	// Update count of beats since each template was matched.
 
-	for(i = 0; i < TypeCount; ++i)
-		++BeatsSinceLastMatch[i] ;
+	for(i = 0; i < m->TypeCount; ++i)
+		++m->BeatsSinceLastMatch[i] ;
 
-	if(TypeCount < MAXTYPES)
+	if(m->TypeCount < MAXTYPES)
 		{
 		for(i = 0; i < BEATLGTH; ++i)
-			BeatTemplates[TypeCount][i] = newBeat[i] ;
+			m->BeatTemplates[m->TypeCount][i] = newBeat[i] ;
 
-		BeatCounts[TypeCount] = 1 ;
-		BeatClassifications[TypeCount] = UNKNOWN ;
-		AnalyzeBeat(&BeatTemplates[TypeCount][0],&onset,&offset, &isoLevel,
+		m->BeatCounts[m->TypeCount] = 1 ;
+		m->BeatClassifications[m->TypeCount] = UNKNOWN ;
+		AnalyzeBeat(&m->BeatTemplates[m->TypeCount][0],&onset,&offset, &isoLevel,
 			&beatBegin, &beatEnd, &amp) ;
-		BeatWidths[TypeCount] = offset-onset ;
-		BeatCenters[TypeCount] = (offset+onset)/2 ;
-		BeatBegins[TypeCount] = beatBegin ;
-		BeatEnds[TypeCount] = beatEnd ;
-		BeatAmps[TypeCount] = amp ;
+		m->BeatWidths[m->TypeCount] = offset-onset ;
+		m->BeatCenters[m->TypeCount] = (offset+onset)/2 ;
+		m->BeatBegins[m->TypeCount] = beatBegin ;
+		m->BeatEnds[m->TypeCount] = beatEnd ;
+		m->BeatAmps[m->TypeCount] = amp ;
 
-		BeatsSinceLastMatch[TypeCount] = 0 ;
+		m->BeatsSinceLastMatch[m->TypeCount] = 0 ;
 
-		++TypeCount ;
-		return(TypeCount-1) ;
+		++m->TypeCount ;
+		return(m->TypeCount-1) ;
 		}
 
 	// If we have used all the template space, replace the beat
@@ -444,34 +624,34 @@ int NewBeatType(int *newBeat )
 			{
 			mcType = 0 ;
 			for(i = 1; i < MAXTYPES; ++i)
-				if(BeatCounts[i] < BeatCounts[mcType])
+				if(m->BeatCounts[i] < m->BeatCounts[mcType])
 					mcType = i ;
-				else if(BeatCounts[i] == BeatCounts[mcType])
+				else if(m->BeatCounts[i] == m->BeatCounts[mcType])
 					{
-					if(BeatsSinceLastMatch[i] > BeatsSinceLastMatch[mcType])
+					if(m->BeatsSinceLastMatch[i] > m->BeatsSinceLastMatch[mcType])
 						mcType = i ;
 					}
 			}
 
 		// Adjust dominant beat monitor data.
 
-		AdjustDomData(mcType,MAXTYPES) ;
+		AdjustDomData(ctx,mcType,MAXTYPES) ;
 
 		// Substitute this beat.
 
 		for(i = 0; i < BEATLGTH; ++i)
-			BeatTemplates[mcType][i] = newBeat[i] ;
+			m->BeatTemplates[mcType][i] = newBeat[i] ;
 
-		BeatCounts[mcType] = 1 ;
-		BeatClassifications[mcType] = UNKNOWN ;
-		AnalyzeBeat(&BeatTemplates[mcType][0],&onset,&offset, &isoLevel,
+		m->BeatCounts[mcType] = 1 ;
+		m->BeatClassifications[mcType] = UNKNOWN ;
+		AnalyzeBeat(&m->BeatTemplates[mcType][0],&onset,&offset, &isoLevel,
 			&beatBegin, &beatEnd, &amp) ;
-		BeatWidths[mcType] = offset-onset ;
-		BeatCenters[mcType] = (offset+onset)/2 ;
-		BeatBegins[mcType] = beatBegin ;
-		BeatEnds[mcType] = beatEnd ;
-		BeatsSinceLastMatch[mcType] = 0 ;
-      BeatAmps[mcType] = amp ;
+		m->BeatWidths[mcType] = offset-onset ;
+		m->BeatCenters[mcType] = (offset+onset)/2 ;
+		m->BeatBegins[mcType] = beatBegin ;
+		m->BeatEnds[mcType] = beatEnd ;
+		m->BeatsSinceLastMatch[mcType] = 0 ;
+      m->BeatAmps[mcType] = amp ;
 		return(mcType) ;
 		}
 	}
@@ -482,15 +662,16 @@ int NewBeatType(int *newBeat )
 	metric for that type, and the shift used for that match.
 ***************************************************************************/
 
-void BestMorphMatch(int *newBeat,int *matchType,double *matchIndex, double *mi2,
+void BestMorphMatch(OseaContext *ctx, int *newBeat,int *matchType,double *matchIndex, double *mi2,
 	int *shiftAdj)
 	{
+	OseaMatch *m = &ctx->match ;
 	int type, i, bestMatch, nextBest, minShift, shift, temp ;
 	int bestShift2, nextShift2 ;
 	double bestDiff2, nextDiff2;
 	double beatDiff, minDiff, nextDiff=10000 ;
 
-	if(TypeCount == 0)
+	if(m->TypeCount == 0)
 		{
 		*matchType = 0 ;
 		*matchIndex = 1000 ;		// Make sure there is no match so a new beat is
@@ -501,9 +682,9 @@ void BestMorphMatch(int *newBeat,int *matchType,double *matchIndex, double *mi2,
 	// Compare the new beat to all type beat
 	// types that have been saved.
 
-	for(type = 0; type < TypeCount; ++type)
+	for(type = 0; type < m->TypeCount; ++type)
 		{
-		beatDiff = CompareBeats(&BeatTemplates[type][0],newBeat,&shift) ;
+		beatDiff = CompareBeats(&m->BeatTemplates[type][0],newBeat,&shift) ;
 		if(type == 0)
 			{
 			bestMatch = 0 ;
@@ -518,7 +699,7 @@ void BestMorphMatch(int *newBeat,int *matchType,double *matchIndex, double *mi2,
 			minDiff = beatDiff ;
 			minShift = shift ;
 			}
-		else if((TypeCount > 1) && (type == 1))
+		else if((m->TypeCount > 1) && (type == 1))
 			{
 			nextBest = type ;
 			nextDiff = beatDiff ;
@@ -535,12 +716,12 @@ void BestMorphMatch(int *newBeat,int *matchType,double *matchIndex, double *mi2,
 	// is the best match when no scaling is used.
 	// Then check whether the two close types can be combined.
 
-	if((minDiff < MATCH_LIMIT) && (nextDiff < MATCH_LIMIT) && (TypeCount > 1))
+	if((minDiff < MATCH_LIMIT) && (nextDiff < MATCH_LIMIT) && (m->TypeCount > 1))
 		{
 		// Compare without scaling.
 
-		bestDiff2 = CompareBeats2(&BeatTemplates[bestMatch][0],newBeat,&bestShift2) ;
-		nextDiff2 = CompareBeats2(&BeatTemplates[nextBest][0],newBeat,&nextShift2) ;
+		bestDiff2 = CompareBeats2(&m->BeatTemplates[bestMatch][0],newBeat,&bestShift2) ;
+		nextDiff2 = CompareBeats2(&m->BeatTemplates[nextBest][0],newBeat,&nextShift2) ;
 		if(nextDiff2 < bestDiff2)
 			{
 			temp = bestMatch ;
@@ -554,10 +735,10 @@ void BestMorphMatch(int *newBeat,int *matchType,double *matchIndex, double *mi2,
 			}
 		else *mi2 = nextDiff2 ;
 
-		beatDiff = CompareBeats(&BeatTemplates[bestMatch][0],&BeatTemplates[nextBest][0],&shift) ;
+		beatDiff = CompareBeats(&m->BeatTemplates[bestMatch][0],&m->BeatTemplates[nextBest][0],&shift) ;
 
 		if((beatDiff < COMBINE_LIMIT) &&
-			((*mi2 < 1.0) || (!MinimumBeatVariation(nextBest))))
+			((*mi2 < 1.0) || (!MinimumBeatVariation(ctx,nextBest))))
 			{
 
 			// Combine beats into bestMatch
@@ -568,24 +749,24 @@ void BestMorphMatch(int *newBeat,int *matchType,double *matchIndex, double *mi2,
 					{
 					if((i+shift > 0) && (i + shift < BEATLGTH))
 						{
-						BeatTemplates[bestMatch][i] += BeatTemplates[nextBest][i+shift] ;
-						BeatTemplates[bestMatch][i] >>= 1 ;
+						m->BeatTemplates[bestMatch][i] += m->BeatTemplates[nextBest][i+shift] ;
+						m->BeatTemplates[bestMatch][i] >>= 1 ;
 						}
 					}
 
-				if((BeatClassifications[bestMatch] == NORMAL) || (BeatClassifications[nextBest] == NORMAL))
-					BeatClassifications[bestMatch] = NORMAL ;
-				else if((BeatClassifications[bestMatch] == PVC) || (BeatClassifications[nextBest] == PVC))
-					BeatClassifications[bestMatch] = PVC ;
+				if((m->BeatClassifications[bestMatch] == NORMAL) || (m->BeatClassifications[nextBest] == NORMAL))
+					m->BeatClassifications[bestMatch] = NORMAL ;
+				else if((m->BeatClassifications[bestMatch] == PVC) || (m->BeatClassifications[nextBest] == PVC))
+					m->BeatClassifications[bestMatch] = PVC ;
 
-				BeatCounts[bestMatch] += BeatCounts[nextBest] ;
+				m->BeatCounts[bestMatch] += m->BeatCounts[nextBest] ;
 
-				CombineDomData(nextBest,bestMatch) ;
+				CombineDomData(ctx,nextBest,bestMatch) ;
 
 				// Shift other templates over.
 
-				for(type = nextBest; type < TypeCount-1; ++type)
-					BeatCopy(type+1,type) ;
+				for(type = nextBest; type < m->TypeCount-1; ++type)
+					BeatCopy(ctx,type+1,type) ;
 
 				}
 
@@ -595,32 +776,32 @@ void BestMorphMatch(int *newBeat,int *matchType,double *matchIndex, double *mi2,
 				{
 				for(i = 0; i < BEATLGTH; ++i)
 					{
-					BeatTemplates[nextBest][i] += BeatTemplates[bestMatch][i] ;
-					BeatTemplates[nextBest][i] >>= 1 ;
+					m->BeatTemplates[nextBest][i] += m->BeatTemplates[bestMatch][i] ;
+					m->BeatTemplates[nextBest][i] >>= 1 ;
 					}
 
-				if((BeatClassifications[bestMatch] == NORMAL) || (BeatClassifications[nextBest] == NORMAL))
-					BeatClassifications[nextBest] = NORMAL ;
-				else if((BeatClassifications[bestMatch] == PVC) || (BeatClassifications[nextBest] == PVC))
-					BeatClassifications[nextBest] = PVC ;
+				if((m->BeatClassifications[bestMatch] == NORMAL) || (m->BeatClassifications[nextBest] == NORMAL))
+					m->BeatClassifications[nextBest] = NORMAL ;
+				else if((m->BeatClassifications[bestMatch] == PVC) || (m->BeatClassifications[nextBest] == PVC))
+					m->BeatClassifications[nextBest] = PVC ;
 
-				BeatCounts[nextBest] += BeatCounts[bestMatch] ;
+				m->BeatCounts[nextBest] += m->BeatCounts[bestMatch] ;
 
-				CombineDomData(bestMatch,nextBest) ;
+				CombineDomData(ctx,bestMatch,nextBest) ;
 
 				// Shift other templates over.
 
-				for(type = bestMatch; type < TypeCount-1; ++type)
-					BeatCopy(type+1,type) ;
+				for(type = bestMatch; type < m->TypeCount-1; ++type)
+					BeatCopy(ctx,type+1,type) ;
 
 
 				bestMatch = nextBest ;
 				}
-			--TypeCount ;
-			BeatClassifications[TypeCount] = UNKNOWN ;
+			--m->TypeCount ;
+			m->BeatClassifications[m->TypeCount] = UNKNOWN ;
 			}
 		}
-	*mi2 = CompareBeats2(&BeatTemplates[bestMatch][0],newBeat,&bestShift2) ;
+	*mi2 = CompareBeats2(&m->BeatTemplates[bestMatch][0],newBeat,&bestShift2) ;
 	*matchType = bestMatch ;
 	*matchIndex = minDiff ;
 	*shiftAdj = minShift ;
@@ -631,52 +812,53 @@ void BestMorphMatch(int *newBeat,int *matchType,double *matchIndex, double *mi2,
 	using a new beat.
 ***************************************************************************/
 
-void UpdateBeatType(int matchType,int *newBeat, double mi2,
+void UpdateBeatType(OseaContext *ctx, int matchType,int *newBeat, double mi2,
 	 int shiftAdj)
 	{
+	OseaMatch *m = &ctx->match ;
 	int i,onset,offset, isoLevel, beatBegin, beatEnd ;
 	int amp ;
 
 	// Update beats since templates were matched.
 
-	for(i = 0; i < TypeCount; ++i)
+	for(i = 0; i < m->TypeCount; ++i)
 		{
 		if(i != matchType)
-			++BeatsSinceLastMatch[i] ;
-		else BeatsSinceLastMatch[i] = 0 ;
+			++m->BeatsSinceLastMatch[i] ;
+		else m->BeatsSinceLastMatch[i] = 0 ;
 		}
 
 	// If this is only the second beat, average it with the existing
 	// template.
 
-	if(BeatCounts[matchType] == 1)
+	if(m->BeatCounts[matchType] == 1)
 		for(i = 0; i < BEATLGTH; ++i)
 			{
 			if((i+shiftAdj >= 0) && (i+shiftAdj < BEATLGTH))
-				BeatTemplates[matchType][i] = (BeatTemplates[matchType][i] + newBeat[i+shiftAdj])>>1 ;
+				m->BeatTemplates[matchType][i] = (m->BeatTemplates[matchType][i] + newBeat[i+shiftAdj])>>1 ;
 			}
 
 	// Otherwise do a normal update.
 
 	else
-		UpdateBeat(&BeatTemplates[matchType][0], newBeat, shiftAdj) ;
+		UpdateBeat(&m->BeatTemplates[matchType][0], newBeat, shiftAdj) ;
 
 	// Determine beat features for the new average beat.
 
-	AnalyzeBeat(&BeatTemplates[matchType][0],&onset,&offset,&isoLevel,
+	AnalyzeBeat(&m->BeatTemplates[matchType][0],&onset,&offset,&isoLevel,
 		&beatBegin, &beatEnd, &amp) ;
 
-	BeatWidths[matchType] = offset-onset ;
-	BeatCenters[matchType] = (offset+onset)/2 ;
-	BeatBegins[matchType] = beatBegin ;
-	BeatEnds[matchType] = beatEnd ;
-	BeatAmps[matchType] = amp ;
+	m->BeatWidths[matchType] = offset-onset ;
+	m->BeatCenters[matchType] = (offset+onset)/2 ;
+	m->BeatBegins[matchType] = beatBegin ;
+	m->BeatEnds[matchType] = beatEnd ;
+	m->BeatAmps[matchType] = amp ;
 
-	++BeatCounts[matchType] ;
+	++m->BeatCounts[matchType] ;
 
 	for(i = MAXPREV-1; i > 0; --i)
-		MIs[matchType][i] = MIs[matchType][i-1] ;
-	MIs[matchType][0] = mi2 ;
+		m->MIs[matchType][i] = m->MIs[matchType][i-1] ;
+	m->MIs[matchType][0] = mi2 ;
 
 	}
 
@@ -686,17 +868,18 @@ void UpdateBeatType(int matchType,int *newBeat, double mi2,
 	frequently.
 ****************************************************************************/
 
-int GetDominantType(void)
+int GetDominantType(OseaContext *ctx)
 	{
+	OseaMatch *m = &ctx->match ;
 	int maxCount = 0, maxType = -1 ;
 	int type, totalCount ;
 
 	for(type = 0; type < MAXTYPES; ++type)
 		{
-		if((BeatClassifications[type] == NORMAL) && (BeatCounts[type] > maxCount))
+		if((m->BeatClassifications[type] == NORMAL) && (m->BeatCounts[type] > maxCount))
 			{
 			maxType = type ;
-			maxCount = BeatCounts[type] ;
+			maxCount = m->BeatCounts[type] ;
 			}
 		}
 
@@ -705,14 +888,14 @@ int GetDominantType(void)
 
 	if(maxType == -1)
 		{
-		for(type = 0, totalCount = 0; type < TypeCount; ++type)
-			totalCount += BeatCounts[type] ;
+		for(type = 0, totalCount = 0; type < m->TypeCount; ++type)
+			totalCount += m->BeatCounts[type] ;
 		if(totalCount > 300)
-			for(type = 0; type < TypeCount; ++type)
-				if(BeatCounts[type] > maxCount)
+			for(type = 0; type < m->TypeCount; ++type)
+				if(m->BeatCounts[type] > maxCount)
 					{
 					maxType = type ;
-					maxCount = BeatCounts[type] ;
+					maxCount = m->BeatCounts[type] ;
 					}
 		}
 
@@ -724,10 +907,10 @@ int GetDominantType(void)
 	ClearLastNewType removes the last new type that was initiated
 ************************************************************************/
 
-void ClearLastNewType(void)
+void ClearLastNewType(OseaContext *ctx)
 	{
-	if(TypeCount != 0)
-		--TypeCount ;
+	if(ctx->match.TypeCount != 0)
+		--ctx->match.TypeCount ;
 	}
 
 /****************************************************************
@@ -735,9 +918,9 @@ void ClearLastNewType(void)
 	beginning of the beat (P-wave onset if a P-wave is found).
 *****************************************************************/
 
-int GetBeatBegin(int type)
+int GetBeatBegin(OseaContext *ctx, int type)
 	{
-	return(BeatBegins[type]) ;
+	return(ctx->match.BeatBegins[type]) ;
 	}
 
 /****************************************************************
@@ -745,14 +928,14 @@ int GetBeatBegin(int type)
 	a beat (T-wave offset).
 *****************************************************************/
 
-int GetBeatEnd(int type)
+int GetBeatEnd(OseaContext *ctx, int type)
 	{
-	return(BeatEnds[type]) ;
+	return(ctx->match.BeatEnds[type]) ;
 	}
 
-int GetBeatAmp(int type)
+int GetBeatAmp(OseaContext *ctx, int type)
 	{
-	return(BeatAmps[type]) ;
+	return(ctx->match.BeatAmps[type]) ;
 	}
 
 
@@ -762,52 +945,53 @@ int GetBeatAmp(int type)
 	normal type.
 ************************************************************************/
 
-double DomCompare2(int *newBeat, int domType)
+double DomCompare2(OseaContext *ctx, int *newBeat, int domType)
 	{
 	int shift ;
-	return(CompareBeats2(&BeatTemplates[domType][0],newBeat,&shift)) ;
+	return(CompareBeats2(&ctx->match.BeatTemplates[domType][0],newBeat,&shift)) ;
 	}
 
-double DomCompare(int newType, int domType)
+double DomCompare(OseaContext *ctx, int newType, int domType)
 	{
 	int shift ;
-	return(CompareBeats2(&BeatTemplates[domType][0],&BeatTemplates[newType][0],
-		&shift)) ;
+	return(CompareBeats2(&ctx->match.BeatTemplates[domType][0],
+		&ctx->match.BeatTemplates[newType][0],&shift)) ;
 	}
 
 /*************************************************************************
 BeatCopy copies beat data from a source beat to a destination beat.
 *************************************************************************/
 
-void BeatCopy(int srcBeat, int destBeat)
+void BeatCopy(OseaContext *ctx, int srcBeat, int destBeat)
 	{
+	OseaMatch *m = &ctx->match ;
 	int i ;
 
 	// Copy template.
 
 	for(i = 0; i < BEATLGTH; ++i)
-		BeatTemplates[destBeat][i] = BeatTemplates[srcBeat][i] ;
+		m->BeatTemplates[destBeat][i] = m->BeatTemplates[srcBeat][i] ;
 
 	// Move feature information.
 
-	BeatCounts[destBeat] = BeatCounts[srcBeat] ;
-	BeatWidths[destBeat] = BeatWidths[srcBeat] ;
-	BeatCenters[destBeat] = BeatCenters[srcBeat] ;
+	m->BeatCounts[destBeat] = m->BeatCounts[srcBeat] ;
+	m->BeatWidths[destBeat] = m->BeatWidths[srcBeat] ;
+	m->BeatCenters[destBeat] = m->BeatCenters[srcBeat] ;
 	for(i = 0; i < MAXPREV; ++i)
 		{
-		PostClass[destBeat][i] = PostClass[srcBeat][i] ;
-		PCRhythm[destBeat][i] = PCRhythm[srcBeat][i] ;
+		ctx->postclas.PostClass[destBeat][i] = ctx->postclas.PostClass[srcBeat][i] ;
+		ctx->postclas.PCRhythm[destBeat][i] = ctx->postclas.PCRhythm[srcBeat][i] ;
 		}
 
-	BeatClassifications[destBeat] = BeatClassifications[srcBeat] ;
-	BeatBegins[destBeat] = BeatBegins[srcBeat] ;
-	BeatEnds[destBeat] = BeatBegins[srcBeat] ;
-	BeatsSinceLastMatch[destBeat] = BeatsSinceLastMatch[srcBeat];
-	BeatAmps[destBeat] = BeatAmps[srcBeat] ;
+	m->BeatClassifications[destBeat] = m->BeatClassifications[srcBeat] ;
+	m->BeatBegins[destBeat] = m->BeatBegins[srcBeat] ;
+	m->BeatEnds[destBeat] = m->BeatBegins[srcBeat] ;
+	m->BeatsSinceLastMatch[destBeat] = m->BeatsSinceLastMatch[srcBeat];
+	m->BeatAmps[destBeat] = m->BeatAmps[srcBeat] ;
 
 	// Adjust data in dominant beat monitor.
 
-	AdjustDomData(srcBeat,destBeat) ;
+	AdjustDomData(ctx,srcBeat,destBeat) ;
 	}
 
 /********************************************************************
@@ -815,11 +999,12 @@ void BeatCopy(int srcBeat, int destBeat)
 	have all had similarity indexes less than 0.5.
 *********************************************************************/
 
-int MinimumBeatVariation(int type)
+int MinimumBeatVariation(OseaContext *ctx, int type)
 	{
+	OseaMatch *m = &ctx->match ;
 	int i ;
 	for(i = 0; i < MAXTYPES; ++i)
-		if(MIs[type][i] > 0.5)
+		if(m->MIs[type][i] > 0.5)
 			i = MAXTYPES+2 ;
 	if(i == MAXTYPES)
 		return(1) ;
@@ -833,17 +1018,18 @@ int MinimumBeatVariation(int type)
 
 #define WIDE_VAR_LIMIT	0.50
 
-int WideBeatVariation(int type)
+int WideBeatVariation(OseaContext *ctx, int type)
 	{
+	OseaMatch *m = &ctx->match ;
 	int i, n ;
 	double aveMI ;
 
-	n = BeatCounts[type] ;
+	n = m->BeatCounts[type] ;
 	if(n > 8)
 		n = 8 ;
 
 	for(i = 0, aveMI = 0; i <n; ++i)
-		aveMI += MIs[type][i] ;
+		aveMI += m->MIs[type][i] ;
 
 	aveMI /= n ;
 	if(aveMI > WIDE_VAR_LIMIT)
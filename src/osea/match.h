@@ -28,26 +28,26 @@ MA 02143 USA).  For updates to this software, please visit our website
 (http://www.eplimited.com).
 ******************************************************************************/
 
-int NewBeatType(int *beat) ;
-void BestMorphMatch(int *newBeat,int *matchType,double *matchIndex, double *mi2, int *shiftAdj) ;
-void UpdateBeatType(int matchType,int *newBeat, double mi2, int shiftAdj) ;
-int GetTypesCount(void) ;
-int GetBeatTypeCount(int type) ;
-int IsTypeIsolated(int type) ;
-void SetBeatClass(int type, int beatClass) ;
-int GetBeatClass(int type) ;
-int GetDominantType(void) ;
-int GetBeatWidth(int type) ;
-int GetPolarity(int type) ;
-int GetRhythmIndex(int type) ;
-void ResetMatch(void) ;
-void ClearLastNewType(void) ;
-int GetBeatBegin(int type) ;
-int GetBeatEnd(int type) ;
-int GetBeatAmp(int type) ;
-int MinimumBeatVariation(int type) ;
-int GetBeatCenter(int type) ;
-int WideBeatVariation(int type) ;
-double DomCompare2(int *newBeat, int domType) ;
-double DomCompare(int newType, int domType) ;
+int NewBeatType(OseaContext *ctx, int *beat) ;
+void BestMorphMatch(OseaContext *ctx, int *newBeat,int *matchType,double *matchIndex, double *mi2, int *shiftAdj) ;
+void UpdateBeatType(OseaContext *ctx, int matchType,int *newBeat, double mi2, int shiftAdj) ;
+int GetTypesCount(OseaContext *ctx) ;
+int GetBeatTypeCount(OseaContext *ctx, int type) ;
+int IsTypeIsolated(OseaContext *ctx, int type) ;
+void SetBeatClass(OseaContext *ctx, int type, int beatClass) ;
+int GetBeatClass(OseaContext *ctx, int type) ;
+int GetDominantType(OseaContext *ctx) ;
+int GetBeatWidth(OseaContext *ctx, int type) ;
+int GetPolarity(OseaContext *ctx, int type) ;
+int GetRhythmIndex(OseaContext *ctx, int type) ;
+void ResetMatch(OseaContext *ctx) ;
+void ClearLastNewType(OseaContext *ctx) ;
+int GetBeatBegin(OseaContext *ctx, int type) ;
+int GetBeatEnd(OseaContext *ctx, int type) ;
+int GetBeatAmp(OseaContext *ctx, int type) ;
+int MinimumBeatVariation(OseaContext *ctx, int type) ;
+int GetBeatCenter(OseaContext *ctx, int type) ;
+int WideBeatVariation(OseaContext *ctx, int type) ;
+double DomCompare2(OseaContext *ctx, int *newBeat, int domType) ;
+double DomCompare(OseaContext *ctx, int newType, int domType) ;
 
@@ -34,21 +34,18 @@ This file contains functions for evaluating the noise content of a beat.
 
 #include <stdlib.h>
 #include "qrsdet.h"
+#include "osea.h"
 
-#define NB_LENGTH	MS1500
 #define NS_LENGTH	MS50
 
-int NoiseBuffer[NB_LENGTH], NBPtr = 0 ;
-int NoiseEstimate ;
-
 /************************************************************************
 	GetNoiseEstimate() allows external access the present noise estimate.
 	this function is only used for debugging.
 *************************************************************************/
 
-int GetNoiseEstimate()
+int GetNoiseEstimate(OseaContext *ctx)
 	{
-	return(NoiseEstimate) ;
+	return(ctx->noisechk.NoiseEstimate) ;
 	}
 
 /***********************************************************************
@@ -72,15 +69,16 @@ int GetNoiseEstimate()
 
 ***********************************************************************/
 
-int NoiseCheck(int datum, int delay, int RR, int beatBegin, int beatEnd)
+int NoiseCheck(OseaContext *ctx, int datum, int delay, int RR, int beatBegin, int beatEnd)
 	{
+	OseaNoiseChk *n = &ctx->noisechk ;
 	int ptr, i;
 	int ncStart, ncEnd, ncMax, ncMin ;
 	double noiseIndex ;
 
-	NoiseBuffer[NBPtr] = datum ;
-	if(++NBPtr == NB_LENGTH)
-		NBPtr = 0 ;
+	n->NoiseBuffer[n->NBPtr] = datum ;
+	if(++n->NBPtr == NB_LENGTH)
+		n->NBPtr = 0 ;
 
 	// Check for noise in region that is 300 ms following
 	// last R-wave and 250 ms preceding present R-wave.
@@ -99,20 +97,20 @@ int NoiseCheck(int datum, int delay, int RR, int beatBegin, int beatEnd)
 	if((delay != 0) && (ncStart < NB_LENGTH) && (ncStart > ncEnd))
 		{
 
-		ptr = NBPtr - ncStart ;	// Find index to end of last beat in
+		ptr = n->NBPtr - ncStart ;	// Find index to end of last beat in
 		if(ptr < 0)					// the circular buffer.
 			ptr += NB_LENGTH ;
 
 		// Find the maximum and minimum values in the
 		// isoelectric region between beats.
 
-		ncMax = ncMin = NoiseBuffer[ptr] ;
+		ncMax = ncMin = n->NoiseBuffer[ptr] ;
 		for(i = 0; i < ncStart-ncEnd; ++i)
 			{
-			if(NoiseBuffer[ptr] > ncMax)
-				ncMax = NoiseBuffer[ptr] ;
-			else if(NoiseBuffer[ptr] < ncMin)
-				ncMin = NoiseBuffer[ptr] ;
+			if(n->NoiseBuffer[ptr] > ncMax)
+				ncMax = n->NoiseBuffer[ptr] ;
+			else if(n->NoiseBuffer[ptr] < ncMin)
+				ncMin = n->NoiseBuffer[ptr] ;
 			if(++ptr == NB_LENGTH)
 				ptr = 0 ;
 			}
@@ -122,10 +120,10 @@ int NoiseCheck(int datum, int delay, int RR, int beatBegin, int beatEnd)
 
 		noiseIndex = (ncMax-ncMin) ;
 		noiseIndex /= (ncStart-ncEnd) ;
-		NoiseEstimate = noiseIndex * 10 ;
+		n->NoiseEstimate = noiseIndex * 10 ;
 		}
 	else
-		NoiseEstimate = 0 ;
-	return(NoiseEstimate) ;
+		n->NoiseEstimate = 0 ;
+	return(n->NoiseEstimate) ;
 	}
 
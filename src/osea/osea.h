@@ -0,0 +1,228 @@
+/*****************************************************************************
+
+FILE:  osea.h
+  ___________________________________________________________________________
+
+osea.h: State of the beat detector and classifier.
+
+This file is free software; you can redistribute it and/or modify it under
+the terms of the GNU Library General Public License as published by the Free
+Software Foundation; either version 2 of the License, or (at your option) any
+later version.
+
+This software is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU Library General Public License for more
+details.
+
+You should have received a copy of the GNU Library General Public License along
+with this library; if not, write to the Free Software Foundation, Inc., 59
+Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  __________________________________________________________________________
+
+	The original OSEA sources keep the state of the detector and the
+	classifier in global and static variables, so only one ECG stream can
+	be analyzed at a time.  Here the same variables are collected into one
+	OseaContext, which is passed to every function that used them.  The
+	variables keep their original names, grouped by the file that uses
+	them.
+
+	A context must be initialized with InitBDAC() before use.  Contexts are
+	independent of each other, so several streams can be analyzed at the
+	same time (also in different threads, one context per thread).
+
+	Beat templates are padded to a multiple of four samples and aligned to
+	OSEA_CONTEXT_ALIGNMENT bytes for the SIMD code in match.c, so a context
+	must be allocated with that alignment (for example with
+	posix_memalign()).
+
+*******************************************************************************/
+#ifndef _OSEA_H
+#define _OSEA_H
+
+#include "qrsdet.h"
+#include "bdac.h"
+#include "variant.h"
+
+// Buffer lengths.
+
+#define ECG_BUFFER_LENGTH	1000	// Should be long enough for a beat
+											// plus extra space to accommodate
+											// the maximum detection delay.
+#define BEAT_QUE_LENGTH	10			// Length of que for beats awaiting
+											// classification.  Because of
+											// detection delays, Multiple beats
+											// can occur before there is enough data
+											// to classify the first beat in the que.
+#define NB_LENGTH	MS1500			// Length of the noise check buffer.
+#define DM_BUFFER_LENGTH	180		// Beats in the dominant monitor.
+#define RBB_LENGTH	8				// Length of the RR interval buffer.
+#define TEMPLATE_LGTH	((BEATLGTH+3) & ~3)	// Padded length of a beat template.
+
+#if defined(__GNUC__)
+#define OSEA_ALIGNED	__attribute__ ((aligned (OSEA_CONTEXT_ALIGNMENT)))
+#else
+#define OSEA_ALIGNED
+#endif
+
+// qrsfilt.c
+
+typedef struct
+	{
+	long y1, y2 ;
+	int data[LPBUFFER_LGTH], ptr ;
+	} OseaLPFilt ;
+
+typedef struct
+	{
+	long y ;
+	int data[HPBUFFER_LGTH], ptr ;
+	} OseaHPFilt ;
+
+typedef struct
+	{
+	int derBuff[DERIV_LENGTH], derI ;
+	} OseaDeriv ;
+
+typedef struct
+	{
+	long sum ;
+	int data[WINDOW_WIDTH], ptr ;
+	} OseaMvwInt ;
+
+typedef struct
+	{
+	OseaLPFilt lp ;
+	OseaHPFilt hp ;
+	OseaDeriv deriv1, deriv2 ;
+	OseaMvwInt mvwint ;
+	} OseaQRSFilt ;
+
+// qrsdet.c
+
+typedef struct
+	{
+	int max, timeSinceMax, lastDatum ;
+	} OseaPeak ;
+
+typedef struct
+	{
+	int DDBuffer[DER_DELAY], DDPtr ;	/* Buffer holding derivative data. */
+	int Dly ;
+	int det_thresh, qpkcnt ;
+	int qrsbuf[8], noise[8], rrbuf[8] ;
+	int rsetBuff[8], rsetCount ;
+	int nmedian, qmedian, rrmedian ;
+	int count, sbpeak, sbloc, sbcount ;
+	int maxder, lastmax ;
+	int initBlank, initMax ;
+	int preBlankCnt, tempPeak ;
+	OseaPeak peak ;
+	} OseaQRSDet ;
+
+// bdac.c
+
+typedef struct
+	{
+	int ECGBuffer[ECG_BUFFER_LENGTH], ECGBufferIndex ;  // Circular data buffer.
+	int BeatBuffer[TEMPLATE_LGTH] OSEA_ALIGNED ;
+	int BeatQue[BEAT_QUE_LENGTH], BeatQueCount ;  // Buffer of detection delays.
+	int RRCount ;
+	int InitBeatFlag ;
+	} OseaBDAC ;
+
+// classify.c
+
+typedef struct
+	{
+	int DomType ;
+	int RecentRRs[8], RecentTypes[8] ;
+
+	// Classify()
+
+	int morphType, runCount ;
+	int lastIsoLevel, lastRhythmClass, lastBeatWasNew ;
+
+	// DomMonitor()
+
+	int NewDom, DomRhythm ;
+	int DMBeatTypes[DM_BUFFER_LENGTH], DMBeatClasses[DM_BUFFER_LENGTH] ;
+	int DMBeatRhythms[DM_BUFFER_LENGTH] ;
+	int DMNormCounts[8], DMBeatCounts[8], DMIrregCount ;
+	int brIndex ;
+	} OseaClassify ;
+
+// match.c
+
+typedef struct
+	{
+	int BeatTemplates[MAXTYPES][TEMPLATE_LGTH] OSEA_ALIGNED ;
+	int BeatCounts[MAXTYPES] ;
+	int BeatWidths[MAXTYPES] ;
+	int BeatClassifications[MAXTYPES] ;
+	int BeatBegins[MAXTYPES] ;
+	int BeatEnds[MAXTYPES] ;
+	int BeatsSinceLastMatch[MAXTYPES] ;
+	int BeatAmps[MAXTYPES] ;
+	int BeatCenters[MAXTYPES] ;
+	double MIs[MAXTYPES][8] ;
+	int TypeCount ;
+	} OseaMatch ;
+
+// noisechk.c
+
+typedef struct
+	{
+	int NoiseBuffer[NB_LENGTH], NBPtr ;
+	int NoiseEstimate ;
+	} OseaNoiseChk ;
+
+// rythmchk.c
+
+typedef struct
+	{
+	int RRBuffer[RBB_LENGTH], RRTypes[RBB_LENGTH], BeatCount ;
+	int ClassifyState ;
+	int BigeminyFlag ;
+	} OseaRhythmChk ;
+
+// postclas.c
+
+typedef struct
+	{
+	int PostClass[MAXTYPES][8], PCInitCount ;
+	int PCRhythm[MAXTYPES][8] ;
+
+	// PostClassify()
+
+	int lastRC, lastWidth ;
+	double lastMI2 ;
+	} OseaPostClas ;
+
+struct _OseaContext
+	{
+	OseaBDAC bdac ;
+	OseaQRSDet qrsdet ;
+	OseaQRSFilt qrsfilt ;
+	OseaClassify classify ;
+	OseaMatch match ;
+	OseaNoiseChk noisechk ;
+	OseaRhythmChk rhythmchk ;
+	OseaPostClas postclas ;
+	} ;
+
+// The QRS filters and detector, for code that filters blocks of samples
+// with QRSFilterBlock() before detection.
+
+int QRSFilter(OseaContext *ctx, int datum, int init) ;
+void QRSFilterBlock(OseaContext *ctx, const int *data, int *fdata, int n) ;
+int QRSDet(OseaContext *ctx, int datum, int init) ;
+int QRSDetFiltered(OseaContext *ctx, int datum, int fdatum) ;
+
+// The beat classifier, for code that classifies beats it has extracted
+// itself: BEATLGTH samples at BEAT_SAMPLE_RATE, R-wave at FIDMARK.
+
+int Classify(OseaContext *ctx, int *newBeat, int rr, int noiseLevel,
+	int *beatMatch, int *fidAdj, int init) ;
+
+#endif /* _OSEA_H */
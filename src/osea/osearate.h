@@ -0,0 +1,135 @@
+/*****************************************************************************
+
+FILE:  osearate.h
+  ___________________________________________________________________________
+
+osearate.h: Sample rate of an OSEA build.
+
+This file is free software; you can redistribute it and/or modify it under
+the terms of the GNU Library General Public License as published by the Free
+Software Foundation; either version 2 of the License, or (at your option) any
+later version.
+
+This software is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU Library General Public License for more
+details.
+
+You should have received a copy of the GNU Library General Public License along
+with this library; if not, write to the Free Software Foundation, Inc., 59
+Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  __________________________________________________________________________
+
+	The time related constants (MS10, MS25, ...) and the buffer lengths of
+	the detector are derived from SAMPLE_RATE at compile time.  To analyze
+	ECG of different sample rates without resampling it, the OSEA sources
+	are compiled once for every supported rate, with OSEA_SAMPLE_RATE
+	defined on the compiler command line.
+
+	So that all the builds can be linked into the same program, every
+	external symbol gets the sample rate appended to its name (QRSDet
+	becomes QRSDet_300 and so on).  A program reaches the builds through
+	the OseaVariant descriptors declared in variant.h.
+
+*******************************************************************************/
+#ifndef _OSEARATE_H
+#define _OSEARATE_H
+
+#ifndef OSEA_SAMPLE_RATE
+#define OSEA_SAMPLE_RATE	300
+#endif
+
+// Beats are classified at half the detector sample rate, as in the
+// original 200/100 Hz OSEA.  At 150 Hz the beats are classified without
+// down sampling, so that the beat templates keep enough resolution.
+
+#if OSEA_SAMPLE_RATE == 150
+#define OSEA_BEAT_SAMPLE_RATE	150
+#else
+#define OSEA_BEAT_SAMPLE_RATE	(OSEA_SAMPLE_RATE/2)
+#endif
+
+// Number of samples in ms milliseconds at rate Hz, rounded to the nearest
+// sample.  The time constants of qrsdet.h and bdac.h were computed in
+// floating point in the original sources, which is not an integer constant
+// expression in C, so the buffers sized by them were variable length
+// arrays at file scope.  For the supported rates this gives the same
+// values.
+
+#define OSEA_MS_TO_SAMPLES(ms, rate)	(((ms)*(rate) + 500)/1000)
+
+#define OSEA_NAME(name)	OSEA_NAME2(name, OSEA_SAMPLE_RATE)
+#define OSEA_NAME2(name, rate)	OSEA_NAME3(name, rate)
+#define OSEA_NAME3(name, rate)	name ## _ ## rate
+
+// External symbols of the OSEA sources.
+
+#define AdjustDomData		OSEA_NAME(AdjustDomData)
+#define AnalyzeBeat		OSEA_NAME(AnalyzeBeat)
+#define BLSCheck		OSEA_NAME(BLSCheck)
+#define BeatCopy		OSEA_NAME(BeatCopy)
+#define BeatDetectAndClassify	OSEA_NAME(BeatDetectAndClassify)
+#define BeatDetectAndClassifyBlock	OSEA_NAME(BeatDetectAndClassifyBlock)
+#define BestMorphMatch		OSEA_NAME(BestMorphMatch)
+#define CheckPCRhythm		OSEA_NAME(CheckPCRhythm)
+#define CheckPostClass		OSEA_NAME(CheckPostClass)
+#define Classify		OSEA_NAME(Classify)
+#define ClearLastNewType	OSEA_NAME(ClearLastNewType)
+#define CombineDomData		OSEA_NAME(CombineDomData)
+#define CompareBeats		OSEA_NAME(CompareBeats)
+#define CompareBeats2		OSEA_NAME(CompareBeats2)
+#define DomCompare		OSEA_NAME(DomCompare)
+#define DomCompare2		OSEA_NAME(DomCompare2)
+#define DomMonitor		OSEA_NAME(DomMonitor)
+#define DownSampleBeat		OSEA_NAME(DownSampleBeat)
+#define GetBeatAmp		OSEA_NAME(GetBeatAmp)
+#define GetBeatBegin		OSEA_NAME(GetBeatBegin)
+#define GetBeatCenter		OSEA_NAME(GetBeatCenter)
+#define GetBeatClass		OSEA_NAME(GetBeatClass)
+#define GetBeatEnd		OSEA_NAME(GetBeatEnd)
+#define GetBeatTypeCount	OSEA_NAME(GetBeatTypeCount)
+#define GetBeatWidth		OSEA_NAME(GetBeatWidth)
+#define GetDomRhythm		OSEA_NAME(GetDomRhythm)
+#define GetDominantType		OSEA_NAME(GetDominantType)
+#define GetNewDominantType	OSEA_NAME(GetNewDominantType)
+#define GetNoiseEstimate	OSEA_NAME(GetNoiseEstimate)
+#define GetRunCount		OSEA_NAME(GetRunCount)
+#define GetTypesCount		OSEA_NAME(GetTypesCount)
+#define HFNoiseCheck		OSEA_NAME(HFNoiseCheck)
+#define InitBDAC		OSEA_NAME(InitBDAC)
+#define IsBigeminy		OSEA_NAME(IsBigeminy)
+#define IsoCheck		OSEA_NAME(IsoCheck)
+#define MEMMOVELEN		OSEA_NAME(MEMMOVELEN)
+#define MinimumBeatVariation	OSEA_NAME(MinimumBeatVariation)
+#define NewBeatType		OSEA_NAME(NewBeatType)
+#define NoiseCheck		OSEA_NAME(NoiseCheck)
+#define Peak			OSEA_NAME(Peak)
+#define PostClassify		OSEA_NAME(PostClassify)
+#define QRSDet			OSEA_NAME(QRSDet)
+#define QRSDetFiltered		OSEA_NAME(QRSDetFiltered)
+#define QRSFilter		OSEA_NAME(QRSFilter)
+#define QRSFilterBlock		OSEA_NAME(QRSFilterBlock)
+#define RRMatch			OSEA_NAME(RRMatch)
+#define RRMatch2		OSEA_NAME(RRMatch2)
+#define RRShort			OSEA_NAME(RRShort)
+#define RRShort2		OSEA_NAME(RRShort2)
+#define ResetBDAC		OSEA_NAME(ResetBDAC)
+#define ResetMatch		OSEA_NAME(ResetMatch)
+#define ResetPostClassify	OSEA_NAME(ResetPostClassify)
+#define ResetRhythmChk		OSEA_NAME(ResetRhythmChk)
+#define RhythmChk		OSEA_NAME(RhythmChk)
+#define SetBeatClass		OSEA_NAME(SetBeatClass)
+#define TH			OSEA_NAME(TH)
+#define TempClass		OSEA_NAME(TempClass)
+#define UpdateBeat		OSEA_NAME(UpdateBeat)
+#define UpdateBeatType		OSEA_NAME(UpdateBeatType)
+#define WideBeatVariation	OSEA_NAME(WideBeatVariation)
+#define deriv1			OSEA_NAME(deriv1)
+#define deriv2			OSEA_NAME(deriv2)
+#define hpfilt			OSEA_NAME(hpfilt)
+#define lpfilt			OSEA_NAME(lpfilt)
+#define median			OSEA_NAME(median)
+#define mvwint			OSEA_NAME(mvwint)
+#define thresh			OSEA_NAME(thresh)
+
+#endif /* _OSEARATE_H */
@@ -44,31 +44,28 @@ following beat is detected.
 
 #include "bdac.h"
 #include "ecgcodes.h"
+#include "osea.h"
 
 // External Prototypes.
 
-double DomCompare(int newType, int domType) ;
-int GetBeatTypeCount(int type) ;
-
-// Records of post classifications.
-
-int PostClass[MAXTYPES][8], PCInitCount = 0 ;
-int PCRhythm[MAXTYPES][8] ;
+double DomCompare(OseaContext *ctx, int newType, int domType) ;
+int GetBeatTypeCount(OseaContext *ctx, int type) ;
 
 /**********************************************************************
  Resets post classifications for beats.
 **********************************************************************/
 
-void ResetPostClassify()
+void ResetPostClassify(OseaContext *ctx)
 	{
+	OseaPostClas *pc = &ctx->postclas ;
 	int i, j ;
 	for(i = 0; i < MAXTYPES; ++i)
 		for(j = 0; j < 8; ++j)
 			{
-			PostClass[i][j] = 0 ;
-			PCRhythm[i][j] = 0 ;
+			pc->PostClass[i][j] = 0 ;
+			pc->PCRhythm[i][j] = 0 ;
 			}
-	PCInitCount = 0 ;
+	pc->PCInitCount = 0 ;
 	}
 
 /***********************************************************************
@@ -77,11 +74,10 @@ void ResetPostClassify()
 	to detecting premature beats followed by compensitory pauses.
 ************************************************************************/
 
-void PostClassify(int *recentTypes, int domType, int *recentRRs, int width, double mi2,
+void PostClassify(OseaContext *ctx, int *recentTypes, int domType, int *recentRRs, int width, double mi2,
 	int rhythmClass)
 	{
-	static int lastRC, lastWidth ;
-	static double lastMI2 ;
+	OseaPostClas *pc = &ctx->postclas ;
 	int i, regCount, pvcCount, normRR ;
 	double mi3 ;
 
@@ -92,9 +88,9 @@ void PostClassify(int *recentTypes, int domType, int *recentRRs, int width, doub
 	if((recentTypes[0] == recentTypes[2]) && (recentTypes[0] != domType)
 		&& (recentTypes[0] != recentTypes[1]))
 		{
-		mi3 = DomCompare(recentTypes[0],domType) ;
+		mi3 = DomCompare(ctx,recentTypes[0],domType) ;
 		for(i = regCount = 0; i < 8; ++i)
-			if(PCRhythm[recentTypes[0]][i] == NORMAL)
+			if(pc->PCRhythm[recentTypes[0]][i] == NORMAL)
 				++regCount ;
 		if((mi3 < 2.0) && (regCount > 6))
 			domType = recentTypes[0] ;
@@ -102,12 +98,12 @@ void PostClassify(int *recentTypes, int domType, int *recentRRs, int width, doub
 
 	// Don't do anything until four beats have gone by.
 
-	if(PCInitCount < 3)
+	if(pc->PCInitCount < 3)
 		{
-		++PCInitCount ;
-		lastWidth = width ;
-		lastMI2 = 0 ;
-		lastRC = 0 ;
+		++pc->PCInitCount ;
+		pc->lastWidth = width ;
+		pc->lastMI2 = 0 ;
+		pc->lastRC = 0 ;
 		return ;
 		}
 
@@ -122,13 +118,13 @@ void PostClassify(int *recentTypes, int domType, int *recentRRs, int width, doub
 		// Shift the previous beat classifications to make room for the
 		// new classification.
 		for(i = pvcCount = 0; i < 8; ++i)
-			if(PostClass[recentTypes[1]][i] == PVC)
+			if(pc->PostClass[recentTypes[1]][i] == PVC)
 				++pvcCount ;
 
 		for(i = 7; i > 0; --i)
 			{
-			PostClass[recentTypes[1]][i] = PostClass[recentTypes[1]][i-1] ;
-			PCRhythm[recentTypes[1]][i] = PCRhythm[recentTypes[1]][i-1] ;
+			pc->PostClass[recentTypes[1]][i] = pc->PostClass[recentTypes[1]][i-1] ;
+			pc->PCRhythm[recentTypes[1]][i] = pc->PCRhythm[recentTypes[1]][i-1] ;
 			}
 
 		// If the beat is premature followed by a compensitory pause and the
@@ -138,43 +134,43 @@ void PostClassify(int *recentTypes, int domType, int *recentRRs, int width, doub
 		if(((normRR-(normRR>>3)) >= recentRRs[1]) && ((recentRRs[0]-(recentRRs[0]>>3)) >= normRR)// && (lastMI2 > 3)
 			&& (recentTypes[0] == domType) && (recentTypes[2] == domType)
 				&& (recentTypes[1] != domType))
-			PostClass[recentTypes[1]][0] = PVC ;
+			pc->PostClass[recentTypes[1]][0] = PVC ;
 
 		// If previous two were classified as PVCs, and this is at least slightly
 		// premature, classify as a PVC.
 
 		else if(((normRR-(normRR>>4)) > recentRRs[1]) && ((normRR+(normRR>>4)) < recentRRs[0]) &&
-			(((PostClass[recentTypes[1]][1] == PVC) && (PostClass[recentTypes[1]][2] == PVC)) ||
+			(((pc->PostClass[recentTypes[1]][1] == PVC) && (pc->PostClass[recentTypes[1]][2] == PVC)) ||
 				(pvcCount >= 6) ) &&
 			(recentTypes[0] == domType) && (recentTypes[2] == domType) && (recentTypes[1] != domType))
-			PostClass[recentTypes[1]][0] = PVC ;
+			pc->PostClass[recentTypes[1]][0] = PVC ;
 
 		// If the previous and following beats are the dominant beat type,
 		// and this beat is significantly different from the dominant,
 		// call it a PVC.
 
-		else if((recentTypes[0] == domType) && (recentTypes[2] == domType) && (lastMI2 > 2.5))
-			PostClass[recentTypes[1]][0] = PVC ;
+		else if((recentTypes[0] == domType) && (recentTypes[2] == domType) && (pc->lastMI2 > 2.5))
+			pc->PostClass[recentTypes[1]][0] = PVC ;
 
 		// Otherwise post classify this beat as UNKNOWN.
 
-		else PostClass[recentTypes[1]][0] = UNKNOWN ;
+		else pc->PostClass[recentTypes[1]][0] = UNKNOWN ;
 
 		// If the beat is premature followed by a compensitory pause, post
 		// classify the rhythm as PVC.
 
 		if(((normRR-(normRR>>3)) > recentRRs[1]) && ((recentRRs[0]-(recentRRs[0]>>3)) > normRR))
-			PCRhythm[recentTypes[1]][0] = PVC ;
+			pc->PCRhythm[recentTypes[1]][0] = PVC ;
 
 		// Otherwise, post classify the rhythm as the same as the
 		// regular rhythm classification.
 
-		else PCRhythm[recentTypes[1]][0] = lastRC ;
+		else pc->PCRhythm[recentTypes[1]][0] = pc->lastRC ;
 		}
 
-	lastWidth = width ;
-	lastMI2 = mi2 ;
-	lastRC = rhythmClass ;
+	pc->lastWidth = width ;
+	pc->lastMI2 = mi2 ;
+	pc->lastRC = rhythmClass ;
 	}
 
 
@@ -183,18 +179,19 @@ void PostClassify(int *recentTypes, int domType, int *recentRRs, int width, doub
 	last eight of a given beat type have been post classified as PVC.
 *************************************************************************/
 
-int CheckPostClass(int type)
+int CheckPostClass(OseaContext *ctx, int type)
 	{
+	OseaPostClas *pc = &ctx->postclas ;
 	int i, pvcs4 = 0, pvcs8 ;
 
 	if(type == MAXTYPES)
 		return(UNKNOWN) ;
 
 	for(i = 0; i < 4; ++i)
-		if(PostClass[type][i] == PVC)
+		if(pc->PostClass[type][i] == PVC)
 			++pvcs4 ;
 	for(pvcs8=pvcs4; i < 8; ++i)
-		if(PostClass[type][i] == PVC)
+		if(pc->PostClass[type][i] == PVC)
 			++pvcs8 ;
 
 	if((pvcs4 >= 3) || (pvcs8 >= 6))
@@ -209,20 +206,21 @@ int CheckPostClass(int type)
 	Call it a PVC if 2 of the last 8 were regular.
 ****************************************************************************/
 
-int CheckPCRhythm(int type)
+int CheckPCRhythm(OseaContext *ctx, int type)
 	{
+	OseaPostClas *pc = &ctx->postclas ;
 	int i, normCount, n ;
 
 
 	if(type == MAXTYPES)
 		return(UNKNOWN) ;
 
-	if(GetBeatTypeCount(type) < 9)
-		n = GetBeatTypeCount(type)-1 ;
+	if(GetBeatTypeCount(ctx,type) < 9)
+		n = GetBeatTypeCount(ctx,type)-1 ;
 	else n = 8 ;
 
 	for(i = normCount = 0; i < n; ++i)
-		if(PCRhythm[type][i] == NORMAL)
+		if(pc->PCRhythm[type][i] == NORMAL)
 			++normCount;
 	if(normCount >= 7)
 		return(NORMAL) ;
@@ -33,7 +33,7 @@ definitions in qrsdet.h.  QRSDet is the only function that needs to be
 visable outside of these files.
 
 Syntax:
-	int QRSDet(int ecgSample, int init) ;
+	int QRSDet(OseaContext *ctx, int ecgSample, int init) ;
 
 Description:
 	QRSDet() implements a modified version of the QRS detection
@@ -44,13 +44,17 @@ Description:
 	IEEE Trans. Biomed. Eng., BME-33, pp. 1158-1165, 1987.
 
 	Consecutive ECG samples are passed to QRSDet.  QRSDet was
-	designed for a 200 Hz sample rate.  QRSDet contains a number
-	of static variables that it uses to adapt to different ECG
+	designed for a 200 Hz sample rate.  QRSDet keeps a number
+	of variables in ctx that it uses to adapt to different ECG
 	signals.  These variables can be reset by passing any value
 	not equal to 0 in init.
 
 	Note: QRSDet() requires filters in QRSFilt.cpp
 
+	QRSDetFiltered(OseaContext *ctx, int ecgSample, int fdatum) does the
+	same as QRSDet() for a sample that has already been filtered with
+	QRSFilter() or QRSFilterBlock().
+
 Returns:
 	When a QRS complex is detected QRSDet returns the detection delay.
 
@@ -64,18 +68,17 @@ Returns:
 #endif
 
 #include <math.h>
-#include "qrsdet.h"
-#define PRE_BLANK	MS200
+#include "osea.h"
 
 
 // External Prototypes.
 
-int QRSFilter(int datum, int init) ;
-int deriv1( int x0, int init ) ;
+int QRSFilter(OseaContext *ctx, int datum, int init) ;
+int deriv1(OseaDeriv *d, int x0, int init ) ;
 
 // Local Prototypes.
 
-int Peak( int datum, int init ) ;
+int Peak(OseaQRSDet *q, int datum, int init ) ;
 int median(int *array, int datnum) ;
 int thresh(int qmedian, int nmedian) ;
 int BLSCheck(int *dBuf,int dbPtr,int *maxder) ;
@@ -83,26 +86,14 @@ int BLSCheck(int *dBuf,int dbPtr,int *maxder) ;
 int earlyThresh(int qmedian, int nmedian) ;
 
 
-double TH = 0.475  ;
-
-int DDBuffer[DER_DELAY], DDPtr ;	/* Buffer holding derivative data. */
-int Dly  = 0 ;
+const double TH = 0.475  ;
 
 const int MEMMOVELEN = 7*sizeof(int);
 
-int QRSDet( int datum, int init )
+int QRSDet(OseaContext *ctx, int datum, int init )
 	{
-	static int det_thresh, qpkcnt = 0 ;
-	static int qrsbuf[8], noise[8], rrbuf[8] ;
-	static int rsetBuff[8], rsetCount = 0 ;
-	static int nmedian, qmedian, rrmedian ;
-	static int count, sbpeak = 0, sbloc, sbcount = MS1500 ;
-	static int maxder, lastmax ;
-	static int initBlank, initMax ;
-	static int preBlankCnt, tempPeak ;
-	
-	int fdatum, QrsDelay = 0 ;
-	int i, newPeak, aPeak ;
+	OseaQRSDet *q = &ctx->qrsdet ;
+	int i ;
 
 /*	Initialize all buffers to 0 on the first call.	*/
 
@@ -110,50 +101,56 @@ int QRSDet( int datum, int init )
 		{
 		for(i = 0; i < 8; ++i)
 			{
-			noise[i] = 0 ;	/* Initialize noise buffer */
-			rrbuf[i] = MS1000 ;/* and R-to-R interval buffer. */
+			q->noise[i] = 0 ;	/* Initialize noise buffer */
+			q->rrbuf[i] = MS1000 ;/* and R-to-R interval buffer. */
 			}
 
-		qpkcnt = maxder = lastmax = count = sbpeak = 0 ;
-		initBlank = initMax = preBlankCnt = DDPtr = 0 ;
-		sbcount = MS1500 ;
-		QRSFilter(0,1) ;	/* initialize filters. */
-		Peak(0,1) ;
+		q->qpkcnt = q->maxder = q->lastmax = q->count = q->sbpeak = 0 ;
+		q->initBlank = q->initMax = q->preBlankCnt = q->DDPtr = 0 ;
+		q->sbcount = MS1500 ;
+		QRSFilter(ctx,0,1) ;	/* initialize filters. */
+		Peak(q,0,1) ;
 		}
 
-	fdatum = QRSFilter(datum,0) ;	/* Filter data. */
+	return(QRSDetFiltered(ctx,datum,QRSFilter(ctx,datum,0))) ;	/* Filter data. */
+	}
 
+int QRSDetFiltered(OseaContext *ctx, int datum, int fdatum)
+	{
+	OseaQRSDet *q = &ctx->qrsdet ;
+	int QrsDelay = 0 ;
+	int i, newPeak, aPeak ;
 
 	/* Wait until normal detector is ready before calling early detections. */
 
-	aPeak = Peak(fdatum,0) ;
+	aPeak = Peak(q,fdatum,0) ;
 
 	// Hold any peak that is detected for 200 ms
 	// in case a bigger one comes along.  There
 	// can only be one QRS complex in any 200 ms window.
 
 	newPeak = 0 ;
-	if(aPeak && !preBlankCnt)			// If there has been no peak for 200 ms
+	if(aPeak && !q->preBlankCnt)			// If there has been no peak for 200 ms
 		{										// save this one and start counting.
-		tempPeak = aPeak ;
-		preBlankCnt = PRE_BLANK ;			// MS200
+		q->tempPeak = aPeak ;
+		q->preBlankCnt = PRE_BLANK ;			// MS200
 		}
 
-	else if(!aPeak && preBlankCnt)	// If we have held onto a peak for
+	else if(!aPeak && q->preBlankCnt)	// If we have held onto a peak for
 		{										// 200 ms pass it on for evaluation.
-		if(--preBlankCnt == 0)
-			newPeak = tempPeak ;
+		if(--q->preBlankCnt == 0)
+			newPeak = q->tempPeak ;
 		}
 
 	else if(aPeak)							// If we were holding a peak, but
 		{										// this ones bigger, save it and
-		if(aPeak > tempPeak)				// start counting to 200 ms again.
+		if(aPeak > q->tempPeak)				// start counting to 200 ms again.
 			{
-			tempPeak = aPeak ;
-			preBlankCnt = PRE_BLANK ; // MS200
+			q->tempPeak = aPeak ;
+			q->preBlankCnt = PRE_BLANK ; // MS200
 			}
-		else if(--preBlankCnt == 0)
-			newPeak = tempPeak ;
+		else if(--q->preBlankCnt == 0)
+			newPeak = q->tempPeak ;
 		}
 
 /*	newPeak = 0 ;
@@ -166,39 +163,39 @@ int QRSDet( int datum, int init )
 	/* Save derivative of raw signal for T-wave and baseline
 	   shift discrimination. */
 	
-	DDBuffer[DDPtr] = deriv1( datum, 0 ) ;
-	if(++DDPtr == DER_DELAY)
-		DDPtr = 0 ;
+	q->DDBuffer[q->DDPtr] = deriv1(&ctx->qrsfilt.deriv1, datum, 0 ) ;
+	if(++q->DDPtr == DER_DELAY)
+		q->DDPtr = 0 ;
 
 	/* Initialize the qrs peak buffer with the first eight 	*/
 	/* local maximum peaks detected.						*/
 
-	if( qpkcnt < 8 )
+	if( q->qpkcnt < 8 )
 		{
-		++count ;
-		if(newPeak > 0) count = WINDOW_WIDTH ;
-		if(++initBlank == MS1000)
+		++q->count ;
+		if(newPeak > 0) q->count = WINDOW_WIDTH ;
+		if(++q->initBlank == MS1000)
 			{
-			initBlank = 0 ;
-			qrsbuf[qpkcnt] = initMax ;
-			initMax = 0 ;
-			++qpkcnt ;
-			if(qpkcnt == 8)
+			q->initBlank = 0 ;
+			q->qrsbuf[q->qpkcnt] = q->initMax ;
+			q->initMax = 0 ;
+			++q->qpkcnt ;
+			if(q->qpkcnt == 8)
 				{
-				qmedian = median( qrsbuf, 8 ) ;
-				nmedian = 0 ;
-				rrmedian = MS1000 ;
-				sbcount = MS1500+MS150 ;
-				det_thresh = thresh(qmedian,nmedian) ;
+				q->qmedian = median( q->qrsbuf, 8 ) ;
+				q->nmedian = 0 ;
+				q->rrmedian = MS1000 ;
+				q->sbcount = MS1500+MS150 ;
+				q->det_thresh = thresh(q->qmedian,q->nmedian) ;
 				}
 			}
-		if( newPeak > initMax )
-			initMax = newPeak ;
+		if( newPeak > q->initMax )
+			q->initMax = newPeak ;
 		}
 
 	else	/* Else test for a qrs. */
 		{
-		++count ;
+		++q->count ;
 		if(newPeak > 0)
 			{
 			
@@ -207,31 +204,31 @@ int QRSDet( int datum, int init )
 			   for T-wave and baseline shift rejection.  Only consider this
 			   peak if it doesn't seem to be a base line shift. */
 			   
-			if(!BLSCheck(DDBuffer, DDPtr, &maxder))
+			if(!BLSCheck(q->DDBuffer, q->DDPtr, &q->maxder))
 				{
 
 
 				// Classify the beat as a QRS complex
 				// if the peak is larger than the detection threshold.
 
-				if(newPeak > det_thresh)
+				if(newPeak > q->det_thresh)
 					{
-					memmove(&qrsbuf[1], qrsbuf, MEMMOVELEN) ;
-					qrsbuf[0] = newPeak ;
-					qmedian = median(qrsbuf,8) ;
-					det_thresh = thresh(qmedian,nmedian) ;
-					memmove(&rrbuf[1], rrbuf, MEMMOVELEN) ;
-					rrbuf[0] = count - WINDOW_WIDTH ;
-					rrmedian = median(rrbuf,8) ;
-					sbcount = rrmedian + (rrmedian >> 1) + WINDOW_WIDTH ;
-					count = WINDOW_WIDTH ;
-
-					sbpeak = 0 ;
-
-					lastmax = maxder ;
-					maxder = 0 ;
+					memmove(&q->qrsbuf[1], q->qrsbuf, MEMMOVELEN) ;
+					q->qrsbuf[0] = newPeak ;
+					q->qmedian = median(q->qrsbuf,8) ;
+					q->det_thresh = thresh(q->qmedian,q->nmedian) ;
+					memmove(&q->rrbuf[1], q->rrbuf, MEMMOVELEN) ;
+					q->rrbuf[0] = q->count - WINDOW_WIDTH ;
+					q->rrmedian = median(q->rrbuf,8) ;
+					q->sbcount = q->rrmedian + (q->rrmedian >> 1) + WINDOW_WIDTH ;
+					q->count = WINDOW_WIDTH ;
+
+					q->sbpeak = 0 ;
+
+					q->lastmax = q->maxder ;
+					q->maxder = 0 ;
 					QrsDelay =  WINDOW_WIDTH + FILTER_DELAY ;
-					initBlank = initMax = rsetCount = 0 ;
+					q->initBlank = q->initMax = q->rsetCount = 0 ;
 
 			//		preBlankCnt = PRE_BLANK ;
 					}
@@ -242,19 +239,19 @@ int QRSDet( int datum, int init )
 
 				else
 					{
-					memmove(&noise[1],noise,MEMMOVELEN) ;
-					noise[0] = newPeak ;
-					nmedian = median(noise,8) ;
-					det_thresh = thresh(qmedian,nmedian) ;
+					memmove(&q->noise[1],q->noise,MEMMOVELEN) ;
+					q->noise[0] = newPeak ;
+					q->nmedian = median(q->noise,8) ;
+					q->det_thresh = thresh(q->qmedian,q->nmedian) ;
 
 					// Don't include early peaks (which might be T-waves)
 					// in the search back process.  A T-wave can mask
 					// a small following QRS.
 
-					if((newPeak > sbpeak) && ((count-WINDOW_WIDTH) >= MS360))
+					if((newPeak > q->sbpeak) && ((q->count-WINDOW_WIDTH) >= MS360))
 						{
-						sbpeak = newPeak ;
-						sbloc = count  - WINDOW_WIDTH ;
+						q->sbpeak = newPeak ;
+						q->sbloc = q->count  - WINDOW_WIDTH ;
 						}
 					}
 				}
@@ -263,58 +260,58 @@ int QRSDet( int datum, int init )
 		/* Test for search back condition.  If a QRS is found in  */
 		/* search back update the QRS buffer and det_thresh.      */
 
-		if((count > sbcount) && (sbpeak > (det_thresh >> 1)))
+		if((q->count > q->sbcount) && (q->sbpeak > (q->det_thresh >> 1)))
 			{
-			memmove(&qrsbuf[1],qrsbuf,MEMMOVELEN) ;
-			qrsbuf[0] = sbpeak ;
-			qmedian = median(qrsbuf,8) ;
-			det_thresh = thresh(qmedian,nmedian) ;
-			memmove(&rrbuf[1],rrbuf,MEMMOVELEN) ;
-			rrbuf[0] = sbloc ;
-			rrmedian = median(rrbuf,8) ;
-			sbcount = rrmedian + (rrmedian >> 1) + WINDOW_WIDTH ;
-			QrsDelay = count = count - sbloc ;
+			memmove(&q->qrsbuf[1],q->qrsbuf,MEMMOVELEN) ;
+			q->qrsbuf[0] = q->sbpeak ;
+			q->qmedian = median(q->qrsbuf,8) ;
+			q->det_thresh = thresh(q->qmedian,q->nmedian) ;
+			memmove(&q->rrbuf[1],q->rrbuf,MEMMOVELEN) ;
+			q->rrbuf[0] = q->sbloc ;
+			q->rrmedian = median(q->rrbuf,8) ;
+			q->sbcount = q->rrmedian + (q->rrmedian >> 1) + WINDOW_WIDTH ;
+			QrsDelay = q->count = q->count - q->sbloc ;
 			QrsDelay += FILTER_DELAY ;
-			sbpeak = 0 ;
-			lastmax = maxder ;
-			maxder = 0 ;
-			initBlank = initMax = rsetCount = 0 ;
+			q->sbpeak = 0 ;
+			q->lastmax = q->maxder ;
+			q->maxder = 0 ;
+			q->initBlank = q->initMax = q->rsetCount = 0 ;
 			}
 		}
 
 	// In the background estimate threshold to replace adaptive threshold
 	// if eight seconds elapses without a QRS detection.
 
-	if( qpkcnt == 8 )
+	if( q->qpkcnt == 8 )
 		{
-		if(++initBlank == MS1000)
+		if(++q->initBlank == MS1000)
 			{
-			initBlank = 0 ;
-			rsetBuff[rsetCount] = initMax ;
-			initMax = 0 ;
-			++rsetCount ;
+			q->initBlank = 0 ;
+			q->rsetBuff[q->rsetCount] = q->initMax ;
+			q->initMax = 0 ;
+			++q->rsetCount ;
 
 			// Reset threshold if it has been 8 seconds without
 			// a detection.
 
-			if(rsetCount == 8)
+			if(q->rsetCount == 8)
 				{
 				for(i = 0; i < 8; ++i)
 					{
-					qrsbuf[i] = rsetBuff[i] ;
-					noise[i] = 0 ;
+					q->qrsbuf[i] = q->rsetBuff[i] ;
+					q->noise[i] = 0 ;
 					}
-				qmedian = median( rsetBuff, 8 ) ;
-				nmedian = 0 ;
-				rrmedian = MS1000 ;
-				sbcount = MS1500+MS150 ;
-				det_thresh = thresh(qmedian,nmedian) ;
-				initBlank = initMax = rsetCount = 0 ;
-            sbpeak = 0 ;
+				q->qmedian = median( q->rsetBuff, 8 ) ;
+				q->nmedian = 0 ;
+				q->rrmedian = MS1000 ;
+				q->sbcount = MS1500+MS150 ;
+				q->det_thresh = thresh(q->qmedian,q->nmedian) ;
+				q->initBlank = q->initMax = q->rsetCount = 0 ;
+            q->sbpeak = 0 ;
 				}
 			}
-		if( newPeak > initMax )
-			initMax = newPeak ;
+		if( newPeak > q->initMax )
+			q->initMax = newPeak ;
 		}
 
 	return(QrsDelay) ;
@@ -325,40 +322,40 @@ int QRSDet( int datum, int init )
 * when the signal returns to half its peak height, or 
 **************************************************************/
 
-int Peak( int datum, int init )
+int Peak(OseaQRSDet *q, int datum, int init )
 	{
-	static int max = 0, timeSinceMax = 0, lastDatum ;
+	OseaPeak *p = &q->peak ;
 	int pk = 0 ;
 
 	if(init)
-		max = timeSinceMax = 0 ;
+		p->max = p->timeSinceMax = 0 ;
 		
-	if(timeSinceMax > 0)
-		++timeSinceMax ;
+	if(p->timeSinceMax > 0)
+		++p->timeSinceMax ;
 
-	if((datum > lastDatum) && (datum > max))
+	if((datum > p->lastDatum) && (datum > p->max))
 		{
-		max = datum ;
-		if(max > 2)
-			timeSinceMax = 1 ;
+		p->max = datum ;
+		if(p->max > 2)
+			p->timeSinceMax = 1 ;
 		}
 
-	else if(datum < (max >> 1))
+	else if(datum < (p->max >> 1))
 		{
-		pk = max ;
-		max = 0 ;
-		timeSinceMax = 0 ;
-		Dly = 0 ;
+		pk = p->max ;
+		p->max = 0 ;
+		p->timeSinceMax = 0 ;
+		q->Dly = 0 ;
 		}
 
-	else if(timeSinceMax > MS95)
+	else if(p->timeSinceMax > MS95)
 		{
-		pk = max ;
-		max = 0 ;
-		timeSinceMax = 0 ;
-		Dly = 3 ;
+		pk = p->max ;
+		p->max = 0 ;
+		p->timeSinceMax = 0 ;
+		q->Dly = 3 ;
 		}
-	lastDatum = datum ;
+	p->lastDatum = datum ;
 	return(pk) ;
 	}
 
@@ -33,18 +33,32 @@ MA 02143 USA).  For updates to this software, please visit our website
 	Revisions:
 		5/13: Filter implementations have been modified to allow simplified
 			modification for different sample rates.
+		QRSFilterBlock() added for filtering blocks of samples.
 *******************************************************************************/
 #include <math.h>
-#include "qrsdet.h"
+#include <stdlib.h>	// For abs()
+#include <string.h>	// For memcpy()
+#include "osea.h"
+
+#define QRSFILT_BLOCK_LENGTH	128	// Samples filtered at a time by
+												// QRSFilterBlock().
+#define QRSFILT_HISTORY_LENGTH	64	// At least HPBUFFER_LGTH, the longest
+												// filter buffer (up to 500 Hz).
+
 // Local Prototypes.
-int lpfilt( int datum ,int init) ;
-int hpfilt( int datum, int init ) ;
-int deriv1( int x0, int init ) ;
-int deriv2( int x0, int init ) ;
-int mvwint(int datum, int init) ;
+int lpfilt(OseaLPFilt *f, int datum ,int init) ;
+int hpfilt(OseaHPFilt *f, int datum, int init ) ;
+int deriv1(OseaDeriv *d, int x0, int init ) ;
+int deriv2(OseaDeriv *d, int x0, int init ) ;
+int mvwint(OseaMvwInt *f, int datum, int init) ;
+static void lpfiltBlock(OseaLPFilt *f, const int *in, int *out, int n) ;
+static void hpfiltBlock(OseaHPFilt *f, const int *in, int *out, int n) ;
+static void derivBlock(OseaDeriv *d, const int *in, int *out, int n) ;
+static void mvwintBlock(OseaMvwInt *f, const int *in, int *out, int n) ;
+static void unwrap(int *x, const int *data, int ptr, int length) ;
 /******************************************************************************
 * Syntax:
-*	int QRSFilter(int datum, int init) ;
+*	int QRSFilter(OseaContext *ctx, int datum, int init) ;
 * Description:
 *	QRSFilter() takes samples of an ECG signal as input and returns a sample of
 *	a signal that is an estimate of the local energy in the QRS bandwidth.  In
@@ -53,28 +67,74 @@ int mvwint(int datum, int init) ;
 *  sampled at 200 samples per second, but they work nearly as well at sample
 *	frequencies from 150 to 250 samples per second.
 *
-*	The filter buffers and static variables are reset if a value other than
+*	The filter buffers and variables in ctx are reset if a value other than
 *	0 is passed to QRSFilter through init.
 *******************************************************************************/
-int QRSFilter(int datum,int init)
+int QRSFilter(OseaContext *ctx, int datum,int init)
 	{
+	OseaQRSFilt *f = &ctx->qrsfilt ;
 	int fdatum ;
 	if(init)
 		{
-		hpfilt( 0, 1 ) ;		// Initialize filters.
-		lpfilt( 0, 1 ) ;
-		mvwint( 0, 1 ) ;
-		deriv1( 0, 1 ) ;
-		deriv2( 0, 1 ) ;
+		hpfilt(&f->hp, 0, 1 ) ;		// Initialize filters.
+		lpfilt(&f->lp, 0, 1 ) ;
+		mvwint(&f->mvwint, 0, 1 ) ;
+		deriv1(&f->deriv1, 0, 1 ) ;
+		deriv2(&f->deriv2, 0, 1 ) ;
 		}
-	fdatum = lpfilt( datum, 0 ) ;		// Low pass filter data.
-	fdatum = hpfilt( fdatum, 0 ) ;	// High pass filter data.
-	fdatum = deriv2( fdatum, 0 ) ;	// Take the derivative.
+	fdatum = lpfilt(&f->lp, datum, 0 ) ;		// Low pass filter data.
+	fdatum = hpfilt(&f->hp, fdatum, 0 ) ;	// High pass filter data.
+	fdatum = deriv2(&f->deriv2, fdatum, 0 ) ;	// Take the derivative.
 	fdatum = abs(fdatum) ;				// Take the absolute value.
-	fdatum = mvwint( fdatum, 0 ) ;	// Average over an 80 ms window .
+	fdatum = mvwint(&f->mvwint, fdatum, 0 ) ;	// Average over an 80 ms window .
 	return(fdatum) ;
 	}
 
+/******************************************************************************
+* Syntax:
+*	void QRSFilterBlock(OseaContext *ctx, const int *data, int *fdata, int n) ;
+* Description:
+*	QRSFilterBlock() filters n samples from data into fdata, with exactly
+*	the same results as n calls to QRSFilter().  Instead of running the
+*	whole filter chain for each sample, each filter is run over a block of
+*	QRSFILT_BLOCK_LENGTH samples at a time.  The samples that a filter needs
+*	from before the block are copied from its circular buffer in front of
+*	the block, so the filters index plain arrays without wrapping around,
+*	and the non-recursive parts of the filters can be vectorized by the
+*	compiler.
+*
+*	The filters keep their state in the same buffers as with QRSFilter(),
+*	so the two can be used in turns.  data and fdata may be the same.
+*******************************************************************************/
+void QRSFilterBlock(OseaContext *ctx, const int *data, int *fdata, int n)
+	{
+	OseaQRSFilt *f = &ctx->qrsfilt ;
+	int i, len ;
+	while(n > 0)
+		{
+		len = (n < QRSFILT_BLOCK_LENGTH) ? n : QRSFILT_BLOCK_LENGTH ;
+		lpfiltBlock(&f->lp, data, fdata, len) ;			// Low pass filter data.
+		hpfiltBlock(&f->hp, fdata, fdata, len) ;		// High pass filter data.
+		derivBlock(&f->deriv2, fdata, fdata, len) ;	// Take the derivative.
+		for(i = 0; i < len; ++i)
+			fdata[i] = abs(fdata[i]) ;						// Take the absolute value.
+		mvwintBlock(&f->mvwint, fdata, fdata, len) ;	// Average over an 80 ms window.
+		data += len ;
+		fdata += len ;
+		n -= len ;
+		}
+	}
+
+/*****************************************************************************
+*  unwrap() copies a circular buffer to x in time order, oldest sample first.
+*  ptr is the index of the oldest sample in the buffer.
+*****************************************************************************/
+static void unwrap(int *x, const int *data, int ptr, int length)
+	{
+	memcpy(x, &data[ptr], (length-ptr)*sizeof(int)) ;
+	memcpy(&x[length-ptr], data, ptr*sizeof(int)) ;
+	}
+
 /*************************************************************************
 *  lpfilt() implements the digital filter represented by the difference
 *  equation:
@@ -84,32 +144,56 @@ int QRSFilter(int datum,int init)
 *	Note that the filter delay is (LPBUFFER_LGTH/2)-1
 *
 **************************************************************************/
-int lpfilt( int datum ,int init)
+int lpfilt(OseaLPFilt *f, int datum ,int init)
 	{
-	static long y1 = 0, y2 = 0 ;
-	static int data[LPBUFFER_LGTH], ptr = 0 ;
 	long y0 ;
 	int output, halfPtr ;
 	if(init)
 		{
-		for(ptr = 0; ptr < LPBUFFER_LGTH; ++ptr)
-			data[ptr] = 0 ;
-		y1 = y2 = 0 ;
-		ptr = 0 ;
+		for(f->ptr = 0; f->ptr < LPBUFFER_LGTH; ++f->ptr)
+			f->data[f->ptr] = 0 ;
+		f->y1 = f->y2 = 0 ;
+		f->ptr = 0 ;
 		}
-	halfPtr = ptr-(LPBUFFER_LGTH/2) ;	// Use halfPtr to index
+	halfPtr = f->ptr-(LPBUFFER_LGTH/2) ;	// Use halfPtr to index
 	if(halfPtr < 0)							// to x[n-6].
 		halfPtr += LPBUFFER_LGTH ;
-	y0 = (y1 << 1) - y2 + datum - (data[halfPtr] << 1) + data[ptr] ;
-	y2 = y1;
-	y1 = y0;
+	y0 = (f->y1 << 1) - f->y2 + datum - (f->data[halfPtr] << 1) + f->data[f->ptr] ;
+	f->y2 = f->y1;
+	f->y1 = y0;
 	output = y0 / ((LPBUFFER_LGTH*LPBUFFER_LGTH)/4);
-	data[ptr] = datum ;			// Stick most recent sample into
-	if(++ptr == LPBUFFER_LGTH)	// the circular buffer and update
-		ptr = 0 ;					// the buffer pointer.
+	f->data[f->ptr] = datum ;			// Stick most recent sample into
+	if(++f->ptr == LPBUFFER_LGTH)	// the circular buffer and update
+		f->ptr = 0 ;					// the buffer pointer.
 	return(output) ;
 	}
 
+/*************************************************************************
+*  lpfiltBlock() runs lpfilt() over n (at most QRSFILT_BLOCK_LENGTH)
+*  samples.  x[] holds the previous LPBUFFER_LGTH samples followed by the
+*  new ones.
+**************************************************************************/
+static void lpfiltBlock(OseaLPFilt *f, const int *in, int *out, int n)
+	{
+	int x[QRSFILT_HISTORY_LENGTH + QRSFILT_BLOCK_LENGTH], *xn = &x[LPBUFFER_LGTH] ;
+	long y[QRSFILT_BLOCK_LENGTH], y0 ;
+	int i ;
+	unwrap(x, f->data, f->ptr, LPBUFFER_LGTH) ;
+	memcpy(xn, in, n*sizeof(int)) ;
+	for(i = 0; i < n; ++i)
+		y[i] = (long) xn[i] - (xn[i-LPBUFFER_LGTH/2] << 1) + xn[i-LPBUFFER_LGTH] ;
+	for(i = 0; i < n; ++i)
+		{
+		y0 = (f->y1 << 1) - f->y2 + y[i] ;
+		f->y2 = f->y1 ;
+		f->y1 = y[i] = y0 ;
+		}
+	for(i = 0; i < n; ++i)
+		out[i] = y[i] / ((LPBUFFER_LGTH*LPBUFFER_LGTH)/4) ;
+	memcpy(f->data, &x[n], LPBUFFER_LGTH*sizeof(int)) ;
+	f->ptr = 0 ;
+	}
+
 /******************************************************************************
 *  hpfilt() implements the high pass filter represented by the following
 *  difference equation:
@@ -119,28 +203,44 @@ int lpfilt( int datum ,int init)
 *
 *  Filter delay is (HPBUFFER_LGTH-1)/2
 ******************************************************************************/
-int hpfilt( int datum, int init )
+int hpfilt(OseaHPFilt *f, int datum, int init )
 	{
-	static long y=0 ;
-	static int data[HPBUFFER_LGTH], ptr = 0 ;
 	int z, halfPtr ;
 	if(init)
 		{
-		for(ptr = 0; ptr < HPBUFFER_LGTH; ++ptr)
-			data[ptr] = 0 ;
-		ptr = 0 ;
-		y = 0 ;
+		for(f->ptr = 0; f->ptr < HPBUFFER_LGTH; ++f->ptr)
+			f->data[f->ptr] = 0 ;
+		f->ptr = 0 ;
+		f->y = 0 ;
 		}
-	y += datum - data[ptr];
-	halfPtr = ptr-(HPBUFFER_LGTH/2) ;
+	f->y += datum - f->data[f->ptr];
+	halfPtr = f->ptr-(HPBUFFER_LGTH/2) ;
 	if(halfPtr < 0)
 		halfPtr += HPBUFFER_LGTH ;
-	z = data[halfPtr] - (y / HPBUFFER_LGTH);
-	data[ptr] = datum ;
-	if(++ptr == HPBUFFER_LGTH)
-		ptr = 0 ;
+	z = f->data[halfPtr] - (f->y / HPBUFFER_LGTH);
+	f->data[f->ptr] = datum ;
+	if(++f->ptr == HPBUFFER_LGTH)
+		f->ptr = 0 ;
 	return( z );
 	}
+
+/******************************************************************************
+*  hpfiltBlock() runs hpfilt() over n (at most QRSFILT_BLOCK_LENGTH) samples.
+******************************************************************************/
+static void hpfiltBlock(OseaHPFilt *f, const int *in, int *out, int n)
+	{
+	int x[QRSFILT_HISTORY_LENGTH + QRSFILT_BLOCK_LENGTH], *xn = &x[HPBUFFER_LGTH] ;
+	long y[QRSFILT_BLOCK_LENGTH] ;
+	int i ;
+	unwrap(x, f->data, f->ptr, HPBUFFER_LGTH) ;
+	memcpy(xn, in, n*sizeof(int)) ;
+	for(i = 0; i < n; ++i)
+		y[i] = f->y += xn[i] - xn[i-HPBUFFER_LGTH] ;
+	for(i = 0; i < n; ++i)
+		out[i] = xn[i-HPBUFFER_LGTH/2] - (y[i] / HPBUFFER_LGTH) ;
+	memcpy(f->data, &x[n], HPBUFFER_LGTH*sizeof(int)) ;
+	f->ptr = 0 ;
+	}
 /*****************************************************************************
 *  deriv1 and deriv2 implement derivative approximations represented by
 *  the difference equation:
@@ -149,66 +249,93 @@ int hpfilt( int datum, int init )
 *
 *  Filter delay is DERIV_LENGTH/2
 *****************************************************************************/
-int deriv1(int x, int init)
+int deriv1(OseaDeriv *d, int x, int init)
 	{
-	static int derBuff[DERIV_LENGTH], derI = 0 ;
 	int y ;
 	if(init != 0)
 		{
-		for(derI = 0; derI < DERIV_LENGTH; ++derI)
-			derBuff[derI] = 0 ;
-		derI = 0 ;
+		for(d->derI = 0; d->derI < DERIV_LENGTH; ++d->derI)
+			d->derBuff[d->derI] = 0 ;
+		d->derI = 0 ;
 		return(0) ;
 		}
-	y = x - derBuff[derI] ;
-	derBuff[derI] = x ;
-	if(++derI == DERIV_LENGTH)
-		derI = 0 ;
+	y = x - d->derBuff[d->derI] ;
+	d->derBuff[d->derI] = x ;
+	if(++d->derI == DERIV_LENGTH)
+		d->derI = 0 ;
 	return(y) ;
 	}
-int deriv2(int x, int init)
+int deriv2(OseaDeriv *d, int x, int init)
 	{
-	static int derBuff[DERIV_LENGTH], derI = 0 ;
 	int y ;
 	if(init != 0)
 		{
-		for(derI = 0; derI < DERIV_LENGTH; ++derI)
-			derBuff[derI] = 0 ;
-		derI = 0 ;
+		for(d->derI = 0; d->derI < DERIV_LENGTH; ++d->derI)
+			d->derBuff[d->derI] = 0 ;
+		d->derI = 0 ;
 		return(0) ;
 		}
-	y = x - derBuff[derI] ;
-	derBuff[derI] = x ;
-	if(++derI == DERIV_LENGTH)
-		derI = 0 ;
+	y = x - d->derBuff[d->derI] ;
+	d->derBuff[d->derI] = x ;
+	if(++d->derI == DERIV_LENGTH)
+		d->derI = 0 ;
 	return(y) ;
 	}
 
+static void derivBlock(OseaDeriv *d, const int *in, int *out, int n)
+	{
+	int x[QRSFILT_HISTORY_LENGTH + QRSFILT_BLOCK_LENGTH], *xn = &x[DERIV_LENGTH] ;
+	int i ;
+	unwrap(x, d->derBuff, d->derI, DERIV_LENGTH) ;
+	memcpy(xn, in, n*sizeof(int)) ;
+	for(i = 0; i < n; ++i)
+		out[i] = xn[i] - xn[i-DERIV_LENGTH] ;
+	memcpy(d->derBuff, &x[n], DERIV_LENGTH*sizeof(int)) ;
+	d->derI = 0 ;
+	}
+
 
 /*****************************************************************************
 * mvwint() implements a moving window integrator.  Actually, mvwint() averages
 * the signal values over the last WINDOW_WIDTH samples.
 *****************************************************************************/
-int mvwint(int datum, int init)
+int mvwint(OseaMvwInt *f, int datum, int init)
 	{
-	static long sum = 0 ;
-	static int data[WINDOW_WIDTH], ptr = 0 ;
 	int output;
 	if(init)
 		{
-		for(ptr = 0; ptr < WINDOW_WIDTH ; ++ptr)
-			data[ptr] = 0 ;
-		sum = 0 ;
-		ptr = 0 ;
+		for(f->ptr = 0; f->ptr < WINDOW_WIDTH ; ++f->ptr)
+			f->data[f->ptr] = 0 ;
+		f->sum = 0 ;
+		f->ptr = 0 ;
 		}
-	sum += datum ;
-	sum -= data[ptr] ;
-	data[ptr] = datum ;
-	if(++ptr == WINDOW_WIDTH)
-		ptr = 0 ;
-	if((sum / WINDOW_WIDTH) > 32000)
+	f->sum += datum ;
+	f->sum -= f->data[f->ptr] ;
+	f->data[f->ptr] = datum ;
+	if(++f->ptr == WINDOW_WIDTH)
+		f->ptr = 0 ;
+	if((f->sum / WINDOW_WIDTH) > 32000)
 		output = 32000 ;
 	else
-		output = sum / WINDOW_WIDTH ;
+		output = f->sum / WINDOW_WIDTH ;
 	return(output) ;
 	}
+
+static void mvwintBlock(OseaMvwInt *f, const int *in, int *out, int n)
+	{
+	int x[QRSFILT_HISTORY_LENGTH + QRSFILT_BLOCK_LENGTH], *xn = &x[WINDOW_WIDTH] ;
+	long sum[QRSFILT_BLOCK_LENGTH] ;
+	int i ;
+	unwrap(x, f->data, f->ptr, WINDOW_WIDTH) ;
+	memcpy(xn, in, n*sizeof(int)) ;
+	for(i = 0; i < n; ++i)
+		{
+		f->sum += xn[i] ;
+		f->sum -= xn[i-WINDOW_WIDTH] ;
+		sum[i] = f->sum ;
+		}
+	for(i = 0; i < n; ++i)
+		out[i] = ((sum[i] / WINDOW_WIDTH) > 32000) ? 32000 : sum[i] / WINDOW_WIDTH ;
+	memcpy(f->data, &x[n], WINDOW_WIDTH*sizeof(int)) ;
+	f->ptr = 0 ;
+	}
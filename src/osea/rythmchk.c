@@ -47,6 +47,7 @@ MA 02143 USA).  For updates to this software, please visit our website
 
 #include "qrsdet.h"		// For time intervals.
 #include "ecgcodes.h"		// Defines codes of NORMAL, PVC, and UNKNOWN.
+#include "osea.h"		// For RBB_LENGTH and OseaContext.
 #include <stdlib.h>		// For abs()
 
 // Define RR interval types.
@@ -57,7 +58,6 @@ MA 02143 USA).  For updates to this software, please visit our website
 #define VN	3	// PVC-Normal interval.
 #define VV	4	// PVC-PVC interval.
 
-#define RBB_LENGTH	8
 #define LEARNING	0
 #define READY	1
 
@@ -69,20 +69,14 @@ int RRShort(int rr0,int rr1) ;
 int RRShort2(int *rrIntervals, int *rrTypes) ;
 int RRMatch2(int rr0,int rr1) ;
 
-// Global variables.
-int RRBuffer[RBB_LENGTH], RRTypes[RBB_LENGTH], BeatCount = 0;
-int ClassifyState	= LEARNING ;
-
-int BigeminyFlag ;
-
 /***************************************************************************
-	ResetRhythmChk() resets static variables used for rhythm classification.
+	ResetRhythmChk() resets the variables used for rhythm classification.
 ****************************************************************************/
 
-void ResetRhythmChk(void)
+void ResetRhythmChk(OseaContext *ctx)
 	{
-	BeatCount = 0 ;
-	ClassifyState = LEARNING ;
+	ctx->rhythmchk.BeatCount = 0 ;
+	ctx->rhythmchk.ClassifyState = LEARNING ;
 	}
 
 /*****************************************************************************
@@ -90,43 +84,44 @@ void ResetRhythmChk(void)
 	intervals, classifys the interval as NORMAL, PVC, or UNKNOWN.
 ******************************************************************************/
 
-int RhythmChk(int rr)
+int RhythmChk(OseaContext *ctx, int rr)
 	{
+	OseaRhythmChk *r = &ctx->rhythmchk ;
 	int i, regular = 1 ;
 	int NNEst, NVEst ;
 
-	BigeminyFlag = 0 ;
+	r->BigeminyFlag = 0 ;
 
 	// Wait for at least 4 beats before classifying anything.
 
-	if(BeatCount < 4)
+	if(r->BeatCount < 4)
 		{
-		if(++BeatCount == 4)
-			ClassifyState = READY ;
+		if(++r->BeatCount == 4)
+			r->ClassifyState = READY ;
 		}
 
 	// Stick the new RR interval into the RR interval Buffer.
 
 	for(i = RBB_LENGTH-1; i > 0; --i)
 		{
-		RRBuffer[i] = RRBuffer[i-1] ;
-		RRTypes[i] = RRTypes[i-1] ;
+		r->RRBuffer[i] = r->RRBuffer[i-1] ;
+		r->RRTypes[i] = r->RRTypes[i-1] ;
 		}
 
-	RRBuffer[0] = rr ;
+	r->RRBuffer[0] = rr ;
 
-	if(ClassifyState == LEARNING)
+	if(r->ClassifyState == LEARNING)
 		{
-		RRTypes[0] = QQ ;
+		r->RRTypes[0] = QQ ;
 		return(UNKNOWN) ;
 		}
 
 	// If we couldn't tell what the last interval was...
 
-	if(RRTypes[1] == QQ)
+	if(r->RRTypes[1] == QQ)
 		{
 		for(i = 0, regular = 1; i < 3; ++i)
-			if(RRMatch(RRBuffer[i],RRBuffer[i+1]) == 0)
+			if(RRMatch(r->RRBuffer[i],r->RRBuffer[i+1]) == 0)
 				regular = 0 ;
 
 		// If this, and the last three intervals matched, classify
@@ -134,7 +129,7 @@ int RhythmChk(int rr)
 
 		if(regular == 1)
 			{
-			RRTypes[0] = NN ;
+			r->RRTypes[0] = NN ;
 			return(NORMAL) ;
 			}
 
@@ -143,37 +138,37 @@ int RhythmChk(int rr)
 		// consecutive beats do not match.
 
 		for(i = 0, regular = 1; i < 6; ++i)
-			if(RRMatch(RRBuffer[i],RRBuffer[i+2]) == 0)
+			if(RRMatch(r->RRBuffer[i],r->RRBuffer[i+2]) == 0)
 				regular = 0 ;
 		for(i = 0; i < 6; ++i)
-			if(RRMatch(RRBuffer[i],RRBuffer[i+1]) != 0)
+			if(RRMatch(r->RRBuffer[i],r->RRBuffer[i+1]) != 0)
 				regular = 0 ;
 
 		if(regular == 1)
 			{
-			BigeminyFlag = 1 ;
-			if(RRBuffer[0] < RRBuffer[1])
+			r->BigeminyFlag = 1 ;
+			if(r->RRBuffer[0] < r->RRBuffer[1])
 				{
-				RRTypes[0] = NV ;
-				RRTypes[1] = VN ;
+				r->RRTypes[0] = NV ;
+				r->RRTypes[1] = VN ;
 				return(PVC) ;
 				}
 			else
 				{
-				RRTypes[0] = VN ;
-				RRTypes[1] = NV ;
+				r->RRTypes[0] = VN ;
+				r->RRTypes[1] = NV ;
 				return(NORMAL) ;
 				}
 			}
 
 		// Check for NNVNNNV pattern.
 
-		if(RRShort(RRBuffer[0],RRBuffer[1]) && RRMatch(RRBuffer[1],RRBuffer[2])
-			&& RRMatch(RRBuffer[2]*2,RRBuffer[3]+RRBuffer[4]) &&
-			RRMatch(RRBuffer[4],RRBuffer[0]) && RRMatch(RRBuffer[5],RRBuffer[2]))
+		if(RRShort(r->RRBuffer[0],r->RRBuffer[1]) && RRMatch(r->RRBuffer[1],r->RRBuffer[2])
+			&& RRMatch(r->RRBuffer[2]*2,r->RRBuffer[3]+r->RRBuffer[4]) &&
+			RRMatch(r->RRBuffer[4],r->RRBuffer[0]) && RRMatch(r->RRBuffer[5],r->RRBuffer[2]))
 			{
-			RRTypes[0] = NV ;
-			RRTypes[1] = NN ;
+			r->RRTypes[0] = NV ;
+			r->RRTypes[1] = NN ;
 			return(PVC) ;
 			}
 
@@ -182,24 +177,24 @@ int RhythmChk(int rr)
 
 		else
 			{
-			RRTypes[0] = QQ ;
+			r->RRTypes[0] = QQ ;
 			return(UNKNOWN) ;
 			}
 		}
 
 	// If the previous two beats were normal...
 
-	else if(RRTypes[1] == NN)
+	else if(r->RRTypes[1] == NN)
 		{
 
-		if(RRShort2(RRBuffer,RRTypes))
+		if(RRShort2(r->RRBuffer,r->RRTypes))
 			{
-			if(RRBuffer[1] < BRADY_LIMIT)
+			if(r->RRBuffer[1] < BRADY_LIMIT)
 				{
-				RRTypes[0] = NV ;
+				r->RRTypes[0] = NV ;
 				return(PVC) ;
 				}
-			else RRTypes[0] = QQ ;
+			else r->RRTypes[0] = QQ ;
 				return(UNKNOWN) ;
 			}
 
@@ -207,31 +202,31 @@ int RhythmChk(int rr)
 		// If this interval matches the previous interval, then it
 		// is regular.
 
-		else if(RRMatch(RRBuffer[0],RRBuffer[1]))
+		else if(RRMatch(r->RRBuffer[0],r->RRBuffer[1]))
 			{
-			RRTypes[0] = NN ;
+			r->RRTypes[0] = NN ;
 			return(NORMAL) ;
 			}
 
 		// If this interval is short..
 
-		else if(RRShort(RRBuffer[0],RRBuffer[1]))
+		else if(RRShort(r->RRBuffer[0],r->RRBuffer[1]))
 			{
 
 			// But matches the one before last and the one before
 			// last was NN, this is a normal interval.
 
-			if(RRMatch(RRBuffer[0],RRBuffer[2]) && (RRTypes[2] == NN))
+			if(RRMatch(r->RRBuffer[0],r->RRBuffer[2]) && (r->RRTypes[2] == NN))
 				{
-				RRTypes[0] = NN ;
+				r->RRTypes[0] = NN ;
 				return(NORMAL) ;
 				}
 
 			// If the rhythm wasn't bradycardia, call it a PVC.
 
-			else if(RRBuffer[1] < BRADY_LIMIT)
+			else if(r->RRBuffer[1] < BRADY_LIMIT)
 				{
-				RRTypes[0] = NV ;
+				r->RRTypes[0] = NV ;
 				return(PVC) ;
 				}
 
@@ -240,7 +235,7 @@ int RhythmChk(int rr)
 
 			else
 				{
-				RRTypes[0] = QQ ;
+				r->RRTypes[0] = QQ ;
 				return(UNKNOWN) ;
 				}
 			}
@@ -251,17 +246,17 @@ int RhythmChk(int rr)
 
 		else
 			{
-			RRTypes[0] = QQ ;
+			r->RRTypes[0] = QQ ;
 			return(NORMAL) ;
 			}
 		}
 
 	// If the previous beat was a PVC...
 
-	else if(RRTypes[1] == NV)
+	else if(r->RRTypes[1] == NV)
 		{
 
-		if(RRShort2(&RRBuffer[1],&RRTypes[1]))
+		if(RRShort2(&r->RRBuffer[1],&r->RRTypes[1]))
 			{
 	/*		if(RRMatch2(RRBuffer[0],RRBuffer[1]))
 				{
@@ -269,20 +264,20 @@ int RhythmChk(int rr)
 				return(PVC) ;
 				} */
 
-			if(RRMatch(RRBuffer[0],RRBuffer[1]))
+			if(RRMatch(r->RRBuffer[0],r->RRBuffer[1]))
 				{
-				RRTypes[0] = NN ;
-				RRTypes[1] = NN ;
+				r->RRTypes[0] = NN ;
+				r->RRTypes[1] = NN ;
 				return(NORMAL) ;
 				}
-			else if(RRBuffer[0] > RRBuffer[1])
+			else if(r->RRBuffer[0] > r->RRBuffer[1])
 				{
-				RRTypes[0] = VN ;
+				r->RRTypes[0] = VN ;
 				return(NORMAL) ;
 				}
 			else
 				{
-				RRTypes[0] = QQ ;
+				r->RRTypes[0] = QQ ;
 				return(UNKNOWN) ;
 				}
 
@@ -292,18 +287,18 @@ int RhythmChk(int rr)
 		// If this interval matches the previous premature
 		// interval assume a ventricular couplet.
 
-		else if(RRMatch(RRBuffer[0],RRBuffer[1]))
+		else if(RRMatch(r->RRBuffer[0],r->RRBuffer[1]))
 			{
-			RRTypes[0] = VV ;
+			r->RRTypes[0] = VV ;
 			return(PVC) ;
 			}
 
 		// If this interval is larger than the previous
 		// interval, assume that it is NORMAL.
 
-		else if(RRBuffer[0] > RRBuffer[1])
+		else if(r->RRBuffer[0] > r->RRBuffer[1])
 			{
-			RRTypes[0] = VN ;
+			r->RRTypes[0] = VN ;
 			return(NORMAL) ;
 			}
 
@@ -312,41 +307,41 @@ int RhythmChk(int rr)
 
 		else
 			{
-			RRTypes[0] = QQ ;
+			r->RRTypes[0] = QQ ;
 			return(UNKNOWN) ;
          }
 		}
 
 	// If the previous beat followed a PVC or couplet etc...
 
-	else if(RRTypes[1] == VN)
+	else if(r->RRTypes[1] == VN)
 		{
 
 		// Find the last NN interval.
 
-		for(i = 2; (RRTypes[i] != NN) && (i < RBB_LENGTH); ++i) ;
+		for(i = 2; (i < RBB_LENGTH) && (r->RRTypes[i] != NN); ++i) ;
 
 		// If there was an NN interval in the interval buffer...
 		if(i != RBB_LENGTH)
 			{
-			NNEst = RRBuffer[i] ;
+			NNEst = r->RRBuffer[i] ;
 
 			// and it matches, classify this interval as NORMAL.
 
-			if(RRMatch(RRBuffer[0],NNEst))
+			if(RRMatch(r->RRBuffer[0],NNEst))
 				{
-				RRTypes[0] = NN ;
+				r->RRTypes[0] = NN ;
 				return(NORMAL) ;
 				}
 			}
 
 		else NNEst = 0 ;
-		for(i = 2; (RRTypes[i] != NV) && (i < RBB_LENGTH); ++i) ;
+		for(i = 2; (i < RBB_LENGTH) && (r->RRTypes[i] != NV); ++i) ;
 		if(i != RBB_LENGTH)
-			NVEst = RRBuffer[i] ;
+			NVEst = r->RRBuffer[i] ;
 		else NVEst = 0 ;
 		if((NNEst == 0) && (NVEst != 0))
-			NNEst = (RRBuffer[1]+NVEst) >> 1 ;
+			NNEst = (r->RRBuffer[1]+NVEst) >> 1 ;
 
 		// NNEst is either the last NN interval or the average
 		// of the most recent NV and VN intervals.
@@ -355,10 +350,10 @@ int RhythmChk(int rr)
 		// matching to NN.
 
 		if((NVEst != 0) &&
-			(abs(NNEst - RRBuffer[0]) < abs(NVEst - RRBuffer[0])) &&
-			RRMatch(NNEst,RRBuffer[0]))
+			(abs(NNEst - r->RRBuffer[0]) < abs(NVEst - r->RRBuffer[0])) &&
+			RRMatch(NNEst,r->RRBuffer[0]))
 			{
-			RRTypes[0] = NN ;
+			r->RRTypes[0] = NN ;
 			return(NORMAL) ;
 			}
 
@@ -366,10 +361,10 @@ int RhythmChk(int rr)
 		// matching to NV.
 
 		else if((NVEst != 0) &&
-			(abs(NNEst - RRBuffer[0]) > abs(NVEst - RRBuffer[0])) &&
-			RRMatch(NVEst,RRBuffer[0]))
+			(abs(NNEst - r->RRBuffer[0]) > abs(NVEst - r->RRBuffer[0])) &&
+			RRMatch(NVEst,r->RRBuffer[0]))
 			{
-			RRTypes[0] = NV ;
+			r->RRTypes[0] = NV ;
 			return(PVC) ;
 			}
 
@@ -378,7 +373,7 @@ int RhythmChk(int rr)
 
 		else
 			{
-			RRTypes[0] = QQ ;
+			r->RRTypes[0] = QQ ;
 			return(UNKNOWN) ;
 			}
 		}
@@ -390,9 +385,9 @@ int RhythmChk(int rr)
 
 		// Does this match previous VV.
 
-		if(RRMatch(RRBuffer[0],RRBuffer[1]))
+		if(RRMatch(r->RRBuffer[0],r->RRBuffer[1]))
 			{
-			RRTypes[0] = VV ;
+			r->RRTypes[0] = VV ;
 			return(PVC) ;
 			}
 
@@ -401,14 +396,14 @@ int RhythmChk(int rr)
 
 		else
 			{
-			if(RRShort(RRBuffer[0],RRBuffer[1]))
+			if(RRShort(r->RRBuffer[0],r->RRBuffer[1]))
 				{
-				RRTypes[0] = QQ ;
+				r->RRTypes[0] = QQ ;
 				return(UNKNOWN) ;
 				}
 			else
 				{
-				RRTypes[0] = VN ;
+				r->RRTypes[0] = VN ;
 				return(NORMAL) ;
 				}
 			}
@@ -444,9 +439,9 @@ int RRShort(int rr0, int rr1)
 	a bigeminal rhythm is in progress.
 **************************************************************************/
 
-int IsBigeminy(void)
+int IsBigeminy(OseaContext *ctx)
 	{
-	return(BigeminyFlag) ;
+	return(ctx->rhythmchk.BigeminyFlag) ;
 	}
 
 /**************************************************************************
@@ -30,6 +30,6 @@ MA 02143 USA).  For updates to this software, please visit our website
 
 // External prototypes for rythmchk.cpp
 
-void ResetRhythmChk(void) ;
-int RhythmChk(int rr) ;
-int IsBigeminy(void) ;
+void ResetRhythmChk(OseaContext *ctx) ;
+int RhythmChk(OseaContext *ctx, int rr) ;
+int IsBigeminy(OseaContext *ctx) ;
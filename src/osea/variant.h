@@ -0,0 +1,66 @@
+/*****************************************************************************
+
+FILE:  variant.h
+  ___________________________________________________________________________
+
+variant.h: Descriptors of the OSEA builds for different sample rates.
+
+This file is free software; you can redistribute it and/or modify it under
+the terms of the GNU Library General Public License as published by the Free
+Software Foundation; either version 2 of the License, or (at your option) any
+later version.
+
+This software is distributed in the hope that it will be useful, but WITHOUT ANY
+WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+PARTICULAR PURPOSE.  See the GNU Library General Public License for more
+details.
+
+You should have received a copy of the GNU Library General Public License along
+with this library; if not, write to the Free Software Foundation, Inc., 59
+Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+  __________________________________________________________________________
+
+	Each OSEA build (see osearate.h) defines one OseaVariant in bdac.c.
+	This file does not depend on the sample rate, so it can be included
+	by code that uses several builds.  The size of OseaContext depends on
+	the sample rate, so a context must be allocated with contextSize bytes,
+	aligned to OSEA_CONTEXT_ALIGNMENT bytes (see osea.h), and used only with
+	the functions of the same variant.
+
+*******************************************************************************/
+#ifndef _VARIANT_H
+#define _VARIANT_H
+
+#define OSEA_CONTEXT_ALIGNMENT	16	// Alignment of OseaContext in bytes.
+
+struct _OseaContext ;
+
+// A beat found by BeatDetectAndClassifyBlock().
+
+typedef struct
+	{
+	int index ;			// Index of the sample in the block that completed
+							// the detection.
+	int delay ;			// Detection delay, as returned by
+							// BeatDetectAndClassify().
+	int type ;			// Beat type (NORMAL, PVC, ...).
+	int match ;			// Template the beat matched.
+	} OseaBeat ;
+
+typedef struct
+	{
+	int sampleRate ;		// Sample rate the build expects, in Hz.
+	int contextSize ;		// sizeof(OseaContext) in the build.
+	void (*init)(struct _OseaContext *ctx) ;
+	void (*reset)(struct _OseaContext *ctx) ;
+	int (*beatDetectAndClassify)(struct _OseaContext *ctx, int ecgSample,
+		int *beatType, int *beatMatch) ;
+	int (*beatDetectAndClassifyBlock)(struct _OseaContext *ctx,
+		const int *ecgSamples, int n, OseaBeat *beats) ;
+	} OseaVariant ;
+
+extern const OseaVariant OseaVariant_150 ;
+extern const OseaVariant OseaVariant_200 ;
+extern const OseaVariant OseaVariant_300 ;
+
+#endif /* _VARIANT_H */
@@ -0,0 +1,876 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*
+ * Accuracy and throughput regression benchmark for OSEA.
+ *
+ * OSEA is run on a fixed set of synthetic ECG fixtures, and optionally on
+ * recorded ECG from PhysioBank records (such as the records of the MIT-BIH
+ * Arrhythmia Database) given on the command line. For each fixture, the
+ * following are printed:
+ *
+ * - samples and beats analyzed per second with the block interface, the
+ *   best of a few runs
+ * - percentiles of the detection delay of the beats, and of the time taken
+ *   by the call that detected and classified each beat
+ * - sensitivity and positive predictivity of the beat detection and of the
+ *   ventricular ectopic beat classification, compared with the reference
+ *   annotations as bxbep.c of OSEA (and bxb of the WFDB library) does
+ *
+ * The synthetic fixtures are generated with a fixed seed, so they are the
+ * same on every run, and their reference annotations are the beats that
+ * were generated. A change in the QRS filters (qrsfilt.c), the template
+ * matching (match.c) or the beat classifier (classify.c) thus shows up as
+ * a change in the speed or the accuracy.
+ *
+ * Usage: osea_bench [OPTION...] [RECORD...]
+ *
+ * For example: osea_bench mitdb/100 mitdb/119
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* System */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "beat_compare.h"
+#include "ec_error.h"
+#include "wfdb_annotation.h"
+#include "wfdb_record.h"
+
+#include "osea/ecgcodes.h"
+#include "osea/variant.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define OSEA_BENCH_DEFAULT_REPEATS		3
+#define OSEA_BENCH_DEFAULT_REFERENCE		"atr"
+
+/** @brief Samples given to OSEA at a time, as in beat_detect.c */
+#define OSEA_BENCH_BLOCK_LENGTH			128
+
+/** @brief Units per millivolt that OSEA expects */
+#define OSEA_BENCH_OSEA_GAIN			200
+
+/** @brief The comparison begins after the learning period of the AAMI
+ * recommended practice */
+#define OSEA_BENCH_START_SECONDS		300
+#define OSEA_BENCH_MATCH_WINDOW_MS		150
+
+/** @brief Period and length of the noise bursts of the synthetic fixtures */
+#define OSEA_BENCH_BURST_PERIOD_SECONDS		120
+#define OSEA_BENCH_BURST_SECONDS		10
+
+/*****************************************************************************
+ * Data structures                                                           *
+ *****************************************************************************/
+
+/**
+ * @brief Parameters of a synthetic fixture
+ */
+typedef struct _OseaBenchSynthetic {
+	const gchar *name;
+	gint sample_rate;
+	gint minutes;
+	guint32 seed;
+
+	/** @brief The heart rate wanders between these */
+	gdouble min_bpm;
+	gdouble max_bpm;
+
+	/** @brief Percentage of premature ventricular beats */
+	gint pvc_percent;
+
+	/** @brief Amplitude of the baseline wander, in mV */
+	gdouble wander_mv;
+
+	/** @brief Amplitude of the white noise, in mV */
+	gdouble noise_mv;
+
+	/** @brief Amplitude of the bursts of muscle noise, in mV */
+	gdouble burst_mv;
+} OseaBenchSynthetic;
+
+/**
+ * @brief A wave of a synthetic beat, in a Gaussian shape
+ */
+typedef struct _OseaBenchWave {
+	/** @brief Time from the fiducial point, in seconds */
+	gdouble offset;
+
+	/** @brief Standard deviation, in seconds */
+	gdouble width;
+
+	/** @brief Amplitude in mV */
+	gdouble amplitude;
+} OseaBenchWave;
+
+/**
+ * @brief An ECG signal with its reference annotations, and the results of
+ * the benchmark
+ */
+typedef struct _OseaBenchFixture {
+	gchar *name;
+	const OseaVariant *variant;
+
+	/** @brief The signal, at the rate of the variant and in the units
+	 * that OSEA expects */
+	gint *samples;
+	glong length;
+
+	/** @brief Reference annotations (#WfdbAnnotation), or NULL if there
+	 * are none */
+	GArray *reference;
+
+	/** @brief Sample rate and length of the reference. The annotations
+	 * of a resampled record are in the samples of the record. */
+	gint reference_rate;
+	glong reference_length;
+
+	/** @brief Time of the fastest run, in seconds */
+	gdouble elapsed;
+
+	/** @brief The beats (#WfdbAnnotation), in reference samples */
+	GArray *beats;
+
+	/** @brief Detection delays of the beats in milliseconds (gdouble) */
+	GArray *delays;
+
+	/** @brief Times of the calls that detected the beats in
+	 * microseconds (gdouble) */
+	GArray *times;
+
+	BeatCompareResult result;
+} OseaBenchFixture;
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Generate a synthetic fixture
+ *
+ * @param self The fixture to fill in
+ * @param synthetic Parameters of the fixture
+ */
+static void osea_bench_synthesize(
+		OseaBenchFixture *self,
+		const OseaBenchSynthetic *synthetic);
+
+/**
+ * @brief Add the waves of a beat to a signal
+ *
+ * @param signal The signal, in mV
+ * @param length Length of the signal
+ * @param sample_rate Sample rate of the signal
+ * @param time Time of the fiducial point of the beat, in seconds
+ * @param waves The waves of the beat
+ * @param wave_count Amount of waves
+ * @param scale Scale of the amplitudes
+ */
+static void osea_bench_add_beat(
+		gdouble *signal,
+		glong length,
+		gint sample_rate,
+		gdouble time,
+		const OseaBenchWave *waves,
+		gint wave_count,
+		gdouble scale);
+
+/**
+ * @brief Read a fixture from a record
+ *
+ * @param self The fixture to fill in
+ * @param path Path of the record
+ * @param error Return location for errors
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean osea_bench_load_record(
+		OseaBenchFixture *self,
+		const gchar *path,
+		GError **error);
+
+/**
+ * @brief Analyze a fixture with the block interface, and measure the speed
+ *
+ * @param self The fixture
+ */
+static void osea_bench_run(OseaBenchFixture *self);
+
+/**
+ * @brief Analyze a fixture one sample at a time, and measure the latency
+ * of every beat
+ *
+ * @param self The fixture
+ *
+ * @return FALSE if the beats differ from the ones of the block interface
+ */
+static gboolean osea_bench_measure_latency(OseaBenchFixture *self);
+
+/**
+ * @brief Get a percentile of values
+ *
+ * @param values Array of gdouble, sorted
+ * @param percent The percentile
+ *
+ * @return The value, or 0 if there are no values
+ */
+static gdouble osea_bench_percentile(GArray *values, gdouble percent);
+
+/**
+ * @brief Comparison function for sorting gdoubles
+ */
+static gint osea_bench_compare_doubles(gconstpointer a, gconstpointer b);
+
+/**
+ * @brief Free the resources of a fixture
+ *
+ * @param self The fixture
+ */
+static void osea_bench_fixture_free(OseaBenchFixture *self);
+
+/*****************************************************************************
+ * Static variables                                                          *
+ *****************************************************************************/
+
+static gint osea_bench_repeats = OSEA_BENCH_DEFAULT_REPEATS;
+static gint osea_bench_signal = 0;
+static gchar *osea_bench_reference = NULL;
+
+static const OseaVariant *osea_bench_variants[] = {
+	&OseaVariant_300,
+	&OseaVariant_200,
+	&OseaVariant_150
+};
+
+/*
+ * The synthetic fixtures run every build of OSEA, and cover a normal sinus
+ * rhythm, frequent ventricular ectopy, noise and a fast heart rate
+ */
+static const OseaBenchSynthetic osea_bench_synthetic[] = {
+	{ "sinus-150", 150, 30, 1, 55, 95, 0, 0.05, 0.01, 0 },
+	{ "pvc-200", 200, 30, 2, 60, 100, 12, 0.1, 0.02, 0 },
+	{ "noise-300", 300, 30, 3, 60, 100, 4, 0.5, 0.05, 0.8 },
+	{ "fast-300", 300, 30, 4, 110, 170, 6, 0.15, 0.03, 0.2 }
+};
+
+/* P, Q, R, S and T waves */
+static const OseaBenchWave osea_bench_normal_beat[] = {
+	{ -0.17, 0.022, 0.12 },
+	{ -0.028, 0.008, -0.12 },
+	{ 0.0, 0.011, 1.1 },
+	{ 0.028, 0.009, -0.28 },
+	{ 0.24, 0.045, 0.28 }
+};
+
+/*
+ * Three forms of premature ventricular beats: a wide QRS complex with an
+ * inverted T wave, a wide upright QRS complex, and one that is only a
+ * little wider than a normal beat. Multiform ectopy makes the classifier
+ * keep several templates, and the last form is easy to miss.
+ */
+static const OseaBenchWave osea_bench_pvc_beat[] = {
+	{ 0.0, 0.03, -1.2 },
+	{ 0.07, 0.035, 0.5 },
+	{ 0.3, 0.06, -0.35 }
+};
+
+static const OseaBenchWave osea_bench_pvc_beat_2[] = {
+	{ -0.04, 0.025, -0.3 },
+	{ 0.0, 0.028, 1.4 },
+	{ 0.28, 0.07, -0.4 }
+};
+
+static const OseaBenchWave osea_bench_pvc_beat_3[] = {
+	{ 0.0, 0.018, 1.0 },
+	{ 0.04, 0.015, -0.4 },
+	{ 0.26, 0.05, -0.2 }
+};
+
+static GOptionEntry osea_bench_options[] = {
+	{ "repeats", 'n', 0, G_OPTION_ARG_INT, &osea_bench_repeats,
+		"Measure the speed N times and take the best (default: 3)",
+		"N" },
+	{ "signal", 's', 0, G_OPTION_ARG_INT, &osea_bench_signal,
+		"Analyze signal N of the records (default: 0)", "N" },
+	{ "reference", 'r', 0, G_OPTION_ARG_STRING, &osea_bench_reference,
+		"Compare with the annotations in RECORD.NAME (default: atr)",
+		"NAME" },
+	{ NULL }
+};
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+int main(int argc, char **argv)
+{
+	GOptionContext *context = NULL;
+	GError *error = NULL;
+	OseaBenchFixture *fixtures = NULL;
+	OseaBenchFixture *f = NULL;
+	BeatCompareResult result;
+	gint synthetic_count = G_N_ELEMENTS(osea_bench_synthetic);
+	gint fixture_count = 0;
+	gint compared = 0;
+	gint status = 0;
+	gint i = 0;
+	glong samples = 0;
+	glong beats = 0;
+	gdouble seconds = 0;
+	gdouble elapsed = 0;
+
+	context = g_option_context_new("[RECORD...] - benchmark the speed and "
+			"the accuracy of OSEA");
+	g_option_context_add_main_entries(context, osea_bench_options, NULL);
+	if(!g_option_context_parse(context, &argc, &argv, &error))
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		g_option_context_free(context);
+		return 1;
+	}
+	g_option_context_free(context);
+
+	osea_bench_repeats = MAX(osea_bench_repeats, 1);
+	if(!osea_bench_reference)
+	{
+		osea_bench_reference = g_strdup(OSEA_BENCH_DEFAULT_REFERENCE);
+	}
+
+	fixtures = g_new0(OseaBenchFixture, synthetic_count + argc - 1);
+	for(i = 0; i < synthetic_count; i++)
+	{
+		osea_bench_synthesize(&fixtures[fixture_count++],
+				&osea_bench_synthetic[i]);
+	}
+	for(i = 1; i < argc; i++)
+	{
+		if(!osea_bench_load_record(&fixtures[fixture_count], argv[i],
+					&error))
+		{
+			g_printerr("%s: %s\n", argv[i], error->message);
+			g_clear_error(&error);
+			osea_bench_fixture_free(&fixtures[fixture_count]);
+			status = 1;
+			continue;
+		}
+		fixture_count++;
+	}
+
+	g_print("%d fixtures, best of %d runs\n\n", fixture_count,
+			osea_bench_repeats);
+	g_print("Fixture            Rate    Beats   Samples/s     Beats/s  "
+			"x realtime\n");
+	for(i = 0; i < fixture_count; i++)
+	{
+		f = &fixtures[i];
+		osea_bench_run(f);
+		if(!osea_bench_measure_latency(f))
+		{
+			g_printerr("%s: the beats of the block interface and "
+					"of BeatDetectAndClassify() differ\n",
+					f->name);
+			status = 1;
+		}
+
+		g_print("%-16s %6d %8u %11.0f %11.0f %11.0f\n",
+				f->name, f->variant->sampleRate, f->beats->len,
+				f->length / f->elapsed,
+				f->beats->len / f->elapsed,
+				(gdouble)f->length / f->variant->sampleRate /
+				f->elapsed);
+
+		samples += f->length;
+		beats += f->beats->len;
+		seconds += (gdouble)f->length / f->variant->sampleRate;
+		elapsed += f->elapsed;
+	}
+	g_print("%-16s %6s %8ld %11.0f %11.0f %11.0f\n", "Total", "", beats,
+			samples / elapsed, beats / elapsed, seconds / elapsed);
+
+	g_print("\n                 Detection delay (ms)        "
+			"Time per beat (us)\n");
+	g_print("Fixture            p50   p90   p99   max     "
+			"p50    p90    p99    max\n");
+	for(i = 0; i < fixture_count; i++)
+	{
+		f = &fixtures[i];
+		g_print("%-16s %5.0f %5.0f %5.0f %5.0f  %6.1f %6.1f %6.1f "
+				"%6.1f\n", f->name,
+				osea_bench_percentile(f->delays, 50),
+				osea_bench_percentile(f->delays, 90),
+				osea_bench_percentile(f->delays, 99),
+				osea_bench_percentile(f->delays, 100),
+				osea_bench_percentile(f->times, 50),
+				osea_bench_percentile(f->times, 90),
+				osea_bench_percentile(f->times, 99),
+				osea_bench_percentile(f->times, 100));
+	}
+
+	g_print("\n");
+	memset(&result, 0, sizeof(result));
+	beat_compare_print_line_header(stdout);
+	for(i = 0; i < fixture_count; i++)
+	{
+		f = &fixtures[i];
+		if(!f->reference)
+		{
+			continue;
+		}
+		beat_compare(&f->result,
+				(WfdbAnnotation *)f->reference->data,
+				f->reference->len,
+				(WfdbAnnotation *)f->beats->data, f->beats->len,
+				(glong)OSEA_BENCH_START_SECONDS *
+				f->reference_rate,
+				f->reference_length,
+				(glong)f->reference_rate *
+				OSEA_BENCH_MATCH_WINDOW_MS / 1000);
+		beat_compare_print_line(stdout, f->name, &f->result);
+		beat_compare_result_add(&result, &f->result);
+		compared++;
+	}
+	if(compared > 0)
+	{
+		beat_compare_print_line(stdout, "Gross", &result);
+		g_print("\n");
+		beat_compare_print_table(stdout, &result);
+	}
+
+	for(i = 0; i < fixture_count; i++)
+	{
+		osea_bench_fixture_free(&fixtures[i]);
+	}
+	g_free(fixtures);
+	g_free(osea_bench_reference);
+
+	return status;
+}
+
+/*****************************************************************************
+ * Private functions                                                         *
+ *****************************************************************************/
+
+static void osea_bench_synthesize(
+		OseaBenchFixture *self,
+		const OseaBenchSynthetic *synthetic)
+{
+	GRand *rand = NULL;
+	WfdbAnnotation annotation;
+	const OseaBenchWave *waves = NULL;
+	gint wave_count = 0;
+	gdouble *signal = NULL;
+	gint rate = synthetic->sample_rate;
+	gdouble seconds = synthetic->minutes * 60.0;
+	gdouble bpm = (synthetic->min_bpm + synthetic->max_bpm) / 2;
+	gdouble time = 0.5;
+	gdouble rr = 0;
+	gdouble t = 0;
+	gdouble noise = 0;
+	glong i = 0;
+	gint j = 0;
+
+	self->name = g_strdup(synthetic->name);
+	for(j = 0; j < (gint)G_N_ELEMENTS(osea_bench_variants); j++)
+	{
+		if(osea_bench_variants[j]->sampleRate == rate)
+		{
+			self->variant = osea_bench_variants[j];
+		}
+	}
+	g_assert(self->variant != NULL);
+
+	self->length = (glong)(seconds * rate);
+	self->reference_rate = rate;
+	self->reference_length = self->length;
+	self->reference = g_array_new(FALSE, FALSE, sizeof(WfdbAnnotation));
+	signal = g_new0(gdouble, self->length);
+	rand = g_rand_new_with_seed(synthetic->seed);
+
+	/* A premature ventricular beat comes early, and is followed by a
+	 * compensatory pause */
+	annotation.subtype = 0;
+	while(time < seconds - 1)
+	{
+		bpm = CLAMP(bpm + g_rand_double_range(rand, -1.5, 1.5),
+				synthetic->min_bpm, synthetic->max_bpm);
+		rr = 60.0 / bpm;
+
+		if(g_rand_int_range(rand, 0, 100) < synthetic->pvc_percent)
+		{
+			switch(g_rand_int_range(rand, 0, 3))
+			{
+			case 0:
+				waves = osea_bench_pvc_beat;
+				wave_count = G_N_ELEMENTS(osea_bench_pvc_beat);
+				break;
+			case 1:
+				waves = osea_bench_pvc_beat_2;
+				wave_count = G_N_ELEMENTS(
+						osea_bench_pvc_beat_2);
+				break;
+			default:
+				waves = osea_bench_pvc_beat_3;
+				wave_count = G_N_ELEMENTS(
+						osea_bench_pvc_beat_3);
+				break;
+			}
+			osea_bench_add_beat(signal, self->length, rate,
+					time + 0.62 * rr, waves, wave_count,
+					g_rand_double_range(rand, 0.9, 1.1));
+			annotation.time = (glong)((time + 0.62 * rr) * rate +
+					0.5);
+			annotation.type = PVC;
+			g_array_append_val(self->reference, annotation);
+			time += 2 * rr;
+		} else {
+			time += rr;
+		}
+		if(time >= seconds - 1)
+		{
+			break;
+		}
+
+		/* Respiration modulates the amplitude */
+		osea_bench_add_beat(signal, self->length, rate, time,
+				osea_bench_normal_beat,
+				G_N_ELEMENTS(osea_bench_normal_beat),
+				(1 + 0.15 * sin(2 * G_PI * 0.25 * time)) *
+				g_rand_double_range(rand, 0.95, 1.05));
+		annotation.time = (glong)(time * rate + 0.5);
+		annotation.type = NORMAL;
+		g_array_append_val(self->reference, annotation);
+	}
+
+	/* Baseline wander (respiration and motion), noise and the bursts of
+	 * muscle noise */
+	self->samples = g_new(gint, self->length);
+	for(i = 0; i < self->length; i++)
+	{
+		t = (gdouble)i / rate;
+		noise = synthetic->noise_mv;
+		if(fmod(t, OSEA_BENCH_BURST_PERIOD_SECONDS) >=
+				OSEA_BENCH_BURST_PERIOD_SECONDS -
+				OSEA_BENCH_BURST_SECONDS)
+		{
+			noise += synthetic->burst_mv;
+		}
+		signal[i] += synthetic->wander_mv * (sin(2 * G_PI * 0.3 * t) +
+				0.5 * sin(2 * G_PI * 0.07 * t));
+		signal[i] += g_rand_double_range(rand, -noise, noise);
+		self->samples[i] = (gint)floor(signal[i] *
+				OSEA_BENCH_OSEA_GAIN + 0.5);
+	}
+
+	g_rand_free(rand);
+	g_free(signal);
+}
+
+static void osea_bench_add_beat(
+		gdouble *signal,
+		glong length,
+		gint sample_rate,
+		gdouble time,
+		const OseaBenchWave *waves,
+		gint wave_count,
+		gdouble scale)
+{
+	gdouble center = 0;
+	gdouble d = 0;
+	glong first = 0;
+	glong last = 0;
+	glong i = 0;
+	gint j = 0;
+
+	for(j = 0; j < wave_count; j++)
+	{
+		center = (time + waves[j].offset) * sample_rate;
+		first = MAX((glong)(center - 4 * waves[j].width * sample_rate),
+				0);
+		last = MIN((glong)(center + 4 * waves[j].width * sample_rate),
+				length - 1);
+		for(i = first; i <= last; i++)
+		{
+			d = (i - center) / (waves[j].width * sample_rate);
+			signal[i] += scale * waves[j].amplitude *
+				exp(-0.5 * d * d);
+		}
+	}
+}
+
+static gboolean osea_bench_load_record(
+		OseaBenchFixture *self,
+		const gchar *path,
+		GError **error)
+{
+	WfdbRecord *record = NULL;
+	gchar *reference_path = NULL;
+	gint i = 0;
+
+	record = wfdb_record_open(path, error);
+	if(!record)
+	{
+		return FALSE;
+	}
+	if(osea_bench_signal >= record->signal_count)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"the record has only %d signals",
+				record->signal_count);
+		wfdb_record_close(record);
+		return FALSE;
+	}
+
+	/* The highest rate of OSEA that is not higher than the rate of the
+	 * record */
+	self->reference_rate = (gint)(record->sample_rate + 0.5);
+	for(i = 0; i < (gint)G_N_ELEMENTS(osea_bench_variants); i++)
+	{
+		if(osea_bench_variants[i]->sampleRate <= self->reference_rate)
+		{
+			self->variant = osea_bench_variants[i];
+			break;
+		}
+	}
+	if(!self->variant)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"sample rate %d Hz is too low",
+				self->reference_rate);
+		wfdb_record_close(record);
+		return FALSE;
+	}
+
+	self->name = g_strdup(record->name);
+	self->reference_length = record->length;
+	self->length = wfdb_record_get_resampled_length(record,
+			self->variant->sampleRate);
+	self->samples = g_new(gint, self->length);
+	wfdb_record_read_resampled(record, osea_bench_signal,
+			self->variant->sampleRate, OSEA_BENCH_OSEA_GAIN, 0,
+			self->length, self->samples);
+	wfdb_record_close(record);
+
+	/* Without reference annotations, only the speed is measured */
+	reference_path = g_strdup_printf("%s.%s", path, osea_bench_reference);
+	if(g_file_test(reference_path, G_FILE_TEST_EXISTS))
+	{
+		self->reference = wfdb_annotation_read(reference_path, error);
+		if(!self->reference)
+		{
+			g_free(reference_path);
+			return FALSE;
+		}
+	}
+	g_free(reference_path);
+
+	return TRUE;
+}
+
+static void osea_bench_run(OseaBenchFixture *self)
+{
+	const OseaVariant *variant = self->variant;
+	struct _OseaContext *ctx = NULL;
+	OseaBeat beats[OSEA_BENCH_BLOCK_LENGTH];
+	WfdbAnnotation annotation;
+	GTimer *timer = NULL;
+	glong position = 0;
+	glong time = 0;
+	gdouble elapsed = 0;
+	gint count = 0;
+	gint repeat = 0;
+	gint i = 0;
+
+	if(posix_memalign((gpointer *)&ctx, OSEA_CONTEXT_ALIGNMENT,
+				variant->contextSize) != 0)
+	{
+		g_error("Could not allocate OSEA context");
+	}
+
+	self->beats = g_array_new(FALSE, FALSE, sizeof(WfdbAnnotation));
+	annotation.subtype = 0;
+	timer = g_timer_new();
+
+	for(repeat = 0; repeat < osea_bench_repeats; repeat++)
+	{
+		g_array_set_size(self->beats, 0);
+		variant->init(ctx);
+		g_timer_start(timer);
+		for(position = 0; position < self->length;
+				position += OSEA_BENCH_BLOCK_LENGTH)
+		{
+			count = variant->beatDetectAndClassifyBlock(ctx,
+					self->samples + position,
+					MIN(OSEA_BENCH_BLOCK_LENGTH,
+						self->length - position),
+					beats);
+			for(i = 0; i < count; i++)
+			{
+				/* As in easytest.c of OSEA */
+				time = position + beats[i].index + 1 -
+					beats[i].delay;
+				annotation.time = (glong)((gint64)time *
+						self->reference_rate /
+						variant->sampleRate);
+				annotation.type = beats[i].type;
+				g_array_append_val(self->beats, annotation);
+			}
+		}
+		elapsed = g_timer_elapsed(timer, NULL);
+		if(repeat == 0 || elapsed < self->elapsed)
+		{
+			self->elapsed = elapsed;
+		}
+	}
+
+	g_timer_destroy(timer);
+	free(ctx);
+}
+
+static gboolean osea_bench_measure_latency(OseaBenchFixture *self)
+{
+	const OseaVariant *variant = self->variant;
+	struct _OseaContext *ctx = NULL;
+	WfdbAnnotation *beat = NULL;
+	struct timespec before;
+	struct timespec after;
+	gboolean same = TRUE;
+	gdouble value = 0;
+	glong time = 0;
+	glong i = 0;
+	guint count = 0;
+	gint delay = 0;
+	gint type = 0;
+	gint match = 0;
+
+	if(posix_memalign((gpointer *)&ctx, OSEA_CONTEXT_ALIGNMENT,
+				variant->contextSize) != 0)
+	{
+		g_error("Could not allocate OSEA context");
+	}
+	variant->init(ctx);
+
+	self->delays = g_array_new(FALSE, FALSE, sizeof(gdouble));
+	self->times = g_array_new(FALSE, FALSE, sizeof(gdouble));
+
+	/* A call takes microseconds, which is below the resolution of
+	 * GTimer on some systems */
+	for(i = 0; i < self->length; i++)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &before);
+		delay = variant->beatDetectAndClassify(ctx, self->samples[i],
+				&type, &match);
+		clock_gettime(CLOCK_MONOTONIC, &after);
+		if(delay == 0)
+		{
+			continue;
+		}
+
+		value = delay * 1000.0 / variant->sampleRate;
+		g_array_append_val(self->delays, value);
+		value = (after.tv_sec - before.tv_sec) * 1000000.0 +
+			(after.tv_nsec - before.tv_nsec) / 1000.0;
+		g_array_append_val(self->times, value);
+
+		/* The beats must be the same as with the block interface */
+		time = (glong)((gint64)(i + 1 - delay) * self->reference_rate /
+				variant->sampleRate);
+		if(count >= self->beats->len)
+		{
+			same = FALSE;
+			continue;
+		}
+		beat = &g_array_index(self->beats, WfdbAnnotation, count++);
+		if(beat->time != time || beat->type != type)
+		{
+			same = FALSE;
+		}
+	}
+	if(count != self->beats->len)
+	{
+		same = FALSE;
+	}
+
+	g_array_sort(self->delays, osea_bench_compare_doubles);
+	g_array_sort(self->times, osea_bench_compare_doubles);
+
+	free(ctx);
+	return same;
+}
+
+static gdouble osea_bench_percentile(GArray *values, gdouble percent)
+{
+	if(values->len == 0)
+	{
+		return 0;
+	}
+	return g_array_index(values, gdouble,
+			(guint)((values->len - 1) * percent / 100 + 0.5));
+}
+
+static gint osea_bench_compare_doubles(gconstpointer a, gconstpointer b)
+{
+	gdouble x = *(const gdouble *)a;
+	gdouble y = *(const gdouble *)b;
+
+	if(x < y)
+	{
+		return -1;
+	}
+	return x > y;
+}
+
+static void osea_bench_fixture_free(OseaBenchFixture *self)
+{
+	g_free(self->name);
+	g_free(self->samples);
+	if(self->reference)
+	{
+		g_array_free(self->reference, TRUE);
+	}
+	if(self->beats)
+	{
+		g_array_free(self->beats, TRUE);
+	}
+	if(self->delays)
+	{
+		g_array_free(self->delays, TRUE);
+	}
+	if(self->times)
+	{
+		g_array_free(self->times, TRUE);
+	}
+	memset(self, 0, sizeof(*self));
+}
@@ -0,0 +1,270 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*
+ * Benchmark for the QRS filters of OSEA.
+ *
+ * A synthetic ECG at 300 Hz is filtered sample by sample with QRSFilter()
+ * and in blocks with QRSFilterBlock(), and then run through the whole
+ * beat detector with BeatDetectAndClassify() and
+ * BeatDetectAndClassifyBlock(). The results of the two paths are compared,
+ * and the benchmark fails if they differ.
+ *
+ * Usage: qrs_filter_bench [minutes of data] [block length]
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* System */
+#include <stdlib.h>
+#include <string.h>
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "osea/osea.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define QRS_FILTER_BENCH_DEFAULT_MINUTES	60
+#define QRS_FILTER_BENCH_DEFAULT_BLOCK		128
+
+/* Heart rate of the synthetic ECG varies between 60 and 90 bpm */
+#define QRS_FILTER_BENCH_MIN_RR			(SAMPLE_RATE * 2 / 3)
+#define QRS_FILTER_BENCH_MAX_RR			SAMPLE_RATE
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Generate a synthetic ECG
+ *
+ * The beats are triangular QRS complexes of about 1 mV on a wandering
+ * baseline with some noise, in the units that OSEA expects (200 per mV).
+ *
+ * @param samples Storage for the samples
+ * @param length Amount of samples
+ */
+static void qrs_filter_bench_generate(gint *samples, gint length);
+
+/**
+ * @brief Print the time and throughput of one run
+ *
+ * @param name Name of the run
+ * @param length Amount of samples
+ * @param elapsed Time in seconds
+ */
+static void qrs_filter_bench_report(
+		const gchar *name,
+		gint length,
+		gdouble elapsed);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+int main(int argc, char **argv)
+{
+	OseaContext *ctx = NULL;
+	GTimer *timer = NULL;
+	OseaBeat *beats = NULL;
+	gint *samples = NULL;
+	gint *filtered = NULL;
+	gint *filtered_block = NULL;
+	gint *delays = NULL;
+	gint *delays_block = NULL;
+	gint minutes = QRS_FILTER_BENCH_DEFAULT_MINUTES;
+	gint block_length = QRS_FILTER_BENCH_DEFAULT_BLOCK;
+	gint length = 0;
+	gint count = 0;
+	gint type = 0;
+	gint match = 0;
+	gint i = 0;
+	gint j = 0;
+	gint n = 0;
+	gboolean identical = TRUE;
+
+	if(argc > 1)
+	{
+		minutes = MAX(atoi(argv[1]), 1);
+	}
+	if(argc > 2)
+	{
+		block_length = MAX(atoi(argv[2]), 1);
+	}
+
+	length = minutes * 60 * SAMPLE_RATE;
+	samples = g_new(gint, length);
+	filtered = g_new(gint, length);
+	filtered_block = g_new(gint, length);
+	delays = g_new0(gint, length);
+	delays_block = g_new0(gint, length);
+	beats = g_new(OseaBeat, block_length);
+	timer = g_timer_new();
+
+	if(posix_memalign((gpointer *)&ctx, OSEA_CONTEXT_ALIGNMENT,
+				sizeof(OseaContext)) != 0)
+	{
+		g_printerr("Could not allocate OSEA context\n");
+		return 1;
+	}
+
+	qrs_filter_bench_generate(samples, length);
+
+	g_print("%d minutes of ECG at %d Hz, %d samples per block\n",
+			minutes, SAMPLE_RATE, block_length);
+	g_print("%-34s %10s %14s %10s\n", "", "time (s)", "samples/s",
+			"x realtime");
+
+	/* The filter chain alone */
+	QRSFilter(ctx, 0, 1);
+	g_timer_start(timer);
+	for(i = 0; i < length; i++)
+	{
+		filtered[i] = QRSFilter(ctx, samples[i], 0);
+	}
+	qrs_filter_bench_report("QRSFilter()", length,
+			g_timer_elapsed(timer, NULL));
+
+	QRSFilter(ctx, 0, 1);
+	g_timer_start(timer);
+	for(i = 0; i < length; i += block_length)
+	{
+		QRSFilterBlock(ctx, samples + i, filtered_block + i,
+				MIN(block_length, length - i));
+	}
+	qrs_filter_bench_report("QRSFilterBlock()", length,
+			g_timer_elapsed(timer, NULL));
+
+	if(memcmp(filtered, filtered_block, length * sizeof(gint)) != 0)
+	{
+		g_printerr("QRSFilterBlock() differs from QRSFilter()\n");
+		identical = FALSE;
+	}
+
+	/* The whole beat detector */
+	InitBDAC(ctx);
+	g_timer_start(timer);
+	for(i = 0; i < length; i++)
+	{
+		delays[i] = BeatDetectAndClassify(ctx, samples[i], &type,
+				&match);
+		if(delays[i])
+		{
+			count++;
+		}
+	}
+	qrs_filter_bench_report("BeatDetectAndClassify()", length,
+			g_timer_elapsed(timer, NULL));
+
+	InitBDAC(ctx);
+	g_timer_start(timer);
+	for(i = 0; i < length; i += block_length)
+	{
+		n = BeatDetectAndClassifyBlock(ctx, samples + i,
+				MIN(block_length, length - i), beats);
+		for(j = 0; j < n; j++)
+		{
+			delays_block[i + beats[j].index] = beats[j].delay;
+		}
+	}
+	qrs_filter_bench_report("BeatDetectAndClassifyBlock()", length,
+			g_timer_elapsed(timer, NULL));
+
+	if(memcmp(delays, delays_block, length * sizeof(gint)) != 0)
+	{
+		g_printerr("BeatDetectAndClassifyBlock() differs from "
+				"BeatDetectAndClassify()\n");
+		identical = FALSE;
+	}
+
+	g_print("%d beats detected\n", count);
+
+	g_timer_destroy(timer);
+	free(ctx);
+	g_free(beats);
+	g_free(delays_block);
+	g_free(delays);
+	g_free(filtered_block);
+	g_free(filtered);
+	g_free(samples);
+	return identical ? 0 : 1;
+}
+
+/*****************************************************************************
+ * Private functions                                                         *
+ *****************************************************************************/
+
+static void qrs_filter_bench_generate(gint *samples, gint length)
+{
+	GRand *rand = NULL;
+	gint next_beat = 0;
+	gint qrs_half_width = SAMPLE_RATE / 25;
+	gint position = 0;
+	gint i = 0;
+
+	/* Fixed seed, so that every run filters the same data */
+	rand = g_rand_new_with_seed(1);
+
+	for(i = 0; i < length; i++)
+	{
+		if(i == next_beat + 2 * qrs_half_width)
+		{
+			next_beat += g_rand_int_range(rand,
+					QRS_FILTER_BENCH_MIN_RR,
+					QRS_FILTER_BENCH_MAX_RR + 1);
+		}
+
+		/* Baseline wander of 0.25 mV every 4 seconds, and noise */
+		samples[i] = (i % (4 * SAMPLE_RATE) < 2 * SAMPLE_RATE ?
+				i % (2 * SAMPLE_RATE) :
+				2 * SAMPLE_RATE - i % (2 * SAMPLE_RATE)) *
+			50 / (2 * SAMPLE_RATE) +
+			g_rand_int_range(rand, -4, 5);
+
+		position = i - next_beat;
+		if(position >= 0 && position < 2 * qrs_half_width)
+		{
+			samples[i] += 200 * (qrs_half_width -
+					ABS(position - qrs_half_width)) /
+				qrs_half_width;
+		}
+	}
+
+	g_rand_free(rand);
+}
+
+static void qrs_filter_bench_report(
+		const gchar *name,
+		gint length,
+		gdouble elapsed)
+{
+	g_print("%-34s %10.3f %14.0f %10.0f\n", name, elapsed,
+			length / elapsed,
+			length / elapsed / SAMPLE_RATE);
+}
@@ -0,0 +1,210 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "ring_buffer.h"
+
+/* System */
+#include <string.h>
+
+/* Other modules */
+#include "debug.h"
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Copy data to both halves of the storage
+ *
+ * @param self Pointer to #RingBuffer
+ * @param offset Offset (already masked) to copy the data to
+ * @param data Data to copy
+ * @param len Length of the data, must not exceed capacity - offset
+ */
+static void ring_buffer_copy_mirrored(
+		RingBuffer *self,
+		guint offset,
+		const guint8 *data,
+		guint len);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+RingBuffer *ring_buffer_new(guint min_capacity)
+{
+	RingBuffer *self = NULL;
+	guint capacity = 1;
+
+	g_return_val_if_fail(min_capacity > 0, NULL);
+	g_return_val_if_fail(min_capacity <= G_MAXINT / 2, NULL);
+	DEBUG_BEGIN();
+
+	while(capacity < min_capacity)
+	{
+		capacity = capacity << 1;
+	}
+
+	self = g_new0(RingBuffer, 1);
+	self->data = g_malloc(capacity * 2);
+	self->capacity = capacity;
+	self->mask = capacity - 1;
+
+	DEBUG_END();
+	return self;
+}
+
+void ring_buffer_free(RingBuffer *self)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	g_free(self->data);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+guint ring_buffer_write(RingBuffer *self, const guint8 *data, guint len)
+{
+	guint dropped = 0;
+	guint length = 0;
+	guint offset = 0;
+	guint first_part = 0;
+
+	g_return_val_if_fail(self != NULL, 0);
+	g_return_val_if_fail(data != NULL || len == 0, 0);
+	DEBUG_BEGIN();
+
+	if(len > self->capacity)
+	{
+		/* Only the newest data fits in */
+		dropped = len - self->capacity;
+		data += dropped;
+		len = self->capacity;
+	}
+
+	length = self->write_position - self->read_position;
+	if(length + len > self->capacity)
+	{
+		dropped += length + len - self->capacity;
+		self->read_position += length + len - self->capacity;
+		g_warning("Ring buffer overflow, dropped %d bytes", dropped);
+	}
+
+	offset = self->write_position & self->mask;
+	first_part = MIN(len, self->capacity - offset);
+
+	ring_buffer_copy_mirrored(self, offset, data, first_part);
+	if(first_part < len)
+	{
+		ring_buffer_copy_mirrored(self, 0, data + first_part,
+				len - first_part);
+	}
+	self->write_position += len;
+
+	length = self->write_position - self->read_position;
+	if(length > self->peak_fill)
+	{
+		self->peak_fill = length;
+	}
+
+	DEBUG_END();
+	return dropped;
+}
+
+const guint8 *ring_buffer_peek(RingBuffer *self)
+{
+	g_return_val_if_fail(self != NULL, NULL);
+	return self->data + (self->read_position & self->mask);
+}
+
+guint ring_buffer_get_length(RingBuffer *self)
+{
+	g_return_val_if_fail(self != NULL, 0);
+	return self->write_position - self->read_position;
+}
+
+void ring_buffer_consume(RingBuffer *self, guint len, guint8 *checksum)
+{
+	const guint8 *data_ptr = NULL;
+	const guint8 *data_end = NULL;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(len <= ring_buffer_get_length(self));
+	DEBUG_BEGIN();
+
+	if(checksum)
+	{
+		/* Add to the checksum of the removed data */
+		data_ptr = ring_buffer_peek(self);
+		for(data_end = data_ptr + len; data_ptr < data_end; data_ptr++)
+		{
+			*checksum += *data_ptr;
+		}
+	}
+
+	self->read_position += len;
+
+	DEBUG_END();
+}
+
+void ring_buffer_clear(RingBuffer *self)
+{
+	g_return_if_fail(self != NULL);
+	self->read_position = self->write_position;
+}
+
+guint ring_buffer_get_capacity(RingBuffer *self)
+{
+	g_return_val_if_fail(self != NULL, 0);
+	return self->capacity;
+}
+
+guint ring_buffer_get_peak_fill(RingBuffer *self)
+{
+	g_return_val_if_fail(self != NULL, 0);
+	return self->peak_fill;
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static void ring_buffer_copy_mirrored(
+		RingBuffer *self,
+		guint offset,
+		const guint8 *data,
+		guint len)
+{
+	memcpy(self->data + offset, data, len);
+	memcpy(self->data + self->capacity + offset, data, len);
+}
@@ -0,0 +1,151 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _RING_BUFFER_H
+#define _RING_BUFFER_H
+
+/* Configuration */
+#include "config.h"
+
+/* GLib */
+#include <glib.h>
+
+/**
+ * @brief Fixed-capacity FIFO byte buffer.
+ *
+ * The capacity is always a power of two, so that the read and write
+ * cursors can run freely and be wrapped with a mask. The storage is
+ * allocated twice the capacity, and every byte is written to both
+ * halves. That way the unread data always starts at
+ * <code>read_position & mask</code> and is contiguous in memory, and
+ * parsers can look at it directly without copying it first.
+ *
+ * Consider all the fields private.
+ */
+typedef struct _RingBuffer {
+	/** @brief Storage, 2 * capacity bytes */
+	guint8 *data;
+
+	/** @brief Capacity in bytes (a power of two) */
+	guint capacity;
+
+	/** @brief capacity - 1 */
+	guint mask;
+
+	/** @brief Total amount of bytes consumed (wraps around) */
+	guint read_position;
+
+	/** @brief Total amount of bytes written (wraps around) */
+	guint write_position;
+
+	/** @brief Highest fill level seen since creation */
+	guint peak_fill;
+} RingBuffer;
+
+/**
+ * @brief Create a new ring buffer
+ *
+ * @param min_capacity Minimum capacity in bytes. The real capacity is
+ * rounded up to the next power of two.
+ *
+ * @return Newly allocated ring buffer
+ */
+RingBuffer *ring_buffer_new(guint min_capacity);
+
+/**
+ * @brief Free a ring buffer
+ *
+ * @param self Pointer to #RingBuffer
+ */
+void ring_buffer_free(RingBuffer *self);
+
+/**
+ * @brief Append data to the end of the buffer.
+ *
+ * If there is not enough room for the data, the oldest unread data is
+ * dropped to make room for it.
+ *
+ * @param self Pointer to #RingBuffer
+ * @param data Data to append
+ * @param len Length of the data
+ *
+ * @return Amount of unread bytes that had to be dropped
+ */
+guint ring_buffer_write(RingBuffer *self, const guint8 *data, guint len);
+
+/**
+ * @brief Get a pointer to the unread data.
+ *
+ * The returned pointer is valid for #ring_buffer_get_length() bytes
+ * and only until the buffer is written to or consumed from next time.
+ *
+ * @param self Pointer to #RingBuffer
+ *
+ * @return Pointer to the oldest unread byte
+ */
+const guint8 *ring_buffer_peek(RingBuffer *self);
+
+/**
+ * @brief Get the amount of unread data
+ *
+ * @param self Pointer to #RingBuffer
+ *
+ * @return Amount of unread bytes
+ */
+guint ring_buffer_get_length(RingBuffer *self);
+
+/**
+ * @brief Remove data from the beginning of the buffer.
+ *
+ * @param self Pointer to #RingBuffer
+ * @param len Amount of bytes to remove
+ * @param checksum Pointer to a checksum the removed bytes are summed up
+ * to, or NULL if the checksum is not wanted
+ */
+void ring_buffer_consume(RingBuffer *self, guint len, guint8 *checksum);
+
+/**
+ * @brief Remove all the unread data from the buffer
+ *
+ * @param self Pointer to #RingBuffer
+ */
+void ring_buffer_clear(RingBuffer *self);
+
+/**
+ * @brief Get the capacity of the buffer
+ *
+ * @param self Pointer to #RingBuffer
+ *
+ * @return Capacity in bytes
+ */
+guint ring_buffer_get_capacity(RingBuffer *self);
+
+/**
+ * @brief Get the highest amount of unread data the buffer has held
+ *
+ * @param self Pointer to #RingBuffer
+ *
+ * @return Peak fill level in bytes
+ */
+guint ring_buffer_get_peak_fill(RingBuffer *self);
+
+#endif /* _RING_BUFFER_H */
@@ -0,0 +1,223 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "sample_clock.h"
+
+/* System */
+#include <time.h>
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Measure the offset from the time base to the wall clock
+ *
+ * @param data Not used
+ *
+ * @return NULL
+ */
+static gpointer sample_clock_measure_wall_offset(gpointer data);
+
+/**
+ * @brief Anchor the clock, and start a new drift period
+ *
+ * @param self Pointer to #SampleClock
+ * @param sample Index of the sample at the anchor
+ * @param time Time of the sample
+ */
+static void sample_clock_anchor(
+		SampleClock *self,
+		guint64 sample,
+		gint64 time);
+
+/*****************************************************************************
+ * Static variables                                                          *
+ *****************************************************************************/
+
+/** @brief Wall clock time minus the time base, in microseconds */
+static gint64 sample_clock_wall_offset = 0;
+
+static GOnce sample_clock_wall_offset_once = G_ONCE_INIT;
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+gint64 sample_clock_now(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (gint64)now.tv_sec * G_USEC_PER_SEC + now.tv_nsec / 1000;
+}
+
+void sample_clock_to_timeval(gint64 time, struct timeval *timeval)
+{
+	gint64 wall = 0;
+
+	g_return_if_fail(timeval != NULL);
+
+	/* The offset is measured only once, so that setting the wall clock
+	 * does not move the events relative to each other */
+	g_once(&sample_clock_wall_offset_once,
+			sample_clock_measure_wall_offset, NULL);
+
+	wall = time + sample_clock_wall_offset;
+	timeval->tv_sec = wall / G_USEC_PER_SEC;
+	timeval->tv_usec = wall % G_USEC_PER_SEC;
+}
+
+void sample_clock_reset(SampleClock *self, gint sample_rate)
+{
+	g_return_if_fail(self != NULL);
+
+	self->sample_rate = sample_rate;
+	self->anchored = FALSE;
+	self->anchor_sample = 0;
+	self->anchor_time = 0;
+	self->period_sample = 0;
+	self->min_latency = 0;
+}
+
+void sample_clock_set_sample_rate(SampleClock *self, gint sample_rate)
+{
+	g_return_if_fail(self != NULL);
+
+	if(self->sample_rate != sample_rate)
+	{
+		sample_clock_reset(self, sample_rate);
+	}
+}
+
+gint64 sample_clock_stamp_block(
+		SampleClock *self,
+		guint64 first_sample,
+		guint length,
+		gint64 arrival)
+{
+	gint64 estimate = 0;
+	gint64 predicted = 0;
+	gint64 latency = 0;
+
+	g_return_val_if_fail(self != NULL, arrival);
+	g_return_val_if_fail(self->sample_rate > 0, arrival);
+
+	/* The last sample of the block was measured at the latest when it
+	 * arrived */
+	estimate = arrival - (gint64)(length > 0 ? length - 1 : 0) *
+		G_USEC_PER_SEC / self->sample_rate;
+
+	if(!self->anchored)
+	{
+		sample_clock_anchor(self, first_sample, estimate);
+		return estimate;
+	}
+
+	predicted = sample_clock_get_time(self, first_sample);
+	latency = estimate - predicted;
+	if(latency < 0)
+	{
+		/* The device clock runs fast. The anchor moves back no further
+		 * than the time of the previous sample, so the time stamps
+		 * stay in order. */
+		if(first_sample > 0)
+		{
+			estimate = MAX(estimate,
+					sample_clock_get_time(self,
+						first_sample - 1));
+		}
+		sample_clock_anchor(self, first_sample, estimate);
+		return estimate;
+	}
+	if(latency > SAMPLE_CLOCK_MAX_LATENCY)
+	{
+		/* There was a gap */
+		sample_clock_anchor(self, first_sample, estimate);
+		return estimate;
+	}
+
+	self->min_latency = MIN(self->min_latency, latency);
+	if(first_sample - self->period_sample >=
+			(guint64)self->sample_rate * SAMPLE_CLOCK_DRIFT_PERIOD)
+	{
+		/* Every block of the period was late, so the device clock
+		 * runs slow. The anchor only moves forward, so the time
+		 * stamps stay in order. */
+		predicted += self->min_latency;
+		sample_clock_anchor(self, first_sample, predicted);
+	}
+
+	return predicted;
+}
+
+gint64 sample_clock_get_time(const SampleClock *self, guint64 sample)
+{
+	g_return_val_if_fail(self != NULL, 0);
+
+	if(!self->anchored)
+	{
+		return 0;
+	}
+
+	/* The difference may be negative */
+	return self->anchor_time + (gint64)(sample - self->anchor_sample) *
+		G_USEC_PER_SEC / self->sample_rate;
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static gpointer sample_clock_measure_wall_offset(gpointer data)
+{
+	struct timeval now;
+	gint64 time = 0;
+
+	time = sample_clock_now();
+	gettimeofday(&now, NULL);
+	sample_clock_wall_offset = (gint64)now.tv_sec * G_USEC_PER_SEC +
+		now.tv_usec - time;
+
+	return NULL;
+}
+
+static void sample_clock_anchor(
+		SampleClock *self,
+		guint64 sample,
+		gint64 time)
+{
+	self->anchored = TRUE;
+	self->anchor_sample = sample;
+	self->anchor_time = time;
+	self->period_sample = sample;
+	self->min_latency = SAMPLE_CLOCK_MAX_LATENCY;
+}
@@ -0,0 +1,156 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _SAMPLE_CLOCK_H
+#define _SAMPLE_CLOCK_H
+
+/* Configuration */
+#include "config.h"
+
+/* System */
+#include <sys/time.h>
+
+/* GLib */
+#include <glib.h>
+ #ifdef __cplusplus
+ extern "C" {
+ #endif 
+
+/**
+ * @brief How much later than the sample clock the data may arrive before
+ * the clock is anchored again, in microseconds. Radio links deliver the
+ * data in bursts, so the usual delay is not a sign of drift.
+ */
+#define SAMPLE_CLOCK_MAX_LATENCY		(G_USEC_PER_SEC)
+
+/**
+ * @brief Length of the period, in seconds of samples, over which the
+ * smallest delay of the data is followed
+ */
+#define SAMPLE_CLOCK_DRIFT_PERIOD		10
+
+/**
+ * @brief Maps the sample indices of a device to the monotonic time base.
+ *
+ * All times in the time base are microseconds of CLOCK_MONOTONIC, so they
+ * do not jump when the wall clock is set. They are converted to wall
+ * clock time only when they are stored, with
+ * sample_clock_to_timeval(), which uses the same offset for the whole
+ * run of the program. Events that are stamped once and converted once
+ * line up exactly, whoever receives them.
+ *
+ * A sample clock is anchored to the arrival time of the first block. The
+ * time of a sample is then the anchor plus the sample count divided by
+ * the sample rate, so that the time stamps do not depend on how late the
+ * data is decoded. If the data arrives much later than the clock says,
+ * the clock is anchored again. If it arrives earlier, the anchor is moved
+ * back, but no further than the time of the previous sample, so that the
+ * time stamps never go backwards. A device clock that runs slow
+ * is followed by moving the anchor by the smallest delay of every
+ * SAMPLE_CLOCK_DRIFT_PERIOD, as the earliest arrival is the best estimate
+ * of when the data was measured.
+ *
+ * Consider all the fields private.
+ */
+typedef struct _SampleClock {
+	/** @brief Sample rate in Hz */
+	gint sample_rate;
+
+	/** @brief Whether the clock has been anchored yet */
+	gboolean anchored;
+
+	/** @brief Index of the sample at the anchor */
+	guint64 anchor_sample;
+
+	/** @brief Time of the sample at the anchor */
+	gint64 anchor_time;
+
+	/** @brief Index of the first sample of the drift period */
+	guint64 period_sample;
+
+	/** @brief Smallest delay of the data in the drift period */
+	gint64 min_latency;
+} SampleClock;
+
+/**
+ * @brief Get the current time in the time base
+ *
+ * @return Microseconds of CLOCK_MONOTONIC
+ */
+gint64 sample_clock_now(void);
+
+/**
+ * @brief Convert a time in the time base to wall clock time
+ *
+ * @param time Time in the time base
+ * @param timeval Storage for the wall clock time
+ */
+void sample_clock_to_timeval(gint64 time, struct timeval *timeval);
+
+/**
+ * @brief Forget the anchor, for example when a new connection is made
+ *
+ * @param self Pointer to #SampleClock
+ * @param sample_rate Sample rate in Hz
+ */
+void sample_clock_reset(SampleClock *self, gint sample_rate);
+
+/**
+ * @brief Set the sample rate. The anchor is forgotten if the rate
+ * changes.
+ *
+ * @param self Pointer to #SampleClock
+ * @param sample_rate Sample rate in Hz
+ */
+void sample_clock_set_sample_rate(SampleClock *self, gint sample_rate);
+
+/**
+ * @brief Get the time of the first sample of a block that has just
+ * arrived, and anchor the clock again if needed
+ *
+ * @param self Pointer to #SampleClock
+ * @param first_sample Index of the first sample in the block
+ * @param length Number of samples in the block
+ * @param arrival Time when the block arrived (see sample_clock_now())
+ *
+ * @return Time of the first sample
+ */
+gint64 sample_clock_stamp_block(
+		SampleClock *self,
+		guint64 first_sample,
+		guint length,
+		gint64 arrival);
+
+/**
+ * @brief Get the time of a sample
+ *
+ * @param self Pointer to #SampleClock
+ * @param sample Index of the sample
+ *
+ * @return Time of the sample, or 0 if the clock has not been anchored
+ */
+gint64 sample_clock_get_time(const SampleClock *self, guint64 sample);
+
+ #ifdef __cplusplus
+ }
+ #endif 
+#endif /* _SAMPLE_CLOCK_H */
@@ -28,7 +28,9 @@
 #include "track.h"
 
 /* System */
+#include <errno.h>
 #include <string.h>
+#include <unistd.h>
 
 /* Location */
 #include "location-distance-utils-fix.h"
@@ -46,6 +48,15 @@
 
 #define TRACK_HELPER_AUTOSAVE_INTERVAL 5 * 60 * 1000
 
+/** @brief The chunk of a point in a #TrackHelperPointStore */
+#define TRACK_HELPER_POINT_CHUNK(store, index) \
+	((TrackHelperPointChunk *)g_ptr_array_index((store)->chunks, \
+		(index) / TRACK_HELPER_POINT_CHUNK_LENGTH))
+
+/** @brief The position of a point in its #TrackHelperPointChunk */
+#define TRACK_HELPER_POINT_OFFSET(index) \
+	((index) % TRACK_HELPER_POINT_CHUNK_LENGTH)
+
 /*****************************************************************************
  * Private function prototypes                                               *
  *****************************************************************************/
@@ -65,6 +76,148 @@ static void track_helper_data_changed(TrackHelper *self);
  */
 static gboolean track_helper_autosave(gpointer user_data);
 
+/**
+ * @brief Choose how a heart rate is added to the track, and start the
+ * track if it is stopped or paused
+ *
+ * @param self Pointer to #TrackHelper
+ * @param point_type Return location for the point type
+ *
+ * @return TRUE on success, FALSE if the state is unknown
+ */
+static gboolean track_helper_begin_heart_rate(
+		TrackHelper *self,
+		GpxStoragePointType *point_type);
+
+/**
+ * @brief Finish adding a heart rate: name a newly started track and
+ * schedule the autosave
+ *
+ * @param self Pointer to #TrackHelper
+ * @param point_type The point type that was used
+ */
+static void track_helper_end_heart_rate(
+		TrackHelper *self,
+		GpxStoragePointType point_type);
+
+/**
+ * @brief Create the journal of a new track, unless a journal is being
+ * replayed
+ *
+ * @param self Pointer to #TrackHelper
+ */
+static void track_helper_journal_open(TrackHelper *self);
+
+/**
+ * @brief Close the journal, if there is one, and stop syncing it
+ *
+ * @param self Pointer to #TrackHelper
+ * @param remove Whether to remove the journal file
+ */
+static void track_helper_journal_close(TrackHelper *self, gboolean remove);
+
+/**
+ * @brief Sync the journal periodically. The journal is only synced when a
+ * record is appended, so without this the last records would wait for the
+ * next one, which may not come for a long time (for example, when the GPS
+ * has no fix).
+ *
+ * @param user_data Pointer to #TrackHelper
+ *
+ * @return TRUE while there is a journal
+ */
+static gboolean track_helper_journal_sync_timeout(gpointer user_data);
+
+/**
+ * @brief Initialize a journal record
+ *
+ * @param record The record
+ * @param type Type of the record
+ * @param time Time stamp of the record, or NULL for the current time
+ */
+static void track_helper_journal_record_init(
+		TrackJournalRecord *record,
+		TrackJournalRecordType type,
+		const struct timeval *time);
+
+/**
+ * @brief Append a record to the journal, if there is one. If the journal
+ * cannot be written, it is removed, because it would have less data than
+ * the autosaved track.
+ *
+ * @param self Pointer to #TrackHelper
+ * @param record The record
+ */
+static void track_helper_journal_append(
+		TrackHelper *self,
+		const TrackJournalRecord *record);
+
+/**
+ * @brief Add the data of a journal record to the track
+ *
+ * @param self Pointer to #TrackHelper
+ * @param record The record
+ */
+static void track_helper_replay(
+		TrackHelper *self,
+		const TrackJournalRecord *record);
+
+/**
+ * @brief Initialize an empty point store
+ *
+ * @param store Pointer to #TrackHelperPointStore
+ */
+static void track_helper_point_store_init(TrackHelperPointStore *store);
+
+/**
+ * @brief Remove all the points of a point store
+ *
+ * @param store Pointer to #TrackHelperPointStore
+ */
+static void track_helper_point_store_clear(TrackHelperPointStore *store);
+
+/**
+ * @brief Free the memory used by a point store
+ *
+ * @param store Pointer to #TrackHelperPointStore
+ */
+static void track_helper_point_store_free(TrackHelperPointStore *store);
+
+/**
+ * @brief Append a point to a point store
+ *
+ * @param store Pointer to #TrackHelperPointStore
+ * @param point The point. The distance and time to the previous point are
+ * ignored.
+ * @param segment_start Whether the point starts a segment
+ * @param distance Travelled distance of the track at the point, in meters
+ */
+static void track_helper_point_store_append(
+		TrackHelperPointStore *store,
+		const TrackHelperPoint *point,
+		gboolean segment_start,
+		gdouble distance);
+
+/**
+ * @brief Get a point of a point store
+ *
+ * @param store Pointer to #TrackHelperPointStore
+ * @param index Index of the point. Must be less than the length.
+ * @param point Return location for the point
+ */
+static void track_helper_point_store_get(
+		const TrackHelperPointStore *store,
+		guint index,
+		TrackHelperPoint *point);
+
+/**
+ * @brief Convert a time in microseconds to a struct timeval
+ *
+ * @param time The time in microseconds
+ * @param tv Return location for the time
+ */
+static void track_helper_time_to_timeval(gint64 time, struct timeval *tv);
+
 /*****************************************************************************
  * Function declarations for TrackHelperPoint                                *
  *****************************************************************************/
@@ -76,6 +229,7 @@ TrackHelperPoint *track_helper_point_new()
 	DEBUG_BEGIN();
 
 	point = g_new0(TrackHelperPoint, 1);
+	point->cadence = -1;
 
 	DEBUG_END();
 	return point;
@@ -107,6 +261,7 @@ TrackHelper *track_helper_new()
 	self = g_new0(TrackHelper, 1);
 
 	self->gpx_storage = gpx_storage_new();
+	track_helper_point_store_init(&self->track_points);
 
 	self->state = TRACK_HELPER_STOPPED;
 
@@ -157,27 +312,17 @@ void track_helper_add_track_point(
 		TrackHelper *self,
 		const TrackHelperPoint *point)
 {
-	TrackHelperPoint *point_copy = NULL;
-	TrackHelperPoint *prev_point = NULL;
+	TrackHelperPoint prev_point;
 	GpxStorageWaypoint wp;
+	TrackJournalRecord record;
+	gdouble distance_to_prev = 0;
+	struct timeval timestamp;
+	struct timeval time_to_prev;
 
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(point != NULL);
 	DEBUG_BEGIN();
 
-	/* Create a copy of the point */
-	point_copy = track_helper_point_new();
-	point_copy->latitude		= point->latitude;
-	point_copy->longitude		= point->longitude;
-	point_copy->altitude_is_set	= point->altitude_is_set;
-	point_copy->altitude		= point->altitude;
-	memcpy(&point_copy->timestamp, &point->timestamp,
-			sizeof(struct timeval));
-
-	/* Add the point to the list. We still can operate on it after this */
-	self->track_points = g_slist_prepend(self->track_points,
-			point_copy);
-
 	switch(self->state)
 	{
 		case TRACK_HELPER_STOPPED:
@@ -194,12 +339,28 @@ void track_helper_add_track_point(
 			break;
 	}
 
+	if(wp.point_type == GPX_STORAGE_POINT_TYPE_TRACK_START)
+	{
+		track_helper_journal_open(self);
+	}
+
+	track_helper_journal_record_init(&record,
+			TRACK_JOURNAL_RECORD_TRACK_POINT,
+			&point->timestamp);
+	record.data.track_point.latitude = point->latitude;
+	record.data.track_point.longitude = point->longitude;
+	record.data.track_point.altitude = point->altitude;
+	record.data.track_point.altitude_is_set = point->altitude_is_set;
+	record.data.track_point.cadence = point->cadence;
+	track_helper_journal_append(self, &record);
+
 	wp.route_track_id = self->current_track_id;
-	wp.latitude = point_copy->latitude;
-	wp.longitude = point_copy->longitude;
-	wp.altitude_is_set = point_copy->altitude_is_set;
-	wp.altitude = point_copy->altitude;
-	memcpy(&wp.timestamp, &point_copy->timestamp, sizeof(struct timeval));
+	wp.latitude = point->latitude;
+	wp.longitude = point->longitude;
+	wp.altitude_is_set = point->altitude_is_set;
+	wp.altitude = point->altitude;
+	wp.cadence = point->cadence;
+	memcpy(&wp.timestamp, &point->timestamp, sizeof(struct timeval));
 
 	gpx_storage_add_waypoint(self->gpx_storage,
 			&wp);
@@ -216,42 +377,46 @@ void track_helper_add_track_point(
 				self->track_comment);
 	}
 
+	/* A heart rate may have started the track before the first point */
 	if(self->state == TRACK_HELPER_STOPPED ||
-			self->state == TRACK_HELPER_PAUSED)
+			self->state == TRACK_HELPER_PAUSED ||
+			self->track_points.length == 0)
 	{
 		self->state = TRACK_HELPER_STARTED;
 		/* No previous point. Distance and elapsed time cannot
 		 * be calculated. */
-		point_copy->distance_to_prev = -1;
-		point_copy->time_to_prev.tv_sec = 0;
-		point_copy->time_to_prev.tv_usec = 0;
+		track_helper_point_store_append(&self->track_points, point,
+				TRUE, self->travelled_distance);
 		DEBUG_END();
 		return;
 	}
 
 	track_helper_data_changed(self);
 
-	/* Get the previous point from the list */
-	prev_point = (TrackHelperPoint *)g_slist_nth(
-			self->track_points, 1)->data;
+	track_helper_point_store_get(&self->track_points,
+			self->track_points.length - 1, &prev_point);
 
 	/* Calculate distance to previous point */
-	point_copy->distance_to_prev = location_distance_between(
-			point_copy->latitude,
-			point_copy->longitude,
-			prev_point->latitude,
-			prev_point->longitude
+	distance_to_prev = location_distance_between(
+			point->latitude,
+			point->longitude,
+			prev_point.latitude,
+			prev_point.longitude
 			) * 1000.0;
 
 	/* Calculate time to previous point */
-	util_subtract_time(&point_copy->timestamp,
-			&prev_point->timestamp,
-			&point_copy->time_to_prev);
+	timestamp = point->timestamp;
+	util_subtract_time(&timestamp,
+			&prev_point.timestamp,
+			&time_to_prev);
 
-	util_add_time(&self->elapsed_time, &point_copy->time_to_prev,
+	util_add_time(&self->elapsed_time, &time_to_prev,
 			&self->elapsed_time);
 
-	self->travelled_distance += point_copy->distance_to_prev;
+	self->travelled_distance += distance_to_prev;
+
+	track_helper_point_store_append(&self->track_points, point, FALSE,
+			self->travelled_distance);
 
 	DEBUG_END();
 }
@@ -262,35 +427,22 @@ void track_helper_add_heart_rate(
 		gint heart_rate)
 {
 	GpxStoragePointType point_type;
+	TrackJournalRecord record;
 
 	g_return_if_fail(self != NULL);
 	g_return_if_fail(time != NULL);
 	DEBUG_BEGIN();
 
-	switch(self->state)
+	if(!track_helper_begin_heart_rate(self, &point_type))
 	{
-		case TRACK_HELPER_STOPPED:
-			point_type = GPX_STORAGE_POINT_TYPE_TRACK_START;
-			break;
-		case TRACK_HELPER_PAUSED:
-			point_type =
-				GPX_STORAGE_POINT_TYPE_TRACK_SEGMENT_START;
-			break;
-		case TRACK_HELPER_STARTED:
-			point_type = GPX_STORAGE_POINT_TYPE_TRACK;
-			break;
-		default:
-			g_warning("Unknown track helper state: %d",
-					self->state);
-			DEBUG_END();
-			return;
+		DEBUG_END();
+		return;
 	}
 
-	if(self->state == TRACK_HELPER_STOPPED ||
-			self->state == TRACK_HELPER_PAUSED)
-	{
-		self->state = TRACK_HELPER_STARTED;
-	}
+	track_helper_journal_record_init(&record,
+			TRACK_JOURNAL_RECORD_HEART_RATE, time);
+	record.data.heart_rate.heart_rate = heart_rate;
+	track_helper_journal_append(self, &record);
 
 	gpx_storage_add_heart_rate(
 			self->gpx_storage,
@@ -299,29 +451,69 @@ void track_helper_add_heart_rate(
 			time,
 			heart_rate);
 
-	if(point_type == GPX_STORAGE_POINT_TYPE_TRACK_START)
+	track_helper_end_heart_rate(self, point_type);
+
+	DEBUG_END();
+}
+
+void track_helper_add_heart_rate_variability(
+		TrackHelper *self,
+		struct timeval *time,
+		const HrvMetrics *metrics)
+{
+	GpxStoragePointType point_type;
+	TrackJournalRecord record;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(time != NULL);
+	g_return_if_fail(metrics != NULL);
+	DEBUG_BEGIN();
+
+	if(!track_helper_begin_heart_rate(self, &point_type))
 	{
-		gpx_storage_set_path(self->gpx_storage, self->file_name);
-		gpx_storage_set_route_or_track_details(
-				self->gpx_storage,
-				TRUE,
-				self->current_track_id,
-				self->track_name,
-				self->track_comment);
+		DEBUG_END();
+		return;
 	}
 
-	track_helper_data_changed(self);
+	track_helper_journal_record_init(&record,
+			TRACK_JOURNAL_RECORD_HEART_RATE_VARIABILITY, time);
+	record.data.heart_rate_variability.heart_rate = metrics->heart_rate;
+	record.data.heart_rate_variability.sdnn = metrics->sdnn;
+	record.data.heart_rate_variability.rmssd = metrics->rmssd;
+	record.data.heart_rate_variability.pnn50 = metrics->pnn50;
+	track_helper_journal_append(self, &record);
+
+	gpx_storage_add_heart_rate_variability(
+			self->gpx_storage,
+			point_type,
+			&self->current_track_id,
+			time,
+			metrics);
+
+	track_helper_end_heart_rate(self, point_type);
 
 	DEBUG_END();
 }
 
 void track_helper_pause(TrackHelper *self)
 {
+	TrackJournalRecord record;
+
 	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 
 	self->state = TRACK_HELPER_PAUSED;
 
+	track_helper_journal_record_init(&record,
+			TRACK_JOURNAL_RECORD_PAUSE, NULL);
+	track_helper_journal_append(self, &record);
+
+	/* Nothing may be added for a while */
+	if(self->journal)
+	{
+		track_journal_sync(self->journal);
+	}
+
 	DEBUG_END();
 }
 
@@ -337,14 +529,93 @@ void track_helper_stop(TrackHelper *self)
 		ec_error_show_message_error(error->message);
 		g_error_free(error);
 		error = NULL;
+
+		/* Keep the journal, so that the track can be recovered */
+		track_helper_journal_close(self, FALSE);
+		return;
 	}
+
+	track_helper_journal_close(self, TRUE);
 }
 
-void track_helper_clear(TrackHelper *self, gboolean remove_tracks)
+gboolean track_helper_recover(const gchar *journal_path, GError **error)
 {
-	GSList *temp = NULL;
-	TrackHelperPoint *point;
+	TrackHelper *self = NULL;
+	TrackJournalHeader header;
+	GArray *records = NULL;
+	gchar *track_path = NULL;
+	gboolean retval = TRUE;
+	guint i = 0;
+
+	g_return_val_if_fail(journal_path != NULL, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	DEBUG_BEGIN();
+
+	track_path = track_journal_get_track_path(journal_path);
+	if(!track_path)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"%s is not a track journal", journal_path);
+		DEBUG_END();
+		return FALSE;
+	}
+
+	records = track_journal_read(journal_path, &header, error);
+	if(!records)
+	{
+		g_free(track_path);
+		DEBUG_END();
+		return FALSE;
+	}
+
+	DEBUG("Recovering %u records to %s", records->len, track_path);
 
+	self = track_helper_new();
+	self->recovering = TRUE;
+	track_helper_setup_track(self,
+			header.track_name[0] ? header.track_name : NULL,
+			header.track_comment[0] ? header.track_comment : NULL);
+	track_helper_set_file_name(self, track_path);
+
+	for(i = 0; i < records->len; i++)
+	{
+		track_helper_replay(self, &g_array_index(records,
+					TrackJournalRecord, i));
+	}
+
+	/* A journal without records had nothing to save */
+	if(records->len > 0)
+	{
+		retval = gpx_storage_write(self->gpx_storage, error);
+	}
+
+	if(retval && unlink(journal_path) == -1)
+	{
+		g_warning("Unable to remove track journal %s: %s",
+				journal_path, strerror(errno));
+	}
+
+	if(self->autosave_timer_id != 0)
+	{
+		g_source_remove(self->autosave_timer_id);
+	}
+	track_helper_journal_close(self, FALSE);
+	track_helper_point_store_free(&self->track_points);
+	gpx_storage_free(self->gpx_storage);
+	g_free(self->track_name);
+	g_free(self->track_comment);
+	g_free(self->file_name);
+	g_free(self);
+
+	g_array_free(records, TRUE);
+	g_free(track_path);
+
+	DEBUG_END();
+	return retval;
+}
+
+void track_helper_clear(TrackHelper *self, gboolean remove_tracks)
+{
 	g_return_if_fail(self != NULL);
 	DEBUG_BEGIN();
 
@@ -354,13 +625,7 @@ void track_helper_clear(TrackHelper *self, gboolean remove_tracks)
 	}
 
 	/* Clear all the current track points and reset statistics */
-	for(temp = self->track_points; temp; temp = g_slist_next(temp))
-	{
-		point = (TrackHelperPoint *)temp->data;
-		track_helper_point_free(point);
-	}
-	g_slist_free(self->track_points);
-	self->track_points = NULL;
+	track_helper_point_store_clear(&self->track_points);
 
 	self->travelled_distance = 0;
 	self->elapsed_time.tv_sec = 0;
@@ -404,15 +669,13 @@ guint track_helper_get_elapsed_time(TrackHelper *self)
 
 gdouble track_helper_get_current_speed(TrackHelper *self)
 {
+	const TrackHelperPointStore *store = NULL;
+	TrackHelperPointChunk *first_chunk = NULL;
+	TrackHelperPointChunk *latest_chunk = NULL;
 	gdouble distance_sum = 0;
-	struct timeval time_sum;
 	gdouble elapsed_secs;
-	gint i = 0;
-	GSList *temp = NULL;
-	TrackHelperPoint *point = NULL;
-
-	time_sum.tv_sec = 0;
-	time_sum.tv_usec = 0;
+	guint first = 0;
+	guint latest = 0;
 
 	g_return_val_if_fail(self != NULL, -1);
 	DEBUG_BEGIN();
@@ -423,29 +686,32 @@ gdouble track_helper_get_current_speed(TrackHelper *self)
 		return -1;
 	}
 
-	if(g_slist_length(self->track_points) < 6)
+	store = &self->track_points;
+	if(store->length < 6)
 	{
 		/* Less than five points, return the average speed of all
 		 * points so far */
 		return track_helper_get_average_speed(self);
 	}
 
-	temp = self->track_points;
-	for(i = 0; i < 5; i++)
+	/* The five latest distances must be in the same segment */
+	latest = store->length - 1;
+	first = store->length - 6;
+	if(store->segment_start > first)
 	{
-		point = (TrackHelperPoint *)temp->data;
-		if(point->distance_to_prev == -1)
-		{
-			DEBUG_END();
-			return -1;
-		}
-		distance_sum += point->distance_to_prev;
-		util_add_time(&time_sum, &point->time_to_prev, &time_sum);
-		temp = g_slist_next(temp);
+		DEBUG_END();
+		return -1;
 	}
 
-	elapsed_secs = (gdouble)time_sum.tv_sec +
-		(gdouble)time_sum.tv_usec / 1000000.0;
+	first_chunk = TRACK_HELPER_POINT_CHUNK(store, first);
+	latest_chunk = TRACK_HELPER_POINT_CHUNK(store, latest);
+	first = TRACK_HELPER_POINT_OFFSET(first);
+	latest = TRACK_HELPER_POINT_OFFSET(latest);
+
+	distance_sum = latest_chunk->distance[latest] -
+		first_chunk->distance[first];
+	elapsed_secs = (gdouble)(latest_chunk->time[latest] -
+			first_chunk->time[first]) / 1000000.0;
 
 	if(elapsed_secs == 0)
 	{
@@ -476,10 +742,111 @@ gdouble track_helper_get_average_speed(TrackHelper *self)
 	return self->travelled_distance / elapsed_secs * 3.6;
 }
 
+guint track_helper_get_track_point_count(TrackHelper *self)
+{
+	g_return_val_if_fail(self != NULL, 0);
+	return self->track_points.length;
+}
+
+gboolean track_helper_get_track_point(
+		TrackHelper *self,
+		guint index,
+		TrackHelperPoint *point)
+{
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(point != NULL, FALSE);
+
+	if(index >= self->track_points.length)
+	{
+		return FALSE;
+	}
+
+	track_helper_point_store_get(&self->track_points, index, point);
+	return TRUE;
+}
+
+void track_helper_get_track_points(
+		TrackHelper *self,
+		TrackHelperPointIter *iter)
+{
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(iter != NULL);
+
+	iter->store = &self->track_points;
+	iter->index = 0;
+}
+
+gboolean track_helper_point_iter_next(
+		TrackHelperPointIter *iter,
+		TrackHelperPoint *point)
+{
+	g_return_val_if_fail(iter != NULL, FALSE);
+	g_return_val_if_fail(point != NULL, FALSE);
+
+	if(iter->index >= iter->store->length)
+	{
+		return FALSE;
+	}
+
+	track_helper_point_store_get(iter->store, iter->index, point);
+	iter->index++;
+	return TRUE;
+}
+
 /*===========================================================================*
  * Private functions                                                         *
  *===========================================================================*/
 
+static gboolean track_helper_begin_heart_rate(
+		TrackHelper *self,
+		GpxStoragePointType *point_type)
+{
+	switch(self->state)
+	{
+		case TRACK_HELPER_STOPPED:
+			*point_type = GPX_STORAGE_POINT_TYPE_TRACK_START;
+			track_helper_journal_open(self);
+			break;
+		case TRACK_HELPER_PAUSED:
+			*point_type =
+				GPX_STORAGE_POINT_TYPE_TRACK_SEGMENT_START;
+			break;
+		case TRACK_HELPER_STARTED:
+			*point_type = GPX_STORAGE_POINT_TYPE_TRACK;
+			break;
+		default:
+			g_warning("Unknown track helper state: %d",
+					self->state);
+			return FALSE;
+	}
+
+	if(self->state == TRACK_HELPER_STOPPED ||
+			self->state == TRACK_HELPER_PAUSED)
+	{
+		self->state = TRACK_HELPER_STARTED;
+	}
+
+	return TRUE;
+}
+
+static void track_helper_end_heart_rate(
+		TrackHelper *self,
+		GpxStoragePointType point_type)
+{
+	if(point_type == GPX_STORAGE_POINT_TYPE_TRACK_START)
+	{
+		gpx_storage_set_path(self->gpx_storage, self->file_name);
+		gpx_storage_set_route_or_track_details(
+				self->gpx_storage,
+				TRUE,
+				self->current_track_id,
+				self->track_name,
+				self->track_comment);
+	}
+
+	track_helper_data_changed(self);
+}
+
 static void track_helper_data_changed(TrackHelper *self)
 {
 	g_return_if_fail(self != NULL);
@@ -525,3 +892,249 @@ static gboolean track_helper_autosave(gpointer user_data)
 	 * if data changes again */
 	return FALSE;
 }
+
+static void track_helper_journal_open(TrackHelper *self)
+{
+	GError *error = NULL;
+	gchar *path = NULL;
+
+	if(self->journal || self->recovering || !self->file_name)
+	{
+		return;
+	}
+
+	path = track_journal_get_path_for_track(self->file_name);
+	self->journal = track_journal_new(path, self->track_name,
+			self->track_comment, &error);
+	if(!self->journal)
+	{
+		/* The track is recorded anyway */
+		g_warning("Unable to create track journal: %s",
+				error->message);
+		g_error_free(error);
+	} else {
+		self->journal_sync_id = g_timeout_add(
+				TRACK_JOURNAL_SYNC_INTERVAL * 1000,
+				track_helper_journal_sync_timeout,
+				self);
+	}
+	g_free(path);
+}
+
+static void track_helper_journal_close(TrackHelper *self, gboolean remove)
+{
+	if(self->journal_sync_id != 0)
+	{
+		g_source_remove(self->journal_sync_id);
+		self->journal_sync_id = 0;
+	}
+
+	if(self->journal)
+	{
+		track_journal_close(self->journal, remove);
+		self->journal = NULL;
+	}
+}
+
+static gboolean track_helper_journal_sync_timeout(gpointer user_data)
+{
+	TrackHelper *self = (TrackHelper *)user_data;
+
+	g_return_val_if_fail(self != NULL, FALSE);
+
+	if(!track_journal_sync(self->journal))
+	{
+		/* As in track_helper_journal_append() */
+		self->journal_sync_id = 0;
+		track_helper_journal_close(self, TRUE);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void track_helper_journal_record_init(
+		TrackJournalRecord *record,
+		TrackJournalRecordType type,
+		const struct timeval *time)
+{
+	struct timeval now;
+
+	if(!time)
+	{
+		gettimeofday(&now, NULL);
+		time = &now;
+	}
+
+	memset(record, 0, sizeof(TrackJournalRecord));
+	record->type = type;
+	record->time = (gint64)time->tv_sec * G_USEC_PER_SEC + time->tv_usec;
+}
+
+static void track_helper_journal_append(
+		TrackHelper *self,
+		const TrackJournalRecord *record)
+{
+	if(!self->journal)
+	{
+		return;
+	}
+
+	if(!track_journal_append(self->journal, record))
+	{
+		track_helper_journal_close(self, TRUE);
+	}
+}
+
+static void track_helper_replay(
+		TrackHelper *self,
+		const TrackJournalRecord *record)
+{
+	TrackHelperPoint point;
+	HrvMetrics metrics;
+	struct timeval time;
+
+	time.tv_sec = record->time / G_USEC_PER_SEC;
+	time.tv_usec = record->time % G_USEC_PER_SEC;
+
+	switch(record->type)
+	{
+		case TRACK_JOURNAL_RECORD_TRACK_POINT:
+			memset(&point, 0, sizeof(point));
+			point.latitude = record->data.track_point.latitude;
+			point.longitude = record->data.track_point.longitude;
+			point.altitude = record->data.track_point.altitude;
+			point.altitude_is_set =
+				record->data.track_point.altitude_is_set;
+			point.cadence = record->data.track_point.cadence;
+			point.timestamp = time;
+			track_helper_add_track_point(self, &point);
+			break;
+		case TRACK_JOURNAL_RECORD_HEART_RATE:
+			track_helper_add_heart_rate(self, &time,
+					record->data.heart_rate.heart_rate);
+			break;
+		case TRACK_JOURNAL_RECORD_HEART_RATE_VARIABILITY:
+			memset(&metrics, 0, sizeof(metrics));
+			metrics.heart_rate =
+				record->data.heart_rate_variability.heart_rate;
+			metrics.sdnn = record->data.heart_rate_variability.sdnn;
+			metrics.rmssd =
+				record->data.heart_rate_variability.rmssd;
+			metrics.pnn50 =
+				record->data.heart_rate_variability.pnn50;
+			track_helper_add_heart_rate_variability(self, &time,
+					&metrics);
+			break;
+		case TRACK_JOURNAL_RECORD_PAUSE:
+			track_helper_pause(self);
+			break;
+		default:
+			g_warning("Unknown track journal record type: %u",
+					record->type);
+	}
+}
+
+static void track_helper_point_store_init(TrackHelperPointStore *store)
+{
+	store->chunks = g_ptr_array_new();
+	store->length = 0;
+	store->segment_start = 0;
+}
+
+static void track_helper_point_store_clear(TrackHelperPointStore *store)
+{
+	guint i = 0;
+
+	for(i = 0; i < store->chunks->len; i++)
+	{
+		g_free(g_ptr_array_index(store->chunks, i));
+	}
+	g_ptr_array_set_size(store->chunks, 0);
+	store->length = 0;
+	store->segment_start = 0;
+}
+
+static void track_helper_point_store_free(TrackHelperPointStore *store)
+{
+	track_helper_point_store_clear(store);
+	g_ptr_array_free(store->chunks, TRUE);
+	store->chunks = NULL;
+}
+
+static void track_helper_point_store_append(
+		TrackHelperPointStore *store,
+		const TrackHelperPoint *point,
+		gboolean segment_start,
+		gdouble distance)
+{
+	TrackHelperPointChunk *chunk = NULL;
+	guint i = TRACK_HELPER_POINT_OFFSET(store->length);
+
+	if(i == 0)
+	{
+		g_ptr_array_add(store->chunks,
+				g_new(TrackHelperPointChunk, 1));
+	}
+	chunk = TRACK_HELPER_POINT_CHUNK(store, store->length);
+
+	chunk->latitude[i] = point->latitude;
+	chunk->longitude[i] = point->longitude;
+	chunk->altitude[i] = point->altitude;
+	chunk->time[i] = (gint64)point->timestamp.tv_sec * G_USEC_PER_SEC +
+		point->timestamp.tv_usec;
+	chunk->distance[i] = distance;
+	chunk->cadence[i] = point->cadence;
+	chunk->flags[i] = 0;
+	if(point->altitude_is_set)
+	{
+		chunk->flags[i] |= TRACK_HELPER_POINT_ALTITUDE_IS_SET;
+	}
+	if(segment_start)
+	{
+		chunk->flags[i] |= TRACK_HELPER_POINT_SEGMENT_START;
+		store->segment_start = store->length;
+	}
+
+	store->length++;
+}
+
+static void track_helper_point_store_get(
+		const TrackHelperPointStore *store,
+		guint index,
+		TrackHelperPoint *point)
+{
+	TrackHelperPointChunk *chunk = TRACK_HELPER_POINT_CHUNK(store, index);
+	TrackHelperPointChunk *prev_chunk = NULL;
+	guint i = TRACK_HELPER_POINT_OFFSET(index);
+	guint prev = 0;
+
+	point->latitude = chunk->latitude[i];
+	point->longitude = chunk->longitude[i];
+	point->altitude_is_set = (chunk->flags[i] &
+			TRACK_HELPER_POINT_ALTITUDE_IS_SET) != 0;
+	point->altitude = chunk->altitude[i];
+	track_helper_time_to_timeval(chunk->time[i], &point->timestamp);
+	point->cadence = chunk->cadence[i];
+
+	if(chunk->flags[i] & TRACK_HELPER_POINT_SEGMENT_START)
+	{
+		point->distance_to_prev = -1;
+		point->time_to_prev.tv_sec = 0;
+		point->time_to_prev.tv_usec = 0;
+		return;
+	}
+
+	prev_chunk = TRACK_HELPER_POINT_CHUNK(store, index - 1);
+	prev = TRACK_HELPER_POINT_OFFSET(index - 1);
+	point->distance_to_prev = chunk->distance[i] -
+		prev_chunk->distance[prev];
+	track_helper_time_to_timeval(chunk->time[i] - prev_chunk->time[prev],
+			&point->time_to_prev);
+}
+
+static void track_helper_time_to_timeval(gint64 time, struct timeval *tv)
+{
+	tv->tv_sec = time / G_USEC_PER_SEC;
+	tv->tv_usec = time % G_USEC_PER_SEC;
+}
@@ -35,6 +35,7 @@
 
 /* Other modules */
 #include "gpx.h"
+#include "track_journal.h"
 
 typedef enum _TrackHelperState {
 	TRACK_HELPER_STOPPED,
@@ -55,15 +56,23 @@ typedef struct _TrackHelperPoint {
 	/** @brief Altitude */
 	gdouble altitude;
 
-	/** @brief Time stamp (in Unix time format, i.e., seconds from Epoch) */
+	/**
+	 * @brief Time stamp (in Unix time format, i.e., seconds from Epoch).
+	 * Convert it from the time base of sample_clock.h with
+	 * sample_clock_to_timeval(), so that the point lines up with the
+	 * heart rate data of the track.
+	 */
 	struct timeval timestamp;
 
+	/** @brief Cadence in steps per minute, or -1 if not known */
+	gint cadence;
+
 	/**
 	 * @brief Distance to previous track point in meters,
 	 * or -1 if not defined (first point after start or resume).
 	 *
-	 * @note This will be automatically set by
-	 * #track_helper_add_track_point()
+	 * @note This is ignored by #track_helper_add_track_point(), and set
+	 * when the point is read from the track
 	 */
 	gdouble distance_to_prev;
 
@@ -71,8 +80,8 @@ typedef struct _TrackHelperPoint {
 	 * @brief Time elapsed since previous track point
 	 * or 0 if not defined (first point after start or resume).
 	 *
-	 * @note This will be automatically set by
-	 * #track_helper_add_track_point()
+	 * @note This is ignored by #track_helper_add_track_point(), and set
+	 * when the point is read from the track
 	 */
 	struct timeval time_to_prev;
 } TrackHelperPoint;
@@ -92,14 +101,73 @@ TrackHelperPoint *track_helper_point_new();
  */
 void track_helper_point_free(TrackHelperPoint *point);
 
-typedef struct _TrackHelper {
+/** @brief Number of points in a #TrackHelperPointChunk (a power of two) */
+#define TRACK_HELPER_POINT_CHUNK_LENGTH		1024
+
+/** @brief Flags of a point in a #TrackHelperPointChunk */
+#define TRACK_HELPER_POINT_ALTITUDE_IS_SET	0x01
+#define TRACK_HELPER_POINT_SEGMENT_START	0x02
+
+/**
+ * @brief A fixed number of track points, stored a column per field so
+ * that a scan over one field reads contiguous memory
+ */
+typedef struct _TrackHelperPointChunk {
+	gdouble latitude[TRACK_HELPER_POINT_CHUNK_LENGTH];
+	gdouble longitude[TRACK_HELPER_POINT_CHUNK_LENGTH];
+	gdouble altitude[TRACK_HELPER_POINT_CHUNK_LENGTH];
+
+	/** @brief Time stamps in microseconds since the Epoch */
+	gint64 time[TRACK_HELPER_POINT_CHUNK_LENGTH];
+
 	/**
-	 * @brief List of track points
-	 *
-	 * @note The list points are in reverse order (latest point first),
-	 * because prepending to a linked list is faster than appending
+	 * @brief Travelled distance of the track at each point, in meters.
+	 * The distance between two points of a segment is the difference.
 	 */
-	GSList *track_points;
+	gdouble distance[TRACK_HELPER_POINT_CHUNK_LENGTH];
+
+	gint cadence[TRACK_HELPER_POINT_CHUNK_LENGTH];
+
+	/** @brief TRACK_HELPER_POINT_ALTITUDE_IS_SET and so on */
+	guint8 flags[TRACK_HELPER_POINT_CHUNK_LENGTH];
+} TrackHelperPointChunk;
+
+/**
+ * @brief The points of a track, in the order in which they were added.
+ *
+ * Point n is in chunk n / TRACK_HELPER_POINT_CHUNK_LENGTH, so a point is
+ * found and appended in constant time, and the points are never moved.
+ *
+ * Consider all the fields private, and read the points with
+ * #TrackHelperPointIter or track_helper_get_track_point().
+ */
+typedef struct _TrackHelperPointStore {
+	/** @brief The chunks (#TrackHelperPointChunk) */
+	GPtrArray *chunks;
+
+	/** @brief Number of points */
+	guint length;
+
+	/** @brief Index of the first point of the latest segment */
+	guint segment_start;
+} TrackHelperPointStore;
+
+/**
+ * @brief Iterates over the points of a track. Initialize with
+ * track_helper_get_track_points().
+ *
+ * Consider all the fields private.
+ */
+typedef struct _TrackHelperPointIter {
+	const TrackHelperPointStore *store;
+
+	/** @brief Index of the next point */
+	guint index;
+} TrackHelperPointIter;
+
+typedef struct _TrackHelper {
+	/** @brief The track points */
+	TrackHelperPointStore track_points;
 
 	time_t start;
 	time_t end;
@@ -131,6 +199,21 @@ typedef struct _TrackHelper {
 
 	/** @brief File name to save the track to */
 	gchar *file_name;
+
+	/**
+	 * @brief Journal of the current track, which is removed when the
+	 * track has been saved
+	 */
+	TrackJournal *journal;
+
+	/**
+	 * @brief Source id of the timeout that syncs the journal while
+	 * nothing is appended, or 0 if there is no journal
+	 */
+	guint journal_sync_id;
+
+	/** @brief Whether a journal is being replayed to the track */
+	gboolean recovering;
 } TrackHelper;
 
 /**
@@ -138,6 +221,19 @@ typedef struct _TrackHelper {
  */
 TrackHelper *track_helper_new();
 
+/**
+ * @brief Save the track of a journal that was left behind when eCoach
+ * was not stopped properly. The GPX file of the track is overwritten with
+ * the track of the journal, and the journal is removed.
+ *
+ * @param journal_path Path of the journal (see
+ * track_journal_get_path_for_track())
+ * @param error Return location for possible error
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean track_helper_recover(const gchar *journal_path, GError **error);
+
 /**
  * @brief Clears all data from #TrackHelper and sets state to stopped
  *
@@ -195,7 +291,8 @@ void track_helper_add_track_point(
  * to a "track" even when GPS is not in use.
  *
  * @param self Pointer to #TrackHelper
- * @param time Time when the heart rate was added
+ * @param time Time when the heart rate was detected, converted with
+ * sample_clock_to_timeval()
  * @param heart_rate Heart rate (in beats per minute)
  */
 void track_helper_add_heart_rate(
@@ -203,6 +300,20 @@ void track_helper_add_heart_rate(
 		struct timeval *time,
 		gint heart_rate);
 
+/**
+ * @brief Add heart rate variability metrics to a track, like
+ * track_helper_add_heart_rate(). Suitable to be called from a
+ * #BeatDetectorHrvFunc.
+ *
+ * @param self Pointer to #TrackHelper
+ * @param time Time of the latest beat in the window
+ * @param metrics The metrics
+ */
+void track_helper_add_heart_rate_variability(
+		TrackHelper *self,
+		struct timeval *time,
+		const HrvMetrics *metrics);
+
 /**
  * @brief Add a pause to track
  *
@@ -211,7 +322,8 @@ void track_helper_add_heart_rate(
 void track_helper_pause(TrackHelper *self);
 
 /**
- * @brief Stop the track recording
+ * @brief Stop the track recording. The track is saved, and its journal is
+ * removed if saving succeeds.
  *
  * @param self Pointer to #TrackHelper
  */
@@ -270,13 +382,52 @@ gdouble track_helper_get_travelled_distance(TrackHelper *self);
  */
 
 /**
- * @brief Returns a GList of track points
+ * @brief Get the number of track points
+ *
+ * @param self Pointer to #TrackHelper
+ *
+ * @return Number of track points
+ */
+guint track_helper_get_track_point_count(TrackHelper *self);
+
+/**
+ * @brief Get a track point
+ *
+ * @param self Pointer to #TrackHelper
+ * @param index Index of the point, 0 being the first point of the track
+ * @param point Return location for the point
+ *
+ * @return TRUE on success, FALSE if there is no such point
+ */
+gboolean track_helper_get_track_point(
+		TrackHelper *self,
+		guint index,
+		TrackHelperPoint *point);
+
+/**
+ * @brief Start iterating over the track points, from the first point to
+ * the latest
+ *
+ * @param self Pointer to #TrackHelper
+ * @param iter Iterator to initialize
+ *
+ * @warning The iterator is invalid after track_helper_clear(). Points
+ * that are added while iterating are included.
+ */
+void track_helper_get_track_points(
+		TrackHelper *self,
+		TrackHelperPointIter *iter);
+
+/**
+ * @brief Get the next track point
  *
- * @note The list items are in reverse order, because prepending is much
- * more effective with linked lists than appending
+ * @param iter Pointer to #TrackHelperPointIter
+ * @param point Return location for the point
  *
- * @warning Do not modify or free the list or its elements.
+ * @return TRUE if a point was returned, FALSE if there are no more points
  */
-const GSList *track_helper_get_track_points(TrackHelper *self);
+gboolean track_helper_point_iter_next(
+		TrackHelperPointIter *iter,
+		TrackHelperPoint *point);
 
 #endif /* _TRACK_H */
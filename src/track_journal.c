@@ -0,0 +1,385 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "track_journal.h"
+
+/* System */
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Other modules */
+#include "ec_error.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+/** @brief Parameters of the FNV-1a hash that is used as the checksum */
+#define TRACK_JOURNAL_CHECKSUM_BASIS		2166136261U
+#define TRACK_JOURNAL_CHECKSUM_PRIME		16777619U
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Compute the checksum of a record
+ *
+ * @param record The record. The checksum field is not included.
+ *
+ * @return The checksum
+ */
+static guint32 track_journal_checksum(const TrackJournalRecord *record);
+
+/**
+ * @brief Write data to the file. Sets the failed flag on error.
+ *
+ * @param self Pointer to #TrackJournal
+ * @param data The data
+ * @param length Length of the data
+ *
+ * @return TRUE on success, FALSE on failure (see errno)
+ */
+static gboolean track_journal_write(
+		TrackJournal *self,
+		const void *data,
+		gsize length);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+TrackJournal *track_journal_new(
+		const gchar *path,
+		const gchar *track_name,
+		const gchar *track_comment,
+		GError **error)
+{
+	TrackJournal *self = NULL;
+	TrackJournalHeader header;
+
+	g_return_val_if_fail(path != NULL, NULL);
+	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+	DEBUG_BEGIN();
+
+	self = g_new0(TrackJournal, 1);
+	self->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(self->fd == -1)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to create track journal %s: %s",
+				path, strerror(errno));
+		g_free(self);
+		DEBUG_END();
+		return NULL;
+	}
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TRACK_JOURNAL_MAGIC, sizeof(header.magic));
+	header.version = TRACK_JOURNAL_VERSION;
+	header.header_length = sizeof(header);
+	if(track_name)
+	{
+		g_strlcpy(header.track_name, track_name,
+				sizeof(header.track_name));
+	}
+	if(track_comment)
+	{
+		g_strlcpy(header.track_comment, track_comment,
+				sizeof(header.track_comment));
+	}
+
+	/* The header is synced with the first batch */
+	if(!track_journal_write(self, &header, sizeof(header)))
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE,
+				"Unable to write track journal %s: %s",
+				path, strerror(errno));
+		close(self->fd);
+		g_free(self);
+		DEBUG_END();
+		return NULL;
+	}
+
+	self->path = g_strdup(path);
+
+	DEBUG_END();
+	return self;
+}
+
+gboolean track_journal_append(
+		TrackJournal *self,
+		const TrackJournalRecord *record)
+{
+	TrackJournalRecord *batch_record = NULL;
+	GTimeVal now;
+
+	g_return_val_if_fail(self != NULL, FALSE);
+	g_return_val_if_fail(record != NULL, FALSE);
+
+	if(self->failed)
+	{
+		return FALSE;
+	}
+
+	g_get_current_time(&now);
+	if(self->batch_length == 0)
+	{
+		self->batch_time = now;
+	}
+
+	batch_record = &self->batch[self->batch_length++];
+	*batch_record = *record;
+	batch_record->checksum = track_journal_checksum(batch_record);
+
+	if(self->batch_length == TRACK_JOURNAL_BATCH_LENGTH ||
+			now.tv_sec - self->batch_time.tv_sec >=
+			TRACK_JOURNAL_SYNC_INTERVAL)
+	{
+		return track_journal_sync(self);
+	}
+
+	return TRUE;
+}
+
+gboolean track_journal_sync(TrackJournal *self)
+{
+	gsize length = 0;
+
+	g_return_val_if_fail(self != NULL, FALSE);
+
+	if(self->failed)
+	{
+		return FALSE;
+	}
+
+	if(self->batch_length == 0)
+	{
+		return TRUE;
+	}
+
+	length = self->batch_length * sizeof(TrackJournalRecord);
+	if(!track_journal_write(self, self->batch, length))
+	{
+		g_warning("Unable to write track journal: %s",
+				strerror(errno));
+		return FALSE;
+	}
+	self->batch_length = 0;
+
+	if(fdatasync(self->fd) == -1)
+	{
+		g_warning("Unable to sync track journal: %s",
+				strerror(errno));
+		self->failed = TRUE;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+void track_journal_close(TrackJournal *self, gboolean remove)
+{
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	if(remove)
+	{
+		/* Syncing is no use anymore */
+		close(self->fd);
+		if(unlink(self->path) == -1)
+		{
+			g_warning("Unable to remove track journal %s: %s",
+					self->path, strerror(errno));
+		}
+	} else {
+		track_journal_sync(self);
+		close(self->fd);
+	}
+
+	g_free(self->path);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+GArray *track_journal_read(
+		const gchar *path,
+		TrackJournalHeader *header,
+		GError **error)
+{
+	GArray *records = NULL;
+	const TrackJournalRecord *record = NULL;
+	gchar *contents = NULL;
+	gsize length = 0;
+	gsize offset = 0;
+
+	g_return_val_if_fail(path != NULL, NULL);
+	g_return_val_if_fail(header != NULL, NULL);
+	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+	DEBUG_BEGIN();
+
+	if(!g_file_get_contents(path, &contents, &length, error))
+	{
+		DEBUG_END();
+		return NULL;
+	}
+
+	if(length < sizeof(TrackJournalHeader))
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"%s is not a track journal", path);
+		g_free(contents);
+		DEBUG_END();
+		return NULL;
+	}
+
+	memcpy(header, contents, sizeof(TrackJournalHeader));
+	if(memcmp(header->magic, TRACK_JOURNAL_MAGIC, sizeof(header->magic))
+			!= 0 ||
+			header->version != TRACK_JOURNAL_VERSION ||
+			header->header_length < sizeof(TrackJournalHeader) ||
+			header->header_length > length)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"%s is not a supported track journal", path);
+		g_free(contents);
+		DEBUG_END();
+		return NULL;
+	}
+	header->track_name[TRACK_JOURNAL_TEXT_LENGTH - 1] = '\0';
+	header->track_comment[TRACK_JOURNAL_TEXT_LENGTH - 1] = '\0';
+
+	records = g_array_new(FALSE, FALSE, sizeof(TrackJournalRecord));
+	for(offset = header->header_length;
+			offset + sizeof(TrackJournalRecord) <= length;
+			offset += sizeof(TrackJournalRecord))
+	{
+		/* The records may not be aligned in the contents */
+		record = (const TrackJournalRecord *)(contents + offset);
+		g_array_append_vals(records, record, 1);
+		record = &g_array_index(records, TrackJournalRecord,
+				records->len - 1);
+
+		/* The rest was not on the disk when writing stopped */
+		if(record->type < TRACK_JOURNAL_RECORD_TRACK_POINT ||
+				record->type > TRACK_JOURNAL_RECORD_PAUSE ||
+				record->checksum !=
+				track_journal_checksum(record))
+		{
+			DEBUG("Track journal ends at record %u",
+					records->len - 1);
+			g_array_set_size(records, records->len - 1);
+			break;
+		}
+	}
+
+	g_free(contents);
+
+	DEBUG_END();
+	return records;
+}
+
+gchar *track_journal_get_path_for_track(const gchar *track_path)
+{
+	g_return_val_if_fail(track_path != NULL, NULL);
+	return g_strconcat(track_path, TRACK_JOURNAL_EXTENSION, NULL);
+}
+
+gchar *track_journal_get_track_path(const gchar *journal_path)
+{
+	g_return_val_if_fail(journal_path != NULL, NULL);
+
+	if(!g_str_has_suffix(journal_path, TRACK_JOURNAL_EXTENSION))
+	{
+		return NULL;
+	}
+
+	return g_strndup(journal_path, strlen(journal_path) -
+			strlen(TRACK_JOURNAL_EXTENSION));
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static guint32 track_journal_checksum(const TrackJournalRecord *record)
+{
+	const guint8 *data = (const guint8 *)&record->time;
+	const guint8 *end = (const guint8 *)(record + 1);
+	guint32 hash = TRACK_JOURNAL_CHECKSUM_BASIS;
+	guint32 type = record->type;
+	gint i = 0;
+
+	for(i = 0; i < 4; i++)
+	{
+		hash = (hash ^ (type & 0xff)) * TRACK_JOURNAL_CHECKSUM_PRIME;
+		type >>= 8;
+	}
+
+	for(; data < end; data++)
+	{
+		hash = (hash ^ *data) * TRACK_JOURNAL_CHECKSUM_PRIME;
+	}
+
+	return hash;
+}
+
+static gboolean track_journal_write(
+		TrackJournal *self,
+		const void *data,
+		gsize length)
+{
+	const guint8 *position = (const guint8 *)data;
+	gssize written = 0;
+
+	while(length > 0)
+	{
+		written = write(self->fd, position, length);
+		if(written < 0)
+		{
+			if(errno == EINTR)
+			{
+				continue;
+			}
+			self->failed = TRUE;
+			return FALSE;
+		}
+		position += written;
+		length -= written;
+	}
+
+	return TRUE;
+}
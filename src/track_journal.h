@@ -0,0 +1,246 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _TRACK_JOURNAL_H
+#define _TRACK_JOURNAL_H
+
+/* Configuration */
+#include "config.h"
+
+/* GLib */
+#include <glib.h>
+
+/**
+ * @brief Identifies a track journal file. Stored in the beginning of the
+ * file.
+ */
+#define TRACK_JOURNAL_MAGIC			"ECTRKJNL"
+#define TRACK_JOURNAL_VERSION			1
+
+/** @brief Maximum length of the track name and comment in the header */
+#define TRACK_JOURNAL_TEXT_LENGTH		256
+
+/**
+ * @brief Number of records that are collected before they are written
+ * and synced
+ */
+#define TRACK_JOURNAL_BATCH_LENGTH		32
+
+/**
+ * @brief Maximum time that a record waits to be written and synced, in
+ * seconds
+ */
+#define TRACK_JOURNAL_SYNC_INTERVAL		5
+
+/** @brief Extension of the journal that is stored with a track */
+#define TRACK_JOURNAL_EXTENSION			".journal"
+
+typedef enum _TrackJournalRecordType {
+	/** @brief A track point (see #TrackHelperPoint) */
+	TRACK_JOURNAL_RECORD_TRACK_POINT = 1,
+
+	/** @brief A heart rate */
+	TRACK_JOURNAL_RECORD_HEART_RATE,
+
+	/** @brief Heart rate variability metrics (see #HrvMetrics) */
+	TRACK_JOURNAL_RECORD_HEART_RATE_VARIABILITY,
+
+	/** @brief The track was paused. The next point starts a segment. */
+	TRACK_JOURNAL_RECORD_PAUSE
+} TrackJournalRecordType;
+
+/**
+ * @brief Header of a track journal file.
+ *
+ * A track journal keeps the data of the track that is being recorded on
+ * the disk, so that it can be written to the GPX file even if eCoach is
+ * killed or the battery runs out before the track is saved. The header is
+ * followed by #TrackJournalRecord structures in the order in which the
+ * data was added to the track.
+ *
+ * The numbers are stored in the byte order of the machine that wrote the
+ * file.
+ */
+typedef struct _TrackJournalHeader {
+	gchar magic[8];
+	guint32 version;
+	guint32 header_length;
+
+	/** @brief Name of the track. Zero terminated. */
+	gchar track_name[TRACK_JOURNAL_TEXT_LENGTH];
+
+	/** @brief Comment of the track. Zero terminated. */
+	gchar track_comment[TRACK_JOURNAL_TEXT_LENGTH];
+} TrackJournalHeader;
+
+/**
+ * @brief A fixed size record of a track journal
+ */
+typedef struct _TrackJournalRecord {
+	/** @brief Type of the record (see #TrackJournalRecordType) */
+	guint32 type;
+
+	/**
+	 * @brief Checksum of the rest of the record. A record that was only
+	 * partly written when the power went off has a wrong checksum.
+	 */
+	guint32 checksum;
+
+	/** @brief Time stamp in microseconds since the Epoch */
+	gint64 time;
+
+	union {
+		struct {
+			gdouble latitude;
+			gdouble longitude;
+			gdouble altitude;
+			gint32 altitude_is_set;
+			gint32 cadence;
+		} track_point;
+
+		struct {
+			gint32 heart_rate;
+		} heart_rate;
+
+		struct {
+			gdouble heart_rate;
+			gdouble sdnn;
+			gdouble rmssd;
+			gdouble pnn50;
+		} heart_rate_variability;
+	} data;
+} TrackJournalRecord;
+
+/**
+ * @brief Writes a track journal file.
+ *
+ * The records are collected and written in batches, each of which is
+ * synced to the disk with one fdatasync(). A batch is written when it has
+ * TRACK_JOURNAL_BATCH_LENGTH records, or when its first record has waited
+ * for TRACK_JOURNAL_SYNC_INTERVAL seconds, so at most that much data is
+ * lost if the device loses power. The age of the batch is only checked
+ * when a record is appended, so call track_journal_sync() at that interval
+ * too. A crashed process loses nothing that was written.
+ *
+ * Consider all the fields private.
+ */
+typedef struct _TrackJournal {
+	gint fd;
+	gchar *path;
+
+	/** @brief Whether writing has failed. Nothing is written after
+	 * that. */
+	gboolean failed;
+
+	/** @brief Records waiting to be written */
+	TrackJournalRecord batch[TRACK_JOURNAL_BATCH_LENGTH];
+	guint batch_length;
+
+	/** @brief When the first record of the batch was appended */
+	GTimeVal batch_time;
+} TrackJournal;
+
+/**
+ * @brief Create a track journal file. An existing file is overwritten.
+ *
+ * @param path Path of the file
+ * @param track_name Name of the track, or NULL
+ * @param track_comment Comment of the track, or NULL
+ * @param error Return location for possible error
+ *
+ * @return Newly allocated journal, or NULL in case of an error
+ */
+TrackJournal *track_journal_new(
+		const gchar *path,
+		const gchar *track_name,
+		const gchar *track_comment,
+		GError **error);
+
+/**
+ * @brief Append a record. The type, time and data of the record must be
+ * set; the checksum is computed here.
+ *
+ * @param self Pointer to #TrackJournal
+ * @param record The record
+ *
+ * @return TRUE on success, FALSE if writing has failed
+ */
+gboolean track_journal_append(
+		TrackJournal *self,
+		const TrackJournalRecord *record);
+
+/**
+ * @brief Write the collected records, and wait until they are on the disk
+ *
+ * @param self Pointer to #TrackJournal
+ *
+ * @return TRUE on success, FALSE if writing has failed
+ */
+gboolean track_journal_sync(TrackJournal *self);
+
+/**
+ * @brief Close the file and free the journal. The collected records are
+ * written first, unless the file is removed.
+ *
+ * @param self Pointer to #TrackJournal
+ * @param remove Whether to remove the file, because the track has been
+ * saved
+ */
+void track_journal_close(TrackJournal *self, gboolean remove);
+
+/**
+ * @brief Read a track journal file
+ *
+ * @param path Path of the file
+ * @param header Return location for the header
+ * @param error Return location for possible error
+ *
+ * @return Newly allocated array of #TrackJournalRecord, or NULL in case
+ * of an error. The records end at the first record that is incomplete or
+ * has a wrong checksum. Free with g_array_free().
+ */
+GArray *track_journal_read(
+		const gchar *path,
+		TrackJournalHeader *header,
+		GError **error);
+
+/**
+ * @brief Get the path of the journal of a track
+ *
+ * @param track_path Path of the track (GPX) file
+ *
+ * @return Newly allocated path, with TRACK_JOURNAL_EXTENSION appended.
+ * Free with g_free().
+ */
+gchar *track_journal_get_path_for_track(const gchar *track_path);
+
+/**
+ * @brief Get the path of the track of a journal
+ *
+ * @param journal_path Path of the journal file
+ *
+ * @return Newly allocated path of the track (GPX) file, or NULL if the
+ * path does not end with TRACK_JOURNAL_EXTENSION. Free with g_free().
+ */
+gchar *track_journal_get_track_path(const gchar *journal_path);
+
+#endif /* _TRACK_JOURNAL_H */
@@ -0,0 +1,477 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*
+ * Benchmark and crash test for the track journal.
+ *
+ * First, track points are appended to a journal as fast as possible, and
+ * the mean and the worst time of an append are printed. Every
+ * TRACK_JOURNAL_BATCH_LENGTH:th append writes and syncs the batch, so the
+ * worst time is the time of a write and an fdatasync().
+ *
+ * Then a child process appends track points to a journal and reports
+ * through a pipe how many of them are synced, until it is killed with
+ * SIGKILL at a random moment. The journal is read back, and every record
+ * that was reported synced must be there, intact and in order. The
+ * records that were not synced may or may not be there. Finally, the
+ * journal is cut in the middle of a record and the last record is
+ * corrupted, and the reader must stop before them.
+ *
+ * The exit status is 0 if the crash test passes, 1 if not.
+ *
+ * Usage: track_journal_bench [records] [crash rounds] [directory]
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* System */
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "track_journal.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define TRACK_JOURNAL_BENCH_DEFAULT_RECORDS	100000
+#define TRACK_JOURNAL_BENCH_DEFAULT_ROUNDS	20
+
+/** @brief Most records that the child appends before it is killed */
+#define TRACK_JOURNAL_BENCH_MAX_KILL_AT		20000
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Fill a track point record that can be recognized later
+ *
+ * @param record The record
+ * @param index Index of the record in the journal
+ */
+static void track_journal_bench_record(
+		TrackJournalRecord *record,
+		guint index);
+
+/**
+ * @brief Check that a record is the one that track_journal_bench_record()
+ * created
+ *
+ * @param record The record
+ * @param index Index of the record in the journal
+ *
+ * @return TRUE if the record is right
+ */
+static gboolean track_journal_bench_check_record(
+		const TrackJournalRecord *record,
+		guint index);
+
+/**
+ * @brief Measure the time of appending records
+ *
+ * @param path Path of the journal
+ * @param record_count Number of records to append
+ *
+ * @return TRUE on success, FALSE if the journal could not be written
+ */
+static gboolean track_journal_bench_append(
+		const gchar *path,
+		guint record_count);
+
+/**
+ * @brief Kill a process that appends records, and check the journal
+ *
+ * @param path Path of the journal
+ * @param kill_at Number of synced records after which to kill
+ *
+ * @return TRUE if the journal has every synced record, FALSE if not
+ */
+static gboolean track_journal_bench_crash(
+		const gchar *path,
+		guint kill_at);
+
+/**
+ * @brief Append records until killed, and report the number of synced
+ * records to a pipe
+ *
+ * @param path Path of the journal
+ * @param fd The pipe
+ */
+static void track_journal_bench_crash_child(const gchar *path, gint fd);
+
+/**
+ * @brief Cut the journal in the middle of a record, corrupt the last
+ * whole record, and check that the reader stops before them
+ *
+ * @param path Path of the journal
+ *
+ * @return TRUE if the reader stops at the right record
+ */
+static gboolean track_journal_bench_torn(const gchar *path);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+int main(int argc, char **argv)
+{
+	gchar *path = NULL;
+	const gchar *directory = NULL;
+	guint record_count = TRACK_JOURNAL_BENCH_DEFAULT_RECORDS;
+	guint rounds = TRACK_JOURNAL_BENCH_DEFAULT_ROUNDS;
+	guint passed = 0;
+	guint kill_at = 0;
+	guint i = 0;
+
+	if(argc > 1)
+	{
+		record_count = MAX(atoi(argv[1]), 1);
+	}
+	if(argc > 2)
+	{
+		rounds = MAX(atoi(argv[2]), 1);
+	}
+	directory = argc > 3 ? argv[3] : g_get_tmp_dir();
+
+	path = g_build_filename(directory, "track_journal_bench.gpx"
+			TRACK_JOURNAL_EXTENSION, NULL);
+
+	if(!track_journal_bench_append(path, record_count))
+	{
+		g_free(path);
+		return 1;
+	}
+
+	/* A fixed seed, so that a failure can be repeated */
+	srand(1);
+	for(i = 0; i < rounds; i++)
+	{
+		kill_at = rand() % TRACK_JOURNAL_BENCH_MAX_KILL_AT;
+		if(track_journal_bench_crash(path, kill_at))
+		{
+			passed++;
+		}
+	}
+	g_print("kill -9 recovery: %u/%u rounds passed\n", passed, rounds);
+
+	if(track_journal_bench_torn(path))
+	{
+		passed++;
+		g_print("torn record: passed\n");
+	} else {
+		g_print("torn record: FAILED\n");
+	}
+
+	unlink(path);
+	g_free(path);
+
+	return passed == rounds + 1 ? 0 : 1;
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static void track_journal_bench_record(
+		TrackJournalRecord *record,
+		guint index)
+{
+	memset(record, 0, sizeof(TrackJournalRecord));
+	record->type = TRACK_JOURNAL_RECORD_TRACK_POINT;
+	record->time = (gint64)index * G_USEC_PER_SEC;
+	record->data.track_point.latitude = 60.0 + index * 1e-5;
+	record->data.track_point.longitude = 25.0 - index * 1e-5;
+	record->data.track_point.altitude = index % 100;
+	record->data.track_point.altitude_is_set = index % 2;
+	record->data.track_point.cadence = index % 200;
+}
+
+static gboolean track_journal_bench_check_record(
+		const TrackJournalRecord *record,
+		guint index)
+{
+	TrackJournalRecord expected;
+
+	track_journal_bench_record(&expected, index);
+
+	/* The checksum was checked by the reader */
+	return record->type == expected.type &&
+		record->time == expected.time &&
+		memcmp(&record->data, &expected.data,
+				sizeof(expected.data)) == 0;
+}
+
+static gboolean track_journal_bench_append(
+		const gchar *path,
+		guint record_count)
+{
+	TrackJournal *journal = NULL;
+	TrackJournalRecord record;
+	GError *error = NULL;
+	struct timeval start;
+	struct timeval before;
+	struct timeval after;
+	gdouble elapsed = 0;
+	gdouble worst = 0;
+	gdouble total = 0;
+	guint i = 0;
+
+	journal = track_journal_new(path, "Benchmark", NULL, &error);
+	if(!journal)
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	gettimeofday(&start, NULL);
+	for(i = 0; i < record_count; i++)
+	{
+		track_journal_bench_record(&record, i);
+
+		gettimeofday(&before, NULL);
+		if(!track_journal_append(journal, &record))
+		{
+			g_printerr("Unable to append to %s\n", path);
+			track_journal_close(journal, TRUE);
+			return FALSE;
+		}
+		gettimeofday(&after, NULL);
+
+		elapsed = (after.tv_sec - before.tv_sec) * 1e6 +
+			(after.tv_usec - before.tv_usec);
+		worst = MAX(worst, elapsed);
+	}
+	track_journal_close(journal, TRUE);
+
+	total = (after.tv_sec - start.tv_sec) * 1e6 +
+		(after.tv_usec - start.tv_usec);
+
+	g_print("append: %u records of %u bytes, %u per fdatasync\n",
+			record_count, (guint)sizeof(TrackJournalRecord),
+			TRACK_JOURNAL_BATCH_LENGTH);
+	g_print("append: %.2f us per record on average, %.0f us at worst\n",
+			total / record_count, worst);
+
+	return TRUE;
+}
+
+static gboolean track_journal_bench_crash(
+		const gchar *path,
+		guint kill_at)
+{
+	TrackJournalHeader header;
+	GArray *records = NULL;
+	GError *error = NULL;
+	guint32 synced = 0;
+	guint32 reported = 0;
+	gint fds[2];
+	pid_t pid = 0;
+	gboolean retval = TRUE;
+	guint i = 0;
+
+	if(pipe(fds) == -1)
+	{
+		g_printerr("Unable to create a pipe\n");
+		return FALSE;
+	}
+
+	pid = fork();
+	if(pid == -1)
+	{
+		g_printerr("Unable to fork\n");
+		close(fds[0]);
+		close(fds[1]);
+		return FALSE;
+	}
+
+	if(pid == 0)
+	{
+		close(fds[0]);
+		track_journal_bench_crash_child(path, fds[1]);
+		_exit(0);
+	}
+
+	close(fds[1]);
+	while(read(fds[0], &reported, sizeof(reported)) ==
+			sizeof(reported))
+	{
+		synced = reported;
+		if(synced >= kill_at)
+		{
+			break;
+		}
+	}
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+
+	/* Reports that were sent before the kill */
+	while(read(fds[0], &reported, sizeof(reported)) ==
+			sizeof(reported))
+	{
+		synced = reported;
+	}
+	close(fds[0]);
+
+	records = track_journal_read(path, &header, &error);
+	if(!records)
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	if(records->len < synced)
+	{
+		g_print("kill -9 after %u synced records: only %u recovered\n",
+				synced, records->len);
+		retval = FALSE;
+	}
+	for(i = 0; i < records->len && retval; i++)
+	{
+		if(!track_journal_bench_check_record(&g_array_index(records,
+						TrackJournalRecord, i), i))
+		{
+			g_print("kill -9 after %u synced records: record %u "
+					"is wrong\n", synced, i);
+			retval = FALSE;
+		}
+	}
+
+	DEBUG("Killed after %u synced records, recovered %u", synced,
+			records->len);
+	g_array_free(records, TRUE);
+
+	return retval;
+}
+
+static void track_journal_bench_crash_child(const gchar *path, gint fd)
+{
+	TrackJournal *journal = NULL;
+	TrackJournalRecord record;
+	guint32 synced = 0;
+	guint i = 0;
+
+	journal = track_journal_new(path, "Crash test", NULL, NULL);
+	if(!journal)
+	{
+		return;
+	}
+
+	for(i = 0; ; i++)
+	{
+		track_journal_bench_record(&record, i);
+		if(!track_journal_append(journal, &record))
+		{
+			return;
+		}
+
+		/* The batch was just synced */
+		if(journal->batch_length == 0)
+		{
+			synced = i + 1;
+			if(write(fd, &synced, sizeof(synced)) !=
+					sizeof(synced))
+			{
+				return;
+			}
+		}
+	}
+}
+
+static gboolean track_journal_bench_torn(const gchar *path)
+{
+	TrackJournal *journal = NULL;
+	TrackJournalHeader header;
+	TrackJournalRecord record;
+	GArray *records = NULL;
+	GError *error = NULL;
+	gchar *contents = NULL;
+	gsize length = 0;
+	gsize last = 0;
+	guint record_count = 100;
+	guint i = 0;
+
+	journal = track_journal_new(path, "Torn", NULL, &error);
+	if(!journal)
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+	for(i = 0; i < record_count; i++)
+	{
+		track_journal_bench_record(&record, i);
+		track_journal_append(journal, &record);
+	}
+	track_journal_close(journal, FALSE);
+
+	if(!g_file_get_contents(path, &contents, &length, &error))
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	/* Cut the last record in half, and flip a bit of the one before */
+	length -= sizeof(TrackJournalRecord) / 2;
+	last = length - sizeof(TrackJournalRecord) -
+		sizeof(TrackJournalRecord) / 2;
+	contents[last + sizeof(TrackJournalRecord) - 1] ^= 0x01;
+
+	if(!g_file_set_contents(path, contents, length, &error))
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		g_free(contents);
+		return FALSE;
+	}
+	g_free(contents);
+
+	records = track_journal_read(path, &header, &error);
+	if(!records)
+	{
+		g_printerr("%s\n", error->message);
+		g_error_free(error);
+		return FALSE;
+	}
+
+	/* The last two records are lost */
+	i = records->len;
+	g_array_free(records, TRUE);
+
+	return i == record_count - 2;
+}
@@ -28,6 +28,8 @@
 #include "util.h"
 
 /* System */
+#include <float.h>
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -45,12 +47,33 @@
 
 static Settings *_util_settings = NULL;
 
+/**
+ * @brief The date and time part of the latest string of
+ * util_xml_date_time_format(), which only changes once per second
+ */
+static gboolean _util_date_time_cached = FALSE;
+static time_t _util_date_time_second = 0;
+static gchar _util_date_time_prefix[UTIL_XML_DATE_TIME_BUF_SIZE];
+static gsize _util_date_time_prefix_length = 0;
+
 /*****************************************************************************
  * Private function prototypes                                               *
  *****************************************************************************/
 
 static const gchar *util_get_timezone_string();
 
+/**
+ * @brief Write the decimal digits of a number to a buffer. The string is
+ * not terminated.
+ *
+ * @param value The number
+ * @param width Minimum number of digits. Leading zeros are added.
+ * @param buf Buffer for the digits
+ *
+ * @return Number of digits
+ */
+static gsize util_format_digits(guint64 value, guint width, gchar *buf);
+
 /**
  * @brief Convert a time from a broken-down representation to time_t format,
  * with both input and output being in UTC
@@ -156,45 +179,157 @@ void util_add_time(struct timeval *time1, struct timeval *time2,
 
 gchar *util_xml_date_time_string_from_timeval(struct timeval *time)
 {
-	gchar *csecs_s = NULL;
-	gchar *retval = NULL;
+	gchar buf[UTIL_XML_DATE_TIME_BUF_SIZE];
+	gsize length = 0;
+
+	g_return_val_if_fail(time != NULL, NULL);
+	DEBUG_BEGIN();
+
+	length = util_xml_date_time_format(time, buf);
+
+	DEBUG_END();
+	return g_strndup(buf, length);
+}
+
+gsize util_xml_date_time_format(const struct timeval *time, gchar *buf)
+{
+	const gchar *timezone_string = NULL;
 	glong csecs = 0;
+	gsize length = 0;
 	time_t time_src;
 	struct tm time_dest;
 
-	g_return_val_if_fail(time != NULL, NULL);
-	DEBUG_BEGIN();
+	g_return_val_if_fail(time != NULL, 0);
+	g_return_val_if_fail(buf != NULL, 0);
 
-	time_src = time->tv_sec;
-	localtime_r(&time_src, &time_dest);
+	if(!_util_date_time_cached || time->tv_sec != _util_date_time_second)
+	{
+		time_src = time->tv_sec;
+		localtime_r(&time_src, &time_dest);
+		_util_date_time_prefix_length = g_snprintf(
+				_util_date_time_prefix,
+				UTIL_XML_DATE_TIME_BUF_SIZE,
+				"%04d-%02d-%02dT%02d:%02d:%02d",
+				time_dest.tm_year + 1900,
+				time_dest.tm_mon + 1,
+				time_dest.tm_mday,
+				time_dest.tm_hour,
+				time_dest.tm_min,
+				time_dest.tm_sec);
+		_util_date_time_second = time->tv_sec;
+		_util_date_time_cached = TRUE;
+	}
+
+	memcpy(buf, _util_date_time_prefix, _util_date_time_prefix_length);
+	length = _util_date_time_prefix_length;
 
 	/* XML dateTime second fraction must not end with a zero, even though
 	 * seems a bit weird since it prevents including accuracy of the time
 	 * by including necessary amount of significant digits. */
-	csecs = time->tv_usec / 1000L;
-	if(csecs == 0)
+	csecs = CLAMP(time->tv_usec, 0, 999999) / 1000L;
+	if(csecs != 0)
 	{
-		csecs_s = g_strdup("");
-	} else if(csecs % 10 == 0) {
-		csecs_s = g_strdup_printf(".%ld", csecs / 10);
-	} else {
-		csecs_s = g_strdup_printf(".%02ld", csecs);
+		buf[length++] = '.';
+		if(csecs % 10 == 0)
+		{
+			length += util_format_digits(csecs / 10, 1,
+					buf + length);
+		} else {
+			length += util_format_digits(csecs, 2, buf + length);
+		}
 	}
 
-	retval = g_strdup_printf("%04d-%02d-%02dT%02d:%02d:%02d%s%s",
-			time_dest.tm_year + 1900,
-			time_dest.tm_mon + 1,
-			time_dest.tm_mday,
-			time_dest.tm_hour,
-			time_dest.tm_min,
-			time_dest.tm_sec,
-			csecs_s,
-			util_get_timezone_string());
+	timezone_string = util_get_timezone_string();
+	strcpy(buf + length, timezone_string);
+	length += strlen(timezone_string);
 
-	g_free(csecs_s);
+	return length;
+}
 
-	DEBUG_END();
-	return retval;
+gsize util_format_fixed(gdouble value, guint decimals, gchar *buf)
+{
+	static const gchar *formats[UTIL_FORMAT_FIXED_MAX_DECIMALS + 1] = {
+		"%.0f", "%.1f", "%.2f", "%.3f", "%.4f",
+		"%.5f", "%.6f", "%.7f", "%.8f", "%.9f"
+	};
+	static const guint64 scales[UTIL_FORMAT_FIXED_MAX_DECIMALS + 1] = {
+		1, 10, 100, 1000, 10000,
+		100000, 1000000, 10000000, 100000000, 1000000000
+	};
+	gdouble scaled = 0;
+	gdouble fraction = 0;
+	guint64 rounded = 0;
+	gsize length = 0;
+
+	g_return_val_if_fail(buf != NULL, 0);
+	g_return_val_if_fail(decimals <= UTIL_FORMAT_FIXED_MAX_DECIMALS, 0);
+
+	/* Negative zero gets a sign, too */
+	scaled = value * scales[decimals];
+	if(signbit(value))
+	{
+		buf[length++] = '-';
+		scaled = -scaled;
+	}
+
+	/* Numbers that do not fit in the integer exactly (and NaN) are left
+	 * to the C library */
+	if(!(scaled < 1e15))
+	{
+		g_ascii_formatd(buf, UTIL_FORMAT_FIXED_BUF_SIZE,
+				formats[decimals], value);
+		return strlen(buf);
+	}
+
+	/* The fraction is exact, but the product was rounded. If the
+	 * product is too close to a half, the rounding may have moved it to
+	 * the wrong side, and an exact half is rounded to even by printf */
+	rounded = (guint64)scaled;
+	fraction = scaled - rounded;
+	if(fraction - 0.5 <= scaled * DBL_EPSILON &&
+			0.5 - fraction <= scaled * DBL_EPSILON)
+	{
+		g_ascii_formatd(buf, UTIL_FORMAT_FIXED_BUF_SIZE,
+				formats[decimals], value);
+		return strlen(buf);
+	}
+	if(fraction > 0.5)
+	{
+		rounded++;
+	}
+
+	length += util_format_digits(rounded / scales[decimals], 1,
+			buf + length);
+	if(decimals > 0)
+	{
+		buf[length++] = '.';
+		length += util_format_digits(rounded % scales[decimals],
+				decimals, buf + length);
+	}
+	buf[length] = '\0';
+
+	return length;
+}
+
+gsize util_format_int(gint value, gchar *buf)
+{
+	guint64 magnitude = 0;
+	gsize length = 0;
+
+	g_return_val_if_fail(buf != NULL, 0);
+
+	if(value < 0)
+	{
+		buf[length++] = '-';
+		magnitude = -(gint64)value;
+	} else {
+		magnitude = value;
+	}
+
+	length += util_format_digits(magnitude, 1, buf + length);
+	buf[length] = '\0';
+
+	return length;
 }
 
 gchar *util_date_string_from_timeval(struct timeval *time)
@@ -397,3 +532,27 @@ time_t my_timegm(struct tm *tm)
 	tzset();
 	return retval;
 }
+
+static gsize util_format_digits(guint64 value, guint width, gchar *buf)
+{
+	gchar digits[20];
+	guint count = 0;
+	gsize length = 0;
+
+	do {
+		digits[count++] = '0' + value % 10;
+		value /= 10;
+	} while(value > 0);
+
+	for(; count + length < width; length++)
+	{
+		buf[length] = '0';
+	}
+
+	while(count > 0)
+	{
+		buf[length++] = digits[--count];
+	}
+
+	return length;
+}
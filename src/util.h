@@ -26,6 +26,7 @@
 #include "config.h"
 
 /* System */
+#include <float.h>
 #include <sys/time.h>
 #include <time.h>
 
@@ -88,6 +89,61 @@ void util_add_time(struct timeval *time1, struct timeval *time2,
  */
 gchar *util_xml_date_time_string_from_timeval(struct timeval *time);
 
+/** @brief Size of the buffer for util_xml_date_time_format() */
+#define UTIL_XML_DATE_TIME_BUF_SIZE	48
+
+/**
+ * @brief Write the XML dateTime representation of a struct timeval to a
+ * buffer. The result is the same as that of
+ * util_xml_date_time_string_from_timeval(), but nothing is allocated, and
+ * the local time is only computed once per second.
+ *
+ * @param time Time to represent as a string
+ * @param buf Buffer of UTIL_XML_DATE_TIME_BUF_SIZE bytes for the string
+ *
+ * @return Length of the string
+ *
+ * @note The cache of the local time is shared, so call this from the main
+ * thread only
+ */
+gsize util_xml_date_time_format(const struct timeval *time, gchar *buf);
+
+/** @brief Maximum number of decimals for util_format_fixed() */
+#define UTIL_FORMAT_FIXED_MAX_DECIMALS	9
+
+/**
+ * @brief Size of the buffer for util_format_fixed(): the sign, the 309
+ * digits of the largest double, the point, the decimals and the '\0'
+ */
+#define UTIL_FORMAT_FIXED_BUF_SIZE	\
+	(DBL_MAX_10_EXP + 1 + UTIL_FORMAT_FIXED_MAX_DECIMALS + 3)
+
+/**
+ * @brief Write a number with a fixed number of decimals to a buffer. The
+ * result is the same as that of g_ascii_formatd() with the format "%.nf",
+ * but it is computed with integers.
+ *
+ * @param value The number
+ * @param decimals Number of decimals, at most UTIL_FORMAT_FIXED_MAX_DECIMALS
+ * @param buf Buffer of UTIL_FORMAT_FIXED_BUF_SIZE bytes for the string
+ *
+ * @return Length of the string
+ */
+gsize util_format_fixed(gdouble value, guint decimals, gchar *buf);
+
+/** @brief Size of the buffer for util_format_int() */
+#define UTIL_FORMAT_INT_BUF_SIZE	12
+
+/**
+ * @brief Write an integer to a buffer, as printf("%d") would
+ *
+ * @param value The integer
+ * @param buf Buffer of UTIL_FORMAT_INT_BUF_SIZE bytes for the string
+ *
+ * @return Length of the string
+ */
+gsize util_format_int(gint value, gchar *buf);
+
 /**
  * @brief Create a date string representation from a struct timeval, ignoring
  * the time
@@ -0,0 +1,372 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*
+ * Benchmark for formatting the track points of GPX files.
+ *
+ * A point is a time stamp, a latitude, a longitude, an elevation and a
+ * heart rate, as GpxStorage writes them. The points are formatted first
+ * the way GpxStorage used to format them (localtime_r() and
+ * g_strdup_printf() for the time, g_ascii_formatd() for the numbers), and
+ * then with util_xml_date_time_format(), util_format_fixed() and
+ * util_format_int(). The rate of both is printed. Every string of the
+ * latter must be the same as that of the former with the same number of
+ * decimals.
+ *
+ * The exit status is 0 if the strings are the same, 1 if not.
+ *
+ * Usage: util_format_bench [points] [decimals]
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* System */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+/* GLib */
+#include <glib.h>
+
+/* Other modules */
+#include "util.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+#define UTIL_FORMAT_BENCH_DEFAULT_POINTS	1000000
+#define UTIL_FORMAT_BENCH_DEFAULT_DECIMALS	7
+
+/** @brief Number of decimals of the elevations */
+#define UTIL_FORMAT_BENCH_ELEVATION_DECIMALS	2
+
+/** @brief Points per second, as from a GPS and a heart rate monitor */
+#define UTIL_FORMAT_BENCH_POINTS_PER_SECOND	1
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Create a point that can be created again
+ *
+ * @param index Index of the point
+ * @param time Return location for the time stamp
+ * @param coordinates Return location for the latitude, the longitude and
+ * the elevation
+ * @param heart_rate Return location for the heart rate
+ */
+static void util_format_bench_point(
+		guint index,
+		struct timeval *time,
+		gdouble *coordinates,
+		gint *heart_rate);
+
+/**
+ * @brief Format a time stamp the way GpxStorage used to
+ *
+ * @param time The time stamp
+ *
+ * @return Newly allocated string. Free with g_free().
+ */
+static gchar *util_format_bench_old_date_time(const struct timeval *time);
+
+/**
+ * @brief Format the points the way GpxStorage used to
+ *
+ * @param point_count Number of points
+ * @param decimals Number of decimals of the coordinates
+ *
+ * @return Time in seconds
+ */
+static gdouble util_format_bench_old(guint point_count, guint decimals);
+
+/**
+ * @brief Format the points with the formatting functions of util.h
+ *
+ * @param point_count Number of points
+ * @param decimals Number of decimals of the coordinates
+ *
+ * @return Time in seconds
+ */
+static gdouble util_format_bench_new(guint point_count, guint decimals);
+
+/**
+ * @brief Check that both ways give the same strings
+ *
+ * @param point_count Number of points
+ * @param decimals Number of decimals of the coordinates
+ *
+ * @return Number of points whose strings are different
+ */
+static guint util_format_bench_compare(guint point_count, guint decimals);
+
+/*****************************************************************************
+ * Static variables                                                          *
+ *****************************************************************************/
+
+static const gchar *_util_format_bench_formats[] = {
+	"%.0f", "%.1f", "%.2f", "%.3f", "%.4f",
+	"%.5f", "%.6f", "%.7f", "%.8f", "%.9f"
+};
+
+/** @brief Keeps the compiler from leaving the formatting out */
+static volatile gsize _util_format_bench_sink = 0;
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+int main(int argc, char **argv)
+{
+	guint point_count = UTIL_FORMAT_BENCH_DEFAULT_POINTS;
+	guint decimals = UTIL_FORMAT_BENCH_DEFAULT_DECIMALS;
+	guint mismatches = 0;
+	gdouble old_time = 0;
+	gdouble new_time = 0;
+
+	if(argc > 1)
+	{
+		point_count = MAX(atoi(argv[1]), 1);
+	}
+	if(argc > 2)
+	{
+		decimals = MIN(atoi(argv[2]), UTIL_FORMAT_FIXED_MAX_DECIMALS);
+	}
+
+	tzset();
+
+	old_time = util_format_bench_old(point_count, decimals);
+	new_time = util_format_bench_new(point_count, decimals);
+
+	g_print("%u points, %u decimals\n", point_count, decimals);
+	g_print("old: %10.0f points/s\n", point_count / MAX(old_time, 1e-6));
+	g_print("new: %10.0f points/s\n", point_count / MAX(new_time, 1e-6));
+
+	mismatches = util_format_bench_compare(point_count, decimals);
+	if(mismatches > 0)
+	{
+		g_print("%u points were formatted differently\n", mismatches);
+		return 1;
+	}
+	g_print("all points were formatted the same\n");
+
+	return 0;
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static void util_format_bench_point(
+		guint index,
+		struct timeval *time,
+		gdouble *coordinates,
+		gint *heart_rate)
+{
+	time->tv_sec = 1200000000 + index / UTIL_FORMAT_BENCH_POINTS_PER_SECOND;
+	time->tv_usec = (index * 7919) % 1000000;
+
+	/* Not quite regular, so that all the digits change */
+	coordinates[0] = 60.1699 + index * 1.3e-6 + (index % 7) * 1e-8;
+	coordinates[1] = 24.9384 - index * 0.9e-6 + (index % 11) * 1e-8;
+	coordinates[2] = 12.0 + (index % 2000) * 0.125 + (index % 3) * 0.01;
+	*heart_rate = 60 + index % 140;
+}
+
+static gchar *util_format_bench_old_date_time(const struct timeval *time)
+{
+	gchar *csecs_s = NULL;
+	gchar *timezone_string = NULL;
+	gchar *retval = NULL;
+	glong csecs = 0;
+	time_t time_src;
+	struct tm time_dest;
+
+	time_src = time->tv_sec;
+	localtime_r(&time_src, &time_dest);
+
+	csecs = time->tv_usec / 1000L;
+	if(csecs == 0)
+	{
+		csecs_s = g_strdup("");
+	} else if(csecs % 10 == 0) {
+		csecs_s = g_strdup_printf(".%ld", csecs / 10);
+	} else {
+		csecs_s = g_strdup_printf(".%02ld", csecs);
+	}
+
+	/* util.c caches this string */
+	timezone_string = g_strdup_printf(timezone > 0 ?
+			"-%02ld:%02ld" : "+%02ld:%02ld",
+			labs(timezone / 3600L), labs((timezone % 60L) / 60L));
+
+	retval = g_strdup_printf("%04d-%02d-%02dT%02d:%02d:%02d%s%s",
+			time_dest.tm_year + 1900,
+			time_dest.tm_mon + 1,
+			time_dest.tm_mday,
+			time_dest.tm_hour,
+			time_dest.tm_min,
+			time_dest.tm_sec,
+			csecs_s,
+			timezone_string);
+
+	g_free(csecs_s);
+	g_free(timezone_string);
+
+	return retval;
+}
+
+static gdouble util_format_bench_old(guint point_count, guint decimals)
+{
+	const gchar *format = _util_format_bench_formats[decimals];
+	const gchar *elevation_format = _util_format_bench_formats[
+		UTIL_FORMAT_BENCH_ELEVATION_DECIMALS];
+	gchar dbuf[G_ASCII_DTOSTR_BUF_SIZE];
+	gchar *buf = NULL;
+	struct timeval time;
+	struct timeval start;
+	struct timeval end;
+	gdouble coordinates[3];
+	gint heart_rate = 0;
+	guint i = 0;
+
+	gettimeofday(&start, NULL);
+	for(i = 0; i < point_count; i++)
+	{
+		util_format_bench_point(i, &time, coordinates, &heart_rate);
+
+		g_ascii_formatd(dbuf, sizeof(dbuf), format, coordinates[0]);
+		_util_format_bench_sink += strlen(dbuf);
+		g_ascii_formatd(dbuf, sizeof(dbuf), format, coordinates[1]);
+		_util_format_bench_sink += strlen(dbuf);
+		g_ascii_formatd(dbuf, sizeof(dbuf), elevation_format,
+				coordinates[2]);
+		_util_format_bench_sink += strlen(dbuf);
+
+		buf = util_format_bench_old_date_time(&time);
+		_util_format_bench_sink += strlen(buf);
+		g_free(buf);
+
+		buf = g_strdup_printf("%d", heart_rate);
+		_util_format_bench_sink += strlen(buf);
+		g_free(buf);
+	}
+	gettimeofday(&end, NULL);
+
+	return (end.tv_sec - start.tv_sec) +
+		(end.tv_usec - start.tv_usec) / 1e6;
+}
+
+static gdouble util_format_bench_new(guint point_count, guint decimals)
+{
+	gchar dbuf[UTIL_FORMAT_FIXED_BUF_SIZE];
+	gchar buf[UTIL_XML_DATE_TIME_BUF_SIZE];
+	struct timeval time;
+	struct timeval start;
+	struct timeval end;
+	gdouble coordinates[3];
+	gint heart_rate = 0;
+	guint i = 0;
+
+	gettimeofday(&start, NULL);
+	for(i = 0; i < point_count; i++)
+	{
+		util_format_bench_point(i, &time, coordinates, &heart_rate);
+
+		_util_format_bench_sink += util_format_fixed(coordinates[0],
+				decimals, dbuf);
+		_util_format_bench_sink += util_format_fixed(coordinates[1],
+				decimals, dbuf);
+		_util_format_bench_sink += util_format_fixed(coordinates[2],
+				UTIL_FORMAT_BENCH_ELEVATION_DECIMALS, dbuf);
+		_util_format_bench_sink += util_xml_date_time_format(&time,
+				buf);
+		_util_format_bench_sink += util_format_int(heart_rate, buf);
+	}
+	gettimeofday(&end, NULL);
+
+	return (end.tv_sec - start.tv_sec) +
+		(end.tv_usec - start.tv_usec) / 1e6;
+}
+
+static guint util_format_bench_compare(guint point_count, guint decimals)
+{
+	gchar old_buf[G_ASCII_DTOSTR_BUF_SIZE];
+	gchar new_buf[UTIL_XML_DATE_TIME_BUF_SIZE];
+	gchar *old_date_time = NULL;
+	struct timeval time;
+	gdouble coordinates[3];
+	gint heart_rate = 0;
+	guint mismatches = 0;
+	guint i = 0;
+	guint j = 0;
+	guint n = 0;
+
+	for(i = 0; i < point_count; i++)
+	{
+		util_format_bench_point(i, &time, coordinates, &heart_rate);
+		n = mismatches;
+
+		for(j = 0; j < 3; j++)
+		{
+			guint d = j < 2 ? decimals :
+				UTIL_FORMAT_BENCH_ELEVATION_DECIMALS;
+			g_ascii_formatd(old_buf, sizeof(old_buf),
+					_util_format_bench_formats[d],
+					coordinates[j]);
+			util_format_fixed(coordinates[j], d, new_buf);
+			if(strcmp(old_buf, new_buf) != 0 && n == mismatches)
+			{
+				g_print("point %u: %s != %s\n", i, new_buf,
+						old_buf);
+				mismatches++;
+			}
+		}
+
+		old_date_time = util_format_bench_old_date_time(&time);
+		util_xml_date_time_format(&time, new_buf);
+		if(strcmp(old_date_time, new_buf) != 0 && n == mismatches)
+		{
+			g_print("point %u: %s != %s\n", i, new_buf,
+					old_date_time);
+			mismatches++;
+		}
+		g_free(old_date_time);
+
+		g_snprintf(old_buf, sizeof(old_buf), "%d", heart_rate);
+		util_format_int(heart_rate, new_buf);
+		if(strcmp(old_buf, new_buf) != 0 && n == mismatches)
+		{
+			g_print("point %u: %s != %s\n", i, new_buf, old_buf);
+			mismatches++;
+		}
+	}
+
+	return mismatches;
+}
@@ -0,0 +1,246 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "wfdb_annotation.h"
+
+/* Other modules */
+#include "ec_error.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+/*
+ * An MIT format annotation file is a sequence of 16-bit little-endian
+ * words. The 6 high bits of a word are the annotation code, and the 10 low
+ * bits are the time since the previous annotation. Codes above ACMAX are
+ * pseudo-annotations that modify the time or the previous annotation.
+ */
+#define WFDB_ANNOTATION_CODE_SHIFT		10
+#define WFDB_ANNOTATION_DATA_MASK		0x3FF
+
+/** @brief Longer time steps than this are written with SKIP */
+#define WFDB_ANNOTATION_MAX_DELTA		WFDB_ANNOTATION_DATA_MASK
+
+/** @brief Time step as 32 bits (high 16 bits first) in the next words */
+#define WFDB_ANNOTATION_SKIP			59
+
+/** @brief Annotation number of the previous annotation */
+#define WFDB_ANNOTATION_NUM			60
+
+/** @brief Subtype of the previous annotation */
+#define WFDB_ANNOTATION_SUB			61
+
+/** @brief Channel of the previous annotation */
+#define WFDB_ANNOTATION_CHN			62
+
+/** @brief Auxiliary information: the data field is its length in bytes,
+ * and the bytes follow, padded to an even length */
+#define WFDB_ANNOTATION_AUX			63
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Append a 16-bit little-endian word to a buffer
+ *
+ * @param buffer The buffer
+ * @param word The word
+ */
+static void wfdb_annotation_append_word(GByteArray *buffer, guint16 word);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+GArray *wfdb_annotation_read(const gchar *path, GError **error)
+{
+	GMappedFile *file = NULL;
+	GArray *annotations = NULL;
+	WfdbAnnotation annotation;
+	WfdbAnnotation *previous = NULL;
+	const guint8 *data = NULL;
+	gsize length = 0;
+	gsize position = 0;
+	glong time = 0;
+	guint word = 0;
+	guint code = 0;
+	guint value = 0;
+
+	g_return_val_if_fail(path != NULL, NULL);
+	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+	DEBUG_BEGIN();
+
+	file = g_mapped_file_new(path, FALSE, error);
+	if(!file)
+	{
+		DEBUG_END();
+		return NULL;
+	}
+
+	data = (const guint8 *)g_mapped_file_get_contents(file);
+	length = g_mapped_file_get_length(file);
+	annotations = g_array_new(FALSE, FALSE, sizeof(WfdbAnnotation));
+
+	while(position + 2 <= length)
+	{
+		word = data[position] | (data[position + 1] << 8);
+		position += 2;
+		code = word >> WFDB_ANNOTATION_CODE_SHIFT;
+		value = word & WFDB_ANNOTATION_DATA_MASK;
+
+		if(word == 0)
+		{
+			/* End of file */
+			break;
+		}
+
+		switch(code)
+		{
+		case WFDB_ANNOTATION_SKIP:
+			if(position + 4 > length)
+			{
+				goto truncated;
+			}
+			time += (gint32)(((guint32)data[position] << 16) |
+					((guint32)data[position + 1] << 24) |
+					data[position + 2] |
+					(data[position + 3] << 8));
+			position += 4;
+			break;
+		case WFDB_ANNOTATION_SUB:
+			if(previous)
+			{
+				previous->subtype = value;
+			}
+			break;
+		case WFDB_ANNOTATION_NUM:
+		case WFDB_ANNOTATION_CHN:
+			break;
+		case WFDB_ANNOTATION_AUX:
+			position += (value + 1) & ~1;
+			break;
+		default:
+			time += value;
+			annotation.time = time;
+			annotation.type = code;
+			annotation.subtype = 0;
+			g_array_append_val(annotations, annotation);
+			previous = &g_array_index(annotations, WfdbAnnotation,
+					annotations->len - 1);
+			break;
+		}
+	}
+
+	g_mapped_file_free(file);
+	DEBUG_END();
+	return annotations;
+
+truncated:
+	g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+			"Annotation file %s is truncated", path);
+	g_array_free(annotations, TRUE);
+	g_mapped_file_free(file);
+	DEBUG_END();
+	return NULL;
+}
+
+gboolean wfdb_annotation_write(
+		const gchar *path,
+		const WfdbAnnotation *annotations,
+		guint count,
+		GError **error)
+{
+	GByteArray *buffer = NULL;
+	glong time = 0;
+	glong delta = 0;
+	guint i = 0;
+	gboolean success = FALSE;
+
+	g_return_val_if_fail(path != NULL, FALSE);
+	g_return_val_if_fail(annotations != NULL || count == 0, FALSE);
+	g_return_val_if_fail(error == NULL || *error == NULL, FALSE);
+	DEBUG_BEGIN();
+
+	buffer = g_byte_array_sized_new(count * 2 + 2);
+
+	for(i = 0; i < count; i++)
+	{
+		delta = annotations[i].time - time;
+		if(delta < 0 || delta > WFDB_ANNOTATION_MAX_DELTA)
+		{
+			wfdb_annotation_append_word(buffer,
+					WFDB_ANNOTATION_SKIP <<
+					WFDB_ANNOTATION_CODE_SHIFT);
+			wfdb_annotation_append_word(buffer,
+					(guint16)((guint32)delta >> 16));
+			wfdb_annotation_append_word(buffer,
+					(guint16)((guint32)delta & 0xFFFF));
+			delta = 0;
+		}
+		wfdb_annotation_append_word(buffer,
+				(annotations[i].type <<
+				 WFDB_ANNOTATION_CODE_SHIFT) | delta);
+		if(annotations[i].subtype != 0)
+		{
+			wfdb_annotation_append_word(buffer,
+					(WFDB_ANNOTATION_SUB <<
+					 WFDB_ANNOTATION_CODE_SHIFT) |
+					(annotations[i].subtype &
+					 WFDB_ANNOTATION_DATA_MASK));
+		}
+		time = annotations[i].time;
+	}
+	wfdb_annotation_append_word(buffer, 0);
+
+	success = g_file_set_contents(path, (const gchar *)buffer->data,
+			buffer->len, error);
+	g_byte_array_free(buffer, TRUE);
+
+	DEBUG_END();
+	return success;
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static void wfdb_annotation_append_word(GByteArray *buffer, guint16 word)
+{
+	guint8 bytes[2];
+
+	bytes[0] = word & 0xFF;
+	bytes[1] = word >> 8;
+	g_byte_array_append(buffer, bytes, sizeof(bytes));
+}
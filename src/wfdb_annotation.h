@@ -0,0 +1,79 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _WFDB_ANNOTATION_H
+#define _WFDB_ANNOTATION_H
+
+/* Configuration */
+#include "config.h"
+
+/* GLib */
+#include <glib.h>
+
+/**
+ * @brief One annotation
+ */
+typedef struct _WfdbAnnotation {
+	/** @brief Time of the annotation, in samples */
+	glong time;
+
+	/** @brief Annotation code (see osea/ecgcodes.h) */
+	gint type;
+
+	/** @brief Annotation subtype */
+	gint subtype;
+} WfdbAnnotation;
+
+/**
+ * @brief Read an annotation file in MIT format
+ *
+ * The annotation codes, times and subtypes are read. Channel and number
+ * fields and auxiliary information are skipped.
+ *
+ * @param path Path of the file, for example "mitdb/100.atr"
+ * @param error Return location for errors
+ *
+ * @return Array of #WfdbAnnotation in the order of the file, or NULL if
+ * an error occurred. Free with g_array_free().
+ */
+GArray *wfdb_annotation_read(const gchar *path, GError **error);
+
+/**
+ * @brief Write an annotation file in MIT format
+ *
+ * The file can be read with the tools of the WFDB library, for example
+ * bxb and rdann.
+ *
+ * @param path Path of the file
+ * @param annotations The annotations, in the order of time
+ * @param count Amount of annotations
+ * @param error Return location for errors
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+gboolean wfdb_annotation_write(
+		const gchar *path,
+		const WfdbAnnotation *annotations,
+		guint count,
+		GError **error);
+
+#endif /* _WFDB_ANNOTATION_H */
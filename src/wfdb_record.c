@@ -0,0 +1,613 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+/*****************************************************************************
+ * Includes                                                                  *
+ *****************************************************************************/
+
+/* This module */
+#include "wfdb_record.h"
+
+/* System */
+#include <stdlib.h>
+#include <string.h>
+
+/* Other modules */
+#include "ec_error.h"
+
+#include "debug.h"
+
+/*****************************************************************************
+ * Definitions                                                               *
+ *****************************************************************************/
+
+/** @brief Gain of a signal whose header does not specify it (WFDB_DEFGAIN) */
+#define WFDB_RECORD_DEFAULT_GAIN		200.0
+
+/** @brief Values that the formats use for missing samples */
+#define WFDB_RECORD_INVALID_212			-2048
+#define WFDB_RECORD_INVALID_16			-32768
+
+/*****************************************************************************
+ * Private function prototypes                                               *
+ *****************************************************************************/
+
+/**
+ * @brief Split a header line into fields separated by white space
+ *
+ * @param line The line
+ *
+ * @return NULL terminated array of the fields. Free with g_strfreev().
+ */
+static gchar **wfdb_record_split_line(const gchar *line);
+
+/**
+ * @brief Parse a signal specification line of the header
+ *
+ * @param self Pointer to #WfdbRecord
+ * @param signal The signal to fill in
+ * @param fields Fields of the line
+ * @param file_name Return location for the name of the signal file. Free
+ * with g_free().
+ * @param error Return location for errors
+ *
+ * @return TRUE on success, FALSE if the line could not be parsed or the
+ * signal format is not supported
+ */
+static gboolean wfdb_record_parse_signal(
+		WfdbRecord *self,
+		WfdbSignal *signal,
+		gchar **fields,
+		const gchar **file_name,
+		GError **error);
+
+/**
+ * @brief Map the signal files, and find out where each signal is in them
+ *
+ * @param self Pointer to #WfdbRecord
+ * @param directory Directory of the header
+ * @param file_names Names of the signal files of each signal
+ * @param error Return location for errors
+ *
+ * @return TRUE on success, FALSE on failure
+ */
+static gboolean wfdb_record_map_files(
+		WfdbRecord *self,
+		const gchar *directory,
+		const gchar **file_names,
+		GError **error);
+
+/**
+ * @brief Get the amount of whole frames in the file of a signal
+ *
+ * @param signal The signal
+ *
+ * @return Amount of frames
+ */
+static glong wfdb_record_get_frames_in_file(WfdbSignal *signal);
+
+/*****************************************************************************
+ * Function declarations                                                     *
+ *****************************************************************************/
+
+/*===========================================================================*
+ * Public functions                                                          *
+ *===========================================================================*/
+
+WfdbRecord *wfdb_record_open(const gchar *path, GError **error)
+{
+	WfdbRecord *self = NULL;
+	gchar *header_path = NULL;
+	gchar *directory = NULL;
+	gchar *contents = NULL;
+	gchar **lines = NULL;
+	gchar **fields = NULL;
+	const gchar **file_names = NULL;
+	gint line = 0;
+	gint signal = 0;
+	gint field_count = 0;
+	gboolean success = FALSE;
+
+	g_return_val_if_fail(path != NULL, NULL);
+	g_return_val_if_fail(error == NULL || *error == NULL, NULL);
+	DEBUG_BEGIN();
+
+	header_path = g_strdup_printf("%s.hea", path);
+	if(!g_file_get_contents(header_path, &contents, NULL, error))
+	{
+		g_free(header_path);
+		DEBUG_END();
+		return NULL;
+	}
+
+	self = g_new0(WfdbRecord, 1);
+	self->name = g_path_get_basename(path);
+	directory = g_path_get_dirname(path);
+	lines = g_strsplit(contents, "\n", -1);
+	g_free(contents);
+
+	for(line = 0; lines[line]; line++)
+	{
+		g_strstrip(lines[line]);
+		if(lines[line][0] == '\0' || lines[line][0] == '#')
+		{
+			continue;
+		}
+
+		fields = wfdb_record_split_line(lines[line]);
+		field_count = g_strv_length(fields);
+
+		if(file_names == NULL)
+		{
+			/* The record line: name, amount of signals, sample
+			 * rate, length, and base time and date */
+			if(field_count < 2 || strchr(fields[0], '/'))
+			{
+				g_set_error(error, EC_ERROR,
+						EC_ERROR_FILE_FORMAT,
+						"%s: not a single-segment "
+						"record", header_path);
+				g_strfreev(fields);
+				goto out;
+			}
+			self->signal_count = atoi(fields[1]);
+			if(self->signal_count < 1)
+			{
+				g_set_error(error, EC_ERROR,
+						EC_ERROR_FILE_FORMAT,
+						"%s: the record has no signals",
+						header_path);
+				g_strfreev(fields);
+				goto out;
+			}
+			self->sample_rate = field_count > 2 ?
+				g_ascii_strtod(fields[2], NULL) : 0;
+			if(self->sample_rate <= 0)
+			{
+				/* Default of the WFDB library */
+				self->sample_rate = 250;
+			}
+			self->length = field_count > 3 ?
+				strtol(fields[3], NULL, 10) : 0;
+
+			self->signals = g_new0(WfdbSignal,
+					self->signal_count);
+			file_names = g_new0(const gchar *,
+					self->signal_count);
+		} else if(signal < self->signal_count) {
+			if(!wfdb_record_parse_signal(self,
+						&self->signals[signal],
+						fields,
+						&file_names[signal],
+						error))
+			{
+				g_strfreev(fields);
+				goto out;
+			}
+			signal++;
+		}
+		g_strfreev(fields);
+	}
+
+	if(signal == 0 || signal < self->signal_count)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"%s: signal specifications are missing",
+				header_path);
+		goto out;
+	}
+
+	if(!wfdb_record_map_files(self, directory, file_names, error))
+	{
+		goto out;
+	}
+
+	if(self->length <= 0)
+	{
+		self->length = wfdb_record_get_frames_in_file(
+				&self->signals[0]);
+	}
+
+	success = TRUE;
+
+out:
+	if(file_names)
+	{
+		for(signal = 0; signal < self->signal_count; signal++)
+		{
+			g_free((gchar *)file_names[signal]);
+		}
+		g_free(file_names);
+	}
+	g_strfreev(lines);
+	g_free(directory);
+	g_free(header_path);
+
+	if(!success)
+	{
+		wfdb_record_close(self);
+		self = NULL;
+	}
+
+	DEBUG_END();
+	return self;
+}
+
+void wfdb_record_close(WfdbRecord *self)
+{
+	gint i = 0;
+
+	g_return_if_fail(self != NULL);
+	DEBUG_BEGIN();
+
+	for(i = 0; i < self->signal_count; i++)
+	{
+		/* The first signal of each file owns the mapping */
+		if(self->signals[i].file &&
+				self->signals[i].position_in_file == 0)
+		{
+			g_mapped_file_free(self->signals[i].file);
+		}
+		g_free(self->signals[i].description);
+	}
+	g_free(self->signals);
+	g_free(self->name);
+	g_free(self);
+
+	DEBUG_END();
+}
+
+void wfdb_record_read(
+		WfdbRecord *self,
+		gint signal,
+		glong start,
+		gint count,
+		gint *samples)
+{
+	WfdbSignal *s = NULL;
+	const guint8 *data = NULL;
+	const guint8 *p = NULL;
+	glong frames = 0;
+	glong index = 0;
+	gint value = 0;
+	gint i = 0;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(signal >= 0 && signal < self->signal_count);
+	g_return_if_fail(samples != NULL || count == 0);
+
+	s = &self->signals[signal];
+	data = (const guint8 *)g_mapped_file_get_contents(s->file) +
+		s->offset;
+	frames = MIN(wfdb_record_get_frames_in_file(s), self->length);
+
+	for(i = 0; i < count; i++)
+	{
+		if(start + i < 0 || start + i >= frames)
+		{
+			samples[i] = s->baseline;
+			continue;
+		}
+
+		/* Index of the sample in the file */
+		index = (start + i) * s->signals_in_file + s->position_in_file;
+
+		if(s->format == WFDB_FORMAT_212)
+		{
+			/* Samples 2n and 2n + 1 are in bytes 3n...3n + 2.
+			 * The middle byte has the high bits of both. */
+			p = data + (index / 2) * 3;
+			if(index % 2 == 0)
+			{
+				value = p[0] | ((p[1] & 0x0F) << 8);
+			} else {
+				value = p[2] | ((p[1] & 0xF0) << 4);
+			}
+			if(value & 0x800)
+			{
+				value -= 0x1000;
+			}
+			if(value == WFDB_RECORD_INVALID_212)
+			{
+				value = s->baseline;
+			}
+		} else {
+			p = data + index * 2;
+			value = (gint16)(p[0] | (p[1] << 8));
+			if(value == WFDB_RECORD_INVALID_16)
+			{
+				value = s->baseline;
+			}
+		}
+		samples[i] = value;
+	}
+}
+
+glong wfdb_record_get_resampled_length(WfdbRecord *self, gint rate)
+{
+	gint record_rate = 0;
+
+	g_return_val_if_fail(self != NULL, 0);
+	g_return_val_if_fail(rate > 0, 0);
+
+	if(self->length == 0)
+	{
+		return 0;
+	}
+	record_rate = (gint)(self->sample_rate + 0.5);
+	return (glong)(((gint64)self->length - 1) * rate / record_rate + 1);
+}
+
+void wfdb_record_read_resampled(
+		WfdbRecord *self,
+		gint signal,
+		gint rate,
+		gdouble gain,
+		glong start,
+		gint count,
+		gint *samples)
+{
+	WfdbSignal *s = NULL;
+	gint *input = NULL;
+	gint record_rate = 0;
+	glong input_start = 0;
+	gint input_count = 0;
+	gint64 position = 0;
+	gint index = 0;
+	gint fraction = 0;
+	gdouble scale = 0;
+	gint i = 0;
+
+	g_return_if_fail(self != NULL);
+	g_return_if_fail(signal >= 0 && signal < self->signal_count);
+	g_return_if_fail(rate > 0);
+	g_return_if_fail(samples != NULL || count == 0);
+
+	if(count <= 0)
+	{
+		return;
+	}
+
+	s = &self->signals[signal];
+	record_rate = (gint)(self->sample_rate + 0.5);
+
+	/* Linear interpolation needs one sample past the last position */
+	input_start = (glong)((gint64)start * record_rate / rate);
+	input_count = (glong)((gint64)(start + count - 1) * record_rate /
+			rate) - input_start + 2;
+	input = g_new(gint, input_count);
+	wfdb_record_read(self, signal, input_start, input_count, input);
+
+	scale = gain / s->gain;
+	for(i = 0; i < input_count; i++)
+	{
+		input[i] -= s->baseline;
+		if(s->gain != gain)
+		{
+			input[i] = (gint)(input[i] * scale +
+					(input[i] < 0 ? -0.5 : 0.5));
+		}
+	}
+
+	if(record_rate == rate)
+	{
+		memcpy(samples, input, count * sizeof(gint));
+		g_free(input);
+		return;
+	}
+
+	/* The positions are computed from the beginning of the record, so
+	 * that every part gets the same samples */
+	for(i = 0; i < count; i++)
+	{
+		position = (gint64)(start + i) * record_rate;
+		index = (gint)(position / rate - input_start);
+		fraction = (gint)(position % rate);
+		samples[i] = input[index] + (input[index + 1] - input[index]) *
+			fraction / rate;
+	}
+
+	g_free(input);
+}
+
+/*===========================================================================*
+ * Private functions                                                         *
+ *===========================================================================*/
+
+static gchar **wfdb_record_split_line(const gchar *line)
+{
+	gchar **fields = NULL;
+	gint i = 0;
+	gint j = 0;
+
+	fields = g_strsplit_set(line, " \t", -1);
+
+	/* Drop the empty fields that consecutive separators leave */
+	for(i = 0; fields[i]; i++)
+	{
+		if(fields[i][0] == '\0')
+		{
+			g_free(fields[i]);
+		} else {
+			fields[j++] = fields[i];
+		}
+	}
+	fields[j] = NULL;
+
+	return fields;
+}
+
+static gboolean wfdb_record_parse_signal(
+		WfdbRecord *self,
+		WfdbSignal *signal,
+		gchar **fields,
+		const gchar **file_name,
+		GError **error)
+{
+	gint field_count = g_strv_length(fields);
+	gchar *end = NULL;
+	gboolean has_baseline = FALSE;
+
+	if(field_count < 2)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"Record %s: invalid signal specification",
+				self->name);
+		return FALSE;
+	}
+
+	/* Format, optionally followed by xSAMPLES_PER_FRAME, :SKEW and
+	 * +BYTE_OFFSET */
+	signal->format = strtol(fields[1], &end, 10);
+	if(signal->format != WFDB_FORMAT_212 &&
+			signal->format != WFDB_FORMAT_16)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"Record %s: signal format %d is not "
+				"supported", self->name, signal->format);
+		return FALSE;
+	}
+	if(*end == 'x' && strtol(end + 1, &end, 10) != 1)
+	{
+		g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+				"Record %s: multi-frequency records are not "
+				"supported", self->name);
+		return FALSE;
+	}
+	if(*end == ':')
+	{
+		strtol(end + 1, &end, 10);
+	}
+	if(*end == '+')
+	{
+		signal->offset = strtol(end + 1, &end, 10);
+	}
+
+	/* Gain, optionally followed by (BASELINE) and /UNITS */
+	signal->gain = 0;
+	if(field_count > 2)
+	{
+		signal->gain = g_ascii_strtod(fields[2], &end);
+		if(*end == '(')
+		{
+			signal->baseline = strtol(end + 1, NULL, 10);
+			has_baseline = TRUE;
+		}
+	}
+	if(signal->gain <= 0)
+	{
+		signal->gain = WFDB_RECORD_DEFAULT_GAIN;
+	}
+
+	/* Without an explicit baseline, the ADC zero is the baseline */
+	if(!has_baseline && field_count > 4)
+	{
+		signal->baseline = atoi(fields[4]);
+	}
+
+	if(field_count > 8)
+	{
+		signal->description = g_strjoinv(" ", fields + 8);
+	} else {
+		signal->description = g_strdup_printf("signal %d",
+				(gint)(signal - self->signals));
+	}
+
+	*file_name = g_strdup(fields[0]);
+	return TRUE;
+}
+
+static gboolean wfdb_record_map_files(
+		WfdbRecord *self,
+		const gchar *directory,
+		const gchar **file_names,
+		GError **error)
+{
+	GMappedFile *file = NULL;
+	gchar *path = NULL;
+	gint first = 0;
+	gint last = 0;
+	gint i = 0;
+
+	/* The signals of a file are consecutive in the header */
+	for(first = 0; first < self->signal_count; first = last)
+	{
+		for(last = first + 1; last < self->signal_count; last++)
+		{
+			if(strcmp(file_names[first], file_names[last]) != 0)
+			{
+				break;
+			}
+			if(self->signals[last].format !=
+					self->signals[first].format)
+			{
+				g_set_error(error, EC_ERROR,
+						EC_ERROR_FILE_FORMAT,
+						"Record %s: signals of %s "
+						"have different formats",
+						self->name,
+						file_names[first]);
+				return FALSE;
+			}
+		}
+
+		path = g_build_filename(directory, file_names[first], NULL);
+		file = g_mapped_file_new(path, FALSE, error);
+		g_free(path);
+		if(!file)
+		{
+			return FALSE;
+		}
+
+		for(i = first; i < last; i++)
+		{
+			self->signals[i].file = file;
+			self->signals[i].signals_in_file = last - first;
+			self->signals[i].position_in_file = i - first;
+			self->signals[i].offset = self->signals[first].offset;
+		}
+
+		if(g_mapped_file_get_length(file) <
+				self->signals[first].offset)
+		{
+			g_set_error(error, EC_ERROR, EC_ERROR_FILE_FORMAT,
+					"Record %s: %s is too short",
+					self->name, file_names[first]);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static glong wfdb_record_get_frames_in_file(WfdbSignal *signal)
+{
+	gsize length = g_mapped_file_get_length(signal->file) -
+		signal->offset;
+
+	if(signal->format == WFDB_FORMAT_212)
+	{
+		return (glong)(length / 3 * 2 + (length % 3 == 2 ? 1 : 0)) /
+			signal->signals_in_file;
+	}
+	return (glong)(length / 2) / signal->signals_in_file;
+}
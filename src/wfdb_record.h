@@ -0,0 +1,172 @@
+/*
+ *  eCoach
+ *
+ *  Copyright (C) 2008  Jukka Alasalmi
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ *  See the file COPYING
+ */
+
+#ifndef _WFDB_RECORD_H
+#define _WFDB_RECORD_H
+
+/* Configuration */
+#include "config.h"
+
+/* GLib */
+#include <glib.h>
+
+/**
+ * @brief Signal file formats that can be read
+ */
+typedef enum _WfdbFormat {
+	/** @brief Two 12-bit samples packed in three bytes (MIT-BIH) */
+	WFDB_FORMAT_212 = 212,
+
+	/** @brief 16-bit little-endian samples */
+	WFDB_FORMAT_16 = 16
+} WfdbFormat;
+
+/**
+ * @brief One signal of a record
+ */
+typedef struct _WfdbSignal {
+	/** @brief Signal description, for example "MLII" */
+	gchar *description;
+
+	WfdbFormat format;
+
+	/** @brief ADC units per millivolt */
+	gdouble gain;
+
+	/** @brief ADC value that corresponds to 0 mV */
+	gint baseline;
+
+	/** @brief The signal file, shared by the signals stored in it */
+	GMappedFile *file;
+
+	/** @brief Offset of the samples in the file, in bytes */
+	gsize offset;
+
+	/** @brief Amount of signals stored in the same file */
+	gint signals_in_file;
+
+	/** @brief Position of this signal in a frame of the file */
+	gint position_in_file;
+} WfdbSignal;
+
+/**
+ * @brief A record of a PhysioBank database (such as the MIT-BIH Arrhythmia
+ * Database), read without the WFDB library
+ *
+ * The header file (.hea) is parsed, and the signal files are memory
+ * mapped, so that the samples can be read from several threads at the
+ * same time. Only signal files in format 212 or 16, with one sample of
+ * each signal per frame, are supported.
+ *
+ * Consider all the fields read-only.
+ */
+typedef struct _WfdbRecord {
+	/** @brief Name of the record, for example "100" */
+	gchar *name;
+
+	/** @brief Sample rate in Hz */
+	gdouble sample_rate;
+
+	/** @brief Length of the record in samples (per signal) */
+	glong length;
+
+	WfdbSignal *signals;
+	gint signal_count;
+} WfdbRecord;
+
+/**
+ * @brief Open a record
+ *
+ * @param path Path of the record without any extension, for example
+ * "mitdb/100". The header is read from path.hea, and the signal files
+ * are looked up from the same directory.
+ * @param error Return location for errors
+ *
+ * @return The record, or NULL if an error occurred
+ */
+WfdbRecord *wfdb_record_open(const gchar *path, GError **error);
+
+/**
+ * @brief Close a record and free its resources
+ *
+ * @param self Pointer to #WfdbRecord
+ */
+void wfdb_record_close(WfdbRecord *self);
+
+/**
+ * @brief Read samples of one signal
+ *
+ * The samples are in ADC units, and samples past the end of the record
+ * are read as the baseline. This function only reads the mapped files, so
+ * it can be called from several threads at the same time.
+ *
+ * @param self Pointer to #WfdbRecord
+ * @param signal Index of the signal
+ * @param start Index of the first sample to read
+ * @param count Amount of samples to read
+ * @param samples Storage for the samples
+ */
+void wfdb_record_read(
+		WfdbRecord *self,
+		gint signal,
+		glong start,
+		gint count,
+		gint *samples);
+
+/**
+ * @brief Get the length of a record resampled to another rate
+ *
+ * @param self Pointer to #WfdbRecord
+ * @param rate The other sample rate in Hz
+ *
+ * @return Amount of samples at the other rate
+ */
+glong wfdb_record_get_resampled_length(WfdbRecord *self, gint rate);
+
+/**
+ * @brief Read samples of one signal, scaled and resampled
+ *
+ * The baseline is subtracted, the samples are scaled to the given gain, and
+ * resampled to the given rate by linear interpolation. Sample i is at
+ * (start + i) * sample_rate / rate in the record, so reading a part of the
+ * record gives the same samples as reading all of it. Like
+ * wfdb_record_read(), this can be called from several threads at the same
+ * time.
+ *
+ * @param self Pointer to #WfdbRecord
+ * @param signal Index of the signal
+ * @param rate Sample rate to resample to, in Hz
+ * @param gain Units per millivolt to scale to
+ * @param start Index of the first sample to read, at the given rate
+ * @param count Amount of samples to read
+ * @param samples Storage for the samples
+ */
+void wfdb_record_read_resampled(
+		WfdbRecord *self,
+		gint signal,
+		gint rate,
+		gdouble gain,
+		glong start,
+		gint count,
+		gint *samples);
+
+#endif /* _WFDB_RECORD_H */